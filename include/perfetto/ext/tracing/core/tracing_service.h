@@ -259,7 +259,17 @@ struct PERFETTO_EXPORT_COMPONENT TracingServiceInitOpts {
   // a vector of TracePackets and replaces the packets in the vector with
   // compressed ones.
   using CompressorFn = void (*)(std::vector<TracePacket>*);
+
+  // Used for TraceConfig::COMPRESSION_TYPE_DEFLATE.
   CompressorFn compressor_fn = nullptr;
+
+  // Used for TraceConfig::COMPRESSION_TYPE_ZSTD.
+  CompressorFn zstd_compressor_fn = nullptr;
+
+  // If true, the sessions with TraceConfig.write_into_file write into the file
+  // from a dedicated thread, so that a slow output file doesn't stall the
+  // service. Requires thread support.
+  bool async_write_into_file = false;
 };
 
 // The public API of the tracing Service business logic.
@@ -148,6 +148,34 @@ struct PERFETTO_EXPORT_COMPONENT Config {
   // The flag has no impact on non-proto traces.
   bool analyze_trace_proto_content = false;
 
+  // When non-zero, trace processor spins up a pool of this many worker threads
+  // and uses it to run the stateless parts of ingestion (currently: inflating
+  // |compressed_packets| in proto traces) concurrently with the parsing of the
+  // rest of the trace. All state-mutating parsing still happens on the thread
+  // calling Parse(), in trace order.
+  //
+  // Ignored on platforms without thread support (e.g. WASM).
+  uint32_t ingestion_worker_threads = 0;
+
+  // When set to true, once the trace is fully loaded, the integer columns of
+  // the largest tables (e.g. timestamps and ids) are compressed (see
+  // CompressedVector) if this saves a significant amount of memory. This
+  // reduces the memory used by a loaded trace at the cost of slightly slower
+  // queries on the compressed columns. It does not reduce the peak memory
+  // usage while the trace is being loaded.
+  bool compress_tables = false;
+
+  // When non-zero, once the events buffered for sorting use more than this
+  // many bytes of memory, further events are buffered in an unlinked
+  // temporary file in $TMPDIR instead. The file is memory mapped, so the
+  // kernel can evict the buffered events under memory pressure and read them
+  // back in when they are merged into timestamp order. This allows sorting
+  // traces whose events do not fit in RAM, at the cost of disk I/O.
+  //
+  // Ignored on platforms without support for memory mapped files (e.g. WASM
+  // and Windows).
+  uint64_t sorting_spill_threshold_bytes = 0;
+
   // When set to true, trace processor will be augmented with a bunch of helpful
   // features for local development such as extra SQL fuctions.
   //
@@ -110,6 +110,19 @@ class PERFETTO_EXPORT_COMPONENT TraceProcessor : public TraceProcessorStorage {
   // by the ingestion process. Returns the number of table/views deleted.
   virtual size_t RestoreInitialTables() = 0;
 
+  // Creates a new query session on the fully loaded trace. A session is a
+  // TraceProcessor with its own SQLite connection which shares the (immutable)
+  // trace storage of this instance: tables, views and functions created in a
+  // session are only visible to that session. Different sessions can execute
+  // queries in parallel on different threads.
+  //
+  // Can only be called after NotifyEndOfFile(); returns nullptr otherwise.
+  // Sessions cannot parse data and must be destroyed before this instance.
+  // While sessions are executing queries, queries should not be executed on
+  // this instance and metatracing should not be enabled. The experimental
+  // flamegraph table function is not available in sessions.
+  virtual std::unique_ptr<TraceProcessor> CreateQuerySession() = 0;
+
   // Sets/returns the name of the currently loaded trace or an empty string if
   // no trace is fully loaded yet. This has no effect on the Trace Processor
   // functionality and is used for UI purposes only.
@@ -127,6 +127,13 @@ class ColumnSerializer:
       return None
     return f'    {self.name}_.ShrinkToFit();'
 
+  def compress(self) -> Optional[str]:
+    if self.is_implicit_id:
+      return None
+    if self.is_ancestor:
+      return None
+    return f'    {self.name}_.Compress();'
+
   def append(self) -> Optional[str]:
     if self.is_implicit_id or self.is_implicit_type:
       return None
@@ -187,7 +194,8 @@ class ColumnSerializer:
         "{self.name}", ColumnType::{self.name}::SqlValueType(), false,
         {str(ColumnFlag.SORTED in self.flags).lower()},
         {str(ColumnFlag.HIDDEN in self.flags).lower()},
-        {str(ColumnFlag.SET_ID in self.flags).lower()}}});
+        {str(ColumnFlag.SET_ID in self.flags).lower()},
+        false}});
     '''
 
   def row_eq(self) -> Optional[str]:
@@ -534,9 +542,9 @@ class {self.table_name} : public macros_internal::MacroTable {{
   static Table::Schema ComputeStaticSchema() {{
     Table::Schema schema;
     schema.columns.emplace_back(Table::Schema::Column{{
-        "id", SqlValue::Type::kLong, true, true, false, false}});
+        "id", SqlValue::Type::kLong, true, true, false, false, false}});
     schema.columns.emplace_back(Table::Schema::Column{{
-        "type", SqlValue::Type::kString, false, false, false, false}});
+        "type", SqlValue::Type::kString, false, false, false, false, false}});
     {self.foreach_col(ColumnSerializer.static_schema)}
     return schema;
   }}
@@ -563,6 +571,10 @@ class {self.table_name} : public macros_internal::MacroTable {{
     {self.foreach_col(ColumnSerializer.shrink_to_fit)}
   }}
 
+  void Compress() {{
+    {self.foreach_col(ColumnSerializer.compress)}
+  }}
+
   std::optional<ConstRowReference> FindById(Id find_id) const {{
     std::optional<uint32_t> row = id().IndexOf(find_id);
     return row ? std::make_optional(ConstRowReference(this, *row))
@@ -211,6 +211,180 @@ class TraceProcessor:
       self.__current_index += 1
       return result
 
+  # This is the class returned by query_columnar(). Unlike
+  # QueryResultIterator, the results are decoded column by column into numpy
+  # arrays, without creating a Python object for each cell. This makes it
+  # suitable for pulling large results into numpy/pandas.
+  class ColumnarQueryResult:
+
+    def __init__(self, column_names, batches):
+      try:
+        import numpy as np
+      except ModuleNotFoundError:
+        raise TraceProcessorException(
+            'Python dependencies missing. Please pip3 install numpy')
+
+      self.__column_names = list(column_names)
+      self.__count = 0
+      self.__current_index = 0
+      self.__rows = None
+
+      # For each column, the (type, values, null mask) of each batch.
+      col_batches = [[] for _ in self.__column_names]
+      batch_index = 0
+      while True:
+        batch = batches[batch_index]
+        if len(batch.columns) != len(self.__column_names):
+          raise TraceProcessorException(
+              "Column count " + str(len(batch.columns)) +
+              " does not match the number of column names " +
+              str(len(self.__column_names)))
+
+        for i, column in enumerate(batch.columns):
+          col_batches[i].append(
+              self.__decode_column(
+                  np, column, batch.row_count))
+        self.__count += batch.row_count
+
+        if batch.is_last_batch:
+          break
+        batch_index += 1
+
+      self.__columns = [
+          self.__merge_batches(np, b)
+          for b in col_batches
+      ]
+
+    @staticmethod
+    def __decode_column(np, column, row_count):
+      if column.null_bitmap:
+        mask = np.unpackbits(
+            np.frombuffer(column.null_bitmap, dtype=np.uint8),
+            count=row_count,
+            bitorder='little').astype(bool)
+      else:
+        mask = np.zeros(row_count, dtype=bool)
+
+      col_type = column.type
+      if col_type == TraceProcessor.QUERY_CELL_VARINT_FIELD_ID:
+        values = np.frombuffer(column.int64_values, dtype='<i8')
+      elif col_type == TraceProcessor.QUERY_CELL_FLOAT64_FIELD_ID:
+        values = np.frombuffer(column.float64_values, dtype='<f8')
+      elif col_type == TraceProcessor.QUERY_CELL_STRING_FIELD_ID:
+        # See QueryResultIterator for why the strings might need decoding.
+        dictionary_str = column.string_dictionary
+        try:
+          dictionary_str = dictionary_str.decode('utf-8', 'ignore')
+        except AttributeError:
+          pass
+        dictionary = np.array(dictionary_str.split('\0')[:-1], dtype=object)
+        indexes = np.frombuffer(column.string_indexes, dtype='<u4')
+        values = dictionary[indexes] if len(dictionary) else np.full(
+            row_count, None, dtype=object)
+        values[mask] = None
+      elif col_type == TraceProcessor.QUERY_CELL_BLOB_FIELD_ID:
+        values = np.full(row_count, None, dtype=object)
+        blobs = np.empty(len(column.blob_values), dtype=object)
+        blobs[:] = list(column.blob_values)
+        values[~mask] = blobs
+      elif col_type == TraceProcessor.QUERY_CELL_NULL_FIELD_ID:
+        values = None
+        mask = np.ones(row_count, dtype=bool)
+      else:
+        raise TraceProcessorException('Invalid column type')
+
+      if values is not None and len(values) != row_count:
+        raise TraceProcessorException("Value count " + str(len(values)) +
+                                      " does not match row count " +
+                                      str(row_count))
+      return col_type, values, mask
+
+    @staticmethod
+    def __merge_batches(np, col_batches):
+      # The type of a column can change between batches: use the same rules
+      # as the serializer to pick a common one.
+      types = {t for t, _, _ in col_batches}
+      types.discard(TraceProcessor.QUERY_CELL_NULL_FIELD_ID)
+      if types == {TraceProcessor.QUERY_CELL_VARINT_FIELD_ID}:
+        dtype = np.int64
+      elif types and types <= {
+          TraceProcessor.QUERY_CELL_VARINT_FIELD_ID,
+          TraceProcessor.QUERY_CELL_FLOAT64_FIELD_ID
+      }:
+        dtype = np.float64
+      else:
+        dtype = object
+
+      values = []
+      for _, batch_values, mask in col_batches:
+        if batch_values is None:
+          batch_values = np.zeros(len(mask), dtype=dtype)
+          if dtype == object:
+            batch_values[:] = None
+        values.append(batch_values.astype(dtype, copy=False))
+      if not values:
+        return np.zeros(0, dtype=dtype), np.zeros(0, dtype=bool)
+      return (np.concatenate(values),
+              np.concatenate([mask for _, _, mask in col_batches]))
+
+    # Returns a dictionary from column name to a numpy masked array with the
+    # values of the column. The mask is set for NULL values.
+    def as_numpy_dict(self):
+      import numpy as np
+      return {
+          name: np.ma.MaskedArray(values, mask=mask)
+          for name, (values, mask) in zip(self.__column_names, self.__columns)
+      }
+
+    # Returns the results as a pandas dataframe. Integer columns containing
+    # NULLs use the nullable Int64 type, double columns use NaN for NULLs and
+    # all other columns use None.
+    def as_pandas_dataframe(self):
+      try:
+        import numpy as np
+        import pandas as pd
+      except ModuleNotFoundError:
+        raise TraceProcessorException(
+            'Python dependencies missing. Please pip3 install pandas numpy')
+
+      data = {}
+      for name, (values, mask) in zip(self.__column_names, self.__columns):
+        if mask.any() and values.dtype == np.int64:
+          values = pd.arrays.IntegerArray(values, mask)
+        elif mask.any() and values.dtype == np.float64:
+          values = np.where(mask, np.nan, values)
+        elif values.dtype == object:
+          # Stop pandas from inferring a type which would turn None into NaN.
+          values = pd.Series(values, dtype=object)
+        data[name] = values
+      return pd.DataFrame(data, columns=self.__column_names)
+
+    def __len__(self):
+      return self.__count
+
+    def __iter__(self):
+      return self
+
+    def __next__(self):
+      if self.__current_index == self.__count:
+        raise StopIteration
+
+      # Converting the columns to lists creates the Python objects for all the
+      # cells: only do this if the rows are actually iterated.
+      if self.__rows is None:
+        self.__rows = []
+        for values, mask in self.__columns:
+          col = values.tolist()
+          for i in mask.nonzero()[0]:
+            col[i] = None
+          self.__rows.append(col)
+
+      result = TraceProcessor.Row()
+      for num, column_name in enumerate(self.__column_names):
+        setattr(result, column_name, self.__rows[num][self.__current_index])
+      self.__current_index += 1
+      return result
+
   def __init__(self,
                trace: Optional[TraceReference] = None,
                addr: Optional[str] = None,
@@ -286,6 +460,33 @@ class TraceProcessor:
     return TraceProcessor.QueryResultIterator(response.column_names,
                                               response.batch)
 
+  def query_columnar(self, sql: str):
+    """Executes passed in SQL query using class defined HTTP API, and returns
+    the response as a ColumnarQueryResult. Raises TraceProcessorException if
+    the response returns with an error.
+
+    This is more efficient than query() when fetching a large number of rows
+    into numpy or pandas: the results are transferred and decoded column by
+    column instead of cell by cell. Requires numpy.
+
+    Args:
+      sql: SQL query written as a String
+
+    Returns:
+      A class which can be converted to a pandas dataframe by calling
+      as_pandas_dataframe() or to numpy arrays by calling as_numpy_dict().
+      The rows can also be iterated as with query().
+    """
+    response = self.http.execute_query(sql, columnar=True)
+    if response.error:
+      raise TraceProcessorException(response.error)
+    if not response.columnar_batch:
+      raise TraceProcessorException(
+          'trace_processor does not support columnar query results')
+
+    return TraceProcessor.ColumnarQueryResult(response.column_names,
+                                              response.columnar_batch)
+
   def metric(self, metrics: List[str]):
     """Returns the metrics data corresponding to the passed in trace metric.
     Raises TraceProcessorException if the response returns with an error.
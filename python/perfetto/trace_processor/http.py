@@ -25,9 +25,11 @@ class TraceProcessorHttp:
     self.protos = protos
     self.conn = http.client.HTTPConnection(url)
 
-  def execute_query(self, query: str):
+  def execute_query(self, query: str, columnar: bool = False):
     args = self.protos.QueryArgs()
     args.sql_query = query
+    if columnar:
+      args.result_format = self.protos.QueryArgs.RESULT_FORMAT_COLUMNAR
     byte_data = args.SerializeToString()
     self.conn.request('POST', '/query', body=byte_data)
     with self.conn.getresponse() as f:
@@ -12,6 +12,7 @@
 # See the License for the specific language governing permissions and
 # limitations under the License.
 
+import struct
 import unittest
 
 from perfetto.trace_processor.api import TraceProcessor
@@ -346,3 +347,113 @@ class TestQueryResultIterator(unittest.TestCase):
     # so we should raise a TraceProcessorException.
     with self.assertRaises(TraceProcessorException):
       _ = qr_iterator.as_pandas_dataframe()
+
+
+class TestColumnarQueryResult(unittest.TestCase):
+  CELL_NULL = PROTO_FACTORY.CellsBatch().CELL_NULL
+  CELL_VARINT = PROTO_FACTORY.CellsBatch().CELL_VARINT
+  CELL_FLOAT64 = PROTO_FACTORY.CellsBatch().CELL_FLOAT64
+  CELL_STRING = PROTO_FACTORY.CellsBatch().CELL_STRING
+  CELL_BLOB = PROTO_FACTORY.CellsBatch().CELL_BLOB
+
+  def make_batch(self, row_count, columns, is_last_batch=True):
+    batch = PROTO_FACTORY.ColumnarBatch()
+    batch.row_count = row_count
+    batch.is_last_batch = is_last_batch
+    for col_type, values, nulls in columns:
+      col = batch.columns.add()
+      col.type = col_type
+      if nulls:
+        bitmap = bytearray((row_count + 7) // 8)
+        for row in nulls:
+          bitmap[row // 8] |= 1 << (row % 8)
+        col.null_bitmap = bytes(bitmap)
+      if col_type == TestColumnarQueryResult.CELL_VARINT:
+        col.int64_values = struct.pack('<%dq' % len(values), *values)
+      elif col_type == TestColumnarQueryResult.CELL_FLOAT64:
+        col.float64_values = struct.pack('<%dd' % len(values), *values)
+      elif col_type == TestColumnarQueryResult.CELL_STRING:
+        dictionary = sorted(set(values))
+        col.string_dictionary = ''.join(s + '\0' for s in dictionary)
+        indexes = [dictionary.index(v) for v in values]
+        col.string_indexes = struct.pack('<%dI' % len(indexes), *indexes)
+      elif col_type == TestColumnarQueryResult.CELL_BLOB:
+        col.blob_values.extend(values)
+    return batch
+
+  def test_one_batch(self):
+    batch = self.make_batch(3, [
+        (TestColumnarQueryResult.CELL_STRING, ['b', 'a', 'b'], []),
+        (TestColumnarQueryResult.CELL_VARINT, [100, 0, 300], [1]),
+        (TestColumnarQueryResult.CELL_FLOAT64, [0.5, 1.5, 0], [2]),
+        (TestColumnarQueryResult.CELL_BLOB, [b'x'], [0, 2]),
+        (TestColumnarQueryResult.CELL_NULL, [], [0, 1, 2]),
+    ])
+    result = TraceProcessor.ColumnarQueryResult(
+        ['str', 'num', 'dbl', 'blb', 'nul'], [batch])
+    self.assertEqual(len(result), 3)
+
+    rows = [(r.str, r.num, r.dbl, r.blb, r.nul) for r in result]
+    self.assertEqual(rows, [
+        ('b', 100, 0.5, None, None),
+        ('a', None, 1.5, b'x', None),
+        ('b', 300, None, None, None),
+    ])
+
+    arrays = result.as_numpy_dict()
+    self.assertEqual(arrays['num'].dtype, 'int64')
+    self.assertEqual(arrays['num'].mask.tolist(), [False, True, False])
+    self.assertEqual(arrays['dbl'].dtype, 'float64')
+
+  def test_many_batches(self):
+    batch_1 = self.make_batch(
+        2, [
+            (TestColumnarQueryResult.CELL_VARINT, [1, 2], []),
+            (TestColumnarQueryResult.CELL_NULL, [], [0, 1]),
+        ],
+        is_last_batch=False)
+    batch_2 = self.make_batch(1, [
+        (TestColumnarQueryResult.CELL_FLOAT64, [3.5], []),
+        (TestColumnarQueryResult.CELL_VARINT, [7], []),
+    ])
+    result = TraceProcessor.ColumnarQueryResult(['a', 'b'], [batch_1, batch_2])
+    self.assertEqual(len(result), 3)
+
+    # Integers mixed with doubles across batches become doubles.
+    arrays = result.as_numpy_dict()
+    self.assertEqual(arrays['a'].dtype, 'float64')
+    self.assertEqual(arrays['a'].tolist(), [1.0, 2.0, 3.5])
+    self.assertEqual(arrays['b'].dtype, 'int64')
+    self.assertEqual(arrays['b'].tolist(), [None, None, 7])
+
+  def test_as_pandas(self):
+    batch = self.make_batch(3, [
+        (TestColumnarQueryResult.CELL_STRING, ['x', 'y', 'x'], [1]),
+        (TestColumnarQueryResult.CELL_VARINT, [1, 0, 3], [1]),
+        (TestColumnarQueryResult.CELL_VARINT, [4, 5, 6], []),
+        (TestColumnarQueryResult.CELL_FLOAT64, [0, 2.5, 0], [0, 2]),
+    ])
+    result = TraceProcessor.ColumnarQueryResult(['s', 'n', 'i', 'd'], [batch])
+    df = result.as_pandas_dataframe()
+
+    self.assertEqual(list(df.columns), ['s', 'n', 'i', 'd'])
+    self.assertEqual(df['s'].tolist(), ['x', None, 'x'])
+    self.assertEqual(str(df['n'].dtype), 'Int64')
+    self.assertEqual(df['n'].isna().tolist(), [False, True, False])
+    self.assertEqual(df['i'].dtype, 'int64')
+    self.assertEqual(df['i'].tolist(), [4, 5, 6])
+    self.assertEqual(df['d'].isna().tolist(), [True, False, True])
+    self.assertEqual(df['d'][1], 2.5)
+
+  def test_empty_batch(self):
+    batch = self.make_batch(0, [(TestColumnarQueryResult.CELL_NULL, [], [])])
+    result = TraceProcessor.ColumnarQueryResult(['a'], [batch])
+    self.assertEqual(len(result), 0)
+    self.assertEqual(len(result.as_pandas_dataframe()), 0)
+    self.assertEqual(list(result), [])
+
+  def test_column_count_mismatch(self):
+    batch = self.make_batch(1, [(TestColumnarQueryResult.CELL_VARINT, [1],
+                                 [])])
+    with self.assertRaises(TraceProcessorException):
+      TraceProcessor.ColumnarQueryResult(['a', 'b'], [batch])
@@ -191,6 +191,33 @@ TYPED_TEST(FlatHashMapTest, FillWithTombstones) {
   }
 }
 
+// Inserting and erasing distinct keys must not fill up the table with
+// tombstones (which would make probing scan the whole table), nor make it
+// grow beyond what the live entries need.
+TYPED_TEST(FlatHashMapTest, ChurnDoesNotAccumulateTombstones) {
+  struct TestMap
+      : public FlatHashMap<size_t, size_t, Hash<size_t>,
+                           typename TestFixture::Probe> {
+    size_t max_probe_length() const { return this->max_probe_length_; }
+  };
+  TestMap fmap;
+  const size_t kLive = 300;  // Less than half of the initial load limit.
+  for (size_t i = 0; i < kLive; i++)
+    ASSERT_TRUE(fmap.Insert(i, i).second);
+  const size_t capacity = fmap.capacity();
+
+  const size_t kEnd = 100 * capacity;
+  for (size_t i = kLive; i < kEnd; i++) {
+    ASSERT_TRUE(fmap.Erase(i - kLive));
+    ASSERT_TRUE(fmap.Insert(i, i).second);
+    ASSERT_EQ(fmap.size(), kLive);
+  }
+  EXPECT_EQ(fmap.capacity(), capacity);
+  EXPECT_LT(fmap.max_probe_length(), capacity / 4);
+  for (size_t i = kEnd - kLive; i < kEnd; i++)
+    ASSERT_EQ(*fmap.Find(i), i);
+}
+
 TYPED_TEST(FlatHashMapTest, Collisions) {
   FlatHashMap<int, int, CollidingHasher, typename TestFixture::Probe> fmap(
       /*initial_capacity=*/0, /*load_limit_pct=*/100);
@@ -18,8 +18,7 @@
 #define SRC_KALLSYMS_LAZY_KERNEL_SYMBOLIZER_H_
 
 #include <memory>
-
-#include "perfetto/ext/base/thread_checker.h"
+#include <mutex>
 
 namespace perfetto {
 
@@ -31,11 +30,15 @@ class KernelSymbolMap;
 // 2. Allows to share the same KernelSymbolMap instance across several clients
 //    and tear it down when tracing stops.
 //
-// LazyKernelSymbolizer is owned by the (one) FtraceController. FtraceController
-// handles LazyKernelSymbolizer pointers to  N CpuReader-s (one per CPU). In
-// this way all CpuReader instances can share the same symbol map instance.
+// LazyKernelSymbolizer is owned by the (one) FtraceController, shared with its
+// reader threads. FtraceController handles LazyKernelSymbolizer pointers to
+// N CpuReader-s (one per CPU). In this way all CpuReader instances can share
+// the same symbol map instance.
 // The object being shared is LazyKernelSymbolizer, which is cheap and always
 // valid. LazyKernelSymbolizer may or may not contain a valid symbol map.
+//
+// Thread safe, as the CpuReader-s can run on several reader threads. The
+// returned KernelSymbolMap must not be used after Destroy().
 class LazyKernelSymbolizer {
  public:
   // Constructs an empty instance. Does NOT load any symbols upon construction.
@@ -46,7 +49,10 @@ class LazyKernelSymbolizer {
   // Returns |instance_|, creating it if doesn't exist or was destroyed.
   KernelSymbolMap* GetOrCreateKernelSymbolMap();
 
-  bool is_valid() const { return !!symbol_map_; }
+  bool is_valid() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return !!symbol_map_;
+  }
 
   // Destroys the |symbol_map_| freeing up memory. A further call to
   // GetOrCreateKernelSymbolMap() will create it again.
@@ -57,8 +63,8 @@ class LazyKernelSymbolizer {
       const char* ksyms_path_for_testing = nullptr);
 
  private:
+  std::mutex mutex_;
   std::unique_ptr<KernelSymbolMap> symbol_map_;
-  PERFETTO_THREAD_CHECKER(thread_checker_)
 };
 
 }  // namespace perfetto
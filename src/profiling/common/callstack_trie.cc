@@ -28,10 +28,64 @@ namespace profiling {
 GlobalCallstackTrie::Node* GlobalCallstackTrie::GetOrCreateChild(
     Node* self,
     const Interned<Frame>& loc) {
-  Node* child = self->GetChild(loc);
-  if (!child)
-    child = self->AddChild(loc, ++next_callstack_id_, self);
-  return child;
+  if (self->last_child_ && self->last_child_->location_ == loc)
+    return self->last_child_;
+
+  Node** child = children_.FindOrPrepareInsert(self, loc);
+  if (*child) {
+    self->last_child_ = *child;
+    return *child;
+  }
+
+  void* storage;
+  if (!free_nodes_.empty()) {
+    storage = free_nodes_.back();
+    free_nodes_.pop_back();
+  } else {
+    if (nodes_used_in_last_block_ == kNodesPerBlock) {
+      node_blocks_.emplace_back(new NodeBlock);
+      nodes_used_in_last_block_ = 0;
+    }
+    storage = &node_blocks_.back()->storage[sizeof(Node) *
+                                            nodes_used_in_last_block_++];
+  }
+  Node* node = new (storage) Node(loc, ++next_callstack_id_, self);
+  children_.Insert(child, node);
+  self->num_children_++;
+  self->last_child_ = node;
+  return node;
+}
+
+void GlobalCallstackTrie::DeleteNode(Node* node) {
+  if (PERFETTO_UNLIKELY(node->num_children_ > 0)) {
+    // Only nodes that were created but never refcounted can be left below a
+    // node that is being deleted. This doesn't happen with consistent use of
+    // IncrementNode/DecrementNode, so it's fine to scan the whole trie.
+    std::vector<Node*> children;
+    children_.ForEach([node, &children](Node* child) {
+      if (child->parent_ == node)
+        children.push_back(child);
+    });
+    for (Node* child : children)
+      DeleteNode(child);
+  }
+  PERFETTO_DCHECK(node->num_children_ == 0);
+  children_.Erase(node);
+  node->parent_->num_children_--;
+  if (node->parent_->last_child_ == node)
+    node->parent_->last_child_ = nullptr;
+  node->~Node();
+  free_nodes_.push_back(node);
+}
+
+void GlobalCallstackTrie::DeleteAllNodes() {
+  children_.ForEach([](Node* node) { node->~Node(); });
+  children_.Clear();
+  node_blocks_.clear();
+  nodes_used_in_last_block_ = kNodesPerBlock;
+  free_nodes_.clear();
+  root_.num_children_ = 0;
+  root_.last_child_ = nullptr;
 }
 
 std::vector<Interned<Frame>> GlobalCallstackTrie::BuildInverseCallstack(
@@ -84,15 +138,30 @@ void GlobalCallstackTrie::IncrementNode(Node* node) {
 void GlobalCallstackTrie::DecrementNode(Node* node) {
   PERFETTO_DCHECK(node->ref_count_ >= 1);
 
-  bool delete_prev = false;
-  Node* prev = nullptr;
-  while (node != nullptr) {
-    if (delete_prev)
-      node->RemoveChild(prev);
+  // A node is never referenced more than its parent, so the nodes whose
+  // refcount drops to zero are |node| and a chain of its ancestors. Those can
+  // only be deleted once the root (and, with it, the trie) is found.
+  Node* const first = node;
+  Node* last_to_delete = nullptr;
+  Node* root = nullptr;
+  for (; node != nullptr; node = node->parent_) {
     node->ref_count_ -= 1;
-    delete_prev = node->ref_count_ == 0;
-    prev = node;
-    node = node->parent_;
+    if (node->ref_count_ == 0 && node->parent_)
+      last_to_delete = node;
+    root = node;
+  }
+  if (!last_to_delete)
+    return;
+  PERFETTO_DCHECK(first->ref_count_ == 0);
+
+  GlobalCallstackTrie* trie = static_cast<RootNode*>(root)->trie_;
+  for (node = first;;) {
+    Node* parent = node->parent_;
+    const bool last = node == last_to_delete;
+    trie->DeleteNode(node);
+    if (last)
+      break;
+    node = parent;
   }
 }
 
@@ -117,6 +186,56 @@ Interned<Frame> GlobalCallstackTrie::InternCodeLocation(
   return frame_interner_.Intern(frame);
 }
 
+GlobalCallstackTrie::Node**
+GlobalCallstackTrie::ChildTable::FindOrPrepareInsert(
+    const Node* parent,
+    const Interned<Frame>& loc) {
+  // Keep the load below 75%, so that probe sequences stay short.
+  if (PERFETTO_UNLIKELY((size_ + 1) * 4 > slots_.size() * 3)) {
+    std::vector<Node*> old_slots(slots_.size() * 2, nullptr);
+    old_slots.swap(slots_);
+    for (Node* node : old_slots) {
+      if (!node)
+        continue;
+      size_t idx = HomeSlot(node);
+      while (slots_[idx])
+        idx = (idx + 1) & (slots_.size() - 1);
+      slots_[idx] = node;
+    }
+  }
+
+  const size_t mask = slots_.size() - 1;
+  for (size_t idx = Hash(parent, loc) & mask;; idx = (idx + 1) & mask) {
+    Node* node = slots_[idx];
+    if (!node || (node->parent_ == parent && node->location_ == loc))
+      return &slots_[idx];
+  }
+}
+
+void GlobalCallstackTrie::ChildTable::Erase(const Node* node) {
+  const size_t mask = slots_.size() - 1;
+  size_t idx = HomeSlot(node);
+  while (slots_[idx] != node) {
+    PERFETTO_DCHECK(slots_[idx]);
+    idx = (idx + 1) & mask;
+  }
+
+  // Move back any later entry of the probe sequence that wouldn't be
+  // reachable anymore once the slot is emptied.
+  for (size_t next = (idx + 1) & mask; slots_[next]; next = (next + 1) & mask) {
+    const size_t home = HomeSlot(slots_[next]);
+    // Whether |home| is cyclically outside of (idx, next].
+    const bool movable = idx <= next ? (home <= idx || home > next)
+                                     : (home <= idx && home > next);
+    if (movable) {
+      slots_[idx] = slots_[next];
+      idx = next;
+    }
+  }
+  slots_[idx] = nullptr;
+  size_--;
+}
+
 Interned<Frame> GlobalCallstackTrie::MakeRootFrame() {
   Mapping map(string_interner_.Intern(""));
 
@@ -126,30 +245,5 @@ Interned<Frame> GlobalCallstackTrie::MakeRootFrame() {
   return frame_interner_.Intern(frame);
 }
 
-GlobalCallstackTrie::Node* GlobalCallstackTrie::Node::AddChild(
-    const Interned<Frame>& loc,
-    uint64_t callstack_id,
-    Node* parent) {
-  auto it = children_.emplace(loc, callstack_id, parent);
-  return const_cast<Node*>(&(*it.first));
-}
-void GlobalCallstackTrie::Node::RemoveChild(Node* node) {
-  children_.erase(*node);
-}
-
-GlobalCallstackTrie::Node* GlobalCallstackTrie::Node::GetChild(
-    const Interned<Frame>& loc) {
-  // This will be nicer with C++14 transparent comparators.
-  // Then we will be able to look up by just the key using a sutiable
-  // comparator.
-  //
-  // For now we need to allow to construct Node from the key.
-  Node node(loc);
-  auto it = children_.find(node);
-  if (it == children_.end())
-    return nullptr;
-  return const_cast<Node*>(&(*it));
-}
-
 }  // namespace profiling
 }  // namespace perfetto
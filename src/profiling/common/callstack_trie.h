@@ -17,7 +17,9 @@
 #ifndef SRC_PROFILING_COMMON_CALLSTACK_TRIE_H_
 #define SRC_PROFILING_COMMON_CALLSTACK_TRIE_H_
 
-#include <set>
+#include <stdint.h>
+
+#include <memory>
 #include <string>
 #include <typeindex>
 #include <vector>
@@ -77,10 +79,9 @@ struct Frame {
 
 // Graph of function callsites. A single instance can be used for callsites from
 // different processes. Each call site is represented by a
-// GlobalCallstackTrie::Node that is owned by the parent callsite. Each node has
-// a pointer to its parent, which means the function call-graph can be
-// reconstructed from a GlobalCallstackTrie::Node by walking down the parent
-// chain.
+// GlobalCallstackTrie::Node that is owned by the trie. Each node has a pointer
+// to its parent, which means the function call-graph can be reconstructed from
+// a GlobalCallstackTrie::Node by walking down the parent chain.
 //
 // For the following two callstacks:
 //  * libc_init -> main -> foo -> alloc_buf
@@ -95,6 +96,12 @@ struct Frame {
 //                   libc_init
 //                       |
 //                    [root_]
+//
+// With millions of callsites, the trie is dominated by the cost of looking up
+// children and of allocating nodes. Rather than each node owning an ordered set
+// of children, nodes are allocated from blocks owned by the trie, and the
+// children of all the nodes are kept in a single hash table, keyed by the
+// (parent node id, frame id) pair.
 class GlobalCallstackTrie {
  public:
   // Optionally, Nodes can be externally refcounted via |IncrementNode| and
@@ -105,47 +112,32 @@ class GlobalCallstackTrie {
     // This is opaque except to GlobalCallstackTrie.
     friend class GlobalCallstackTrie;
 
-    // Allow building a node out of a frame for GetChild.
-    explicit Node(Interned<Frame> frame) : Node(frame, 0, nullptr) {}
-    Node(const Node&) = default;
-    Node(Node&&) = default;
-
-    Node(Interned<Frame> frame, uint64_t id)
-        : Node(std::move(frame), id, nullptr) {}
-    Node(Interned<Frame> frame, uint64_t id, Node* parent)
-        : id_(id), parent_(parent), location_(frame) {}
+    Node(const Node&) = delete;
+    Node& operator=(const Node&) = delete;
 
     ~Node() { PERFETTO_DCHECK(!ref_count_); }
 
     uint64_t id() const { return id_; }
 
    private:
-    Node* GetOrCreateChild(const Interned<Frame>& loc);
-    // Deletes all descendant nodes, regardless of |ref_count_|.
-    void DeleteChildren() { children_.clear(); }
+    Node(Interned<Frame> frame, uint64_t id, Node* parent)
+        : id_(id), parent_(parent), location_(std::move(frame)) {}
 
-    uint64_t ref_count_ = 0;
-    uint64_t id_;
+    uint32_t ref_count_ = 0;
+    uint32_t num_children_ = 0;
+    // Never reused, not even across ClearTrie().
+    const uint64_t id_;
     Node* const parent_;
     const Interned<Frame> location_;
 
-    class NodeComparator {
-     public:
-      bool operator()(const Node& one, const Node& other) const {
-        return one.location_ < other.location_;
-      }
-    };
-    Node* AddChild(const Interned<Frame>& loc,
-                   uint64_t next_callstack_id_,
-                   Node* parent);
-    void RemoveChild(Node* node);
-    Node* GetChild(const Interned<Frame>& loc);
-
-    std::set<Node, NodeComparator> children_;
+    // The child returned by the last lookup. Most nodes have a single child,
+    // and the rest tend to be looked up repeatedly with the same callstack,
+    // so this avoids most of the lookups in |children_|.
+    Node* last_child_ = nullptr;
   };
 
   GlobalCallstackTrie() = default;
-  ~GlobalCallstackTrie() = default;
+  ~GlobalCallstackTrie() { DeleteAllNodes(); }
   GlobalCallstackTrie(const GlobalCallstackTrie&) = delete;
   GlobalCallstackTrie& operator=(const GlobalCallstackTrie&) = delete;
 
@@ -170,12 +162,94 @@ class GlobalCallstackTrie {
   // of nodes (Node.ref_count_).
   void ClearTrie() {
     PERFETTO_DLOG("Clearing trie");
-    root_.DeleteChildren();
+    DeleteAllNodes();
   }
 
+  size_t node_count_for_testing() const { return children_.size() + 1; }
+
  private:
+  // The root knows its trie, so that DecrementNode (which is static) can find
+  // where to return the nodes it deletes.
+  class RootNode : public Node {
+   public:
+    RootNode(Interned<Frame> frame, uint64_t id, GlobalCallstackTrie* trie)
+        : Node(std::move(frame), id, nullptr), trie_(trie) {}
+
+    GlobalCallstackTrie* const trie_;
+  };
+
+  // Nodes are allocated in blocks of this many nodes. Deleted nodes are reused
+  // by later allocations.
+  static constexpr size_t kNodesPerBlock = 4096;
+  struct NodeBlock {
+    alignas(Node) unsigned char storage[sizeof(Node) * kNodesPerBlock];
+  };
+
+  // Hash set of all the nodes except root_, looked up by (parent, frame).
+  // The slots only hold node pointers, and the key is read from the node
+  // itself: a lookup touches a slot and the node it returns, which the caller
+  // needs anyway. Uses linear probing with backward shift deletion, so that
+  // erasing doesn't leave tombstones behind.
+  class ChildTable {
+   public:
+    ChildTable() { Reset(kInitialCapacity); }
+
+    // Returns the slot holding the child of |parent| for |loc|, or the empty
+    // slot where it should be inserted. Grows the table if needed, so that
+    // the returned slot can be filled.
+    Node** FindOrPrepareInsert(const Node* parent, const Interned<Frame>& loc);
+    void Insert(Node** slot, Node* node) {
+      *slot = node;
+      size_++;
+    }
+    void Erase(const Node* node);
+    void Clear() { Reset(kInitialCapacity); }
+
+    template <typename F>
+    void ForEach(F fn) const {
+      for (Node* node : slots_) {
+        if (node)
+          fn(node);
+      }
+    }
+
+    size_t size() const { return size_; }
+
+   private:
+    static constexpr size_t kInitialCapacity = 1024;
+
+    static size_t Hash(const Node* parent, const Interned<Frame>& loc) {
+      // Both ids are sequential integers: mix them so that they spread over
+      // the whole table.
+      uint64_t key = parent->id_ * 0x9e3779b97f4a7c15ULL ^ loc.id();
+      key ^= key >> 33;
+      key *= 0xff51afd7ed558ccdULL;
+      key ^= key >> 33;
+      key *= 0xc4ceb9fe1a85ec53ULL;
+      key ^= key >> 33;
+      return static_cast<size_t>(key);
+    }
+
+    size_t HomeSlot(const Node* node) const {
+      return Hash(node->parent_, node->location_) & (slots_.size() - 1);
+    }
+
+    void Reset(size_t capacity) {
+      slots_.assign(capacity, nullptr);
+      size_ = 0;
+    }
+
+    std::vector<Node*> slots_;
+    size_t size_ = 0;
+  };
+
   Node* GetOrCreateChild(Node* self, const Interned<Frame>& loc);
 
+  // Removes |node| from the trie and destroys it, together with any
+  // descendants it might still have.
+  void DeleteNode(Node* node);
+  void DeleteAllNodes();
+
   Interned<Frame> MakeRootFrame();
 
   Interner<std::string> string_interner_;
@@ -184,9 +258,15 @@ class GlobalCallstackTrie {
 
   uint64_t next_callstack_id_ = 0;
 
+  ChildTable children_;
+
+  std::vector<std::unique_ptr<NodeBlock>> node_blocks_;
+  size_t nodes_used_in_last_block_ = kNodesPerBlock;
+  std::vector<Node*> free_nodes_;
+
   // Note: profile_module in trace processor relies on the value of this root
   // callsite being exactly "1". See the perf_sample parsing code.
-  Node root_{MakeRootFrame(), ++next_callstack_id_};
+  RootNode root_{MakeRootFrame(), ++next_callstack_id_, this};
 };
 
 }  // namespace profiling
@@ -0,0 +1,120 @@
+// Copyright (C) 2023 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdlib.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "src/profiling/common/callstack_trie.h"
+
+namespace perfetto {
+namespace profiling {
+namespace {
+
+constexpr uint32_t kNumStacksLog2 = 14;
+constexpr uint32_t kNumStacks = 1 << kNumStacksLog2;
+
+bool IsBenchmarkFunctionalOnly() {
+  return getenv("BENCHMARK_FUNCTIONAL_TEST_ONLY") != nullptr;
+}
+
+// Builds kNumStacks callstacks of |depth| frames, in libunwindstack order
+// (top-first). Stacks share their bottom frames: at depth d, stacks are split
+// in 2^d groups, so that the trie branches out close to the root like real
+// callstacks do, and every stack ends with a chain of frames of its own.
+std::vector<std::vector<Interned<Frame>>> MakeCallstacks(
+    GlobalCallstackTrie* trie,
+    uint32_t depth) {
+  std::vector<std::vector<Interned<Frame>>> callstacks(kNumStacks);
+  for (uint32_t i = 0; i < kNumStacks; i++) {
+    for (uint32_t d = depth; d-- > 0;) {
+      const uint32_t shift = d < kNumStacksLog2 ? kNumStacksLog2 - d : 0;
+      unwindstack::FrameData frame{};
+      frame.rel_pc = (uint64_t{d} << 32) | (i >> shift);
+      frame.pc = frame.rel_pc;
+      frame.function_name = "fun_" + std::to_string(frame.rel_pc);
+      callstacks[i].emplace_back(trie->InternCodeLocation(frame, ""));
+    }
+  }
+  return callstacks;
+}
+
+// Looks up callsites that already exist in the trie, as it happens for most
+// samples.
+void BM_CallstackTrieLookup(benchmark::State& state) {
+  const uint32_t depth = static_cast<uint32_t>(state.range(0));
+  GlobalCallstackTrie trie;
+  const auto callstacks = MakeCallstacks(&trie, depth);
+  for (const auto& callstack : callstacks)
+    trie.CreateCallsite(callstack);
+
+  // Samples don't come in any particular order.
+  std::minstd_rand rnd(0);
+  std::vector<uint32_t> order(kNumStacks);
+  for (uint32_t& idx : order)
+    idx = static_cast<uint32_t>(rnd() % kNumStacks);
+
+  uint32_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        trie.CreateCallsite(callstacks[order[i++ % kNumStacks]]));
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()));
+  state.counters["frames/s"] = benchmark::Counter(
+      static_cast<double>(state.iterations() * depth),
+      benchmark::Counter::kIsRate);
+  state.counters["nodes"] =
+      static_cast<double>(trie.node_count_for_testing());
+}
+
+// Creates callsites, references and dereferences them, which deletes them
+// again, as heapprofd does for allocations that are freed before a dump.
+void BM_CallstackTrieCreateAndDelete(benchmark::State& state) {
+  const uint32_t depth = static_cast<uint32_t>(state.range(0));
+  GlobalCallstackTrie trie;
+  const auto callstacks = MakeCallstacks(&trie, depth);
+  // Keep the shared bottom part of the trie alive.
+  GlobalCallstackTrie::Node* pinned = trie.CreateCallsite(callstacks[0]);
+  GlobalCallstackTrie::IncrementNode(pinned);
+
+  uint32_t i = 1;
+  for (auto _ : state) {
+    GlobalCallstackTrie::Node* node =
+        trie.CreateCallsite(callstacks[i++ % kNumStacks]);
+    GlobalCallstackTrie::IncrementNode(node);
+    GlobalCallstackTrie::DecrementNode(node);
+  }
+  GlobalCallstackTrie::DecrementNode(pinned);
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()));
+}
+
+void BenchmarkArgs(benchmark::internal::Benchmark* b) {
+  if (IsBenchmarkFunctionalOnly()) {
+    b->Arg(32);
+    return;
+  }
+  b->Arg(32)->Arg(64)->Arg(256);
+}
+
+}  // namespace
+
+BENCHMARK(BM_CallstackTrieLookup)->Apply(BenchmarkArgs);
+BENCHMARK(BM_CallstackTrieCreateAndDelete)->Apply(BenchmarkArgs);
+
+}  // namespace profiling
+}  // namespace perfetto
@@ -0,0 +1,164 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/profiling/common/callstack_trie.h"
+
+#include <map>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace profiling {
+namespace {
+
+using ::testing::ElementsAre;
+
+// Returns a callstack in libunwindstack order (top-first) with the given pcs,
+// listed bottom-first.
+std::vector<unwindstack::FrameData> MakeStack(std::vector<uint64_t> pcs) {
+  std::vector<unwindstack::FrameData> res;
+  for (auto it = pcs.rbegin(); it != pcs.rend(); ++it) {
+    unwindstack::FrameData data{};
+    data.function_name = "fun" + std::to_string(*it);
+    data.pc = *it;
+    data.rel_pc = *it;
+    res.emplace_back(std::move(data));
+  }
+  return res;
+}
+
+std::vector<uint64_t> InverseCallstackPcs(GlobalCallstackTrie* trie,
+                                          GlobalCallstackTrie::Node* node) {
+  std::vector<uint64_t> res;
+  for (const Interned<Frame>& frame : trie->BuildInverseCallstack(node))
+    res.push_back(frame->rel_pc);
+  return res;
+}
+
+TEST(GlobalCallstackTrieTest, SharesCommonPrefixes) {
+  GlobalCallstackTrie trie;
+  const std::vector<std::string> build_ids(3);
+  auto* foo = trie.CreateCallsite(MakeStack({1, 2, 3}), build_ids);
+  auto* bar = trie.CreateCallsite(MakeStack({1, 2, 4}), build_ids);
+  auto* foo_again = trie.CreateCallsite(MakeStack({1, 2, 3}), build_ids);
+
+  EXPECT_EQ(foo, foo_again);
+  EXPECT_NE(foo, bar);
+  EXPECT_NE(foo->id(), bar->id());
+  // Root, 1, 2, 3, 4.
+  EXPECT_EQ(trie.node_count_for_testing(), 5u);
+  EXPECT_THAT(InverseCallstackPcs(&trie, foo), ElementsAre(3, 2, 1));
+  EXPECT_THAT(InverseCallstackPcs(&trie, bar), ElementsAre(4, 2, 1));
+}
+
+TEST(GlobalCallstackTrieTest, DecrementDeletesUnreferencedNodes) {
+  GlobalCallstackTrie trie;
+  const std::vector<std::string> build_ids(3);
+  auto* foo = trie.CreateCallsite(MakeStack({1, 2, 3}), build_ids);
+  GlobalCallstackTrie::IncrementNode(foo);
+  auto* bar = trie.CreateCallsite(MakeStack({1, 2, 4}), build_ids);
+  GlobalCallstackTrie::IncrementNode(bar);
+  ASSERT_EQ(trie.node_count_for_testing(), 5u);
+
+  // Only the leaf is not shared with foo.
+  GlobalCallstackTrie::DecrementNode(bar);
+  EXPECT_EQ(trie.node_count_for_testing(), 4u);
+  EXPECT_THAT(InverseCallstackPcs(&trie, foo), ElementsAre(3, 2, 1));
+
+  GlobalCallstackTrie::DecrementNode(foo);
+  EXPECT_EQ(trie.node_count_for_testing(), 1u);
+}
+
+TEST(GlobalCallstackTrieTest, DecrementDeletesUnreferencedDescendants) {
+  GlobalCallstackTrie trie;
+  auto* foo =
+      trie.CreateCallsite(MakeStack({1, 2}), std::vector<std::string>(2));
+  GlobalCallstackTrie::IncrementNode(foo);
+  // Never refcounted.
+  trie.CreateCallsite(MakeStack({1, 2, 3, 4}), std::vector<std::string>(4));
+  ASSERT_EQ(trie.node_count_for_testing(), 5u);
+
+  GlobalCallstackTrie::DecrementNode(foo);
+  EXPECT_EQ(trie.node_count_for_testing(), 1u);
+}
+
+TEST(GlobalCallstackTrieTest, IdsAreNotReused) {
+  GlobalCallstackTrie trie;
+  const std::vector<std::string> build_ids(2);
+  std::set<uint64_t> ids;
+  for (uint64_t i = 0; i < 10000; i++) {
+    auto* node = trie.CreateCallsite(MakeStack({1, 100 + i}), build_ids);
+    GlobalCallstackTrie::IncrementNode(node);
+    EXPECT_TRUE(ids.insert(node->id()).second);
+    GlobalCallstackTrie::DecrementNode(node);
+  }
+  EXPECT_EQ(trie.node_count_for_testing(), 1u);
+}
+
+// Exercises growing the child table and deleting from it in random order.
+TEST(GlobalCallstackTrieTest, RandomCreateAndDelete) {
+  GlobalCallstackTrie trie;
+  const std::vector<std::string> build_ids(3);
+  std::minstd_rand rnd(42);
+  std::map<uint64_t, GlobalCallstackTrie::Node*> live;
+  for (int i = 0; i < 20000; i++) {
+    const uint64_t leaf = rnd() % 5000;
+    auto* node = trie.CreateCallsite(MakeStack({1, 2 + leaf % 7, leaf}),
+                                     build_ids);
+    auto it = live.find(leaf);
+    if (it == live.end()) {
+      GlobalCallstackTrie::IncrementNode(node);
+      live.emplace(leaf, node);
+    } else {
+      ASSERT_EQ(it->second, node);
+      GlobalCallstackTrie::DecrementNode(node);
+      live.erase(it);
+    }
+  }
+  for (const auto& leaf_and_node : live) {
+    ASSERT_THAT(InverseCallstackPcs(&trie, leaf_and_node.second),
+                ElementsAre(leaf_and_node.first, 2 + leaf_and_node.first % 7,
+                            1));
+    GlobalCallstackTrie::DecrementNode(leaf_and_node.second);
+  }
+  EXPECT_EQ(trie.node_count_for_testing(), 1u);
+}
+
+TEST(GlobalCallstackTrieTest, ClearTrie) {
+  GlobalCallstackTrie trie;
+  const std::vector<std::string> build_ids(3);
+  for (uint64_t i = 0; i < 10000; i++)
+    trie.CreateCallsite(MakeStack({1, 2, 100 + i}), build_ids);
+  auto* node = trie.CreateCallsite(MakeStack({1, 2, 3}), build_ids);
+  const uint64_t id = node->id();
+  ASSERT_EQ(trie.node_count_for_testing(), 10004u);
+
+  trie.ClearTrie();
+  EXPECT_EQ(trie.node_count_for_testing(), 1u);
+
+  // Ids keep increasing after clearing the trie.
+  node = trie.CreateCallsite(MakeStack({1, 2, 3}), build_ids);
+  EXPECT_GT(node->id(), id);
+  EXPECT_THAT(InverseCallstackPcs(&trie, node), ElementsAre(3, 2, 1));
+}
+
+}  // namespace
+}  // namespace profiling
+}  // namespace perfetto
@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/profiling/common/elf_cache.h"
+
+#include "perfetto/base/logging.h"
+
+namespace perfetto {
+namespace profiling {
+
+ElfCache::ElfCache(size_t max_size_bytes) : max_size_bytes_(max_size_bytes) {}
+
+ElfCache::~ElfCache() = default;
+
+bool ElfCache::Get(const Key& key, unwindstack::MapInfo* map_info) {
+  PERFETTO_DCHECK(!map_info->elf());
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = entries_.find(key);
+  if (it == entries_.end())
+    return false;
+  Entry& entry = it->second;
+  map_info->set_elf(entry.elf);
+  map_info->set_elf_offset(entry.elf_offset);
+  map_info->set_elf_start_offset(entry.elf_start_offset);
+  lru_.splice(lru_.begin(), lru_, entry.lru_it);
+  stats_.hits++;
+  return true;
+}
+
+// static
+bool ElfCache::IsCacheable(unwindstack::MapInfo* map_info) {
+  std::shared_ptr<unwindstack::Elf>& elf = map_info->elf();
+  // Elfs read from the process memory (rather than from the file) can't be
+  // shared with other processes.
+  return elf && elf->valid() && !map_info->memory_backed_elf();
+}
+
+bool ElfCache::Add(const Key& key, unwindstack::MapInfo* map_info) {
+  if (!IsCacheable(map_info))
+    return false;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it_and_inserted = entries_.emplace(key, Entry{});
+  Entry& entry = it_and_inserted.first->second;
+  if (!it_and_inserted.second) {
+    // Another process parsed the same file concurrently. Keep the cached
+    // version, the other one goes away with the maps of that process.
+    return false;
+  }
+  entry.elf = map_info->elf();
+  entry.elf_offset = map_info->elf_offset();
+  entry.elf_start_offset = map_info->elf_start_offset();
+  entry.size_bytes = static_cast<size_t>(map_info->end() - map_info->start());
+  size_bytes_ += entry.size_bytes;
+  lru_.push_front(&it_and_inserted.first->first);
+  entry.lru_it = lru_.begin();
+  stats_.misses++;
+  EvictUnusedEntries();
+  return true;
+}
+
+void ElfCache::EvictUnusedEntries() {
+  auto lru_it = lru_.end();
+  while (size_bytes_ > max_size_bytes_ && lru_it != lru_.begin()) {
+    --lru_it;
+    auto entry_it = entries_.find(**lru_it);
+    PERFETTO_DCHECK(entry_it != entries_.end());
+    // Still used by the maps of a process.
+    if (entry_it->second.elf.use_count() > 1)
+      continue;
+    lru_it = lru_.erase(lru_it);
+    size_bytes_ -= entry_it->second.size_bytes;
+    entries_.erase(entry_it);
+    stats_.evictions++;
+  }
+}
+
+void ElfCache::Clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  stats_.evictions += entries_.size();
+  lru_.clear();
+  entries_.clear();
+  size_bytes_ = 0;
+}
+
+ElfCache::Stats ElfCache::GetStats() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+size_t ElfCache::size() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return entries_.size();
+}
+
+size_t ElfCache::size_bytes() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return size_bytes_;
+}
+
+}  // namespace profiling
+}  // namespace perfetto
@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_PROFILING_COMMON_ELF_CACHE_H_
+#define SRC_PROFILING_COMMON_ELF_CACHE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include <unwindstack/Elf.h>
+#include <unwindstack/MapInfo.h>
+
+#include "perfetto/ext/base/hash.h"
+
+namespace perfetto {
+namespace profiling {
+
+// Cache of the libunwindstack Elf objects (i.e. the parsed unwinding info and
+// symbols) of the mapped files, shared across all the processes being unwound
+// by a daemon and across tracing sessions. Without it, the Elf of a library
+// such as libc or libart would be parsed again for every profiled process, and
+// every time the maps of a process are reparsed.
+//
+// Entries are keyed by the file identity reported by /proc/pid/maps (path,
+// device, inode and offset of the mapping), so a file that gets replaced is not
+// confused with its previous version, nor with a file of another filesystem
+// that has the same inode. The build id isn't part of the key as it
+// can only be known after parsing the file.
+//
+// The Elf objects are refcounted: the cache holds a reference to every entry,
+// and so does every parsed mapping that uses it. Each entry is accounted for
+// the size of the mapping its Elf was parsed for, as that's what the memory
+// of the Elf (the mapped file and the unwinding tables and symbols parsed from
+// it) grows with. The cache holds on to at most |max_size_bytes| of them,
+// evicting the least recently used ones that aren't used by any process.
+// Entries used by a process don't take additional memory by being cached, so
+// they are never evicted.
+//
+// Thread safe.
+class ElfCache {
+ public:
+  static constexpr size_t kDefaultMaxSizeBytes = 256 * 1024 * 1024;
+
+  struct Key {
+    std::string name;
+    // st_dev of the file.
+    uint64_t dev = 0;
+    uint64_t inode = 0;
+    uint64_t offset = 0;
+
+    bool operator==(const Key& other) const {
+      return inode == other.inode && dev == other.dev &&
+             offset == other.offset && name == other.name;
+    }
+  };
+
+  struct Stats {
+    // Number of mappings that got their Elf from the cache.
+    uint64_t hits = 0;
+    // Number of Elfs that were parsed by libunwindstack and added.
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+  };
+
+  explicit ElfCache(size_t max_size_bytes = kDefaultMaxSizeBytes);
+  ~ElfCache();
+
+  ElfCache(const ElfCache&) = delete;
+  ElfCache& operator=(const ElfCache&) = delete;
+
+  // If the Elf for |key| is cached, sets it on |map_info| (which must not have
+  // one yet) and returns true.
+  bool Get(const Key& key, unwindstack::MapInfo* map_info);
+
+  // Returns true if the Elf that libunwindstack created for |map_info| can be
+  // cached, i.e. it was parsed successfully from the file.
+  static bool IsCacheable(unwindstack::MapInfo* map_info);
+
+  // Adds the Elf that libunwindstack created for |map_info| to the cache.
+  // Returns false if it isn't cacheable, or if it's already cached.
+  bool Add(const Key& key, unwindstack::MapInfo* map_info);
+
+  // Drops all the cached entries. Mappings that use them keep them alive.
+  void Clear();
+
+  Stats GetStats();
+  size_t size();
+  // Sum of the sizes of the cached entries.
+  size_t size_bytes();
+
+ private:
+  struct KeyHash {
+    size_t operator()(const Key& key) const {
+      return static_cast<size_t>(
+          base::Hasher::Combine(key.name, key.dev, key.inode, key.offset));
+    }
+  };
+
+  struct Entry {
+    std::shared_ptr<unwindstack::Elf> elf;
+    uint64_t elf_offset = 0;
+    uint64_t elf_start_offset = 0;
+    size_t size_bytes = 0;
+    // Position in |lru_|.
+    std::list<const Key*>::iterator lru_it;
+  };
+
+  // Evicts unused entries, starting from the least recently used, until the
+  // cache is within |max_size_bytes_|. Must be called with |mutex_| held.
+  void EvictUnusedEntries();
+
+  const size_t max_size_bytes_;
+
+  std::mutex mutex_;
+  std::unordered_map<Key, Entry, KeyHash> entries_;
+  size_t size_bytes_ = 0;
+  // Most recently used first. Points to the keys of |entries_|.
+  std::list<const Key*> lru_;
+  Stats stats_;
+};
+
+}  // namespace profiling
+}  // namespace perfetto
+
+#endif  // SRC_PROFILING_COMMON_ELF_CACHE_H_
@@ -16,6 +16,10 @@
 
 #include "src/profiling/common/unwind_support.h"
 
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/sysmacros.h>
+
 #include <cinttypes>
 
 #include <procinfo/process_map.h>
@@ -23,9 +27,28 @@
 #include <unwindstack/Memory.h>
 
 #include "perfetto/ext/base/file_utils.h"
+#include "perfetto/ext/base/string_splitter.h"
 
 namespace perfetto {
 namespace profiling {
+namespace {
+
+// Returns the device of every mapping of the /proc/pid/maps |content|, which
+// ReadMapFileContent() doesn't report.
+std::vector<uint64_t> ParseMapsDevices(const std::string& content) {
+  std::vector<uint64_t> devices;
+  for (base::StringSplitter lines(content, '\n'); lines.Next();) {
+    // The fields are: address perms offset dev inode pathname.
+    unsigned int major = 0;
+    unsigned int minor = 0;
+    if (sscanf(lines.cur_token(), "%*s %*s %*s %x:%x", &major, &minor) != 2)
+      major = minor = 0;
+    devices.push_back(makedev(major, minor));
+  }
+  return devices;
+}
+
+}  // namespace
 
 StackOverlayMemory::StackOverlayMemory(std::shared_ptr<unwindstack::Memory> mem,
                                        uint64_t sp,
@@ -55,7 +78,8 @@ size_t FDMemory::Read(uint64_t addr, void* dst, size_t size) {
   return static_cast<size_t>(rd);
 }
 
-FDMaps::FDMaps(base::ScopedFile fd) : fd_(std::move(fd)) {}
+FDMaps::FDMaps(base::ScopedFile fd, ElfCache* elf_cache)
+    : fd_(std::move(fd)), elf_cache_(elf_cache) {}
 
 bool FDMaps::Parse() {
   // If the process has already exited, lseek or ReadFileDescriptor will
@@ -67,10 +91,19 @@ bool FDMaps::Parse() {
   if (!base::ReadFileDescriptor(*fd_, &content))
     return false;
 
+  // ReadMapFileContent() calls back for every line, in order.
+  std::vector<uint64_t> devices;
+  if (elf_cache_)
+    devices = ParseMapsDevices(content);
+  size_t map_index = 0;
+
   unwindstack::SharedString name("");
   std::shared_ptr<unwindstack::MapInfo> prev_map;
   return android::procinfo::ReadMapFileContent(
       &content[0], [&](const android::procinfo::MapInfo& mapinfo) {
+        uint64_t dev = map_index < devices.size() ? devices[map_index] : 0;
+        map_index++;
+
         // Mark a device map in /dev/ and not in /dev/ashmem/ specially.
         auto flags = mapinfo.flags;
         if (strncmp(mapinfo.name.c_str(), "/dev/", 5) == 0 &&
@@ -84,16 +117,54 @@ bool FDMaps::Parse() {
         maps_.emplace_back(unwindstack::MapInfo::Create(
             prev_map, mapinfo.start, mapinfo.end, mapinfo.pgoff, flags, name));
         prev_map = maps_.back();
+
+        // Only the executable mappings are used to unwind. Anonymous
+        // mappings (e.g. JIT code) have no inode, and their contents can
+        // change without the mapping changing.
+        if (elf_cache_ && (flags & PROT_EXEC) && mapinfo.inode != 0 &&
+            !(flags & unwindstack::MAPS_FLAGS_DEVICE_MAP) &&
+            !mapinfo.name.empty()) {
+          ElfCache::Key key{mapinfo.name, dev,
+                            static_cast<uint64_t>(mapinfo.inode),
+                            mapinfo.pgoff};
+          if (elf_cache_->Get(key, prev_map.get())) {
+            elf_cache_hits_++;
+          } else {
+            uncached_maps_.emplace(prev_map.get(), std::move(key));
+          }
+        }
       });
 }
 
 void FDMaps::Reset() {
+  uncached_maps_.clear();
   maps_.clear();
 }
 
+void FDMaps::AddElfsToCache(
+    const std::vector<unwindstack::FrameData>& frames) {
+  if (uncached_maps_.empty())
+    return;
+  for (const unwindstack::FrameData& frame : frames) {
+    auto it = uncached_maps_.find(frame.map_info.get());
+    if (it == uncached_maps_.end())
+      continue;
+    // The Elfs that can't be cached (e.g. the ones read from the process
+    // memory) aren't misses.
+    if (ElfCache::IsCacheable(frame.map_info.get())) {
+      elf_cache_misses_++;
+      elf_cache_->Add(it->second, frame.map_info.get());
+    }
+    uncached_maps_.erase(it);
+    if (uncached_maps_.empty())
+      return;
+  }
+}
+
 UnwindingMetadata::UnwindingMetadata(base::ScopedFile maps_fd,
-                                     base::ScopedFile mem_fd)
-    : fd_maps(std::move(maps_fd)),
+                                     base::ScopedFile mem_fd,
+                                     ElfCache* elf_cache)
+    : fd_maps(std::move(maps_fd), elf_cache),
       fd_mem(std::make_shared<FDMemory>(std::move(mem_fd))) {
   if (!fd_maps.Parse())
     PERFETTO_DLOG("Failed initial maps parse");
@@ -22,6 +22,8 @@
 
 #include <memory>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 #include <unwindstack/Maps.h>
 #include <unwindstack/Unwinder.h>
@@ -33,23 +35,40 @@
 #include "perfetto/base/logging.h"
 #include "perfetto/base/time.h"
 #include "perfetto/ext/base/scoped_file.h"
+#include "src/profiling/common/elf_cache.h"
 
 namespace perfetto {
 namespace profiling {
 
 // Read /proc/[pid]/maps from an open file descriptor.
+//
+// If an |ElfCache| is given, the executable file mappings reuse the Elf
+// objects that are already in the cache, and AddElfsToCache() must be called
+// after every unwind to add the ones that libunwindstack has parsed in the
+// meantime.
 class FDMaps : public unwindstack::Maps {
  public:
-  explicit FDMaps(base::ScopedFile fd);
+  explicit FDMaps(base::ScopedFile fd, ElfCache* elf_cache = nullptr);
 
   FDMaps(const FDMaps&) = delete;
   FDMaps& operator=(const FDMaps&) = delete;
 
-  FDMaps(FDMaps&& m) : Maps(std::move(m)) { fd_ = std::move(m.fd_); }
+  FDMaps(FDMaps&& m)
+      : Maps(std::move(m)),
+        fd_(std::move(m.fd_)),
+        elf_cache_(m.elf_cache_),
+        uncached_maps_(std::move(m.uncached_maps_)),
+        elf_cache_hits_(m.elf_cache_hits_),
+        elf_cache_misses_(m.elf_cache_misses_) {}
 
   FDMaps& operator=(FDMaps&& m) {
-    if (&m != this)
+    if (&m != this) {
       fd_ = std::move(m.fd_);
+      elf_cache_ = m.elf_cache_;
+      uncached_maps_ = std::move(m.uncached_maps_);
+      elf_cache_hits_ = m.elf_cache_hits_;
+      elf_cache_misses_ = m.elf_cache_misses_;
+    }
     Maps::operator=(std::move(m));
     return *this;
   }
@@ -59,8 +78,23 @@ class FDMaps : public unwindstack::Maps {
   bool Parse() override;
   void Reset();
 
+  // Adds the Elfs that were created while unwinding |frames| to the cache.
+  void AddElfsToCache(const std::vector<unwindstack::FrameData>& frames);
+
+  // Number of mappings of this process that got their Elf from the cache, and
+  // that had to be parsed instead.
+  uint64_t elf_cache_hits() const { return elf_cache_hits_; }
+  uint64_t elf_cache_misses() const { return elf_cache_misses_; }
+
  private:
   base::ScopedFile fd_;
+  ElfCache* elf_cache_ = nullptr;
+  // Executable file mappings whose Elf wasn't in the cache when the maps were
+  // parsed.
+  std::unordered_map<const unwindstack::MapInfo*, ElfCache::Key>
+      uncached_maps_;
+  uint64_t elf_cache_hits_ = 0;
+  uint64_t elf_cache_misses_ = 0;
 };
 
 class FDMemory : public unwindstack::Memory {
@@ -91,7 +125,9 @@ class StackOverlayMemory : public unwindstack::Memory {
 };
 
 struct UnwindingMetadata {
-  UnwindingMetadata(base::ScopedFile maps_fd, base::ScopedFile mem_fd);
+  UnwindingMetadata(base::ScopedFile maps_fd,
+                    base::ScopedFile mem_fd,
+                    ElfCache* elf_cache = nullptr);
 
   // move-only
   UnwindingMetadata(const UnwindingMetadata&) = delete;
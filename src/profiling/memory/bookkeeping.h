@@ -17,10 +17,13 @@
 #ifndef SRC_PROFILING_MEMORY_BOOKKEEPING_H_
 #define SRC_PROFILING_MEMORY_BOOKKEEPING_H_
 
-#include <map>
+#include <memory>
+#include <tuple>
+#include <unordered_map>
 #include <vector>
 
 #include "perfetto/base/time.h"
+#include "perfetto/ext/base/flat_hash_map.h"
 #include "src/profiling/common/callstack_trie.h"
 #include "src/profiling/common/interner.h"
 #include "src/profiling/memory/unwound_messages.h"
@@ -145,10 +148,10 @@ class HeapTracker {
     // * We need to remove them after the callstacks were dumped, which
     //   currently happens after the allocations are dumped.
     // * This way, we do not destroy and recreate callstacks as frequently.
-    for (auto it_and_alloc : dead_callstack_allocations_) {
-      auto& it = it_and_alloc.first;
-      uint64_t allocated = it_and_alloc.second;
-      const CallstackAllocations& alloc = it->second;
+    for (const auto& node_and_allocated : dead_callstack_allocations_) {
+      GlobalCallstackTrie::Node* node = node_and_allocated.first;
+      uint64_t allocated = node_and_allocated.second;
+      const CallstackAllocations& alloc = **callstack_allocations_.Find(node);
       // For non-dump-at-max, we need to check, even if there are still no
       // allocations referencing this callstack, whether there were any
       // allocations that happened but were freed again. If that was the case,
@@ -160,27 +163,27 @@ class HeapTracker {
         // TODO(fmayer): We could probably be smarter than throw away
         // our whole frames cache.
         ClearFrameCache();
-        callstack_allocations_.erase(it);
+        callstack_allocations_.Erase(node);
       }
     }
     dead_callstack_allocations_.clear();
 
-    for (auto it = callstack_allocations_.begin();
-         it != callstack_allocations_.end(); ++it) {
-      const CallstackAllocations& alloc = it->second;
+    for (auto it = callstack_allocations_.GetIterator(); it; ++it) {
+      const CallstackAllocations& alloc = *it.value();
       fn(alloc);
 
       if (alloc.allocs == 0)
         dead_callstack_allocations_.emplace_back(
-            it, !dump_at_max_mode_ ? alloc.value.totals.allocation_count : 0);
+            it.key(),
+            !dump_at_max_mode_ ? alloc.value.totals.allocation_count : 0);
     }
   }
 
   template <typename F>
   void GetAllocations(F fn) {
-    for (const auto& addr_and_allocation : allocations_) {
-      const Allocation& alloc = addr_and_allocation.second;
-      fn(addr_and_allocation.first, alloc.sample_size, alloc.alloc_size,
+    for (auto it = allocations_.GetIterator(); it; ++it) {
+      const Allocation& alloc = it.value();
+      fn(it.key(), alloc.sample_size, alloc.alloc_size,
          alloc.callstack_allocations()->node->id());
     }
   }
@@ -256,15 +259,17 @@ class HeapTracker {
 
   CallstackAllocations* MaybeCreateCallstackAllocations(
       GlobalCallstackTrie::Node* node) {
-    auto callstack_allocations_it = callstack_allocations_.find(node);
-    if (callstack_allocations_it == callstack_allocations_.end()) {
+    std::unique_ptr<CallstackAllocations>* callstack_allocations =
+        callstack_allocations_.Find(node);
+    if (!callstack_allocations) {
       GlobalCallstackTrie::IncrementNode(node);
       bool inserted;
-      std::tie(callstack_allocations_it, inserted) =
-          callstack_allocations_.emplace(node, node);
+      std::tie(callstack_allocations, inserted) = callstack_allocations_.Insert(
+          node, std::unique_ptr<CallstackAllocations>(
+                    new CallstackAllocations(node)));
       PERFETTO_DCHECK(inserted);
     }
-    return &callstack_allocations_it->second;
+    return callstack_allocations->get();
   }
 
   void RecordOperation(uint64_t sequence_number,
@@ -298,11 +303,11 @@ class HeapTracker {
         alloc.callstack_allocations()->value.retain_max.max_count =
             alloc.callstack_allocations()->value.retain_max.cur_count;
       } else {
-        for (auto& p : callstack_allocations_) {
+        for (auto it = callstack_allocations_.GetIterator(); it; ++it) {
           // We need to reset max = cur for every CallstackAllocation, as we
           // do not know which ones have changed since the last max.
           // TODO(fmayer): Add an index to speed this up
-          CallstackAllocations& csa = p.second;
+          CallstackAllocations& csa = *it.value();
           csa.value.retain_max.max = csa.value.retain_max.cur;
           csa.value.retain_max.max_count = csa.value.retain_max.cur_count;
         }
@@ -331,13 +336,22 @@ class HeapTracker {
   // We cannot use an interner here, because after the last allocation goes
   // away, we still need to keep the CallstackAllocations around until the next
   // dump.
-  std::map<GlobalCallstackTrie::Node*, CallstackAllocations>
+  // The CallstackAllocations are heap allocated because Allocations point to
+  // them, and entries of a FlatHashMap move when it rehashes.
+  base::FlatHashMap<GlobalCallstackTrie::Node*,
+                    std::unique_ptr<CallstackAllocations>>
       callstack_allocations_;
 
-  std::vector<std::pair<decltype(callstack_allocations_)::iterator, uint64_t>>
+  // Callstacks that had no allocations referencing them on the last dump,
+  // with their allocation_count at that time.
+  std::vector<std::pair<GlobalCallstackTrie::Node*, uint64_t>>
       dead_callstack_allocations_;
 
-  std::map<uint64_t /* allocation address */, Allocation> allocations_;
+  // This can hold tens of millions of entries for allocation-heavy processes,
+  // so it is a flat table rather than a node-based map: lookups don't chase
+  // pointers and there is no per-entry heap allocation. Allocations are moved
+  // when the table rehashes (see Allocation's move constructor).
+  base::FlatHashMap<uint64_t /* allocation address */, Allocation> allocations_;
 
   // An operation is either a commit of an allocation or freeing of an
   // allocation. An operation is a free if its seq_id is larger than
@@ -346,7 +360,11 @@ class HeapTracker {
   //
   // If its seq_id is less than the sequence_number of the corresponding
   // allocation it could be either, but is ignored either way.
-  std::map<uint64_t /* seq_id */, PendingOperation /* allocation address */>
+  //
+  // Operations are committed in order of seq_id, by looking up
+  // committed_sequence_number_ + 1, so this does not need to be ordered.
+  base::FlatHashMap<uint64_t /* seq_id */,
+                    PendingOperation /* allocation address */>
       pending_operations_;
 
   uint64_t committed_timestamp_ = 0;
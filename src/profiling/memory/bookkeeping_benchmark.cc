@@ -0,0 +1,140 @@
+// Copyright (C) 2023 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <malloc.h>
+#include <stdlib.h>
+
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "perfetto/base/build_config.h"
+#include "perfetto/base/logging.h"
+#include "src/profiling/common/callstack_trie.h"
+#include "src/profiling/memory/bookkeeping.h"
+
+namespace perfetto {
+namespace profiling {
+namespace {
+
+constexpr size_t kNumCallstacks = 64;
+constexpr size_t kCallstackDepth = 16;
+constexpr uint64_t kBaseAddress = 0x7f0000000000;
+constexpr uint64_t kAllocSize = 64;
+
+bool IsBenchmarkFunctionalOnly() {
+  return getenv("BENCHMARK_FUNCTIONAL_TEST_ONLY") != nullptr;
+}
+
+// Returns the number of bytes allocated through malloc, or 0 if that isn't
+// known. This is more precise than the RSS, which doesn't grow when memory
+// freed by a previous run of the benchmark is reused.
+uint64_t GetHeapBytesInUse() {
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_ANDROID)
+  struct mallinfo info = mallinfo();
+  return info.uordblks + info.hblkhd;
+#elif defined(__GLIBC__) && __GLIBC_PREREQ(2, 33)
+  struct mallinfo2 info = mallinfo2();
+  return info.uordblks + info.hblkhd;
+#else
+  return 0;
+#endif
+}
+
+std::vector<std::vector<unwindstack::FrameData>> MakeCallstacks() {
+  std::vector<std::vector<unwindstack::FrameData>> callstacks(kNumCallstacks);
+  for (size_t i = 0; i < kNumCallstacks; i++) {
+    for (size_t depth = 0; depth < kCallstackDepth; depth++) {
+      unwindstack::FrameData frame{};
+      // Callstacks share their outermost frames, like real ones do.
+      frame.pc = depth < kCallstackDepth / 2 ? depth : i * 1000 + depth;
+      frame.rel_pc = frame.pc;
+      frame.function_name = "fun_" + std::to_string(frame.pc);
+      callstacks[i].emplace_back(std::move(frame));
+    }
+  }
+  return callstacks;
+}
+
+// Keeps |state.range(0)| allocations live, and on every iteration frees the
+// oldest one and allocates a new one. If |state.range(1)| is set, pairs of
+// operations are recorded in reverse order of sequence number, as it happens
+// when they are unwound by different threads, so they go through the pending
+// operations.
+void BM_HeapTrackerMallocFree(benchmark::State& state) {
+  const size_t num_live = static_cast<size_t>(state.range(0));
+  const bool out_of_order = state.range(1) != 0;
+
+  const auto callstacks = MakeCallstacks();
+  const std::vector<std::string> build_ids(kCallstackDepth);
+  GlobalCallstackTrie callsites;
+
+  const uint64_t heap_before = GetHeapBytesInUse();
+  HeapTracker tracker(&callsites, /*dump_at_max_mode=*/false);
+  uint64_t seq = 0;
+  uint64_t next_alloc = 0;
+  auto malloc_at = [&](uint64_t alloc_idx, uint64_t sequence_number) {
+    tracker.RecordMalloc(callstacks[alloc_idx % kNumCallstacks], build_ids,
+                         kBaseAddress + alloc_idx * kAllocSize, kAllocSize,
+                         kAllocSize, sequence_number, sequence_number);
+  };
+  auto free_at = [&](uint64_t alloc_idx, uint64_t sequence_number) {
+    tracker.RecordFree(kBaseAddress + alloc_idx * kAllocSize, sequence_number,
+                       sequence_number);
+  };
+
+  for (; next_alloc < num_live; next_alloc++)
+    malloc_at(next_alloc, ++seq);
+  const uint64_t heap_after = GetHeapBytesInUse();
+
+  for (auto _ : state) {
+    const uint64_t free_seq = ++seq;
+    const uint64_t malloc_seq = ++seq;
+    if (out_of_order) {
+      malloc_at(next_alloc, malloc_seq);
+      free_at(next_alloc - num_live, free_seq);
+    } else {
+      free_at(next_alloc - num_live, free_seq);
+      malloc_at(next_alloc, malloc_seq);
+    }
+    next_alloc++;
+  }
+
+  PERFETTO_CHECK(tracker.GetTimestampForTesting() == seq);
+  state.SetItemsProcessed(2 * static_cast<int64_t>(state.iterations()));
+  if (heap_before && heap_after > heap_before) {
+    state.counters["bytes_per_live_alloc"] = benchmark::Counter(
+        static_cast<double>(heap_after - heap_before) /
+        static_cast<double>(num_live));
+  }
+}
+
+void BenchmarkArgs(benchmark::internal::Benchmark* b) {
+  if (IsBenchmarkFunctionalOnly()) {
+    b->Args({1000, 0});
+    return;
+  }
+  for (int64_t out_of_order : {0, 1}) {
+    for (int64_t num_live : {1000, 100 * 1000, 1000 * 1000, 3000 * 1000})
+      b->Args({num_live, out_of_order});
+  }
+}
+
+}  // namespace
+
+BENCHMARK(BM_HeapTrackerMallocFree)->Apply(BenchmarkArgs);
+
+}  // namespace profiling
+}  // namespace perfetto
@@ -71,11 +71,13 @@ constexpr int kProfilingSignal = __SIGRTMIN + 4;
 constexpr int kHeapprofdSignalValue = 0;
 
 std::vector<UnwindingWorker> MakeUnwindingWorkers(HeapprofdProducer* delegate,
+                                                  ElfCache* elf_cache,
                                                   size_t n) {
   std::vector<UnwindingWorker> ret;
   for (size_t i = 0; i < n; ++i) {
     ret.emplace_back(delegate,
-                     base::ThreadTaskRunner::CreateAndStart("heapprofdunwind"));
+                     base::ThreadTaskRunner::CreateAndStart("heapprofdunwind"),
+                     elf_cache);
   }
   return ret;
 }
@@ -211,7 +213,8 @@ HeapprofdProducer::HeapprofdProducer(HeapprofdMode mode,
       exit_when_done_(exit_when_done),
       socket_delegate_(this),
       weak_factory_(this),
-      unwinding_workers_(MakeUnwindingWorkers(this, kUnwinderThreads)) {
+      unwinding_workers_(
+          MakeUnwindingWorkers(this, &elf_cache_, kUnwinderThreads)) {
   CheckDataSourceCpuTask();
   CheckDataSourceMemoryTask();
 }
@@ -695,6 +698,8 @@ void HeapprofdProducer::SetStats(
   stats->set_total_unwinding_time_us(process_state.total_unwinding_time_us);
   stats->set_client_spinlock_blocked_us(
       process_state.client_spinlock_blocked_us);
+  stats->set_elf_cache_hits(process_state.elf_cache_hits);
+  stats->set_elf_cache_misses(process_state.elf_cache_misses);
   auto* unwinding_hist = stats->set_unwinding_time_us();
   for (const auto& p : process_state.unwinding_time_us.GetData()) {
     auto* bucket = unwinding_hist->add_buckets();
@@ -1092,6 +1097,8 @@ void HeapprofdProducer::HandleAllocRecord(AllocRecord* alloc_rec) {
   process_state.heap_samples++;
   process_state.unwinding_time_us.Add(alloc_rec->unwinding_time_us);
   process_state.total_unwinding_time_us += alloc_rec->unwinding_time_us;
+  process_state.elf_cache_hits = alloc_rec->elf_cache_hits;
+  process_state.elf_cache_misses = alloc_rec->elf_cache_misses;
 
   // abspc may no longer refer to the same functions, as we had to reparse
   // maps. Reset the cache.
@@ -33,6 +33,7 @@
 #include "perfetto/ext/tracing/core/tracing_service.h"
 #include "perfetto/tracing/core/data_source_config.h"
 #include "perfetto/tracing/core/forward_decls.h"
+#include "src/profiling/common/elf_cache.h"
 #include "src/profiling/common/interning_output.h"
 #include "src/profiling/common/proc_utils.h"
 #include "src/profiling/common/profiler_guardrails.h"
@@ -194,6 +195,8 @@ class HeapprofdProducer : public Producer, public UnwindingWorker::Delegate {
 
     uint64_t total_unwinding_time_us = 0;
     uint64_t client_spinlock_blocked_us = 0;
+    uint64_t elf_cache_hits = 0;
+    uint64_t elf_cache_misses = 0;
     GlobalCallstackTrie* callsites;
     bool dump_at_max_mode;
     LogHistogram unwinding_time_us;
@@ -327,6 +330,9 @@ class HeapprofdProducer : public Producer, public UnwindingWorker::Delegate {
 
   base::WeakPtrFactory<HeapprofdProducer> weak_factory_;
 
+  // Shared by all the unwinding workers, must outlive them.
+  ElfCache elf_cache_;
+
   // UnwindingWorker's destructor might attempt to post producer tasks, so this
   // needs to outlive weak_factory_.
   std::vector<UnwindingWorker> unwinding_workers_;
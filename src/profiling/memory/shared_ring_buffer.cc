@@ -251,8 +251,11 @@ SharedRingBuffer::Buffer SharedRingBuffer::BeginRead() {
     errno = EBADF;
     return Buffer();
   }
-  auto pos = opt_pos.value();
+  return ReadRecordAt(opt_pos.value());
+}
 
+SharedRingBuffer::Buffer SharedRingBuffer::ReadRecordAt(
+    const PointerPositions& pos) {
   size_t avail_read = read_avail(pos);
 
   if (avail_read < kHeaderSize) {
@@ -296,6 +299,80 @@ size_t SharedRingBuffer::EndRead(Buffer buf) {
   return size_with_header;
 }
 
+SharedRingBuffer::ReadBatch SharedRingBuffer::BeginReadBatch() {
+  ReadBatch batch;
+  std::optional<PointerPositions> opt_pos = GetPointerPositions();
+  if (!opt_pos) {
+    meta_->stats.num_reads_corrupt++;
+    batch.corrupt = true;
+    return batch;
+  }
+  batch.read_pos = opt_pos->read_pos;
+  batch.write_pos = opt_pos->write_pos;
+  return batch;
+}
+
+SharedRingBuffer::Buffer SharedRingBuffer::ReadNext(ReadBatch* batch) {
+  if (batch->corrupt) {
+    errno = EBADF;
+    return Buffer();
+  }
+
+  // The caller is done with the record returned by the previous call.
+  ConsumeLastRecord(batch);
+  if (batch->unpublished_bytes >= size_ / 4)
+    PublishReadPos(batch);
+
+  PointerPositions pos{batch->read_pos, batch->write_pos};
+  if (read_avail(pos) < kHeaderSize) {
+    // All the records that were there when the write position was last loaded
+    // have been read. Let the writers reuse their space, and look for new
+    // ones. See GetPointerPositions for the acquire.
+    PublishReadPos(batch);
+    pos.write_pos = meta_->write_pos.load(std::memory_order_acquire);
+    if (IsCorrupt(pos)) {
+      meta_->stats.num_reads_corrupt++;
+      batch->corrupt = true;
+      errno = EBADF;
+      return Buffer();
+    }
+    batch->write_pos = pos.write_pos;
+  }
+
+  Buffer buf = ReadRecordAt(pos);
+  if (buf) {
+    batch->last_record_size =
+        base::AlignUp<kAlignment>(buf.size + kHeaderSize);
+  }
+  return buf;
+}
+
+size_t SharedRingBuffer::EndReadBatch(ReadBatch* batch) {
+  ConsumeLastRecord(batch);
+  PublishReadPos(batch);
+  return batch->bytes_read;
+}
+
+void SharedRingBuffer::ConsumeLastRecord(ReadBatch* batch) {
+  if (!batch->last_record_size)
+    return;
+  batch->read_pos += batch->last_record_size;
+  batch->unpublished_bytes += batch->last_record_size;
+  batch->bytes_read += batch->last_record_size;
+  batch->unpublished_reads++;
+  batch->last_record_size = 0;
+}
+
+void SharedRingBuffer::PublishReadPos(ReadBatch* batch) {
+  if (!batch->unpublished_bytes)
+    return;
+  meta_->read_pos.fetch_add(batch->unpublished_bytes,
+                            std::memory_order_relaxed);
+  meta_->stats.num_reads_succeeded += batch->unpublished_reads;
+  batch->unpublished_bytes = 0;
+  batch->unpublished_reads = 0;
+}
+
 bool SharedRingBuffer::IsCorrupt(const PointerPositions& pos) {
   if (pos.write_pos < pos.read_pos || pos.write_pos - pos.read_pos > size_ ||
       pos.write_pos % kAlignment || pos.read_pos % kAlignment) {
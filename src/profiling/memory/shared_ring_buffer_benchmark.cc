@@ -0,0 +1,141 @@
+// Copyright (C) 2023 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "perfetto/base/logging.h"
+#include "perfetto/ext/base/scoped_file.h"
+#include "src/profiling/memory/shared_ring_buffer.h"
+
+namespace perfetto {
+namespace profiling {
+namespace {
+
+// Same as the default shmem_size_bytes of the heapprofd config.
+constexpr size_t kBufSize = 8 * 1024 * 1024;
+constexpr size_t kRecordSize = 256;
+// Same as the number of records the UnwindingWorker reads per task.
+constexpr size_t kRecordsPerIteration = 1000;
+
+bool IsBenchmarkFunctionalOnly() {
+  return getenv("BENCHMARK_FUNCTIONAL_TEST_ONLY") != nullptr;
+}
+
+// Writes records as fast as possible through its own mapping of the buffer,
+// like a client process would, until |stop| is set.
+void WriterMain(int fd, std::atomic<bool>* stop) {
+  std::optional<SharedRingBuffer> buf =
+      SharedRingBuffer::Attach(base::ScopedFile(dup(fd)));
+  PERFETTO_CHECK(buf);
+  while (!stop->load(std::memory_order_relaxed)) {
+    SharedRingBuffer::Buffer wr_buf;
+    {
+      auto lock = buf->AcquireLock(ScopedSpinlock::Mode::Try);
+      if (!lock.locked())
+        continue;
+      wr_buf = buf->BeginWrite(lock, kRecordSize);
+    }
+    if (!wr_buf) {
+      // The buffer is full, let the reader catch up.
+      std::this_thread::yield();
+      continue;
+    }
+    memset(wr_buf.data, 0x42, wr_buf.size);
+    buf->EndWrite(std::move(wr_buf));
+  }
+}
+
+// The benchmark thread reads from the buffer while |state.range(0)| threads
+// write to it. If |state.range(1)| is set, the records are read through
+// BeginReadBatch / ReadNext, otherwise through BeginRead / EndRead.
+void BM_SharedRingBufferRead(benchmark::State& state) {
+  const size_t num_writers = static_cast<size_t>(state.range(0));
+  const bool batched = state.range(1) != 0;
+
+  std::optional<SharedRingBuffer> buf = SharedRingBuffer::Create(kBufSize);
+  PERFETTO_CHECK(buf);
+  std::atomic<bool> stop{false};
+  std::vector<std::thread> writers;
+  for (size_t i = 0; i < num_writers; i++)
+    writers.emplace_back(WriterMain, buf->fd(), &stop);
+
+  uint64_t records = 0;
+  uint64_t checksum = 0;
+  for (auto _ : state) {
+    if (batched) {
+      SharedRingBuffer::ReadBatch batch = buf->BeginReadBatch();
+      for (size_t i = 0; i < kRecordsPerIteration; i++) {
+        SharedRingBuffer::Buffer rd_buf = buf->ReadNext(&batch);
+        if (!rd_buf)
+          break;
+        checksum += rd_buf.data[rd_buf.size - 1];
+        records++;
+      }
+      buf->EndReadBatch(&batch);
+    } else {
+      for (size_t i = 0; i < kRecordsPerIteration; i++) {
+        SharedRingBuffer::Buffer rd_buf = buf->BeginRead();
+        if (!rd_buf)
+          break;
+        checksum += rd_buf.data[rd_buf.size - 1];
+        records++;
+        buf->EndRead(std::move(rd_buf));
+      }
+    }
+  }
+
+  stop.store(true);
+  for (std::thread& writer : writers)
+    writer.join();
+
+  benchmark::DoNotOptimize(checksum);
+  SharedRingBuffer::Stats stats;
+  {
+    auto lock = buf->AcquireLock(ScopedSpinlock::Mode::Blocking);
+    stats = buf->GetStats(lock);
+  }
+  state.counters["records/s"] = benchmark::Counter(
+      static_cast<double>(records), benchmark::Counter::kIsRate);
+  state.counters["writes_overflow"] =
+      benchmark::Counter(static_cast<double>(stats.num_writes_overflow));
+  state.counters["failed_spinlocks"] =
+      benchmark::Counter(static_cast<double>(stats.failed_spinlocks));
+}
+
+void BenchmarkArgs(benchmark::internal::Benchmark* b) {
+  b->UseRealTime();
+  if (IsBenchmarkFunctionalOnly()) {
+    b->Args({1, 0})->Args({1, 1})->Iterations(100);
+    return;
+  }
+  for (int64_t batched : {0, 1}) {
+    for (int64_t num_writers : {1, 8, 32})
+      b->Args({num_writers, batched});
+  }
+}
+
+}  // namespace
+
+BENCHMARK(BM_SharedRingBufferRead)->Apply(BenchmarkArgs);
+
+}  // namespace profiling
+}  // namespace perfetto
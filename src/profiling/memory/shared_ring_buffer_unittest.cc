@@ -186,7 +186,7 @@ TEST(SharedRingBufferTest, SingleThreadAttach) {
   StructuredTest(&*buf1, &*buf2);
 }
 
-TEST(SharedRingBufferTest, MultiThreadingTest) {
+void MultiThreadingTest(bool batched_reads) {
   constexpr auto kBufSize = base::kPageSize * 1024;  // 4 MB
   SharedRingBuffer rd = *SharedRingBuffer::Create(kBufSize);
   SharedRingBuffer wr =
@@ -217,9 +217,22 @@ TEST(SharedRingBufferTest, MultiThreadingTest) {
     }
   };
 
-  auto reader_thread_fn = [&rd, &expected_contents, &mutex, &writers_enabled] {
+  auto reader_thread_fn = [&rd, &expected_contents, &mutex, &writers_enabled,
+                           batched_reads] {
+    std::optional<SharedRingBuffer::ReadBatch> batch;
     for (;;) {
-      auto buf_and_size = rd.BeginRead();
+      SharedRingBuffer::Buffer buf_and_size;
+      if (batched_reads) {
+        if (!batch)
+          batch = rd.BeginReadBatch();
+        buf_and_size = rd.ReadNext(&*batch);
+        if (!buf_and_size) {
+          rd.EndReadBatch(&*batch);
+          batch.reset();
+        }
+      } else {
+        buf_and_size = rd.BeginRead();
+      }
       if (!buf_and_size) {
         if (!writers_enabled.load()) {
           // Failing to read after the writers are done means that there is no
@@ -233,7 +246,8 @@ TEST(SharedRingBufferTest, MultiThreadingTest) {
       std::string data = ToString(buf_and_size);
       std::lock_guard<std::mutex> lock(mutex);
       expected_contents[std::move(data)]--;
-      rd.EndRead(std::move(buf_and_size));
+      if (!batched_reads)
+        rd.EndRead(std::move(buf_and_size));
     }
   };
 
@@ -252,6 +266,69 @@ TEST(SharedRingBufferTest, MultiThreadingTest) {
   writers_enabled.store(false);
 
   reader_thread.join();
+
+  for (const auto& content_and_count : expected_contents)
+    EXPECT_EQ(content_and_count.second, 0);
+}
+
+TEST(SharedRingBufferTest, MultiThreadingTest) {
+  MultiThreadingTest(/*batched_reads=*/false);
+}
+
+TEST(SharedRingBufferTest, MultiThreadingBatchedReadsTest) {
+  MultiThreadingTest(/*batched_reads=*/true);
+}
+
+TEST(SharedRingBufferTest, BatchedRead) {
+  constexpr auto kBufSize = base::kPageSize * 4;
+  std::optional<SharedRingBuffer> wr = SharedRingBuffer::Create(kBufSize);
+  ASSERT_TRUE(wr);
+  SharedRingBuffer rd =
+      *SharedRingBuffer::Attach(base::ScopedFile(dup(wr->fd())));
+
+  ASSERT_TRUE(TryWrite(&*wr, "1", 1));
+  ASSERT_TRUE(TryWrite(&*wr, "22", 2));
+
+  SharedRingBuffer::ReadBatch batch = rd.BeginReadBatch();
+  EXPECT_EQ(ToString(rd.ReadNext(&batch)), "1");
+  EXPECT_EQ(ToString(rd.ReadNext(&batch)), "22");
+  // Records written after the batch started are read too.
+  ASSERT_TRUE(TryWrite(&*wr, "333", 3));
+  EXPECT_EQ(ToString(rd.ReadNext(&batch)), "333");
+  // The first two records are given back to the writers when the write
+  // position is reloaded, the third one only once the reader is done with it.
+  EXPECT_EQ(wr->write_avail(), kBufSize - 16);
+  EXPECT_FALSE(rd.ReadNext(&batch));
+  EXPECT_EQ(wr->write_avail(), kBufSize);
+  EXPECT_EQ(rd.EndReadBatch(&batch), 48u);
+
+  auto lock = wr->AcquireLock(ScopedSpinlock::Mode::Try);
+  ASSERT_TRUE(lock.locked());
+  SharedRingBuffer::Stats stats = wr->GetStats(lock);
+  EXPECT_EQ(stats.num_writes_succeeded, 3u);
+  EXPECT_EQ(stats.num_reads_succeeded, 3u);
+  EXPECT_EQ(stats.num_reads_nodata, 1u);
+}
+
+TEST(SharedRingBufferTest, BatchedReadPublishesLargeReads) {
+  constexpr auto kBufSize = base::kPageSize * 4;
+  std::optional<SharedRingBuffer> buf = SharedRingBuffer::Create(kBufSize);
+  ASSERT_TRUE(buf);
+
+  // Fill the buffer with records of a quarter of its size.
+  std::string data(kBufSize / 4 - sizeof(uint64_t), '.');
+  for (int i = 0; i < 4; i++)
+    ASSERT_TRUE(TryWrite(&*buf, data.data(), data.size()));
+  ASSERT_EQ(buf->write_avail(), 0u);
+
+  SharedRingBuffer::ReadBatch batch = buf->BeginReadBatch();
+  ASSERT_TRUE(buf->ReadNext(&batch));
+  EXPECT_EQ(buf->write_avail(), 0u);
+  // Reading the second record lets the writers reuse the first one.
+  ASSERT_TRUE(buf->ReadNext(&batch));
+  EXPECT_EQ(buf->write_avail(), kBufSize / 4);
+  ASSERT_TRUE(TryWrite(&*buf, data.data(), data.size()));
+  EXPECT_EQ(buf->EndReadBatch(&batch), kBufSize / 2);
 }
 
 TEST(SharedRingBufferTest, InvalidSize) {
@@ -177,6 +177,8 @@ bool DoUnwind(WireMessage* msg, UnwindingMetadata* metadata, AllocRecord* out) {
       break;
     }
   }
+  metadata->fd_maps.AddElfsToCache(out->frames);
+
   out->build_ids.resize(out->frames.size());
   for (size_t i = 0; i < out->frames.size(); ++i) {
     out->build_ids[i] = metadata->GetBuildId(out->frames[i]);
@@ -285,22 +287,26 @@ UnwindingWorker::ReadAndUnwindBatchResult UnwindingWorker::ReadAndUnwindBatch(
   SharedRingBuffer::Buffer buf;
   ReadAndUnwindBatchResult res;
 
+  // Read the whole batch without going back to the shared pointer positions
+  // for every record, as they are contended with the writers in the client.
+  SharedRingBuffer::ReadBatch read_batch = shmem.BeginReadBatch();
   size_t i;
   for (i = 0; i < kUnwindBatchSize; ++i) {
     uint64_t reparses_before = client_data->metadata.reparses;
-    buf = shmem.BeginRead();
+    buf = shmem.ReadNext(&read_batch);
     if (!buf)
       break;
     HandleBuffer(this, &alloc_record_arena_, buf, client_data,
                  client_data->sock->peer_pid_linux(), delegate_);
-    res.bytes_read += shmem.EndRead(std::move(buf));
     // Reparsing takes time, so process the rest in a new batch to avoid timing
     // out.
     if (reparses_before < client_data->metadata.reparses) {
+      res.bytes_read = shmem.EndReadBatch(&read_batch);
       res.status = ReadAndUnwindBatchResult::Status::kHasMore;
       return res;
     }
   }
+  res.bytes_read = shmem.EndReadBatch(&read_batch);
 
   if (i == kUnwindBatchSize) {
     res.status = ReadAndUnwindBatchResult::Status::kHasMore;
@@ -414,6 +420,8 @@ void UnwindingWorker::HandleBuffer(UnwindingWorker* self,
       DoUnwind(&msg, unwinding_metadata, rec.get());
     rec->unwinding_time_us = static_cast<uint64_t>(
         ((base::GetWallTimeNs() / 1000) - start_time_us).count());
+    rec->elf_cache_hits = unwinding_metadata->fd_maps.elf_cache_hits();
+    rec->elf_cache_misses = unwinding_metadata->fd_maps.elf_cache_misses();
     delegate->PostAllocRecord(self, std::move(rec));
   } else if (msg.record_type == RecordType::Free) {
     FreeRecord rec;
@@ -459,7 +467,7 @@ void UnwindingWorker::HandleHandoffSocket(HandoffData handoff_data) {
   pid_t peer_pid = sock->peer_pid_linux();
 
   UnwindingMetadata metadata(std::move(handoff_data.maps_fd),
-                             std::move(handoff_data.mem_fd));
+                             std::move(handoff_data.mem_fd), elf_cache_);
   ClientData client_data{
       handoff_data.data_source_instance_id,
       std::move(sock),
@@ -23,6 +23,7 @@
 #include "perfetto/ext/base/scoped_file.h"
 #include "perfetto/ext/base/thread_task_runner.h"
 #include "perfetto/ext/tracing/core/basic_types.h"
+#include "src/profiling/common/elf_cache.h"
 #include "src/profiling/common/unwind_support.h"
 #include "src/profiling/memory/bookkeeping.h"
 #include "src/profiling/memory/unwound_messages.h"
@@ -82,8 +83,12 @@ class UnwindingWorker : public base::UnixSocket::EventListener {
     bool stream_allocations;
   };
 
-  UnwindingWorker(Delegate* delegate, base::ThreadTaskRunner thread_task_runner)
+  // |elf_cache| is optional, and shared with other workers.
+  UnwindingWorker(Delegate* delegate,
+                  base::ThreadTaskRunner thread_task_runner,
+                  ElfCache* elf_cache = nullptr)
       : delegate_(delegate),
+        elf_cache_(elf_cache),
         thread_task_runner_(std::move(thread_task_runner)) {}
 
   ~UnwindingWorker() override;
@@ -154,6 +159,7 @@ class UnwindingWorker : public base::UnixSocket::EventListener {
   AllocRecordArena alloc_record_arena_;
   std::map<pid_t, ClientData> client_data_;
   Delegate* delegate_;
+  ElfCache* elf_cache_;
 
   // Task runner with a dedicated thread. Keep last. By destroying this task
   // runner first, we ensure that the UnwindingWorker is not active while the
@@ -24,6 +24,7 @@
 
 #include "perfetto/ext/base/file_utils.h"
 #include "perfetto/ext/base/scoped_file.h"
+#include "src/profiling/common/elf_cache.h"
 #include "src/profiling/common/unwind_support.h"
 #include "src/profiling/memory/client.h"
 #include "src/profiling/memory/wire_protocol.h"
@@ -182,6 +183,40 @@ TEST(UnwindingTest, DoUnwindReparse) {
                "namespace)::GetRecord(perfetto::profiling::WireMessage*)");
 }
 
+TEST(UnwindingTest, DoUnwindReusesElfCache) {
+  ElfCache elf_cache;
+  WireMessage msg;
+  auto record = GetRecord(&msg);
+
+  UnwindingMetadata metadata(base::OpenFile("/proc/self/maps", O_RDONLY),
+                             base::OpenFile("/proc/self/mem", O_RDONLY),
+                             &elf_cache);
+  EXPECT_EQ(metadata.fd_maps.elf_cache_hits(), 0u);
+  AllocRecord out;
+  ASSERT_TRUE(DoUnwind(&msg, &metadata, &out));
+  EXPECT_GT(metadata.fd_maps.elf_cache_misses(), 0u);
+  EXPECT_GT(elf_cache.size(), 0u);
+  EXPECT_GT(elf_cache.size_bytes(), 0u);
+
+  // Another process with the same mappings (here, the same process again)
+  // reuses the Elfs parsed for the first one.
+  UnwindingMetadata other_metadata(
+      base::OpenFile("/proc/self/maps", O_RDONLY),
+      base::OpenFile("/proc/self/mem", O_RDONLY), &elf_cache);
+  EXPECT_GT(other_metadata.fd_maps.elf_cache_hits(), 0u);
+  AllocRecord other_out;
+  ASSERT_TRUE(DoUnwind(&msg, &other_metadata, &other_out));
+  EXPECT_LT(other_metadata.fd_maps.elf_cache_misses(),
+            metadata.fd_maps.elf_cache_misses());
+
+  ASSERT_EQ(other_out.frames.size(), out.frames.size());
+  for (size_t i = 0; i < out.frames.size(); i++) {
+    EXPECT_EQ(other_out.frames[i].pc, out.frames[i].pc);
+    EXPECT_EQ(other_out.frames[i].function_name, out.frames[i].function_name);
+    EXPECT_EQ(other_out.build_ids[i], out.build_ids[i]);
+  }
+}
+
 TEST(AllocRecordArenaTest, Smoke) {
   AllocRecordArena a;
   auto borrowed = a.BorrowAllocRecord();
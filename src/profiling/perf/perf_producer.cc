@@ -366,11 +366,14 @@ bool PerfProducer::ShouldRejectDueToFilter(
 }
 
 PerfProducer::PerfProducer(ProcDescriptorGetter* proc_fd_getter,
-                           base::TaskRunner* task_runner)
+                           base::TaskRunner* task_runner,
+                           uint32_t num_unwinder_threads)
     : task_runner_(task_runner),
       proc_fd_getter_(proc_fd_getter),
-      unwinding_worker_(this),
       weak_factory_(this) {
+  PERFETTO_CHECK(num_unwinder_threads > 0);
+  for (uint32_t i = 0; i < num_unwinder_threads; i++)
+    unwinding_workers_.emplace_back(new UnwinderHandle(this, i, &elf_cache_));
   proc_fd_getter->SetDelegate(this);
 }
 
@@ -470,13 +473,14 @@ void PerfProducer::StartDataSource(DataSourceInstanceID ds_id,
       ds_it->second.trace_writer.get(),
       protos::pbzero::TracePacket::SEQ_NEEDS_INCREMENTAL_STATE);
 
-  // Inform unwinder of the new data source instance, and optionally start a
-  // periodic task to clear its cached state.
-  unwinding_worker_->PostStartDataSource(ds_id,
-                                         ds.event_config.kernel_frames());
-  if (ds.event_config.unwind_state_clear_period_ms()) {
-    unwinding_worker_->PostClearCachedStatePeriodic(
-        ds_id, ds.event_config.unwind_state_clear_period_ms());
+  // Inform unwinders of the new data source instance, and optionally start a
+  // periodic task to clear their cached state.
+  for (auto& unwinder : unwinding_workers_) {
+    (*unwinder)->PostStartDataSource(ds_id, ds.event_config.kernel_frames());
+    if (ds.event_config.unwind_state_clear_period_ms()) {
+      (*unwinder)->PostClearCachedStatePeriodic(
+          ds_id, ds.event_config.unwind_state_clear_period_ms());
+    }
   }
 
   // Kick off periodic read task.
@@ -634,12 +638,16 @@ void PerfProducer::TickDataSourceRead(DataSourceInstanceID ds_id) {
     }
   }
 
-  // Wake up the unwinder as we've (likely) pushed samples into its queue.
-  unwinding_worker_->PostProcessQueue();
+  // Wake up the unwinders as we've (likely) pushed samples into their queues.
+  for (auto& unwinder : unwinding_workers_)
+    (*unwinder)->PostProcessQueue();
 
   if (PERFETTO_UNLIKELY(ds.status == DataSourceState::Status::kShuttingDown) &&
       !more_records_available) {
-    unwinding_worker_->PostInitiateDataSourceStop(ds_id);
+    // The stop is acked once all of the unwinders are done with the source.
+    ds.unwinders_pending_stop = unwinding_workers_.size();
+    for (auto& unwinder : unwinding_workers_)
+      (*unwinder)->PostInitiateDataSourceStop(ds_id);
   } else {
     // otherwise, keep reading
     auto tick_period_ms = it->second.event_config.read_tick_period_ms();
@@ -752,7 +760,7 @@ bool PerfProducer::ReadAndParsePerCpuBuffer(EventReader* reader,
         // Either a kernel thread (no need to obtain proc-fds), or a userspace
         // process but we're not recording userspace callstacks.
         process_state = ProcessTrackingStatus::kAccepted;
-        unwinding_worker_->PostRecordNoUserspaceProcess(ds_id, pid);
+        UnwinderForPid(pid)->PostRecordNoUserspaceProcess(ds_id, pid);
         // note: fallthrough
       }
     }
@@ -774,7 +782,7 @@ bool PerfProducer::ReadAndParsePerCpuBuffer(EventReader* reader,
     uint64_t max_footprint_bytes = event_config.max_enqueued_footprint_bytes();
     uint64_t sample_stack_size = sample->stack.size();
     if (max_footprint_bytes) {
-      uint64_t footprint_bytes = unwinding_worker_->GetEnqueuedFootprint();
+      uint64_t footprint_bytes = GetEnqueuedFootprint();
       if (footprint_bytes + sample_stack_size >= max_footprint_bytes) {
         PERFETTO_DLOG("Skipping sample enqueueing due to footprint limit.");
         EmitSkippedSample(ds_id, std::move(sample.value()),
@@ -784,13 +792,14 @@ bool PerfProducer::ReadAndParsePerCpuBuffer(EventReader* reader,
     }
 
     // Push the sample into the unwinding queue if there is room.
-    auto& queue = unwinding_worker_->unwind_queue();
+    UnwinderHandle& unwinder = UnwinderForPid(pid);
+    auto& queue = unwinder->unwind_queue();
     WriteView write_view = queue.BeginWrite();
     if (write_view.valid) {
       queue.at(write_view.write_pos) =
           UnwindEntry{ds_id, std::move(sample.value())};
       queue.CommitWrite();
-      unwinding_worker_->IncrementEnqueuedFootprint(sample_stack_size);
+      unwinder->IncrementEnqueuedFootprint(sample_stack_size);
     } else {
       PERFETTO_DLOG("Unwinder queue full, skipping sample");
       EmitSkippedSample(ds_id, std::move(sample.value()),
@@ -836,7 +845,7 @@ void PerfProducer::OnProcDescriptors(pid_t pid,
                     static_cast<int>(pid), static_cast<size_t>(it.first));
 
       proc_status_it->second = ProcessTrackingStatus::kAccepted;
-      unwinding_worker_->PostAdoptProcDescriptors(
+      UnwinderForPid(pid)->PostAdoptProcDescriptors(
           it.first, pid, std::move(maps_fd), std::move(mem_fd));
       return;  // done
     }
@@ -899,10 +908,17 @@ void PerfProducer::EvaluateDescriptorLookupTimeout(DataSourceInstanceID ds_id,
     proc_status_it->second = ProcessTrackingStatus::kFdsTimedOut;
     // Also inform the unwinder of the state change (so that it can discard any
     // of the already-enqueued samples).
-    unwinding_worker_->PostRecordTimedOutProcDescriptors(ds_id, pid);
+    UnwinderForPid(pid)->PostRecordTimedOutProcDescriptors(ds_id, pid);
   }
 }
 
+uint64_t PerfProducer::GetEnqueuedFootprint() {
+  uint64_t footprint_bytes = 0;
+  for (auto& unwinder : unwinding_workers_)
+    footprint_bytes += (*unwinder)->GetEnqueuedFootprint();
+  return footprint_bytes;
+}
+
 void PerfProducer::PostEmitSample(DataSourceInstanceID ds_id,
                                   CompletedSample sample) {
   // hack: c++11 lambdas can't be moved into, so stash the sample on the heap.
@@ -978,6 +994,39 @@ void PerfProducer::EmitRingBufferLoss(DataSourceInstanceID ds_id,
   perf_sample->set_kernel_records_lost(records_lost);
 }
 
+void PerfProducer::PostEmitUnwinderStats(DataSourceInstanceID ds_id,
+                                         Unwinder::Stats stats) {
+  auto weak_this = weak_factory_.GetWeakPtr();
+  task_runner_->PostTask([weak_this, ds_id, stats] {
+    if (weak_this)
+      weak_this->EmitUnwinderStats(ds_id, stats);
+  });
+}
+
+void PerfProducer::EmitUnwinderStats(DataSourceInstanceID ds_id,
+                                     const Unwinder::Stats& stats) {
+  auto ds_it = data_sources_.find(ds_id);
+  if (ds_it == data_sources_.end())
+    return;
+  DataSourceState& ds = ds_it->second;
+
+  // Like for the ring buffer loss, the timestamp is only for packet ordering.
+  auto packet = StartTracePacket(ds.trace_writer.get());
+  packet->set_timestamp(static_cast<uint64_t>(base::GetBootTimeNs().count()));
+  packet->set_timestamp_clock_id(
+      protos::pbzero::BuiltinClock::BUILTIN_CLOCK_BOOTTIME);
+
+  auto* unwinder_stats = packet->set_perf_sample()->set_unwinder_stats();
+  unwinder_stats->set_unwinder_id(stats.unwinder_id);
+  unwinder_stats->set_samples_unwound(stats.samples_unwound);
+  unwinder_stats->set_unwind_time_ns(stats.unwind_time_ns);
+  unwinder_stats->set_max_queue_occupancy(
+      static_cast<uint32_t>(stats.max_queue_occupancy));
+  unwinder_stats->set_queue_capacity(kUnwindQueueCapacity);
+  unwinder_stats->set_elf_cache_hits(stats.elf_cache_hits);
+  unwinder_stats->set_elf_cache_misses(stats.elf_cache_misses);
+}
+
 void PerfProducer::PostEmitUnwinderSkippedSample(DataSourceInstanceID ds_id,
                                                  ParsedSample sample) {
   PostEmitSkippedSample(ds_id, std::move(sample),
@@ -1061,6 +1110,10 @@ void PerfProducer::FinishDataSourceStop(DataSourceInstanceID ds_id) {
   DataSourceState& ds = ds_it->second;
   PERFETTO_CHECK(ds.status == DataSourceState::Status::kShuttingDown);
 
+  PERFETTO_CHECK(ds.unwinders_pending_stop > 0);
+  if (--ds.unwinders_pending_stop > 0)
+    return;  // wait for the remaining unwinders
+
   ds.trace_writer->Flush();
   data_sources_.erase(ds_it);
 
@@ -1091,7 +1144,8 @@ void PerfProducer::PurgeDataSource(DataSourceInstanceID ds_id) {
   PERFETTO_LOG("Stopping DataSource(%zu) prematurely",
                static_cast<size_t>(ds_id));
 
-  unwinding_worker_->PostPurgeDataSource(ds_id);
+  for (auto& unwinder : unwinding_workers_)
+    (*unwinder)->PostPurgeDataSource(ds_id);
 
   // Write a packet indicating the abrupt stop.
   {
@@ -1248,10 +1302,12 @@ void PerfProducer::Restart() {
   base::TaskRunner* task_runner = task_runner_;
   const char* socket_name = producer_socket_name_;
   ProcDescriptorGetter* proc_fd_getter = proc_fd_getter_;
+  uint32_t num_unwinder_threads =
+      static_cast<uint32_t>(unwinding_workers_.size());
 
   // Invoke destructor and then the constructor again.
   this->~PerfProducer();
-  new (this) PerfProducer(proc_fd_getter, task_runner);
+  new (this) PerfProducer(proc_fd_getter, task_runner, num_unwinder_threads);
 
   ConnectWithRetries(socket_name);
 }
@@ -21,6 +21,7 @@
 #include <map>
 #include <memory>
 #include <optional>
+#include <vector>
 
 #include <unwindstack/Error.h>
 #include <unwindstack/Regs.h>
@@ -34,6 +35,7 @@
 #include "perfetto/ext/tracing/core/trace_writer.h"
 #include "perfetto/ext/tracing/core/tracing_service.h"
 #include "src/profiling/common/callstack_trie.h"
+#include "src/profiling/common/elf_cache.h"
 #include "src/profiling/common/interning_output.h"
 #include "src/profiling/common/unwind_support.h"
 #include "src/profiling/perf/common_types.h"
@@ -52,13 +54,15 @@ namespace profiling {
 // summary in the mean time: three stages: (1) kernel buffer reader that parses
 // the samples -> (2) callstack unwinder -> (3) interning and serialization of
 // samples. This class handles stages (1) and (3) on the main thread. Unwinding
-// is done by |Unwinder| on a dedicated thread.
+// is done by one or more |Unwinder|s, each on a dedicated thread. Samples are
+// sharded between the unwinders by pid.
 class PerfProducer : public Producer,
                      public ProcDescriptorDelegate,
                      public Unwinder::Delegate {
  public:
   PerfProducer(ProcDescriptorGetter* proc_fd_getter,
-               base::TaskRunner* task_runner);
+               base::TaskRunner* task_runner,
+               uint32_t num_unwinder_threads = 1);
   ~PerfProducer() override = default;
 
   PerfProducer(const PerfProducer&) = delete;
@@ -93,6 +97,8 @@ class PerfProducer : public Producer,
                       CompletedSample sample) override;
   void PostEmitUnwinderSkippedSample(DataSourceInstanceID ds_id,
                                      ParsedSample sample) override;
+  void PostEmitUnwinderStats(DataSourceInstanceID ds_id,
+                             Unwinder::Stats stats) override;
   void PostFinishDataSourceStop(DataSourceInstanceID ds_id) override;
 
   // Calls `cb` when all data sources have been registered.
@@ -101,6 +107,12 @@ class PerfProducer : public Producer,
   }
 
   // public for testing:
+  // Index of the unwinder, amongst |num_unwinders|, that handles the samples
+  // of the given process.
+  static size_t UnwinderIndexForPid(pid_t pid, size_t num_unwinders) {
+    return static_cast<size_t>(pid) % num_unwinders;
+  }
+
   static bool ShouldRejectDueToFilter(
       pid_t pid,
       const TargetFilter& filter,
@@ -167,6 +179,8 @@ class PerfProducer : public Producer,
     // Additional state for EventConfig.TargetFilter: command lines we have
     // decided to unwind, up to a total of additional_cmdline_count values.
     base::FlatSet<std::string> additional_cmdlines;
+    // Number of unwinders that haven't yet finished stopping this source.
+    size_t unwinders_pending_stop = 0;
   };
 
   // For |EmitSkippedSample|.
@@ -207,6 +221,8 @@ class PerfProducer : public Producer,
   void EmitRingBufferLoss(DataSourceInstanceID ds_id,
                           size_t cpu,
                           uint64_t records_lost);
+  void EmitUnwinderStats(DataSourceInstanceID ds_id,
+                         const Unwinder::Stats& stats);
 
   void PostEmitSkippedSample(DataSourceInstanceID ds_id,
                              ParsedSample sample,
@@ -245,6 +261,15 @@ class PerfProducer : public Producer,
 
   void StartMetatraceSource(DataSourceInstanceID ds_id, BufferID target_buffer);
 
+  // Returns the unwinder that handles the samples of the given process.
+  UnwinderHandle& UnwinderForPid(pid_t pid) {
+    return *unwinding_workers_[UnwinderIndexForPid(
+        pid, unwinding_workers_.size())];
+  }
+
+  // Sum of the footprints of all the unwinding queues.
+  uint64_t GetEnqueuedFootprint();
+
   // Task runner owned by the main thread.
   base::TaskRunner* const task_runner_;
   State state_ = kNotStarted;
@@ -274,8 +299,12 @@ class PerfProducer : public Producer,
   // State associated with perf-sampling data sources.
   std::map<DataSourceInstanceID, DataSourceState> data_sources_;
 
-  // Unwinding stage, running on a dedicated thread.
-  UnwinderHandle unwinding_worker_;
+  // Reuses the parsed unwinding info of the mapped files across processes and
+  // data sources. Shared by the unwinders, must outlive them.
+  ElfCache elf_cache_;
+
+  // Unwinding stage, each unwinder running on a dedicated thread. Never empty.
+  std::vector<std::unique_ptr<UnwinderHandle>> unwinding_workers_;
 
   // Used for tracepoint name -> id lookups. Initialized lazily, and in general
   // best effort - can be null if tracefs isn't accessible.
@@ -18,6 +18,7 @@
 
 #include <stdint.h>
 #include <optional>
+#include <vector>
 
 #include "perfetto/base/logging.h"
 #include "test/gtest_and_gmock.h"
@@ -197,6 +198,24 @@ TEST(TargetFilterTest, AdditionalCmdlines) {
   EXPECT_EQ(extra_cmds.count("/bin/top"), 0u);
 }
 
+TEST(UnwinderShardingTest, SameUnwinderForAllSamplesOfAProcess) {
+  // A single unwinder handles everything.
+  for (pid_t pid : {0, 1, 42, 32768})
+    EXPECT_EQ(PerfProducer::UnwinderIndexForPid(pid, 1), 0u);
+
+  // The processes are spread across all of the unwinders, and a given pid is
+  // always assigned to the same one.
+  static constexpr size_t kNumUnwinders = 4;
+  std::vector<size_t> processes_per_unwinder(kNumUnwinders);
+  for (pid_t pid = 1; pid <= 400; pid++) {
+    size_t index = PerfProducer::UnwinderIndexForPid(pid, kNumUnwinders);
+    ASSERT_LT(index, kNumUnwinders);
+    EXPECT_EQ(PerfProducer::UnwinderIndexForPid(pid, kNumUnwinders), index);
+    processes_per_unwinder[index]++;
+  }
+  EXPECT_THAT(processes_per_unwinder, ::testing::Each(100u));
+}
+
 }  // namespace
 }  // namespace profiling
 }  // namespace perfetto
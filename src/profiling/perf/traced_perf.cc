@@ -16,6 +16,8 @@
 
 #include "src/profiling/perf/traced_perf.h"
 #include "perfetto/ext/base/file_utils.h"
+#include "perfetto/ext/base/getopt.h"
+#include "perfetto/ext/base/string_utils.h"
 #include "perfetto/ext/base/unix_task_runner.h"
 #include "perfetto/ext/tracing/ipc/default_socket.h"
 #include "src/profiling/perf/perf_producer.h"
@@ -24,6 +26,10 @@
 namespace perfetto {
 
 namespace {
+// Upper bound for --unwinder-threads, there is no point in having more
+// unwinders than cpus to sample.
+constexpr uint32_t kMaxUnwinderThreads = 256;
+
 #if PERFETTO_BUILDFLAG(PERFETTO_ANDROID_BUILD)
 static constexpr char kTracedPerfSocketEnvVar[] = "ANDROID_SOCKET_traced_perf";
 
@@ -41,7 +47,35 @@ int GetRawInheritedListeningSocket() {
 }  // namespace
 
 // TODO(rsavitski): watchdog.
-int TracedPerfMain(int, char**) {
+int TracedPerfMain(int argc, char** argv) {
+  // Number of threads unwinding the sampled callstacks. Samples are sharded
+  // between the threads by pid, so more threads help only when sampling
+  // several processes at high frequencies.
+  uint32_t num_unwinder_threads = 1;
+
+  enum { kUnwinderThreads = 256 };
+  static option long_options[] = {
+      {"unwinder-threads", required_argument, nullptr, kUnwinderThreads},
+      {nullptr, 0, nullptr, 0}};
+  int c;
+  while ((c = getopt_long(argc, argv, "", long_options, nullptr)) != -1) {
+    switch (c) {
+      case kUnwinderThreads: {
+        std::optional<uint32_t> threads = base::CStringToUInt32(optarg);
+        if (!threads || *threads == 0 || *threads > kMaxUnwinderThreads) {
+          PERFETTO_ELOG("--unwinder-threads must be in [1, %u]",
+                        kMaxUnwinderThreads);
+          return 1;
+        }
+        num_unwinder_threads = *threads;
+        break;
+      }
+      default:
+        PERFETTO_ELOG("Usage: %s [--unwinder-threads N]", argv[0]);
+        return 1;
+    }
+  }
+
   base::UnixTaskRunner task_runner;
 
 // TODO(rsavitski): support standalone --root or similar on android.
@@ -52,7 +86,8 @@ int TracedPerfMain(int, char**) {
   DirectDescriptorGetter proc_fd_getter;
 #endif
 
-  profiling::PerfProducer producer(&proc_fd_getter, &task_runner);
+  profiling::PerfProducer producer(&proc_fd_getter, &task_runner,
+                                   num_unwinder_threads);
   const char* env_notif = getenv("TRACED_PERF_NOTIFY_FD");
   if (env_notif) {
     int notif_fd = atoi(env_notif);
@@ -16,11 +16,14 @@
 
 #include "src/profiling/perf/unwinding.h"
 
+#include <algorithm>
 #include <cinttypes>
 #include <mutex>
+#include <shared_mutex>
 
 #include <unwindstack/Unwinder.h>
 
+#include "perfetto/base/time.h"
 #include "perfetto/ext/base/metatrace.h"
 #include "perfetto/ext/base/no_destructor.h"
 #include "perfetto/ext/base/thread_utils.h"
@@ -29,6 +32,15 @@
 namespace {
 constexpr size_t kUnwindingMaxFrames = 1000;
 constexpr uint32_t kDataSourceShutdownRetryDelayMs = 400;
+
+// Libunwindstack uses unsynchronized static state for the Elf cache, which is
+// (re)created and destroyed when toggling the caching. Toggling must therefore
+// not race with unwinding on other threads, so unwinds hold this lock in shared
+// mode, and toggling the cache takes it in exclusive mode.
+std::shared_mutex& UnwindstackCacheMutex() {
+  static std::shared_mutex* mutex = new std::shared_mutex{};
+  return *mutex;
+}
 }  // namespace
 
 namespace perfetto {
@@ -36,8 +48,14 @@ namespace profiling {
 
 Unwinder::Delegate::~Delegate() = default;
 
-Unwinder::Unwinder(Delegate* delegate, base::UnixTaskRunner* task_runner)
-    : task_runner_(task_runner), delegate_(delegate) {
+Unwinder::Unwinder(Delegate* delegate,
+                   base::UnixTaskRunner* task_runner,
+                   uint32_t unwinder_id,
+                   ElfCache* elf_cache)
+    : task_runner_(task_runner),
+      delegate_(delegate),
+      unwinder_id_(unwinder_id),
+      elf_cache_(elf_cache) {
   ResetAndEnableUnwindstackCache();
   base::MaybeSetThreadName("stack-unwinding");
 }
@@ -113,7 +131,7 @@ void Unwinder::AdoptProcDescriptors(DataSourceInstanceID ds_id,
 
   proc_state.status = ProcessState::Status::kFdsResolved;
   proc_state.unwind_state =
-      UnwindingMetadata{std::move(maps_fd), std::move(mem_fd)};
+      UnwindingMetadata{std::move(maps_fd), std::move(mem_fd), elf_cache_};
 }
 
 void Unwinder::PostRecordTimedOutProcDescriptors(DataSourceInstanceID ds_id,
@@ -205,13 +223,19 @@ base::FlatSet<DataSourceInstanceID> Unwinder::ConsumeAndUnwindReadySamples() {
   // Use a single snapshot of the ring buffer pointers.
   ReadView read_view = unwind_queue_.BeginRead();
 
-  PERFETTO_METATRACE_COUNTER(
-      TAG_PRODUCER, PROFILER_UNWIND_QUEUE_SZ,
-      static_cast<int32_t>(read_view.write_pos - read_view.read_pos));
+  const uint64_t queue_occupancy = read_view.write_pos - read_view.read_pos;
+  PERFETTO_METATRACE_COUNTER(TAG_PRODUCER, PROFILER_UNWIND_QUEUE_SZ,
+                             static_cast<int32_t>(queue_occupancy));
 
   if (read_view.read_pos == read_view.write_pos)
     return pending_sample_sources;
 
+  for (auto& id_and_ds : data_sources_) {
+    DataSourceState& ds = id_and_ds.second;
+    ds.stats.max_queue_occupancy =
+        std::max(ds.stats.max_queue_occupancy, queue_occupancy);
+  }
+
   // Walk the queue.
   for (auto read_pos = read_view.read_pos; read_pos < read_view.write_pos;
        read_pos++) {
@@ -275,9 +299,17 @@ base::FlatSet<DataSourceInstanceID> Unwinder::ConsumeAndUnwindReadySamples() {
           (proc_state.unwind_state.has_value()
                ? &proc_state.unwind_state.value()
                : nullptr);
-      CompletedSample unwound_sample = UnwindSample(
-          entry.sample, opt_user_state, proc_state.attempted_unwinding);
+      const auto start = base::GetWallTimeNs();
+      CompletedSample unwound_sample;
+      {
+        std::shared_lock<std::shared_mutex> cache_lock(UnwindstackCacheMutex());
+        unwound_sample = UnwindSample(entry.sample, opt_user_state,
+                                      proc_state.attempted_unwinding);
+      }
       proc_state.attempted_unwinding = true;
+      ds.stats.samples_unwound++;
+      ds.stats.unwind_time_ns +=
+          static_cast<uint64_t>((base::GetWallTimeNs() - start).count());
 
       PERFETTO_METATRACE_COUNTER(TAG_PRODUCER, PROFILER_UNWIND_CURRENT_PID, 0);
 
@@ -402,6 +434,7 @@ CompletedSample Unwinder::UnwindSample(const ParsedSample& sample,
     // reunwind attempt
     unwind = attempt_unwind();
   }
+  unwind_state->fd_maps.AddElfsToCache(unwind.frames);
 
   ret.build_ids.reserve(kernel_frames_size + unwind.frames.size());
   ret.frames.reserve(kernel_frames_size + unwind.frames.size());
@@ -494,6 +527,25 @@ void Unwinder::FinishDataSourceStop(DataSourceInstanceID ds_id) {
     return;
   DataSourceState& ds = it->second;
 
+  Stats stats = ds.stats;
+  stats.unwinder_id = unwinder_id_;
+  for (const auto& pid_and_process : ds.process_states) {
+    const ProcessState& proc_state = pid_and_process.second;
+    if (proc_state.unwind_state.has_value()) {
+      stats.elf_cache_hits += proc_state.unwind_state->fd_maps.elf_cache_hits();
+      stats.elf_cache_misses +=
+          proc_state.unwind_state->fd_maps.elf_cache_misses();
+    }
+  }
+  PERFETTO_LOG("Unwinder %" PRIu32 " stats for DS(%zu): %" PRIu64
+               " samples unwound in %" PRIu64
+               " ms, max queue occupancy %" PRIu64 "/%" PRIu32
+               ", elf cache hits %" PRIu64 " misses %" PRIu64,
+               unwinder_id_, static_cast<size_t>(ds_id),
+               ds.stats.samples_unwound, ds.stats.unwind_time_ns / 1000000,
+               ds.stats.max_queue_occupancy, kUnwindQueueCapacity,
+               stats.elf_cache_hits, stats.elf_cache_misses);
+
   // Drop unwinder's state tied to the source.
   PERFETTO_CHECK(ds.status == DataSourceState::Status::kShuttingDown);
   data_sources_.erase(it);
@@ -505,6 +557,7 @@ void Unwinder::FinishDataSourceStop(DataSourceInstanceID ds_id) {
   }
 
   // Inform service thread that the unwinder is done with the source.
+  delegate_->PostEmitUnwinderStats(ds_id, stats);
   delegate_->PostFinishDataSourceStop(ds_id);
 }
 
@@ -558,7 +611,12 @@ void Unwinder::ClearCachedStatePeriodic(DataSourceInstanceID ds_id,
     if (pid_and_process.second.status == ProcessState::Status::kFdsResolved)
       pid_and_process.second.unwind_state->fd_maps.Reset();
   }
-  ResetAndEnableUnwindstackCache();
+  // The caches are shared by all the unwinders, which all run this task: only
+  // the first one clears them, so that they're cleared once per period.
+  if (unwinder_id_ == 0) {
+    elf_cache_->Clear();
+    ResetAndEnableUnwindstackCache();
+  }
   base::MaybeReleaseAllocatorMemToOS();
 
   PostClearCachedStatePeriodic(ds_id, period_ms);  // repost
@@ -567,13 +625,12 @@ void Unwinder::ClearCachedStatePeriodic(DataSourceInstanceID ds_id,
 void Unwinder::ResetAndEnableUnwindstackCache() {
   PERFETTO_DLOG("Resetting unwindstack cache");
   // Libunwindstack uses an unsynchronized variable for setting/checking whether
-  // the cache is enabled. Therefore unwinding and cache toggling should stay on
-  // the same thread, but we might be moving unwinding across threads if we're
-  // recreating |Unwinder| instances (during a reconnect to traced). Therefore,
-  // use our own static lock to synchronize the cache toggling.
+  // the cache is enabled. As there can be several unwinders running on
+  // different threads (and they are recreated on a reconnect to traced), use
+  // our own static lock to synchronize the cache toggling with unwinding.
+  // Note that this also drops the cached state of the other unwinders.
   // TODO(rsavitski): consider fixing this in libunwindstack itself.
-  static std::mutex* lock = new std::mutex{};
-  std::lock_guard<std::mutex> guard{*lock};
+  std::unique_lock<std::shared_mutex> guard(UnwindstackCacheMutex());
   unwindstack::Elf::SetCachingEnabled(false);  // free any existing state
   unwindstack::Elf::SetCachingEnabled(true);   // reallocate a fresh cache
 }
@@ -33,6 +33,7 @@
 #include "perfetto/ext/tracing/core/basic_types.h"
 #include "src/kallsyms/kernel_symbol_map.h"
 #include "src/kallsyms/lazy_kernel_symbolizer.h"
+#include "src/profiling/common/elf_cache.h"
 #include "src/profiling/common/unwind_support.h"
 #include "src/profiling/perf/common_types.h"
 #include "src/profiling/perf/unwind_queue.h"
@@ -48,6 +49,11 @@ constexpr static uint32_t kUnwindQueueCapacity = 1024;
 // symbolisation using /proc/kallsyms is necessary. Has a single unwinding ring
 // queue, shared across all data sources.
 //
+// The producer can run several unwinders, each on its own thread and with its
+// own queue. Samples are then sharded between the unwinders by pid, so that
+// all of the state for a given process (e.g. its |UnwindingMetadata|) is only
+// ever used by one thread.
+//
 // Userspace samples cannot be unwound without having /proc/<pid>/{maps,mem}
 // file descriptors for that process. This lookup can be asynchronous (e.g. on
 // Android), so the unwinder might have to wait before it can process (or
@@ -75,6 +81,20 @@ class Unwinder {
  public:
   friend class UnwinderHandle;
 
+  // Per-data-source stats of an unwinder, reported when the source stops.
+  struct Stats {
+    uint32_t unwinder_id = 0;
+    uint64_t samples_unwound = 0;
+    uint64_t unwind_time_ns = 0;
+    // The maximum number of entries seen in the queue while the data source
+    // was active (including the entries of other data sources).
+    uint64_t max_queue_occupancy = 0;
+    // Summed over the processes unwound for the data source, see
+    // FDMaps::elf_cache_hits().
+    uint64_t elf_cache_hits = 0;
+    uint64_t elf_cache_misses = 0;
+  };
+
   // Callbacks from the unwinder to the primary producer thread.
   class Delegate {
    public:
@@ -82,6 +102,9 @@ class Unwinder {
                                 CompletedSample sample) = 0;
     virtual void PostEmitUnwinderSkippedSample(DataSourceInstanceID ds_id,
                                                ParsedSample sample) = 0;
+    // Called right before PostFinishDataSourceStop().
+    virtual void PostEmitUnwinderStats(DataSourceInstanceID ds_id,
+                                       Stats stats) = 0;
     virtual void PostFinishDataSourceStop(DataSourceInstanceID ds_id) = 0;
 
     virtual ~Delegate();
@@ -147,6 +170,9 @@ class Unwinder {
 
     Status status = Status::kActive;
     std::map<pid_t, ProcessState> process_states;
+
+    // Reported to the delegate when the data source stops.
+    Stats stats;
   };
 
   // Accounting for how much heap memory is attached to the enqueued samples at
@@ -159,7 +185,10 @@ class Unwinder {
   };
 
   // Must be instantiated via the |UnwinderHandle|.
-  Unwinder(Delegate* delegate, base::UnixTaskRunner* task_runner);
+  Unwinder(Delegate* delegate,
+           base::UnixTaskRunner* task_runner,
+           uint32_t unwinder_id,
+           ElfCache* elf_cache);
 
   // Marks the data source as valid and active at the unwinding stage.
   // Initializes kernel address symbolization if needed.
@@ -210,8 +239,10 @@ class Unwinder {
   }
 
   // Clears the parsed maps for all previously-sampled processes, and resets the
-  // libunwindstack cache. This has the effect of deallocating the cached Elf
-  // objects within libunwindstack, which take up non-trivial amounts of memory.
+  // libunwindstack cache as well as the |ElfCache|. This has the effect of
+  // deallocating the cached Elf objects, which take up non-trivial amounts of
+  // memory. The two caches are shared by all the unwinders, and only the one
+  // with id 0 resets them.
   //
   // There are two reasons for having this operation:
   // * over a longer trace, it's desireable to drop heavy state for processes
@@ -243,6 +274,10 @@ class Unwinder {
 
   base::UnixTaskRunner* const task_runner_;
   Delegate* const delegate_;
+  // Index of this unwinder amongst the ones owned by the producer, for logging.
+  const uint32_t unwinder_id_;
+  // Shared with the other unwinders.
+  ElfCache* const elf_cache_;
   UnwindQueue<UnwindEntry, kUnwindQueueCapacity> unwind_queue_;
   QueueFootprintTracker footprint_tracker_;
   std::map<DataSourceInstanceID, DataSourceState> data_sources_;
@@ -257,7 +292,9 @@ class Unwinder {
 // owned state, and consolidate.
 class UnwinderHandle {
  public:
-  explicit UnwinderHandle(Unwinder::Delegate* delegate) {
+  UnwinderHandle(Unwinder::Delegate* delegate,
+                 uint32_t unwinder_id,
+                 ElfCache* elf_cache) {
     std::mutex init_lock;
     std::condition_variable init_cv;
 
@@ -275,7 +312,8 @@ class UnwinderHandle {
         };
 
     thread_ = std::thread(&UnwinderHandle::RunTaskThread, this,
-                          std::move(initializer), delegate);
+                          std::move(initializer), delegate, unwinder_id,
+                          elf_cache);
 
     std::unique_lock<std::mutex> lock(init_lock);
     init_cv.wait(lock, [this] { return !!task_runner_ && !!unwinder_; });
@@ -297,9 +335,11 @@ class UnwinderHandle {
  private:
   void RunTaskThread(
       std::function<void(base::UnixTaskRunner*, Unwinder*)> initializer,
-      Unwinder::Delegate* delegate) {
+      Unwinder::Delegate* delegate,
+      uint32_t unwinder_id,
+      ElfCache* elf_cache) {
     base::UnixTaskRunner task_runner;
-    Unwinder unwinder(delegate, &task_runner);
+    Unwinder unwinder(delegate, &task_runner, unwinder_id, elf_cache);
     task_runner.PostTask(
         std::bind(std::move(initializer), &task_runner, &unwinder));
     task_runner.Run();
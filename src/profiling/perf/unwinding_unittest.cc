@@ -0,0 +1,160 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/profiling/perf/unwinding.h"
+
+#include <stdint.h>
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "src/base/test/test_task_runner.h"
+#include "src/profiling/common/elf_cache.h"
+#include "src/profiling/perf/perf_producer.h"
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace profiling {
+namespace {
+
+constexpr DataSourceInstanceID kDsId = 42;
+
+// Records the callbacks of the unwinders on the test's main thread, like the
+// producer does.
+class FakeDelegate : public Unwinder::Delegate {
+ public:
+  explicit FakeDelegate(base::TestTaskRunner* task_runner)
+      : task_runner_(task_runner) {}
+
+  void PostEmitSample(DataSourceInstanceID ds_id,
+                      CompletedSample sample) override {
+    pid_t pid = sample.common.pid;
+    task_runner_->PostTask([this, ds_id, pid] {
+      EXPECT_EQ(ds_id, kDsId);
+      emitted_pids.push_back(pid);
+    });
+  }
+
+  void PostEmitUnwinderSkippedSample(DataSourceInstanceID,
+                                     ParsedSample) override {
+    ADD_FAILURE() << "Unexpected skipped sample";
+  }
+
+  void PostEmitUnwinderStats(DataSourceInstanceID ds_id,
+                             Unwinder::Stats stats) override {
+    task_runner_->PostTask([this, ds_id, stats] {
+      EXPECT_EQ(ds_id, kDsId);
+      EXPECT_EQ(stats_.count(stats.unwinder_id), 0u);
+      stats_[stats.unwinder_id] = stats;
+    });
+  }
+
+  void PostFinishDataSourceStop(DataSourceInstanceID ds_id) override {
+    task_runner_->PostTask([this, ds_id] {
+      EXPECT_EQ(ds_id, kDsId);
+      stops_acked++;
+      if (on_stop_acked)
+        on_stop_acked();
+    });
+  }
+
+  const std::map<uint32_t, Unwinder::Stats>& stats() const { return stats_; }
+
+  std::vector<pid_t> emitted_pids;
+  size_t stops_acked = 0;
+  std::function<void()> on_stop_acked;
+
+ private:
+  base::TestTaskRunner* const task_runner_;
+  std::map<uint32_t, Unwinder::Stats> stats_;
+};
+
+// Enqueues a sample of a kernel thread, which needs no proc-fds to be unwound.
+void EnqueueSample(UnwinderHandle* unwinder, pid_t pid) {
+  ParsedSample sample;
+  sample.common.pid = pid;
+  sample.common.tid = pid;
+  auto& queue = (*unwinder)->unwind_queue();
+  WriteView write_view = queue.BeginWrite();
+  ASSERT_TRUE(write_view.valid);
+  queue.at(write_view.write_pos) = UnwindEntry{kDsId, std::move(sample)};
+  queue.CommitWrite();
+}
+
+TEST(UnwinderTest, SamplesShardedByPidAndStopAckedByAllUnwinders) {
+  static constexpr size_t kNumUnwinders = 3;
+  base::TestTaskRunner task_runner;
+  FakeDelegate delegate(&task_runner);
+  ElfCache elf_cache;
+  std::vector<std::unique_ptr<UnwinderHandle>> unwinders;
+  for (uint32_t i = 0; i < kNumUnwinders; i++)
+    unwinders.emplace_back(new UnwinderHandle(&delegate, i, &elf_cache));
+
+  for (auto& unwinder : unwinders)
+    (*unwinder)->PostStartDataSource(kDsId, /*kernel_frames=*/false);
+
+  // Route the samples like the producer does. Each process is assigned to one
+  // unwinder only, which must be told about the process before its samples.
+  std::vector<pid_t> pids = {1, 2, 3, 4, 5, 6, 7, 100};
+  std::map<size_t, uint64_t> expected_samples_per_unwinder;
+  for (pid_t pid : pids) {
+    size_t index = PerfProducer::UnwinderIndexForPid(pid, kNumUnwinders);
+    ASSERT_LT(index, kNumUnwinders);
+    (*unwinders[index])->PostRecordNoUserspaceProcess(kDsId, pid);
+    for (int i = 0; i < 2; i++) {
+      EnqueueSample(unwinders[index].get(), pid);
+      expected_samples_per_unwinder[index]++;
+    }
+  }
+  for (auto& unwinder : unwinders)
+    (*unwinder)->PostProcessQueue();
+
+  // The data source is stopped on all of the unwinders, and each of them acks
+  // the stop once, after having emitted all of its samples and its stats.
+  auto all_stopped = task_runner.CreateCheckpoint("all_stopped");
+  delegate.on_stop_acked = [&] {
+    EXPECT_GE(delegate.stats().size(), delegate.stops_acked);
+    if (delegate.stops_acked == kNumUnwinders)
+      all_stopped();
+  };
+  for (auto& unwinder : unwinders)
+    (*unwinder)->PostInitiateDataSourceStop(kDsId);
+  task_runner.RunUntilCheckpoint("all_stopped");
+  EXPECT_EQ(delegate.stops_acked, kNumUnwinders);
+
+  std::vector<pid_t> expected_pids;
+  for (pid_t pid : pids) {
+    expected_pids.push_back(pid);
+    expected_pids.push_back(pid);
+  }
+  EXPECT_THAT(delegate.emitted_pids,
+              ::testing::UnorderedElementsAreArray(expected_pids));
+
+  ASSERT_EQ(delegate.stats().size(), kNumUnwinders);
+  for (uint32_t i = 0; i < kNumUnwinders; i++) {
+    const Unwinder::Stats& stats = delegate.stats().at(i);
+    EXPECT_EQ(stats.unwinder_id, i);
+    EXPECT_EQ(stats.samples_unwound, expected_samples_per_unwinder[i]);
+    EXPECT_GT(stats.max_queue_occupancy, 0u);
+    EXPECT_LE(stats.max_queue_occupancy, expected_samples_per_unwinder[i]);
+  }
+}
+
+}  // namespace
+}  // namespace profiling
+}  // namespace perfetto
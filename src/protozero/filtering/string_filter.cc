@@ -16,6 +16,8 @@
 
 #include "src/protozero/filtering/string_filter.h"
 
+#include <cctype>
+#include <cstdint>
 #include <cstring>
 #include <regex>
 #include <string_view>
@@ -90,6 +92,150 @@ void RedactMatches(const Matches& matches) {
   }
 }
 
+// Returns the position after the character class starting at |pos| (i.e.
+// after the closing ']'), or npos if the class is not terminated.
+size_t SkipCharClass(std::string_view pattern, size_t pos) {
+  PERFETTO_DCHECK(pattern[pos] == '[');
+  for (size_t i = pos + 1; i < pattern.size(); ++i) {
+    if (pattern[i] == '\\') {
+      ++i;
+    } else if (pattern[i] == ']') {
+      return i + 1;
+    }
+  }
+  return std::string_view::npos;
+}
+
+// Returns the position after the group starting at |pos| (i.e. after the
+// matching ')'), or npos if the group is not terminated.
+size_t SkipGroup(std::string_view pattern, size_t pos) {
+  PERFETTO_DCHECK(pattern[pos] == '(');
+  uint32_t depth = 0;
+  for (size_t i = pos; i < pattern.size();) {
+    char c = pattern[i];
+    if (c == '\\') {
+      i += 2;
+    } else if (c == '[') {
+      i = SkipCharClass(pattern, i);
+    } else {
+      if (c == '(') {
+        depth++;
+      } else if (c == ')' && --depth == 0) {
+        return i + 1;
+      }
+      i++;
+    }
+  }
+  return std::string_view::npos;
+}
+
+// Finds the literals which every string fully matched by |pattern| must
+// start with (|prefix|) and contain (|literal|, the longest run of literal
+// characters after the prefix).
+//
+// Only a subset of the ECMAScript syntax is understood: the pattern is split
+// into a sequence of atoms (literal characters, escapes, character classes,
+// groups and '.'), and a run of literals is broken by any other atom or by a
+// quantifier. Returns false for anything else (e.g. a top-level alternation,
+// backreferences), in which case the literals must not be used.
+bool FindRequiredLiterals(std::string_view pattern,
+                          std::string* prefix,
+                          std::string* literal) {
+  std::string run;
+  bool run_is_prefix = true;
+  auto end_run = [&] {
+    if (run_is_prefix) {
+      *prefix = run;
+    } else if (run.size() > literal->size()) {
+      *literal = run;
+    }
+    run_is_prefix = false;
+    run.clear();
+  };
+
+  size_t i = 0;
+  if (!pattern.empty() && pattern[0] == '^')
+    i++;
+  while (i < pattern.size()) {
+    char c = pattern[i];
+    size_t next = i + 1;
+    bool is_literal = false;
+    if (c == '\\') {
+      if (next == pattern.size())
+        return false;
+      char escaped = pattern[next++];
+      if (escaped == 'n') {
+        is_literal = true;
+        c = '\n';
+      } else if (escaped == 't') {
+        is_literal = true;
+        c = '\t';
+      } else if (!isalnum(static_cast<unsigned char>(escaped))) {
+        is_literal = true;
+        c = escaped;
+      } else if (!strchr("dDwWsSbB", escaped)) {
+        // Backreferences, hex and control escapes.
+        return false;
+      }
+    } else if (c == '[') {
+      next = SkipCharClass(pattern, i);
+    } else if (c == '(') {
+      next = SkipGroup(pattern, i);
+    } else if (c == '$' && next == pattern.size()) {
+      break;
+    } else if (strchr("|^$)]{}*+?", c)) {
+      return false;
+    } else {
+      is_literal = c != '.';
+    }
+    if (next == std::string_view::npos)
+      return false;
+
+    // Handle the quantifier of the atom, if any.
+    char quantifier = next < pattern.size() ? pattern[next] : '\0';
+    if (quantifier == '*' || quantifier == '?' || quantifier == '{' ||
+        quantifier == '+') {
+      // With '+' the atom is there at least once, but might be followed by
+      // copies of itself. Otherwise it might not be there at all.
+      if (quantifier == '+' && is_literal)
+        run.push_back(c);
+      end_run();
+      if (quantifier == '{')
+        next = pattern.find('}', next);
+      if (next == std::string_view::npos)
+        return false;
+      next++;
+      // Skip the lazy modifier.
+      if (next < pattern.size() && pattern[next] == '?')
+        next++;
+    } else if (is_literal) {
+      run.push_back(c);
+    } else {
+      end_run();
+    }
+    i = next;
+  }
+  end_run();
+  return true;
+}
+
+// Returns false if the string [ptr, end) can't match a pattern, because it
+// doesn't start with or contain the literals required by the pattern (see
+// FindRequiredLiterals()).
+bool MayMatch(const std::string& required_prefix,
+              const std::string& required_literal,
+              const char* ptr,
+              const char* end) {
+  if (!StartsWith(ptr, end, required_prefix))
+    return false;
+  if (required_literal.empty())
+    return true;
+  std::string_view rest(ptr + required_prefix.size(),
+                        static_cast<size_t>(end - ptr) -
+                            required_prefix.size());
+  return rest.find(required_literal) != std::string_view::npos;
+}
+
 }  // namespace
 
 void StringFilter::AddRule(Policy policy,
@@ -99,7 +245,13 @@ void StringFilter::AddRule(Policy policy,
       policy,
       std::regex(pattern_str.begin(), pattern_str.end(),
                  std::regex::ECMAScript | std::regex_constants::optimize),
-      std::move(atrace_payload_starts_with)});
+      std::move(atrace_payload_starts_with), "", ""});
+  Rule& rule = rules_.back();
+  if (!FindRequiredLiterals(pattern_str, &rule.required_prefix,
+                            &rule.required_literal)) {
+    rule.required_prefix.clear();
+    rule.required_literal.clear();
+  }
 }
 
 bool StringFilter::MaybeFilterInternal(char* ptr, size_t len) const {
@@ -110,7 +262,9 @@ bool StringFilter::MaybeFilterInternal(char* ptr, size_t len) const {
     switch (rule.policy) {
       case Policy::kMatchRedactGroups:
       case Policy::kMatchBreak:
-        if (std::regex_match(ptr, ptr + len, matches, rule.pattern)) {
+        if (MayMatch(rule.required_prefix, rule.required_literal, ptr,
+                     ptr + len) &&
+            std::regex_match(ptr, ptr + len, matches, rule.pattern)) {
           if (rule.policy == Policy::kMatchBreak) {
             return false;
           }
@@ -127,6 +281,8 @@ bool StringFilter::MaybeFilterInternal(char* ptr, size_t len) const {
         if (atrace_payload_ptr &&
             StartsWith(atrace_payload_ptr, ptr + len,
                        rule.atrace_payload_starts_with) &&
+            MayMatch(rule.required_prefix, rule.required_literal, ptr,
+                     ptr + len) &&
             std::regex_match(ptr, ptr + len, matches, rule.pattern)) {
           if (rule.policy == Policy::kAtraceMatchBreak) {
             return false;
@@ -53,6 +53,11 @@ class StringFilter {
     Policy policy;
     std::regex pattern;
     std::string atrace_payload_starts_with;
+    // Literals that every string matching |pattern| starts with and
+    // contains, respectively. Used to skip running |pattern| on most of the
+    // strings. Empty if unknown.
+    std::string required_prefix;
+    std::string required_literal;
   };
 
   bool MaybeFilterInternal(char* ptr, size_t len) const;
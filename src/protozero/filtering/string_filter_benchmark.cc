@@ -128,3 +128,50 @@ static void BM_ProtozeroStringRewriterAtraceRedactCommon(
 BENCHMARK(BM_ProtozeroStringRewriterAtraceRedactCommon)
     ->Unit(benchmark::kMillisecond)
     ->Arg(10);
+
+// A rule set similar to the ones used to redact atrace strings on Android
+// devices: a mix of atrace and plain rules, most of which never match.
+static void BM_ProtozeroStringRewriterRealisticRules(benchmark::State& state) {
+  struct RuleSpec {
+    Policy policy;
+    const char* regex;
+    const char* atrace;
+  };
+  static const RuleSpec kRules[] = {
+      {Policy::kAtraceMatchRedactGroups, R"(S\|[^|]+\|\*job\*\/.*\/.*\/(.*)\n)",
+       "*job*"},
+      {Policy::kAtraceMatchRedactGroups,
+       R"(F\|[^|]+\|\*job\*\/.*\/.*\/(.*)\|\d+\n)", "*job*"},
+      {Policy::kAtraceMatchRedactGroups, R"(S\|[^|]+\|\*sync\*\/.*\/(.*)\n)",
+       "*sync*"},
+      {Policy::kAtraceMatchRedactGroups, R"(B\|[^|]+\|VerifyClass (.*)\n)",
+       "VerifyClass"},
+      {Policy::kMatchBreak, R"(B\|[^|]+\|Choreographer#doFrame \d+\n)", ""},
+      {Policy::kMatchRedactGroups,
+       R"(B\|[^|]+\|Lock contention on a monitor lock \(owner tid: (.*)\n)",
+       ""},
+      {Policy::kMatchRedactGroups, R"(B\|[^|]+\|sendMessage: (.*)\n)", ""},
+      {Policy::kMatchRedactGroups,
+       R"(B\|[^|]+\|AssetManager::OpenAsset\((.*)\)\n)", ""},
+  };
+  protozero::StringFilter rewriter;
+  for (const RuleSpec& rule : kRules) {
+    rewriter.AddRule(rule.policy, rule.regex, rule.atrace);
+  }
+
+  std::vector<char> storage;
+  auto strs = LoadTraceStrings(state, storage);
+  for (auto _ : state) {
+    uint32_t match = 0;
+    for (auto& str : strs) {
+      match += rewriter.MaybeFilter(storage.data() + str.first, str.second);
+    }
+    benchmark::DoNotOptimize(match);
+  }
+  state.counters["time/string"] =
+      benchmark::Counter(static_cast<double>(strs.size()),
+                         benchmark::Counter::kIsIterationInvariantRate |
+                             benchmark::Counter::kInvert);
+}
+BENCHMARK(BM_ProtozeroStringRewriterRealisticRules)
+    ->Unit(benchmark::kMillisecond);
@@ -226,5 +226,51 @@ TEST(StringFilterTest, AtraceRedactionNonUtf) {
   ASSERT_EQ(metatrace, metatrace_copy);
 }
 
+// The rules are only run on the strings containing the literals required by
+// their pattern: check that optional characters are not required.
+TEST(StringFilterTest, RegexRedactionOptionalLiterals) {
+  StringFilter filter;
+  filter.AddRule(StringFilter::Policy::kMatchRedactGroups,
+                 R"(B\|\d+\|fo?o\.b*ar x{0,2}(.*))", "");
+
+  std::string res = "B|1234|fo.ar 1234";
+  ASSERT_TRUE(filter.MaybeFilter(res.data(), res.size()));
+  ASSERT_EQ(res, "B|1234|fo.ar P60R");
+
+  res = "B|1234|foo.bbar xx1234";
+  ASSERT_TRUE(filter.MaybeFilter(res.data(), res.size()));
+  ASSERT_EQ(res, "B|1234|foo.bbar xxP60R");
+
+  res = "B|1234|foo-bar 1234";
+  ASSERT_FALSE(filter.MaybeFilter(res.data(), res.size()));
+  ASSERT_EQ(res, "B|1234|foo-bar 1234");
+}
+
+TEST(StringFilterTest, RegexRedactionAlternation) {
+  StringFilter filter;
+  filter.AddRule(StringFilter::Policy::kMatchRedactGroups,
+                 R"(B\|\d+\|foo|C\|\d+\|(?:bar|baz) (.*))", "");
+
+  std::string res = "C|1234|baz 1234";
+  ASSERT_TRUE(filter.MaybeFilter(res.data(), res.size()));
+  ASSERT_EQ(res, "C|1234|baz P60R");
+}
+
+TEST(StringFilterTest, RegexBreakLiterals) {
+  StringFilter filter;
+  filter.AddRule(StringFilter::Policy::kMatchBreak,
+                 R"(B\|\d+\|foo \(bar\)(.*))", "");
+  filter.AddRule(StringFilter::Policy::kMatchRedactGroups,
+                 R"(B\|\d+\|foo (.*))", "");
+
+  std::string res = "B|1234|foo (bar) 1234";
+  ASSERT_FALSE(filter.MaybeFilter(res.data(), res.size()));
+  ASSERT_EQ(res, "B|1234|foo (bar) 1234");
+
+  res = "B|1234|foo bar 1234";
+  ASSERT_TRUE(filter.MaybeFilter(res.data(), res.size()));
+  ASSERT_EQ(res, "B|1234|foo P60REDAC");
+}
+
 }  // namespace
 }  // namespace protozero
@@ -0,0 +1,278 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_CONTAINERS_COMPRESSED_VECTOR_H_
+#define SRC_TRACE_PROCESSOR_CONTAINERS_COMPRESSED_VECTOR_H_
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <limits>
+#include <optional>
+#include <type_traits>
+#include <vector>
+
+#include "perfetto/base/logging.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+// An immutable vector of integers which uses less memory than a std::vector
+// while still allowing O(1) random access to the values.
+//
+// One of two encodings is picked, whichever uses less memory:
+// - kFrameOfReference: the values are split in blocks of |kBlockSize|. Each
+//   block stores its minimum (the "frame of reference") and the deltas of all
+//   its values from it, bitpacked using as many bits as the largest delta of
+//   the block needs. This works well for sorted columns (e.g. timestamps),
+//   where the deltas are bounded by the time span of a block, and for
+//   columns whose values are clustered (e.g. ids).
+// - kDictionary: the distinct values are stored sorted in a dictionary and
+//   each value is stored as its one byte index (the "code") in it. This works
+//   well for columns with few distinct values (e.g. cpu or priority). As the
+//   dictionary is sorted, codes compare like the values they represent.
+//
+// Blocks are aligned to BitVector words (i.e. |kBlockSize| is the number of
+// bits in a word) so that searches can compute the result of a whole block
+// at once.
+template <typename T>
+class CompressedVector {
+ public:
+  static_assert(std::is_integral_v<T>, "Only integers can be compressed");
+
+  using ValueType = T;
+  using UnsignedT = std::make_unsigned_t<T>;
+
+  enum class Encoding {
+    kFrameOfReference,
+    kDictionary,
+  };
+
+  static constexpr uint32_t kBlockSize = 64;
+  static constexpr uint32_t kMaxDictionarySize = 256;
+
+  CompressedVector(const CompressedVector&) = delete;
+  CompressedVector& operator=(const CompressedVector&) = delete;
+
+  CompressedVector(CompressedVector&&) = default;
+  CompressedVector& operator=(CompressedVector&&) noexcept = default;
+
+  // Compresses |values|. Returns std::nullopt if no encoding saves at least a
+  // quarter of the memory used by |values|, as then compression isn't worth
+  // the slower accesses.
+  static std::optional<CompressedVector<T>> Compress(
+      const std::vector<T>& values) {
+    if (values.empty())
+      return std::nullopt;
+    const size_t uncompressed = values.size() * sizeof(T);
+    std::optional<CompressedVector<T>> dict = CompressDictionary(values);
+    CompressedVector<T> frame = CompressFrameOfReference(values);
+    CompressedVector<T>* best = &frame;
+    if (dict && dict->memory_usage() < frame.memory_usage())
+      best = &*dict;
+    if (best->memory_usage() * 4 > uncompressed * 3)
+      return std::nullopt;
+    return std::move(*best);
+  }
+
+  // Returns the value at |idx|.
+  T Get(uint32_t idx) const {
+    PERFETTO_DCHECK(idx < size_);
+    if (encoding_ == Encoding::kDictionary)
+      return dictionary_[codes_[idx]];
+    uint32_t block = idx / kBlockSize;
+    return AddDelta(block_bases_[block],
+                    GetDelta(block, idx % kBlockSize));
+  }
+
+  // Returns all the values in a std::vector.
+  std::vector<T> Decompress() const {
+    std::vector<T> values(size_);
+    for (uint32_t i = 0; i < size_; ++i)
+      values[i] = Get(i);
+    return values;
+  }
+
+  // Returns the number of values stored.
+  uint32_t size() const { return size_; }
+
+  Encoding encoding() const { return encoding_; }
+
+  // Returns the memory used by the encoded values.
+  size_t memory_usage() const {
+    return block_bases_.capacity() * sizeof(T) + block_widths_.capacity() +
+           block_offsets_.capacity() * sizeof(uint32_t) +
+           packed_.capacity() * sizeof(uint64_t) +
+           dictionary_.capacity() * sizeof(T) + codes_.capacity();
+  }
+
+  // kFrameOfReference only: accessors for searching blocks without
+  // decompressing them.
+
+  // Returns the number of blocks, including a trailing partial one.
+  uint32_t block_count() const {
+    return static_cast<uint32_t>(block_bases_.size());
+  }
+
+  // Returns the smallest value of the block.
+  T block_base(uint32_t block) const { return block_bases_[block]; }
+
+  // Returns the largest delta which can be stored in the block: all the
+  // values of the block are in [base, base + max_delta].
+  uint64_t block_max_delta(uint32_t block) const {
+    return MaxValue(block_widths_[block]);
+  }
+
+  // Returns the delta from the base of the block of its |offset|-th value.
+  uint64_t GetDelta(uint32_t block, uint32_t offset) const {
+    uint8_t width = block_widths_[block];
+    if (width == 0)
+      return 0;
+    uint64_t bit = static_cast<uint64_t>(offset) * width;
+    const uint64_t* word = &packed_[block_offsets_[block] + bit / 64];
+    uint32_t shift = bit % 64;
+    uint64_t delta = word[0] >> shift;
+    if (shift + width > 64)
+      delta |= word[1] << (64 - shift);
+    return delta & MaxValue(width);
+  }
+
+  // Adds |delta| to |base|, wrapping around like unsigned integers do: a
+  // delta can be larger than the maximum of a signed T.
+  static T AddDelta(T base, uint64_t delta) {
+    return static_cast<T>(
+        static_cast<UnsignedT>(static_cast<UnsignedT>(base) + delta));
+  }
+
+  // Returns the difference between |value| and |base|. |value| must not be
+  // smaller than |base|.
+  static uint64_t Difference(T value, T base) {
+    PERFETTO_DCHECK(value >= base);
+    return static_cast<UnsignedT>(static_cast<UnsignedT>(value) -
+                                  static_cast<UnsignedT>(base));
+  }
+
+  // kDictionary only: the sorted distinct values and the index of each value
+  // in it.
+  const std::vector<T>& dictionary() const { return dictionary_; }
+  const std::vector<uint8_t>& codes() const { return codes_; }
+
+ private:
+  explicit CompressedVector(Encoding encoding, uint32_t size)
+      : encoding_(encoding), size_(size) {}
+
+  static uint64_t MaxValue(uint8_t width) {
+    return width == 64 ? std::numeric_limits<uint64_t>::max()
+                       : (1ull << width) - 1;
+  }
+
+  static uint8_t BitWidth(uint64_t value) {
+    uint8_t width = 0;
+    for (; value; value >>= 1)
+      width++;
+    return width;
+  }
+
+  static CompressedVector<T> CompressFrameOfReference(
+      const std::vector<T>& values) {
+    CompressedVector<T> res(Encoding::kFrameOfReference,
+                            static_cast<uint32_t>(values.size()));
+    const uint32_t blocks = static_cast<uint32_t>(
+        (values.size() + kBlockSize - 1) / kBlockSize);
+    res.block_bases_.reserve(blocks);
+    res.block_widths_.reserve(blocks);
+    res.block_offsets_.reserve(blocks);
+
+    uint32_t packed_words = 0;
+    for (uint32_t block = 0; block < blocks; ++block) {
+      auto begin = values.begin() + block * kBlockSize;
+      auto end = values.begin() +
+                 std::min<size_t>(values.size(), (block + 1) * kBlockSize);
+      auto [min, max] = std::minmax_element(begin, end);
+      uint8_t width = BitWidth(Difference(*max, *min));
+
+      res.block_bases_.push_back(*min);
+      res.block_widths_.push_back(width);
+      res.block_offsets_.push_back(packed_words);
+      // As a block has 64 values, |width| words always hold all its deltas
+      // (even if the block is partial).
+      packed_words += width;
+    }
+
+    // One extra word so that GetDelta() can always read the word after the
+    // one a delta starts in.
+    res.packed_.resize(packed_words + 1);
+    for (uint32_t i = 0; i < values.size(); ++i) {
+      uint32_t block = i / kBlockSize;
+      uint8_t width = res.block_widths_[block];
+      if (width == 0)
+        continue;
+      uint64_t delta = Difference(values[i], res.block_bases_[block]);
+      uint64_t bit = static_cast<uint64_t>(i % kBlockSize) * width;
+      uint64_t* word = &res.packed_[res.block_offsets_[block] + bit / 64];
+      uint32_t shift = bit % 64;
+      word[0] |= delta << shift;
+      if (shift + width > 64)
+        word[1] |= delta >> (64 - shift);
+    }
+    return res;
+  }
+
+  static std::optional<CompressedVector<T>> CompressDictionary(
+      const std::vector<T>& values) {
+    // Keep the distinct values sorted while scanning: with at most
+    // |kMaxDictionarySize| of them, this is cheaper than hashing.
+    std::vector<T> dictionary;
+    for (T value : values) {
+      auto it = std::lower_bound(dictionary.begin(), dictionary.end(), value);
+      if (it != dictionary.end() && *it == value)
+        continue;
+      if (dictionary.size() == kMaxDictionarySize)
+        return std::nullopt;
+      dictionary.insert(it, value);
+    }
+
+    CompressedVector<T> res(Encoding::kDictionary,
+                            static_cast<uint32_t>(values.size()));
+    res.codes_.reserve(values.size());
+    for (T value : values) {
+      auto it = std::lower_bound(dictionary.begin(), dictionary.end(), value);
+      res.codes_.push_back(static_cast<uint8_t>(it - dictionary.begin()));
+    }
+    dictionary.shrink_to_fit();
+    res.dictionary_ = std::move(dictionary);
+    return std::make_optional(std::move(res));
+  }
+
+  Encoding encoding_;
+  uint32_t size_ = 0;
+
+  // kFrameOfReference.
+  std::vector<T> block_bases_;
+  std::vector<uint8_t> block_widths_;
+  // Index of the first word of each block in |packed_|.
+  std::vector<uint32_t> block_offsets_;
+  std::vector<uint64_t> packed_;
+
+  // kDictionary.
+  std::vector<T> dictionary_;
+  std::vector<uint8_t> codes_;
+};
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_CONTAINERS_COMPRESSED_VECTOR_H_
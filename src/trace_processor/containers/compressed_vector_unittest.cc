@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/containers/compressed_vector.h"
+
+#include <algorithm>
+#include <limits>
+#include <random>
+
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+TEST(CompressedVector, SortedTimestamps) {
+  std::minstd_rand0 rnd(0);
+  std::vector<int64_t> values;
+  int64_t ts = 1000000000000;
+  for (uint32_t i = 0; i < 10000; ++i) {
+    ts += rnd() % 100000;
+    values.push_back(ts);
+  }
+
+  auto cv = CompressedVector<int64_t>::Compress(values);
+  ASSERT_TRUE(cv.has_value());
+  ASSERT_EQ(cv->encoding(),
+            CompressedVector<int64_t>::Encoding::kFrameOfReference);
+  ASSERT_EQ(cv->size(), values.size());
+  ASSERT_LT(cv->memory_usage(), values.size() * sizeof(int64_t) / 2);
+  for (uint32_t i = 0; i < values.size(); ++i) {
+    ASSERT_EQ(cv->Get(i), values[i]);
+  }
+  ASSERT_EQ(cv->Decompress(), values);
+}
+
+TEST(CompressedVector, FewDistinctValues) {
+  std::vector<uint32_t> values;
+  for (uint32_t i = 0; i < 1000; ++i) {
+    values.push_back((i * 7) % 8 * 1000000);
+  }
+
+  auto cv = CompressedVector<uint32_t>::Compress(values);
+  ASSERT_TRUE(cv.has_value());
+  ASSERT_EQ(cv->encoding(), CompressedVector<uint32_t>::Encoding::kDictionary);
+  ASSERT_EQ(cv->dictionary().size(), 8u);
+  ASSERT_TRUE(std::is_sorted(cv->dictionary().begin(), cv->dictionary().end()));
+  ASSERT_EQ(cv->Decompress(), values);
+}
+
+TEST(CompressedVector, NegativeAndExtremeValues) {
+  std::vector<int64_t> values;
+  for (int64_t i = 0; i < 300; ++i) {
+    values.push_back(-1000 + i);
+  }
+  // A single block with values spanning the whole int64 range.
+  values.push_back(std::numeric_limits<int64_t>::min());
+  values.push_back(std::numeric_limits<int64_t>::max());
+
+  auto cv = CompressedVector<int64_t>::Compress(values);
+  ASSERT_TRUE(cv.has_value());
+  ASSERT_EQ(cv->encoding(),
+            CompressedVector<int64_t>::Encoding::kFrameOfReference);
+  ASSERT_EQ(cv->Decompress(), values);
+
+  uint32_t last_block = cv->block_count() - 1;
+  ASSERT_EQ(cv->block_base(last_block), std::numeric_limits<int64_t>::min());
+  ASSERT_EQ(cv->block_max_delta(last_block),
+            std::numeric_limits<uint64_t>::max());
+}
+
+TEST(CompressedVector, ConstantBlocks) {
+  std::vector<int32_t> values(1000, -5);
+  values[999] = 3;
+
+  auto cv = CompressedVector<int32_t>::Compress(values);
+  ASSERT_TRUE(cv.has_value());
+  ASSERT_EQ(cv->Decompress(), values);
+}
+
+TEST(CompressedVector, IncompressibleValues) {
+  std::minstd_rand0 rnd(0);
+  std::vector<uint32_t> values;
+  for (uint32_t i = 0; i < 1000; ++i) {
+    values.push_back(static_cast<uint32_t>(rnd()) << 1);
+  }
+  ASSERT_FALSE(CompressedVector<uint32_t>::Compress(values).has_value());
+}
+
+TEST(CompressedVector, Empty) {
+  auto cv = CompressedVector<int64_t>::Compress({});
+  ASSERT_FALSE(cv.has_value());
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -17,6 +17,7 @@
 #include "src/trace_processor/containers/string_pool.h"
 
 #include <limits>
+#include <mutex>
 #include <tuple>
 
 #include "perfetto/base/logging.h"
@@ -25,12 +26,40 @@
 namespace perfetto {
 namespace trace_processor {
 
+struct StringPool::ConcurrentState {
+  struct Shard {
+    std::mutex mutex;
+    base::FlatHashMap<StringHash,
+                      Id,
+                      base::AlreadyHashed<StringHash>,
+                      base::LinearProbe,
+                      /*AppendOnly=*/true>
+        index;
+
+    // The index in |blocks_| of the block new strings of this shard are
+    // appended to, kNoBlock if the shard didn't need one yet.
+    uint32_t block_index = kNoBlock;
+  };
+  static constexpr uint32_t kNoBlock = std::numeric_limits<uint32_t>::max();
+
+  static size_t ShardIndex(StringHash hash) {
+    // The low bits of the hash are used for the slots of the index.
+    return static_cast<size_t>(hash >> (64 - kNumShardBits));
+  }
+
+  Shard shards[kNumShards];
+
+  // Protects the growth of |blocks_| and |large_strings_|.
+  mutable std::mutex alloc_mutex;
+};
+
 StringPool::StringPool() {
   static_assert(
       StringPool::kMinLargeStringSizeBytes <= StringPool::kBlockSizeBytes + 1,
       "minimum size of large strings must be small enough to support any "
       "string that doesn't fit in a Block.");
 
+  blocks_.reserve(kMaxBlockCount);
   blocks_.emplace_back(kBlockSizeBytes);
 
   // Reserve a slot for the null string.
@@ -88,6 +117,107 @@ StringPool::Id StringPool::InsertLargeString(base::StringView str,
   return string_id;
 }
 
+StringPool::Id StringPool::InternStringConcurrent(base::StringView str,
+                                                  uint64_t hash) {
+  // The main index is read-only in the concurrent mode.
+  if (Id* id = string_index_.Find(hash)) {
+    PERFETTO_DCHECK(Get(*id) == str);
+    return *id;
+  }
+
+  ConcurrentState::Shard& shard =
+      concurrent_->shards[ConcurrentState::ShardIndex(hash)];
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  auto it_and_inserted = shard.index.Insert(hash, Id());
+  Id* id = it_and_inserted.first;
+  if (!it_and_inserted.second) {
+    PERFETTO_DCHECK(Get(*id) == str);
+    return *id;
+  }
+
+  // Blocks are only written by the shard owning them, so the string can be
+  // copied without holding any other lock.
+  if (shard.block_index != ConcurrentState::kNoBlock) {
+    auto success_and_offset = blocks_[shard.block_index].TryInsert(str);
+    if (success_and_offset.first) {
+      *id = Id::BlockString(shard.block_index, success_and_offset.second);
+      return *id;
+    }
+  }
+
+  std::lock_guard<std::mutex> alloc_lock(concurrent_->alloc_mutex);
+  if (str.size() + kMaxMetadataSize >= kMinLargeStringSizeBytes) {
+    large_strings_.emplace_back(new std::string(str.begin(), str.size()));
+    *id = Id::LargeString(large_strings_.size() - 1);
+    return *id;
+  }
+  PERFETTO_CHECK(blocks_.size() < kMaxBlockCount);
+  blocks_.emplace_back(kBlockSizeBytes);
+  shard.block_index = static_cast<uint32_t>(blocks_.size() - 1);
+
+  auto success_and_offset = blocks_.back().TryInsert(str);
+  PERFETTO_CHECK(success_and_offset.first);
+  *id = Id::BlockString(shard.block_index, success_and_offset.second);
+  return *id;
+}
+
+std::optional<StringPool::Id> StringPool::FindInShard(uint64_t hash) const {
+  ConcurrentState::Shard& shard =
+      concurrent_->shards[ConcurrentState::ShardIndex(hash)];
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  Id* id = shard.index.Find(hash);
+  return id ? std::make_optional(*id) : std::nullopt;
+}
+
+NullTermStringView StringPool::GetLargeString(Id id) const {
+  PERFETTO_DCHECK(id.is_large_string());
+  size_t index = id.large_string_index();
+  const std::string* str;
+  if (PERFETTO_UNLIKELY(concurrent_)) {
+    // |large_strings_| might be growing on another thread.
+    std::lock_guard<std::mutex> lock(concurrent_->alloc_mutex);
+    PERFETTO_DCHECK(index < large_strings_.size());
+    str = large_strings_[index].get();
+  } else {
+    PERFETTO_DCHECK(index < large_strings_.size());
+    str = large_strings_[index].get();
+  }
+  return NullTermStringView(str->c_str(), str->size());
+}
+
+size_t StringPool::size() const {
+  size_t size = string_index_.size();
+  if (PERFETTO_UNLIKELY(concurrent_)) {
+    for (ConcurrentState::Shard& shard : concurrent_->shards) {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      size += shard.index.size();
+    }
+  }
+  return size;
+}
+
+void StringPool::SetConcurrentInterning(bool enabled) {
+  if (enabled == concurrent_interning())
+    return;
+
+  if (enabled) {
+    concurrent_.reset(new ConcurrentState());
+    // Keep filling the current block from one of the shards.
+    concurrent_->shards[0].block_index =
+        static_cast<uint32_t>(blocks_.size() - 1);
+    return;
+  }
+
+  // Merge the shards back into the main index. New strings will be appended
+  // to the last block added by any of the shards: the free space left in the
+  // blocks of the other shards is not reused.
+  for (ConcurrentState::Shard& shard : concurrent_->shards) {
+    for (auto it = shard.index.GetIterator(); it; ++it)
+      string_index_.Insert(it.key(), it.value());
+  }
+  concurrent_.reset();
+}
+
 std::pair<bool /*success*/, uint32_t /*offset*/> StringPool::Block::TryInsert(
     base::StringView str) {
   auto str_size = str.size();
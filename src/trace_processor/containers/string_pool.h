@@ -21,6 +21,7 @@
 #include <stdint.h>
 
 #include <limits>
+#include <memory>
 #include <optional>
 #include <vector>
 
@@ -119,6 +120,8 @@ class StringPool {
       return Id::Null();
 
     auto hash = str.Hash();
+    if (PERFETTO_UNLIKELY(concurrent_))
+      return InternStringConcurrent(str, hash);
 
     // Perform a hashtable insertion with a null ID just to check if the string
     // is already inserted. If it's not, overwrite 0 with the actual Id.
@@ -142,6 +145,8 @@ class StringPool {
       PERFETTO_DCHECK(Get(*id) == str);
       return *id;
     }
+    if (PERFETTO_UNLIKELY(concurrent_))
+      return FindInShard(hash);
     return std::nullopt;
   }
 
@@ -155,7 +160,7 @@ class StringPool {
 
   Iterator CreateIterator() const { return Iterator(this); }
 
-  size_t size() const { return string_index_.size(); }
+  size_t size() const;
 
   // Maximum Id of a small (not large) string in the string pool.
   StringPool::Id MaxSmallStringId() const {
@@ -165,6 +170,24 @@ class StringPool {
   // Returns whether there is at least one large string in a string pool
   bool HasLargeString() const { return !large_strings_.empty(); }
 
+  // Switches the pool in and out of the concurrent interning mode.
+  //
+  // In this mode InternString(), GetId() and Get() can be called from any
+  // number of threads at the same time. The hash index is split in
+  // |kNumShards| shards, each protected by its own lock and appending new
+  // strings to its own block, so threads only contend when interning strings
+  // with hashes in the same shard. The strings interned before entering the
+  // mode stay in the main index, which is read-only (and lock-free) in this
+  // mode. Leaving the mode merges the shards back into the main index.
+  //
+  // Ids are stable across mode switches. The iterator, MaxSmallStringId() and
+  // HasLargeString() must not be used while other threads are interning
+  // strings. This function must be called while no other thread is accessing
+  // the pool.
+  void SetConcurrentInterning(bool enabled);
+
+  bool concurrent_interning() const { return concurrent_ != nullptr; }
+
  private:
   using StringHash = uint64_t;
 
@@ -204,6 +227,9 @@ class StringPool {
     size_t size_ = 0;
   };
 
+  // State of the concurrent interning mode (see SetConcurrentInterning()).
+  struct ConcurrentState;
+
   friend class Iterator;
   friend class StringPoolTest;
 
@@ -227,6 +253,14 @@ class StringPool {
 
   static constexpr size_t kBlockSizeBytes = kBlockOffsetBitMask + 1;  // 32 MB
 
+  // The maximum number of blocks which can be addressed by an Id.
+  static constexpr size_t kMaxBlockCount = 1u << kNumBlockIndexBits;
+
+  // The number of shards of the index in the concurrent interning mode. Each
+  // shard appends strings to its own block.
+  static constexpr size_t kNumShardBits = 3;
+  static constexpr size_t kNumShards = 1u << kNumShardBits;
+
   // If a string doesn't fit into the current block, we can either start a new
   // block or insert the string into the |large_strings_| vector. To maximize
   // the used proportion of each block's memory, we only start a new block if
@@ -244,6 +278,10 @@ class StringPool {
   // Insert a large string into the pool and return its Id.
   Id InsertLargeString(base::StringView, uint64_t hash);
 
+  // Slow paths of InternString() and GetId() in the concurrent interning mode.
+  Id InternStringConcurrent(base::StringView, uint64_t hash);
+  std::optional<Id> FindInShard(uint64_t hash) const;
+
   // The returned pointer points to the start of the string metadata (i.e. the
   // first byte of the size).
   const uint8_t* IdToPtr(Id id) const {
@@ -283,15 +321,11 @@ class StringPool {
 
   // Lookup a string in the |large_strings_| vector. |id| should have the MSB
   // set.
-  NullTermStringView GetLargeString(Id id) const {
-    PERFETTO_DCHECK(id.is_large_string());
-    size_t index = id.large_string_index();
-    PERFETTO_DCHECK(index < large_strings_.size());
-    const std::string* str = large_strings_[index].get();
-    return NullTermStringView(str->c_str(), str->size());
-  }
+  NullTermStringView GetLargeString(Id id) const;
 
-  // The actual memory storing the strings.
+  // The actual memory storing the strings. Its capacity is reserved upfront
+  // for |kMaxBlockCount| blocks so that blocks never move: this allows a shard
+  // to add a block while other threads read from the existing ones.
   std::vector<Block> blocks_;
 
   // Any string that is too large to fit into a Block is stored separately
@@ -306,6 +340,9 @@ class StringPool {
                     base::LinearProbe,
                     /*AppendOnly=*/true>
       string_index_{/*initial_capacity=*/4096u};
+
+  // Only set in the concurrent interning mode.
+  std::unique_ptr<ConcurrentState> concurrent_;
 };
 
 }  // namespace trace_processor
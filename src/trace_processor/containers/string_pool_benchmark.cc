@@ -0,0 +1,87 @@
+// Copyright (C) 2023 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "src/trace_processor/containers/string_pool.h"
+
+namespace {
+
+using perfetto::trace_processor::StringPool;
+
+bool IsBenchmarkFunctionalOnly() {
+  return getenv("BENCHMARK_FUNCTIONAL_TEST_ONLY") != nullptr;
+}
+
+// Args are {number of threads, percentage of strings already in the pool}.
+// Zero threads interns all the strings on the calling thread without enabling
+// the concurrent mode, as a baseline.
+void StringPoolArgs(benchmark::internal::Benchmark* b) {
+  if (IsBenchmarkFunctionalOnly()) {
+    b->Args({2, 50});
+  } else {
+    b->ArgsProduct({{0, 1, 2, 4, 8}, {0, 50, 100}});
+  }
+}
+
+std::vector<std::string> CreateStrings(size_t count) {
+  std::vector<std::string> strings;
+  strings.reserve(count);
+  for (size_t i = 0; i < count; ++i)
+    strings.push_back("com.example.process.thread_name_" + std::to_string(i));
+  return strings;
+}
+
+}  // namespace
+
+static void BM_StringPoolIntern(benchmark::State& state) {
+  const size_t num_strings = IsBenchmarkFunctionalOnly() ? 1024 : 1024 * 1024;
+  const auto num_threads = static_cast<uint32_t>(state.range(0));
+  const auto existing_percentage = static_cast<size_t>(state.range(1));
+
+  std::vector<std::string> strings = CreateStrings(num_strings);
+  const size_t num_existing = num_strings * existing_percentage / 100;
+
+  for (auto _ : state) {
+    state.PauseTiming();
+    StringPool pool;
+    for (size_t i = 0; i < num_existing; ++i)
+      pool.InternString(perfetto::base::StringView(strings[i]));
+    state.ResumeTiming();
+
+    if (num_threads == 0) {
+      for (const std::string& str : strings)
+        pool.InternString(perfetto::base::StringView(str));
+    } else {
+      pool.SetConcurrentInterning(true);
+      std::vector<std::thread> threads;
+      for (uint32_t t = 0; t < num_threads; ++t) {
+        threads.emplace_back([&pool, &strings, t, num_threads] {
+          for (size_t i = t; i < strings.size(); i += num_threads)
+            pool.InternString(perfetto::base::StringView(strings[i]));
+        });
+      }
+      for (auto& thread : threads)
+        thread.join();
+      pool.SetConcurrentInterning(false);
+    }
+    benchmark::DoNotOptimize(pool.size());
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * num_strings));
+}
+BENCHMARK(BM_StringPoolIntern)->Apply(StringPoolArgs)->UseRealTime();
@@ -18,6 +18,9 @@
 
 #include <array>
 #include <random>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include "test/gtest_and_gmock.h"
 
@@ -197,6 +200,74 @@ TEST_F(StringPoolTest, BigString) {
   }
 }
 
+TEST_F(StringPoolTest, ConcurrentInterningKeepsIds) {
+  StringPool::Id before = pool_.InternString("before");
+
+  pool_.SetConcurrentInterning(true);
+  ASSERT_TRUE(pool_.concurrent_interning());
+  ASSERT_EQ(pool_.InternString("before"), before);
+  StringPool::Id during = pool_.InternString("during");
+  ASSERT_EQ(pool_.InternString("during"), during);
+  ASSERT_EQ(pool_.GetId("during"), during);
+  ASSERT_EQ(pool_.GetId("missing"), std::nullopt);
+  ASSERT_EQ(pool_.size(), 2u);
+
+  // Leaving the concurrent mode merges the strings back in the main index.
+  pool_.SetConcurrentInterning(false);
+  ASSERT_FALSE(pool_.concurrent_interning());
+  ASSERT_EQ(pool_.InternString("before"), before);
+  ASSERT_EQ(pool_.InternString("during"), during);
+  ASSERT_EQ(pool_.GetId("during"), during);
+  ASSERT_EQ(pool_.Get(during), "during");
+  StringPool::Id after = pool_.InternString("after");
+  ASSERT_EQ(pool_.Get(after), "after");
+  ASSERT_EQ(pool_.size(), 3u);
+
+  // All the strings can be iterated, regardless of the block they are in.
+  std::vector<std::string> strings;
+  for (auto it = pool_.CreateIterator(); it; ++it) {
+    if (!it.StringId().is_null())
+      strings.push_back(it.StringView().ToStdString());
+  }
+  ASSERT_THAT(strings,
+              testing::UnorderedElementsAre("before", "during", "after"));
+}
+
+TEST_F(StringPoolTest, ConcurrentInterningFromManyThreads) {
+  constexpr size_t kNumThreads = 8;
+  constexpr size_t kNumStrings = 10000;
+  pool_.SetConcurrentInterning(true);
+
+  // Each thread interns the same strings in a different order (7919 is prime
+  // so the indices below are a permutation of [0, kNumStrings)).
+  std::vector<std::vector<StringPool::Id>> ids(kNumThreads);
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < kNumThreads; ++t) {
+    threads.emplace_back([this, &ids, t] {
+      ids[t].resize(kNumStrings);
+      for (size_t i = 0; i < kNumStrings; ++i) {
+        size_t idx = (i * 7919 + t * 1237) % kNumStrings;
+        std::string str = "string_" + std::to_string(idx);
+        ids[t][idx] = pool_.InternString(base::StringView(str));
+        ASSERT_EQ(pool_.Get(ids[t][idx]).ToStdString(), str);
+      }
+    });
+  }
+  for (auto& thread : threads)
+    thread.join();
+
+  ASSERT_EQ(pool_.size(), kNumStrings);
+  for (size_t t = 1; t < kNumThreads; ++t)
+    ASSERT_EQ(ids[t], ids[0]);
+
+  pool_.SetConcurrentInterning(false);
+  for (size_t i = 0; i < kNumStrings; ++i) {
+    std::string str = "string_" + std::to_string(i);
+    ASSERT_EQ(pool_.GetId(base::StringView(str)), ids[0][i]);
+    ASSERT_EQ(pool_.Get(ids[0][i]).ToStdString(), str);
+  }
+}
+
 }  // namespace
 }  // namespace trace_processor
 }  // namespace perfetto
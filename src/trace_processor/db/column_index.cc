@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "src/trace_processor/db/column_index.h"
+
+#include <algorithm>
+#include <iterator>
+
+#include "perfetto/base/logging.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+namespace {
+
+// When more than 1/|kBitmapSortRatio| of the rows in the bounds match, it's
+// cheaper to sort them by marking them in a bitmap than with std::sort.
+constexpr uint32_t kBitmapSortRatio = 32;
+
+// Sorts |rows|, which are unique and all inside |bounds|.
+void SortRows(RowMap::Range bounds, std::vector<uint32_t>* rows) {
+  if (rows->size() * kBitmapSortRatio < bounds.size()) {
+    std::sort(rows->begin(), rows->end());
+    return;
+  }
+  std::vector<bool> matched(bounds.size());
+  for (uint32_t row : *rows) {
+    matched[row - bounds.start] = true;
+  }
+  uint32_t out = 0;
+  for (uint32_t i = 0; i < bounds.size(); ++i) {
+    if (matched[i])
+      (*rows)[out++] = bounds.start + i;
+  }
+  PERFETTO_DCHECK(out == rows->size());
+}
+
+}  // namespace
+
+ColumnIndex::ColumnIndex(std::vector<uint32_t> storage_indices,
+                         std::vector<uint32_t> rows,
+                         std::vector<uint32_t> null_rows)
+    : storage_indices_(std::move(storage_indices)),
+      rows_(std::move(rows)),
+      null_rows_(std::move(null_rows)) {
+  PERFETTO_DCHECK(storage_indices_.size() == rows_.size());
+  PERFETTO_DCHECK(std::is_sorted(null_rows_.begin(), null_rows_.end()));
+}
+
+bool ColumnIndex::CanSearch(FilterOp op) {
+  switch (op) {
+    case FilterOp::kEq:
+    case FilterOp::kLt:
+    case FilterOp::kLe:
+    case FilterOp::kGt:
+    case FilterOp::kGe:
+    case FilterOp::kIsNull:
+      return true;
+    case FilterOp::kNe:
+    case FilterOp::kIsNotNull:
+    case FilterOp::kGlob:
+    case FilterOp::kRegex:
+      return false;
+  }
+  PERFETTO_FATAL("For GCC");
+}
+
+RowMap ColumnIndex::Search(FilterOp op,
+                           SqlValue value,
+                           const storage::Storage& storage,
+                           RowMap::Range bounds) const {
+  PERFETTO_DCHECK(CanSearch(op));
+
+  // |storage_indices_| makes the storage sorted so the result is the range of
+  // positions in it which match. Note that IndexSearch doesn't modify the
+  // indices.
+  RangeOrBitVector res = storage.IndexSearch(
+      op, value, const_cast<uint32_t*>(storage_indices_.data()),
+      static_cast<uint32_t>(storage_indices_.size()), true /* sorted */);
+  RowMap::Range positions = std::move(res).TakeIfRange();
+  auto begin = rows_.begin() + positions.start;
+  auto end = rows_.begin() + positions.end;
+
+  std::vector<uint32_t> matched;
+  if (op == FilterOp::kEq || op == FilterOp::kIsNull) {
+    // All the matched values are equal, so the rows are in increasing order.
+    auto first = std::lower_bound(begin, end, bounds.start);
+    matched.assign(first, std::lower_bound(first, end, bounds.end));
+  } else {
+    std::copy_if(begin, end, std::back_inserter(matched),
+                 [bounds](uint32_t row) { return bounds.Contains(row); });
+    SortRows(bounds, &matched);
+  }
+
+  if (op == FilterOp::kIsNull && !null_rows_.empty()) {
+    auto first =
+        std::lower_bound(null_rows_.begin(), null_rows_.end(), bounds.start);
+    auto last = std::lower_bound(first, null_rows_.end(), bounds.end);
+    std::vector<uint32_t> merged;
+    merged.reserve(matched.size() +
+                   static_cast<size_t>(std::distance(first, last)));
+    std::merge(matched.begin(), matched.end(), first, last,
+               std::back_inserter(merged));
+    matched = std::move(merged);
+  }
+  return RowMap(std::move(matched));
+}
+
+size_t ColumnIndex::memory_usage() const {
+  return (storage_indices_.capacity() + rows_.capacity() +
+          null_rows_.capacity()) *
+         sizeof(uint32_t);
+}
+
+}  // namespace trace_processor
+}  // namespace perfetto
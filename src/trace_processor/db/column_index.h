@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_TRACE_PROCESSOR_DB_COLUMN_INDEX_H_
+#define SRC_TRACE_PROCESSOR_DB_COLUMN_INDEX_H_
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "src/trace_processor/containers/row_map.h"
+#include "src/trace_processor/db/storage/storage.h"
+#include "src/trace_processor/db/storage/types.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+// Secondary index on a single column of a Table: all the rows of the table
+// sorted by the value of the column. This allows filtering columns which are
+// not sorted with a binary search instead of scanning the whole column.
+//
+// The index only stores indices: the values are read from the storage of the
+// column, which has to be passed to |Search|.
+class ColumnIndex {
+ public:
+  ColumnIndex(std::vector<uint32_t> storage_indices,
+              std::vector<uint32_t> rows,
+              std::vector<uint32_t> null_rows);
+
+  ColumnIndex(ColumnIndex&&) noexcept = default;
+  ColumnIndex& operator=(ColumnIndex&&) noexcept = default;
+
+  ColumnIndex(const ColumnIndex&) = delete;
+  ColumnIndex& operator=(const ColumnIndex&) = delete;
+
+  // Returns whether constraints with |op| can be answered by the index.
+  static bool CanSearch(FilterOp op);
+
+  // Returns the rows in |bounds| matching |op| and |value|, in increasing
+  // order. |storage| has to be the storage of the indexed column.
+  RowMap Search(FilterOp op,
+                SqlValue value,
+                const storage::Storage& storage,
+                RowMap::Range bounds) const;
+
+  // Number of bytes used by the index.
+  size_t memory_usage() const;
+
+ private:
+  // Storage indices of the non-null rows, sorted by their value.
+  std::vector<uint32_t> storage_indices_;
+
+  // Table rows of the elements of |storage_indices_|. Rows with the same value
+  // are in increasing order.
+  std::vector<uint32_t> rows_;
+
+  // Table rows, in increasing order, which are null because of an overlay
+  // (i.e. which don't have a value in the storage).
+  std::vector<uint32_t> null_rows_;
+};
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_DB_COLUMN_INDEX_H_
@@ -17,7 +17,14 @@
 #ifndef SRC_TRACE_PROCESSOR_DB_COLUMN_STORAGE_H_
 #define SRC_TRACE_PROCESSOR_DB_COLUMN_STORAGE_H_
 
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <vector>
+
+#include "perfetto/base/compiler.h"
 #include "src/trace_processor/containers/bit_vector.h"
+#include "src/trace_processor/containers/compressed_vector.h"
 #include "src/trace_processor/containers/nullable_vector.h"
 
 namespace perfetto {
@@ -40,6 +47,17 @@ class ColumnStorageBase {
   virtual const BitVector* bv() const = 0;
   virtual uint32_t size() const = 0;
   virtual uint32_t non_null_size() const = 0;
+
+  // Returns the CompressedVector storing the values if they were compressed or
+  // nullptr otherwise. When non-null, |data()| returns nullptr.
+  virtual const void* compressed() const = 0;
+
+  // Number of times the values in this storage were changed. Allows state
+  // derived from the values (e.g. indexes) to find out that it is stale.
+  uint32_t mutation_count() const { return mutation_count_; }
+
+ protected:
+  uint32_t mutation_count_ = 0;
 };
 
 // Class used for implementing storage for non-null columns.
@@ -54,16 +72,51 @@ class ColumnStorage final : public ColumnStorageBase {
   ColumnStorage(ColumnStorage&&) = default;
   ColumnStorage& operator=(ColumnStorage&&) noexcept = default;
 
-  T Get(uint32_t idx) const { return vector_[idx]; }
-  void Append(T val) { vector_.emplace_back(val); }
-  void Set(uint32_t idx, T val) { vector_[idx] = val; }
+  T Get(uint32_t idx) const {
+    if constexpr (kIsCompressible) {
+      if (PERFETTO_UNLIKELY(compressed_))
+        return compressed_->Get(idx);
+    }
+    return vector_[idx];
+  }
+  void Append(T val) {
+    MaybeDecompress();
+    vector_.emplace_back(val);
+    ++mutation_count_;
+  }
+  void Set(uint32_t idx, T val) {
+    MaybeDecompress();
+    vector_[idx] = val;
+    ++mutation_count_;
+  }
   void ShrinkToFit() { vector_.shrink_to_fit(); }
-  const std::vector<T>& vector() const { return vector_; }
 
-  const void* data() const final { return vector_.data(); }
+  // Replaces the values with a CompressedVector if this saves enough memory.
+  // Only integers are compressed. Modifying the values afterwards decompresses
+  // them.
+  void Compress() {
+    if constexpr (kIsCompressible) {
+      if (compressed_)
+        return;
+      std::optional<CompressedVector<T>> cv =
+          CompressedVector<T>::Compress(vector_);
+      if (!cv)
+        return;
+      compressed_.reset(new CompressedVector<T>(std::move(*cv)));
+      vector_ = std::vector<T>();
+    }
+  }
+
+  const void* data() const final {
+    return compressed_ ? nullptr : vector_.data();
+  }
   const BitVector* bv() const final { return nullptr; }
-  uint32_t size() const final { return static_cast<uint32_t>(vector_.size()); }
+  uint32_t size() const final {
+    return compressed_ ? compressed_->size()
+                       : static_cast<uint32_t>(vector_.size());
+  }
   uint32_t non_null_size() const final { return size(); }
+  const void* compressed() const final { return compressed_.get(); }
 
   template <bool IsDense>
   static ColumnStorage<T> Create() {
@@ -72,7 +125,28 @@ class ColumnStorage final : public ColumnStorageBase {
   }
 
  private:
+  static constexpr bool kIsCompressible = std::is_same_v<T, int64_t> ||
+                                          std::is_same_v<T, int32_t> ||
+                                          std::is_same_v<T, uint32_t>;
+
+  // Placeholder for |compressed_| for types which cannot be compressed.
+  struct NotCompressible {
+    uint32_t size() const { return 0; }
+  };
+  using Compressed = std::
+      conditional_t<kIsCompressible, CompressedVector<T>, NotCompressible>;
+
+  void MaybeDecompress() {
+    if constexpr (kIsCompressible) {
+      if (PERFETTO_UNLIKELY(compressed_)) {
+        vector_ = compressed_->Decompress();
+        compressed_.reset();
+      }
+    }
+  }
+
   std::vector<T> vector_;
+  std::unique_ptr<Compressed> compressed_;
 };
 
 // Class used for implementing storage for nullable columns.
@@ -88,11 +162,22 @@ class ColumnStorage<std::optional<T>> final : public ColumnStorageBase {
   ColumnStorage& operator=(ColumnStorage&&) noexcept = default;
 
   std::optional<T> Get(uint32_t idx) const { return nv_.Get(idx); }
-  void Append(T val) { nv_.Append(val); }
-  void Append(std::optional<T> val) { nv_.Append(std::move(val)); }
-  void Set(uint32_t idx, T val) { nv_.Set(idx, val); }
+  void Append(T val) {
+    nv_.Append(val);
+    ++mutation_count_;
+  }
+  void Append(std::optional<T> val) {
+    nv_.Append(std::move(val));
+    ++mutation_count_;
+  }
+  void Set(uint32_t idx, T val) {
+    nv_.Set(idx, val);
+    ++mutation_count_;
+  }
   bool IsDense() const { return nv_.IsDense(); }
   void ShrinkToFit() { nv_.ShrinkToFit(); }
+  // Nullable columns are not compressed.
+  void Compress() {}
   // For dense columns the size of the vector is equal to size of the bit
   // vector. For sparse it's equal to count set bits of the bit vector.
   const std::vector<T>& non_null_vector() const {
@@ -108,6 +193,7 @@ class ColumnStorage<std::optional<T>> final : public ColumnStorageBase {
   uint32_t non_null_size() const final {
     return static_cast<uint32_t>(nv_.non_null_vector().size());
   }
+  const void* compressed() const final { return nullptr; }
 
   template <bool IsDense>
   static ColumnStorage<std::optional<T>> Create() {
@@ -14,8 +14,10 @@
  * limitations under the License.
  */
 
+#include <algorithm>
 #include <array>
 #include <cstddef>
+#include <iterator>
 #include <memory>
 #include <numeric>
 #include <vector>
@@ -28,6 +30,7 @@
 #include "src/trace_processor/db/overlays/storage_overlay.h"
 #include "src/trace_processor/db/overlays/types.h"
 #include "src/trace_processor/db/query_executor.h"
+#include "src/trace_processor/db/storage/compressed_storage.h"
 #include "src/trace_processor/db/storage/id_storage.h"
 #include "src/trace_processor/db/storage/numeric_storage.h"
 #include "src/trace_processor/db/storage/string_storage.h"
@@ -122,6 +125,175 @@ struct IndexFilterHelper {
   std::vector<uint32_t> current_;
   std::vector<uint32_t> global_;
 };
+
+// Number of elements in the storage backing the legacy |col|.
+uint32_t LegacyColumnSize(const Column& col) {
+  return col.IsId() ? col.overlay().row_map().Max()
+                    : col.storage_base().size();
+}
+
+// cDBv2 storage and overlays describing a legacy Column. Owns everything the
+// SimpleColumn returned by |simple_column()| points to.
+class LegacyColumn {
+ public:
+  LegacyColumn(const Table* table, const Column& col)
+      : selector_overlay_(col.overlay().row_map().GetIfBitVector()),
+        arrangement_overlay_(col.overlay().row_map().GetIfIndexVector()),
+        null_overlay_(col.IsNullable() ? col.storage_base().bv() : &null_bv_) {
+    // String columns are inherently nullable: null values are signified with
+    // Id::Null().
+    PERFETTO_CHECK(
+        !(col.col_type() == ColumnType::kString && col.IsNullable()));
+
+    // Create storage
+    uint32_t column_size = LegacyColumnSize(col);
+    if (col.IsId()) {
+      storage_.reset(new storage::IdStorage(column_size));
+    } else if (col.col_type() == ColumnType::kString) {
+      storage_.reset(new storage::StringStorage(
+          table->string_pool(),
+          static_cast<const StringPool::Id*>(col.storage_base().data()),
+          col.storage_base().non_null_size()));
+    } else if (col.storage_base().compressed()) {
+      storage_.reset(new storage::CompressedStorage(
+          col.storage_base().compressed(), col.col_type(), col.IsSorted()));
+    } else {
+      storage_.reset(new storage::NumericStorage(
+          col.storage_base().data(), col.storage_base().non_null_size(),
+          col.col_type(), col.IsSorted()));
+    }
+    s_col_.storage = storage_.get();
+
+    // Create cDBv2 overlays based on col.overlay()
+    if (col.overlay().size() != column_size &&
+        col.overlay().row_map().IsBitVector())
+      s_col_.overlays.emplace_back(&selector_overlay_);
+
+    if (col.overlay().row_map().IsIndexVector())
+      s_col_.overlays.emplace_back(&arrangement_overlay_);
+
+    // Add nullability
+    if (col.IsNullable())
+      s_col_.overlays.emplace_back(&null_overlay_);
+  }
+
+  LegacyColumn(const LegacyColumn&) = delete;
+  LegacyColumn& operator=(const LegacyColumn&) = delete;
+
+  const QueryExecutor::SimpleColumn& simple_column() const { return s_col_; }
+
+ private:
+  std::unique_ptr<Storage> storage_;
+  BitVector null_bv_;
+  overlays::SelectorOverlay selector_overlay_;
+  overlays::ArrangementOverlay arrangement_overlay_;
+  overlays::NullOverlay null_overlay_;
+  QueryExecutor::SimpleColumn s_col_{OverlaysVec(), nullptr};
+};
+
+// Returns true if the legacy |col| can't be sorted using cDBv2.
+bool RequiresLegacySort(const Column& col) {
+  // Rare cases where we have a range which doesn't match the size of the
+  // column.
+  return (col.overlay().size() != LegacyColumnSize(col) &&
+          col.overlay().row_map().IsRange()) ||
+         (col.col_type() == ColumnType::kString && col.IsNullable()) ||
+         col.col_type() == ColumnType::kDummy;
+}
+
+// Maps the rows at |table_indices| to the storage of |col| and returns, for
+// each of them, a SortToken with its storage index and its position in
+// |table_indices|. Rows which don't require a storage lookup are nulls: their
+// positions are instead added to |null_positions|, in increasing order.
+std::vector<storage::SortToken> ToStorageSortTokens(
+    const QueryExecutor::SimpleColumn& col,
+    const std::vector<uint32_t>& table_indices,
+    std::vector<uint32_t>* null_positions) {
+  std::vector<uint32_t> positions(table_indices.size());
+  std::iota(positions.begin(), positions.end(), 0);
+  TableIndexVector current{table_indices};
+
+  for (const auto& overlay : col.overlays) {
+    BitVector lookup =
+        overlay->IsStorageLookupRequired(OverlayOp::kOther, current);
+    if (lookup.CountSetBits() != lookup.size()) {
+      uint32_t kept = 0;
+      for (uint32_t i = 0; i < current.size(); ++i) {
+        if (lookup.IsSet(i)) {
+          current.indices[kept] = current.indices[i];
+          positions[kept++] = positions[i];
+        } else {
+          null_positions->push_back(positions[i]);
+        }
+      }
+      current.indices.resize(kept);
+      positions.resize(kept);
+    }
+    current = TableIndexVector{
+        overlay->MapToStorageIndexVector(std::move(current)).indices};
+  }
+
+  // Nulls can be taken out by different overlays: restore their relative
+  // order.
+  if (!std::is_sorted(null_positions->begin(), null_positions->end()))
+    std::sort(null_positions->begin(), null_positions->end());
+
+  std::vector<storage::SortToken> tokens(positions.size());
+  for (uint32_t i = 0; i < positions.size(); ++i) {
+    tokens[i] = storage::SortToken{current.indices[i], positions[i]};
+  }
+  return tokens;
+}
+
+// Appends to |group_starts| the first row of each group of equal values of
+// the sorted, non-null |col|, comparing the values in their stored type.
+template <typename T>
+void FindGroupStartsTyped(const Column& col,
+                          std::vector<uint32_t>* group_starts) {
+  const auto& storage = col.storage<T>();
+  const ColumnStorageOverlay& overlay = col.overlay();
+  uint32_t row_count = overlay.size();
+  if (row_count == 0)
+    return;
+  group_starts->push_back(0);
+  auto prev_value = storage.Get(overlay.Get(0));
+  for (uint32_t i = 1; i < row_count; ++i) {
+    auto value = storage.Get(overlay.Get(i));
+    if (value != prev_value)
+      group_starts->push_back(i);
+    prev_value = value;
+  }
+}
+
+void FindGroupStarts(const Column& col, std::vector<uint32_t>* group_starts) {
+  switch (col.col_type()) {
+    case ColumnType::kInt32:
+      FindGroupStartsTyped<int32_t>(col, group_starts);
+      return;
+    case ColumnType::kUint32:
+      FindGroupStartsTyped<uint32_t>(col, group_starts);
+      return;
+    case ColumnType::kInt64:
+      FindGroupStartsTyped<int64_t>(col, group_starts);
+      return;
+    case ColumnType::kDouble:
+      FindGroupStartsTyped<double>(col, group_starts);
+      return;
+    case ColumnType::kString:
+      // Equal strings are interned to the same id.
+      FindGroupStartsTyped<StringPool::Id>(col, group_starts);
+      return;
+    case ColumnType::kId:
+      // Ids are unique: each row is its own group.
+      group_starts->resize(col.overlay().size());
+      std::iota(group_starts->begin(), group_starts->end(), 0);
+      return;
+    case ColumnType::kDummy:
+      PERFETTO_FATAL("Dummy columns can't be sorted");
+  }
+  PERFETTO_FATAL("For GCC");
+}
+
 }  // namespace
 
 void QueryExecutor::FilterColumn(const Constraint& c,
@@ -267,8 +439,7 @@ RowMap QueryExecutor::FilterLegacy(const Table* table,
   RowMap rm(0, table->row_count());
   for (const auto& c : c_vec) {
     const Column& col = table->columns()[c.col_idx];
-    uint32_t column_size =
-        col.IsId() ? col.overlay().row_map().Max() : col.storage_base().size();
+    uint32_t column_size = LegacyColumnSize(col);
 
     // RowMap size
     bool use_legacy = rm.size() <= 1;
@@ -302,53 +473,157 @@ RowMap QueryExecutor::FilterLegacy(const Table* table,
       continue;
     }
 
-    // String columns are inherently nullable: null values are signified with
-    // Id::Null().
-    PERFETTO_CHECK(
-        !(col.col_type() == ColumnType::kString && col.IsNullable()));
+    LegacyColumn legacy_col(table, col);
+
+    // Indexed columns can be filtered with a binary search. This only pays off
+    // while the rows are a contiguous range: once other constraints narrowed
+    // them down, filtering just those rows is cheaper.
+    if (rm.IsRange() && rm.size() > 0 && ColumnIndex::CanSearch(c.op)) {
+      if (std::shared_ptr<const ColumnIndex> index =
+              table->GetIndex(c.col_idx)) {
+        Range bounds(rm.Get(0), rm.Get(0) + rm.size());
+        rm = index->Search(c.op, c.value, *legacy_col.simple_column().storage,
+                           bounds);
+        continue;
+      }
+    }
 
-    SimpleColumn s_col{OverlaysVec(), nullptr};
+    uint32_t pre_count = rm.size();
+    FilterColumn(c, legacy_col.simple_column(), &rm);
+    PERFETTO_DCHECK(rm.size() <= pre_count);
+  }
+  return rm;
+}
 
-    // Create storage
-    std::unique_ptr<Storage> storage;
-    if (col.IsId()) {
-      storage.reset(new storage::IdStorage(column_size));
-    } else if (col.col_type() == ColumnType::kString) {
-      storage.reset(new storage::StringStorage(
-          table->string_pool(),
-          static_cast<const StringPool::Id*>(col.storage_base().data()),
-          col.storage_base().non_null_size()));
-    } else {
-      storage.reset(new storage::NumericStorage(
-          col.storage_base().data(), col.storage_base().non_null_size(),
-          col.col_type(), col.IsSorted()));
+void QueryExecutor::SortColumn(const SimpleColumn& col,
+                               bool desc,
+                               std::vector<uint32_t>* table_indices) {
+  uint32_t size = static_cast<uint32_t>(table_indices->size());
+
+  std::vector<uint32_t> null_positions;
+  std::vector<storage::SortToken> tokens =
+      ToStorageSortTokens(col, *table_indices, &null_positions);
+  col.storage->StableSort(tokens.data(), static_cast<uint32_t>(tokens.size()),
+                          desc);
+
+  std::vector<uint32_t> sorted;
+  sorted.reserve(size);
+  if (!desc) {
+    for (uint32_t pos : null_positions)
+      sorted.push_back((*table_indices)[pos]);
+  }
+  for (const storage::SortToken& token : tokens)
+    sorted.push_back((*table_indices)[token.payload]);
+  if (desc) {
+    for (uint32_t pos : null_positions)
+      sorted.push_back((*table_indices)[pos]);
+  }
+  *table_indices = std::move(sorted);
+}
+
+RowMap QueryExecutor::SortLegacy(const Table* table,
+                                 const std::vector<Order>& ob) {
+  PERFETTO_DCHECK(!ob.empty());
+  uint32_t row_count = table->row_count();
+
+  // If the column is already sorted, only the reverse order might need to be
+  // computed.
+  const Column& first_col = table->columns()[ob.front().col_idx];
+  if (ob.size() == 1 && first_col.IsSorted()) {
+    if (!ob.front().desc)
+      return RowMap(0, row_count);
+    std::vector<uint32_t> idx(row_count);
+    std::iota(idx.rbegin(), idx.rend(), 0);
+    return RowMap(std::move(idx));
+  }
+
+  // Sorts |idx| by |orders|. If |idx| is in increasing order, ascending
+  // orders on sorted columns at the end of the list don't change it and can
+  // be skipped.
+  auto sort_by = [table](std::vector<Order>::const_iterator begin,
+                         std::vector<Order>::const_iterator end,
+                         std::vector<uint32_t>* idx) {
+    bool is_increasing = true;
+    for (auto it = std::make_reverse_iterator(end);
+         it != std::make_reverse_iterator(begin); ++it) {
+      const Column& col = table->columns()[it->col_idx];
+      if (is_increasing && col.IsSorted() && !it->desc)
+        continue;
+      is_increasing = false;
+
+      if (RequiresLegacySort(col)) {
+        col.StableSort(it->desc, idx);
+        continue;
+      }
+      LegacyColumn legacy_col(table, col);
+      SortColumn(legacy_col.simple_column(), it->desc, idx);
     }
-    s_col.storage = storage.get();
+  };
 
-    // Create cDBv2 overlays based on col.overlay()
-    overlays::SelectorOverlay selector_overlay(
-        col.overlay().row_map().GetIfBitVector());
-    if (col.overlay().size() != column_size &&
-        col.overlay().row_map().IsBitVector())
-      s_col.overlays.emplace_back(&selector_overlay);
+  if (!first_col.IsSorted() || first_col.IsNullable()) {
+    std::vector<uint32_t> idx(row_count);
+    std::iota(idx.begin(), idx.end(), 0);
+    sort_by(ob.begin(), ob.end(), &idx);
+    return RowMap(std::move(idx));
+  }
 
-    overlays::ArrangementOverlay arrangement_overlay(
-        col.overlay().row_map().GetIfIndexVector());
-    if (col.overlay().row_map().IsIndexVector())
-      s_col.overlays.emplace_back(&arrangement_overlay);
+  // The leading column is sorted, so rows are already grouped by its values:
+  // only the rows inside each group need to be sorted by the remaining orders
+  // and descending order just reverses the order of the groups.
+  std::vector<uint32_t> group_starts;
+  FindGroupStarts(first_col, &group_starts);
+  group_starts.push_back(row_count);
+
+  std::vector<uint32_t> idx;
+  idx.reserve(row_count);
+  std::vector<uint32_t> group;
+  uint32_t group_count = static_cast<uint32_t>(group_starts.size()) - 1;
+  for (uint32_t i = 0; i < group_count; ++i) {
+    uint32_t group_idx = ob.front().desc ? group_count - 1 - i : i;
+    group.resize(group_starts[group_idx + 1] - group_starts[group_idx]);
+    std::iota(group.begin(), group.end(), group_starts[group_idx]);
+    if (group.size() > 1)
+      sort_by(ob.begin() + 1, ob.end(), &group);
+    idx.insert(idx.end(), group.begin(), group.end());
+  }
+  return RowMap(std::move(idx));
+}
 
-    // Add nullability
-    BitVector null_bv;
-    overlays::NullOverlay null_overlay(
-        col.IsNullable() ? col.storage_base().bv() : &null_bv);
-    if (col.IsNullable())
-      s_col.overlays.emplace_back(&null_overlay);
+ColumnIndex QueryExecutor::CreateIndex(const SimpleColumn& col,
+                                       uint32_t row_count) {
+  std::vector<uint32_t> rows(row_count);
+  std::iota(rows.begin(), rows.end(), 0);
+
+  // As |rows| is the identity, positions in it are also table rows.
+  std::vector<uint32_t> null_rows;
+  std::vector<storage::SortToken> tokens =
+      ToStorageSortTokens(col, rows, &null_rows);
+  col.storage->StableSort(tokens.data(), static_cast<uint32_t>(tokens.size()),
+                          false);
+
+  std::vector<uint32_t> storage_indices(tokens.size());
+  rows.resize(tokens.size());
+  for (uint32_t i = 0; i < tokens.size(); ++i) {
+    storage_indices[i] = tokens[i].index;
+    rows[i] = tokens[i].payload;
+  }
+  return ColumnIndex(std::move(storage_indices), std::move(rows),
+                     std::move(null_rows));
+}
 
-    uint32_t pre_count = rm.size();
-    FilterColumn(c, s_col, &rm);
-    PERFETTO_DCHECK(rm.size() <= pre_count);
+base::StatusOr<ColumnIndex> QueryExecutor::CreateIndexLegacy(
+    const Table* table,
+    uint32_t col_idx) {
+  const Column& col = table->columns()[col_idx];
+  if (col.IsId() || col.IsSorted()) {
+    return base::ErrStatus("Column '%s' is sorted and doesn't need an index",
+                           col.name());
   }
-  return rm;
+  if (col.IsDense() || RequiresLegacySort(col)) {
+    return base::ErrStatus("Column '%s' doesn't support indexes", col.name());
+  }
+  LegacyColumn legacy_col(table, col);
+  return CreateIndex(legacy_col.simple_column(), table->row_count());
 }
 
 }  // namespace trace_processor
@@ -21,9 +21,11 @@
 #include <vector>
 
 #include "perfetto/ext/base/small_vector.h"
+#include "perfetto/ext/base/status_or.h"
 #include "src/trace_processor/containers/bit_vector.h"
 #include "src/trace_processor/containers/row_map.h"
 #include "src/trace_processor/db/column.h"
+#include "src/trace_processor/db/column_index.h"
 #include "src/trace_processor/db/overlays/storage_overlay.h"
 #include "src/trace_processor/db/overlays/types.h"
 #include "src/trace_processor/db/storage/storage.h"
@@ -32,7 +34,6 @@ namespace perfetto {
 namespace trace_processor {
 
 // Responsible for executing filtering/sorting operations on a single Table.
-// TODO(b/283763282): Introduce sorting.
 class QueryExecutor {
  public:
   static constexpr uint32_t kMaxOverlayCount = 8;
@@ -58,17 +59,31 @@ class QueryExecutor {
   }
 
   // Sorts using vector of Order.
-  // TODO(b/283763282): Implement.
-  RowMap Sort(const std::vector<Order>&) { PERFETTO_FATAL("Not implemented."); }
+  RowMap Sort(const std::vector<Order>& ob) {
+    std::vector<uint32_t> idx(row_count_);
+    std::iota(idx.begin(), idx.end(), 0);
+
+    // Stable sorting on each order in *reverse* order preserves the
+    // lexicographical ordering (see Table::Sort for details).
+    for (auto it = ob.rbegin(); it != ob.rend(); ++it) {
+      SortColumn(columns_[it->col_idx], it->desc, &idx);
+    }
+    return RowMap(std::move(idx));
+  }
 
   // Enables QueryExecutor::Filter on Table columns.
   static RowMap FilterLegacy(const Table*, const std::vector<Constraint>&);
 
   // Enables QueryExecutor::Sort on Table columns.
-  // TODO(b/283763282): Implement.
-  static RowMap SortLegacy(const Table*, const std::vector<Order>&) {
-    PERFETTO_FATAL("Not implemented.");
-  }
+  static RowMap SortLegacy(const Table*, const std::vector<Order>&);
+
+  // Creates an index over the first |row_count| rows of the column.
+  static ColumnIndex CreateIndex(const SimpleColumn&, uint32_t row_count);
+
+  // Enables QueryExecutor::CreateIndex on Table columns. Returns an error if
+  // the column can't be indexed.
+  static base::StatusOr<ColumnIndex> CreateIndexLegacy(const Table*,
+                                                       uint32_t col_idx);
 
   // Used only in unittests. Exposes private function.
   static void BoundedColumnFilterForTesting(const Constraint& c,
@@ -96,6 +111,12 @@ class QueryExecutor {
   // storage with.
   static RowMap IndexSearch(const Constraint&, const SimpleColumn&, RowMap*);
 
+  // Stable sorts |table_indices| by the values of the column. Nulls go before
+  // all other values in ascending order and after them in descending order.
+  static void SortColumn(const SimpleColumn&,
+                         bool desc,
+                         std::vector<uint32_t>* table_indices);
+
   std::vector<SimpleColumn> columns_;
 
   // Number of rows in the outmost overlay.
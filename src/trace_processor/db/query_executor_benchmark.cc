@@ -16,13 +16,16 @@
 
 #include <benchmark/benchmark.h>
 #include <initializer_list>
+#include <random>
 #include <string>
 
 #include "perfetto/ext/base/file_utils.h"
 #include "perfetto/ext/base/string_utils.h"
 #include "src/base/test/utils.h"
 #include "src/trace_processor/db/table.h"
+#include "src/trace_processor/tables/counter_tables_py.h"
 #include "src/trace_processor/tables/metadata_tables_py.h"
+#include "src/trace_processor/tables/sched_tables_py.h"
 #include "src/trace_processor/tables/slice_tables_py.h"
 #include "src/trace_processor/tables/track_tables_py.h"
 
@@ -35,6 +38,8 @@ using ThreadTrackTable = tables::ThreadTrackTable;
 using ExpectedFrameTimelineSliceTable = tables::ExpectedFrameTimelineSliceTable;
 using RawTable = tables::RawTable;
 using FtraceEventTable = tables::FtraceEventTable;
+using SchedSliceTable = tables::SchedSliceTable;
+using CounterTable = tables::CounterTable;
 
 // `SELECT * FROM SLICE` on android_monitor_contention_trace.at
 static char kSliceTable[] = "test/data/slice_table_for_benchmarks.csv";
@@ -50,6 +55,15 @@ static char kRawTable[] = "test/data/raw_cpu_for_benchmarks.csv";
 static char kFtraceEventTable[] =
     "test/data/ftrace_event_cpu_for_benchmarks.csv";
 
+// Number of rows in the synthetic sched table used for the sorting
+// benchmarks. This is in the ballpark of a long trace from a device with many
+// CPUs.
+static constexpr uint32_t kSchedSliceRows = 50 * 1000 * 1000;
+
+// Number of rows in the synthetic tables used for the benchmarks of full scans
+// of unsorted numeric columns.
+static constexpr uint32_t kNumericScanRows = 100 * 1000 * 1000;
+
 enum DB { V1, V2 };
 
 std::vector<std::string> SplitCSVLine(const std::string& line) {
@@ -193,6 +207,49 @@ struct FtraceEventTableForBenchmark {
   tables::FtraceEventTable table_{&pool_, &raw_};
 };
 
+struct SchedSliceTableForBenchmark {
+  explicit SchedSliceTableForBenchmark(uint32_t rows = kSchedSliceRows) {
+    static constexpr uint32_t kRandomSeed = 42;
+    static constexpr uint32_t kCpuCount = 16;
+    std::minstd_rand0 rnd_engine(kRandomSeed);
+
+    // Like in real traces, |ts| is sorted while the slices of all the CPUs
+    // are interleaved.
+    int64_t ts = 0;
+    for (uint32_t i = 0; i < rows; ++i) {
+      SchedSliceTable::Row row;
+      ts += rnd_engine() % 1000;
+      row.ts = ts;
+      row.dur = rnd_engine() % 100000;
+      row.cpu = rnd_engine() % kCpuCount;
+      row.utid = rnd_engine() % 1000;
+      row.priority = 120;
+      table_.Insert(row);
+    }
+  }
+
+  StringPool pool_;
+  SchedSliceTable table_{&pool_};
+};
+
+struct CounterTableForBenchmark {
+  explicit CounterTableForBenchmark(uint32_t rows) {
+    static constexpr uint32_t kRandomSeed = 42;
+    std::minstd_rand0 rnd_engine(kRandomSeed);
+
+    for (uint32_t i = 0; i < rows; ++i) {
+      CounterTable::Row row;
+      row.ts = i;
+      row.track_id = tables::CounterTrackTable::Id(rnd_engine() % 100);
+      row.value = static_cast<double>(rnd_engine() % 100000) / 100;
+      table_.Insert(row);
+    }
+  }
+
+  StringPool pool_;
+  CounterTable table_{&pool_};
+};
+
 void BenchmarkSliceTable(benchmark::State& state,
                          SliceTableForBenchmark& table,
                          std::initializer_list<Constraint> c) {
@@ -346,6 +403,82 @@ static void BM_QEFilterWithArrangement(benchmark::State& state) {
 
 BENCHMARK(BM_QEFilterWithArrangement)->ArgsProduct({{DB::V1, DB::V2}});
 
+void BenchmarkNumericScan(benchmark::State& state,
+                          const Table& table,
+                          std::initializer_list<Constraint> c) {
+  Table::kUseFilterV2 = state.range(0) == 1;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(table.FilterToRowMap(c));
+  }
+  state.counters["s/row"] =
+      benchmark::Counter(static_cast<double>(table.row_count()),
+                         benchmark::Counter::kIsIterationInvariantRate |
+                             benchmark::Counter::kInvert);
+}
+
+static void BM_QESchedSliceTableDurGt(benchmark::State& state) {
+  SchedSliceTableForBenchmark table(kNumericScanRows);
+  BenchmarkNumericScan(state, table.table_, {table.table_.dur().gt(50000)});
+}
+
+BENCHMARK(BM_QESchedSliceTableDurGt)
+    ->ArgsProduct({{DB::V1, DB::V2}})
+    ->Unit(benchmark::kMillisecond);
+
+static void BM_QESchedSliceTableCpuEq(benchmark::State& state) {
+  SchedSliceTableForBenchmark table(kNumericScanRows);
+  BenchmarkNumericScan(state, table.table_, {table.table_.cpu().eq(4)});
+}
+
+BENCHMARK(BM_QESchedSliceTableCpuEq)
+    ->ArgsProduct({{DB::V1, DB::V2}})
+    ->Unit(benchmark::kMillisecond);
+
+static void BM_QECounterTableValueLe(benchmark::State& state) {
+  CounterTableForBenchmark table(kNumericScanRows);
+  BenchmarkNumericScan(state, table.table_, {table.table_.value().le(500.0)});
+}
+
+BENCHMARK(BM_QECounterTableValueLe)
+    ->ArgsProduct({{DB::V1, DB::V2}})
+    ->Unit(benchmark::kMillisecond);
+
+static void BM_QESchedSliceTableSortCpuTs(benchmark::State& state) {
+  Table::kUseSortV2 = state.range(0) == 1;
+
+  SchedSliceTableForBenchmark table;
+  std::vector<Order> orders{{table.table_.cpu().index_in_table(), false},
+                            {table.table_.ts().index_in_table(), false}};
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(table.table_.Sort(orders));
+  }
+  state.counters["s/row"] =
+      benchmark::Counter(static_cast<double>(table.table_.row_count()),
+                         benchmark::Counter::kIsIterationInvariantRate |
+                             benchmark::Counter::kInvert);
+}
+
+BENCHMARK(BM_QESchedSliceTableSortCpuTs)
+    ->ArgsProduct({{DB::V1, DB::V2}})
+    ->Unit(benchmark::kMillisecond);
+
+static void BM_QESliceTableSortTrackIdDur(benchmark::State& state) {
+  Table::kUseSortV2 = state.range(0) == 1;
+
+  SliceTableForBenchmark table(state);
+  std::vector<Order> orders{{table.table_.track_id().index_in_table(), false},
+                            {table.table_.dur().index_in_table(), true}};
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(table.table_.Sort(orders));
+  }
+  state.counters["s/row"] =
+      benchmark::Counter(static_cast<double>(table.table_.row_count()),
+                         benchmark::Counter::kIsIterationInvariantRate |
+                             benchmark::Counter::kInvert);
+}
+
+BENCHMARK(BM_QESliceTableSortTrackIdDur)->ArgsProduct({{DB::V1, DB::V2}});
+
 }  // namespace
 }  // namespace trace_processor
 }  // namespace perfetto
@@ -31,6 +31,7 @@ using OverlaysVec = base::SmallVector<const overlays::StorageOverlay*,
 using NumericStorage = storage::NumericStorage;
 using StringStorage = storage::StringStorage;
 using SimpleColumn = QueryExecutor::SimpleColumn;
+using testing::ElementsAre;
 using ArrangementOverlay = overlays::ArrangementOverlay;
 using NullOverlay = overlays::NullOverlay;
 using SelectorOverlay = overlays::SelectorOverlay;
@@ -445,6 +446,145 @@ TEST(QueryExecutor, StringBinarySearchIsNull) {
   ASSERT_EQ(res.Get(0), 2u);
 }
 
+TEST(QueryExecutor, SortWithNullOverlay) {
+  std::vector<int64_t> storage_data{3, 1, 2, 1};
+  NumericStorage storage(storage_data.data(), 4, ColumnType::kInt64);
+
+  // Final vector
+  // 3, NULL, 1, NULL, 2, 1
+  BitVector null_bv{1, 0, 1, 0, 1, 1};
+  NullOverlay null_overlay(&null_bv);
+
+  OverlaysVec overlays_vec;
+  overlays_vec.emplace_back(&null_overlay);
+  SimpleColumn col{overlays_vec, &storage};
+  QueryExecutor exec({col}, 6);
+
+  RowMap asc = exec.Sort({Order{0, false}});
+  ASSERT_THAT(std::move(asc).TakeAsIndexVector(),
+              ElementsAre(1, 3, 2, 5, 4, 0));
+
+  RowMap desc = exec.Sort({Order{0, true}});
+  ASSERT_THAT(std::move(desc).TakeAsIndexVector(),
+              ElementsAre(0, 4, 2, 5, 1, 3));
+}
+
+TEST(QueryExecutor, SortWithNullAndArrangement) {
+  std::vector<int64_t> storage_data{3, 1, 2};
+  NumericStorage storage(storage_data.data(), 3, ColumnType::kInt64);
+
+  // Current vector
+  // 3, NULL, 1, 2
+  BitVector null_bv{1, 0, 1, 1};
+  NullOverlay null_overlay(&null_bv);
+
+  // Final vector
+  // 2, NULL, 3, 2, 1, NULL
+  std::vector<uint32_t> arrangement{3, 1, 0, 3, 2, 1};
+  ArrangementOverlay arrangement_overlay(&arrangement);
+
+  OverlaysVec overlays_vec;
+  overlays_vec.emplace_back(&arrangement_overlay);
+  overlays_vec.emplace_back(&null_overlay);
+  SimpleColumn col{overlays_vec, &storage};
+  QueryExecutor exec({col}, 6);
+
+  RowMap res = exec.Sort({Order{0, false}});
+  ASSERT_THAT(std::move(res).TakeAsIndexVector(),
+              ElementsAre(1, 5, 4, 0, 3, 2));
+}
+
+TEST(QueryExecutor, SortMultipleColumns) {
+  // Rows: (1, b), (0, c), (1, a), (0, a), (1, b)
+  std::vector<uint32_t> first_data{1, 0, 1, 0, 1};
+  NumericStorage first_storage(first_data.data(), 5, ColumnType::kUint32);
+  SimpleColumn first_col{OverlaysVec(), &first_storage};
+
+  StringPool pool;
+  std::vector<StringPool::Id> second_data;
+  for (const char* str : {"b", "c", "a", "a", "b"}) {
+    second_data.push_back(pool.InternString(str));
+  }
+  StringStorage second_storage(&pool, second_data.data(), 5);
+  SimpleColumn second_col{OverlaysVec(), &second_storage};
+
+  QueryExecutor exec({first_col, second_col}, 5);
+
+  RowMap res = exec.Sort({Order{0, false}, Order{1, true}});
+  ASSERT_THAT(std::move(res).TakeAsIndexVector(),
+              ElementsAre(1, 3, 0, 4, 2));
+}
+
+TEST(QueryExecutor, SortStringsWithNull) {
+  StringPool pool;
+  std::vector<StringPool::Id> data;
+  data.push_back(pool.InternString("pasta"));
+  data.push_back(StringPool::Id::Null());
+  data.push_back(pool.InternString("cheese"));
+  StringStorage storage(&pool, data.data(), 3);
+  SimpleColumn col{OverlaysVec(), &storage};
+  QueryExecutor exec({col}, 3);
+
+  RowMap asc = exec.Sort({Order{0, false}});
+  ASSERT_THAT(std::move(asc).TakeAsIndexVector(), ElementsAre(1, 2, 0));
+
+  RowMap desc = exec.Sort({Order{0, true}});
+  ASSERT_THAT(std::move(desc).TakeAsIndexVector(), ElementsAre(0, 2, 1));
+}
+
+TEST(QueryExecutor, ColumnIndexWithNullOverlay) {
+  std::vector<int64_t> storage_data{0, 1, 2, 0, 1, 2};
+  NumericStorage storage(storage_data.data(), 6, ColumnType::kInt64);
+
+  // Final vec {0, 1, NULL, 2, 0, NULL, 1, NULL, NULL, 2}.
+  BitVector bv{1, 1, 0, 1, 1, 0, 1, 0, 0, 1};
+  NullOverlay overlay(&bv);
+  OverlaysVec overlays_vec;
+  overlays_vec.emplace_back(&overlay);
+
+  SimpleColumn col{overlays_vec, &storage};
+  ColumnIndex index = QueryExecutor::CreateIndex(col, 10);
+
+  RowMap res = index.Search(FilterOp::kGe, SqlValue::Long(1), storage,
+                            RowMap::Range(0, 10));
+  ASSERT_THAT(res.GetAllIndices(), ElementsAre(1u, 3u, 6u, 9u));
+
+  res = index.Search(FilterOp::kLt, SqlValue::Long(2), storage,
+                     RowMap::Range(0, 10));
+  ASSERT_THAT(res.GetAllIndices(), ElementsAre(0u, 1u, 4u, 6u));
+
+  res = index.Search(FilterOp::kEq, SqlValue::Long(0), storage,
+                     RowMap::Range(2, 10));
+  ASSERT_THAT(res.GetAllIndices(), ElementsAre(4u));
+
+  res = index.Search(FilterOp::kIsNull, SqlValue(), storage,
+                     RowMap::Range(0, 6));
+  ASSERT_THAT(res.GetAllIndices(), ElementsAre(2u, 5u));
+}
+
+TEST(QueryExecutor, ColumnIndexStrings) {
+  StringPool pool;
+  std::vector<std::string> strings{"cheese",  "pasta", "pizza",
+                                   "pierogi", "onion", "fries"};
+  std::vector<StringPool::Id> ids;
+  for (const auto& string : strings) {
+    ids.push_back(pool.InternString(base::StringView(string)));
+  }
+  ids.insert(ids.begin() + 3, StringPool::Id::Null());
+  StringStorage storage(&pool, ids.data(), 7);
+  SimpleColumn col{OverlaysVec(), &storage};
+
+  ColumnIndex index = QueryExecutor::CreateIndex(col, 7);
+
+  RowMap res = index.Search(FilterOp::kGt, SqlValue::String("onion"), storage,
+                            RowMap::Range(0, 7));
+  ASSERT_THAT(res.GetAllIndices(), ElementsAre(1u, 2u, 4u));
+
+  res = index.Search(FilterOp::kIsNull, SqlValue(), storage,
+                     RowMap::Range(0, 7));
+  ASSERT_THAT(res.GetAllIndices(), ElementsAre(3u));
+}
+
 #if !PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
 TEST(QueryExecutor, StringBinarySearchRegex) {
   StringPool pool;
@@ -0,0 +1,451 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/db/storage/compressed_storage.h"
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <optional>
+#include <string>
+#include <type_traits>
+
+#include "src/trace_processor/containers/bit_vector.h"
+#include "src/trace_processor/containers/compressed_vector.h"
+#include "src/trace_processor/containers/row_map.h"
+#include "src/trace_processor/db/storage/types.h"
+#include "src/trace_processor/db/storage/utils.h"
+#include "src/trace_processor/tp_metatrace.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace storage {
+namespace {
+
+// Calls |fn| with the CompressedVector pointed by |compressed|, cast to the
+// type backing |type|.
+template <typename Fn>
+auto VisitCompressed(ColumnType type, const void* compressed, Fn fn) {
+  switch (type) {
+    case ColumnType::kInt32:
+      return fn(*static_cast<const CompressedVector<int32_t>*>(compressed));
+    case ColumnType::kUint32:
+      return fn(*static_cast<const CompressedVector<uint32_t>*>(compressed));
+    case ColumnType::kInt64:
+      return fn(*static_cast<const CompressedVector<int64_t>*>(compressed));
+    case ColumnType::kDouble:
+    case ColumnType::kString:
+    case ColumnType::kDummy:
+    case ColumnType::kId:
+      break;
+  }
+  PERFETTO_FATAL("Invalid type for compressed storage.");
+}
+
+// Casts |val| to T, returns std::nullopt if SqlValue can't be cast and should
+// be considered invalid for comparison. Matches NumericStorage.
+template <typename T>
+std::optional<T> GetTypedValue(SqlValue val) {
+  if (val.is_null())
+    return std::nullopt;
+  int64_t long_val = val.AsLong();
+  if constexpr (!std::is_same_v<T, int64_t>) {
+    if (long_val > std::numeric_limits<T>::max() ||
+        long_val < std::numeric_limits<T>::min())
+      return std::nullopt;
+  }
+  return static_cast<T>(long_val);
+}
+
+// Calls |fn| with the std comparator for |op|.
+template <typename Fn>
+auto WithComparator(FilterOp op, Fn fn) {
+  switch (op) {
+    case FilterOp::kEq:
+      return fn(std::equal_to<>());
+    case FilterOp::kNe:
+      return fn(std::not_equal_to<>());
+    case FilterOp::kGe:
+      return fn(std::greater_equal<>());
+    case FilterOp::kGt:
+      return fn(std::greater<>());
+    case FilterOp::kLe:
+      return fn(std::less_equal<>());
+    case FilterOp::kLt:
+      return fn(std::less<>());
+    case FilterOp::kGlob:
+    case FilterOp::kRegex:
+    case FilterOp::kIsNotNull:
+    case FilterOp::kIsNull:
+      break;
+  }
+  PERFETTO_FATAL("Not a valid operation on numeric type.");
+}
+
+// Calls |fn| with a comparator and a code such that comparing the codes of
+// a dictionary encoded vector with it is the same as comparing the values with
+// |val| using |op|. This works as the dictionary is sorted.
+template <typename T, typename Fn>
+void WithDictionaryComparator(const CompressedVector<T>& cv,
+                              FilterOp op,
+                              T val,
+                              Fn fn) {
+  const std::vector<T>& dict = cv.dictionary();
+  auto lower = static_cast<uint32_t>(
+      std::lower_bound(dict.begin(), dict.end(), val) - dict.begin());
+  auto upper = static_cast<uint32_t>(
+      std::upper_bound(dict.begin(), dict.end(), val) - dict.begin());
+  // No code is equal to |kMaxDictionarySize| so use it when |val| is not in
+  // the dictionary.
+  uint32_t equal =
+      lower == upper ? CompressedVector<T>::kMaxDictionarySize : lower;
+  switch (op) {
+    case FilterOp::kEq:
+      fn(std::equal_to<uint32_t>(), equal);
+      return;
+    case FilterOp::kNe:
+      fn(std::not_equal_to<uint32_t>(), equal);
+      return;
+    case FilterOp::kLt:
+      fn(std::less<uint32_t>(), lower);
+      return;
+    case FilterOp::kLe:
+      fn(std::less<uint32_t>(), upper);
+      return;
+    case FilterOp::kGt:
+      fn(std::greater_equal<uint32_t>(), upper);
+      return;
+    case FilterOp::kGe:
+      fn(std::greater_equal<uint32_t>(), lower);
+      return;
+    case FilterOp::kGlob:
+    case FilterOp::kRegex:
+    case FilterOp::kIsNotNull:
+    case FilterOp::kIsNull:
+      break;
+  }
+  PERFETTO_FATAL("Not a valid operation on numeric type.");
+}
+
+// Returns a word with the bit k set iff |comparator| returns true for the k-th
+// value of |block| and |val|.
+template <typename T, typename Comparator>
+uint64_t FrameOfReferenceWord(const CompressedVector<T>& cv,
+                              uint32_t block,
+                              T val,
+                              Comparator comparator) {
+  // If all the values of the block are greater (or all smaller) than |val|,
+  // the result is the same for all of them.
+  const uint64_t if_greater = comparator(1, 0) ? ~0ull : 0;
+  const uint64_t if_smaller = comparator(0, 1) ? ~0ull : 0;
+
+  T base = cv.block_base(block);
+  if (val < base)
+    return if_greater;
+  uint64_t rel = CompressedVector<T>::Difference(val, base);
+  if (rel > cv.block_max_delta(block))
+    return if_smaller;
+
+  // Otherwise, compare the deltas with the delta of |val|: this has the same
+  // result as comparing the values.
+  uint64_t word = 0;
+  for (uint32_t k = 0; k < BitVector::kBitsInWord; ++k) {
+    bool comp_result = comparator(cv.GetDelta(block, k), rel);
+    word |= static_cast<uint64_t>(comp_result) << k;
+  }
+  return word;
+}
+
+template <typename T, typename Comparator>
+void FrameOfReferenceSearch(const CompressedVector<T>& cv,
+                            T val,
+                            uint32_t start,
+                            Comparator comparator,
+                            BitVector::Builder& builder) {
+  static_assert(CompressedVector<T>::kBlockSize == BitVector::kBitsInWord);
+
+  // Slow path: we compare <64 elements and append to get us to a word
+  // boundary.
+  uint32_t cur = start;
+  uint32_t front_elements = builder.BitsUntilWordBoundaryOrFull();
+  for (uint32_t i = 0; i < front_elements; ++i, ++cur) {
+    builder.Append(comparator(cv.Get(cur), val));
+  }
+
+  // Fast path: as the blocks are aligned with words, each word of the result
+  // is computed from exactly one block.
+  uint32_t fast_path_elements = builder.BitsInCompleteWordsUntilFull();
+  for (uint32_t i = 0; i < fast_path_elements; i += BitVector::kBitsInWord) {
+    builder.AppendWord(FrameOfReferenceWord(
+        cv, cur / CompressedVector<T>::kBlockSize, val, comparator));
+    cur += BitVector::kBitsInWord;
+  }
+
+  // Slow path: we compare <64 elements and append to fill the Builder.
+  uint32_t back_elements = builder.BitsUntilFull();
+  for (uint32_t i = 0; i < back_elements; ++i, ++cur) {
+    builder.Append(comparator(cv.Get(cur), val));
+  }
+}
+
+// Returns the first index in |range| for which |pred| is false. |pred| must be
+// true for all the values before it and false for all the values after it.
+template <typename T, typename Pred>
+uint32_t PartitionPoint(const CompressedVector<T>& cv,
+                        RowMap::Range range,
+                        Pred pred) {
+  uint32_t first = range.start;
+  uint32_t count = range.end - range.start;
+  while (count > 0) {
+    uint32_t step = count / 2;
+    if (pred(cv.Get(first + step))) {
+      first += step + 1;
+      count -= step + 1;
+    } else {
+      count = step;
+    }
+  }
+  return first;
+}
+
+// Returns the range of [start, end) matching |op| given the positions of the
+// first element not less than the value (|lower|) and of the first element
+// greater than it (|upper|).
+RowMap::Range SortedRangeForOp(FilterOp op,
+                               uint32_t start,
+                               uint32_t end,
+                               uint32_t lower,
+                               uint32_t upper) {
+  switch (op) {
+    case FilterOp::kEq:
+      return RowMap::Range(lower, upper);
+    case FilterOp::kLe:
+      return RowMap::Range(start, upper);
+    case FilterOp::kLt:
+      return RowMap::Range(start, lower);
+    case FilterOp::kGe:
+      return RowMap::Range(lower, end);
+    case FilterOp::kGt:
+      return RowMap::Range(upper, end);
+    case FilterOp::kNe:
+    case FilterOp::kIsNull:
+    case FilterOp::kIsNotNull:
+    case FilterOp::kGlob:
+    case FilterOp::kRegex:
+      return RowMap::Range();
+  }
+  return RowMap::Range();
+}
+
+}  // namespace
+
+CompressedStorage::CompressedStorage(const void* compressed,
+                                     ColumnType type,
+                                     bool is_sorted)
+    : type_(type),
+      compressed_(compressed),
+      size_(VisitCompressed(type, compressed,
+                            [](const auto& cv) { return cv.size(); })),
+      is_sorted_(is_sorted) {}
+
+RangeOrBitVector CompressedStorage::Search(FilterOp op,
+                                           SqlValue value,
+                                           RowMap::Range range) const {
+  if (is_sorted_)
+    return RangeOrBitVector(BinarySearchIntrinsic(op, value, range));
+  return RangeOrBitVector(LinearSearch(op, value, range));
+}
+
+RangeOrBitVector CompressedStorage::IndexSearch(FilterOp op,
+                                                SqlValue value,
+                                                uint32_t* indices,
+                                                uint32_t indices_count,
+                                                bool sorted) const {
+  if (sorted) {
+    return RangeOrBitVector(
+        BinarySearchExtrinsic(op, value, indices, indices_count));
+  }
+  return RangeOrBitVector(IndexSearch(op, value, indices, indices_count));
+}
+
+BitVector CompressedStorage::LinearSearch(FilterOp op,
+                                          SqlValue sql_val,
+                                          RowMap::Range range) const {
+  PERFETTO_TP_TRACE(metatrace::Category::DB, "CompressedStorage::LinearSearch",
+                    [&range, op](metatrace::Record* r) {
+                      r->AddArg("Start", std::to_string(range.start));
+                      r->AddArg("End", std::to_string(range.end));
+                      r->AddArg("Op",
+                                std::to_string(static_cast<uint32_t>(op)));
+                    });
+
+  if (op == FilterOp::kIsNotNull)
+    return BitVector(size(), true);
+
+  if (op == FilterOp::kIsNull || op == FilterOp::kGlob ||
+      op == FilterOp::kRegex)
+    return BitVector(size(), false);
+
+  return VisitCompressed(type_, compressed_, [&](const auto& cv) {
+    using T = typename std::decay_t<decltype(cv)>::ValueType;
+    std::optional<T> val = GetTypedValue<T>(sql_val);
+    if (!val.has_value())
+      return BitVector(size(), false);
+
+    BitVector::Builder builder(range.end, range.start);
+    if (cv.encoding() == CompressedVector<T>::Encoding::kDictionary) {
+      WithDictionaryComparator(
+          cv, op, *val, [&](auto comparator, uint32_t code) {
+            utils::LinearSearchWithComparator(
+                code, cv.codes().data() + range.start, comparator, builder);
+          });
+    } else {
+      WithComparator(op, [&](auto comparator) {
+        FrameOfReferenceSearch(cv, *val, range.start, comparator, builder);
+      });
+    }
+    return std::move(builder).Build();
+  });
+}
+
+BitVector CompressedStorage::IndexSearch(FilterOp op,
+                                         SqlValue sql_val,
+                                         uint32_t* indices,
+                                         uint32_t indices_count) const {
+  PERFETTO_TP_TRACE(metatrace::Category::DB, "CompressedStorage::IndexSearch",
+                    [indices_count, op](metatrace::Record* r) {
+                      r->AddArg("Count", std::to_string(indices_count));
+                      r->AddArg("Op",
+                                std::to_string(static_cast<uint32_t>(op)));
+                    });
+
+  if (op == FilterOp::kIsNotNull)
+    return BitVector(indices_count, true);
+
+  if (op == FilterOp::kIsNull || op == FilterOp::kGlob ||
+      op == FilterOp::kRegex)
+    return BitVector(indices_count, false);
+
+  return VisitCompressed(type_, compressed_, [&](const auto& cv) {
+    using T = typename std::decay_t<decltype(cv)>::ValueType;
+    std::optional<T> val = GetTypedValue<T>(sql_val);
+    if (!val.has_value())
+      return BitVector(indices_count, false);
+
+    BitVector::Builder builder(indices_count);
+    if (cv.encoding() == CompressedVector<T>::Encoding::kDictionary) {
+      WithDictionaryComparator(
+          cv, op, *val, [&](auto comparator, uint32_t code) {
+            utils::IndexSearchWithComparator(code, cv.codes().data(), indices,
+                                             comparator, builder);
+          });
+    } else {
+      WithComparator(op, [&](auto comparator) {
+        for (uint32_t i = 0; i < indices_count; ++i) {
+          builder.Append(comparator(cv.Get(indices[i]), *val));
+        }
+      });
+    }
+    return std::move(builder).Build();
+  });
+}
+
+RowMap::Range CompressedStorage::BinarySearchIntrinsic(
+    FilterOp op,
+    SqlValue sql_val,
+    RowMap::Range search_range) const {
+  if (op == FilterOp::kIsNotNull)
+    return search_range;
+
+  return VisitCompressed(type_, compressed_, [&](const auto& cv) {
+    using T = typename std::decay_t<decltype(cv)>::ValueType;
+    std::optional<T> val = GetTypedValue<T>(sql_val);
+    if (!val.has_value() || op == FilterOp::kIsNull || op == FilterOp::kGlob)
+      return RowMap::Range();
+
+    uint32_t lower =
+        PartitionPoint(cv, search_range, [&](T x) { return x < *val; });
+    uint32_t upper =
+        PartitionPoint(cv, search_range, [&](T x) { return x <= *val; });
+    return SortedRangeForOp(op, search_range.start, search_range.end, lower,
+                            upper);
+  });
+}
+
+RowMap::Range CompressedStorage::BinarySearchExtrinsic(
+    FilterOp op,
+    SqlValue sql_val,
+    uint32_t* indices,
+    uint32_t indices_count) const {
+  if (op == FilterOp::kIsNotNull)
+    return RowMap::Range(0, indices_count);
+
+  return VisitCompressed(type_, compressed_, [&](const auto& cv) {
+    using T = typename std::decay_t<decltype(cv)>::ValueType;
+    std::optional<T> val = GetTypedValue<T>(sql_val);
+    if (!val.has_value() || op == FilterOp::kIsNull || op == FilterOp::kGlob)
+      return RowMap::Range();
+
+    uint32_t* end = indices + indices_count;
+    auto lower = static_cast<uint32_t>(
+        std::partition_point(indices, end,
+                             [&](uint32_t i) { return cv.Get(i) < *val; }) -
+        indices);
+    auto upper = static_cast<uint32_t>(
+        std::partition_point(indices, end,
+                             [&](uint32_t i) { return cv.Get(i) <= *val; }) -
+        indices);
+    return SortedRangeForOp(op, 0, indices_count, lower, upper);
+  });
+}
+
+void CompressedStorage::StableSort(SortToken* tokens,
+                                   uint32_t tokens_size,
+                                   bool desc) const {
+  VisitCompressed(type_, compressed_, [&](const auto& cv) {
+    if (desc) {
+      std::stable_sort(tokens, tokens + tokens_size,
+                       [&cv](SortToken a, SortToken b) {
+                         return cv.Get(a.index) > cv.Get(b.index);
+                       });
+      return;
+    }
+    std::stable_sort(tokens, tokens + tokens_size,
+                     [&cv](SortToken a, SortToken b) {
+                       return cv.Get(a.index) < cv.Get(b.index);
+                     });
+  });
+}
+
+void CompressedStorage::Sort(SortToken* tokens,
+                             uint32_t tokens_size,
+                             bool desc) const {
+  VisitCompressed(type_, compressed_, [&](const auto& cv) {
+    if (desc) {
+      std::sort(tokens, tokens + tokens_size, [&cv](SortToken a, SortToken b) {
+        return cv.Get(a.index) > cv.Get(b.index);
+      });
+      return;
+    }
+    std::sort(tokens, tokens + tokens_size, [&cv](SortToken a, SortToken b) {
+      return cv.Get(a.index) < cv.Get(b.index);
+    });
+  });
+}
+
+}  // namespace storage
+}  // namespace trace_processor
+}  // namespace perfetto
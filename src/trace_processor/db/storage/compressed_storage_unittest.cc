@@ -0,0 +1,230 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "src/trace_processor/db/storage/compressed_storage.h"
+
+#include <algorithm>
+#include <limits>
+#include <numeric>
+#include <random>
+
+#include "src/trace_processor/containers/compressed_vector.h"
+#include "src/trace_processor/db/storage/numeric_storage.h"
+#include "src/trace_processor/db/storage/types.h"
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace storage {
+namespace {
+
+using Range = RowMap::Range;
+
+constexpr FilterOp kOps[] = {
+    FilterOp::kEq, FilterOp::kNe, FilterOp::kLt,        FilterOp::kLe,
+    FilterOp::kGt, FilterOp::kGe, FilterOp::kIsNotNull, FilterOp::kIsNull,
+};
+
+std::vector<uint32_t> ToSetIndices(RangeOrBitVector res) {
+  std::vector<uint32_t> out;
+  if (res.IsRange()) {
+    Range range = std::move(res).TakeIfRange();
+    for (uint32_t i = range.start; i < range.end; ++i)
+      out.push_back(i);
+    return out;
+  }
+  BitVector bv = std::move(res).TakeIfBitVector();
+  for (uint32_t i = 0; i < bv.size(); ++i) {
+    if (bv.IsSet(i))
+      out.push_back(i);
+  }
+  return out;
+}
+
+std::vector<uint32_t> ToIndices(const std::vector<SortToken>& tokens) {
+  std::vector<uint32_t> indices;
+  for (const SortToken& token : tokens)
+    indices.push_back(token.index);
+  return indices;
+}
+
+// Checks that searching and sorting |data_vec| with CompressedStorage gives the
+// same results as with NumericStorage.
+template <typename T>
+void CheckMatchesNumericStorage(
+    ColumnType type,
+    const std::vector<T>& data_vec,
+    typename CompressedVector<T>::Encoding expected_encoding,
+    const std::vector<SqlValue>& values,
+    bool is_sorted) {
+  std::optional<CompressedVector<T>> cv =
+      CompressedVector<T>::Compress(data_vec);
+  ASSERT_TRUE(cv.has_value());
+  ASSERT_EQ(cv->encoding(), expected_encoding);
+
+  auto size = static_cast<uint32_t>(data_vec.size());
+  NumericStorage numeric(data_vec.data(), size, type, is_sorted);
+  CompressedStorage compressed(&*cv, type, is_sorted);
+  ASSERT_EQ(compressed.size(), size);
+
+  std::minstd_rand0 rnd(0);
+  std::vector<uint32_t> indices(size / 2);
+  for (uint32_t& index : indices)
+    index = static_cast<uint32_t>(rnd() % size);
+  std::vector<uint32_t> sorted_indices = indices;
+  std::sort(sorted_indices.begin(), sorted_indices.end());
+  auto indices_count = static_cast<uint32_t>(indices.size());
+
+  for (FilterOp op : kOps) {
+    for (SqlValue value : values) {
+      for (uint32_t start : {0u, 1u, 63u, 64u, 65u, 200u}) {
+        Range range(start, size - start / 2);
+        ASSERT_EQ(ToSetIndices(compressed.Search(op, value, range)),
+                  ToSetIndices(numeric.Search(op, value, range)))
+            << "op " << static_cast<int>(op) << " start " << start;
+      }
+      ASSERT_EQ(ToSetIndices(compressed.IndexSearch(op, value, indices.data(),
+                                                    indices_count, false)),
+                ToSetIndices(numeric.IndexSearch(op, value, indices.data(),
+                                                 indices_count, false)))
+          << "op " << static_cast<int>(op);
+      if (is_sorted) {
+        ASSERT_EQ(
+            ToSetIndices(compressed.IndexSearch(
+                op, value, sorted_indices.data(), indices_count, true)),
+            ToSetIndices(numeric.IndexSearch(op, value, sorted_indices.data(),
+                                             indices_count, true)))
+            << "op " << static_cast<int>(op);
+      }
+    }
+  }
+
+  for (bool desc : {false, true}) {
+    std::vector<SortToken> expected;
+    for (uint32_t i = 0; i < indices_count; ++i)
+      expected.push_back(SortToken{indices[i], i});
+    std::vector<SortToken> actual = expected;
+    numeric.StableSort(expected.data(), indices_count, desc);
+    compressed.StableSort(actual.data(), indices_count, desc);
+    ASSERT_EQ(ToIndices(actual), ToIndices(expected));
+
+    std::vector<T> expected_values;
+    for (uint32_t index : ToIndices(expected))
+      expected_values.push_back(data_vec[index]);
+    compressed.Sort(actual.data(), indices_count, desc);
+    std::vector<T> actual_values;
+    for (uint32_t index : ToIndices(actual))
+      actual_values.push_back(data_vec[index]);
+    ASSERT_EQ(actual_values, expected_values);
+  }
+}
+
+TEST(CompressedStorageUnittest, SortedTimestamps) {
+  std::minstd_rand0 rnd(0);
+  std::vector<int64_t> data_vec;
+  int64_t ts = 1000000000;
+  for (uint32_t i = 0; i < 1000; ++i) {
+    // Runs of equal timestamps and some large gaps.
+    if (i % 5 != 0)
+      ts += rnd() % 1000;
+    if (i % 300 == 0)
+      ts += 1ll << 40;
+    data_vec.push_back(ts);
+  }
+  std::vector<SqlValue> values{
+      SqlValue::Long(data_vec[0] - 1), SqlValue::Long(data_vec[0]),
+      SqlValue::Long(data_vec[128]),   SqlValue::Long(data_vec[500] + 1),
+      SqlValue::Long(data_vec[999]),   SqlValue::Long(data_vec[999] + 1),
+      SqlValue(),
+  };
+  CheckMatchesNumericStorage(
+      ColumnType::kInt64, data_vec,
+      CompressedVector<int64_t>::Encoding::kFrameOfReference, values, true);
+  CheckMatchesNumericStorage(
+      ColumnType::kInt64, data_vec,
+      CompressedVector<int64_t>::Encoding::kFrameOfReference, values, false);
+}
+
+TEST(CompressedStorageUnittest, ClusteredInt64) {
+  std::minstd_rand0 rnd(0);
+  std::vector<int64_t> data_vec;
+  for (uint32_t i = 0; i < 1000; ++i)
+    data_vec.push_back(static_cast<int64_t>(rnd() % 4096) - 2048);
+  // A block spanning the whole int64 range.
+  data_vec[130] = std::numeric_limits<int64_t>::min();
+  data_vec[140] = std::numeric_limits<int64_t>::max();
+  std::vector<SqlValue> values{
+      SqlValue::Long(-2049),
+      SqlValue::Long(0),
+      SqlValue::Long(data_vec[10]),
+      SqlValue::Long(5000),
+      SqlValue::Long(std::numeric_limits<int64_t>::min()),
+      SqlValue::Long(std::numeric_limits<int64_t>::max()),
+  };
+  CheckMatchesNumericStorage(
+      ColumnType::kInt64, data_vec,
+      CompressedVector<int64_t>::Encoding::kFrameOfReference, values, false);
+}
+
+TEST(CompressedStorageUnittest, SortedIds) {
+  std::vector<uint32_t> data_vec(1000);
+  std::iota(data_vec.begin(), data_vec.end(), 1u << 31);
+  std::vector<SqlValue> values{
+      SqlValue::Long(0),
+      SqlValue::Long((1ll << 31) + 500),
+      SqlValue::Long((1ll << 31) + 1000),
+      SqlValue::Long(-1),
+      SqlValue::Long(1ll << 40),
+  };
+  CheckMatchesNumericStorage(
+      ColumnType::kUint32, data_vec,
+      CompressedVector<uint32_t>::Encoding::kFrameOfReference, values, true);
+}
+
+TEST(CompressedStorageUnittest, DictionaryInt32) {
+  std::vector<int32_t> data_vec;
+  for (int32_t i = 0; i < 1000; ++i)
+    data_vec.push_back(((i * 7919) % 21 - 10) * 100000);
+  std::vector<SqlValue> values{
+      SqlValue::Long(-1000001), SqlValue::Long(-1000000),
+      SqlValue::Long(-50),      SqlValue::Long(0),
+      SqlValue::Long(1000000),  SqlValue::Long(1000001),
+      SqlValue::Long(1ll << 40),
+  };
+  CheckMatchesNumericStorage(ColumnType::kInt32, data_vec,
+                             CompressedVector<int32_t>::Encoding::kDictionary,
+                             values, false);
+}
+
+TEST(CompressedStorageUnittest, DictionarySorted) {
+  std::vector<uint32_t> data_vec;
+  for (uint32_t i = 0; i < 1000; ++i)
+    data_vec.push_back(i / 10 * 1000000);
+  std::vector<SqlValue> values{
+      SqlValue::Long(0),
+      SqlValue::Long(5000000),
+      SqlValue::Long(5000001),
+      SqlValue::Long(99000000),
+      SqlValue::Long(100000000),
+  };
+  CheckMatchesNumericStorage(ColumnType::kUint32, data_vec,
+                             CompressedVector<uint32_t>::Encoding::kDictionary,
+                             values, true);
+}
+
+}  // namespace
+}  // namespace storage
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -173,13 +173,26 @@ RowMap::Range IdStorage::BinarySearchIntrinsic(FilterOp op,
   return RowMap::Range();
 }
 
-void IdStorage::StableSort(uint32_t* indices, uint32_t indices_size) const {
-  // We can use sort, as |indices| will not have duplicates.
-  Sort(indices, indices_size);
+void IdStorage::StableSort(SortToken* tokens,
+                           uint32_t tokens_size,
+                           bool desc) const {
+  if (desc) {
+    std::stable_sort(tokens, tokens + tokens_size,
+                     [](SortToken a, SortToken b) { return a.index > b.index; });
+    return;
+  }
+  std::stable_sort(tokens, tokens + tokens_size,
+                   [](SortToken a, SortToken b) { return a.index < b.index; });
 }
 
-void IdStorage::Sort(uint32_t* indices, uint32_t indices_size) const {
-  std::sort(indices, indices + indices_size);
+void IdStorage::Sort(SortToken* tokens, uint32_t tokens_size, bool desc) const {
+  if (desc) {
+    std::sort(tokens, tokens + tokens_size,
+              [](SortToken a, SortToken b) { return a.index > b.index; });
+    return;
+  }
+  std::sort(tokens, tokens + tokens_size,
+            [](SortToken a, SortToken b) { return a.index < b.index; });
 }
 
 }  // namespace storage
@@ -41,9 +41,11 @@ class IdStorage final : public Storage {
                                uint32_t indices_count,
                                bool sorted) const override;
 
-  void StableSort(uint32_t* rows, uint32_t rows_size) const override;
+  void StableSort(SortToken* tokens,
+                  uint32_t tokens_size,
+                  bool desc) const override;
 
-  void Sort(uint32_t* rows, uint32_t rows_size) const override;
+  void Sort(SortToken* tokens, uint32_t tokens_size, bool desc) const override;
 
   uint32_t size() const override { return size_; }
 
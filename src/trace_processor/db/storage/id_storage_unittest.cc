@@ -23,6 +23,7 @@ namespace trace_processor {
 namespace storage {
 namespace {
 
+using testing::ElementsAre;
 using Range = RowMap::Range;
 
 TEST(IdStorageUnittest, BinarySearchIntrinsicEqSimple) {
@@ -89,12 +90,25 @@ TEST(IdStorageUnittest, BinarySearchIntrinsicGt) {
 }
 
 TEST(IdStorageUnittest, Sort) {
-  std::vector<uint32_t> order{4, 3, 6, 1, 5};
+  std::vector<SortToken> tokens{{4, 0}, {3, 1}, {6, 2}, {1, 3}, {5, 4}};
   IdStorage storage(10);
-  storage.Sort(order.data(), 5);
+  storage.Sort(tokens.data(), 5, false);
 
-  std::vector<uint32_t> sorted_order{1, 3, 4, 5, 6};
-  ASSERT_EQ(order, sorted_order);
+  std::vector<uint32_t> payloads;
+  for (const SortToken& token : tokens)
+    payloads.push_back(token.payload);
+  ASSERT_THAT(payloads, ElementsAre(3, 1, 0, 4, 2));
+}
+
+TEST(IdStorageUnittest, SortDesc) {
+  std::vector<SortToken> tokens{{4, 0}, {3, 1}, {6, 2}, {1, 3}, {5, 4}};
+  IdStorage storage(10);
+  storage.Sort(tokens.data(), 5, true);
+
+  std::vector<uint32_t> payloads;
+  for (const SortToken& token : tokens)
+    payloads.push_back(token.payload);
+  ASSERT_THAT(payloads, ElementsAre(2, 4, 0, 1, 3));
 }
 
 }  // namespace
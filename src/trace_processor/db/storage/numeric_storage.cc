@@ -16,13 +16,23 @@
  */
 
 #include "src/trace_processor/db/storage/numeric_storage.h"
+
+#include <array>
+#include <cstring>
+#include <memory>
 #include <string>
+
+#include "perfetto/base/build_config.h"
 #include "src/trace_processor/containers/bit_vector.h"
 #include "src/trace_processor/containers/row_map.h"
 #include "src/trace_processor/db/storage/types.h"
 #include "src/trace_processor/db/storage/utils.h"
 #include "src/trace_processor/tp_metatrace.h"
 
+#if PERFETTO_BUILDFLAG(PERFETTO_X64_CPU_OPT)
+#include <immintrin.h>
+#endif
+
 namespace perfetto {
 namespace trace_processor {
 namespace storage {
@@ -73,6 +83,14 @@ inline std::optional<NumericValue> GetNumericTypeVariant(ColumnType type,
   PERFETTO_FATAL("For GCC");
 }
 
+// Returns a zero of the type backing |type|. Useful for std::visit based
+// dispatch on the type of the data when there is no SqlValue at hand.
+inline NumericValue GetNumericTypeVariant(ColumnType type) {
+  SqlValue zero =
+      type == ColumnType::kDouble ? SqlValue::Double(0) : SqlValue::Long(0);
+  return *GetNumericTypeVariant(type, zero);
+}
+
 // Fetch std binary comparator class based on FilterOp. Can be used in
 // std::visit for comparison.
 template <typename T>
@@ -99,6 +117,89 @@ inline FilterOpVariant<T> GetFilterOpVariant(FilterOp op) {
   PERFETTO_FATAL("For GCC");
 }
 
+// Below this number of elements, comparison based sorting beats the fixed cost
+// of building histograms and allocating the scratch buffers for radix sort.
+constexpr uint32_t kMinRadixSortSize = 1024;
+
+// Maps numeric values to unsigned integers which have the same ordering, so
+// they can be sorted byte by byte.
+inline uint32_t ToRadixKey(uint32_t val) {
+  return val;
+}
+
+inline uint32_t ToRadixKey(int32_t val) {
+  return static_cast<uint32_t>(val) ^ (1u << 31);
+}
+
+inline uint64_t ToRadixKey(int64_t val) {
+  return static_cast<uint64_t>(val) ^ (1ull << 63);
+}
+
+inline uint64_t ToRadixKey(double val) {
+  // -0.0 and 0.0 compare equal so they should have the same key.
+  if (val == 0)
+    val = 0;
+  uint64_t bits;
+  memcpy(&bits, &val, sizeof(bits));
+  // Negative numbers have all the bits flipped (so bigger magnitudes go
+  // first), positive ones only the sign bit (so they go after negatives).
+  return (bits & (1ull << 63)) ? ~bits : bits | (1ull << 63);
+}
+
+template <typename Key>
+struct RadixSortEntry {
+  Key key;
+  SortToken token;
+};
+
+// Stable LSD radix sort of |tokens| by the value of |data| at their index,
+// going through the keys one byte at a time. Histograms for all the bytes are
+// built in a single pass and bytes which are the same for all the keys (e.g.
+// upper bytes of small numbers) are skipped.
+template <typename T>
+void RadixSort(const T* data, SortToken* tokens, uint32_t size, bool desc) {
+  using Key = decltype(ToRadixKey(T()));
+  using Entry = RadixSortEntry<Key>;
+  constexpr uint32_t kPasses = sizeof(Key);
+  constexpr uint32_t kBuckets = 256;
+
+  std::unique_ptr<Entry[]> src(new Entry[size]);
+  std::unique_ptr<Entry[]> dst(new Entry[size]);
+  std::array<std::array<uint32_t, kBuckets>, kPasses> counts{};
+  for (uint32_t i = 0; i < size; ++i) {
+    // Flipping all the bits reverses the order, while keeping the sort
+    // stable.
+    Key key = ToRadixKey(data[tokens[i].index]);
+    key = desc ? static_cast<Key>(~key) : key;
+    src[i] = Entry{key, tokens[i]};
+    for (uint32_t pass = 0; pass < kPasses; ++pass) {
+      counts[pass][(key >> (pass * 8)) & 0xff]++;
+    }
+  }
+
+  for (uint32_t pass = 0; pass < kPasses; ++pass) {
+    const uint32_t shift = pass * 8;
+    auto& count = counts[pass];
+    if (count[(src[0].key >> shift) & 0xff] == size)
+      continue;
+
+    std::array<uint32_t, kBuckets> offsets;
+    uint32_t offset = 0;
+    for (uint32_t bucket = 0; bucket < kBuckets; ++bucket) {
+      offsets[bucket] = offset;
+      offset += count[bucket];
+    }
+    for (uint32_t i = 0; i < size; ++i) {
+      dst[offsets[(src[i].key >> shift) & 0xff]++] = src[i];
+    }
+    std::swap(src, dst);
+  }
+
+  for (uint32_t i = 0; i < size; ++i) {
+    tokens[i] = src[i].token;
+  }
+}
+
 uint32_t LowerBoundIntrinsic(const void* data,
                              NumericValue val,
                              RowMap::Range search_range) {
@@ -163,6 +264,145 @@ uint32_t UpperBoundExtrinsic(const void* data,
       val);
 }
 
+#if PERFETTO_BUILDFLAG(PERFETTO_X64_CPU_OPT)
+
+// AVX2 comparisons of the elements of a 256 bit register with a value. The
+// results are returned as the low bits of an integer, one bit per element.
+// Note: loads are unaligned as the searched range can start anywhere.
+struct Avx2Int64 {
+  using Vec = __m256i;
+  static constexpr uint32_t kLanes = 4;
+  static Vec Set(int64_t val) { return _mm256_set1_epi64x(val); }
+  static Vec Load(const int64_t* ptr) {
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptr));
+  }
+  static uint32_t Mask(Vec cmp) {
+    return static_cast<uint32_t>(_mm256_movemask_pd(_mm256_castsi256_pd(cmp)));
+  }
+  static uint32_t Eq(Vec a, Vec b) { return Mask(_mm256_cmpeq_epi64(a, b)); }
+  static uint32_t Gt(Vec a, Vec b) { return Mask(_mm256_cmpgt_epi64(a, b)); }
+};
+
+struct Avx2Int32 {
+  using Vec = __m256i;
+  static constexpr uint32_t kLanes = 8;
+  static Vec Set(int32_t val) { return _mm256_set1_epi32(val); }
+  static Vec Load(const int32_t* ptr) {
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptr));
+  }
+  static uint32_t Mask(Vec cmp) {
+    return static_cast<uint32_t>(_mm256_movemask_ps(_mm256_castsi256_ps(cmp)));
+  }
+  static uint32_t Eq(Vec a, Vec b) { return Mask(_mm256_cmpeq_epi32(a, b)); }
+  static uint32_t Gt(Vec a, Vec b) { return Mask(_mm256_cmpgt_epi32(a, b)); }
+};
+
+// AVX2 has no unsigned comparisons: flipping the sign bit maps unsigned values
+// to signed ones with the same ordering.
+struct Avx2Uint32 : Avx2Int32 {
+  static Vec Set(uint32_t val) {
+    return _mm256_set1_epi32(static_cast<int32_t>(val ^ 0x80000000u));
+  }
+  static Vec Load(const uint32_t* ptr) {
+    return _mm256_xor_si256(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptr)),
+        _mm256_set1_epi32(static_cast<int32_t>(0x80000000u)));
+  }
+};
+
+// Derives all the comparisons of integers from == and >.
+template <typename Base>
+struct Avx2IntegerCompare : Base {
+  using Vec = typename Base::Vec;
+  static constexpr uint32_t kAllLanes = (1u << Base::kLanes) - 1;
+  static uint32_t Ne(Vec a, Vec b) { return ~Base::Eq(a, b) & kAllLanes; }
+  static uint32_t Lt(Vec a, Vec b) { return Base::Gt(b, a); }
+  static uint32_t Le(Vec a, Vec b) { return ~Base::Gt(a, b) & kAllLanes; }
+  static uint32_t Ge(Vec a, Vec b) { return ~Base::Gt(b, a) & kAllLanes; }
+};
+
+template <typename T>
+struct Avx2Compare;
+
+template <>
+struct Avx2Compare<int64_t> : Avx2IntegerCompare<Avx2Int64> {};
+
+template <>
+struct Avx2Compare<int32_t> : Avx2IntegerCompare<Avx2Int32> {};
+
+template <>
+struct Avx2Compare<uint32_t> : Avx2IntegerCompare<Avx2Uint32> {};
+
+// Doubles can't derive comparisons by negating others because of NaNs: all the
+// comparisons are ordered (i.e. false with NaNs) except != which, like
+// std::not_equal_to, is true with NaNs.
+template <>
+struct Avx2Compare<double> {
+  using Vec = __m256d;
+  static constexpr uint32_t kLanes = 4;
+  static Vec Set(double val) { return _mm256_set1_pd(val); }
+  static Vec Load(const double* ptr) { return _mm256_loadu_pd(ptr); }
+  template <int kPredicate>
+  static uint32_t Cmp(Vec a, Vec b) {
+    return static_cast<uint32_t>(
+        _mm256_movemask_pd(_mm256_cmp_pd(a, b, kPredicate)));
+  }
+  static uint32_t Eq(Vec a, Vec b) { return Cmp<_CMP_EQ_OQ>(a, b); }
+  static uint32_t Ne(Vec a, Vec b) { return Cmp<_CMP_NEQ_UQ>(a, b); }
+  static uint32_t Lt(Vec a, Vec b) { return Cmp<_CMP_LT_OQ>(a, b); }
+  static uint32_t Le(Vec a, Vec b) { return Cmp<_CMP_LE_OQ>(a, b); }
+  static uint32_t Gt(Vec a, Vec b) { return Cmp<_CMP_GT_OQ>(a, b); }
+  static uint32_t Ge(Vec a, Vec b) { return Cmp<_CMP_GE_OQ>(a, b); }
+};
+
+// Compares BitVector::kBitsInWord elements starting at |data| with |val| and
+// returns the results as a BitVector word.
+template <FilterOp op, typename T>
+uint64_t Avx2CompareWord(const T* data, typename Avx2Compare<T>::Vec val) {
+  using Compare = Avx2Compare<T>;
+  uint64_t word = 0;
+  for (uint32_t k = 0; k < BitVector::kBitsInWord; k += Compare::kLanes) {
+    auto vec = Compare::Load(data + k);
+    uint32_t mask;
+    if constexpr (op == FilterOp::kEq) {
+      mask = Compare::Eq(vec, val);
+    } else if constexpr (op == FilterOp::kNe) {
+      mask = Compare::Ne(vec, val);
+    } else if constexpr (op == FilterOp::kLt) {
+      mask = Compare::Lt(vec, val);
+    } else if constexpr (op == FilterOp::kLe) {
+      mask = Compare::Le(vec, val);
+    } else if constexpr (op == FilterOp::kGt) {
+      mask = Compare::Gt(vec, val);
+    } else {
+      static_assert(op == FilterOp::kGe, "Not a valid numeric operation");
+      mask = Compare::Ge(vec, val);
+    }
+    word |= static_cast<uint64_t>(mask) << k;
+  }
+  return word;
+}
+
+#endif  // PERFETTO_BUILDFLAG(PERFETTO_X64_CPU_OPT)
+
+// Runs |comparator| on all the elements, using the AVX2 kernels above to
+// compare whole words of elements at a time when available.
+template <FilterOp op, typename T, typename Comparator>
+void TypedLinearSearchWithOp(T typed_val,
+                             const T* start,
+                             Comparator comparator,
+                             BitVector::Builder& builder) {
+#if PERFETTO_BUILDFLAG(PERFETTO_X64_CPU_OPT)
+  auto vec_val = Avx2Compare<T>::Set(typed_val);
+  utils::LinearSearchWithWordComparator(
+      typed_val, start, comparator,
+      [vec_val](const T* data) { return Avx2CompareWord<op>(data, vec_val); },
+      builder);
+#else
+  utils::LinearSearchWithComparator(typed_val, start, comparator, builder);
+#endif
+}
+
 template <typename T>
 void TypedLinearSearch(T typed_val,
                        const T* start,
@@ -170,22 +410,22 @@ void TypedLinearSearch(T typed_val,
                        BitVector::Builder& builder) {
   switch (op) {
     case FilterOp::kEq:
-      return utils::LinearSearchWithComparator(typed_val, start,
-                                               std::equal_to<T>(), builder);
+      return TypedLinearSearchWithOp<FilterOp::kEq>(
+          typed_val, start, std::equal_to<T>(), builder);
     case FilterOp::kNe:
-      return utils::LinearSearchWithComparator(typed_val, start,
-                                               std::not_equal_to<T>(), builder);
+      return TypedLinearSearchWithOp<FilterOp::kNe>(
+          typed_val, start, std::not_equal_to<T>(), builder);
     case FilterOp::kLe:
-      return utils::LinearSearchWithComparator(typed_val, start,
-                                               std::less_equal<T>(), builder);
+      return TypedLinearSearchWithOp<FilterOp::kLe>(
+          typed_val, start, std::less_equal<T>(), builder);
     case FilterOp::kLt:
-      return utils::LinearSearchWithComparator(typed_val, start, std::less<T>(),
-                                               builder);
+      return TypedLinearSearchWithOp<FilterOp::kLt>(typed_val, start,
+                                                    std::less<T>(), builder);
     case FilterOp::kGt:
-      return utils::LinearSearchWithComparator(typed_val, start,
-                                               std::greater<T>(), builder);
+      return TypedLinearSearchWithOp<FilterOp::kGt>(
+          typed_val, start, std::greater<T>(), builder);
     case FilterOp::kGe:
-      return utils::LinearSearchWithComparator(
+      return TypedLinearSearchWithOp<FilterOp::kGe>(
           typed_val, start, std::greater_equal<T>(), builder);
     case FilterOp::kGlob:
     case FilterOp::kRegex:
@@ -334,7 +574,7 @@ RowMap::Range NumericStorage::BinarySearchExtrinsic(
   std::optional<NumericValue> val = GetNumericTypeVariant(type_, sql_val);
 
   if (op == FilterOp::kIsNotNull)
-    return RowMap::Range(0, size());
+    return RowMap::Range(0, indices_count);
 
   if (!val.has_value() || op == FilterOp::kIsNull || op == FilterOp::kGlob)
     return RowMap::Range();
@@ -352,10 +592,12 @@ RowMap::Range NumericStorage::BinarySearchExtrinsic(
           0, LowerBoundExtrinsic(data_, *val, indices, indices_count));
     case FilterOp::kGe:
       return RowMap::Range(
-          LowerBoundExtrinsic(data_, *val, indices, indices_count), size_);
+          LowerBoundExtrinsic(data_, *val, indices, indices_count),
+          indices_count);
     case FilterOp::kGt:
       return RowMap::Range(
-          UpperBoundExtrinsic(data_, *val, indices, indices_count), size_);
+          UpperBoundExtrinsic(data_, *val, indices, indices_count),
+          indices_count);
     case FilterOp::kNe:
     case FilterOp::kIsNull:
     case FilterOp::kIsNotNull:
@@ -366,23 +608,42 @@ RowMap::Range NumericStorage::BinarySearchExtrinsic(
   return RowMap::Range();
 }
 
-void NumericStorage::StableSort(uint32_t* rows, uint32_t rows_size) const {
-  NumericValue val = *GetNumericTypeVariant(type_, SqlValue::Long(0));
+void NumericStorage::StableSort(SortToken* tokens,
+                                uint32_t tokens_size,
+                                bool desc) const {
+  NumericValue val = GetNumericTypeVariant(type_);
   std::visit(
-      [this, &rows, rows_size](auto val_data) {
+      [this, tokens, tokens_size, desc](auto val_data) {
         using T = decltype(val_data);
         const T* typed_start = static_cast<const T*>(data_);
-        std::stable_sort(rows, rows + rows_size,
-                         [typed_start](uint32_t a_idx, uint32_t b_idx) {
-                           T first_val = typed_start[a_idx];
-                           T second_val = typed_start[b_idx];
-                           return first_val < second_val;
+        if (tokens_size >= kMinRadixSortSize) {
+          RadixSort(typed_start, tokens, tokens_size, desc);
+          return;
+        }
+        if (desc) {
+          std::stable_sort(tokens, tokens + tokens_size,
+                           [typed_start](SortToken a, SortToken b) {
+                             return typed_start[a.index] >
+                                    typed_start[b.index];
+                           });
+          return;
+        }
+        std::stable_sort(tokens, tokens + tokens_size,
+                         [typed_start](SortToken a, SortToken b) {
+                           return typed_start[a.index] < typed_start[b.index];
                          });
       },
       val);
 }
 
-void NumericStorage::Sort(uint32_t*, uint32_t) const {}
+void NumericStorage::Sort(SortToken* tokens,
+                          uint32_t tokens_size,
+                          bool desc) const {
+  // Radix sort is stable anyway and beats comparison based sorting on all but
+  // the smallest inputs so there is no reason to have a separate unstable
+  // implementation.
+  StableSort(tokens, tokens_size, desc);
+}
 
 }  // namespace storage
 }  // namespace trace_processor
@@ -15,6 +15,9 @@
  */
 #include "src/trace_processor/db/storage/numeric_storage.h"
 
+#include <functional>
+#include <limits>
+
 #include "src/trace_processor/db/storage/types.h"
 #include "test/gtest_and_gmock.h"
 
@@ -23,30 +26,129 @@ namespace trace_processor {
 namespace storage {
 namespace {
 
+using testing::ElementsAre;
 using Range = RowMap::Range;
 
+std::vector<SortToken> ToSortTokens(const std::vector<uint32_t>& indices) {
+  std::vector<SortToken> tokens;
+  for (uint32_t i = 0; i < indices.size(); ++i)
+    tokens.push_back(SortToken{indices[i], i});
+  return tokens;
+}
+
+std::vector<uint32_t> ToIndices(const std::vector<SortToken>& tokens) {
+  std::vector<uint32_t> indices;
+  for (const SortToken& token : tokens)
+    indices.push_back(token.index);
+  return indices;
+}
+
 TEST(NumericStorageUnittest, StableSortTrivial) {
   std::vector<uint32_t> data_vec{0, 1, 2, 0, 1, 2, 0, 1, 2};
-  std::vector<uint32_t> out = {0, 1, 2, 3, 4, 5, 6, 7, 8};
+  std::vector<SortToken> out = ToSortTokens({0, 1, 2, 3, 4, 5, 6, 7, 8});
 
   NumericStorage storage(data_vec.data(), 9, ColumnType::kUint32);
-  RowMap rm(0, 9);
-  storage.StableSort(out.data(), 9);
+  storage.StableSort(out.data(), 9, false);
 
   std::vector<uint32_t> stable_out{0, 3, 6, 1, 4, 7, 2, 5, 8};
-  ASSERT_EQ(out, stable_out);
+  ASSERT_EQ(ToIndices(out), stable_out);
 }
 
 TEST(NumericStorageUnittest, StableSort) {
   std::vector<uint32_t> data_vec{0, 1, 2, 0, 1, 2, 0, 1, 2};
-  std::vector<uint32_t> out = {1, 7, 4, 0, 6, 3, 2, 5, 8};
+  std::vector<SortToken> out = ToSortTokens({1, 7, 4, 0, 6, 3, 2, 5, 8});
 
   NumericStorage storage(data_vec.data(), 9, ColumnType::kUint32);
-  RowMap rm(0, 9);
-  storage.StableSort(out.data(), 9);
+  storage.StableSort(out.data(), 9, false);
 
   std::vector<uint32_t> stable_out{0, 6, 3, 1, 7, 4, 2, 5, 8};
-  ASSERT_EQ(out, stable_out);
+  ASSERT_EQ(ToIndices(out), stable_out);
+}
+
+TEST(NumericStorageUnittest, StableSortDesc) {
+  std::vector<uint32_t> data_vec{0, 1, 2, 0, 1, 2, 0, 1, 2};
+  std::vector<SortToken> out = ToSortTokens({1, 7, 4, 0, 6, 3, 2, 5, 8});
+
+  NumericStorage storage(data_vec.data(), 9, ColumnType::kUint32);
+  storage.StableSort(out.data(), 9, true);
+
+  std::vector<uint32_t> stable_out{2, 5, 8, 1, 7, 4, 0, 6, 3};
+  ASSERT_EQ(ToIndices(out), stable_out);
+}
+
+TEST(NumericStorageUnittest, StableSortPayload) {
+  std::vector<int64_t> data_vec{5, -3, 5};
+  // Index 0 is referenced twice, the payload tells those apart.
+  std::vector<SortToken> out{{0, 10}, {1, 11}, {2, 12}, {0, 13}};
+
+  NumericStorage storage(data_vec.data(), 3, ColumnType::kInt64);
+  storage.StableSort(out.data(), 4, false);
+
+  std::vector<uint32_t> payloads;
+  for (const SortToken& token : out)
+    payloads.push_back(token.payload);
+  ASSERT_THAT(payloads, ElementsAre(11, 10, 12, 13));
+}
+
+template <typename T>
+void CheckRadixSortMatchesStableSort(ColumnType type,
+                                     const std::vector<T>& data_vec,
+                                     bool desc) {
+  // Enough elements to go through the radix sort path.
+  uint32_t size = 4 * 1024;
+  std::vector<uint32_t> indices(size);
+  for (uint32_t i = 0; i < size; ++i)
+    indices[i] = (i * 7919) % static_cast<uint32_t>(data_vec.size());
+  std::vector<SortToken> out = ToSortTokens(indices);
+
+  NumericStorage storage(data_vec.data(),
+                         static_cast<uint32_t>(data_vec.size()), type);
+  storage.StableSort(out.data(), size, desc);
+
+  std::vector<SortToken> expected = ToSortTokens(indices);
+  std::stable_sort(expected.begin(), expected.end(),
+                   [&data_vec, desc](SortToken a, SortToken b) {
+                     return desc ? data_vec[a.index] > data_vec[b.index]
+                                 : data_vec[a.index] < data_vec[b.index];
+                   });
+  for (uint32_t i = 0; i < size; ++i) {
+    ASSERT_EQ(out[i].index, expected[i].index);
+    ASSERT_EQ(out[i].payload, expected[i].payload);
+  }
+}
+
+TEST(NumericStorageUnittest, RadixSortInt64) {
+  std::vector<int64_t> data_vec;
+  for (int64_t i = 0; i < 1000; ++i)
+    data_vec.push_back((i % 2 ? -1 : 1) * (i * i * 1000003) % 1234567891);
+  data_vec.push_back(std::numeric_limits<int64_t>::min());
+  data_vec.push_back(std::numeric_limits<int64_t>::max());
+  CheckRadixSortMatchesStableSort(ColumnType::kInt64, data_vec, false);
+  CheckRadixSortMatchesStableSort(ColumnType::kInt64, data_vec, true);
+}
+
+TEST(NumericStorageUnittest, RadixSortInt32) {
+  std::vector<int32_t> data_vec;
+  for (int32_t i = 0; i < 1000; ++i)
+    data_vec.push_back((i % 3 ? -1 : 1) * ((i * 7877) % 100003));
+  CheckRadixSortMatchesStableSort(ColumnType::kInt32, data_vec, false);
+  CheckRadixSortMatchesStableSort(ColumnType::kInt32, data_vec, true);
+}
+
+TEST(NumericStorageUnittest, RadixSortUint32FewValues) {
+  std::vector<uint32_t> data_vec;
+  for (uint32_t i = 0; i < 1000; ++i)
+    data_vec.push_back(i % 8);
+  CheckRadixSortMatchesStableSort(ColumnType::kUint32, data_vec, false);
+  CheckRadixSortMatchesStableSort(ColumnType::kUint32, data_vec, true);
+}
+
+TEST(NumericStorageUnittest, RadixSortDouble) {
+  std::vector<double> data_vec{-0.0, 0.0, -1.5, 1.5, -1e300, 1e300};
+  for (uint32_t i = 0; i < 1000; ++i)
+    data_vec.push_back((i % 2 ? -0.25 : 0.75) * i);
+  CheckRadixSortMatchesStableSort(ColumnType::kDouble, data_vec, false);
+  CheckRadixSortMatchesStableSort(ColumnType::kDouble, data_vec, true);
 }
 
 TEST(NumericStorageUnittest, CompareFast) {
@@ -61,6 +163,84 @@ TEST(NumericStorageUnittest, CompareFast) {
   ASSERT_EQ(bv.IndexOfNthSet(0), 100u);
 }
 
+// Checks the result of a linear search of every numeric operation against the
+// std comparators. The ranges don't start and end on word boundaries so that
+// both the slow and the (SIMD) fast paths are exercised.
+template <typename T>
+void CheckLinearSearchMatchesComparators(ColumnType type,
+                                         const std::vector<T>& data_vec,
+                                         SqlValue value) {
+  T typed_value = type == ColumnType::kDouble
+                      ? static_cast<T>(value.AsDouble())
+                      : static_cast<T>(value.AsLong());
+  NumericStorage storage(data_vec.data(),
+                         static_cast<uint32_t>(data_vec.size()), type);
+  std::vector<std::pair<FilterOp, std::function<bool(T, T)>>> ops{
+      {FilterOp::kEq, std::equal_to<T>()},
+      {FilterOp::kNe, std::not_equal_to<T>()},
+      {FilterOp::kLt, std::less<T>()},
+      {FilterOp::kLe, std::less_equal<T>()},
+      {FilterOp::kGt, std::greater<T>()},
+      {FilterOp::kGe, std::greater_equal<T>()},
+  };
+  for (const auto& [op, comparator] : ops) {
+    for (uint32_t start : {0u, 1u, 63u, 64u, 65u}) {
+      Range range(start, static_cast<uint32_t>(data_vec.size()) - start / 2);
+      BitVector bv = storage.Search(op, value, range).TakeIfBitVector();
+      for (uint32_t i = 0; i < range.end; ++i) {
+        bool expected = i >= start && comparator(data_vec[i], typed_value);
+        ASSERT_EQ(bv.IsSet(i), expected)
+            << "op " << static_cast<int>(op) << " start " << start << " i "
+            << i;
+      }
+    }
+  }
+}
+
+TEST(NumericStorageUnittest, LinearSearchInt64) {
+  std::vector<int64_t> data_vec;
+  for (int64_t i = 0; i < 1000; ++i)
+    data_vec.push_back((i * 7919) % 21 - 10);
+  data_vec[5] = std::numeric_limits<int64_t>::min();
+  data_vec[70] = std::numeric_limits<int64_t>::max();
+  CheckLinearSearchMatchesComparators(ColumnType::kInt64, data_vec,
+                                      SqlValue::Long(3));
+}
+
+TEST(NumericStorageUnittest, LinearSearchInt32) {
+  std::vector<int32_t> data_vec;
+  for (int32_t i = 0; i < 1000; ++i)
+    data_vec.push_back((i * 7919) % 21 - 10);
+  CheckLinearSearchMatchesComparators(ColumnType::kInt32, data_vec,
+                                      SqlValue::Long(-2));
+}
+
+TEST(NumericStorageUnittest, LinearSearchUint32) {
+  std::vector<uint32_t> data_vec;
+  for (uint32_t i = 0; i < 1000; ++i)
+    data_vec.push_back((i * 7919) % 21);
+  // Values with the MSB set would be negative if compared as signed.
+  data_vec[3] = std::numeric_limits<uint32_t>::max();
+  data_vec[90] = 1u << 31;
+  CheckLinearSearchMatchesComparators(ColumnType::kUint32, data_vec,
+                                      SqlValue::Long(7));
+  CheckLinearSearchMatchesComparators(ColumnType::kUint32, data_vec,
+                                      SqlValue::Long(1ll << 31));
+}
+
+TEST(NumericStorageUnittest, LinearSearchDouble) {
+  std::vector<double> data_vec;
+  for (uint32_t i = 0; i < 1000; ++i)
+    data_vec.push_back(static_cast<double>((i * 7919) % 21) * 0.5 - 5);
+  data_vec[7] = std::numeric_limits<double>::quiet_NaN();
+  data_vec[80] = std::numeric_limits<double>::quiet_NaN();
+  data_vec[81] = -0.0;
+  CheckLinearSearchMatchesComparators(ColumnType::kDouble, data_vec,
+                                      SqlValue::Double(0.5));
+  CheckLinearSearchMatchesComparators(ColumnType::kDouble, data_vec,
+                                      SqlValue::Double(0));
+}
+
 TEST(NumericStorageUnittest, CompareSorted) {
   std::vector<uint32_t> data_vec(128);
   std::iota(data_vec.begin(), data_vec.end(), 0);
@@ -101,6 +281,21 @@ TEST(NumericStorageUnittest, CompareSortedIndexesGreaterEqual) {
   ASSERT_EQ(range.end, 10u);
 }
 
+TEST(NumericStorageUnittest, CompareSortedIndexesSubsetGreater) {
+  std::vector<uint32_t> data_vec{30, 40, 50, 60, 90, 80, 70, 0, 10, 20};
+  std::vector<uint32_t> sorted_order{7, 0, 2, 5};
+
+  NumericStorage storage(data_vec.data(), 10, ColumnType::kUint32);
+
+  Range range = storage
+                    .IndexSearch(FilterOp::kGt, SqlValue::Long(30),
+                                 sorted_order.data(), 4, true)
+                    .TakeIfRange();
+
+  ASSERT_EQ(range.start, 2u);
+  ASSERT_EQ(range.end, 4u);
+}
+
 TEST(NumericStorageUnittest, CompareSortedIndexesLess) {
   std::vector<uint32_t> data_vec{30, 40, 50, 60, 90, 80, 70, 0, 10, 20};
   std::vector<uint32_t> sorted_order{7, 8, 9, 0, 1, 2, 3, 6, 5, 4};
@@ -25,6 +25,14 @@ namespace perfetto {
 namespace trace_processor {
 namespace storage {
 
+// Index into the storage which is being sorted together with an opaque
+// |payload| which is moved along with it. Callers use the payload to remember
+// which row (e.g. the index in the table) the storage index came from.
+struct SortToken {
+  uint32_t index;
+  uint32_t payload;
+};
+
 // Backing storage for columnar tables.
 class Storage {
  public:
@@ -39,20 +47,25 @@ class Storage {
   // Searches for elements which match |op| and |value| at the positions given
   // by |indices| array.
   // If the order defined by |indices| makes storage sorted, |sorted| flag
-  // should be set to true.
+  // should be set to true. The result is then the Range of positions in
+  // |indices| which match.
   virtual RangeOrBitVector IndexSearch(FilterOp op,
                                        SqlValue value,
                                        uint32_t* indices,
                                        uint32_t indices_count,
                                        bool sorted = false) const = 0;
 
-  // Sorts |rows| in ascending order with the comparator:
-  // data[rows[a]] < data[rows[b]].
-  virtual void Sort(uint32_t* rows, uint32_t rows_size) const = 0;
+  // Sorts |tokens| in ascending (or descending if |desc| is set) order with
+  // the comparator: data[tokens[a].index] < data[tokens[b].index].
+  virtual void Sort(SortToken* tokens,
+                    uint32_t tokens_size,
+                    bool desc) const = 0;
 
-  // Stable sorts |rows| in ascending order with the comparator:
-  // data[rows[a]] < data[rows[b]].
-  virtual void StableSort(uint32_t* rows, uint32_t rows_size) const = 0;
+  // Stable sorts |tokens| in ascending (or descending if |desc| is set) order
+  // with the comparator: data[tokens[a].index] < data[tokens[b].index].
+  virtual void StableSort(SortToken* tokens,
+                          uint32_t tokens_size,
+                          bool desc) const = 0;
 
   // Number of elements in stored data.
   virtual uint32_t size() const = 0;
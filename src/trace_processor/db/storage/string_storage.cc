@@ -15,6 +15,9 @@
  */
 
 #include "src/trace_processor/db/storage/string_storage.h"
+
+#include <algorithm>
+
 #include "perfetto/ext/base/scoped_file.h"
 #include "perfetto/ext/base/status_or.h"
 #include "perfetto/ext/base/string_utils.h"
@@ -198,9 +201,11 @@ RangeOrBitVector StringStorage::Search(FilterOp op,
         break;
       }
 
-      // For very big string pools (or small ranges) or pools with large strings
-      // run a standard glob function.
-      if (range.size() < string_pool_->size() ||
+      // For very big string pools (or small ranges), pools with large strings
+      // or pools which other query sessions may be interning into (and so
+      // cannot be iterated) run a standard glob function.
+      if (string_pool_->concurrent_interning() ||
+          range.size() < string_pool_->size() ||
           string_pool_->HasLargeString()) {
         utils::LinearSearchWithComparator(std::move(matcher), start,
                                           Glob{string_pool_}, builder);
@@ -218,9 +223,10 @@ RangeOrBitVector StringStorage::Search(FilterOp op,
           regex::Regex::Create(sql_val.AsString());
       PERFETTO_CHECK(regex.status().ok());
 
-      // For very big string pools (or small ranges) or pools with large
-      // strings run a standard regex function.
-      if (range.size() < string_pool_->size() ||
+      // For very big string pools (or small ranges), pools with large strings
+      // or pools in concurrent interning mode run a standard regex function.
+      if (string_pool_->concurrent_interning() ||
+          range.size() < string_pool_->size() ||
           string_pool_->HasLargeString()) {
         utils::LinearSearchWithComparator(std::move(regex.value()), start,
                                           Regex{string_pool_}, builder);
@@ -245,7 +251,11 @@ RangeOrBitVector StringStorage::IndexSearch(FilterOp op,
                                             SqlValue sql_val,
                                             uint32_t* indices,
                                             uint32_t indices_size,
-                                            bool) const {
+                                            bool sorted) const {
+  if (sorted) {
+    return RangeOrBitVector(
+        BinarySearchExtrinsic(op, sql_val, indices, indices_size));
+  }
   if (sql_val.is_null() &&
       (op != FilterOp::kIsNotNull && op != FilterOp::kIsNull)) {
     return RangeOrBitVector(Range());
@@ -321,28 +331,91 @@ RangeOrBitVector StringStorage::IndexSearch(FilterOp op,
   return RangeOrBitVector(std::move(builder).Build());
 }
 
-RowMap::Range StringStorage::BinarySearchExtrinsic(FilterOp,
-                                                   SqlValue,
-                                                   uint32_t*,
-                                                   uint32_t) const {
-  PERFETTO_FATAL("Not implemented");
+RowMap::Range StringStorage::BinarySearchExtrinsic(
+    FilterOp op,
+    SqlValue sql_val,
+    uint32_t* indices,
+    uint32_t indices_count) const {
+  auto pos = [indices](const uint32_t* it) {
+    return static_cast<uint32_t>(it - indices);
+  };
+
+  // Null strings are sorted before all the other ones (see |IsLess|).
+  uint32_t* end = indices + indices_count;
+  uint32_t* non_null =
+      std::partition_point(indices, end, [this](uint32_t index) {
+        return data_[index].is_null();
+      });
+  if (op == FilterOp::kIsNull)
+    return Range(0, pos(non_null));
+  if (op == FilterOp::kIsNotNull)
+    return Range(pos(non_null), indices_count);
+
+  if (sql_val.type != SqlValue::kString)
+    return Range();
+
+  NullTermStringView val(sql_val.AsString());
+  auto lower_bound = [this, non_null, end, &val]() {
+    return std::lower_bound(non_null, end, val,
+                            [this](uint32_t index, NullTermStringView v) {
+                              return string_pool_->Get(data_[index]) < v;
+                            });
+  };
+  auto upper_bound = [this, non_null, end, &val]() {
+    return std::upper_bound(non_null, end, val,
+                            [this](NullTermStringView v, uint32_t index) {
+                              return v < string_pool_->Get(data_[index]);
+                            });
+  };
+
+  switch (op) {
+    case FilterOp::kEq:
+      return Range(pos(lower_bound()), pos(upper_bound()));
+    case FilterOp::kLe:
+      return Range(pos(non_null), pos(upper_bound()));
+    case FilterOp::kLt:
+      return Range(pos(non_null), pos(lower_bound()));
+    case FilterOp::kGe:
+      return Range(pos(lower_bound()), indices_count);
+    case FilterOp::kGt:
+      return Range(pos(upper_bound()), indices_count);
+    case FilterOp::kNe:
+    case FilterOp::kIsNull:
+    case FilterOp::kIsNotNull:
+    case FilterOp::kGlob:
+    case FilterOp::kRegex:
+      return Range();
+  }
+  return Range();
 }
-void StringStorage::StableSort(uint32_t* indices, uint32_t indices_size) const {
-  std::stable_sort(indices, indices + indices_size,
-                   [this](uint32_t a_idx, uint32_t b_idx) {
-                     return string_pool_->Get(data_[a_idx]) <
-                            string_pool_->Get(data_[b_idx]);
+
+void StringStorage::StableSort(SortToken* tokens,
+                               uint32_t tokens_size,
+                               bool desc) const {
+  std::stable_sort(tokens, tokens + tokens_size,
+                   [this, desc](SortToken a, SortToken b) {
+                     return desc ? IsLess(data_[b.index], data_[a.index])
+                                 : IsLess(data_[a.index], data_[b.index]);
                    });
 }
 
-void StringStorage::Sort(uint32_t* indices, uint32_t indices_size) const {
-  std::sort(indices, indices + indices_size,
-            [this](uint32_t a_idx, uint32_t b_idx) {
-              return string_pool_->Get(data_[a_idx]) <
-                     string_pool_->Get(data_[b_idx]);
+void StringStorage::Sort(SortToken* tokens,
+                         uint32_t tokens_size,
+                         bool desc) const {
+  std::sort(tokens, tokens + tokens_size,
+            [this, desc](SortToken a, SortToken b) {
+              return desc ? IsLess(data_[b.index], data_[a.index])
+                          : IsLess(data_[a.index], data_[b.index]);
             });
 }
 
+bool StringStorage::IsLess(StringPool::Id a, StringPool::Id b) const {
+  // Null strings go before all the other ones.
+  if (a.is_null() || b.is_null())
+    return a.is_null() && !b.is_null();
+  return string_pool_->Get(a) < string_pool_->Get(b);
+}
+
 }  // namespace storage
 }  // namespace trace_processor
 }  // namespace perfetto
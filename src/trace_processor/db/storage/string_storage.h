@@ -45,9 +45,11 @@ class StringStorage final : public Storage {
                                uint32_t indices_count,
                                bool sorted = false) const override;
 
-  void StableSort(uint32_t* rows, uint32_t rows_size) const override;
+  void StableSort(SortToken* tokens,
+                  uint32_t tokens_size,
+                  bool desc) const override;
 
-  void Sort(uint32_t* rows, uint32_t rows_size) const override;
+  void Sort(SortToken* tokens, uint32_t tokens_size, bool desc) const override;
 
   uint32_t size() const override { return size_; }
 
@@ -59,6 +61,10 @@ class StringStorage final : public Storage {
                                       uint32_t*,
                                       uint32_t) const;
 
+  // Compares the strings behind the ids, with null strings being smaller than
+  // all the others.
+  bool IsLess(StringPool::Id, StringPool::Id) const;
+
   const StringPool::Id* data_ = nullptr;
   const uint32_t size_ = 0;
 
@@ -253,6 +253,53 @@ TEST(StringStorageUnittest, IndexSearchEq) {
   ASSERT_EQ(bv.IndexOfNthSet(0), 5u);
 }
 
+TEST(StringStorageUnittest, IndexSearchSorted) {
+  std::vector<std::string> strings{"cheese",  "pasta", "pizza",
+                                   "pierogi", "onion", "fries"};
+  std::vector<StringPool::Id> ids;
+  StringPool pool;
+  for (const auto& string : strings) {
+    ids.push_back(pool.InternString(base::StringView(string)));
+  }
+  ids.insert(ids.begin() + 3, StringPool::Id::Null());
+
+  // Sorted order: NULL, "cheese", "fries", "onion", "pasta", "pierogi",
+  // "pizza".
+  StringStorage storage(&pool, ids.data(), 7);
+  std::vector<uint32_t> indices{3, 0, 6, 5, 1, 4, 2};
+  auto search = [&](FilterOp op, SqlValue value) {
+    return storage.IndexSearch(op, value, indices.data(), 7, true)
+        .TakeIfRange();
+  };
+
+  Range range = search(FilterOp::kEq, SqlValue::String("pasta"));
+  ASSERT_EQ(range.start, 4u);
+  ASSERT_EQ(range.end, 5u);
+
+  range = search(FilterOp::kEq, SqlValue::String("pear"));
+  ASSERT_EQ(range.size(), 0u);
+
+  range = search(FilterOp::kLt, SqlValue::String("onion"));
+  ASSERT_EQ(range.start, 1u);
+  ASSERT_EQ(range.end, 3u);
+
+  range = search(FilterOp::kLe, SqlValue::String("onion"));
+  ASSERT_EQ(range.start, 1u);
+  ASSERT_EQ(range.end, 4u);
+
+  range = search(FilterOp::kGt, SqlValue::String("pasta"));
+  ASSERT_EQ(range.start, 5u);
+  ASSERT_EQ(range.end, 7u);
+
+  range = search(FilterOp::kGe, SqlValue::String("pasta"));
+  ASSERT_EQ(range.start, 4u);
+  ASSERT_EQ(range.end, 7u);
+
+  range = search(FilterOp::kIsNull, SqlValue());
+  ASSERT_EQ(range.start, 0u);
+  ASSERT_EQ(range.end, 1u);
+}
+
 }  // namespace
 }  // namespace storage
 }  // namespace trace_processor
@@ -23,11 +23,20 @@ namespace trace_processor {
 namespace storage {
 namespace utils {
 
-template <typename Comparator, typename ValType, typename DataType>
-void LinearSearchWithComparator(ValType val,
-                                const DataType* data_ptr,
-                                Comparator comparator,
-                                BitVector::Builder& builder) {
+// Same as LinearSearchWithComparator below but the complete words of the
+// result are computed by |word_comparator|: it is passed a pointer to
+// BitVector::kBitsInWord consecutive elements and returns a word with the bit k
+// set iff |comparator| returns true for the k-th element. This allows the
+// callers to provide hand-written SIMD implementations of the fast path.
+template <typename Comparator,
+          typename WordComparator,
+          typename ValType,
+          typename DataType>
+void LinearSearchWithWordComparator(ValType val,
+                                    const DataType* data_ptr,
+                                    Comparator comparator,
+                                    WordComparator word_comparator,
+                                    BitVector::Builder& builder) {
   // Slow path: we compare <64 elements and append to get us to a word
   // boundary.
   const DataType* cur_val = data_ptr;
@@ -37,16 +46,10 @@ void LinearSearchWithComparator(ValType val,
   }
 
   // Fast path: we compare as many groups of 64 elements as we can.
-  // This should be very easy for the compiler to auto-vectorize.
   uint32_t fast_path_elements = builder.BitsInCompleteWordsUntilFull();
   for (uint32_t i = 0; i < fast_path_elements; i += BitVector::kBitsInWord) {
-    uint64_t word = 0;
-    // This part should be optimised by SIMD and is expected to be fast.
-    for (uint32_t k = 0; k < BitVector::kBitsInWord; ++k, ++cur_val) {
-      bool comp_result = comparator(*cur_val, val);
-      word |= static_cast<uint64_t>(comp_result) << k;
-    }
-    builder.AppendWord(word);
+    builder.AppendWord(word_comparator(cur_val));
+    cur_val += BitVector::kBitsInWord;
   }
 
   // Slow path: we compare <64 elements and append to fill the Builder.
@@ -56,6 +59,25 @@ void LinearSearchWithComparator(ValType val,
   }
 }
 
+template <typename Comparator, typename ValType, typename DataType>
+void LinearSearchWithComparator(ValType val,
+                                const DataType* data_ptr,
+                                Comparator comparator,
+                                BitVector::Builder& builder) {
+  LinearSearchWithWordComparator(
+      val, data_ptr, comparator,
+      [&val, &comparator](const DataType* cur_val) {
+        uint64_t word = 0;
+        // This should be very easy for the compiler to auto-vectorize.
+        for (uint32_t k = 0; k < BitVector::kBitsInWord; ++k, ++cur_val) {
+          bool comp_result = comparator(*cur_val, val);
+          word |= static_cast<uint64_t>(comp_result) << k;
+        }
+        return word;
+      },
+      builder);
+}
+
 template <typename Comparator, typename ValType, typename DataType>
 void IndexSearchWithComparator(ValType val,
                                const DataType* data_ptr,
@@ -16,10 +16,15 @@
 
 #include "src/trace_processor/db/table.h"
 
+#include <memory>
+#include <mutex>
+#include <utility>
+
 namespace perfetto {
 namespace trace_processor {
 
 bool Table::kUseFilterV2 = true;
+bool Table::kUseSortV2 = false;
 
 Table::Table() = default;
 Table::~Table() = default;
@@ -35,6 +40,9 @@ Table& Table::operator=(Table&& other) noexcept {
   for (Column& col : columns_) {
     col.table_ = this;
   }
+  // Swapped rather than moved so that |other| is still usable afterwards.
+  std::swap(indexes_mutex_, other.indexes_mutex_);
+  indexes_ = std::move(other.indexes_);
   return *this;
 }
 
@@ -76,6 +84,8 @@ Table Table::Sort(const std::vector<Order>& od) const {
     // to reverse the order of this column.
     PERFETTO_DCHECK(od.front().desc);
     std::iota(idx.rbegin(), idx.rend(), 0);
+  } else if (kUseSortV2) {
+    idx = QueryExecutor::SortLegacy(this, od).TakeAsIndexVector();
   } else {
     // As our data is columnar, it's always more efficient to sort one column
     // at a time rather than try and sort lexiographically all at once.
@@ -137,5 +147,74 @@ Table Table::Sort(const std::vector<Order>& od) const {
   return table;
 }
 
+base::Status Table::CreateIndex(uint32_t col_idx) const {
+  if (col_idx >= columns_.size())
+    return base::ErrStatus("Column index %u out of bounds", col_idx);
+
+  std::lock_guard<std::mutex> lock(*indexes_mutex_);
+  base::StatusOr<ColumnIndex> index =
+      QueryExecutor::CreateIndexLegacy(this, col_idx);
+  RETURN_IF_ERROR(index.status());
+  if (indexes_.size() < columns_.size())
+    indexes_.resize(columns_.size());
+  indexes_[col_idx] = std::make_shared<const IndexEntry>(
+      IndexEntry{std::move(*index), row_count_,
+                 columns_[col_idx].storage_base().mutation_count()});
+  return base::OkStatus();
+}
+
+void Table::DropIndex(uint32_t col_idx) const {
+  std::lock_guard<std::mutex> lock(*indexes_mutex_);
+  if (col_idx < indexes_.size())
+    indexes_[col_idx] = nullptr;
+}
+
+bool Table::HasIndex(uint32_t col_idx) const {
+  std::lock_guard<std::mutex> lock(*indexes_mutex_);
+  return col_idx < indexes_.size() && indexes_[col_idx];
+}
+
+std::shared_ptr<const ColumnIndex> Table::GetIndex(uint32_t col_idx) const {
+  std::lock_guard<std::mutex> lock(*indexes_mutex_);
+  if (col_idx >= indexes_.size() || !indexes_[col_idx])
+    return nullptr;
+
+  std::shared_ptr<const IndexEntry>& entry = indexes_[col_idx];
+  uint32_t mutation_count = columns_[col_idx].storage_base().mutation_count();
+  if (entry->row_count != row_count_ ||
+      entry->mutation_count != mutation_count) {
+    // Whether a column can be indexed doesn't depend on its contents.
+    base::StatusOr<ColumnIndex> index =
+        QueryExecutor::CreateIndexLegacy(this, col_idx);
+    PERFETTO_CHECK(index.ok());
+    entry = std::make_shared<const IndexEntry>(
+        IndexEntry{std::move(*index), row_count_, mutation_count});
+  }
+  return std::shared_ptr<const ColumnIndex>(entry, &entry->index);
+}
+
+size_t Table::GetIndexesMemoryUsage() const {
+  std::lock_guard<std::mutex> lock(*indexes_mutex_);
+  size_t size = 0;
+  for (const auto& entry : indexes_) {
+    if (entry)
+      size += entry->index.memory_usage();
+  }
+  return size;
+}
+
+uint64_t Table::GetMutationCount() const {
+  uint64_t count = row_count_;
+  for (const Column& col : columns_) {
+    // Id and dummy columns don't have any storage.
+    if (col.col_type() == ColumnType::kId ||
+        col.col_type() == ColumnType::kDummy) {
+      continue;
+    }
+    count += col.storage_base().mutation_count();
+  }
+  return count;
+}
+
 }  // namespace trace_processor
 }  // namespace perfetto
@@ -21,6 +21,7 @@
 
 #include <limits>
 #include <memory>
+#include <mutex>
 #include <numeric>
 #include <optional>
 #include <string>
@@ -31,6 +32,7 @@
 #include "src/trace_processor/containers/row_map.h"
 #include "src/trace_processor/containers/string_pool.h"
 #include "src/trace_processor/db/column.h"
+#include "src/trace_processor/db/column_index.h"
 #include "src/trace_processor/db/column_storage_overlay.h"
 #include "src/trace_processor/db/query_executor.h"
 #include "src/trace_processor/db/typed_column.h"
@@ -93,11 +95,13 @@ class Table {
       bool is_sorted;
       bool is_hidden;
       bool is_set_id;
+      bool is_indexed;
     };
     std::vector<Column> columns;
   };
 
   static bool kUseFilterV2;
+  static bool kUseSortV2;
 
   Table();
   virtual ~Table();
@@ -196,6 +200,32 @@ class Table {
     return static_cast<uint32_t>(columns_.size());
   }
 
+  // Creates a secondary index on the column at index |col_idx|, allowing
+  // equality and range constraints on it to be filtered with a binary search.
+  // Indexes are used by QueryExecutor (i.e. if |kUseFilterV2| is set) and are
+  // rebuilt on the first filter after the table changes. All index methods are
+  // safe to call concurrently (e.g. from different query sessions).
+  base::Status CreateIndex(uint32_t col_idx) const;
+
+  // Removes the index on the column at index |col_idx|, if any.
+  void DropIndex(uint32_t col_idx) const;
+
+  // Returns whether the column at index |col_idx| has an index.
+  bool HasIndex(uint32_t col_idx) const;
+
+  // Returns the up to date index on the column at index |col_idx| or nullptr
+  // if the column doesn't have one. The returned index stays valid even if
+  // it is rebuilt or dropped by another thread while in use.
+  std::shared_ptr<const ColumnIndex> GetIndex(uint32_t col_idx) const;
+
+  // Returns the number of bytes used by the indexes of this table.
+  size_t GetIndexesMemoryUsage() const;
+
+  // Returns a number which changes every time rows are added to the table or
+  // values of its columns are changed. Allows state derived from the contents
+  // of the table (e.g. cached query results) to find out that it is stale.
+  uint64_t GetMutationCount() const;
+
   // Returns an iterator into the Table.
   Iterator IterateRows() const { return Iterator(this); }
 
@@ -207,9 +237,9 @@ class Table {
     Schema schema;
     schema.columns.reserve(columns_.size());
     for (const auto& col : columns_) {
-      schema.columns.emplace_back(
-          Schema::Column{col.name(), col.type(), col.IsId(), col.IsSorted(),
-                         col.IsHidden(), col.IsSetId()});
+      schema.columns.emplace_back(Schema::Column{
+          col.name(), col.type(), col.IsId(), col.IsSorted(), col.IsHidden(),
+          col.IsSetId(), HasIndex(col.index_in_table())});
     }
     return schema;
   }
@@ -242,7 +272,23 @@ class Table {
   friend class Column;
   friend class View;
 
+  struct IndexEntry {
+    ColumnIndex index;
+
+    // State of the table when |index| was created.
+    uint32_t row_count;
+    uint32_t mutation_count;
+  };
+
   Table CopyExceptOverlays() const;
+
+  // Indexes are derived from the contents of the table (much like a cache), so
+  // they can be created on const tables. Entries are never modified in place:
+  // a stale entry is replaced under |indexes_mutex_|, so readers holding the
+  // previous one are unaffected. The mutex is held by pointer to keep the
+  // table movable.
+  std::unique_ptr<std::mutex> indexes_mutex_{new std::mutex()};
+  mutable std::vector<std::shared_ptr<const IndexEntry>> indexes_;
 };
 
 }  // namespace trace_processor
@@ -162,7 +162,8 @@ base::Status View::Create(Table* root_table,
         source_table_name == root_table_name ? table_col.IsId() : false,
         source_table_name == root_table_name ? table_col.IsSorted() : false,
         table_col.IsHidden(),
-        source_table_name == root_table_name ? table_col.IsSetId() : false});
+        source_table_name == root_table_name ? table_col.IsSetId() : false,
+        false /* is_indexed */});
 
     uint32_t output_idx = static_cast<uint32_t>(schema.columns.size() - 1);
     source_col_by_output_idx[output_idx] = {node, table_col_idx};
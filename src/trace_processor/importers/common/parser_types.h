@@ -42,6 +42,37 @@ struct alignas(8) InlineSchedWaking {
 };
 static_assert(sizeof(InlineSchedWaking) == 16);
 
+// An ftrace event recorded in the generic compact encoding
+// (FtraceEventBundle.CompactSched.EventColumns). Only used for the event types
+// that FtraceParser can parse in this form, all of which have at most
+// |kMaxFields| fields, numbered from 1.
+struct alignas(8) InlineFtraceEvent {
+  static constexpr uint32_t kMaxFields = 5;
+
+  bool has_field(uint32_t field_id) const {
+    return present_fields & (1u << field_id);
+  }
+  bool is_string(uint32_t field_id) const {
+    return string_fields & (1u << field_id);
+  }
+  uint64_t value(uint32_t field_id) const { return values[field_id - 1]; }
+  StringPool::Id string_value(uint32_t field_id) const {
+    return StringPool::Id::Raw(static_cast<uint32_t>(values[field_id - 1]));
+  }
+
+  // Field number of the event in FtraceEvent.
+  uint16_t event_id;
+  // Bit |field_id| is set if the field is present, and if it's a string
+  // (including a kernel symbol resolved by the tokenizer).
+  uint8_t present_fields;
+  uint8_t string_fields;
+  uint32_t pid;
+  // Indexed by field number - 1. The value of the field as it's varint-encoded
+  // in the event proto, or the StringPool::Id of a string.
+  uint64_t values[kMaxFields];
+};
+static_assert(sizeof(InlineFtraceEvent) == 48);
+
 struct alignas(8) JsonEvent {
   std::string value;
 };
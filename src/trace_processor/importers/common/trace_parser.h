@@ -28,6 +28,7 @@ struct InlineSchedSwitch;
 class FuchsiaRecord;
 struct SystraceLine;
 struct InlineSchedWaking;
+struct InlineFtraceEvent;
 struct TracePacketData;
 struct TrackEventData;
 
@@ -44,6 +45,7 @@ class TraceParser {
   virtual void ParseFtraceEvent(uint32_t, int64_t, TracePacketData);
   virtual void ParseInlineSchedSwitch(uint32_t, int64_t, InlineSchedSwitch);
   virtual void ParseInlineSchedWaking(uint32_t, int64_t, InlineSchedWaking);
+  virtual void ParseInlineFtraceEvent(uint32_t, int64_t, InlineFtraceEvent);
 };
 
 }  // namespace trace_processor
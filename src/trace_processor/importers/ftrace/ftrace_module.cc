@@ -33,5 +33,9 @@ void FtraceModule::ParseInlineSchedWaking(uint32_t /*cpu*/,
                                           int64_t /*ts*/,
                                           const InlineSchedWaking&) {}
 
+void FtraceModule::ParseInlineFtraceEvent(uint32_t /*cpu*/,
+                                          int64_t /*ts*/,
+                                          const InlineFtraceEvent&) {}
+
 }  // namespace trace_processor
 }  // namespace perfetto
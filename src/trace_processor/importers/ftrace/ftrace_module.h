@@ -37,6 +37,10 @@ class FtraceModule : public ProtoImporterModule {
   virtual void ParseInlineSchedWaking(uint32_t cpu,
                                       int64_t ts,
                                       const InlineSchedWaking& data);
+
+  virtual void ParseInlineFtraceEvent(uint32_t cpu,
+                                      int64_t ts,
+                                      const InlineFtraceEvent& data);
 };
 
 }  // namespace trace_processor
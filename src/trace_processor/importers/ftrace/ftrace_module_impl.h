@@ -68,6 +68,15 @@ class FtraceModuleImpl : public FtraceModule {
     }
   }
 
+  void ParseInlineFtraceEvent(uint32_t cpu,
+                              int64_t ts,
+                              const InlineFtraceEvent& data) override {
+    util::Status res = parser_.ParseInlineFtraceEvent(cpu, ts, data);
+    if (!res.ok()) {
+      PERFETTO_ELOG("%s", res.message().c_str());
+    }
+  }
+
  private:
   FtraceTokenizer tokenizer_;
   FtraceParser parser_;
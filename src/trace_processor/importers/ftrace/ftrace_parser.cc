@@ -756,7 +756,7 @@ util::Status FtraceParser::ParseFtraceEvent(uint32_t cpu,
         break;
       }
       case FtraceEvent::kWorkqueueExecuteEndFieldNumber: {
-        ParseWorkqueueExecuteEnd(ts, pid, fld_bytes);
+        ParseWorkqueueExecuteEnd(ts, pid);
         break;
       }
       case FtraceEvent::kIrqHandlerEntryFieldNumber: {
@@ -1080,6 +1080,86 @@ util::Status FtraceParser::ParseInlineSchedWaking(
   return util::OkStatus();
 }
 
+util::Status FtraceParser::ParseInlineFtraceEvent(
+    uint32_t cpu,
+    int64_t ts,
+    const InlineFtraceEvent& data) {
+  MaybeOnFirstFtraceEvent();
+  if (PERFETTO_UNLIKELY(ts < drop_ftrace_data_before_ts_)) {
+    context_->storage->IncrementStats(
+        stats::ftrace_packet_before_tracing_start);
+    return util::OkStatus();
+  }
+  ParseInlineFtraceEventToRaw(ts, cpu, data);
+
+  // Mirrors the parsing of these events in ParseFtraceEvent(). The fields that
+  // the event doesn't have are 0, like in the proto decoders.
+  using protos::pbzero::FtraceEvent;
+  switch (data.event_id) {
+    case FtraceEvent::kCpuFrequencyFieldNumber: {
+      using Evt = protos::pbzero::CpuFrequencyFtraceEvent;
+      ParseCpuFreq(ts,
+                   static_cast<uint32_t>(data.value(Evt::kCpuIdFieldNumber)),
+                   static_cast<uint32_t>(data.value(Evt::kStateFieldNumber)));
+      break;
+    }
+    case FtraceEvent::kCpuIdleFieldNumber: {
+      using Evt = protos::pbzero::CpuIdleFtraceEvent;
+      ParseCpuIdle(ts,
+                   static_cast<uint32_t>(data.value(Evt::kCpuIdFieldNumber)),
+                   static_cast<uint32_t>(data.value(Evt::kStateFieldNumber)));
+      break;
+    }
+    case FtraceEvent::kWorkqueueExecuteStartFieldNumber: {
+      using Evt = protos::pbzero::WorkqueueExecuteStartFtraceEvent;
+      // The tokenizer resolves the function to a kernel symbol when it can.
+      StringId name_id;
+      if (data.is_string(Evt::kFunctionFieldNumber)) {
+        name_id = data.string_value(Evt::kFunctionFieldNumber);
+      } else {
+        base::StackString<255> slice_name(
+            "%#" PRIx64, data.value(Evt::kFunctionFieldNumber));
+        name_id = context_->storage->InternString(slice_name.string_view());
+      }
+      ParseWorkqueueExecuteStart(cpu, ts, data.pid, name_id);
+      break;
+    }
+    case FtraceEvent::kWorkqueueExecuteEndFieldNumber: {
+      ParseWorkqueueExecuteEnd(ts, data.pid);
+      break;
+    }
+    case FtraceEvent::kIrqHandlerEntryFieldNumber: {
+      using Evt = protos::pbzero::IrqHandlerEntryFtraceEvent;
+      base::StringView irq_name;
+      if (data.is_string(Evt::kNameFieldNumber)) {
+        irq_name = context_->storage->GetString(
+            data.string_value(Evt::kNameFieldNumber));
+      }
+      ParseIrqHandlerEntry(cpu, ts, irq_name);
+      break;
+    }
+    case FtraceEvent::kIrqHandlerExitFieldNumber: {
+      using Evt = protos::pbzero::IrqHandlerExitFtraceEvent;
+      ParseIrqHandlerExit(
+          cpu, ts, static_cast<int32_t>(data.value(Evt::kRetFieldNumber)));
+      break;
+    }
+    case FtraceEvent::kSoftirqEntryFieldNumber: {
+      using Evt = protos::pbzero::SoftirqEntryFtraceEvent;
+      ParseSoftIrqEntry(
+          cpu, ts, static_cast<uint32_t>(data.value(Evt::kVecFieldNumber)));
+      break;
+    }
+    case FtraceEvent::kSoftirqExitFieldNumber: {
+      using Evt = protos::pbzero::SoftirqExitFtraceEvent;
+      ParseSoftIrqExit(
+          cpu, ts, static_cast<uint32_t>(data.value(Evt::kVecFieldNumber)));
+      break;
+    }
+  }
+  return util::OkStatus();
+}
+
 void FtraceParser::MaybeOnFirstFtraceEvent() {
   if (PERFETTO_LIKELY(has_seen_first_ftrace_packet_)) {
     return;
@@ -1249,6 +1329,71 @@ void FtraceParser::ParseTypedFtraceToRaw(
   }
 }
 
+void FtraceParser::ParseInlineFtraceEventToRaw(int64_t timestamp,
+                                               uint32_t cpu,
+                                               const InlineFtraceEvent& data) {
+  if (PERFETTO_UNLIKELY(!context_->config.ingest_ftrace_in_raw_table))
+    return;
+
+  // The tokenizer only pushes the events of the types that FtraceParser knows.
+  uint32_t ftrace_id = data.event_id;
+  FtraceMessageDescriptor* m = GetMessageDescriptorForId(ftrace_id);
+  const auto& message_strings = ftrace_message_strings_[ftrace_id];
+  UniqueTid utid = context_->process_tracker->GetOrCreateThread(data.pid);
+  RawId id =
+      context_->storage->mutable_ftrace_event_table()
+          ->Insert({timestamp, message_strings.message_name_id, cpu, utid})
+          .id;
+  auto inserter = context_->args_tracker->AddArgsTo(id);
+
+  for (uint32_t field_id = 1; field_id <= InlineFtraceEvent::kMaxFields;
+       field_id++) {
+    if (!data.has_field(field_id))
+      continue;
+    StringId name_id = message_strings.field_name_ids[field_id];
+    if (data.is_string(field_id)) {
+      inserter.AddArg(name_id, Variadic::String(data.string_value(field_id)));
+      continue;
+    }
+
+    // As in ParseTypedFtraceToRaw(), but the value is always a varint.
+    ProtoSchemaType type = m->fields[field_id].type;
+    switch (type) {
+      case ProtoSchemaType::kInt32:
+      case ProtoSchemaType::kInt64:
+      case ProtoSchemaType::kSfixed32:
+      case ProtoSchemaType::kSfixed64:
+      case ProtoSchemaType::kSint32:
+      case ProtoSchemaType::kSint64:
+      case ProtoSchemaType::kBool:
+      case ProtoSchemaType::kEnum: {
+        inserter.AddArg(
+            name_id,
+            Variadic::Integer(static_cast<int64_t>(data.value(field_id))));
+        break;
+      }
+      case ProtoSchemaType::kUint32:
+      case ProtoSchemaType::kUint64:
+      case ProtoSchemaType::kFixed32:
+      case ProtoSchemaType::kFixed64: {
+        inserter.AddArg(name_id,
+                        Variadic::UnsignedInteger(data.value(field_id)));
+        break;
+      }
+      case ProtoSchemaType::kString:
+      case ProtoSchemaType::kBytes:
+      case ProtoSchemaType::kDouble:
+      case ProtoSchemaType::kFloat:
+      case ProtoSchemaType::kUnknown:
+      case ProtoSchemaType::kGroup:
+      case ProtoSchemaType::kMessage:
+        PERFETTO_DLOG("Could not store %s as a field in args table.",
+                      ProtoSchemaToString(type));
+        break;
+    }
+  }
+}
+
 PERFETTO_ALWAYS_INLINE
 void FtraceParser::ParseSchedSwitch(uint32_t cpu,
                                     int64_t timestamp,
@@ -1282,8 +1427,12 @@ void FtraceParser::ParseSchedProcessFree(int64_t timestamp, ConstBytes blob) {
 
 void FtraceParser::ParseCpuFreq(int64_t timestamp, ConstBytes blob) {
   protos::pbzero::CpuFrequencyFtraceEvent::Decoder freq(blob.data, blob.size);
-  uint32_t cpu = freq.cpu_id();
-  uint32_t new_freq = freq.state();
+  ParseCpuFreq(timestamp, freq.cpu_id(), freq.state());
+}
+
+void FtraceParser::ParseCpuFreq(int64_t timestamp,
+                                uint32_t cpu,
+                                uint32_t new_freq) {
   TrackId track =
       context_->track_tracker->InternCpuCounterTrack(cpu_freq_name_id_, cpu);
   context_->event_tracker->PushCounter(timestamp, new_freq, track);
@@ -1300,8 +1449,12 @@ void FtraceParser::ParseGpuFreq(int64_t timestamp, ConstBytes blob) {
 
 void FtraceParser::ParseCpuIdle(int64_t timestamp, ConstBytes blob) {
   protos::pbzero::CpuIdleFtraceEvent::Decoder idle(blob.data, blob.size);
-  uint32_t cpu = idle.cpu_id();
-  uint32_t new_state = idle.state();
+  ParseCpuIdle(timestamp, idle.cpu_id(), idle.state());
+}
+
+void FtraceParser::ParseCpuIdle(int64_t timestamp,
+                                uint32_t cpu,
+                                uint32_t new_state) {
   TrackId track =
       context_->track_tracker->InternCpuCounterTrack(cpu_idle_name_id_, cpu);
   context_->event_tracker->PushCounter(timestamp, new_state, track);
@@ -2034,7 +2187,13 @@ void FtraceParser::ParseWorkqueueExecuteStart(
   protos::pbzero::WorkqueueExecuteStartFtraceEvent::Decoder evt(blob.data,
                                                                 blob.size);
   StringId name_id = InternedKernelSymbolOrFallback(evt.function(), seq_state);
+  ParseWorkqueueExecuteStart(cpu, timestamp, pid, name_id);
+}
 
+void FtraceParser::ParseWorkqueueExecuteStart(uint32_t cpu,
+                                              int64_t timestamp,
+                                              uint32_t pid,
+                                              StringId name_id) {
   UniqueTid utid = context_->process_tracker->GetOrCreateThread(pid);
   TrackId track = context_->track_tracker->InternThreadTrack(utid);
 
@@ -2045,11 +2204,7 @@ void FtraceParser::ParseWorkqueueExecuteStart(
                                  args_inserter);
 }
 
-void FtraceParser::ParseWorkqueueExecuteEnd(int64_t timestamp,
-                                            uint32_t pid,
-                                            ConstBytes blob) {
-  protos::pbzero::WorkqueueExecuteEndFtraceEvent::Decoder evt(blob.data,
-                                                              blob.size);
+void FtraceParser::ParseWorkqueueExecuteEnd(int64_t timestamp, uint32_t pid) {
   UniqueTid utid = context_->process_tracker->GetOrCreateThread(pid);
   TrackId track = context_->track_tracker->InternThreadTrack(utid);
   context_->slice_tracker->End(timestamp, track, workqueue_id_);
@@ -2059,11 +2214,16 @@ void FtraceParser::ParseIrqHandlerEntry(uint32_t cpu,
                                         int64_t timestamp,
                                         protozero::ConstBytes blob) {
   protos::pbzero::IrqHandlerEntryFtraceEvent::Decoder evt(blob.data, blob.size);
+  ParseIrqHandlerEntry(cpu, timestamp, evt.name());
+}
+
+void FtraceParser::ParseIrqHandlerEntry(uint32_t cpu,
+                                        int64_t timestamp,
+                                        base::StringView irq_name) {
   base::StackString<255> track_name("Irq Cpu %d", cpu);
   StringId track_name_id =
       context_->storage->InternString(track_name.string_view());
 
-  base::StringView irq_name = evt.name();
   base::StackString<255> slice_name("IRQ (%.*s)", int(irq_name.size()),
                                     irq_name.data());
   StringId slice_name_id =
@@ -2076,12 +2236,18 @@ void FtraceParser::ParseIrqHandlerExit(uint32_t cpu,
                                        int64_t timestamp,
                                        protozero::ConstBytes blob) {
   protos::pbzero::IrqHandlerExitFtraceEvent::Decoder evt(blob.data, blob.size);
+  ParseIrqHandlerExit(cpu, timestamp, evt.ret());
+}
+
+void FtraceParser::ParseIrqHandlerExit(uint32_t cpu,
+                                       int64_t timestamp,
+                                       int32_t ret) {
   base::StackString<255> track_name("Irq Cpu %d", cpu);
   StringId track_name_id =
       context_->storage->InternString(track_name.string_view());
   TrackId track = context_->track_tracker->InternCpuTrack(track_name_id, cpu);
 
-  base::StackString<255> status("%s", evt.ret() == 1 ? "handled" : "unhandled");
+  base::StackString<255> status("%s", ret == 1 ? "handled" : "unhandled");
   StringId status_id = context_->storage->InternString(status.string_view());
   auto args_inserter = [this,
                         &status_id](ArgsTracker::BoundInserter* inserter) {
@@ -2094,15 +2260,21 @@ void FtraceParser::ParseSoftIrqEntry(uint32_t cpu,
                                      int64_t timestamp,
                                      protozero::ConstBytes blob) {
   protos::pbzero::SoftirqEntryFtraceEvent::Decoder evt(blob.data, blob.size);
+  ParseSoftIrqEntry(cpu, timestamp, evt.vec());
+}
+
+void FtraceParser::ParseSoftIrqEntry(uint32_t cpu,
+                                     int64_t timestamp,
+                                     uint32_t vec) {
   base::StackString<255> track_name("SoftIrq Cpu %d", cpu);
   StringId track_name_id =
       context_->storage->InternString(track_name.string_view());
   auto num_actions = sizeof(kActionNames) / sizeof(*kActionNames);
-  if (evt.vec() >= num_actions) {
-    PERFETTO_DFATAL("No action name at index %d for softirq event.", evt.vec());
+  if (vec >= num_actions) {
+    PERFETTO_DFATAL("No action name at index %d for softirq event.", vec);
     return;
   }
-  base::StringView slice_name = kActionNames[evt.vec()];
+  base::StringView slice_name = kActionNames[vec];
   StringId slice_name_id = context_->storage->InternString(slice_name);
   TrackId track = context_->track_tracker->InternCpuTrack(track_name_id, cpu);
   context_->slice_tracker->Begin(timestamp, track, irq_id_, slice_name_id);
@@ -2112,11 +2284,16 @@ void FtraceParser::ParseSoftIrqExit(uint32_t cpu,
                                     int64_t timestamp,
                                     protozero::ConstBytes blob) {
   protos::pbzero::SoftirqExitFtraceEvent::Decoder evt(blob.data, blob.size);
+  ParseSoftIrqExit(cpu, timestamp, evt.vec());
+}
+
+void FtraceParser::ParseSoftIrqExit(uint32_t cpu,
+                                    int64_t timestamp,
+                                    uint32_t vec) {
   base::StackString<255> track_name("SoftIrq Cpu %d", cpu);
   StringId track_name_id =
       context_->storage->InternString(track_name.string_view());
   TrackId track = context_->track_tracker->InternCpuTrack(track_name_id, cpu);
-  auto vec = evt.vec();
   auto args_inserter = [this, vec](ArgsTracker::BoundInserter* inserter) {
     inserter->AddArg(vec_arg_id_, Variadic::Integer(vec));
   };
@@ -52,6 +52,9 @@ class FtraceParser {
   util::Status ParseInlineSchedWaking(uint32_t cpu,
                                       int64_t ts,
                                       const InlineSchedWaking& data);
+  util::Status ParseInlineFtraceEvent(uint32_t cpu,
+                                      int64_t ts,
+                                      const InlineFtraceEvent& data);
 
  private:
   void ParseGenericFtrace(int64_t timestamp,
@@ -64,12 +67,17 @@ class FtraceParser {
                              uint32_t pid,
                              protozero::ConstBytes,
                              PacketSequenceStateGeneration*);
+  void ParseInlineFtraceEventToRaw(int64_t timestamp,
+                                   uint32_t cpu,
+                                   const InlineFtraceEvent&);
   void ParseSchedSwitch(uint32_t cpu, int64_t timestamp, protozero::ConstBytes);
   void ParseSchedWaking(int64_t timestamp, uint32_t pid, protozero::ConstBytes);
   void ParseSchedProcessFree(int64_t timestamp, protozero::ConstBytes);
   void ParseCpuFreq(int64_t timestamp, protozero::ConstBytes);
+  void ParseCpuFreq(int64_t timestamp, uint32_t cpu, uint32_t new_freq);
   void ParseGpuFreq(int64_t timestamp, protozero::ConstBytes);
   void ParseCpuIdle(int64_t timestamp, protozero::ConstBytes);
+  void ParseCpuIdle(int64_t timestamp, uint32_t cpu, uint32_t new_state);
   void ParsePrint(int64_t timestamp, uint32_t pid, protozero::ConstBytes);
   void ParseZero(int64_t timestamp, uint32_t pid, protozero::ConstBytes);
   void ParseMdssTracingMarkWrite(int64_t timestamp,
@@ -173,19 +181,27 @@ class FtraceParser {
                                   uint32_t pid,
                                   protozero::ConstBytes,
                                   PacketSequenceStateGeneration* seq_state);
-  void ParseWorkqueueExecuteEnd(int64_t timestamp,
-                                uint32_t pid,
-                                protozero::ConstBytes);
+  void ParseWorkqueueExecuteStart(uint32_t cpu,
+                                  int64_t timestamp,
+                                  uint32_t pid,
+                                  StringId name_id);
+  void ParseWorkqueueExecuteEnd(int64_t timestamp, uint32_t pid);
   void ParseIrqHandlerEntry(uint32_t cpu,
                             int64_t timestamp,
                             protozero::ConstBytes);
+  void ParseIrqHandlerEntry(uint32_t cpu,
+                            int64_t timestamp,
+                            base::StringView irq_name);
   void ParseIrqHandlerExit(uint32_t cpu,
                            int64_t timestamp,
                            protozero::ConstBytes);
+  void ParseIrqHandlerExit(uint32_t cpu, int64_t timestamp, int32_t ret);
   void ParseSoftIrqEntry(uint32_t cpu,
                          int64_t timestamp,
                          protozero::ConstBytes);
+  void ParseSoftIrqEntry(uint32_t cpu, int64_t timestamp, uint32_t vec);
   void ParseSoftIrqExit(uint32_t cpu, int64_t timestamp, protozero::ConstBytes);
+  void ParseSoftIrqExit(uint32_t cpu, int64_t timestamp, uint32_t vec);
   void ParseGpuMemTotal(int64_t timestamp, protozero::ConstBytes);
   void ParseThermalTemperature(int64_t timestamp, protozero::ConstBytes);
   void ParseCdevUpdate(int64_t timestamp, protozero::ConstBytes);
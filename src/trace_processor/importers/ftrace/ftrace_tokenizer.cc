@@ -16,6 +16,10 @@
 
 #include "src/trace_processor/importers/ftrace/ftrace_tokenizer.h"
 
+#include <optional>
+#include <utility>
+#include <vector>
+
 #include "perfetto/base/logging.h"
 #include "perfetto/protozero/proto_decoder.h"
 #include "perfetto/protozero/proto_utils.h"
@@ -27,6 +31,9 @@
 #include "protos/perfetto/common/builtin_clock.pbzero.h"
 #include "protos/perfetto/trace/ftrace/ftrace_event.pbzero.h"
 #include "protos/perfetto/trace/ftrace/ftrace_event_bundle.pbzero.h"
+#include "protos/perfetto/trace/ftrace/workqueue.pbzero.h"
+#include "protos/perfetto/trace/interned_data/interned_data.pbzero.h"
+#include "protos/perfetto/trace/profiling/profile_common.pbzero.h"
 
 namespace perfetto {
 namespace trace_processor {
@@ -53,6 +60,45 @@ PERFETTO_ALWAYS_INLINE base::StatusOr<int64_t> ResolveTraceTime(
   return context->clock_tracker->ToTraceTime(clock_id, ts);
 }
 
+// Whether FtraceParser can parse the events of type |event_id|, a field
+// number of FtraceEvent, in the generic compact encoding. Must cover the
+// events that traced_probes records in that encoding (see
+// SupportsCompactEncoding() in src/traced/probes/ftrace/compact_sched.h).
+bool IsInlineFtraceEvent(uint32_t event_id) {
+  using protos::pbzero::FtraceEvent;
+  switch (event_id) {
+    case FtraceEvent::kIrqHandlerEntryFieldNumber:
+    case FtraceEvent::kIrqHandlerExitFieldNumber:
+    case FtraceEvent::kSoftirqEntryFieldNumber:
+    case FtraceEvent::kSoftirqExitFieldNumber:
+    case FtraceEvent::kSoftirqRaiseFieldNumber:
+    case FtraceEvent::kIpiEntryFieldNumber:
+    case FtraceEvent::kIpiExitFieldNumber:
+    case FtraceEvent::kIpiRaiseFieldNumber:
+    case FtraceEvent::kCpuFrequencyFieldNumber:
+    case FtraceEvent::kCpuIdleFieldNumber:
+    case FtraceEvent::kWorkqueueActivateWorkFieldNumber:
+    case FtraceEvent::kWorkqueueExecuteEndFieldNumber:
+    case FtraceEvent::kWorkqueueExecuteStartFieldNumber:
+    case FtraceEvent::kWorkqueueQueueWorkFieldNumber:
+      return true;
+  }
+  return false;
+}
+
+// Whether the field |field_id| of the events of type |event_id| is a kernel
+// function, recorded as the iid of an interned kernel symbol.
+bool IsKernelFunctionField(uint32_t event_id, uint32_t field_id) {
+  using protos::pbzero::FtraceEvent;
+  using protos::pbzero::WorkqueueExecuteStartFtraceEvent;
+  using protos::pbzero::WorkqueueQueueWorkFtraceEvent;
+  return (event_id == FtraceEvent::kWorkqueueExecuteStartFieldNumber &&
+          field_id ==
+              WorkqueueExecuteStartFtraceEvent::kFunctionFieldNumber) ||
+         (event_id == FtraceEvent::kWorkqueueQueueWorkFieldNumber &&
+          field_id == WorkqueueQueueWorkFtraceEvent::kFunctionFieldNumber);
+}
+
 }  // namespace
 
 PERFETTO_ALWAYS_INLINE
@@ -104,7 +150,7 @@ base::Status FtraceTokenizer::TokenizeFtraceBundle(
   }
 
   if (decoder.has_compact_sched()) {
-    TokenizeFtraceCompactSched(cpu, clock_id, decoder.compact_sched());
+    TokenizeFtraceCompactSched(cpu, clock_id, decoder.compact_sched(), state);
   }
 
   for (auto it = decoder.event(); it; ++it) {
@@ -166,7 +212,8 @@ void FtraceTokenizer::TokenizeFtraceEvent(uint32_t cpu,
 PERFETTO_ALWAYS_INLINE
 void FtraceTokenizer::TokenizeFtraceCompactSched(uint32_t cpu,
                                                  ClockTracker::ClockId clock_id,
-                                                 protozero::ConstBytes packet) {
+                                                 protozero::ConstBytes packet,
+                                                 PacketSequenceState* state) {
   FtraceEventBundle::CompactSched::Decoder compact_sched(packet);
 
   // Build the interning table for comm fields.
@@ -179,6 +226,7 @@ void FtraceTokenizer::TokenizeFtraceCompactSched(uint32_t cpu,
 
   TokenizeFtraceCompactSchedSwitch(cpu, clock_id, compact_sched, string_table);
   TokenizeFtraceCompactSchedWaking(cpu, clock_id, compact_sched, string_table);
+  TokenizeFtraceCompactEvents(cpu, clock_id, compact_sched, state);
 }
 
 void FtraceTokenizer::TokenizeFtraceCompactSchedSwitch(
@@ -286,6 +334,123 @@ void FtraceTokenizer::TokenizeFtraceCompactSchedWaking(
     context_->storage->IncrementStats(stats::compact_sched_has_parse_errors);
 }
 
+void FtraceTokenizer::TokenizeFtraceCompactEvents(
+    uint32_t cpu,
+    ClockTracker::ClockId clock_id,
+    const FtraceEventBundle::CompactSched::Decoder& compact,
+    PacketSequenceState* state) {
+  using EventColumns = FtraceEventBundle::CompactSched::EventColumns;
+  if (!compact.has_event_columns())
+    return;
+
+  std::vector<StringId> string_table;
+  for (auto it = compact.event_intern_table(); it; ++it)
+    string_table.push_back(context_->storage->InternString(*it));
+
+  std::vector<int64_t> timestamps;
+  std::vector<InlineFtraceEvent> events;
+  for (auto it = compact.event_columns(); it; ++it) {
+    EventColumns::Decoder event_columns(*it);
+    uint32_t event_id = event_columns.event_field_id();
+    if (!IsInlineFtraceEvent(event_id)) {
+      context_->storage->IncrementStats(
+          stats::compact_ftrace_event_unsupported);
+      continue;
+    }
+
+    bool parse_error = false;
+    timestamps.clear();
+    events.clear();
+    int64_t timestamp_acc = 0;
+    for (auto ts_it = event_columns.timestamp(&parse_error); ts_it; ++ts_it) {
+      // delta-encoded timestamp
+      timestamp_acc += static_cast<int64_t>(*ts_it);
+      timestamps.push_back(timestamp_acc);
+      InlineFtraceEvent event{};
+      event.event_id = static_cast<uint16_t>(event_id);
+      events.push_back(event);
+    }
+    size_t num_pids = 0;
+    for (auto pid_it = event_columns.pid(&parse_error); pid_it;
+         ++pid_it, ++num_pids) {
+      if (num_pids < events.size())
+        events[num_pids].pid = static_cast<uint32_t>(*pid_it);
+    }
+    if (num_pids != events.size())
+      parse_error = true;
+
+    // Each column has a value for all the events, except for the ones in
+    // |omitted_event|, which don't have the field.
+    for (auto col_it = event_columns.column(); col_it && !parse_error;
+         ++col_it) {
+      EventColumns::Column::Decoder column(*col_it);
+      uint32_t field_id = column.field_id();
+      if (field_id == 0 || field_id > InlineFtraceEvent::kMaxFields) {
+        parse_error = true;
+        break;
+      }
+      bool kernel_function = IsKernelFunctionField(event_id, field_id);
+      auto omitted_it = column.omitted_event(&parse_error);
+      auto value_it = column.value(&parse_error);
+      for (size_t i = 0; i < events.size(); i++) {
+        if (omitted_it && *omitted_it == i) {
+          ++omitted_it;
+          continue;
+        }
+        if (!value_it) {
+          parse_error = true;
+          break;
+        }
+        uint64_t value = *value_it;
+        ++value_it;
+
+        InlineFtraceEvent& event = events[i];
+        event.present_fields |= static_cast<uint8_t>(1u << field_id);
+        std::optional<StringId> str;
+        if (column.interned_string()) {
+          if (value >= string_table.size()) {
+            parse_error = true;
+            break;
+          }
+          str = string_table[static_cast<size_t>(value)];
+        } else if (kernel_function) {
+          // If the symbol isn't interned (e.g. symbolization wasn't enabled),
+          // the field is kept as the iid, like in the normal form.
+          auto* symbol = state->current_generation()->LookupInternedMessage<
+              protos::pbzero::InternedData::kKernelSymbolsFieldNumber,
+              protos::pbzero::InternedString>(value);
+          if (symbol) {
+            protozero::ConstBytes name = symbol->str();
+            str = context_->storage->InternString(base::StringView(
+                reinterpret_cast<const char*>(name.data), name.size));
+          }
+        }
+        if (str) {
+          event.string_fields |= static_cast<uint8_t>(1u << field_id);
+          value = str->raw_id();
+        }
+        event.values[field_id - 1] = value;
+      }
+      if (value_it || omitted_it)
+        parse_error = true;
+    }
+    if (parse_error) {
+      context_->storage->IncrementStats(stats::compact_sched_has_parse_errors);
+      continue;
+    }
+
+    for (size_t i = 0; i < events.size(); i++) {
+      base::StatusOr<int64_t> timestamp =
+          ResolveTraceTime(context_, clock_id, timestamps[i]);
+      if (!timestamp.ok()) {
+        DlogWithLimit(timestamp.status());
+        return;
+      }
+      context_->sorter->PushInlineFtraceEvent(cpu, *timestamp, events[i]);
+    }
+  }
+}
+
 void FtraceTokenizer::HandleFtraceClockSnapshot(int64_t ftrace_ts,
                                                 int64_t boot_ts,
                                                 uint32_t packet_sequence_id) {
@@ -45,7 +45,8 @@ class FtraceTokenizer {
                            PacketSequenceState* state);
   void TokenizeFtraceCompactSched(uint32_t cpu,
                                   ClockTracker::ClockId,
-                                  protozero::ConstBytes);
+                                  protozero::ConstBytes,
+                                  PacketSequenceState* state);
   void TokenizeFtraceCompactSchedSwitch(
       uint32_t cpu,
       ClockTracker::ClockId,
@@ -56,6 +57,11 @@ class FtraceTokenizer {
       ClockTracker::ClockId,
       const protos::pbzero::FtraceEventBundle::CompactSched::Decoder& compact,
       const std::vector<StringId>& string_table);
+  void TokenizeFtraceCompactEvents(
+      uint32_t cpu,
+      ClockTracker::ClockId,
+      const protos::pbzero::FtraceEventBundle::CompactSched::Decoder& compact,
+      PacketSequenceState* state);
 
   void HandleFtraceClockSnapshot(int64_t ftrace_ts,
                                  int64_t boot_ts,
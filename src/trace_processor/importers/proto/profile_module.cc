@@ -225,6 +225,32 @@ void ProfileModule::ParsePerfSample(
     return;
   }
 
+  // Not a sample, but the stats of one of the producer's unwinder threads,
+  // indexed by the unwinder id and summed across data sources.
+  if (sample.has_unwinder_stats()) {
+    PerfSample::UnwinderStats::Decoder unwinder_stats(sample.unwinder_stats());
+    int unwinder_id = static_cast<int>(unwinder_stats.unwinder_id());
+    context_->storage->IncrementIndexedStats(
+        stats::perf_unwinder_samples_unwound, unwinder_id,
+        static_cast<int64_t>(unwinder_stats.samples_unwound()));
+    context_->storage->IncrementIndexedStats(
+        stats::perf_unwinder_elf_cache_hits, unwinder_id,
+        static_cast<int64_t>(unwinder_stats.elf_cache_hits()));
+    context_->storage->IncrementIndexedStats(
+        stats::perf_unwinder_elf_cache_misses, unwinder_id,
+        static_cast<int64_t>(unwinder_stats.elf_cache_misses()));
+    int64_t max_queue_occupancy =
+        static_cast<int64_t>(unwinder_stats.max_queue_occupancy());
+    std::optional<int64_t> prev_max = context_->storage->GetIndexedStats(
+        stats::perf_unwinder_max_queue_occupancy, unwinder_id);
+    if (!prev_max || *prev_max < max_queue_occupancy) {
+      context_->storage->SetIndexedStats(
+          stats::perf_unwinder_max_queue_occupancy, unwinder_id,
+          max_queue_occupancy);
+    }
+    return;
+  }
+
   // Not a sample, but an event from the producer.
   // TODO(rsavitski): this stat is indexed by the session id, but the older
   // stats (see above) aren't. The indexing is relevant if a trace contains more
@@ -147,6 +147,18 @@ void ProtoTraceParser::ParseInlineSchedWaking(uint32_t cpu,
   context_->args_tracker->Flush();
 }
 
+void ProtoTraceParser::ParseInlineFtraceEvent(uint32_t cpu,
+                                              int64_t ts,
+                                              InlineFtraceEvent data) {
+  PERFETTO_DCHECK(context_->ftrace_module);
+  context_->ftrace_module->ParseInlineFtraceEvent(cpu, ts, data);
+
+  // TODO(lalitm): maybe move this to the flush method in the trace processor
+  // once we have it. This may reduce performance in the ArgsTracker though so
+  // needs to be handled carefully.
+  context_->args_tracker->Flush();
+}
+
 void ProtoTraceParser::ParseTraceStats(ConstBytes blob) {
   protos::pbzero::TraceStats::Decoder evt(blob.data, blob.size);
   auto* storage = context_->storage.get();
@@ -182,6 +194,12 @@ void ProtoTraceParser::ParseTraceStats(ConstBytes blob) {
     case protos::pbzero::TraceStats::FINAL_FLUSH_UNSPECIFIED:
       break;
   }
+  if (evt.has_write_into_file_stats()) {
+    protos::pbzero::TraceStats::WriteIntoFileStats::Decoder file_stats(
+        evt.write_into_file_stats());
+    storage->SetStats(stats::traced_write_into_file_queue_full,
+                      static_cast<int64_t>(file_stats.queue_full_events()));
+  }
 
   int buf_num = 0;
   for (auto it = evt.buffer_stats(); it; ++it, ++buf_num) {
@@ -61,6 +61,10 @@ class ProtoTraceParser : public TraceParser {
                               int64_t /*ts*/,
                               InlineSchedWaking data) override;
 
+  void ParseInlineFtraceEvent(uint32_t cpu,
+                              int64_t /*ts*/,
+                              InlineFtraceEvent data) override;
+
   void ParseTraceStats(ConstBytes);
   void ParseChromeEvents(int64_t ts, ConstBytes);
   void ParseMetatraceEvent(int64_t ts, ConstBytes);
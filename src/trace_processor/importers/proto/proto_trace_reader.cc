@@ -22,6 +22,7 @@
 #include "perfetto/base/build_config.h"
 #include "perfetto/base/logging.h"
 #include "perfetto/ext/base/string_view.h"
+#include "perfetto/ext/base/threading/thread_pool.h"
 #include "perfetto/ext/base/utils.h"
 #include "perfetto/protozero/proto_decoder.h"
 #include "perfetto/protozero/proto_utils.h"
@@ -52,8 +53,27 @@
 namespace perfetto {
 namespace trace_processor {
 
+namespace {
+
+std::unique_ptr<base::ThreadPool> MaybeCreateIngestionThreadPool(
+    const Config& config) {
+  if (config.ingestion_worker_threads == 0)
+    return nullptr;
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_WASM)
+  PERFETTO_ELOG("Ignoring ingestion_worker_threads: no threads on WASM");
+  return nullptr;
+#else
+  return std::unique_ptr<base::ThreadPool>(
+      new base::ThreadPool(config.ingestion_worker_threads));
+#endif
+}
+
+}  // namespace
+
 ProtoTraceReader::ProtoTraceReader(TraceProcessorContext* ctx)
     : context_(ctx),
+      ingestion_thread_pool_(MaybeCreateIngestionThreadPool(ctx->config)),
+      tokenizer_(ingestion_thread_pool_.get()),
       skipped_packet_key_id_(ctx->storage->InternString("skipped_packet")),
       invalid_incremental_state_key_id_(
           ctx->storage->InternString("invalid_incremental_state")) {}
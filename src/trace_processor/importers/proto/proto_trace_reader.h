@@ -31,6 +31,10 @@ struct ConstBytes;
 
 namespace perfetto {
 
+namespace base {
+class ThreadPool;
+}  // namespace base
+
 namespace protos {
 namespace pbzero {
 class TracePacket_Decoder;
@@ -87,6 +91,10 @@ class ProtoTraceReader : public ChunkedTraceReader {
 
   TraceProcessorContext* context_;
 
+  // Only set if Config::ingestion_worker_threads > 0. Must be declared before
+  // |tokenizer_| which uses it.
+  std::unique_ptr<base::ThreadPool> ingestion_thread_pool_;
+
   ProtoTraceTokenizer tokenizer_;
 
   // Temporary. Currently trace packets do not have a timestamp, so the
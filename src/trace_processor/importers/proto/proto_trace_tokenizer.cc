@@ -15,38 +15,115 @@
  */
 
 #include "src/trace_processor/importers/proto/proto_trace_tokenizer.h"
-#include "perfetto/trace_processor/trace_blob.h"
 
+#include "perfetto/ext/base/threading/thread_pool.h"
 #include "perfetto/ext/base/utils.h"
+#include "perfetto/trace_processor/trace_blob.h"
 
 namespace perfetto {
 namespace trace_processor {
 
-ProtoTraceTokenizer::ProtoTraceTokenizer() = default;
-
-util::Status ProtoTraceTokenizer::Decompress(TraceBlobView input,
-                                             TraceBlobView* output) {
-  PERFETTO_DCHECK(util::IsGzipSupported());
+namespace {
 
-  std::vector<uint8_t> data;
-  data.reserve(input.length());
+// Inflates |size| bytes at |data| into a new TraceBlob. Does not touch any
+// refcounted object so it can be called from any thread.
+template <typename Decompressor>
+util::Status DecompressToBlob(Decompressor* decompressor,
+                              const uint8_t* data,
+                              size_t size,
+                              std::optional<TraceBlob>* output) {
+  std::vector<uint8_t> buf;
+  buf.reserve(size);
 
   // Ensure that the decompressor is able to cope with a new stream of data.
-  decompressor_.Reset();
-  using ResultCode = util::GzipDecompressor::ResultCode;
-  ResultCode ret = decompressor_.FeedAndExtract(
-      input.data(), input.length(),
-      [&data](const uint8_t* buffer, size_t buffer_len) {
-        data.insert(data.end(), buffer, buffer + buffer_len);
+  decompressor->Reset();
+  using ResultCode = typename Decompressor::ResultCode;
+  ResultCode ret = decompressor->FeedAndExtract(
+      data, size, [&buf](const uint8_t* buffer, size_t buffer_len) {
+        buf.insert(buf.end(), buffer, buffer + buffer_len);
       });
 
   if (ret == ResultCode::kError || ret == ResultCode::kNeedsMoreInput) {
     return util::ErrStatus("Failed to decompress (error code: %d)",
                            static_cast<int>(ret));
   }
+  output->emplace(TraceBlob::CopyFrom(buf.data(), buf.size()));
+  return util::OkStatus();
+}
+
+}  // namespace
+
+ProtoTraceTokenizer::ProtoTraceTokenizer(base::ThreadPool* decompression_pool)
+    : decompression_pool_(decompression_pool) {}
+
+ProtoTraceTokenizer::~ProtoTraceTokenizer() = default;
+
+util::Status ProtoTraceTokenizer::Decompress(TraceBlobView input,
+                                             TraceBlobView* output) {
+  std::optional<TraceBlob> out_blob;
+  if (util::IsZstdCompressed(input.data(), input.length())) {
+    PERFETTO_DCHECK(util::IsZstdSupported());
+    RETURN_IF_ERROR(DecompressToBlob(&zstd_decompressor_, input.data(),
+                                     input.length(), &out_blob));
+  } else {
+    PERFETTO_DCHECK(util::IsGzipSupported());
+    RETURN_IF_ERROR(DecompressToBlob(&decompressor_, input.data(),
+                                     input.length(), &out_blob));
+  }
+  *output = TraceBlobView(std::move(*out_blob));
+  return util::OkStatus();
+}
+
+std::unique_ptr<ProtoTraceTokenizer::PendingDecompression>
+ProtoTraceTokenizer::MaybePostDecompression(const TraceBlobView& packet) {
+  protos::pbzero::TracePacket::Decoder decoder(packet.data(),
+                                               packet.length());
+  if (!decoder.has_compressed_packets())
+    return nullptr;
+
+  // Let ParsePacket() deal with the (rare) error case of zlib or zstd not
+  // being available so that the error is reported in the right order.
+  protozero::ConstBytes field = decoder.compressed_packets();
+  bool is_zstd = util::IsZstdCompressed(field.data, field.size);
+  if (is_zstd ? !util::IsZstdSupported() : !util::IsGzipSupported())
+    return nullptr;
+
+  std::unique_ptr<PendingDecompression> pending(new PendingDecompression());
+  pending->input = field.data;
+  pending->input_size = field.size;
+
+  PendingDecompression* raw = pending.get();
+  decompression_pool_->PostTask([raw, is_zstd] {
+    // A fresh decompressor per task: GzipDecompressor is not thread-safe and
+    // is not reusable after a failed inflate.
+    std::optional<TraceBlob> output;
+    util::Status status;
+    if (is_zstd) {
+      util::ZstdDecompressor decompressor;
+      status =
+          DecompressToBlob(&decompressor, raw->input, raw->input_size, &output);
+    } else {
+      util::GzipDecompressor decompressor;
+      status =
+          DecompressToBlob(&decompressor, raw->input, raw->input_size, &output);
+    }
+    std::lock_guard<std::mutex> lock(raw->mutex);
+    raw->status = std::move(status);
+    raw->output = std::move(output);
+    raw->done = true;
+    raw->cv.notify_one();
+  });
+  return pending;
+}
 
-  TraceBlob out_blob = TraceBlob::CopyFrom(data.data(), data.size());
-  *output = TraceBlobView(std::move(out_blob));
+util::Status ProtoTraceTokenizer::WaitForDecompression(
+    PendingDecompression* pending,
+    TraceBlobView* output) {
+  std::unique_lock<std::mutex> lock(pending->mutex);
+  pending->cv.wait(lock, [pending] { return pending->done; });
+  RETURN_IF_ERROR(pending->status);
+  if (output)
+    *output = TraceBlobView(std::move(*pending->output));
   return util::OkStatus();
 }
 
@@ -17,7 +17,11 @@
 #ifndef SRC_TRACE_PROCESSOR_IMPORTERS_PROTO_PROTO_TRACE_TOKENIZER_H_
 #define SRC_TRACE_PROCESSOR_IMPORTERS_PROTO_PROTO_TRACE_TOKENIZER_H_
 
+#include <condition_variable>
 #include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <vector>
 
 #include "perfetto/base/status.h"
@@ -27,19 +31,30 @@
 #include "perfetto/trace_processor/trace_blob.h"
 #include "perfetto/trace_processor/trace_blob_view.h"
 #include "src/trace_processor/util/gzip_utils.h"
+#include "src/trace_processor/util/zstd_utils.h"
 #include "src/trace_processor/util/status_macros.h"
 
 #include "protos/perfetto/trace/trace.pbzero.h"
 #include "protos/perfetto/trace/trace_packet.pbzero.h"
 
 namespace perfetto {
+
+namespace base {
+class ThreadPool;
+}  // namespace base
+
 namespace trace_processor {
 
 // Reads a protobuf trace in chunks and extracts boundaries of trace packets
 // (or subfields, for the case of ftrace) with their timestamps.
 class ProtoTraceTokenizer {
  public:
-  ProtoTraceTokenizer();
+  // If |decompression_pool| is not null, |compressed_packets| are inflated on
+  // the threads of the pool ahead of being tokenized. The packets are still
+  // passed to the callback in trace order and on the calling thread. The pool
+  // must outlive this object.
+  explicit ProtoTraceTokenizer(base::ThreadPool* decompression_pool = nullptr);
+  ~ProtoTraceTokenizer();
 
   template <typename Callback = util::Status(TraceBlobView)>
   util::Status Tokenize(TraceBlobView blob, Callback callback) {
@@ -113,20 +128,30 @@ class ProtoTraceTokenizer {
       protozero::proto_utils::MakeTagLengthDelimited(
           protos::pbzero::Trace::kPacketFieldNumber);
 
+  // Bounds the memory used by decompressed packets waiting to be tokenized.
+  static constexpr size_t kMaxPendingDecompressions = 64;
+
   template <typename Callback = util::Status(TraceBlobView)>
   util::Status ParseInternal(TraceBlobView whole_buf, Callback callback) {
     static constexpr auto kLengthDelimited =
         protozero::proto_utils::ProtoWireType::kLengthDelimited;
     const uint8_t* const start = whole_buf.data();
     protos::pbzero::Trace::Decoder decoder(whole_buf.data(), whole_buf.size());
+    std::vector<TraceBlobView> packets;
     for (auto it = decoder.packet(); it; ++it) {
       if (PERFETTO_UNLIKELY(it->type() != kLengthDelimited)) {
         return base::ErrStatus("Failed to parse TracePacket bounds");
       }
       protozero::ConstBytes packet = *it;
       TraceBlobView sliced = whole_buf.slice(packet.data, packet.size);
+      if (decompression_pool_) {
+        packets.emplace_back(std::move(sliced));
+        continue;
+      }
       RETURN_IF_ERROR(ParsePacket(std::move(sliced), callback));
     }
+    if (!packets.empty())
+      RETURN_IF_ERROR(ParsePacketsWithPool(std::move(packets), callback));
 
     const size_t bytes_left = decoder.bytes_left();
     if (bytes_left > 0) {
@@ -142,40 +167,114 @@ class ProtoTraceTokenizer {
     protos::pbzero::TracePacket::Decoder decoder(packet.data(),
                                                  packet.length());
     if (decoder.has_compressed_packets()) {
-      if (!util::IsGzipSupported()) {
+      protozero::ConstBytes field = decoder.compressed_packets();
+      if (util::IsZstdCompressed(field.data, field.size)) {
+        if (!util::IsZstdSupported()) {
+          return util::Status(
+              "Cannot decode compressed packets. Zstd not enabled");
+        }
+      } else if (!util::IsGzipSupported()) {
         return util::Status(
             "Cannot decode compressed packets. Zlib not enabled");
       }
 
-      protozero::ConstBytes field = decoder.compressed_packets();
       TraceBlobView compressed_packets = packet.slice(field.data, field.size);
       TraceBlobView packets;
 
       RETURN_IF_ERROR(Decompress(std::move(compressed_packets), &packets));
+      return ParseDecompressedPackets(std::move(packets), callback);
+    }
+    return callback(std::move(packet));
+  }
+
+  template <typename Callback = util::Status(TraceBlobView)>
+  util::Status ParseDecompressedPackets(TraceBlobView packets,
+                                        Callback callback) {
+    const uint8_t* start = packets.data();
+    const uint8_t* end = packets.data() + packets.length();
+    const uint8_t* ptr = start;
+    while ((end - ptr) > 2) {
+      const uint8_t* packet_outer = ptr;
+      if (PERFETTO_UNLIKELY(*ptr != kTracePacketTag))
+        return util::ErrStatus("Expected TracePacket tag");
+      uint64_t packet_size = 0;
+      ptr = protozero::proto_utils::ParseVarInt(++ptr, end, &packet_size);
+      const uint8_t* packet_start = ptr;
+      ptr += packet_size;
+      if (PERFETTO_UNLIKELY((ptr - packet_outer) < 2 || ptr > end))
+        return util::ErrStatus("Invalid packet size");
+
+      TraceBlobView sliced =
+          packets.slice(packet_start, static_cast<size_t>(packet_size));
+      RETURN_IF_ERROR(ParsePacket(std::move(sliced), callback));
+    }
+    return util::OkStatus();
+  }
 
-      const uint8_t* start = packets.data();
-      const uint8_t* end = packets.data() + packets.length();
-      const uint8_t* ptr = start;
-      while ((end - ptr) > 2) {
-        const uint8_t* packet_outer = ptr;
-        if (PERFETTO_UNLIKELY(*ptr != kTracePacketTag))
-          return util::ErrStatus("Expected TracePacket tag");
-        uint64_t packet_size = 0;
-        ptr = protozero::proto_utils::ParseVarInt(++ptr, end, &packet_size);
-        const uint8_t* packet_start = ptr;
-        ptr += packet_size;
-        if (PERFETTO_UNLIKELY((ptr - packet_outer) < 2 || ptr > end))
-          return util::ErrStatus("Invalid packet size");
-
-        TraceBlobView sliced =
-            packets.slice(packet_start, static_cast<size_t>(packet_size));
-        RETURN_IF_ERROR(ParsePacket(std::move(sliced), callback));
+  // Tokenizes |packets| in order while inflating the |compressed_packets|
+  // among them on |decompression_pool_|, at most
+  // |kMaxPendingDecompressions| packets ahead of the one being tokenized.
+  template <typename Callback = util::Status(TraceBlobView)>
+  util::Status ParsePacketsWithPool(std::vector<TraceBlobView> packets,
+                                    Callback callback) {
+    std::vector<std::unique_ptr<PendingDecompression>> pending(packets.size());
+    size_t next_to_post = 0;
+    util::Status status = util::OkStatus();
+    for (size_t i = 0; i < packets.size() && status.ok(); ++i) {
+      for (; next_to_post < packets.size() &&
+             next_to_post < i + kMaxPendingDecompressions;
+           ++next_to_post) {
+        pending[next_to_post] = MaybePostDecompression(packets[next_to_post]);
       }
-      return util::OkStatus();
+      if (!pending[i]) {
+        status = ParsePacket(std::move(packets[i]), callback);
+        continue;
+      }
+      TraceBlobView decompressed;
+      status = WaitForDecompression(pending[i].get(), &decompressed);
+      pending[i].reset();
+      if (status.ok())
+        status = ParseDecompressedPackets(std::move(decompressed), callback);
     }
-    return callback(std::move(packet));
+    // The tasks still in flight reference the memory of |packets|: wait for
+    // them before returning, even on failure.
+    for (auto& p : pending) {
+      if (p)
+        WaitForDecompression(p.get(), nullptr);
+    }
+    return status;
   }
 
+  // Shared between the tokenizer thread and the pool thread doing the work.
+  // TraceBlobView is not thread-safe (its refcount is not atomic), so only raw
+  // pointers cross threads and the result is handed over as a TraceBlob which
+  // nobody else references yet.
+  struct PendingDecompression {
+    // Points inside a TraceBlobView kept alive by the tokenizer thread until
+    // the task is done.
+    const uint8_t* input = nullptr;
+    size_t input_size = 0;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+
+    // Start of |mutex| protected members.
+    bool done = false;
+    util::Status status;
+    std::optional<TraceBlob> output;
+    // End of |mutex| protected members.
+  };
+
+  // If |packet| contains |compressed_packets|, posts a task inflating them on
+  // |decompression_pool_| and returns its handle. Returns null otherwise.
+  std::unique_ptr<PendingDecompression> MaybePostDecompression(
+      const TraceBlobView& packet);
+
+  // Blocks until the task behind |pending| has completed. |output| can be
+  // null if the caller is not interested in the result.
+  util::Status WaitForDecompression(PendingDecompression* pending,
+                                    TraceBlobView* output);
+
   util::Status Decompress(TraceBlobView input, TraceBlobView* output);
 
   // Used to glue together trace packets that span across two (or more)
@@ -184,6 +283,10 @@ class ProtoTraceTokenizer {
 
   // Allows support for compressed trace packets.
   util::GzipDecompressor decompressor_;
+  util::ZstdDecompressor zstd_decompressor_;
+
+  // Optional, not owned. See the constructor.
+  base::ThreadPool* const decompression_pool_;
 };
 
 }  // namespace trace_processor
@@ -0,0 +1,142 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/importers/proto/proto_trace_tokenizer.h"
+
+#include <zlib.h>
+
+#include <string>
+#include <vector>
+
+#include "perfetto/ext/base/threading/thread_pool.h"
+#include "perfetto/protozero/scattered_heap_buffer.h"
+#include "test/gtest_and_gmock.h"
+
+#include "protos/perfetto/trace/trace.pbzero.h"
+#include "protos/perfetto/trace/trace_packet.pbzero.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+using ::testing::ElementsAreArray;
+
+std::string Deflate(const std::string& input) {
+  uLongf output_size = compressBound(static_cast<uLong>(input.size()));
+  std::string output(output_size, '\0');
+  int ret = compress(reinterpret_cast<Bytef*>(&output[0]), &output_size,
+                     reinterpret_cast<const Bytef*>(input.data()),
+                     static_cast<uLong>(input.size()));
+  PERFETTO_CHECK(ret == Z_OK);
+  output.resize(output_size);
+  return output;
+}
+
+void AddPacket(protos::pbzero::Trace* trace, uint64_t ts) {
+  auto* packet = trace->add_packet();
+  packet->set_timestamp(ts);
+  packet->set_trusted_packet_sequence_id(1);
+}
+
+// Builds a trace where packets with timestamps [0, |num_packets|) are spread
+// across plain packets and |compressed_packets| batches of varying size.
+std::vector<uint8_t> BuildTrace(uint32_t num_packets) {
+  protozero::HeapBuffered<protos::pbzero::Trace> trace;
+  uint32_t ts = 0;
+  for (uint32_t batch = 0; ts < num_packets; ++batch) {
+    if (batch % 3 == 0) {
+      AddPacket(trace.get(), ts++);
+      continue;
+    }
+    protozero::HeapBuffered<protos::pbzero::Trace> inner;
+    for (uint32_t i = 0; i < batch % 7 + 1 && ts < num_packets; ++i)
+      AddPacket(inner.get(), ts++);
+    trace->add_packet()->set_compressed_packets(
+        Deflate(inner.SerializeAsString()));
+  }
+  return trace.SerializeAsArray();
+}
+
+util::Status Tokenize(ProtoTraceTokenizer* tokenizer,
+                      const std::vector<uint8_t>& trace,
+                      size_t chunk_size,
+                      std::vector<uint64_t>* timestamps) {
+  TraceBlob blob = TraceBlob::CopyFrom(trace.data(), trace.size());
+  TraceBlobView whole(std::move(blob));
+  for (size_t off = 0; off < whole.size(); off += chunk_size) {
+    size_t size = std::min(chunk_size, whole.size() - off);
+    RETURN_IF_ERROR(tokenizer->Tokenize(
+        whole.slice_off(off, size), [timestamps](TraceBlobView packet) {
+          protos::pbzero::TracePacket::Decoder decoder(packet.data(),
+                                                       packet.length());
+          timestamps->push_back(decoder.timestamp());
+          return util::OkStatus();
+        }));
+  }
+  return util::OkStatus();
+}
+
+TEST(ProtoTraceTokenizerTest, CompressedPacketsInOrder) {
+  if (!util::IsGzipSupported())
+    GTEST_SKIP() << "zlib not enabled";
+
+  std::vector<uint8_t> trace = BuildTrace(1000);
+  std::vector<uint64_t> expected;
+  for (uint64_t i = 0; i < 1000; ++i)
+    expected.push_back(i);
+
+  for (size_t chunk_size : {size_t(13), size_t(4096), trace.size()}) {
+    std::vector<uint64_t> sequential;
+    ProtoTraceTokenizer sequential_tokenizer;
+    ASSERT_TRUE(
+        Tokenize(&sequential_tokenizer, trace, chunk_size, &sequential).ok());
+    EXPECT_THAT(sequential, ElementsAreArray(expected));
+
+    base::ThreadPool pool(4);
+    std::vector<uint64_t> parallel;
+    ProtoTraceTokenizer parallel_tokenizer(&pool);
+    ASSERT_TRUE(
+        Tokenize(&parallel_tokenizer, trace, chunk_size, &parallel).ok());
+    EXPECT_THAT(parallel, ElementsAreArray(expected));
+  }
+}
+
+TEST(ProtoTraceTokenizerTest, CorruptedCompressedPacketsWithPool) {
+  if (!util::IsGzipSupported())
+    GTEST_SKIP() << "zlib not enabled";
+
+  protozero::HeapBuffered<protos::pbzero::Trace> trace;
+  AddPacket(trace.get(), 1);
+  trace->add_packet()->set_compressed_packets("not a zlib stream");
+  for (uint32_t i = 0; i < 100; ++i) {
+    protozero::HeapBuffered<protos::pbzero::Trace> inner;
+    AddPacket(inner.get(), 2);
+    trace->add_packet()->set_compressed_packets(
+        Deflate(inner.SerializeAsString()));
+  }
+
+  base::ThreadPool pool(2);
+  ProtoTraceTokenizer tokenizer(&pool);
+  std::vector<uint64_t> timestamps;
+  util::Status status =
+      Tokenize(&tokenizer, trace.SerializeAsArray(), SIZE_MAX, &timestamps);
+  EXPECT_FALSE(status.ok());
+  EXPECT_THAT(timestamps, ElementsAreArray({uint64_t(1)}));
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -106,8 +106,10 @@ PerfettoSqlEngine::PerfettoSqlEngine(StringPool* pool)
         return table->get();
       },
       [this](const std::string& name) {
-        bool res = runtime_tables_.Erase(name);
-        PERFETTO_CHECK(res);
+        auto table = runtime_tables_.Find(name);
+        PERFETTO_CHECK(table);
+        query_cache_->InvalidateTable(table->get());
+        runtime_tables_.Erase(name);
       });
   engine_->RegisterVirtualTableModule<DbSqliteTable>(
       "runtime_table", std::move(context),
@@ -128,6 +130,7 @@ void PerfettoSqlEngine::RegisterStaticTable(const Table& table,
       std::make_unique<DbSqliteTable::Context>(query_cache_.get(), &table);
   engine_->RegisterVirtualTableModule<DbSqliteTable>(
       table_name, std::move(context), SqliteTable::kEponymousOnly, false);
+  static_tables_.Insert(table_name, &table);
 
   // Register virtual tables into an internal 'perfetto_tables' table.
   // This is used for iterating through all the tables during a database
@@ -203,6 +206,13 @@ PerfettoSqlEngine::ExecuteUntilLastStatement(SqlSource sql_source) {
       // dummy statement.
       source = cst->sql.FullRewrite(
           SqlSource::FromTraceProcessorImplementation("SELECT 0 WHERE 0"));
+    } else if (auto* ci = std::get_if<PerfettoSqlParser::CreateIndex>(
+                   &parser.statement())) {
+      RETURN_IF_ERROR(AddTracebackIfNeeded(ExecuteCreateIndex(*ci), ci->sql));
+      // Since the rest of the code requires a statement, just use a no-value
+      // dummy statement.
+      source = ci->sql.FullRewrite(
+          SqlSource::FromTraceProcessorImplementation("SELECT 0 WHERE 0"));
     } else {
       // If none of the above matched, this must just be an SQL statement
       // directly executable by SQLite.
@@ -387,6 +397,65 @@ base::Status PerfettoSqlEngine::RegisterRuntimeTable(std::string name,
       .status();
 }
 
+base::Status PerfettoSqlEngine::ExecuteCreateIndex(
+    const PerfettoSqlParser::CreateIndex& index) {
+  const Table* table = GetTableOrNull(index.table_name);
+  if (!table) {
+    return base::ErrStatus("CREATE PERFETTO INDEX: table '%s' does not exist",
+                           index.table_name.c_str());
+  }
+  if (static_tables_shared_ && static_tables_.Find(index.table_name)) {
+    return base::ErrStatus(
+        "CREATE PERFETTO INDEX: table '%s' is shared between query sessions "
+        "and cannot be indexed",
+        index.table_name.c_str());
+  }
+  std::optional<uint32_t> col_idx =
+      table->GetColumnIndexByName(index.column_name.c_str());
+  if (!col_idx) {
+    return base::ErrStatus(
+        "CREATE PERFETTO INDEX: column '%s' does not exist in table '%s'",
+        index.column_name.c_str(), index.table_name.c_str());
+  }
+
+  if (Index* existing = indexes_.Find(index.name)) {
+    if (!index.replace) {
+      return base::ErrStatus("CREATE PERFETTO INDEX: index '%s' already exists",
+                             index.name.c_str());
+    }
+    if (const Table* t = GetTableOrNull(existing->table_name))
+      t->DropIndex(existing->col_idx);
+    indexes_.Erase(index.name);
+  }
+
+  base::Status status = table->CreateIndex(*col_idx);
+  if (!status.ok()) {
+    return base::ErrStatus("CREATE PERFETTO INDEX[%s]: %s", index.name.c_str(),
+                           status.c_message());
+  }
+  indexes_.Insert(index.name, Index{index.table_name, *col_idx});
+  return base::OkStatus();
+}
+
+const Table* PerfettoSqlEngine::GetTableOrNull(const std::string& name) {
+  if (const Table** table = static_tables_.Find(name))
+    return *table;
+  if (std::unique_ptr<RuntimeTable>* table = runtime_tables_.Find(name))
+    return table->get();
+  return nullptr;
+}
+
+size_t PerfettoSqlEngine::GetIndexesMemoryUsage() {
+  size_t size = 0;
+  for (auto it = static_tables_.GetIterator(); it; ++it) {
+    size += it.value()->GetIndexesMemoryUsage();
+  }
+  for (auto it = runtime_tables_.GetIterator(); it; ++it) {
+    size += it.value()->GetIndexesMemoryUsage();
+  }
+  return size;
+}
+
 base::Status PerfettoSqlEngine::EnableSqlFunctionMemoization(
     const std::string& name) {
   constexpr size_t kSupportedArgCount = 1;
@@ -126,20 +126,46 @@ class PerfettoSqlEngine {
   // Should be called when a table function is destroyed.
   void OnRuntimeTableFunctionDestroyed(const std::string&);
 
+  // Returns the number of bytes used by the indexes of all the tables.
+  size_t GetIndexesMemoryUsage();
+
+  // Marks the static tables as shared with other engines which may execute
+  // queries concurrently. As indexes are stored in the tables themselves,
+  // CREATE PERFETTO INDEX is then only allowed on runtime tables.
+  void set_static_tables_shared(bool shared) { static_tables_shared_ = shared; }
+
+  // Returns the cache used to speed up repeated queries on tables.
+  const QueryCache& query_cache() const { return *query_cache_; }
+
   SqliteEngine* sqlite_engine() { return engine_.get(); }
 
  private:
+  // Index created with CREATE PERFETTO INDEX.
+  struct Index {
+    std::string table_name;
+    uint32_t col_idx;
+  };
+
   base::StatusOr<SqlSource> ExecuteCreateFunction(
       const PerfettoSqlParser::CreateFunction&);
 
   // Registers a SQL-defined trace processor C++ table with SQLite.
   base::Status RegisterRuntimeTable(std::string name, SqlSource sql);
 
+  base::Status ExecuteCreateIndex(const PerfettoSqlParser::CreateIndex&);
+
+  // Returns the static or runtime table with the given name or nullptr if
+  // there is no such table.
+  const Table* GetTableOrNull(const std::string& name);
+
   std::unique_ptr<QueryCache> query_cache_;
   StringPool* pool_ = nullptr;
   base::FlatHashMap<std::string, std::unique_ptr<RuntimeTableFunction::State>>
       runtime_table_fn_states_;
   base::FlatHashMap<std::string, std::unique_ptr<RuntimeTable>> runtime_tables_;
+  base::FlatHashMap<std::string, const Table*> static_tables_;
+  base::FlatHashMap<std::string, Index> indexes_;
+  bool static_tables_shared_ = false;
   std::unique_ptr<SqliteEngine> engine_;
 };
 
@@ -109,6 +109,45 @@ TEST_F(PerfettoSqlEngineTest, CreateTableFunctionDupe) {
   ASSERT_TRUE(res.ok());
 }
 
+TEST_F(PerfettoSqlEngineTest, CreatePerfettoIndex) {
+  auto res = engine_.ExecuteUntilLastStatement(SqlSource::FromExecuteQuery(
+      "CREATE PERFETTO TABLE foo AS "
+      "SELECT 3 AS bar UNION ALL SELECT 1 UNION ALL SELECT 2;"
+      "CREATE PERFETTO INDEX foo_bar ON foo(bar);"
+      "SELECT COUNT(*) FROM foo WHERE bar >= 2"));
+  ASSERT_TRUE(res.ok()) << res.status().c_message();
+  ASSERT_FALSE(res->stmt.IsDone());
+  ASSERT_EQ(sqlite3_column_int64(res->stmt.sqlite_stmt(), 0), 2);
+  ASSERT_FALSE(res->stmt.Step());
+  ASSERT_GT(engine_.GetIndexesMemoryUsage(), 0u);
+}
+
+TEST_F(PerfettoSqlEngineTest, CreatePerfettoIndexError) {
+  auto res = engine_.Execute(SqlSource::FromExecuteQuery(
+      "CREATE PERFETTO TABLE foo AS SELECT 42 AS bar"));
+  ASSERT_TRUE(res.ok());
+
+  res = engine_.Execute(SqlSource::FromExecuteQuery(
+      "CREATE PERFETTO INDEX foo_idx ON missing(bar)"));
+  ASSERT_FALSE(res.ok());
+
+  res = engine_.Execute(SqlSource::FromExecuteQuery(
+      "CREATE PERFETTO INDEX foo_idx ON foo(missing)"));
+  ASSERT_FALSE(res.ok());
+
+  res = engine_.Execute(
+      SqlSource::FromExecuteQuery("CREATE PERFETTO INDEX foo_idx ON foo(bar)"));
+  ASSERT_TRUE(res.ok());
+
+  res = engine_.Execute(
+      SqlSource::FromExecuteQuery("CREATE PERFETTO INDEX foo_idx ON foo(bar)"));
+  ASSERT_FALSE(res.ok());
+
+  res = engine_.Execute(SqlSource::FromExecuteQuery(
+      "CREATE OR REPLACE PERFETTO INDEX foo_idx ON foo(bar)"));
+  ASSERT_TRUE(res.ok());
+}
+
 }  // namespace
 }  // namespace trace_processor
 }  // namespace perfetto
@@ -141,9 +141,13 @@ bool PerfettoSqlParser::Next() {
         if (TokenIsSqliteKeyword("table", token)) {
           return ParseCreatePerfettoTable();
         }
+        if (TokenIsSqliteKeyword("index", token)) {
+          return ParseCreatePerfettoIndex(
+              state == State::kCreateOrReplacePerfetto, *first_non_space_token);
+        }
         base::StackString<1024> err(
-            "Expected 'FUNCTION' or 'TABLE' after 'CREATE PERFETTO', received "
-            "'%*s'.",
+            "Expected 'FUNCTION', 'TABLE' or 'INDEX' after 'CREATE PERFETTO', "
+            "received '%*s'.",
             static_cast<int>(token.str.size()), token.str.data());
         return ErrorAtToken(token, err.c_str());
     }
@@ -175,6 +179,62 @@ bool PerfettoSqlParser::ParseCreatePerfettoTable() {
   return true;
 }
 
+bool PerfettoSqlParser::ParseCreatePerfettoIndex(bool replace, Token first) {
+  Token index_name = tokenizer_.NextNonWhitespace();
+  if (index_name.token_type != SqliteTokenType::TK_ID) {
+    base::StackString<1024> err("Invalid index name %.*s",
+                                static_cast<int>(index_name.str.size()),
+                                index_name.str.data());
+    return ErrorAtToken(index_name, err.c_str());
+  }
+  std::string name(index_name.str);
+
+  if (Token on = tokenizer_.NextNonWhitespace();
+      !TokenIsSqliteKeyword("on", on)) {
+    return ErrorAtToken(on, "Expected keyword 'on'");
+  }
+
+  Token table_name = tokenizer_.NextNonWhitespace();
+  if (table_name.token_type != SqliteTokenType::TK_ID) {
+    base::StackString<1024> err("Invalid table name %.*s",
+                                static_cast<int>(table_name.str.size()),
+                                table_name.str.data());
+    return ErrorAtToken(table_name, err.c_str());
+  }
+
+  // TK_LP == '(' (i.e. left parenthesis).
+  if (Token lp = tokenizer_.NextNonWhitespace();
+      lp.token_type != SqliteTokenType::TK_LP) {
+    return ErrorAtToken(lp, "Malformed index definition: '(' expected");
+  }
+
+  Token column_name = tokenizer_.NextNonWhitespace();
+  if (column_name.token_type != SqliteTokenType::TK_ID) {
+    base::StackString<1024> err("Invalid column name %.*s",
+                                static_cast<int>(column_name.str.size()),
+                                column_name.str.data());
+    return ErrorAtToken(column_name, err.c_str());
+  }
+
+  // TK_RP == ')' (i.e. right parenthesis).
+  if (Token rp = tokenizer_.NextNonWhitespace();
+      rp.token_type != SqliteTokenType::TK_RP) {
+    return ErrorAtToken(
+        rp, "Malformed index definition: only a single column can be indexed");
+  }
+
+  Token terminal = tokenizer_.NextNonWhitespace();
+  if (!terminal.IsTerminal()) {
+    return ErrorAtToken(terminal, "Expected end of statement");
+  }
+
+  statement_ = CreateIndex{replace, std::move(name),
+                           std::string(table_name.str),
+                           std::string(column_name.str),
+                           tokenizer_.Substr(first, terminal)};
+  return true;
+}
+
 bool PerfettoSqlParser::ParseCreatePerfettoFunction(bool replace) {
   std::string prototype;
   Token function_name = tokenizer_.NextNonWhitespace();
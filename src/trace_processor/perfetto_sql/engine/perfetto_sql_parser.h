@@ -59,7 +59,17 @@ class PerfettoSqlParser {
     std::string name;
     SqlSource sql;
   };
-  using Statement = std::variant<SqliteSql, CreateFunction, CreateTable>;
+  // Indicates that the specified SQL was a CREATE PERFETTO INDEX statement
+  // with the following parameters.
+  struct CreateIndex {
+    bool replace;
+    std::string name;
+    std::string table_name;
+    std::string column_name;
+    SqlSource sql;
+  };
+  using Statement =
+      std::variant<SqliteSql, CreateFunction, CreateTable, CreateIndex>;
 
   // Creates a new SQL parser with the a block of PerfettoSQL statements.
   // Concretely, the passed string can contain >1 statement.
@@ -93,6 +103,8 @@ class PerfettoSqlParser {
 
   bool ParseCreatePerfettoTable();
 
+  bool ParseCreatePerfettoIndex(bool replace, SqliteTokenizer::Token first);
+
   bool ParseArgumentDefinitions(std::string*);
 
   bool ErrorAtToken(const SqliteTokenizer::Token&, const char* error);
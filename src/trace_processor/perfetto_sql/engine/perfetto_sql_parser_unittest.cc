@@ -32,6 +32,7 @@ using Result = PerfettoSqlParser::Statement;
 using SqliteSql = PerfettoSqlParser::SqliteSql;
 using CreateFn = PerfettoSqlParser::CreateFunction;
 using CreateTable = PerfettoSqlParser::CreateTable;
+using CreateIndex = PerfettoSqlParser::CreateIndex;
 
 inline bool operator==(const SqlSource& a, const SqlSource& b) {
   return a.sql() == b.sql();
@@ -50,6 +51,11 @@ inline bool operator==(const CreateTable& a, const CreateTable& b) {
   return std::tie(a.name, a.sql) == std::tie(b.name, b.sql);
 }
 
+inline bool operator==(const CreateIndex& a, const CreateIndex& b) {
+  return std::tie(a.replace, a.name, a.table_name, a.column_name) ==
+         std::tie(b.replace, b.name, b.table_name, b.column_name);
+}
+
 namespace {
 
 SqlSource FindSubstr(const SqlSource& source, const std::string& needle) {
@@ -146,6 +152,35 @@ TEST_F(PerfettoSqlParserTest, CreatePerfettoFunctionAndOther) {
                                    SqliteSql{FindSubstr(res, "select foo()")}));
 }
 
+TEST_F(PerfettoSqlParserTest, CreatePerfettoIndex) {
+  auto res = SqlSource::FromExecuteQuery(
+      "create perfetto index foo_idx on foo(bar); select 1");
+  ASSERT_THAT(*Parse(res),
+              testing::ElementsAre(
+                  CreateIndex{false, "foo_idx", "foo", "bar",
+                              FindSubstr(res, "create perfetto index")},
+                  SqliteSql{FindSubstr(res, "select 1")}));
+
+  res = SqlSource::FromExecuteQuery(
+      "CREATE OR REPLACE PERFETTO INDEX foo_idx ON foo ( bar )");
+  ASSERT_THAT(*Parse(res), testing::ElementsAre(CreateIndex{
+                               true, "foo_idx", "foo", "bar",
+                               FindSubstr(res, "CREATE OR REPLACE")}));
+}
+
+TEST_F(PerfettoSqlParserTest, CreatePerfettoIndexError) {
+  auto res =
+      SqlSource::FromExecuteQuery("create perfetto index foo_idx foo(bar)");
+  ASSERT_FALSE(Parse(res).status().ok());
+
+  res = SqlSource::FromExecuteQuery("create perfetto index foo_idx on foo");
+  ASSERT_FALSE(Parse(res).status().ok());
+
+  res = SqlSource::FromExecuteQuery(
+      "create perfetto index foo_idx on foo(bar, baz)");
+  ASSERT_FALSE(Parse(res).status().ok());
+}
+
 }  // namespace
 }  // namespace trace_processor
 }  // namespace perfetto
@@ -31,6 +31,7 @@
 #include "src/trace_processor/read_trace_internal.h"
 #include "src/trace_processor/util/gzip_utils.h"
 #include "src/trace_processor/util/status_macros.h"
+#include "src/trace_processor/util/zstd_utils.h"
 
 #include "protos/perfetto/trace/trace.pbzero.h"
 #include "protos/perfetto/trace/trace_packet.pbzero.h"
@@ -113,6 +114,7 @@ util::Status DecompressTrace(const uint8_t* data,
 
   protos::pbzero::Trace::Decoder decoder(data, size);
   util::GzipDecompressor decompressor;
+  util::ZstdDecompressor zstd_decompressor;
   if (size > 0 && !decoder.packet()) {
     return util::ErrStatus("Trace does not contain valid packets");
   }
@@ -125,12 +127,18 @@ util::Status DecompressTrace(const uint8_t* data,
 
     // Make sure that to reset the stream between the gzip streams.
     auto bytes = packet.compressed_packets();
-    decompressor.Reset();
+    auto append = [&output](const uint8_t* buf, size_t buf_len) {
+      output->insert(output->end(), buf, buf + buf_len);
+    };
     using ResultCode = util::GzipDecompressor::ResultCode;
-    ResultCode ret = decompressor.FeedAndExtract(
-        bytes.data, bytes.size, [&output](const uint8_t* buf, size_t buf_len) {
-          output->insert(output->end(), buf, buf + buf_len);
-        });
+    ResultCode ret;
+    if (util::IsZstdCompressed(bytes.data, bytes.size)) {
+      zstd_decompressor.Reset();
+      ret = zstd_decompressor.FeedAndExtract(bytes.data, bytes.size, append);
+    } else {
+      decompressor.Reset();
+      ret = decompressor.FeedAndExtract(bytes.data, bytes.size, append);
+    }
     if (ret == ResultCode::kError || ret == ResultCode::kNeedsMoreInput) {
       return util::ErrStatus("Failed while decompressing stream");
     }
@@ -16,8 +16,14 @@
 
 #include "src/trace_processor/rpc/query_result_serializer.h"
 
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
 #include <vector>
 
+#include "perfetto/ext/base/flat_hash_map.h"
 #include "perfetto/protozero/packed_repeated_fields.h"
 #include "perfetto/protozero/proto_utils.h"
 #include "perfetto/protozero/scattered_heap_buffer.h"
@@ -33,6 +39,7 @@ namespace {
 namespace pu = ::protozero::proto_utils;
 using BatchProto = protos::pbzero::QueryResult::CellsBatch;
 using ResultProto = protos::pbzero::QueryResult;
+using ColumnarBatchProto = protos::pbzero::QueryResult::ColumnarBatch;
 
 // The reserved field in trace_processor.proto.
 static constexpr uint32_t kPaddingFieldId = 7;
@@ -43,10 +50,243 @@ uint8_t MakeLenDelimTag(uint32_t field_num) {
   return static_cast<uint8_t>(tag);
 }
 
+// Accumulates the values of one column of a ColumnarBatch. The storage used
+// for the values depends on the types seen so far and is converted when a
+// value of a new type is appended (see the comment on ColumnarBatch.Column in
+// trace_processor.proto).
+class ColumnBuilder {
+ public:
+  // Appends the value of the next row. Returns an estimate of the number of
+  // bytes this adds to the serialized column.
+  uint32_t Append(const SqlValue& value) {
+    if (row_count_ % 8 == 0)
+      null_bitmap_.push_back(0);
+
+    uint32_t row = row_count_++;
+    switch (value.type) {
+      case SqlValue::Type::kNull:
+        null_bitmap_.back() |= static_cast<uint8_t>(1u << (row % 8));
+        has_nulls_ = true;
+        AppendNullValue();
+        return 0;
+      case SqlValue::Type::kLong:
+        if (type_ == BatchProto::CELL_NULL)
+          SetType(BatchProto::CELL_VARINT);
+        if (type_ == BatchProto::CELL_BLOB)
+          ConvertToString();
+
+        if (type_ == BatchProto::CELL_VARINT) {
+          longs_.push_back(value.long_value);
+        } else if (type_ == BatchProto::CELL_FLOAT64) {
+          doubles_.push_back(static_cast<double>(value.long_value));
+        } else {
+          AppendLongAsString(value.long_value);
+        }
+        return sizeof(int64_t);
+      case SqlValue::Type::kDouble:
+        if (type_ == BatchProto::CELL_NULL)
+          SetType(BatchProto::CELL_FLOAT64);
+        if (type_ == BatchProto::CELL_VARINT)
+          ConvertToDouble();
+        if (type_ == BatchProto::CELL_BLOB)
+          ConvertToString();
+
+        if (type_ == BatchProto::CELL_FLOAT64) {
+          doubles_.push_back(value.double_value);
+        } else {
+          AppendDoubleAsString(value.double_value);
+        }
+        return sizeof(double);
+      case SqlValue::Type::kString: {
+        if (type_ == BatchProto::CELL_NULL)
+          SetType(BatchProto::CELL_STRING);
+        if (type_ != BatchProto::CELL_STRING)
+          ConvertToString();
+        return AppendString(value.string_value, strlen(value.string_value));
+      }
+      case SqlValue::Type::kBytes: {
+        const char* data = static_cast<const char*>(value.bytes_value);
+        if (type_ == BatchProto::CELL_NULL)
+          SetType(BatchProto::CELL_BLOB);
+        if (type_ != BatchProto::CELL_BLOB && type_ != BatchProto::CELL_STRING)
+          ConvertToString();
+
+        if (type_ == BatchProto::CELL_BLOB) {
+          blobs_.emplace_back(data, value.bytes_count);
+          return static_cast<uint32_t>(value.bytes_count) + 4;
+        }
+        // Strings can't contain a NUL so stop at the first one, like SQLite
+        // does when reading a blob as text.
+        return AppendString(data, strnlen(data, value.bytes_count));
+      }
+    }
+    PERFETTO_FATAL("For GCC");
+  }
+
+  void Serialize(ColumnarBatchProto::Column* column) const {
+    column->set_type(type_);
+    if (has_nulls_)
+      column->set_null_bitmap(null_bitmap_.data(), null_bitmap_.size());
+
+    switch (type_) {
+      case BatchProto::CELL_VARINT:
+        column->set_int64_values(reinterpret_cast<const uint8_t*>(longs_.data()),
+                                 longs_.size() * sizeof(int64_t));
+        break;
+      case BatchProto::CELL_FLOAT64:
+        column->set_float64_values(
+            reinterpret_cast<const uint8_t*>(doubles_.data()),
+            doubles_.size() * sizeof(double));
+        break;
+      case BatchProto::CELL_STRING:
+        column->set_string_indexes(
+            reinterpret_cast<const uint8_t*>(string_indexes_.data()),
+            string_indexes_.size() * sizeof(uint32_t));
+        column->set_string_dictionary(string_dictionary_.data(),
+                                      string_dictionary_.size());
+        break;
+      case BatchProto::CELL_BLOB:
+        for (const std::string& blob : blobs_) {
+          column->add_blob_values(reinterpret_cast<const uint8_t*>(blob.data()),
+                                  blob.size());
+        }
+        break;
+      case BatchProto::CELL_NULL:
+      case BatchProto::CELL_INVALID:
+        break;
+    }
+  }
+
+ private:
+  bool IsNull(uint32_t row) const {
+    return null_bitmap_[row / 8] & (1u << (row % 8));
+  }
+
+  // Switches from CELL_NULL to |type|, adding a zero for the NULL rows seen so
+  // far.
+  void SetType(BatchProto::CellType type) {
+    PERFETTO_DCHECK(type_ == BatchProto::CELL_NULL);
+    type_ = type;
+    for (uint32_t i = 0; i < row_count_ - 1; ++i)
+      AppendNullValue();
+  }
+
+  void AppendNullValue() {
+    switch (type_) {
+      case BatchProto::CELL_VARINT:
+        longs_.push_back(0);
+        break;
+      case BatchProto::CELL_FLOAT64:
+        doubles_.push_back(0);
+        break;
+      case BatchProto::CELL_STRING:
+        string_indexes_.push_back(0);
+        break;
+      case BatchProto::CELL_BLOB:
+      case BatchProto::CELL_NULL:
+      case BatchProto::CELL_INVALID:
+        break;
+    }
+  }
+
+  void ConvertToDouble() {
+    PERFETTO_DCHECK(type_ == BatchProto::CELL_VARINT);
+    doubles_.assign(longs_.begin(), longs_.end());
+    longs_.clear();
+    type_ = BatchProto::CELL_FLOAT64;
+  }
+
+  // Converts the values of the rows before the last one (which is being
+  // appended) to strings.
+  void ConvertToString() {
+    BatchProto::CellType old_type = type_;
+    std::vector<int64_t> longs = std::move(longs_);
+    std::vector<double> doubles = std::move(doubles_);
+    std::vector<std::string> blobs = std::move(blobs_);
+    longs_.clear();
+    doubles_.clear();
+    blobs_.clear();
+    type_ = BatchProto::CELL_STRING;
+
+    uint32_t blob_idx = 0;
+    for (uint32_t i = 0; i < row_count_ - 1; ++i) {
+      if (IsNull(i)) {
+        AppendNullValue();
+        continue;
+      }
+      switch (old_type) {
+        case BatchProto::CELL_VARINT:
+          AppendLongAsString(longs[i]);
+          break;
+        case BatchProto::CELL_FLOAT64:
+          AppendDoubleAsString(doubles[i]);
+          break;
+        case BatchProto::CELL_BLOB: {
+          const std::string& blob = blobs[blob_idx++];
+          AppendString(blob.data(), strnlen(blob.data(), blob.size()));
+          break;
+        }
+        case BatchProto::CELL_STRING:
+        case BatchProto::CELL_NULL:
+        case BatchProto::CELL_INVALID:
+          PERFETTO_FATAL("Unexpected column type");
+      }
+    }
+  }
+
+  void AppendLongAsString(int64_t value) {
+    char buf[32];
+    int len = snprintf(buf, sizeof(buf), "%" PRId64, value);
+    AppendString(buf, static_cast<size_t>(len));
+  }
+
+  void AppendDoubleAsString(double value) {
+    char buf[32];
+    int len = snprintf(buf, sizeof(buf), "%.15g", value);
+    AppendString(buf, static_cast<size_t>(len));
+  }
+
+  uint32_t AppendString(const char* data, size_t len) {
+    auto [id, inserted] = string_ids_.Insert(
+        std::string(data, len), static_cast<uint32_t>(string_ids_.size()));
+    string_indexes_.push_back(*id);
+    if (!inserted)
+      return sizeof(uint32_t);
+
+    string_dictionary_.append(data, len);
+    string_dictionary_.push_back('\0');
+    return static_cast<uint32_t>(len + 1 + sizeof(uint32_t));
+  }
+
+  BatchProto::CellType type_ = BatchProto::CELL_NULL;
+  uint32_t row_count_ = 0;
+  bool has_nulls_ = false;
+  std::vector<uint8_t> null_bitmap_;
+
+  // Only one of these is used, depending on |type_|.
+  std::vector<int64_t> longs_;
+  std::vector<double> doubles_;
+  std::vector<uint32_t> string_indexes_;
+  std::vector<std::string> blobs_;
+
+  std::string string_dictionary_;
+  base::FlatHashMap<std::string, uint32_t> string_ids_;
+};
+
 }  // namespace
 
-QueryResultSerializer::QueryResultSerializer(Iterator iter)
-    : iter_(iter.take_impl()), num_cols_(iter_->ColumnCount()) {}
+QueryResultSerializer::QueryResultSerializer(Iterator iter,
+                                             ResultFormat format)
+    : iter_(iter.take_impl()),
+      num_cols_(iter_->ColumnCount()),
+      format_(format) {
+  if (format_ == ResultFormat::kColumnar) {
+    // The batches are limited by their size in bytes: allow enough cells to
+    // fill a batch with 64-bit values.
+    cells_per_batch_ = kDefaultColumnarBatchSplitThreshold / sizeof(int64_t);
+    batch_split_threshold_ = kDefaultColumnarBatchSplitThreshold;
+  }
+}
 
 QueryResultSerializer::~QueryResultSerializer() = default;
 
@@ -71,7 +311,11 @@ bool QueryResultSerializer::Serialize(protos::pbzero::QueryResult* res) {
   // write an empty batch with the EOF marker. Errors can happen also in the
   // middle of a query, not just before starting it.
 
-  SerializeBatch(res);
+  if (format_ == ResultFormat::kColumnar) {
+    SerializeColumnarBatch(res);
+  } else {
+    SerializeBatch(res);
+  }
   MaybeSerializeError(res);
   return !eof_reached_;
 }
@@ -250,6 +494,49 @@ void QueryResultSerializer::SerializeBatch(protos::pbzero::QueryResult* res) {
   batch->Finalize();
 }
 
+void QueryResultSerializer::SerializeColumnarBatch(
+    protos::pbzero::QueryResult* res) {
+  std::vector<ColumnBuilder> columns(num_cols_);
+
+  // See SerializeBatch() for the rationale of the size estimate.
+  uint32_t approx_batch_size = 16;
+  uint32_t row_count = 0;
+  bool batch_full = false;
+
+  for (;; ++row_count) {
+    // The previous batch might have stopped after advancing the iterator to a
+    // row which didn't fit. Note that, as in SerializeBatch(), Next() must be
+    // called even if num_cols_ == 0 so that the statement has an effect.
+    if (!has_pending_row_ && !iter_->Next())
+      break;  // EOF or error.
+    has_pending_row_ = false;
+
+    PERFETTO_DCHECK(num_cols_ > 0);
+    // A batch always contains at least one row, even if it is larger than the
+    // limits by itself.
+    if (row_count > 0 && ((row_count + 1) * num_cols_ > cells_per_batch_ ||
+                          approx_batch_size > batch_split_threshold_)) {
+      has_pending_row_ = true;
+      batch_full = true;
+      break;
+    }
+
+    for (uint32_t c = 0; c < num_cols_; ++c)
+      approx_batch_size += columns[c].Append(iter_->Get(c));
+  }
+
+  auto* batch = res->add_columnar_batch();
+  batch->set_row_count(row_count);
+  for (const ColumnBuilder& column : columns)
+    column.Serialize(batch->add_columns());
+
+  // If this is the last batch, write the EOF field.
+  if (!batch_full) {
+    eof_reached_ = true;
+    batch->set_is_last_batch(true);
+  }
+}
+
 void QueryResultSerializer::MaybeSerializeError(
     protos::pbzero::QueryResult* res) {
   if (iter_->Status().ok())
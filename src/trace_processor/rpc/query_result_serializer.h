@@ -51,10 +51,30 @@ class IteratorImpl;
 //   of a row).
 // The intended use case is streaaming these batches onto through a
 // chunked-encoded HTTP response, or through a repetition of Wasm calls.
+//
+// Results can be serialized in two formats (see QueryArgs.ResultFormat):
+// - kCells: each batch is a CellsBatch, which stores the results row by row.
+// - kColumnar: each batch is a ColumnarBatch, which stores the results column
+//   by column as typed arrays. This is more efficient for clients pulling a
+//   large number of rows in bulk (e.g. into numpy/pandas). As the type of a
+//   column is only known after seeing all its values, the rows of each batch
+//   are buffered before being serialized.
 class QueryResultSerializer {
  public:
+  enum class ResultFormat {
+    kCells,
+    kColumnar,
+  };
+
   static constexpr uint32_t kDefaultBatchSplitThreshold = 128 * 1024;
-  explicit QueryResultSerializer(Iterator);
+
+  // Columnar results are meant to be pulled in bulk, so use larger batches to
+  // amortize the per-batch overhead.
+  static constexpr uint32_t kDefaultColumnarBatchSplitThreshold =
+      4 * 1024 * 1024;
+
+  explicit QueryResultSerializer(Iterator,
+                                 ResultFormat = ResultFormat::kCells);
   ~QueryResultSerializer();
 
   // No copy or move.
@@ -78,10 +98,12 @@ class QueryResultSerializer {
  private:
   void SerializeMetadata(protos::pbzero::QueryResult*);
   void SerializeBatch(protos::pbzero::QueryResult*);
+  void SerializeColumnarBatch(protos::pbzero::QueryResult*);
   void MaybeSerializeError(protos::pbzero::QueryResult*);
 
   std::unique_ptr<IteratorImpl> iter_;
   const uint32_t num_cols_;
+  const ResultFormat format_;
   bool did_write_metadata_ = false;
   bool eof_reached_ = false;
   uint32_t col_ = UINT32_MAX;
@@ -94,6 +116,10 @@ class QueryResultSerializer {
   // Overridable for testing only.
   uint32_t cells_per_batch_ = 50000;
   uint32_t batch_split_threshold_ = kDefaultBatchSplitThreshold;
+
+  // Only used for ResultFormat::kColumnar. Set when the iterator has been
+  // advanced to a row which didn't fit in the previous batch.
+  bool has_pending_row_ = false;
 };
 
 }  // namespace trace_processor
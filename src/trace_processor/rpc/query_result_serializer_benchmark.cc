@@ -24,6 +24,7 @@
 using perfetto::trace_processor::Config;
 using perfetto::trace_processor::QueryResultSerializer;
 using perfetto::trace_processor::TraceProcessor;
+using ResultFormat = QueryResultSerializer::ResultFormat;
 using VectorType = std::vector<uint8_t>;
 
 namespace {
@@ -48,7 +49,8 @@ void RunQueryChecked(TraceProcessor* tp, const std::string& query) {
 
 }  // namespace
 
-static void BM_QueryResultSerializer_Mixed(benchmark::State& state) {
+static void BM_QueryResultSerializer_Mixed(benchmark::State& state,
+                                           ResultFormat format) {
   auto tp = TraceProcessor::CreateInstance(Config());
   RunQueryChecked(tp.get(), "create virtual table win using window;");
   RunQueryChecked(tp.get(),
@@ -58,7 +60,7 @@ static void BM_QueryResultSerializer_Mixed(benchmark::State& state) {
   for (auto _ : state) {
     auto iter = tp->ExecuteQuery(
         "select dur || dur as x, ts, dur * 1.0 as dur, quantum_ts from win");
-    QueryResultSerializer serializer(std::move(iter));
+    QueryResultSerializer serializer(std::move(iter), format);
     serializer.set_batch_size_for_testing(
         static_cast<uint32_t>(state.range(0)),
         static_cast<uint32_t>(state.range(1)));
@@ -70,7 +72,8 @@ static void BM_QueryResultSerializer_Mixed(benchmark::State& state) {
   benchmark::ClobberMemory();
 }
 
-static void BM_QueryResultSerializer_Strings(benchmark::State& state) {
+static void BM_QueryResultSerializer_Strings(benchmark::State& state,
+                                             ResultFormat format) {
   auto tp = TraceProcessor::CreateInstance(Config());
   RunQueryChecked(tp.get(), "create virtual table win using window;");
   RunQueryChecked(tp.get(),
@@ -80,7 +83,7 @@ static void BM_QueryResultSerializer_Strings(benchmark::State& state) {
   for (auto _ : state) {
     auto iter = tp->ExecuteQuery(
         "select  ts || '-' || ts , (dur * 1.0) || dur from win");
-    QueryResultSerializer serializer(std::move(iter));
+    QueryResultSerializer serializer(std::move(iter), format);
     serializer.set_batch_size_for_testing(
         static_cast<uint32_t>(state.range(0)),
         static_cast<uint32_t>(state.range(1)));
@@ -92,5 +95,17 @@ static void BM_QueryResultSerializer_Strings(benchmark::State& state) {
   benchmark::ClobberMemory();
 }
 
-BENCHMARK(BM_QueryResultSerializer_Mixed)->Apply(BenchmarkArgs);
-BENCHMARK(BM_QueryResultSerializer_Strings)->Apply(BenchmarkArgs);
+BENCHMARK_CAPTURE(BM_QueryResultSerializer_Mixed, cells, ResultFormat::kCells)
+    ->Apply(BenchmarkArgs);
+BENCHMARK_CAPTURE(BM_QueryResultSerializer_Mixed,
+                  columnar,
+                  ResultFormat::kColumnar)
+    ->Apply(BenchmarkArgs);
+BENCHMARK_CAPTURE(BM_QueryResultSerializer_Strings,
+                  cells,
+                  ResultFormat::kCells)
+    ->Apply(BenchmarkArgs);
+BENCHMARK_CAPTURE(BM_QueryResultSerializer_Strings,
+                  columnar,
+                  ResultFormat::kColumnar)
+    ->Apply(BenchmarkArgs);
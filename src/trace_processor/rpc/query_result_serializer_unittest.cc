@@ -71,7 +71,9 @@ namespace {
 
 using ::testing::ElementsAre;
 using BatchProto = protos::pbzero::QueryResult::CellsBatch;
+using ColumnarBatchProto = protos::pbzero::QueryResult::ColumnarBatch;
 using ResultProto = protos::pbzero::QueryResult;
+using ResultFormat = QueryResultSerializer::ResultFormat;
 
 void RunQueryChecked(TraceProcessor* tp, const std::string& query) {
   auto iter = tp->ExecuteQuery(query);
@@ -91,6 +93,10 @@ class TestDeserializer {
   bool eof_reached = false;
 
  private:
+  void DeserializeColumnarBatch(protozero::ConstBytes);
+  SqlValue CopyString(const std::string&);
+  SqlValue CopyBytes(const std::string&);
+
   std::vector<std::unique_ptr<char[]>> copied_buf_;
 };
 
@@ -191,6 +197,102 @@ void TestDeserializer::DeserializeBuffer(const uint8_t* start, size_t size) {
       EXPECT_EQ(num_cells % columns.size(), 0u);
     }
   }
+
+  for (auto batch_it = result.columnar_batch(); batch_it; ++batch_it) {
+    ASSERT_FALSE(eof_reached);
+    DeserializeColumnarBatch(batch_it->as_bytes());
+  }
+}
+
+void TestDeserializer::DeserializeColumnarBatch(protozero::ConstBytes bytes) {
+  ColumnarBatchProto::Decoder batch(bytes.data, bytes.size);
+  eof_reached = batch.is_last_batch();
+  const uint32_t row_count = batch.row_count();
+
+  // Decode the batch column by column and then append the cells row by row.
+  std::vector<std::vector<SqlValue>> values;
+  for (auto col_it = batch.columns(); col_it; ++col_it) {
+    auto col_bytes = col_it->as_bytes();
+    ColumnarBatchProto::Column::Decoder col(col_bytes.data, col_bytes.size);
+    std::string null_bitmap = col.null_bitmap().ToStdString();
+    std::string int64_values = col.int64_values().ToStdString();
+    std::string float64_values = col.float64_values().ToStdString();
+    std::string string_indexes = col.string_indexes().ToStdString();
+
+    std::vector<std::string> dictionary;
+    std::string merged_strings = col.string_dictionary().ToStdString();
+    for (size_t pos = 0; pos < merged_strings.size();) {
+      size_t next_sep = merged_strings.find('\0', pos);
+      ASSERT_NE(next_sep, std::string::npos);
+      dictionary.emplace_back(merged_strings.substr(pos, next_sep - pos));
+      pos = next_sep + 1;
+    }
+    std::deque<std::string> blobs;
+    for (auto it = col.blob_values(); it; ++it)
+      blobs.emplace_back((*it).ToStdString());
+
+    std::vector<SqlValue> col_values;
+    for (uint32_t row = 0; row < row_count; ++row) {
+      if (!null_bitmap.empty() &&
+          (static_cast<uint8_t>(null_bitmap[row / 8]) & (1u << (row % 8)))) {
+        col_values.emplace_back(SqlValue());
+        continue;
+      }
+      switch (col.type()) {
+        case BatchProto::CELL_NULL:
+          col_values.emplace_back(SqlValue());
+          break;
+        case BatchProto::CELL_VARINT: {
+          ASSERT_EQ(int64_values.size(), row_count * sizeof(int64_t));
+          int64_t value;
+          memcpy(&value, &int64_values[row * sizeof(int64_t)], sizeof(value));
+          col_values.emplace_back(SqlValue::Long(value));
+          break;
+        }
+        case BatchProto::CELL_FLOAT64: {
+          ASSERT_EQ(float64_values.size(), row_count * sizeof(double));
+          double value;
+          memcpy(&value, &float64_values[row * sizeof(double)], sizeof(value));
+          col_values.emplace_back(SqlValue::Double(value));
+          break;
+        }
+        case BatchProto::CELL_STRING: {
+          ASSERT_EQ(string_indexes.size(), row_count * sizeof(uint32_t));
+          uint32_t idx;
+          memcpy(&idx, &string_indexes[row * sizeof(uint32_t)], sizeof(idx));
+          ASSERT_LT(idx, dictionary.size());
+          col_values.emplace_back(CopyString(dictionary[idx]));
+          break;
+        }
+        case BatchProto::CELL_BLOB:
+          ASSERT_GT(blobs.size(), 0u);
+          col_values.emplace_back(CopyBytes(blobs.front()));
+          blobs.pop_front();
+          break;
+        default:
+          FAIL() << "Unknown column type " << col.type();
+      }
+    }
+    values.emplace_back(std::move(col_values));
+  }
+  ASSERT_EQ(values.size(), columns.size());
+
+  for (uint32_t row = 0; row < row_count; ++row) {
+    for (const auto& col_values : values)
+      cells.emplace_back(col_values[row]);
+  }
+}
+
+SqlValue TestDeserializer::CopyString(const std::string& str) {
+  copied_buf_.emplace_back(new char[str.size() + 1]);
+  memcpy(copied_buf_.back().get(), str.c_str(), str.size() + 1);
+  return SqlValue::String(copied_buf_.back().get());
+}
+
+SqlValue TestDeserializer::CopyBytes(const std::string& bytes) {
+  copied_buf_.emplace_back(new char[bytes.size()]);
+  memcpy(copied_buf_.back().get(), bytes.data(), bytes.size());
+  return SqlValue::Bytes(copied_buf_.back().get(), bytes.size());
 }
 
 TEST(QueryResultSerializerTest, ShortBatch) {
@@ -452,6 +554,108 @@ TEST(QueryResultSerializerTest, NoResultQuery) {
   }
 }
 
+TEST(QueryResultSerializerTest, ColumnarShortBatch) {
+  auto tp = TraceProcessor::CreateInstance(trace_processor::Config());
+
+  auto iter = tp->ExecuteQuery(
+      "select 1 as i8, 42001001001 as i64, 1e9 as f64, 'a_string' as str, "
+      "cast('a_blob' as blob) as blb, NULL as nul");
+  QueryResultSerializer ser(std::move(iter), ResultFormat::kColumnar);
+  TestDeserializer deser;
+  deser.SerializeAndDeserialize(&ser);
+
+  EXPECT_THAT(deser.columns,
+              ElementsAre("i8", "i64", "f64", "str", "blb", "nul"));
+  EXPECT_THAT(deser.cells,
+              ElementsAre(SqlValue::Long(1), SqlValue::Long(42001001001),
+                          SqlValue::Double(1e9), SqlValue::String("a_string"),
+                          SqlValue::Bytes("a_blob", 6), SqlValue()));
+}
+
+TEST(QueryResultSerializerTest, ColumnarLongBatch) {
+  auto tp = TraceProcessor::CreateInstance(trace_processor::Config());
+
+  RunQueryChecked(tp.get(), "create virtual table win using window;");
+  RunQueryChecked(tp.get(),
+                  "update win set window_start=0, window_dur=8192, quantum=1 "
+                  "where rowid = 0");
+
+  // Check both a single batch and many small batches.
+  for (uint32_t cells_per_batch : {1u << 20, 64u, 3u}) {
+    auto iter = tp->ExecuteQuery(
+        "select ts % 3 as x, ts, iif(ts % 2, NULL, dur * 1.0) as dur, "
+        "'s' || (ts % 10) as str from win");
+    QueryResultSerializer ser(std::move(iter), ResultFormat::kColumnar);
+    ser.set_batch_size_for_testing(cells_per_batch, 1 << 20);
+
+    TestDeserializer deser;
+    deser.SerializeAndDeserialize(&ser);
+
+    ASSERT_THAT(deser.columns, ElementsAre("x", "ts", "dur", "str"));
+    ASSERT_EQ(deser.cells.size(), 4 * 8192u);
+    for (uint32_t row = 0; row < 8192; row++) {
+      uint32_t cell = row * 4;
+      ASSERT_EQ(deser.cells[cell], SqlValue::Long(row % 3));
+      ASSERT_EQ(deser.cells[cell + 1], SqlValue::Long(row));
+      if (row % 2) {
+        ASSERT_EQ(deser.cells[cell + 2].type, SqlValue::kNull);
+      } else {
+        ASSERT_EQ(deser.cells[cell + 2].type, SqlValue::kDouble);
+        ASSERT_EQ(deser.cells[cell + 2].double_value, 1.0);
+      }
+      std::string str = "s" + std::to_string(row % 10);
+      ASSERT_EQ(deser.cells[cell + 3], SqlValue::String(str.c_str()));
+    }
+  }
+}
+
+TEST(QueryResultSerializerTest, ColumnarMixedTypes) {
+  auto tp = TraceProcessor::CreateInstance(trace_processor::Config());
+  RunQueryChecked(tp.get(), "create table tab (a, b, c)");
+  RunQueryChecked(tp.get(),
+                  "insert into tab (a, b, c) values "
+                  "(NULL, 1, X'41'), (1, 'x', 'y'), (2.5, 2.5, 3)");
+
+  auto iter = tp->ExecuteQuery("select a, b, c from tab");
+  QueryResultSerializer ser(std::move(iter), ResultFormat::kColumnar);
+  TestDeserializer deser;
+  deser.SerializeAndDeserialize(&ser);
+
+  // Integers mixed with doubles become doubles; anything mixed with strings or
+  // blobs becomes a string.
+  EXPECT_THAT(deser.cells,
+              ElementsAre(SqlValue(), SqlValue::String("1"),
+                          SqlValue::String("A"), SqlValue::Double(1),
+                          SqlValue::String("x"), SqlValue::String("y"),
+                          SqlValue::Double(2.5), SqlValue::String("2.5"),
+                          SqlValue::String("3")));
+}
+
+TEST(QueryResultSerializerTest, ColumnarErrorAfterSomeResults) {
+  auto tp = TraceProcessor::CreateInstance(trace_processor::Config());
+  RunQueryChecked(tp.get(), "create table tab (x)");
+  RunQueryChecked(tp.get(), "insert into tab (x) values (0), (1), ('error')");
+  auto iter = tp->ExecuteQuery("select str_split('a;b', ';', x) as s from tab");
+  QueryResultSerializer ser(std::move(iter), ResultFormat::kColumnar);
+  TestDeserializer deser;
+  deser.SerializeAndDeserialize(&ser);
+  EXPECT_NE(deser.error, "");
+  EXPECT_THAT(deser.cells,
+              ElementsAre(SqlValue::String("a"), SqlValue::String("b")));
+  EXPECT_TRUE(deser.eof_reached);
+}
+
+TEST(QueryResultSerializerTest, ColumnarNoResultQuery) {
+  auto tp = TraceProcessor::CreateInstance(trace_processor::Config());
+  auto iter = tp->ExecuteQuery("create table tab (x)");
+  QueryResultSerializer ser(std::move(iter), ResultFormat::kColumnar);
+  TestDeserializer deser;
+  deser.SerializeAndDeserialize(&ser);
+  EXPECT_EQ(deser.error, "");
+  EXPECT_EQ(deser.cells.size(), 0u);
+  EXPECT_TRUE(deser.eof_reached);
+}
+
 }  // namespace
 }  // namespace trace_processor
 }  // namespace perfetto
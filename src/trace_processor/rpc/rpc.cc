@@ -97,6 +97,17 @@ Rpc::Rpc(std::unique_ptr<TraceProcessor> preloaded_instance)
 Rpc::Rpc() : Rpc(nullptr) {}
 Rpc::~Rpc() = default;
 
+std::unique_ptr<Rpc> Rpc::CreateQuerySession() {
+  std::unique_ptr<TraceProcessor> session =
+      trace_processor_->CreateQuerySession();
+  if (!session)
+    return nullptr;
+  std::unique_ptr<Rpc> rpc(new Rpc(std::move(session)));
+  rpc->trace_processor_config_ = trace_processor_config_;
+  rpc->eof_ = true;
+  return rpc;
+}
+
 void Rpc::ResetTraceProcessorInternal(const Config& config) {
   trace_processor_config_ = config;
   trace_processor_ = TraceProcessor::CreateInstance(config);
@@ -207,8 +218,9 @@ void Rpc::ParseRpcRequest(const uint8_t* data, size_t len) {
         resp.Send(rpc_response_fn_);
       } else {
         protozero::ConstBytes args = req.query_args();
-        auto it = QueryInternal(args.data, args.size);
-        QueryResultSerializer serializer(std::move(it));
+        QueryResultSerializer::ResultFormat format;
+        auto it = QueryInternal(args.data, args.size, &format);
+        QueryResultSerializer serializer(std::move(it), format);
         for (bool has_more = true; has_more;) {
           Response resp(tx_seq_id_++, req_type);
           has_more = serializer.Serialize(resp->set_query_result());
@@ -357,8 +369,9 @@ void Rpc::MaybePrintProgress() {
 void Rpc::Query(const uint8_t* args,
                 size_t len,
                 QueryResultBatchCallback result_callback) {
-  auto it = QueryInternal(args, len);
-  QueryResultSerializer serializer(std::move(it));
+  QueryResultSerializer::ResultFormat format;
+  auto it = QueryInternal(args, len, &format);
+  QueryResultSerializer serializer(std::move(it), format);
 
   std::vector<uint8_t> res;
   for (bool has_more = true; has_more;) {
@@ -368,9 +381,15 @@ void Rpc::Query(const uint8_t* args,
   }
 }
 
-Iterator Rpc::QueryInternal(const uint8_t* args, size_t len) {
+Iterator Rpc::QueryInternal(const uint8_t* args,
+                            size_t len,
+                            QueryResultSerializer::ResultFormat* format) {
   protos::pbzero::QueryArgs::Decoder query(args, len);
   std::string sql = query.sql_query().ToStdString();
+  *format = query.result_format() ==
+                    protos::pbzero::QueryArgs::RESULT_FORMAT_COLUMNAR
+                ? QueryResultSerializer::ResultFormat::kColumnar
+                : QueryResultSerializer::ResultFormat::kCells;
   PERFETTO_DLOG("[RPC] Query < %s", sql.c_str());
   PERFETTO_TP_TRACE(metatrace::Category::TOPLEVEL, "RPC_QUERY",
                     [&](metatrace::Record* r) {
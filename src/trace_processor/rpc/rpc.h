@@ -27,6 +27,7 @@
 #include "perfetto/trace_processor/basic_types.h"
 #include "perfetto/trace_processor/status.h"
 #include "src/protozero/proto_ring_buffer.h"
+#include "src/trace_processor/rpc/query_result_serializer.h"
 
 namespace perfetto {
 
@@ -65,6 +66,14 @@ class Rpc {
   Rpc();
   ~Rpc();
 
+  // Creates an RPC endpoint backed by a query session (see
+  // TraceProcessor::CreateQuerySession()) of the trace loaded in this
+  // instance. Each endpoint can serve its requests on a different thread,
+  // concurrently with the other sessions. Returns nullptr if the trace is not
+  // fully loaded yet. The returned instance must be destroyed before this one
+  // and this instance should not serve queries while sessions exist.
+  std::unique_ptr<Rpc> CreateQuerySession();
+
   // 1. TraceProcessor byte-pipe RPC interface.
   // This is a bidirectional channel with a remote TraceProcessor instance. All
   // it needs is a byte-oriented pipe (e.g., a TCP socket, a pipe(2) between two
@@ -135,7 +144,11 @@ class Rpc {
   void ParseRpcRequest(const uint8_t* data, size_t len);
   void ResetTraceProcessorInternal(const Config& config);
   void MaybePrintProgress();
-  Iterator QueryInternal(const uint8_t* args, size_t len);
+  // Runs the query in the passed QueryArgs and sets |format| to the format
+  // requested for its results.
+  Iterator QueryInternal(const uint8_t* args,
+                         size_t len,
+                         QueryResultSerializer::ResultFormat* format);
   void ComputeMetricInternal(const uint8_t* args,
                              size_t len,
                              protos::pbzero::ComputeMetricResult*);
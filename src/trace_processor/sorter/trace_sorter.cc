@@ -38,6 +38,9 @@ TraceSorter::TraceSorter(TraceProcessorContext* context,
   bypass_next_stage_for_testing_ = env && !strcmp(env, "1");
   if (bypass_next_stage_for_testing_)
     PERFETTO_ELOG("TEST MODE: bypassing protobuf parsing stage");
+  uint64_t spill_threshold = context_->config.sorting_spill_threshold_bytes;
+  if (spill_threshold > 0)
+    token_buffer_.EnableSpilling(spill_threshold);
 }
 
 TraceSorter::~TraceSorter() {
@@ -199,6 +202,7 @@ void TraceSorter::ParseTracePacket(const TimestampedEvent& event) {
       return;
     case TimestampedEvent::Type::kInlineSchedSwitch:
     case TimestampedEvent::Type::kInlineSchedWaking:
+    case TimestampedEvent::Type::kInlineFtraceEvent:
     case TimestampedEvent::Type::kFtraceEvent:
       PERFETTO_FATAL("Invalid event type");
   }
@@ -217,6 +221,10 @@ void TraceSorter::ParseFtracePacket(uint32_t cpu,
       parser_->ParseInlineSchedWaking(
           cpu, event.ts, token_buffer_.Extract<InlineSchedWaking>(id));
       return;
+    case TimestampedEvent::Type::kInlineFtraceEvent:
+      parser_->ParseInlineFtraceEvent(
+          cpu, event.ts, token_buffer_.Extract<InlineFtraceEvent>(id));
+      return;
     case TimestampedEvent::Type::kFtraceEvent:
       parser_->ParseFtraceEvent(cpu, event.ts,
                                 token_buffer_.Extract<TracePacketData>(id));
@@ -256,6 +264,9 @@ void TraceSorter::ExtractAndDiscardTokenizedObject(
     case TimestampedEvent::Type::kInlineSchedWaking:
       base::ignore_result(token_buffer_.Extract<InlineSchedWaking>(id));
       return;
+    case TimestampedEvent::Type::kInlineFtraceEvent:
+      base::ignore_result(token_buffer_.Extract<InlineFtraceEvent>(id));
+      return;
     case TimestampedEvent::Type::kFtraceEvent:
       base::ignore_result(token_buffer_.Extract<TracePacketData>(id));
       return;
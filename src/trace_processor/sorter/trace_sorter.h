@@ -165,6 +165,16 @@ class TraceSorter {
     UpdateAppendMaxTs(queue);
   }
 
+  inline void PushInlineFtraceEvent(uint32_t cpu,
+                                    int64_t timestamp,
+                                    InlineFtraceEvent inline_ftrace_event) {
+    TraceTokenBuffer::Id id =
+        token_buffer_.Append(std::move(inline_ftrace_event));
+    auto* queue = GetQueue(cpu + 1);
+    queue->Append(timestamp, TimestampedEvent::Type::kInlineFtraceEvent, id);
+    UpdateAppendMaxTs(queue);
+  }
+
   void ExtractEventsForced() {
     BumpAllocator::AllocId end_id = token_buffer_.PastTheEndAllocId();
     SortAndExtractEventsUntilAllocId(end_id);
@@ -199,6 +209,7 @@ class TraceSorter {
       kTracePacket,
       kInlineSchedSwitch,
       kInlineSchedWaking,
+      kInlineFtraceEvent,
       kJsonValue,
       kFuchsiaRecord,
       kTrackEvent,
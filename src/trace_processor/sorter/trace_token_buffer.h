@@ -97,6 +97,12 @@ class TraceTokenBuffer {
   // allocator. The amount of memory free is implementation defined.
   void FreeMemory();
 
+  // Backs the tokens with a temporary file once they use more than
+  // |max_resident_bytes| of memory. See BumpAllocator::EnableSpilling.
+  void EnableSpilling(uint64_t max_resident_bytes) {
+    allocator_.EnableSpilling(max_resident_bytes);
+  }
+
  private:
   struct BlobWithOffset {
     TraceBlob* blob;
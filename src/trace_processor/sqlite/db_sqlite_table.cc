@@ -15,6 +15,9 @@
  */
 
 #include "src/trace_processor/sqlite/db_sqlite_table.h"
+
+#include <algorithm>
+#include <memory>
 #include <optional>
 
 #include "perfetto/base/status.h"
@@ -184,6 +187,7 @@ SqliteTable::Schema DbSqliteTable::ComputeSchema(const Table::Schema& schema,
 }
 
 int DbSqliteTable::BestIndex(const QueryConstraints& qc, BestIndexInfo* info) {
+  UpdateIndexedColumns();
   switch (context_->computation) {
     case TableComputation::kStatic:
       BestIndex(schema_, context_->static_table->row_count(), qc, info);
@@ -223,10 +227,30 @@ void DbSqliteTable::BestIndex(const Table::Schema& schema,
 }
 
 base::Status DbSqliteTable::ModifyConstraints(QueryConstraints* qc) {
+  UpdateIndexedColumns();
   ModifyConstraints(schema_, qc);
   return base::OkStatus();
 }
 
+void DbSqliteTable::UpdateIndexedColumns() {
+  const Table* table = nullptr;
+  switch (context_->computation) {
+    case TableComputation::kStatic:
+      table = context_->static_table;
+      break;
+    case TableComputation::kRuntime:
+      table = runtime_table_;
+      break;
+    case TableComputation::kTableFunction:
+      // Tables returned by table functions are recomputed on every filter so
+      // they never have indexes.
+      return;
+  }
+  for (uint32_t i = 0; i < schema_.columns.size(); ++i) {
+    schema_.columns[i].is_indexed = table->HasIndex(i);
+  }
+}
+
 void DbSqliteTable::ModifyConstraints(const Table::Schema& schema,
                                       QueryConstraints* qc) {
   using C = QueryConstraints::Constraint;
@@ -255,6 +279,11 @@ void DbSqliteTable::ModifyConstraints(const Table::Schema& schema,
     if (a_col.is_sorted || b_col.is_sorted)
       return a_col.is_sorted && !b_col.is_sorted;
 
+    // Indexed columns can be filtered with a binary search as long as no other
+    // constraint was applied before so order them after sorted columns.
+    if (a_col.is_indexed || b_col.is_indexed)
+      return a_col.is_indexed && !b_col.is_indexed;
+
     // TODO(lalitm): introduce more orderings here based on empirical data.
     return false;
   });
@@ -332,24 +361,25 @@ DbSqliteTable::QueryCost DbSqliteTable::EstimateCost(
       // to sort by that column and then binary search if we see the constraint
       // set often. Model this by dividing by the log of the number of rows as
       // a good approximation. Otherwise, we'll need to do a full table scan.
-      // Alternatively, if the column is sorted, we can use the same binary
-      // search logic so we have the same low cost (even better because we don't
-      // have to sort at all).
-      filter_cost += cs.size() == 1 || col_schema.is_sorted
-                         ? log2(current_row_count)
-                         : current_row_count;
+      // Alternatively, if the column is sorted or has an index, we can use the
+      // same binary search logic so we have the same low cost (even better
+      // because we don't have to sort at all).
+      filter_cost +=
+          cs.size() == 1 || col_schema.is_sorted || col_schema.is_indexed
+              ? log2(current_row_count)
+              : current_row_count;
 
       // As an extremely rough heuristic, assume that an equalty constraint will
       // cut down the number of rows by approximately double log of the number
       // of rows.
       double estimated_rows = current_row_count / (2 * log2(current_row_count));
       current_row_count = std::max(static_cast<uint32_t>(estimated_rows), 1u);
-    } else if (col_schema.is_sorted &&
+    } else if ((col_schema.is_sorted || col_schema.is_indexed) &&
                (sqlite_utils::IsOpLe(c.op) || sqlite_utils::IsOpLt(c.op) ||
                 sqlite_utils::IsOpGt(c.op) || sqlite_utils::IsOpGe(c.op))) {
-      // On a sorted column, if we see any partition constraints, we can do this
-      // filter very efficiently. Model this using the log of the  number of
-      // rows as a good approximation.
+      // On a sorted or indexed column, if we see any partition constraints, we
+      // can do this filter very efficiently. Model this using the log of the
+      // number of rows as a good approximation.
       filter_cost += log2(current_row_count);
 
       // As an extremely rough heuristic, assume that an partition constraint
@@ -432,9 +462,10 @@ void DbSqliteTable::Cursor::TryCacheCreateSortedTable(
   if (!sqlite_utils::IsOpEq(c.op))
     return;
 
-  // If the column is already sorted, we don't need to cache at all.
+  // If the column is already sorted or indexed, we don't need to cache at all.
   uint32_t col = static_cast<uint32_t>(c.column);
-  if (upstream_table_->GetColumn(col).IsSorted())
+  if (upstream_table_->GetColumn(col).IsSorted() ||
+      upstream_table_->HasIndex(col))
     return;
 
   // Try again to get the result or start caching it.
@@ -444,6 +475,26 @@ void DbSqliteTable::Cursor::TryCacheCreateSortedTable(
       });
 }
 
+bool DbSqliteTable::Cursor::ShouldCacheResult() const {
+  // Table functions compute a new table for each query.
+  if (!cache_ || db_sqlite_table_->context_->computation ==
+                     TableComputation::kTableFunction) {
+    return false;
+  }
+
+  // Nothing to save if we don't need to filter or sort.
+  if (constraints_.empty() && orders_.empty())
+    return false;
+
+  // Equality constraints on the id column (e.g. in joins) are answered in
+  // constant time: looking them up would only add overhead.
+  return std::none_of(
+      constraints_.begin(), constraints_.end(), [this](const Constraint& c) {
+        return c.op == FilterOp::kEq &&
+               upstream_table_->GetColumn(c.col_idx).IsId();
+      });
+}
+
 base::Status DbSqliteTable::Cursor::Filter(const QueryConstraints& qc,
                                            sqlite3_value** argv,
                                            FilterHistory history) {
@@ -604,6 +655,19 @@ base::Status DbSqliteTable::Cursor::Filter(const QueryConstraints& qc,
         }
       });
 
+  // Repeated queries can be served directly from the cache.
+  bool should_cache_result = ShouldCacheResult();
+  if (should_cache_result) {
+    db_table_ =
+        cache_->GetResultIfCached(upstream_table_, constraints_, orders_);
+    if (db_table_) {
+      mode_ = Mode::kTable;
+      iterator_ = db_table_->IterateRows();
+      eof_ = !*iterator_;
+      return base::OkStatus();
+    }
+  }
+
   // Attempt to filter into a RowMap first - weall figure out whether to apply
   // this to the table or we should use the RowMap directly. Also, if we are
   // going to sort on the RowMap, it makes sense that we optimize for lookup
@@ -632,9 +696,14 @@ base::Status DbSqliteTable::Cursor::Filter(const QueryConstraints& qc,
   } else {
     mode_ = Mode::kTable;
 
-    db_table_ = SourceTable()->Apply(std::move(filter_map));
+    Table table = SourceTable()->Apply(std::move(filter_map));
     if (!orders_.empty())
-      db_table_ = db_table_->Sort(orders_);
+      table = table.Sort(orders_);
+
+    db_table_ = should_cache_result
+                    ? cache_->CacheResult(upstream_table_, constraints_,
+                                          orders_, std::move(table))
+                    : std::make_shared<Table>(std::move(table));
 
     iterator_ = db_table_->IterateRows();
 
@@ -98,6 +98,10 @@ class DbSqliteTable final
     // constraint set matches the requirements.
     void TryCacheCreateSortedTable(const QueryConstraints&, FilterHistory);
 
+    // Returns whether the result of the current query should be looked up in
+    // and added to |cache_|.
+    bool ShouldCacheResult() const;
+
     const Table* SourceTable() const {
       // Try and use the sorted cache table (if it exists) to speed up the
       // sorting. Otherwise, just use the original table.
@@ -119,8 +123,9 @@ class DbSqliteTable final
     // Only valid for Mode::kSingleRow.
     std::optional<uint32_t> single_row_;
 
-    // Only valid for Mode::kTable.
-    std::optional<Table> db_table_;
+    // Only valid for Mode::kTable. Shared with |cache_| if the result of the
+    // query is cached.
+    std::shared_ptr<Table> db_table_;
     std::optional<Table::Iterator> iterator_;
 
     bool eof_ = true;
@@ -169,6 +174,10 @@ class DbSqliteTable final
                                 const QueryConstraints& qc);
 
  private:
+  // Indexes can be created after |schema_| was computed: updates the
+  // |is_indexed| flags of the columns to match the table.
+  void UpdateIndexedColumns();
+
   Context* context_ = nullptr;
 
   // Only valid after Init has completed.
@@ -27,19 +27,24 @@ Table::Schema CreateSchema() {
   Table::Schema schema;
   schema.columns.push_back({"id", SqlValue::Type::kLong, true /* is_id */,
                             true /* is_sorted */, false /* is_hidden */,
-                            false /* is_set_id */});
+                            false /* is_set_id */,
+                            false /* is_indexed */});
   schema.columns.push_back({"type", SqlValue::Type::kLong, false /* is_id */,
                             false /* is_sorted */, false /* is_hidden */,
-                            false /* is_set_id */});
+                            false /* is_set_id */,
+                            false /* is_indexed */});
   schema.columns.push_back({"test1", SqlValue::Type::kLong, false /* is_id */,
                             true /* is_sorted */, false /* is_hidden */,
-                            false /* is_set_id */});
+                            false /* is_set_id */,
+                            false /* is_indexed */});
   schema.columns.push_back({"test2", SqlValue::Type::kLong, false /* is_id */,
                             false /* is_sorted */, false /* is_hidden */,
-                            false /* is_set_id */});
+                            false /* is_set_id */,
+                            false /* is_indexed */});
   schema.columns.push_back({"test3", SqlValue::Type::kLong, false /* is_id */,
                             false /* is_sorted */, false /* is_hidden */,
-                            false /* is_set_id */});
+                            false /* is_set_id */,
+                            false /* is_indexed */});
   return schema;
 }
 
@@ -123,6 +128,25 @@ TEST(DbSqliteTable, MultiSortedEqCheaperThanMultiUnsortedEq) {
   ASSERT_EQ(sorted_cost.rows, unsorted_cost.rows);
 }
 
+TEST(DbSqliteTable, MultiIndexedEqCheaperThanMultiUnindexedEq) {
+  auto schema = CreateSchema();
+  constexpr uint32_t kRowCount = 1234;
+
+  QueryConstraints qc;
+  qc.AddConstraint(3u, SQLITE_INDEX_CONSTRAINT_EQ, 0u);
+  qc.AddConstraint(4u, SQLITE_INDEX_CONSTRAINT_EQ, 0u);
+
+  auto unindexed_cost = DbSqliteTable::EstimateCost(schema, kRowCount, qc);
+
+  schema.columns[3].is_indexed = true;
+  auto indexed_cost = DbSqliteTable::EstimateCost(schema, kRowCount, qc);
+
+  // The number of rows should be the same but the cost of the query on the
+  // indexed column should be less.
+  ASSERT_LT(indexed_cost.cost, unindexed_cost.cost);
+  ASSERT_EQ(indexed_cost.rows, unindexed_cost.rows);
+}
+
 TEST(DbSqliteTable, EmptyTableCosting) {
   auto schema = CreateSchema();
 
@@ -0,0 +1,296 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/sqlite/query_cache.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <iterator>
+
+namespace perfetto {
+namespace trace_processor {
+
+namespace {
+
+uint64_t HashSortedTableKey(
+    const Table* source,
+    const std::vector<QueryConstraints::Constraint>& cs) {
+  base::Hasher h;
+  h.Update(false);
+  h.Update(reinterpret_cast<uintptr_t>(source));
+  for (const auto& c : cs) {
+    h.Update(c.column);
+    h.Update(c.op);
+  }
+  return h.digest();
+}
+
+uint64_t HashResultKey(const Table* source,
+                       const std::vector<Constraint>& cs,
+                       const std::vector<Order>& ob) {
+  base::Hasher h;
+  h.Update(true);
+  h.Update(reinterpret_cast<uintptr_t>(source));
+  for (const Constraint& c : cs) {
+    h.Update(c.col_idx);
+    h.Update(static_cast<int>(c.op));
+    h.Update(static_cast<int>(c.value.type));
+    switch (c.value.type) {
+      case SqlValue::kLong:
+        h.Update(c.value.long_value);
+        break;
+      case SqlValue::kDouble:
+        h.Update(c.value.double_value);
+        break;
+      case SqlValue::kString:
+        h.Update(c.value.string_value);
+        break;
+      case SqlValue::kNull:
+      case SqlValue::kBytes:
+        break;
+    }
+  }
+  for (const Order& o : ob) {
+    h.Update(o.col_idx);
+    h.Update(o.desc);
+  }
+  return h.digest();
+}
+
+// Byte values are not copied by the cache so queries using them are never
+// cached.
+bool HasBytesValue(const std::vector<Constraint>& cs) {
+  return std::any_of(cs.begin(), cs.end(), [](const Constraint& c) {
+    return c.value.type == SqlValue::kBytes;
+  });
+}
+
+// The cached tables share the column storage with their source table so only
+// the overlays (i.e. the rows selected by the query) have to be accounted for.
+size_t EstimateMemoryUsage(const Table& table) {
+  size_t size = sizeof(Table) + table.columns().size() * sizeof(Column);
+  for (const ColumnStorageOverlay& overlay : table.overlays()) {
+    const RowMap& rm = overlay.row_map();
+    if (const BitVector* bv = rm.GetIfBitVector()) {
+      size += bv->size() / 8;
+    } else if (const std::vector<uint32_t>* iv = rm.GetIfIndexVector()) {
+      size += iv->size() * sizeof(uint32_t);
+    }
+  }
+  return size;
+}
+
+}  // namespace
+
+QueryCache::QueryCache(size_t max_memory_bytes)
+    : max_memory_bytes_(max_memory_bytes) {}
+
+QueryCache::~QueryCache() = default;
+
+std::shared_ptr<Table> QueryCache::GetIfCached(
+    const Table* source,
+    const std::vector<Constraint>& cs) {
+  Entry* entry = Find(HashSortedTableKey(source, cs));
+  if (!entry || !IsSortedTableKey(*entry, source, cs))
+    return nullptr;
+  return entry->table;
+}
+
+std::shared_ptr<Table> QueryCache::GetOrCache(
+    const Table* source,
+    const std::vector<Constraint>& cs,
+    std::function<Table()> fn) {
+  std::shared_ptr<Table> cached = GetIfCached(source, cs);
+  if (cached)
+    return cached;
+
+  Entry entry;
+  entry.kind = Kind::kSortedTable;
+  entry.source = source;
+  entry.hash = HashSortedTableKey(source, cs);
+  entry.constraints.reserve(cs.size());
+  for (const Constraint& c : cs) {
+    entry.constraints.push_back(KeyConstraint{static_cast<uint32_t>(c.column),
+                                              c.op, SqlValue::kNull, 0, 0, {}});
+  }
+  return Insert(std::move(entry), fn());
+}
+
+std::shared_ptr<Table> QueryCache::GetResultIfCached(
+    const Table* source,
+    const std::vector<trace_processor::Constraint>& cs,
+    const std::vector<Order>& ob) {
+  if (HasBytesValue(cs))
+    return nullptr;
+
+  Entry* entry = Find(HashResultKey(source, cs, ob));
+  if (!entry || !IsResultKey(*entry, source, cs, ob)) {
+    stats_.misses++;
+    return nullptr;
+  }
+  stats_.hits++;
+  return entry->table;
+}
+
+std::shared_ptr<Table> QueryCache::CacheResult(
+    const Table* source,
+    const std::vector<trace_processor::Constraint>& cs,
+    const std::vector<Order>& ob,
+    Table result) {
+  if (HasBytesValue(cs))
+    return std::make_shared<Table>(std::move(result));
+
+  Entry entry;
+  entry.kind = Kind::kResult;
+  entry.source = source;
+  entry.hash = HashResultKey(source, cs, ob);
+  entry.constraints.reserve(cs.size());
+  for (const trace_processor::Constraint& c : cs) {
+    KeyConstraint kc{c.col_idx, static_cast<int>(c.op), c.value.type, 0, 0, {}};
+    switch (c.value.type) {
+      case SqlValue::kLong:
+        kc.long_value = c.value.long_value;
+        break;
+      case SqlValue::kDouble:
+        kc.double_value = c.value.double_value;
+        break;
+      case SqlValue::kString:
+        kc.string_value = c.value.string_value;
+        break;
+      case SqlValue::kNull:
+      case SqlValue::kBytes:
+        break;
+    }
+    entry.constraints.push_back(std::move(kc));
+  }
+  entry.orders = ob;
+  return Insert(std::move(entry), std::move(result));
+}
+
+void QueryCache::InvalidateTable(const Table* source) {
+  for (auto it = lru_.begin(); it != lru_.end();) {
+    auto next = std::next(it);
+    if (it->source == source)
+      Erase(it);
+    it = next;
+  }
+}
+
+bool QueryCache::IsSortedTableKey(const Entry& entry,
+                                  const Table* source,
+                                  const std::vector<Constraint>& cs) {
+  if (entry.kind != Kind::kSortedTable || entry.source != source ||
+      entry.constraints.size() != cs.size()) {
+    return false;
+  }
+  for (uint32_t i = 0; i < cs.size(); ++i) {
+    const KeyConstraint& kc = entry.constraints[i];
+    if (kc.column != static_cast<uint32_t>(cs[i].column) || kc.op != cs[i].op)
+      return false;
+  }
+  return true;
+}
+
+bool QueryCache::IsResultKey(const Entry& entry,
+                             const Table* source,
+                             const std::vector<trace_processor::Constraint>& cs,
+                             const std::vector<Order>& ob) {
+  if (entry.kind != Kind::kResult || entry.source != source ||
+      entry.constraints.size() != cs.size() ||
+      entry.orders.size() != ob.size()) {
+    return false;
+  }
+  for (uint32_t i = 0; i < cs.size(); ++i) {
+    const KeyConstraint& kc = entry.constraints[i];
+    const trace_processor::Constraint& c = cs[i];
+    if (kc.column != c.col_idx || kc.op != static_cast<int>(c.op) ||
+        kc.type != c.value.type) {
+      return false;
+    }
+    switch (c.value.type) {
+      case SqlValue::kLong:
+        if (kc.long_value != c.value.long_value)
+          return false;
+        break;
+      case SqlValue::kDouble:
+        if (kc.double_value != c.value.double_value)
+          return false;
+        break;
+      case SqlValue::kString:
+        if (strcmp(kc.string_value.c_str(), c.value.string_value) != 0)
+          return false;
+        break;
+      case SqlValue::kNull:
+      case SqlValue::kBytes:
+        break;
+    }
+  }
+  for (uint32_t i = 0; i < ob.size(); ++i) {
+    if (entry.orders[i].col_idx != ob[i].col_idx ||
+        entry.orders[i].desc != ob[i].desc) {
+      return false;
+    }
+  }
+  return true;
+}
+
+QueryCache::Entry* QueryCache::Find(uint64_t hash) {
+  EntryList::iterator* it = entries_.Find(hash);
+  if (!it)
+    return nullptr;
+
+  // The source table changed since the entry was computed.
+  if ((*it)->source->GetMutationCount() != (*it)->source_mutation_count) {
+    Erase(*it);
+    return nullptr;
+  }
+  lru_.splice(lru_.begin(), lru_, *it);
+  return &lru_.front();
+}
+
+std::shared_ptr<Table> QueryCache::Insert(Entry entry, Table table) {
+  // Replace any entry with the same hash: this is either a stale version of
+  // this entry or a (rare) collision.
+  if (EntryList::iterator* it = entries_.Find(entry.hash); it)
+    Erase(*it);
+
+  entry.source_mutation_count = entry.source->GetMutationCount();
+  entry.table = std::make_shared<Table>(std::move(table));
+  entry.memory_usage = EstimateMemoryUsage(*entry.table);
+  memory_usage_ += entry.memory_usage;
+
+  uint64_t hash = entry.hash;
+  lru_.push_front(std::move(entry));
+  entries_.Insert(hash, lru_.begin());
+
+  // Always keep the newest entry, even if it is larger than the limit by
+  // itself.
+  while (memory_usage_ > max_memory_bytes_ && lru_.size() > 1) {
+    Erase(std::prev(lru_.end()));
+    stats_.evictions++;
+  }
+  return lru_.front().table;
+}
+
+void QueryCache::Erase(EntryList::iterator it) {
+  memory_usage_ -= it->memory_usage;
+  entries_.Erase(it->hash);
+  lru_.erase(it);
+}
+
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -17,62 +17,153 @@
 #ifndef SRC_TRACE_PROCESSOR_SQLITE_QUERY_CACHE_H_
 #define SRC_TRACE_PROCESSOR_SQLITE_QUERY_CACHE_H_
 
-#include <optional>
+#include <stddef.h>
+#include <stdint.h>
 
+#include <functional>
+#include <list>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "perfetto/ext/base/flat_hash_map.h"
+#include "perfetto/ext/base/hash.h"
 #include "src/trace_processor/db/table.h"
 #include "src/trace_processor/sqlite/query_constraints.h"
 
 namespace perfetto {
 namespace trace_processor {
 
-// Implements a simple caching strategy for commonly executed queries.
-// TODO(lalitm): the design of this class is very experimental. It was mainly
-// introduced to solve a specific problem (slow process summary tracks in the
-// Perfetto UI) and should not be modified without a full design discussion.
+// Implements a caching strategy for commonly executed queries.
+//
+// Two kinds of tables are cached:
+//  * copies of a table sorted on a column, used to speed up repeated equality
+//    constraints on that column (e.g. in joins). These are keyed on the source
+//    table and the set of (column, op) pairs of the constraints.
+//  * results of queries, keyed on the source table, the constraints (including
+//    their values) and the order by. These allow repeated queries (e.g. the
+//    queries for the tracks in the UI) to skip filtering and sorting.
+//
+// Entries are evicted in least recently used order once the memory used by
+// the cached tables goes over a limit and are dropped whenever the source
+// table is mutated.
 class QueryCache {
  public:
   using Constraint = QueryConstraints::Constraint;
 
-  // Returns a cached table if the passed query set are currenly cached or
-  // nullptr otherwise.
+  struct Stats {
+    // Number of query results found in the cache.
+    uint64_t hits = 0;
+
+    // Number of query results which had to be computed.
+    uint64_t misses = 0;
+
+    // Number of tables removed from the cache to stay under the memory limit.
+    uint64_t evictions = 0;
+  };
+
+  static constexpr size_t kDefaultMaxMemoryBytes = 128 * 1024 * 1024;
+
+  explicit QueryCache(size_t max_memory_bytes = kDefaultMaxMemoryBytes);
+  ~QueryCache();
+
+  // Returns a cached sorted table for the passed query set if it is currently
+  // cached or nullptr otherwise.
   std::shared_ptr<Table> GetIfCached(const Table* source,
-                                     const std::vector<Constraint>& cs) const {
-    if (cached_.source != source || cs.size() != cached_.constraints.size())
-      return nullptr;
-
-    auto p = [](const Constraint& a, const Constraint& b) {
-      return a.column == b.column && a.op == b.op;
-    };
-    bool same_cs =
-        std::equal(cs.begin(), cs.end(), cached_.constraints.begin(), p);
-    return same_cs ? cached_.table : nullptr;
-  }
-
-  // Caches the table with the given source, constraint and order set. Returns
-  // a pointer to the newly cached table.
-  std::shared_ptr<Table> GetOrCache(
+                                     const std::vector<Constraint>& cs);
+
+  // Caches the sorted table computed by |fn| for the given source and
+  // constraint set. Returns a pointer to the newly cached table.
+  std::shared_ptr<Table> GetOrCache(const Table* source,
+                                    const std::vector<Constraint>& cs,
+                                    std::function<Table()> fn);
+
+  // Returns the cached result of filtering |source| with |cs| and sorting it
+  // with |ob| or nullptr if there is no such result in the cache.
+  std::shared_ptr<Table> GetResultIfCached(
+      const Table* source,
+      const std::vector<trace_processor::Constraint>& cs,
+      const std::vector<Order>& ob);
+
+  // Caches |result| as the result of filtering |source| with |cs| and sorting
+  // it with |ob|. Returns a pointer to the cached table.
+  std::shared_ptr<Table> CacheResult(
       const Table* source,
-      const std::vector<QueryConstraints::Constraint>& cs,
-      std::function<Table()> fn) {
-    std::shared_ptr<Table> cached = GetIfCached(source, cs);
-    if (cached)
-      return cached;
-
-    cached_.source = source;
-    cached_.constraints = cs;
-    cached_.table.reset(new Table(fn()));
-    return cached_.table;
-  }
+      const std::vector<trace_processor::Constraint>& cs,
+      const std::vector<Order>& ob,
+      Table result);
+
+  // Removes all the tables computed from |source|. Has to be called before
+  // |source| is destroyed.
+  void InvalidateTable(const Table* source);
+
+  const Stats& stats() const { return stats_; }
+
+  // Approximate number of bytes used by the cached tables.
+  size_t memory_usage() const { return memory_usage_; }
 
  private:
-  struct CachedTable {
+  enum class Kind {
+    kSortedTable,
+    kResult,
+  };
+
+  // Copy of a constraint which owns its value.
+  struct KeyConstraint {
+    uint32_t column;
+    int op;
+    SqlValue::Type type;
+    int64_t long_value;
+    double double_value;
+    std::string string_value;
+  };
+
+  struct Entry {
+    Kind kind;
+    const Table* source;
+    std::vector<KeyConstraint> constraints;
+    std::vector<Order> orders;
+
+    uint64_t hash;
     std::shared_ptr<Table> table;
+    size_t memory_usage;
 
-    const Table* source = nullptr;
-    std::vector<Constraint> constraints;
+    // Value of |source->GetMutationCount()| when |table| was computed.
+    uint64_t source_mutation_count;
   };
+  using EntryList = std::list<Entry>;
+
+  static bool IsSortedTableKey(const Entry&,
+                               const Table* source,
+                               const std::vector<Constraint>& cs);
+  static bool IsResultKey(const Entry&,
+                          const Table* source,
+                          const std::vector<trace_processor::Constraint>& cs,
+                          const std::vector<Order>& ob);
+
+  // Returns the up to date entry with the passed hash, moving it to the front
+  // of the LRU list, or nullptr if there is no such entry. The caller has to
+  // check that the key of the entry matches: different keys can have the same
+  // hash.
+  Entry* Find(uint64_t hash);
+
+  // Adds a new entry to the front of the LRU list and evicts the least
+  // recently used ones if we go over the memory limit.
+  std::shared_ptr<Table> Insert(Entry entry, Table table);
+
+  void Erase(EntryList::iterator it);
+
+  const size_t max_memory_bytes_;
+
+  // Most recently used entries are at the front.
+  EntryList lru_;
+  base::FlatHashMap<uint64_t,
+                    EntryList::iterator,
+                    base::AlreadyHashed<uint64_t>>
+      entries_;
 
-  CachedTable cached_;
+  size_t memory_usage_ = 0;
+  Stats stats_;
 };
 
 }  // namespace trace_processor
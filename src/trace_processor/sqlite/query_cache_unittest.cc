@@ -0,0 +1,162 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/sqlite/query_cache.h"
+
+#include "src/trace_processor/tables/counter_tables_py.h"
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+using CounterTable = tables::CounterTable;
+using TrackId = tables::CounterTrackTable::Id;
+
+class QueryCacheUnittest : public ::testing::Test {
+ protected:
+  QueryCacheUnittest() {
+    for (uint32_t i = 0; i < 10; ++i) {
+      table_.Insert({i, TrackId{i % 3}, static_cast<double>(i), std::nullopt});
+    }
+  }
+
+  std::vector<Constraint> TrackEq(uint32_t track_id) {
+    return {table_.track_id().eq(track_id)};
+  }
+
+  StringPool pool_;
+  CounterTable table_{&pool_};
+};
+
+TEST_F(QueryCacheUnittest, ResultHitAndMiss) {
+  QueryCache cache;
+  std::vector<Order> ob{table_.value().descending()};
+
+  ASSERT_EQ(cache.GetResultIfCached(&table_, TrackEq(1), ob), nullptr);
+  ASSERT_EQ(cache.stats().misses, 1u);
+
+  std::shared_ptr<Table> result = cache.CacheResult(
+      &table_, TrackEq(1), ob, table_.Filter(TrackEq(1)).Sort(ob));
+  ASSERT_EQ(result->row_count(), 3u);
+  ASSERT_EQ(cache.GetResultIfCached(&table_, TrackEq(1), ob), result);
+  ASSERT_EQ(cache.stats().hits, 1u);
+
+  // Different values, constraints or orders are different queries.
+  ASSERT_EQ(cache.GetResultIfCached(&table_, TrackEq(2), ob), nullptr);
+  ASSERT_EQ(cache.GetResultIfCached(&table_, TrackEq(1), {}), nullptr);
+  ASSERT_EQ(cache.GetResultIfCached(
+                &table_, {table_.track_id().ne(1)}, ob),
+            nullptr);
+  ASSERT_EQ(cache.stats().misses, 4u);
+  ASSERT_GT(cache.memory_usage(), 0u);
+}
+
+TEST_F(QueryCacheUnittest, StringValuesAreCopied) {
+  QueryCache cache;
+  std::string value = "foo";
+  std::vector<Constraint> cs{
+      Constraint{CounterTable::ColumnIndex::type, FilterOp::kEq,
+                 SqlValue::String(value.c_str())}};
+  std::shared_ptr<Table> result =
+      cache.CacheResult(&table_, cs, {}, table_.Copy());
+
+  value = "bar";
+  cs[0].value = SqlValue::String(value.c_str());
+  ASSERT_EQ(cache.GetResultIfCached(&table_, cs, {}), nullptr);
+
+  std::string other = "foo";
+  cs[0].value = SqlValue::String(other.c_str());
+  ASSERT_EQ(cache.GetResultIfCached(&table_, cs, {}), result);
+}
+
+TEST_F(QueryCacheUnittest, InvalidatedOnMutation) {
+  QueryCache cache;
+  cache.CacheResult(&table_, TrackEq(1), {}, table_.Filter(TrackEq(1)));
+  ASSERT_NE(cache.GetResultIfCached(&table_, TrackEq(1), {}), nullptr);
+
+  table_.mutable_value()->Set(0, 100);
+  ASSERT_EQ(cache.GetResultIfCached(&table_, TrackEq(1), {}), nullptr);
+
+  cache.CacheResult(&table_, TrackEq(1), {}, table_.Filter(TrackEq(1)));
+  table_.Insert({10, TrackId{1}, 10, std::nullopt});
+  ASSERT_EQ(cache.GetResultIfCached(&table_, TrackEq(1), {}), nullptr);
+  ASSERT_EQ(cache.memory_usage(), 0u);
+}
+
+TEST_F(QueryCacheUnittest, EvictsLeastRecentlyUsed) {
+  size_t entry_size;
+  {
+    QueryCache probe;
+    probe.CacheResult(&table_, TrackEq(0), {}, table_.Copy());
+    entry_size = probe.memory_usage();
+  }
+
+  // Room for two results.
+  QueryCache cache(2 * entry_size);
+  cache.CacheResult(&table_, TrackEq(0), {}, table_.Copy());
+  cache.CacheResult(&table_, TrackEq(1), {}, table_.Copy());
+  ASSERT_NE(cache.GetResultIfCached(&table_, TrackEq(0), {}), nullptr);
+
+  cache.CacheResult(&table_, TrackEq(2), {}, table_.Copy());
+  ASSERT_EQ(cache.stats().evictions, 1u);
+  ASSERT_EQ(cache.memory_usage(), 2 * entry_size);
+
+  ASSERT_NE(cache.GetResultIfCached(&table_, TrackEq(0), {}), nullptr);
+  ASSERT_EQ(cache.GetResultIfCached(&table_, TrackEq(1), {}), nullptr);
+  ASSERT_NE(cache.GetResultIfCached(&table_, TrackEq(2), {}), nullptr);
+}
+
+TEST_F(QueryCacheUnittest, NewestEntryKeptOverLimit) {
+  QueryCache cache(0);
+  cache.CacheResult(&table_, TrackEq(0), {}, table_.Copy());
+  cache.CacheResult(&table_, TrackEq(1), {}, table_.Copy());
+  ASSERT_EQ(cache.stats().evictions, 1u);
+  ASSERT_NE(cache.GetResultIfCached(&table_, TrackEq(1), {}), nullptr);
+}
+
+TEST_F(QueryCacheUnittest, InvalidateTable) {
+  QueryCache cache;
+  CounterTable other{&pool_};
+  cache.CacheResult(&table_, TrackEq(0), {}, table_.Copy());
+  cache.CacheResult(&other, TrackEq(0), {}, other.Copy());
+
+  cache.InvalidateTable(&table_);
+  ASSERT_EQ(cache.GetResultIfCached(&table_, TrackEq(0), {}), nullptr);
+  ASSERT_NE(cache.GetResultIfCached(&other, TrackEq(0), {}), nullptr);
+}
+
+TEST_F(QueryCacheUnittest, SortedTable) {
+  QueryCache cache;
+  QueryConstraints qc;
+  qc.AddConstraint(static_cast<int>(CounterTable::ColumnIndex::track_id),
+                   SQLITE_INDEX_CONSTRAINT_EQ, 0);
+
+  ASSERT_EQ(cache.GetIfCached(&table_, qc.constraints()), nullptr);
+  std::shared_ptr<Table> sorted =
+      cache.GetOrCache(&table_, qc.constraints(), [this]() {
+        return table_.Sort({table_.track_id().ascending()});
+      });
+  ASSERT_EQ(cache.GetIfCached(&table_, qc.constraints()), sorted);
+
+  // Sorted tables don't count as query results.
+  ASSERT_EQ(cache.stats().hits, 0u);
+  ASSERT_EQ(cache.stats().misses, 0u);
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
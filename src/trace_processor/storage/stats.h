@@ -137,6 +137,10 @@ namespace stats {
   F(traced_producers_seen,                kSingle,  kInfo,     kTrace,    ""), \
   F(traced_total_buffers,                 kSingle,  kInfo,     kTrace,    ""), \
   F(traced_tracing_sessions,              kSingle,  kInfo,     kTrace,    ""), \
+  F(traced_write_into_file_queue_full,    kSingle,  kInfo,     kTrace,         \
+       "The output file couldn't keep up with the rate of the trace data, so " \
+       "traced had to leave data in its buffers for longer. This can cause "   \
+       "data losses (see traced_buf_chunks_overwritten)."),                    \
   F(track_event_parser_errors,            kSingle,  kInfo,     kAnalysis, ""), \
   F(track_event_dropped_packets_outside_of_range_of_interest,                  \
                                           kSingle,  kInfo,     kAnalysis,      \
@@ -214,6 +218,10 @@ namespace stats {
        "The file to be parsed can't be opened. This can happend when "         \
        "the file name is not found or no permission to access the file"),      \
   F(compact_sched_has_parse_errors,       kSingle,  kError,    kTrace,    ""), \
+  F(compact_ftrace_event_unsupported,     kSingle,  kDataLoss, kTrace,         \
+      "Number of groups of ftrace events in the generic compact encoding "     \
+      "that were dropped, as trace processor can't parse their event type "   \
+      "in that encoding."),                                                    \
   F(misplaced_end_event,                  kSingle,  kDataLoss, kAnalysis, ""), \
   F(truncated_sys_write_duration,         kSingle,  kDataLoss,  kAnalysis,     \
       "Count of sys_write slices that have a truncated duration to resolve "   \
@@ -230,6 +238,10 @@ namespace stats {
   F(perf_guardrail_stop_ts,               kIndexed, kDataLoss, kTrace,    ""), \
   F(perf_samples_skipped,                 kSingle,  kInfo,     kTrace,    ""), \
   F(perf_samples_skipped_dataloss,        kSingle,  kDataLoss, kTrace,    ""), \
+  F(perf_unwinder_samples_unwound,        kIndexed, kInfo,     kTrace,    ""), \
+  F(perf_unwinder_max_queue_occupancy,    kIndexed, kInfo,     kTrace,    ""), \
+  F(perf_unwinder_elf_cache_hits,         kIndexed, kInfo,     kTrace,    ""), \
+  F(perf_unwinder_elf_cache_misses,       kIndexed, kInfo,     kTrace,    ""), \
   F(memory_snapshot_parser_failure,       kSingle,  kError,    kAnalysis, ""), \
   F(thread_time_in_state_out_of_order,    kSingle,  kError,    kAnalysis, ""), \
   F(thread_time_in_state_unknown_cpu_freq,                                     \
@@ -262,7 +274,22 @@ namespace stats {
                                           kSingle,  kInfo,     kAnalysis,      \
       "SurfaceFlinger transactions packet has unknown fields, which results "  \
       "in some arguments missing. You may need a newer version of trace "      \
-      "processor to parse them.")
+      "processor to parse them."),                                             \
+  F(perfetto_index_memory_bytes,          kSingle,  kInfo,     kAnalysis,      \
+      "Memory used, in bytes, by the indexes created with CREATE PERFETTO "    \
+      "INDEX. Updated after each query."),                                     \
+  F(query_cache_hits,                     kSingle,  kInfo,     kAnalysis,      \
+      "Number of queries on tables whose result was served by the query "      \
+      "cache. Updated after each query."),                                     \
+  F(query_cache_misses,                   kSingle,  kInfo,     kAnalysis,      \
+      "Number of queries on tables whose result was not in the query cache. "  \
+      "Updated after each query."),                                            \
+  F(query_cache_evictions,                kSingle,  kInfo,     kAnalysis,      \
+      "Number of tables evicted from the query cache to keep its memory "      \
+      "under the limit. Updated after each query."),                           \
+  F(query_cache_memory_bytes,             kSingle,  kInfo,     kAnalysis,      \
+      "Approximate memory used, in bytes, by the tables in the query cache. "  \
+      "Updated after each query.")
 // clang-format on
 
 enum Type {
@@ -326,6 +326,20 @@ class TraceStorage {
     arg_table_.ShrinkToFit();
   }
 
+  // Compresses the integer columns of the same tables as ShrinkToFitTables()
+  // where this saves enough memory. See ColumnStorage::Compress.
+  void CompressTables() {
+    thread_table_.Compress();
+    process_table_.Compress();
+    track_table_.Compress();
+    counter_table_.Compress();
+    slice_table_.Compress();
+    raw_table_.Compress();
+    sched_slice_table_.Compress();
+    thread_state_table_.Compress();
+    arg_table_.Compress();
+  }
+
   const tables::ThreadTable& thread_table() const { return thread_table_; }
   tables::ThreadTable* mutable_thread_table() { return &thread_table_; }
 
@@ -504,6 +518,9 @@ class TraceStorage {
 
   const StatsMap& stats() const { return stats_; }
 
+  // Overwrites all the stats with the ones of |other|.
+  void CopyStatsFrom(const TraceStorage& other) { stats_ = other.stats_; }
+
   const tables::MetadataTable& metadata_table() const {
     return metadata_table_;
   }
@@ -14,6 +14,9 @@
  * limitations under the License.
  */
 
+#include <thread>
+#include <vector>
+
 #include "src/trace_processor/db/column.h"
 #include "src/trace_processor/db/column_storage.h"
 #include "src/trace_processor/tables/py_tables_unittest_py.h"
@@ -101,6 +104,29 @@ TEST_F(PyTablesUnittest, ShrinkToFit) {
   // ensure it doesn't cause crashes.
 }
 
+TEST_F(PyTablesUnittest, Compress) {
+  for (uint32_t i = 0; i < 1000; ++i) {
+    event_.Insert(TestEventTable::Row(1000000 + i * 10, i % 4));
+  }
+  event_.Compress();
+
+  ASSERT_NE(event_.ts().storage_base().compressed(), nullptr);
+  ASSERT_NE(event_.arg_set_id().storage_base().compressed(), nullptr);
+  ASSERT_EQ(event_.ts()[999], 1009990);
+  ASSERT_EQ(event_.arg_set_id()[998], 2u);
+
+  Table res = event_.Filter({event_.ts().ge(1005000)});
+  ASSERT_EQ(res.row_count(), 500u);
+  res = event_.Filter({event_.arg_set_id().eq(2)});
+  ASSERT_EQ(res.row_count(), 250u);
+
+  // Modifying the table decompresses the columns.
+  event_.Insert(TestEventTable::Row(1010000, 3));
+  ASSERT_EQ(event_.ts().storage_base().compressed(), nullptr);
+  ASSERT_EQ(event_.ts()[1000], 1010000);
+  ASSERT_EQ(event_.ts()[999], 1009990);
+}
+
 TEST_F(PyTablesUnittest, FindById) {
   auto id_and_row = event_.Insert(TestEventTable::Row(100, 0));
 
@@ -310,6 +336,71 @@ TEST_F(PyTablesUnittest, SetIdColumns) {
   }
 }
 
+TEST_F(PyTablesUnittest, ColumnIndex) {
+  event_.Insert(TestEventTable::Row(50, 7));
+  slice_.Insert(TestSliceTable::Row(100, 3, 30));
+  slice_.Insert(TestSliceTable::Row(200, 1, 10));
+  slice_.Insert(TestSliceTable::Row(300, 3, 20));
+  slice_.Insert(TestSliceTable::Row(400, 2, 10));
+
+  uint32_t dur_idx = static_cast<uint32_t>(TestSliceTable::ColumnIndex::dur);
+  uint32_t arg_set_id_idx =
+      static_cast<uint32_t>(TestSliceTable::ColumnIndex::arg_set_id);
+  ASSERT_TRUE(slice_.CreateIndex(dur_idx).ok());
+  ASSERT_TRUE(slice_.CreateIndex(arg_set_id_idx).ok());
+  ASSERT_TRUE(slice_.HasIndex(dur_idx));
+  ASSERT_GT(slice_.GetIndexesMemoryUsage(), 0u);
+
+  // Sorted columns don't need an index.
+  ASSERT_FALSE(
+      slice_
+          .CreateIndex(static_cast<uint32_t>(TestSliceTable::ColumnIndex::ts))
+          .ok());
+
+  RowMap rm = slice_.FilterToRowMap({slice_.dur().eq(10)});
+  ASSERT_THAT(rm.GetAllIndices(), testing::ElementsAre(1u, 3u));
+
+  rm = slice_.FilterToRowMap({slice_.arg_set_id().ge(2)});
+  ASSERT_THAT(rm.GetAllIndices(), testing::ElementsAre(0u, 2u, 3u));
+
+  rm = slice_.FilterToRowMap(
+      {slice_.ts().gt(150), slice_.dur().lt(30), slice_.arg_set_id().eq(3)});
+  ASSERT_THAT(rm.GetAllIndices(), testing::ElementsAre(2u));
+
+  // The index has to follow mutations of the table.
+  slice_.mutable_dur()->Set(0, 10);
+  slice_.Insert(TestSliceTable::Row(500, 4, 10));
+  rm = slice_.FilterToRowMap({slice_.dur().eq(10)});
+  ASSERT_THAT(rm.GetAllIndices(), testing::ElementsAre(0u, 1u, 3u, 4u));
+
+  slice_.DropIndex(dur_idx);
+  ASSERT_FALSE(slice_.HasIndex(dur_idx));
+  rm = slice_.FilterToRowMap({slice_.dur().eq(10)});
+  ASSERT_THAT(rm.GetAllIndices(), testing::ElementsAre(0u, 1u, 3u, 4u));
+}
+
+TEST_F(PyTablesUnittest, ColumnIndexConcurrentRebuild) {
+  for (uint32_t i = 0; i < 1000; ++i)
+    slice_.Insert(TestSliceTable::Row(i, i % 10, i % 20));
+
+  uint32_t dur_idx = static_cast<uint32_t>(TestSliceTable::ColumnIndex::dur);
+  ASSERT_TRUE(slice_.CreateIndex(dur_idx).ok());
+
+  // Makes the index stale: all the threads below race to rebuild it.
+  slice_.mutable_dur()->Set(0, 10);
+
+  std::vector<std::thread> threads;
+  std::vector<uint32_t> sizes(4);
+  for (uint32_t t = 0; t < sizes.size(); ++t) {
+    threads.emplace_back([this, &sizes, t] {
+      sizes[t] = slice_.FilterToRowMap({slice_.dur().eq(10)}).size();
+    });
+  }
+  for (std::thread& thread : threads)
+    thread.join();
+  ASSERT_THAT(sizes, testing::Each(51u));
+}
+
 }  // namespace
 }  // namespace tables
 }  // namespace trace_processor
@@ -20,6 +20,8 @@
 #include <optional>
 #include <random>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include "perfetto/base/logging.h"
 #include "perfetto/ext/base/scoped_file.h"
@@ -124,6 +126,10 @@ class TraceProcessorIntegrationTest : public ::testing::Test {
 
   size_t RestoreInitialTables() { return processor_->RestoreInitialTables(); }
 
+  std::unique_ptr<TraceProcessor> CreateQuerySession() {
+    return processor_->CreateQuerySession();
+  }
+
  private:
   std::unique_ptr<TraceProcessor> processor_;
 };
@@ -542,6 +548,116 @@ TEST_F(TraceProcessorIntegrationTest, ErrorMessageModule) {
 no such column: t)");
 }
 
+TEST_F(TraceProcessorIntegrationTest, QuerySessionNeedsEndOfFile) {
+  ASSERT_EQ(CreateQuerySession(), nullptr);
+}
+
+TEST_F(TraceProcessorIntegrationTest, QuerySessionsAreIsolated) {
+  ASSERT_TRUE(LoadTrace("android_sched_and_ps.pb").ok());
+  auto session_a = CreateQuerySession();
+  auto session_b = CreateQuerySession();
+  ASSERT_NE(session_a, nullptr);
+  ASSERT_NE(session_b, nullptr);
+
+  auto it = session_a->ExecuteQuery(
+      "CREATE PERFETTO TABLE foo AS "
+      "SELECT utid, COUNT(*) AS cnt FROM sched GROUP BY utid");
+  it.Next();
+  ASSERT_TRUE(it.Status().ok()) << it.Status().message();
+
+  it = session_a->ExecuteQuery("SELECT SUM(cnt) FROM foo");
+  ASSERT_TRUE(it.Next());
+  int64_t session_count = it.Get(0).long_value;
+  it = Query("SELECT COUNT(*) FROM sched");
+  ASSERT_TRUE(it.Next());
+  ASSERT_EQ(session_count, it.Get(0).long_value);
+
+  // Neither the other session nor the parent can see the table.
+  it = session_b->ExecuteQuery("SELECT * FROM foo");
+  ASSERT_FALSE(it.Next());
+  ASSERT_FALSE(it.Status().ok());
+  it = Query("SELECT * FROM foo");
+  ASSERT_FALSE(it.Next());
+  ASSERT_FALSE(it.Status().ok());
+
+  // Tables created by another session are not initial tables of a session.
+  ASSERT_EQ(session_b->RestoreInitialTables(), 0u);
+  ASSERT_EQ(session_a->RestoreInitialTables(), 1u);
+
+  // Sessions share the trace storage of the parent but can't parse.
+  ASSERT_FALSE(session_b->Parse(std::unique_ptr<uint8_t[]>(new uint8_t[1]), 1)
+                   .ok());
+  it = session_b->ExecuteQuery(
+      "SELECT COUNT(*) FROM process WHERE name IS NOT NULL");
+  ASSERT_TRUE(it.Next());
+  int64_t session_processes = it.Get(0).long_value;
+  ASSERT_GT(session_processes, 0);
+  it = Query("SELECT COUNT(*) FROM process WHERE name IS NOT NULL");
+  ASSERT_TRUE(it.Next());
+  ASSERT_EQ(session_processes, it.Get(0).long_value);
+}
+
+TEST_F(TraceProcessorIntegrationTest, QuerySessionsInheritModules) {
+  SqlModule module;
+  module.name = "foo";
+  module.files.push_back(
+      std::make_pair("foo.bar", "CREATE TABLE bar AS SELECT 42 AS x"));
+  ASSERT_TRUE(Processor()->RegisterSqlModule(module).ok());
+  ASSERT_TRUE(LoadTrace("android_sched_and_ps.pb").ok());
+
+  auto session = CreateQuerySession();
+  auto it =
+      session->ExecuteQuery("SELECT IMPORT('foo.bar'); SELECT x FROM bar");
+  ASSERT_TRUE(it.Next()) << it.Status().message();
+  ASSERT_EQ(it.Get(0).long_value, 42);
+}
+
+TEST_F(TraceProcessorIntegrationTest, QuerySessionsRunConcurrently) {
+  ASSERT_TRUE(LoadTrace("android_sched_and_ps.pb").ok());
+
+  constexpr size_t kNumSessions = 4;
+  std::vector<std::unique_ptr<TraceProcessor>> sessions;
+  for (size_t i = 0; i < kNumSessions; ++i)
+    sessions.emplace_back(CreateQuerySession());
+
+  std::vector<int64_t> results(kNumSessions);
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < kNumSessions; ++i) {
+    threads.emplace_back([&sessions, &results, i] {
+      TraceProcessor* session = sessions[i].get();
+      auto it = session->ExecuteQuery(
+          "CREATE PERFETTO TABLE per_thread AS "
+          "SELECT utid, SUM(dur) AS total_dur FROM sched "
+          "WHERE dur != 0 AND utid != 0 GROUP BY utid");
+      it.Next();
+      if (!it.Status().ok())
+        return;
+      it = session->ExecuteQuery(
+          "SELECT COUNT(*) FROM per_thread JOIN thread USING (utid) "
+          "WHERE thread.name IS NOT NULL");
+      if (it.Next())
+        results[i] = it.Get(0).long_value;
+    });
+  }
+  for (auto& thread : threads)
+    thread.join();
+
+  auto it = Query(
+      "SELECT COUNT(DISTINCT utid) FROM sched JOIN thread USING (utid) "
+      "WHERE dur != 0 AND utid != 0 AND thread.name IS NOT NULL");
+  ASSERT_TRUE(it.Next());
+  for (int64_t result : results)
+    ASSERT_EQ(result, it.Get(0).long_value);
+}
+
+TEST_F(TraceProcessorIntegrationTest, QuerySessionsHaveNoHeapGraphFlamegraph) {
+  ASSERT_TRUE(LoadTrace("android_sched_and_ps.pb").ok());
+  auto session = CreateQuerySession();
+  auto it = session->ExecuteQuery("SELECT * FROM experimental_flamegraph");
+  ASSERT_FALSE(it.Next());
+  ASSERT_THAT(it.Status().message(), testing::HasSubstr("no such table"));
+}
+
 }  // namespace
 }  // namespace trace_processor
 }  // namespace perfetto
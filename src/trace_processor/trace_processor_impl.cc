@@ -84,6 +84,7 @@
 #include "src/trace_processor/sqlite/sqlite_table.h"
 #include "src/trace_processor/sqlite/sqlite_utils.h"
 #include "src/trace_processor/sqlite/stats_table.h"
+#include "src/trace_processor/storage/stats.h"
 #include "src/trace_processor/tp_metatrace.h"
 #include "src/trace_processor/types/variadic.h"
 #include "src/trace_processor/util/protozero_to_json.h"
@@ -364,44 +365,59 @@ void TraceProcessorImpl::RegisterView(const View& view) {
 }
 
 TraceProcessorImpl::TraceProcessorImpl(const Config& cfg)
+    : TraceProcessorImpl(cfg, nullptr) {}
+
+TraceProcessorImpl::TraceProcessorImpl(const Config& cfg,
+                                       TraceProcessorImpl* parent)
     : TraceProcessorStorageImpl(cfg),
+      config_(cfg),
+      parent_(parent),
       engine_(context_.storage->mutable_string_pool()) {
-  context_.fuchsia_trace_tokenizer.reset(new FuchsiaTraceTokenizer(&context_));
-  context_.fuchsia_trace_parser.reset(new FuchsiaTraceParser(&context_));
-
-  context_.ninja_log_parser.reset(new NinjaLogParser(&context_));
-
-  context_.systrace_trace_parser.reset(new SystraceTraceParser(&context_));
-
-  if (util::IsGzipSupported()) {
-    context_.gzip_trace_parser.reset(new GzipTraceParser(&context_));
-    context_.android_bugreport_parser.reset(
-        new AndroidBugreportParser(&context_));
-  }
-
-  if (json::IsJsonSupported()) {
-    context_.json_trace_tokenizer.reset(new JsonTraceTokenizer(&context_));
-    context_.json_trace_parser.reset(new JsonTraceParser(&context_));
-  }
-
-  if (context_.config.analyze_trace_proto_content) {
-    context_.content_analyzer.reset(new ProtoContentAnalyzer(&context_));
-  }
+  if (parent_) {
+    // Query sessions never parse any data: only keep the storage, which holds
+    // the strings interned by the session (e.g. in CREATE PERFETTO TABLE) and
+    // the stats of its queries.
+    TraceProcessorStorageImpl::DestroyContext();
+
+    // The clock converter lazily caches the clock snapshots of the trace so
+    // cannot be shared between sessions running on different threads.
+    context_.clock_converter.reset(new ClockConverter(&parent_->context_));
+  } else {
+    InitializeParsers();
+
+    // These flags are global: they are only set by the instance loading the
+    // trace to avoid racing with queries running in other sessions.
+    auto v2 = context_.config.dev_flags.find("enable_db2_filtering");
+    if (v2 != context_.config.dev_flags.end()) {
+      if (v2->second == "true") {
+        Table::kUseFilterV2 = true;
+      } else if (v2->second == "false") {
+        Table::kUseFilterV2 = false;
+      } else {
+        PERFETTO_ELOG("Unknown value for enable_db2_filtering %s",
+                      v2->second.c_str());
+      }
+    }
 
-  auto v2 = context_.config.dev_flags.find("enable_db2_filtering");
-  if (v2 != context_.config.dev_flags.end()) {
-    if (v2->second == "true") {
-      Table::kUseFilterV2 = true;
-    } else if (v2->second == "false") {
-      Table::kUseFilterV2 = false;
-    } else {
-      PERFETTO_ELOG("Unknown value for enable_db2_filtering %s",
-                    v2->second.c_str());
+    auto sort_v2 = context_.config.dev_flags.find("enable_db2_sorting");
+    if (sort_v2 != context_.config.dev_flags.end()) {
+      if (sort_v2->second == "true") {
+        Table::kUseSortV2 = true;
+      } else if (sort_v2->second == "false") {
+        Table::kUseSortV2 = false;
+      } else {
+        PERFETTO_ELOG("Unknown value for enable_db2_sorting %s",
+                      sort_v2->second.c_str());
+      }
     }
   }
 
+  // The context owning the trace storage this instance runs queries on. For
+  // query sessions this is the one of the parent, which is immutable at this
+  // point.
+  TraceProcessorContext* context = parent_ ? &parent_->context_ : &context_;
+
   sqlite3_str_split_init(engine_.sqlite_engine()->db());
-  RegisterAdditionalModules(&context_);
 
   // New style function registration.
   if (cfg.enable_dev_features) {
@@ -413,9 +429,9 @@ TraceProcessorImpl::TraceProcessorImpl(const Config& cfg)
   RegisterFunction<Demangle>(&engine_, "DEMANGLE", 1);
   RegisterFunction<SourceGeq>(&engine_, "SOURCE_GEQ", -1);
   RegisterFunction<ExportJson>(&engine_, "EXPORT_JSON", 1,
-                               context_.storage.get(), false);
+                               context->storage.get(), false);
   RegisterFunction<ExtractArg>(&engine_, "EXTRACT_ARG", 2,
-                               context_.storage.get());
+                               context->storage.get());
   RegisterFunction<AbsTimeStr>(&engine_, "ABS_TIME_STR", 1,
                                context_.clock_converter.get());
   RegisterFunction<Reverse>(&engine_, "REVERSE", 1);
@@ -433,7 +449,7 @@ TraceProcessorImpl::TraceProcessorImpl(const Config& cfg)
   RegisterFunction<ToFtrace>(
       &engine_, "TO_FTRACE", 1,
       std::unique_ptr<ToFtrace::Context>(new ToFtrace::Context{
-          context_.storage.get(), SystraceSerializer(&context_)}));
+          context->storage.get(), SystraceSerializer(context)}));
 
   if constexpr (regex::IsRegexSupported()) {
     RegisterFunction<Regex>(&engine_, "regexp", 2);
@@ -444,19 +460,19 @@ TraceProcessorImpl::TraceProcessorImpl(const Config& cfg)
   RegisterLastNonNullFunction(engine_.sqlite_engine()->db());
   RegisterValueAtMaxTsFunction(engine_.sqlite_engine()->db());
   {
-    base::Status status = RegisterStackFunctions(&engine_, &context_);
+    base::Status status = RegisterStackFunctions(&engine_, context);
     if (!status.ok())
       PERFETTO_ELOG("%s", status.c_message());
   }
   {
     base::Status status =
-        PprofFunctions::Register(engine_.sqlite_engine()->db(), &context_);
+        PprofFunctions::Register(engine_.sqlite_engine()->db(), context);
     if (!status.ok())
       PERFETTO_ELOG("%s", status.c_message());
   }
   {
     base::Status status =
-        LayoutFunctions::Register(engine_.sqlite_engine()->db(), &context_);
+        LayoutFunctions::Register(engine_.sqlite_engine()->db(), context);
     if (!status.ok())
       PERFETTO_ELOG("%s", status.c_message());
   }
@@ -466,7 +482,7 @@ TraceProcessorImpl::TraceProcessorImpl(const Config& cfg)
       PERFETTO_ELOG("%s", status.c_message());
   }
 
-  const TraceStorage* storage = context_.storage.get();
+  const TraceStorage* storage = context->storage.get();
 
   // Operator tables.
   engine_.sqlite_engine()->RegisterVirtualTableModule<SpanJoinOperatorTable>(
@@ -493,43 +509,51 @@ TraceProcessorImpl::TraceProcessorImpl(const Config& cfg)
 
   SetupMetrics(this, &engine_, &sql_metrics_, cfg.skip_builtin_metric_paths);
 
-  // Legacy tables.
+  // Legacy tables. These are always backed by the storage of this instance as
+  // they contain the stats of its queries.
   engine_.sqlite_engine()->RegisterVirtualTableModule<SqlStatsTable>(
-      "sqlstats", storage, SqliteTable::TableType::kEponymousOnly, false);
+      "sqlstats", context_.storage.get(),
+      SqliteTable::TableType::kEponymousOnly, false);
   engine_.sqlite_engine()->RegisterVirtualTableModule<StatsTable>(
-      "stats", storage, SqliteTable::TableType::kEponymousOnly, false);
+      "stats", context_.storage.get(), SqliteTable::TableType::kEponymousOnly,
+      false);
 
   // Tables dynamically generated at query time.
-  RegisterStaticTableFunction(std::unique_ptr<ExperimentalFlamegraph>(
-      new ExperimentalFlamegraph(&context_)));
+  // Building a heap graph flamegraph updates the root distances stored in the
+  // heap graph object table, so it cannot run concurrently with other queries
+  // and is not available in query sessions.
+  if (!parent_) {
+    RegisterStaticTableFunction(std::unique_ptr<ExperimentalFlamegraph>(
+        new ExperimentalFlamegraph(&context_)));
+  }
+  RegisterStaticTableFunction(
+      std::unique_ptr<ExperimentalSliceLayout>(new ExperimentalSliceLayout(
+          context->storage->mutable_string_pool(), &storage->slice_table())));
+  RegisterStaticTableFunction(std::unique_ptr<ExperimentalAnnotatedStack>(
+      new ExperimentalAnnotatedStack(context)));
+  RegisterStaticTableFunction(std::unique_ptr<ExperimentalFlatSlice>(
+      new ExperimentalFlatSlice(context)));
   RegisterStaticTableFunction(std::unique_ptr<ExperimentalCounterDur>(
       new ExperimentalCounterDur(storage->counter_table())));
-  RegisterStaticTableFunction(std::unique_ptr<ExperimentalSliceLayout>(
-      new ExperimentalSliceLayout(context_.storage.get()->mutable_string_pool(),
-                                  &storage->slice_table())));
   RegisterStaticTableFunction(std::unique_ptr<Ancestor>(
-      new Ancestor(Ancestor::Type::kSlice, context_.storage.get())));
+      new Ancestor(Ancestor::Type::kSlice, context->storage.get())));
   RegisterStaticTableFunction(std::unique_ptr<Ancestor>(new Ancestor(
-      Ancestor::Type::kStackProfileCallsite, context_.storage.get())));
+      Ancestor::Type::kStackProfileCallsite, context->storage.get())));
   RegisterStaticTableFunction(std::unique_ptr<Ancestor>(
-      new Ancestor(Ancestor::Type::kSliceByStack, context_.storage.get())));
+      new Ancestor(Ancestor::Type::kSliceByStack, context->storage.get())));
   RegisterStaticTableFunction(std::unique_ptr<Descendant>(
-      new Descendant(Descendant::Type::kSlice, context_.storage.get())));
+      new Descendant(Descendant::Type::kSlice, context->storage.get())));
   RegisterStaticTableFunction(std::unique_ptr<Descendant>(
-      new Descendant(Descendant::Type::kSliceByStack, context_.storage.get())));
+      new Descendant(Descendant::Type::kSliceByStack, context->storage.get())));
   RegisterStaticTableFunction(std::unique_ptr<ConnectedFlow>(new ConnectedFlow(
-      ConnectedFlow::Mode::kDirectlyConnectedFlow, context_.storage.get())));
+      ConnectedFlow::Mode::kDirectlyConnectedFlow, context->storage.get())));
   RegisterStaticTableFunction(std::unique_ptr<ConnectedFlow>(new ConnectedFlow(
-      ConnectedFlow::Mode::kPrecedingFlow, context_.storage.get())));
+      ConnectedFlow::Mode::kPrecedingFlow, context->storage.get())));
   RegisterStaticTableFunction(std::unique_ptr<ConnectedFlow>(new ConnectedFlow(
-      ConnectedFlow::Mode::kFollowingFlow, context_.storage.get())));
+      ConnectedFlow::Mode::kFollowingFlow, context->storage.get())));
   RegisterStaticTableFunction(
       std::unique_ptr<ExperimentalSchedUpid>(new ExperimentalSchedUpid(
           storage->sched_slice_table(), storage->thread_table())));
-  RegisterStaticTableFunction(std::unique_ptr<ExperimentalAnnotatedStack>(
-      new ExperimentalAnnotatedStack(&context_)));
-  RegisterStaticTableFunction(std::unique_ptr<ExperimentalFlatSlice>(
-      new ExperimentalFlatSlice(&context_)));
 
   // Views.
   RegisterView(storage->thread_slice_view());
@@ -617,11 +641,124 @@ TraceProcessorImpl::TraceProcessorImpl(const Config& cfg)
   RegisterStaticTable(storage->experimental_proto_content_table());
 
   RegisterStaticTable(storage->experimental_missing_chrome_processes_table());
+
+  // The builtin metric descriptors have been added above: only keep track of
+  // the ones added later by the embedder.
+  metric_proto_extensions_.clear();
+
+  if (parent_) {
+    engine_.set_static_tables_shared(true);
+    InitializeQuerySession();
+  }
+}
+
+void TraceProcessorImpl::InitializeParsers() {
+  context_.fuchsia_trace_tokenizer.reset(new FuchsiaTraceTokenizer(&context_));
+  context_.fuchsia_trace_parser.reset(new FuchsiaTraceParser(&context_));
+
+  context_.ninja_log_parser.reset(new NinjaLogParser(&context_));
+
+  context_.systrace_trace_parser.reset(new SystraceTraceParser(&context_));
+
+  if (util::IsGzipSupported()) {
+    context_.gzip_trace_parser.reset(new GzipTraceParser(&context_));
+    context_.android_bugreport_parser.reset(
+        new AndroidBugreportParser(&context_));
+  }
+
+  if (json::IsJsonSupported()) {
+    context_.json_trace_tokenizer.reset(new JsonTraceTokenizer(&context_));
+    context_.json_trace_parser.reset(new JsonTraceParser(&context_));
+  }
+
+  if (context_.config.analyze_trace_proto_content) {
+    context_.content_analyzer.reset(new ProtoContentAnalyzer(&context_));
+  }
+
+  RegisterAdditionalModules(&context_);
+}
+
+TraceProcessorImpl::~TraceProcessorImpl() {
+  if (!parent_)
+    return;
+
+  // The whole pool can only be iterated (e.g. to precompute glob and regex
+  // matches) outside of the concurrent interning mode: leave it as soon as
+  // the last session is gone.
+  std::lock_guard<std::mutex> lock(parent_->query_sessions_mutex_);
+  PERFETTO_DCHECK(parent_->query_session_count_ > 0);
+  if (--parent_->query_session_count_ == 0) {
+    parent_->context_.storage->mutable_string_pool()->SetConcurrentInterning(
+        false);
+  }
+}
+
+void TraceProcessorImpl::InitializeQuerySession() {
+  // Replay on the session what the embedder registered on the parent.
+  for (const auto& extension : parent_->metric_proto_extensions_) {
+    base::Status status = ExtendMetricsProto(
+        extension.first.data(), extension.first.size(), extension.second);
+    if (!status.ok())
+      PERFETTO_ELOG("%s", status.c_message());
+  }
+  for (const auto& metric : parent_->sql_metrics_) {
+    base::Status status = RegisterMetric(metric.path, metric.sql);
+    if (!status.ok())
+      PERFETTO_ELOG("%s", status.c_message());
+  }
+  for (auto it = parent_->sql_modules_.GetIterator(); it; ++it) {
+    // Modules have been validated when registered on the parent and might
+    // override the stdlib ones registered above: just copy them over.
+    sql_modules_.Erase(it.key());
+    sql_modules::RegisteredModule* module =
+        sql_modules_.Insert(it.key(), {}).first;
+    for (auto file = it.value().import_key_to_file.GetIterator(); file;
+         ++file) {
+      module->import_key_to_file.Insert(file.key(), {file.value().sql, false});
+    }
+  }
+
+  const TraceStorage& storage = *parent_->context_.storage;
+  context_.storage->CopyStatsFrom(storage);
+  BuildBoundsTable(engine_.sqlite_engine()->db(),
+                   storage.GetTraceTimestampBoundsNs());
+
+  current_trace_name_ = parent_->current_trace_name_;
+  bytes_parsed_ = parent_->bytes_parsed_;
+  notify_eof_called_ = true;
+
+  // The initial tables of a session are the ones it has been created with,
+  // not the ones of the parent (which might have created more in the
+  // meantime).
+  for (auto it = ExecuteQuery(kAllTablesQuery); it.Next();) {
+    auto value = it.Get(0);
+    PERFETTO_CHECK(value.type == SqlValue::Type::kString);
+    initial_tables_.push_back(value.string_value);
+  }
 }
 
-TraceProcessorImpl::~TraceProcessorImpl() = default;
+std::unique_ptr<TraceProcessor> TraceProcessorImpl::CreateQuerySession() {
+  // Sessions created from a session are siblings of it.
+  if (parent_)
+    return parent_->CreateQuerySession();
+  if (!notify_eof_called_) {
+    PERFETTO_ELOG("Query sessions can only be created after NotifyEndOfFile");
+    return nullptr;
+  }
+
+  // Once the trace is loaded, the storage is only modified by queries interning
+  // strings (e.g. in table functions), which sessions can do concurrently.
+  {
+    std::lock_guard<std::mutex> lock(query_sessions_mutex_);
+    if (query_session_count_++ == 0)
+      context_.storage->mutable_string_pool()->SetConcurrentInterning(true);
+  }
+  return std::unique_ptr<TraceProcessor>(new TraceProcessorImpl(config_, this));
+}
 
 base::Status TraceProcessorImpl::Parse(TraceBlobView blob) {
+  if (parent_)
+    return base::ErrStatus("Query sessions cannot parse traces");
   bytes_parsed_ += blob.size();
   return TraceProcessorStorageImpl::Parse(std::move(blob));
 }
@@ -638,6 +775,8 @@ void TraceProcessorImpl::SetCurrentTraceName(const std::string& name) {
 }
 
 void TraceProcessorImpl::Flush() {
+  if (parent_)
+    return;
   TraceProcessorStorageImpl::Flush();
 
   context_.metadata_tracker->SetMetadata(
@@ -680,6 +819,8 @@ void TraceProcessorImpl::NotifyEndOfFile() {
   }
 
   context_.storage->ShrinkToFitTables();
+  if (config_.compress_tables)
+    context_.storage->CompressTables();
 
   // Rebuild the bounds table once everything has been completed: we do this
   // so that if any data was added to tables in
@@ -731,14 +872,35 @@ Iterator TraceProcessorImpl::ExecuteQuery(const std::string& sql) {
       context_.storage->mutable_sql_stats()->RecordQueryBegin(
           sql, base::GetWallTimeNs().count());
   std::string non_breaking_sql = base::ReplaceAll(sql, "\u00A0", " ");
+
+  // Update the stats both before (so queries on the stats table see the effect
+  // of the previous queries) and after executing the query.
+  UpdateQueryEngineStats();
   base::StatusOr<PerfettoSqlEngine::ExecutionResult> result =
       engine_.ExecuteUntilLastStatement(
           SqlSource::FromExecuteQuery(std::move(non_breaking_sql)));
+  UpdateQueryEngineStats();
   std::unique_ptr<IteratorImpl> impl(
       new IteratorImpl(this, std::move(result), sql_stats_row));
   return Iterator(std::move(impl));
 }
 
+void TraceProcessorImpl::UpdateQueryEngineStats() {
+  TraceStorage* storage = context_.storage.get();
+  storage->SetStats(stats::perfetto_index_memory_bytes,
+                    static_cast<int64_t>(engine_.GetIndexesMemoryUsage()));
+
+  const QueryCache& cache = engine_.query_cache();
+  storage->SetStats(stats::query_cache_hits,
+                    static_cast<int64_t>(cache.stats().hits));
+  storage->SetStats(stats::query_cache_misses,
+                    static_cast<int64_t>(cache.stats().misses));
+  storage->SetStats(stats::query_cache_evictions,
+                    static_cast<int64_t>(cache.stats().evictions));
+  storage->SetStats(stats::query_cache_memory_bytes,
+                    static_cast<int64_t>(cache.memory_usage()));
+}
+
 void TraceProcessorImpl::InterruptQuery() {
   if (!engine_.sqlite_engine()->db())
     return;
@@ -847,6 +1009,8 @@ base::Status TraceProcessorImpl::ExtendMetricsProto(
       pool_.AddFromFileDescriptorSet(data, size, skip_prefixes);
   if (!status.ok())
     return status;
+  metric_proto_extensions_.emplace_back(std::vector<uint8_t>(data, data + size),
+                                        skip_prefixes);
 
   for (uint32_t i = 0; i < pool_.descriptors().size(); ++i) {
     // Convert the full name (e.g. .perfetto.protos.TraceMetrics.SubMetric)
@@ -22,7 +22,10 @@
 #include <atomic>
 #include <functional>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "perfetto/ext/base/flat_hash_map.h"
@@ -95,6 +98,8 @@ class TraceProcessorImpl : public TraceProcessor,
 
   size_t RestoreInitialTables() override;
 
+  std::unique_ptr<TraceProcessor> CreateQuerySession() override;
+
   std::string GetCurrentTraceName() override;
   void SetCurrentTraceName(const std::string&) override;
 
@@ -107,6 +112,17 @@ class TraceProcessorImpl : public TraceProcessor,
   // Needed for iterators to be able to access the context.
   friend class IteratorImpl;
 
+  // Creates a query session (see CreateQuerySession()) sharing the trace
+  // storage of |parent|, which must have reached the end of file.
+  TraceProcessorImpl(const Config&, TraceProcessorImpl* parent);
+
+  // Creates the tokenizers and parsers used to load traces.
+  void InitializeParsers();
+
+  // Copies the user registered SQL modules and metrics, the stats and the
+  // trace bounds of |parent_| into this session.
+  void InitializeQuerySession();
+
   template <typename Table>
   void RegisterStaticTable(const Table& table) {
     engine_.RegisterStaticTable(table, Table::Name());
@@ -121,6 +137,17 @@ class TraceProcessorImpl : public TraceProcessor,
 
   bool IsRootMetricField(const std::string& metric_name);
 
+  // Copies the state of the query engine (e.g. the query cache) into the stats
+  // table.
+  void UpdateQueryEngineStats();
+
+  // Kept around to create query sessions with the same config.
+  const Config config_;
+
+  // Non-null iff this instance is a query session. In this case the trace
+  // storage of |parent_| is queried instead of the one of this instance.
+  TraceProcessorImpl* const parent_ = nullptr;
+
   PerfettoSqlEngine engine_;
 
   DescriptorPool pool_;
@@ -130,6 +157,11 @@ class TraceProcessorImpl : public TraceProcessor,
   std::vector<metrics::SqlMetricFile> sql_metrics_;
   std::unordered_map<std::string, std::string> proto_field_to_sql_metric_path_;
 
+  // The arguments of the ExtendMetricsProto() calls made by the embedder, which
+  // are replayed on each query session.
+  std::vector<std::pair<std::vector<uint8_t>, std::vector<std::string>>>
+      metric_proto_extensions_;
+
   // This is atomic because it is set by the CTRL-C signal handler and we need
   // to prevent single-flow compiler optimizations in ExecuteQuery().
   std::atomic<bool> query_interrupted_{false};
@@ -145,6 +177,12 @@ class TraceProcessorImpl : public TraceProcessor,
   // NotifyEndOfFile should only be called once. Set to true whenever it is
   // called.
   bool notify_eof_called_ = false;
+
+  // The number of live query sessions of this instance. The string pool is in
+  // the concurrent interning mode iff this is non-zero. Sessions can be
+  // destroyed on any thread, hence the mutex.
+  std::mutex query_sessions_mutex_;
+  uint32_t query_session_count_ = 0;
 };
 
 }  // namespace trace_processor
@@ -0,0 +1,250 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <zlib.h>
+
+#include <benchmark/benchmark.h>
+
+#include <string>
+#include <vector>
+
+#include "perfetto/base/logging.h"
+#include "perfetto/protozero/packed_repeated_fields.h"
+#include "perfetto/protozero/scattered_heap_buffer.h"
+#include "perfetto/trace_processor/basic_types.h"
+#include "perfetto/trace_processor/trace_blob.h"
+#include "perfetto/trace_processor/trace_blob_view.h"
+#include "perfetto/trace_processor/trace_processor.h"
+
+#include "protos/perfetto/trace/ftrace/ftrace_event.pbzero.h"
+#include "protos/perfetto/trace/ftrace/ftrace_event_bundle.pbzero.h"
+#include "protos/perfetto/trace/ftrace/irq.pbzero.h"
+#include "protos/perfetto/trace/ftrace/power.pbzero.h"
+#include "protos/perfetto/trace/ftrace/sched.pbzero.h"
+#include "protos/perfetto/trace/trace.pbzero.h"
+#include "protos/perfetto/trace/trace_packet.pbzero.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+constexpr uint32_t kCpus = 8;
+constexpr uint32_t kEventsPerBundle = 256;
+
+bool IsBenchmarkFunctionalOnly() {
+  return getenv("BENCHMARK_FUNCTIONAL_TEST_ONLY") != nullptr;
+}
+
+std::string Deflate(const std::string& input) {
+  uLongf output_size = compressBound(static_cast<uLong>(input.size()));
+  std::string output(output_size, '\0');
+  int ret = compress(reinterpret_cast<Bytef*>(&output[0]), &output_size,
+                     reinterpret_cast<const Bytef*>(input.data()),
+                     static_cast<uLong>(input.size()));
+  PERFETTO_CHECK(ret == Z_OK);
+  output.resize(output_size);
+  return output;
+}
+
+// Builds a trace which looks like the output of traced with
+// compression_type = COMPRESSION_TYPE_DEFLATE: every top-level packet is a
+// |compressed_packets| batch containing one sched_switch bundle per CPU.
+std::vector<uint8_t> BuildCompressedSchedTrace(uint32_t batches) {
+  protozero::HeapBuffered<protos::pbzero::Trace> trace;
+  uint64_t ts = 1000;
+  for (uint32_t batch = 0; batch < batches; ++batch) {
+    protozero::HeapBuffered<protos::pbzero::Trace> inner;
+    for (uint32_t cpu = 0; cpu < kCpus; ++cpu) {
+      auto* bundle = inner->add_packet()->set_ftrace_events();
+      bundle->set_cpu(cpu);
+      for (uint32_t i = 0; i < kEventsPerBundle; ++i) {
+        auto* event = bundle->add_event();
+        event->set_timestamp(ts++);
+        event->set_pid(static_cast<uint32_t>(100 + i % 32));
+        auto* sched_switch = event->set_sched_switch();
+        sched_switch->set_prev_comm("prev_thread");
+        sched_switch->set_prev_pid(static_cast<int32_t>(100 + i % 32));
+        sched_switch->set_prev_prio(120);
+        sched_switch->set_prev_state(1);
+        sched_switch->set_next_comm("next_thread");
+        sched_switch->set_next_pid(static_cast<int32_t>(100 + (i + 1) % 32));
+        sched_switch->set_next_prio(120);
+      }
+    }
+    trace->add_packet()->set_compressed_packets(
+        Deflate(inner.SerializeAsString()));
+  }
+  return trace.SerializeAsArray();
+}
+
+// Builds a trace with |bundles| bundles per CPU of irq_handler_entry,
+// irq_handler_exit and cpu_frequency events, in the normal form or, if
+// |compact| is true, in the generic compact encoding
+// (CompactSched.event_columns), as traced_probes writes them.
+std::vector<uint8_t> BuildIrqTrace(uint32_t bundles, bool compact) {
+  using protos::pbzero::FtraceEvent;
+
+  constexpr uint32_t kEventTypes = 3;
+  const uint32_t kEventIds[kEventTypes] = {
+      FtraceEvent::kIrqHandlerEntryFieldNumber,
+      FtraceEvent::kIrqHandlerExitFieldNumber,
+      FtraceEvent::kCpuFrequencyFieldNumber};
+
+  protozero::HeapBuffered<protos::pbzero::Trace> trace;
+  uint64_t ts = 1000;
+  for (uint32_t bundle_idx = 0; bundle_idx < bundles; ++bundle_idx) {
+    for (uint32_t cpu = 0; cpu < kCpus; ++cpu) {
+      auto* bundle = trace->add_packet()->set_ftrace_events();
+      bundle->set_cpu(cpu);
+      if (!compact) {
+        for (uint32_t i = 0; i < kEventsPerBundle; ++i) {
+          auto* event = bundle->add_event();
+          event->set_timestamp(ts++);
+          event->set_pid(0);
+          uint32_t irq = i % 16;
+          switch (i % kEventTypes) {
+            case 0: {
+              auto* entry = event->set_irq_handler_entry();
+              entry->set_irq(static_cast<int32_t>(irq));
+              entry->set_name("arch_timer");
+              break;
+            }
+            case 1: {
+              auto* exit = event->set_irq_handler_exit();
+              exit->set_irq(static_cast<int32_t>(irq));
+              exit->set_ret(1);
+              break;
+            }
+            case 2: {
+              auto* freq = event->set_cpu_frequency();
+              freq->set_state(500000 + 100000 * irq);
+              freq->set_cpu_id(cpu);
+              break;
+            }
+          }
+        }
+        continue;
+      }
+
+      // One column per field of each event type, as in the normal form above.
+      auto* compact_sched = bundle->set_compact_sched();
+      protozero::PackedVarInt timestamps[kEventTypes];
+      protozero::PackedVarInt pids[kEventTypes];
+      protozero::PackedVarInt fields[kEventTypes][2];
+      uint64_t last_ts[kEventTypes] = {};
+      for (uint32_t i = 0; i < kEventsPerBundle; ++i) {
+        uint32_t type = i % kEventTypes;
+        uint32_t irq = i % 16;
+        timestamps[type].Append(ts - last_ts[type]);
+        last_ts[type] = ts++;
+        pids[type].Append(0);
+        switch (type) {
+          case 0:
+            fields[type][0].Append(irq);
+            fields[type][1].Append(0);  // "arch_timer"
+            break;
+          case 1:
+            fields[type][0].Append(irq);
+            fields[type][1].Append(1);
+            break;
+          case 2:
+            fields[type][0].Append(500000 + 100000 * irq);
+            fields[type][1].Append(cpu);
+            break;
+        }
+      }
+      for (uint32_t type = 0; type < kEventTypes; ++type) {
+        auto* columns = compact_sched->add_event_columns();
+        columns->set_event_field_id(kEventIds[type]);
+        columns->set_timestamp(timestamps[type]);
+        columns->set_pid(pids[type]);
+        for (uint32_t field = 0; field < 2; ++field) {
+          auto* column = columns->add_column();
+          column->set_field_id(field + 1);
+          column->set_value(fields[type][field]);
+          if (type == 0 && field == 1)
+            column->set_interned_string(true);
+        }
+      }
+      compact_sched->add_event_intern_table("arch_timer");
+    }
+  }
+  return trace.SerializeAsArray();
+}
+
+}  // namespace
+
+static void BM_TraceProcessorIngestion_CompressedSched(
+    benchmark::State& state) {
+  const uint32_t batches = IsBenchmarkFunctionalOnly() ? 16 : 4096;
+  std::vector<uint8_t> trace = BuildCompressedSchedTrace(batches);
+
+  Config config;
+  config.ingestion_worker_threads = static_cast<uint32_t>(state.range(0));
+  for (auto _ : state) {
+    std::unique_ptr<TraceProcessor> tp = TraceProcessor::CreateInstance(config);
+    TraceBlob blob = TraceBlob::CopyFrom(trace.data(), trace.size());
+    PERFETTO_CHECK(tp->Parse(TraceBlobView(std::move(blob))).ok());
+    tp->NotifyEndOfFile();
+    benchmark::DoNotOptimize(tp);
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(trace.size()));
+  state.counters["events/s"] = benchmark::Counter(
+      static_cast<double>(batches * kCpus * kEventsPerBundle),
+      benchmark::Counter::kIsIterationInvariantRate);
+}
+BENCHMARK(BM_TraceProcessorIngestion_CompressedSched)
+    ->Arg(0)
+    ->Arg(1)
+    ->Arg(2)
+    ->Arg(4)
+    ->Arg(8)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+// Compares the ingestion of ftrace events in the generic compact encoding
+// (arg 1) with the normal form (arg 0).
+static void BM_TraceProcessorIngestion_CompactFtraceEvents(
+    benchmark::State& state) {
+  const uint32_t bundles = IsBenchmarkFunctionalOnly() ? 16 : 1024;
+  std::vector<uint8_t> trace = BuildIrqTrace(bundles, state.range(0) != 0);
+  const uint32_t num_events = bundles * kCpus * kEventsPerBundle;
+
+  for (auto _ : state) {
+    std::unique_ptr<TraceProcessor> tp =
+        TraceProcessor::CreateInstance(Config());
+    TraceBlob blob = TraceBlob::CopyFrom(trace.data(), trace.size());
+    PERFETTO_CHECK(tp->Parse(TraceBlobView(std::move(blob))).ok());
+    tp->NotifyEndOfFile();
+    benchmark::DoNotOptimize(tp);
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(trace.size()));
+  state.counters["events/s"] = benchmark::Counter(
+      static_cast<double>(num_events),
+      benchmark::Counter::kIsIterationInvariantRate);
+  state.counters["bytes/event"] = benchmark::Counter(
+      static_cast<double>(trace.size()) / static_cast<double>(num_events));
+}
+BENCHMARK(BM_TraceProcessorIngestion_CompactFtraceEvents)
+    ->Arg(0)
+    ->Arg(1)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -22,6 +22,7 @@
 #include <cinttypes>
 #include <functional>
 #include <iostream>
+#include <limits>
 #include <optional>
 #include <string>
 #include <unordered_map>
@@ -662,6 +663,20 @@ metatrace::MetatraceCategories ParseMetatraceCategories(std::string s) {
   return result;
 }
 
+uint64_t ParseSortingSpillThresholdMb(const char* arg) {
+  // strtoull() accepts (and wraps around) negative numbers, so only digits are
+  // let through.
+  std::optional<uint64_t> mb;
+  if (isdigit(static_cast<unsigned char>(arg[0])))
+    mb = base::StringToUInt64(arg);
+  constexpr uint64_t kMaxMb = std::numeric_limits<uint64_t>::max() >> 20;
+  if (!mb || *mb == 0 || *mb > kMaxMb) {
+    PERFETTO_ELOG("Invalid --sorting-spill-threshold-mb value: %s", arg);
+    exit(1);
+  }
+  return *mb;
+}
+
 struct CommandLineOptions {
   std::string perf_file_path;
   std::string query_file_path;
@@ -687,6 +702,9 @@ struct CommandLineOptions {
   bool no_ftrace_raw = false;
   bool analyze_trace_proto_content = false;
   bool crop_track_events = false;
+  uint32_t ingestion_worker_threads = 0;
+  bool compress_tables = false;
+  uint64_t sorting_spill_threshold_mb = 0;
   std::vector<std::string> dev_flags;
 };
 
@@ -732,6 +750,18 @@ Feature flags:
                                       trace processor.
  --crop-track-events                  Ignores track event outside of the
                                       range of interest in trace processor.
+ --ingestion-threads N                Uses N worker threads for the stateless
+                                      parts of trace ingestion (e.g.
+                                      decompression of compressed packets).
+ --compress-tables                    Compresses the integer columns of the
+                                      largest tables once the trace is loaded.
+                                      This reduces the memory usage of a
+                                      loaded trace at the cost of slightly
+                                      slower queries.
+ --sorting-spill-threshold-mb N       Buffers the events being sorted in a
+                                      temporary file in $TMPDIR once they
+                                      use more than N MB of memory. Allows
+                                      loading traces larger than RAM.
  --dev                                Enables features which are reserved for
                                       local development use only and
                                       *should not* be enabled on production
@@ -801,6 +831,9 @@ CommandLineOptions ParseCommandLineOptions(int argc, char** argv) {
     OPT_METATRACE_CATEGORIES,
     OPT_ANALYZE_TRACE_PROTO_CONTENT,
     OPT_CROP_TRACK_EVENTS,
+    OPT_INGESTION_THREADS,
+    OPT_COMPRESS_TABLES,
+    OPT_SORTING_SPILL_THRESHOLD_MB,
     OPT_DEV_FLAG,
   };
 
@@ -825,6 +858,11 @@ CommandLineOptions ParseCommandLineOptions(int argc, char** argv) {
       {"analyze-trace-proto-content", no_argument, nullptr,
        OPT_ANALYZE_TRACE_PROTO_CONTENT},
       {"crop-track-events", no_argument, nullptr, OPT_CROP_TRACK_EVENTS},
+      {"ingestion-threads", required_argument, nullptr,
+       OPT_INGESTION_THREADS},
+      {"compress-tables", no_argument, nullptr, OPT_COMPRESS_TABLES},
+      {"sorting-spill-threshold-mb", required_argument, nullptr,
+       OPT_SORTING_SPILL_THRESHOLD_MB},
       {"dev", no_argument, nullptr, OPT_DEV},
       {"add-sql-module", required_argument, nullptr, OPT_ADD_SQL_MODULE},
       {"override-sql-module", required_argument, nullptr,
@@ -933,6 +971,23 @@ CommandLineOptions ParseCommandLineOptions(int argc, char** argv) {
       continue;
     }
 
+    if (option == OPT_INGESTION_THREADS) {
+      command_line_options.ingestion_worker_threads =
+          static_cast<uint32_t>(atoi(optarg));
+      continue;
+    }
+
+    if (option == OPT_COMPRESS_TABLES) {
+      command_line_options.compress_tables = true;
+      continue;
+    }
+
+    if (option == OPT_SORTING_SPILL_THRESHOLD_MB) {
+      command_line_options.sorting_spill_threshold_mb =
+          ParseSortingSpillThresholdMb(optarg);
+      continue;
+    }
+
     if (option == OPT_DEV) {
       command_line_options.dev = true;
       continue;
@@ -1555,6 +1610,10 @@ base::Status TraceProcessorMain(int argc, char** argv) {
       options.crop_track_events
           ? DropTrackEventDataBefore::kTrackEventRangeOfInterest
           : DropTrackEventDataBefore::kNoDrop;
+  config.ingestion_worker_threads = options.ingestion_worker_threads;
+  config.compress_tables = options.compress_tables;
+  config.sorting_spill_threshold_bytes =
+      options.sorting_spill_threshold_mb * 1024 * 1024;
 
   std::vector<MetricExtension> metric_extensions;
   RETURN_IF_ERROR(ParseMetricExtensionPaths(
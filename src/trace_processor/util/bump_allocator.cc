@@ -62,9 +62,7 @@ BumpAllocator::AllocId BumpAllocator::Alloc(uint32_t size) {
   }
 
   // Slow path: we don't have enough space in the last chunk so we create one.
-  Chunk chunk;
-  chunk.allocation = Allocate(kChunkSize);
-  chunks_.emplace_back(std::move(chunk));
+  chunks_.emplace_back(NewChunk());
 
   // Ensure that we haven't exceeded the maximum number of chunks.
   PERFETTO_CHECK(LastChunkIndex() < kMaxChunkCount);
@@ -87,23 +85,56 @@ void BumpAllocator::Free(AllocId id) {
 void* BumpAllocator::GetPointer(AllocId id) {
   uint64_t queue_index = ChunkIndexToQueueIndex(id.chunk_index);
   PERFETTO_CHECK(queue_index <= std::numeric_limits<size_t>::max());
-  return chunks_.at(static_cast<size_t>(queue_index)).allocation.get() +
-         id.chunk_offset;
+  return chunks_.at(static_cast<size_t>(queue_index)).data + id.chunk_offset;
 }
 
 uint64_t BumpAllocator::EraseFrontFreeChunks() {
   size_t to_erase_chunks = 0;
   for (; to_erase_chunks < chunks_.size(); ++to_erase_chunks) {
     // Break on the first chunk which still has unfreed allocations.
-    if (chunks_.at(to_erase_chunks).unfreed_allocations > 0) {
+    const Chunk& chunk = chunks_.at(to_erase_chunks);
+    if (chunk.unfreed_allocations > 0) {
       break;
     }
+    if (chunk.allocation) {
+      resident_chunks_count_--;
+    }
   }
   chunks_.erase_front(to_erase_chunks);
   erased_front_chunks_count_ += to_erase_chunks;
   return to_erase_chunks;
 }
 
+void BumpAllocator::EnableSpilling(uint64_t max_resident_bytes) {
+  spilling_enabled_ = true;
+  max_resident_bytes_ = max_resident_bytes;
+}
+
+BumpAllocator::Chunk BumpAllocator::NewChunk() {
+  Chunk chunk;
+  if (spilling_enabled_ &&
+      (resident_chunks_count_ + 1) * kChunkSize > max_resident_bytes_) {
+    // Only try to create the file once: if this fails, keep allocating from
+    // the system allocator.
+    if (!spill_file_) {
+      spill_file_ = SpillFile::Create(kChunkSize);
+      spilling_enabled_ = spill_file_ != nullptr;
+    }
+    if (spill_file_) {
+      chunk.spilled_allocation = spill_file_->AllocateChunk();
+    }
+    if (chunk.spilled_allocation) {
+      chunk.data = chunk.spilled_allocation.get();
+      PERFETTO_ASAN_POISON(chunk.data, kChunkSize);
+      return chunk;
+    }
+  }
+  chunk.allocation = Allocate(kChunkSize);
+  chunk.data = chunk.allocation.get();
+  resident_chunks_count_++;
+  return chunk;
+}
+
 BumpAllocator::AllocId BumpAllocator::PastTheEndId() {
   if (chunks_.empty()) {
     return AllocId{erased_front_chunks_count_, 0};
@@ -127,7 +158,7 @@ std::optional<BumpAllocator::AllocId> BumpAllocator::TryAllocInLastChunk(
   // Verify some invariants:
   // 1) The allocation must exist
   // 2) The bump must be in the bounds of the chunk.
-  PERFETTO_DCHECK(chunk.allocation);
+  PERFETTO_DCHECK(chunk.data);
   PERFETTO_DCHECK(chunk.bump_offset <= kChunkSize);
 
   // If the end of the allocation ends up after this chunk, we cannot service it
@@ -144,7 +175,7 @@ std::optional<BumpAllocator::AllocId> BumpAllocator::TryAllocInLastChunk(
   chunk.unfreed_allocations++;
 
   // Unpoison the allocation range to allow access to it on ASAN builds.
-  PERFETTO_ASAN_UNPOISON(chunk.allocation.get() + alloc_offset, size);
+  PERFETTO_ASAN_UNPOISON(chunk.data + alloc_offset, size);
 
   return AllocId{LastChunkIndex(), alloc_offset};
 }
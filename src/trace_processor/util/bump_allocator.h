@@ -27,6 +27,7 @@
 
 #include "perfetto/ext/base/circular_queue.h"
 #include "perfetto/ext/base/utils.h"
+#include "src/trace_processor/util/spill_file.h"
 
 namespace perfetto {
 namespace trace_processor {
@@ -150,6 +151,21 @@ class BumpAllocator {
     return erased_front_chunks_count_;
   }
 
+  // Makes the allocator back new chunks with an unlinked temporary file (see
+  // SpillFile) instead of anonymous memory once the chunks allocated from the
+  // system allocator use more than |max_resident_bytes|. Such chunks can be
+  // evicted by the kernel when they are not accessed, allowing more memory to
+  // be allocated than the system has RAM.
+  //
+  // If spilling is not supported on this platform or the file cannot be
+  // created or grown, chunks keep being allocated from the system allocator.
+  void EnableSpilling(uint64_t max_resident_bytes);
+
+  // Returns the number of bytes in chunks backed by the spill file.
+  uint64_t spilled_bytes() const {
+    return spill_file_ ? spill_file_->allocated_bytes() : 0;
+  }
+
  private:
   struct Chunk {
     // The allocation from the system for this chunk. Because all allocations
@@ -157,6 +173,12 @@ class BumpAllocator {
     // base::AlignedUniquePtr ensures this is the case.
     base::AlignedUniquePtr<uint8_t[]> allocation;
 
+    // The chunk of the spill file backing this chunk, if |allocation| is null.
+    SpillFile::ChunkPtr spilled_allocation{nullptr, {nullptr}};
+
+    // Points to the memory of |allocation| or |spilled_allocation|.
+    uint8_t* data = nullptr;
+
     // The bump offset relative to |allocation.data|. Incremented to service
     // Alloc requests.
     uint32_t bump_offset = 0;
@@ -180,6 +202,16 @@ class BumpAllocator {
     return QueueIndexToChunkIndex(static_cast<uint64_t>(chunks_.size() - 1));
   }
 
+  // Allocates the memory of a new chunk.
+  Chunk NewChunk();
+
+  // Must be declared before |chunks_| as chunks free their memory from the
+  // spill file when destroyed.
+  std::unique_ptr<SpillFile> spill_file_;
+  bool spilling_enabled_ = false;
+  uint64_t max_resident_bytes_ = 0;
+  uint64_t resident_chunks_count_ = 0;
+
   base::CircularQueue<Chunk> chunks_;
   uint64_t erased_front_chunks_count_ = 0;
 };
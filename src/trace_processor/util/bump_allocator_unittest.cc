@@ -20,6 +20,7 @@
 #include <random>
 #include <vector>
 
+#include "perfetto/base/build_config.h"
 #include "perfetto/ext/base/utils.h"
 #include "test/gtest_and_gmock.h"
 
@@ -111,5 +112,38 @@ TEST_F(BumpAllocatorUnittest, StressTest) {
   }
 }
 
+TEST_F(BumpAllocatorUnittest, Spilling) {
+  allocator_.EnableSpilling(2 * BumpAllocator::kChunkSize);
+
+  // Fill 2 chunks in memory and 3 chunks in the spill file.
+  constexpr uint32_t kAllocSize = BumpAllocator::kChunkSize / 4;
+  std::vector<BumpAllocator::AllocId> ids;
+  for (uint32_t i = 0; i < 20; ++i) {
+    BumpAllocator::AllocId id = allocator_.Alloc(kAllocSize);
+    memset(allocator_.GetPointer(id), static_cast<int>(i), kAllocSize);
+    ids.push_back(id);
+  }
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_LINUX) || \
+    PERFETTO_BUILDFLAG(PERFETTO_OS_ANDROID) || \
+    PERFETTO_BUILDFLAG(PERFETTO_OS_APPLE)
+  ASSERT_EQ(allocator_.spilled_bytes(), 3 * BumpAllocator::kChunkSize);
+#endif
+
+  for (uint32_t i = 0; i < ids.size(); ++i) {
+    const uint8_t* ptr =
+        static_cast<const uint8_t*>(allocator_.GetPointer(ids[i]));
+    ASSERT_EQ(ptr[0], i);
+    ASSERT_EQ(ptr[kAllocSize - 1], i);
+    allocator_.Free(ids[i]);
+  }
+  ASSERT_EQ(allocator_.EraseFrontFreeChunks(), 5u);
+  ASSERT_EQ(allocator_.spilled_bytes(), 0u);
+
+  // Memory is available again for resident chunks.
+  BumpAllocator::AllocId id = allocator_.Alloc(8);
+  ASSERT_EQ(allocator_.spilled_bytes(), 0u);
+  allocator_.Free(id);
+}
+
 }  // namespace trace_processor
 }  // namespace perfetto
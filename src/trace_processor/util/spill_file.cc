@@ -0,0 +1,142 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/util/spill_file.h"
+
+#include <string>
+
+#include "perfetto/base/build_config.h"
+#include "perfetto/base/compiler.h"
+#include "perfetto/base/logging.h"
+#include "perfetto/ext/base/temp_file.h"
+
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_LINUX) ||   \
+    PERFETTO_BUILDFLAG(PERFETTO_OS_ANDROID) || \
+    PERFETTO_BUILDFLAG(PERFETTO_OS_APPLE)
+#define PERFETTO_TP_HAS_SPILL_FILE() 1
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#else
+#define PERFETTO_TP_HAS_SPILL_FILE() 0
+#endif
+
+namespace perfetto {
+namespace trace_processor {
+
+// static
+std::unique_ptr<SpillFile> SpillFile::Create(size_t chunk_size) {
+  PERFETTO_CHECK(chunk_size > 0 && kSegmentSize % chunk_size == 0);
+#if PERFETTO_TP_HAS_SPILL_FILE()
+  std::string path = base::GetSysTempDir() + "/perfetto-spill-XXXXXXXX";
+  base::ScopedFile fd(mkstemp(&path[0]));
+  if (!fd) {
+    PERFETTO_PLOG("Failed to create spill file %s", path.c_str());
+    return nullptr;
+  }
+  unlink(path.c_str());
+  return std::unique_ptr<SpillFile>(new SpillFile(std::move(fd), chunk_size));
+#else
+  return nullptr;
+#endif
+}
+
+SpillFile::SpillFile(base::ScopedFile fd, size_t chunk_size)
+    : fd_(std::move(fd)), chunk_size_(chunk_size) {}
+
+SpillFile::~SpillFile() {
+  // All the chunks should have been freed before the file is destroyed.
+  PERFETTO_CHECK(allocated_chunks_ == 0);
+#if PERFETTO_TP_HAS_SPILL_FILE()
+  if (current_segment_)
+    munmap(current_segment_, kSegmentSize);
+#endif
+}
+
+SpillFile::ChunkPtr SpillFile::AllocateChunk() {
+#if PERFETTO_TP_HAS_SPILL_FILE()
+  if (current_segment_offset_ == kSegmentSize) {
+    // Grow the file by one segment and map it. Each segment is mapped at a
+    // new offset: the space of the freed chunks of previous segments has
+    // already been released so the file stays sparse.
+    off_t file_size = static_cast<off_t>((segment_count_ + 1) * kSegmentSize);
+    if (ftruncate(*fd_, file_size) != 0) {
+      PERFETTO_PLOG("Failed to grow spill file");
+      return ChunkPtr(nullptr, ChunkDeleter{this});
+    }
+    void* segment =
+        mmap(nullptr, kSegmentSize, PROT_READ | PROT_WRITE, MAP_SHARED, *fd_,
+             static_cast<off_t>(segment_count_ * kSegmentSize));
+    if (segment == MAP_FAILED) {
+      PERFETTO_PLOG("Failed to map spill file");
+      return ChunkPtr(nullptr, ChunkDeleter{this});
+    }
+
+    // The previous segment is no longer current: unmap it if all its chunks
+    // were already freed.
+    if (current_segment_ && segments_.count(current_segment_) == 0)
+      munmap(current_segment_, kSegmentSize);
+
+    segment_count_++;
+    current_segment_ = static_cast<uint8_t*>(segment);
+    current_segment_offset_ = 0;
+  }
+
+  uint8_t* chunk = current_segment_ + current_segment_offset_;
+  current_segment_offset_ += chunk_size_;
+  segments_[current_segment_].live_chunks++;
+  allocated_chunks_++;
+  return ChunkPtr(chunk, ChunkDeleter{this});
+#else
+  return ChunkPtr(nullptr, ChunkDeleter{this});
+#endif
+}
+
+void SpillFile::FreeChunk(uint8_t* ptr) {
+#if PERFETTO_TP_HAS_SPILL_FILE()
+  PERFETTO_ASAN_UNPOISON(ptr, chunk_size_);
+
+  // Find the segment containing |ptr|: the one with the largest start address
+  // not greater than |ptr|.
+  auto it = segments_.upper_bound(ptr);
+  PERFETTO_CHECK(it != segments_.begin());
+  --it;
+  PERFETTO_DCHECK(ptr < it->first + kSegmentSize);
+
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_LINUX) || \
+    PERFETTO_BUILDFLAG(PERFETTO_OS_ANDROID)
+  // Drops the pages from the page cache and punches a hole in the file so
+  // that the disk space is released too. Failures are not fatal: the space
+  // is released anyway when the file is closed.
+  madvise(ptr, chunk_size_, MADV_REMOVE);
+#endif
+
+  allocated_chunks_--;
+  if (--it->second.live_chunks > 0)
+    return;
+
+  // The current segment stays mapped as new chunks will be allocated in it.
+  if (it->first != current_segment_)
+    munmap(it->first, kSegmentSize);
+  segments_.erase(it);
+#else
+  base::ignore_result(ptr);
+  PERFETTO_FATAL("Spill files are not supported on this platform");
+#endif
+}
+
+}  // namespace trace_processor
+}  // namespace perfetto
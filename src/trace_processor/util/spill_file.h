@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_UTIL_SPILL_FILE_H_
+#define SRC_TRACE_PROCESSOR_UTIL_SPILL_FILE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+
+#include "perfetto/ext/base/scoped_file.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+// An unlinked temporary file (in base::GetSysTempDir(), i.e. $TMPDIR) which
+// backs memory that does not need to stay resident.
+//
+// Memory is handed out in fixed size chunks carved out of large shared memory
+// mappings of the file. As the pages of these mappings are backed by the file
+// rather than by anonymous memory, the kernel can write them back and evict
+// them under memory pressure and transparently read them back when they are
+// accessed again.
+//
+// Freeing a chunk releases both its pages and its space in the file.
+class SpillFile {
+ public:
+  // Size of each mapping of the file: large enough to keep the number of
+  // mappings of the process well below the system limit.
+  static constexpr size_t kSegmentSize = 64ul * 1024 * 1024;
+
+  struct ChunkDeleter {
+    void operator()(uint8_t* ptr) const { file->FreeChunk(ptr); }
+    SpillFile* file;
+  };
+  using ChunkPtr = std::unique_ptr<uint8_t[], ChunkDeleter>;
+
+  // Creates a new file handing out chunks of |chunk_size| bytes, which must
+  // divide |kSegmentSize| and be a multiple of the page size. Returns nullptr
+  // if the file could not be created or spilling is not supported on this
+  // platform.
+  static std::unique_ptr<SpillFile> Create(size_t chunk_size);
+
+  ~SpillFile();
+
+  SpillFile(const SpillFile&) = delete;
+  SpillFile& operator=(const SpillFile&) = delete;
+
+  // Returns a new zero-initialized chunk or nullptr if the file could not be
+  // grown (e.g. because the disk is full).
+  ChunkPtr AllocateChunk();
+
+  // Number of bytes in chunks which were allocated and not freed yet.
+  uint64_t allocated_bytes() const { return allocated_chunks_ * chunk_size_; }
+
+ private:
+  struct Segment {
+    uint32_t live_chunks = 0;
+  };
+
+  SpillFile(base::ScopedFile, size_t chunk_size);
+
+  void FreeChunk(uint8_t*);
+
+  base::ScopedFile fd_;
+  const size_t chunk_size_;
+
+  // The mapped segments which still contain allocated chunks, indexed by
+  // their start address.
+  std::map<uint8_t*, Segment> segments_;
+  uint64_t segment_count_ = 0;
+
+  // The segment in which new chunks are allocated and the offset of the next
+  // chunk in it.
+  uint8_t* current_segment_ = nullptr;
+  size_t current_segment_offset_ = kSegmentSize;
+
+  uint64_t allocated_chunks_ = 0;
+};
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_UTIL_SPILL_FILE_H_
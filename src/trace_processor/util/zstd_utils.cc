@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/util/zstd_utils.h"
+
+#include <cstring>
+
+// For bazel build.
+#include "perfetto/base/build_config.h"
+#include "perfetto/base/logging.h"
+
+#if PERFETTO_BUILDFLAG(PERFETTO_ZSTD)
+#include <zstd.h>
+#endif
+
+namespace perfetto {
+namespace trace_processor {
+namespace util {
+
+namespace {
+
+// The first four bytes of a zstd frame, in little endian (ZSTD_MAGICNUMBER).
+constexpr uint8_t kZstdMagic[] = {0x28, 0xB5, 0x2F, 0xFD};
+
+}  // namespace
+
+bool IsZstdSupported() {
+#if PERFETTO_BUILDFLAG(PERFETTO_ZSTD)
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool IsZstdCompressed(const uint8_t* data, size_t size) {
+  return size >= sizeof(kZstdMagic) &&
+         memcmp(data, kZstdMagic, sizeof(kZstdMagic)) == 0;
+}
+
+#if PERFETTO_BUILDFLAG(PERFETTO_ZSTD)  // Real Implementation
+
+struct ZstdDecompressor::Impl {
+  ZSTD_DCtx* ctx = nullptr;
+  ZSTD_inBuffer in{};
+};
+
+ZstdDecompressor::ZstdDecompressor() : impl_(new Impl()) {
+  impl_->ctx = ZSTD_createDCtx();
+  PERFETTO_CHECK(impl_->ctx);
+}
+
+ZstdDecompressor::~ZstdDecompressor() {
+  ZSTD_freeDCtx(impl_->ctx);
+}
+
+void ZstdDecompressor::Reset() {
+  ZSTD_DCtx_reset(impl_->ctx, ZSTD_reset_session_only);
+  impl_->in = ZSTD_inBuffer{};
+}
+
+void ZstdDecompressor::Feed(const uint8_t* data, size_t size) {
+  impl_->in = ZSTD_inBuffer{data, size, 0};
+}
+
+ZstdDecompressor::Result ZstdDecompressor::ExtractOutput(uint8_t* out,
+                                                         size_t out_size) {
+  ZSTD_outBuffer out_buf{out, out_size, 0};
+  size_t ret = ZSTD_decompressStream(impl_->ctx, &out_buf, &impl_->in);
+  if (ZSTD_isError(ret))
+    return Result{ResultCode::kError, 0};
+
+  // 0 is returned once a frame is fully decoded and flushed.
+  if (ret == 0)
+    return Result{ResultCode::kEof, out_buf.pos};
+
+  // Unless the output buffer is full, zstd flushed everything it could
+  // decode from the input fed so far.
+  if (out_buf.pos == 0 && impl_->in.pos == impl_->in.size)
+    return Result{ResultCode::kNeedsMoreInput, 0};
+  return Result{ResultCode::kOk, out_buf.pos};
+}
+
+#else  // Dummy Implementation
+
+struct ZstdDecompressor::Impl {};
+
+ZstdDecompressor::ZstdDecompressor() = default;
+ZstdDecompressor::~ZstdDecompressor() = default;
+void ZstdDecompressor::Reset() {}
+void ZstdDecompressor::Feed(const uint8_t*, size_t) {}
+ZstdDecompressor::Result ZstdDecompressor::ExtractOutput(uint8_t*, size_t) {
+  return Result{ResultCode::kError, 0};
+}
+
+#endif  // PERFETTO_BUILDFLAG(PERFETTO_ZSTD)
+
+// static
+std::vector<uint8_t> ZstdDecompressor::DecompressFully(const uint8_t* data,
+                                                       size_t len) {
+  std::vector<uint8_t> whole_data;
+  ZstdDecompressor decompressor;
+  auto decom_output_consumer = [&](const uint8_t* buf, size_t buf_len) {
+    whole_data.insert(whole_data.end(), buf, buf + buf_len);
+  };
+  decompressor.FeedAndExtract(data, len, decom_output_consumer);
+  return whole_data;
+}
+
+}  // namespace util
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_UTIL_ZSTD_UTILS_H_
+#define SRC_TRACE_PROCESSOR_UTIL_ZSTD_UTILS_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "src/trace_processor/util/gzip_utils.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace util {
+
+// Returns whether zstd related functionality is supported with the current
+// build flags.
+bool IsZstdSupported();
+
+// Returns whether |data| starts with the magic number of a zstd frame. This is
+// used to tell zstd |compressed_packets| (see TraceConfig.compression_type)
+// apart from deflate ones.
+bool IsZstdCompressed(const uint8_t* data, size_t size);
+
+// Streaming zstd decompressor. Has the same interface (and uses the same
+// result codes) as GzipDecompressor so that code can be shared between the
+// two: see GzipDecompressor for the usage.
+class ZstdDecompressor {
+ public:
+  using ResultCode = GzipDecompressor::ResultCode;
+  using Result = GzipDecompressor::Result;
+
+  ZstdDecompressor();
+  ~ZstdDecompressor();
+  ZstdDecompressor(const ZstdDecompressor&) = delete;
+  ZstdDecompressor& operator=(const ZstdDecompressor&) = delete;
+
+  // Feed the next mem-block.
+  void Feed(const uint8_t* data, size_t size);
+
+  // Feed the next mem-block and extract output in the callback consumer.
+  // callback can get invoked multiple times if there are multiple
+  // mem-blocks to output.
+  template <typename Callback = void(const uint8_t* ptr, size_t size)>
+  ResultCode FeedAndExtract(const uint8_t* data,
+                            size_t size,
+                            const Callback& output_consumer) {
+    Feed(data, size);
+    uint8_t buffer[4096];
+    Result result;
+    do {
+      result = ExtractOutput(buffer, sizeof(buffer));
+      if (result.ret != ResultCode::kError && result.bytes_written > 0) {
+        output_consumer(buffer, result.bytes_written);
+      }
+    } while (result.ret == ResultCode::kOk);
+    return result.ret;
+  }
+
+  // Extract the newly available partial output. On each 'Feed', this method
+  // should be called repeatedly until there is no more data to output
+  // i.e. (either 'kEof' or 'kNeedsMoreInput').
+  Result ExtractOutput(uint8_t* out, size_t out_capacity);
+
+  // Sets the state of the decompressor to reuse with other zstd frames.
+  void Reset();
+
+  // Decompress the entire mem-block and return decompressed mem-block.
+  static std::vector<uint8_t> DecompressFully(const uint8_t* data, size_t len);
+
+ private:
+  struct Impl;
+  std::unique_ptr<Impl> impl_;
+};
+
+}  // namespace util
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_UTIL_ZSTD_UTILS_H_
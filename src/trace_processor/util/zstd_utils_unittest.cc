@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/util/zstd_utils.h"
+
+#include <zstd.h>
+
+#include <algorithm>
+#include <string>
+
+#include "perfetto/base/logging.h"
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace util {
+namespace {
+
+// Compresses |input| with a checksum, like ZstdCompressFn does.
+std::string Compress(const std::string& input) {
+  std::string output(ZSTD_compressBound(input.size()), '\0');
+  ZSTD_CCtx* ctx = ZSTD_createCCtx();
+  ZSTD_CCtx_setParameter(ctx, ZSTD_c_checksumFlag, 1);
+  size_t size = ZSTD_compress2(ctx, &output[0], output.size(), input.data(),
+                               input.size());
+  ZSTD_freeCCtx(ctx);
+  PERFETTO_CHECK(!ZSTD_isError(size));
+  output.resize(size);
+  return output;
+}
+
+std::string BigString() {
+  std::string output;
+  for (int i = 0; i < 10000; i++)
+    output += "Abc..Def..Ghi." + std::to_string(i);
+  return output;
+}
+
+TEST(ZstdDecompressor, Basic) {
+  std::string input = "Abc..Def..Ghi";
+  std::string compressed = Compress(input);
+  auto* data = reinterpret_cast<const uint8_t*>(compressed.data());
+  ASSERT_TRUE(IsZstdCompressed(data, compressed.size()));
+  std::vector<uint8_t> decompressed =
+      ZstdDecompressor::DecompressFully(data, compressed.size());
+  EXPECT_EQ(input, std::string(decompressed.begin(), decompressed.end()));
+}
+
+TEST(ZstdDecompressor, Streaming) {
+  std::string input = BigString();
+  std::string compressed = Compress(input);
+  auto* data = reinterpret_cast<const uint8_t*>(compressed.data());
+
+  std::string decompressed;
+  auto consumer = [&](const uint8_t* buf, size_t len) {
+    decompressed.append(reinterpret_cast<const char*>(buf), len);
+  };
+  using ResultCode = ZstdDecompressor::ResultCode;
+  ZstdDecompressor decompressor;
+  const size_t kChunk = 1000;
+  ASSERT_GT(compressed.size(), 2 * kChunk);
+  for (size_t off = 0; off < compressed.size(); off += kChunk) {
+    size_t len = std::min(kChunk, compressed.size() - off);
+    ResultCode ret = decompressor.FeedAndExtract(data + off, len, consumer);
+    ASSERT_EQ(ret, off + len == compressed.size()
+                       ? ResultCode::kEof
+                       : ResultCode::kNeedsMoreInput);
+  }
+  EXPECT_EQ(input, decompressed);
+}
+
+TEST(ZstdDecompressor, Reset) {
+  std::string first = Compress("first");
+  std::string second = Compress(BigString());
+  ZstdDecompressor decompressor;
+  std::string decompressed;
+  auto consumer = [&](const uint8_t* buf, size_t len) {
+    decompressed.append(reinterpret_cast<const char*>(buf), len);
+  };
+
+  // Stop half way through the first frame.
+  decompressor.FeedAndExtract(reinterpret_cast<const uint8_t*>(first.data()),
+                              first.size() / 2, consumer);
+  decompressor.Reset();
+  decompressed.clear();
+  EXPECT_EQ(decompressor.FeedAndExtract(
+                reinterpret_cast<const uint8_t*>(second.data()), second.size(),
+                consumer),
+            ZstdDecompressor::ResultCode::kEof);
+  EXPECT_EQ(decompressed, BigString());
+}
+
+TEST(ZstdDecompressor, Corrupted) {
+  std::string compressed = Compress(BigString());
+  compressed[compressed.size() / 2] ^= 0x5a;
+  compressed[compressed.size() / 2 + 1] ^= 0x5a;
+  ZstdDecompressor decompressor;
+  EXPECT_EQ(decompressor.FeedAndExtract(
+                reinterpret_cast<const uint8_t*>(compressed.data()),
+                compressed.size(), [](const uint8_t*, size_t) {}),
+            ZstdDecompressor::ResultCode::kError);
+}
+
+TEST(ZstdDecompressor, NotZstd) {
+  const uint8_t kDeflate[] = {0x78, 0x9c, 0x01, 0x02};
+  EXPECT_FALSE(IsZstdCompressed(kDeflate, sizeof(kDeflate)));
+  EXPECT_FALSE(IsZstdCompressed(kDeflate, 0));
+}
+
+}  // namespace
+}  // namespace util
+}  // namespace trace_processor
+}  // namespace perfetto
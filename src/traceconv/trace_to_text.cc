@@ -30,6 +30,7 @@
 #include "src/trace_processor/util/descriptors.h"
 #include "src/trace_processor/util/gzip_utils.h"
 #include "src/trace_processor/util/protozero_to_text.h"
+#include "src/trace_processor/util/zstd_utils.h"
 
 namespace perfetto {
 namespace trace_to_text {
@@ -38,6 +39,7 @@ namespace {
 using perfetto::trace_processor::DescriptorPool;
 using trace_processor::TraceType;
 using trace_processor::util::GzipDecompressor;
+using trace_processor::util::ZstdDecompressor;
 
 template <size_t N>
 static void WriteToOutput(std::ostream* output, const char (&str)[N]) {
@@ -82,9 +84,14 @@ std::string OnlineTraceToText::TracePacketToText(protozero::ConstBytes packet,
 
 void OnlineTraceToText::PrintCompressedPackets(protozero::ConstBytes packets) {
   WriteToOutput(output_, "compressed_packets {\n");
-  if (trace_processor::util::IsGzipSupported()) {
+  bool is_zstd =
+      trace_processor::util::IsZstdCompressed(packets.data, packets.size);
+  bool supported = is_zstd ? trace_processor::util::IsZstdSupported()
+                           : trace_processor::util::IsGzipSupported();
+  if (supported) {
     std::vector<uint8_t> whole_data =
-        GzipDecompressor::DecompressFully(packets.data, packets.size);
+        is_zstd ? ZstdDecompressor::DecompressFully(packets.data, packets.size)
+                : GzipDecompressor::DecompressFully(packets.data, packets.size);
     protos::pbzero::Trace::Decoder decoder(whole_data.data(),
                                            whole_data.size());
     for (auto it = decoder.packet(); it; ++it) {
@@ -95,8 +102,8 @@ void OnlineTraceToText::PrintCompressedPackets(protozero::ConstBytes packets) {
     }
   } else {
     static const char kErrMsg[] =
-        "Cannot decode compressed packets. zlib not enabled in the build "
-        "config";
+        "Cannot decode compressed packets. zlib or zstd not enabled in the "
+        "build config";
     WriteToOutput(output_, kErrMsg);
     static bool log_once = [] {
       PERFETTO_ELOG("%s", kErrMsg);
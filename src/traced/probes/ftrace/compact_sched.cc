@@ -24,6 +24,7 @@
 #include "protos/perfetto/trace/ftrace/sched.pbzero.h"
 #include "src/traced/probes/ftrace/event_info_constants.h"
 #include "src/traced/probes/ftrace/ftrace_config_utils.h"
+#include "src/traced/probes/ftrace/proto_translation_table.h"
 
 namespace perfetto {
 
@@ -163,6 +164,12 @@ std::optional<CompactSchedWakingFormat> ValidateSchedWakingFormat(
   return std::make_optional(waking_format);
 }
 
+// Whether the field is written with AppendBytes() rather than AppendVarInt().
+bool IsStringStrategy(TranslationStrategy strategy) {
+  return strategy == kFixedCStringToString || strategy == kCStringToString ||
+         strategy == kStringPtrToString || strategy == kDataLocToString;
+}
+
 }  // namespace
 
 // TODO(rsavitski): could avoid looping over all events if the caller did the
@@ -201,19 +208,70 @@ CompactSchedEventFormat InvalidCompactSchedEventFormatForTesting() {
                                  CompactSchedWakingFormat{}};
 }
 
+bool SupportsCompactEncoding(const Event& event) {
+  using protos::pbzero::FtraceEvent;
+  // Trace processor decodes these events straight from their columns, without
+  // the FtraceEvent proto (see FtraceTokenizer::TokenizeFtraceCompactEvents),
+  // so it can only do it for the events whose parsing it implements that way.
+  switch (event.proto_field_id) {
+    case FtraceEvent::kIrqHandlerEntryFieldNumber:
+    case FtraceEvent::kIrqHandlerExitFieldNumber:
+    case FtraceEvent::kSoftirqEntryFieldNumber:
+    case FtraceEvent::kSoftirqExitFieldNumber:
+    case FtraceEvent::kSoftirqRaiseFieldNumber:
+    case FtraceEvent::kIpiEntryFieldNumber:
+    case FtraceEvent::kIpiExitFieldNumber:
+    case FtraceEvent::kIpiRaiseFieldNumber:
+    case FtraceEvent::kCpuFrequencyFieldNumber:
+    case FtraceEvent::kCpuIdleFieldNumber:
+    case FtraceEvent::kWorkqueueActivateWorkFieldNumber:
+    case FtraceEvent::kWorkqueueExecuteEndFieldNumber:
+    case FtraceEvent::kWorkqueueExecuteStartFieldNumber:
+    case FtraceEvent::kWorkqueueQueueWorkFieldNumber:
+      break;
+    default:
+      return false;
+  }
+  for (const Field& field : event.fields) {
+    if (field.strategy == kInvalidTranslationStrategy)
+      return false;
+  }
+  return true;
+}
+
 // TODO(rsavitski): find the correct place in the trace for, and method of,
 // reporting rejection of compact_sched due to compile-time assumptions not
 // holding at runtime.
 CompactSchedConfig CreateCompactSchedConfig(
     const FtraceConfig& request,
-    const CompactSchedEventFormat& compact_format) {
+    const ProtoTranslationTable* table) {
   if (!request.compact_sched().enabled())
     return CompactSchedConfig{/*enabled=*/false};
 
-  if (!compact_format.format_valid)
+  if (!table->compact_sched_format().format_valid)
     return CompactSchedConfig{/*enabled=*/false};
 
-  return CompactSchedConfig{/*enabled=*/true};
+  // The generic compact encoding relies on every event having a pid.
+  std::vector<bool> events;
+  if (table->common_pid()) {
+    for (const std::string& group_and_name : request.compact_sched().events()) {
+      size_t slash_pos = group_and_name.find('/');
+      if (slash_pos == std::string::npos)
+        continue;
+      const Event* event = table->GetEvent(
+          GroupAndName(group_and_name.substr(0, slash_pos),
+                       group_and_name.substr(slash_pos + 1)));
+      if (!event || !SupportsCompactEncoding(*event)) {
+        PERFETTO_DLOG("Can't encode %s in the compact format",
+                      group_and_name.c_str());
+        continue;
+      }
+      if (event->ftrace_event_id >= events.size())
+        events.resize(event->ftrace_event_id + 1);
+      events[event->ftrace_event_id] = true;
+    }
+  }
+  return CompactSchedConfig{/*enabled=*/true, std::move(events)};
 }
 
 CompactSchedConfig EnabledCompactSchedConfigForTesting() {
@@ -279,24 +337,116 @@ void CommInterner::Reset() {
   interned_comms_size_ = 0;
 }
 
+void CompactEventInterner::Write(
+    protos::pbzero::FtraceEventBundle::CompactSched* compact_out) const {
+  for (size_t i = 0; i < strings_size_; i++)
+    compact_out->add_event_intern_table(strings_[i]);
+}
+
+void CompactEventBuffer::Write(
+    protos::pbzero::FtraceEventBundle::CompactSched* compact_out,
+    protozero::PackedVarInt* scratch) const {
+  auto* columns_out = compact_out->add_event_columns();
+  columns_out->set_event_field_id(event_->proto_field_id);
+
+  scratch->Reset();
+  for (uint64_t timestamp : timestamp_)
+    scratch->Append(timestamp);
+  columns_out->set_timestamp(*scratch);
+
+  // Transpose the rows into one column per field, starting with the pid.
+  const size_t row_size = event_->fields.size() + 1;
+  PERFETTO_DCHECK(values_.size() == row_size * timestamp_.size());
+  for (size_t column = 0; column < row_size; column++) {
+    scratch->Reset();
+    // |omitted_| is sorted, and so are the indices of this column.
+    auto omitted_it = omitted_.begin();
+    bool has_omitted = false;
+    for (size_t i = column; i < values_.size(); i += row_size) {
+      while (omitted_it != omitted_.end() && *omitted_it < i)
+        omitted_it++;
+      if (omitted_it != omitted_.end() && *omitted_it == i) {
+        has_omitted = true;
+        continue;
+      }
+      scratch->Append(values_[i]);
+    }
+    if (column == 0) {
+      // The common pid is always written.
+      PERFETTO_DCHECK(!has_omitted);
+      columns_out->set_pid(*scratch);
+      continue;
+    }
+    const Field& field = event_->fields[column - 1];
+    auto* column_out = columns_out->add_column();
+    column_out->set_field_id(field.proto_field_id);
+    if (IsStringStrategy(field.strategy))
+      column_out->set_interned_string(true);
+    column_out->set_value(*scratch);
+    if (!has_omitted)
+      continue;
+    scratch->Reset();
+    for (size_t index : omitted_) {
+      if (index % row_size == column)
+        scratch->Append(static_cast<uint32_t>(index / row_size));
+    }
+    column_out->set_omitted_event(*scratch);
+  }
+}
+
+void CompactEventBuffer::Reset() {
+  last_timestamp_ = 0;
+  timestamp_.clear();
+  values_.clear();
+  omitted_.clear();
+}
+
+CompactEventBuffer* CompactSchedBuffer::GetOrCreateEventBuffer(
+    const Event* event) {
+  for (const auto& event_buffer : event_buffers_) {
+    if (event_buffer->event() == event)
+      return event_buffer.get();
+  }
+  event_buffers_.push_back(
+      std::make_unique<CompactEventBuffer>(event, &event_interner_));
+  return event_buffers_.back().get();
+}
+
 void CompactSchedBuffer::WriteAndReset(
     protos::pbzero::FtraceEventBundle* bundle) {
-  if (switch_.size() > 0 || waking_.size() > 0) {
+  bool has_events = false;
+  for (const auto& event_buffer : event_buffers_)
+    has_events |= event_buffer->size() > 0;
+
+  if (switch_.size() > 0 || waking_.size() > 0 || has_events) {
     auto* compact_out = bundle->set_compact_sched();
 
-    PERFETTO_DCHECK(interner_.interned_comms_size() > 0);
-    interner_.Write(compact_out);
+    if (switch_.size() > 0 || waking_.size() > 0) {
+      PERFETTO_DCHECK(interner_.interned_comms_size() > 0);
+      interner_.Write(compact_out);
+    }
 
     if (switch_.size() > 0)
       switch_.Write(compact_out);
 
     if (waking_.size() > 0)
       waking_.Write(compact_out);
+
+    if (has_events) {
+      event_interner_.Write(compact_out);
+      for (const auto& event_buffer : event_buffers_) {
+        if (event_buffer->size() > 0)
+          event_buffer->Write(compact_out, &scratch_);
+      }
+    }
   }
 
   interner_.Reset();
   switch_.Reset();
   waking_.Reset();
+  event_interner_.Reset();
+  for (const auto& event_buffer : event_buffers_)
+    event_buffer->Reset();
 }
 
 }  // namespace perfetto
@@ -19,14 +19,21 @@
 
 #include <stdint.h>
 
+#include <memory>
+#include <string>
+#include <vector>
+
 #include "perfetto/ext/base/string_view.h"
 #include "perfetto/protozero/packed_repeated_fields.h"
+#include "perfetto/protozero/proto_utils.h"
 #include "protos/perfetto/trace/ftrace/ftrace_event_bundle.pbzero.h"
 #include "src/traced/probes/ftrace/event_info_constants.h"
 #include "src/traced/probes/ftrace/ftrace_config_utils.h"
 
 namespace perfetto {
 
+class ProtoTranslationTable;
+
 // The subset of the sched_switch event's format that is used when parsing and
 // encoding into the compact format.
 struct CompactSchedSwitchFormat {
@@ -80,15 +87,32 @@ CompactSchedEventFormat InvalidCompactSchedEventFormatForTesting();
 // Compact encoding configuration used at ftrace reading & parsing time.
 struct CompactSchedConfig {
   CompactSchedConfig(bool _enabled) : enabled(_enabled) {}
+  CompactSchedConfig(bool _enabled, std::vector<bool> _events)
+      : enabled(_enabled), events(std::move(_events)) {}
+
+  // Whether the event with the given ftrace id is encoded in the generic
+  // compact format (see CompactEventBuffer).
+  bool IsCompactEvent(size_t ftrace_event_id) const {
+    return ftrace_event_id < events.size() && events[ftrace_event_id];
+  }
 
   // If true, and sched_switch and/or sched_waking events are enabled, encode
   // them in a compact format instead of the normal form.
   const bool enabled = false;
+
+  // Indexed by ftrace event id. The events listed in
+  // FtraceConfig.CompactSchedConfig.events that support the generic compact
+  // encoding. Always empty if |enabled| is false.
+  const std::vector<bool> events;
 };
 
-CompactSchedConfig CreateCompactSchedConfig(
-    const FtraceConfig& request,
-    const CompactSchedEventFormat& compact_format);
+// Returns whether |event| can be recorded in the generic compact encoding: one
+// of the event types listed in FtraceConfig.CompactSchedConfig.events, with
+// fields of supported types.
+bool SupportsCompactEncoding(const Event& event);
+
+CompactSchedConfig CreateCompactSchedConfig(const FtraceConfig& request,
+                                            const ProtoTranslationTable* table);
 
 CompactSchedConfig EnabledCompactSchedConfigForTesting();
 CompactSchedConfig DisabledCompactSchedConfigForTesting();
@@ -217,6 +241,99 @@ class CommInterner {
   uint32_t interned_comms_size_ = 0;
 };
 
+// Interns the string fields of the events recorded in the generic compact
+// encoding. Unlike |CommInterner|, the strings can be of any length.
+class CompactEventInterner {
+ public:
+  uint32_t InternString(base::StringView str) {
+    // Linearly scan existing strings, as in |CommInterner|.
+    for (uint32_t i = 0; i < strings_size_; i++) {
+      if (str == base::StringView(strings_[i]))
+        return i;
+    }
+    // The strings of the previous batches are kept to reuse their storage.
+    if (strings_size_ == strings_.size())
+      strings_.emplace_back();
+    strings_[strings_size_].assign(str.data(), str.size());
+    return strings_size_++;
+  }
+
+  size_t interned_strings_size() const { return strings_size_; }
+
+  void Write(
+      protos::pbzero::FtraceEventBundle::CompactSched* compact_out) const;
+  void Reset() { strings_size_ = 0; }
+
+ private:
+  std::vector<std::string> strings_;
+  uint32_t strings_size_ = 0;
+};
+
+// Collects the events of one type that are recorded in the generic compact
+// encoding. The fields of an event are parsed by the same code as in the
+// normal form (see CpuReader::ParseField), through the Append* methods below,
+// and buffered as a row. They are written out as one packed column per field.
+class CompactEventBuffer {
+ public:
+  CompactEventBuffer(const Event* event, CompactEventInterner* interner)
+      : event_(event), interner_(interner) {}
+
+  const Event* event() const { return event_; }
+
+  size_t size() const { return timestamp_.size(); }
+
+  inline void AppendTimestamp(uint64_t timestamp) {
+    timestamp_.push_back(timestamp - last_timestamp_);
+    last_timestamp_ = timestamp;
+  }
+
+  // Same as protozero::Message::AppendVarInt(). The field is implied by the
+  // position in the row.
+  template <typename T>
+  inline void AppendVarInt(uint32_t /*field_id*/, T value) {
+    values_.push_back(static_cast<uint64_t>(
+        protozero::proto_utils::ExtendValueForVarIntSerialization(value)));
+  }
+
+  // Same as protozero::Message::AppendBytes(). The string is interned.
+  inline void AppendBytes(uint32_t /*field_id*/,
+                          const void* data,
+                          size_t size) {
+    values_.push_back(interner_->InternString(
+        base::StringView(static_cast<const char*>(data), size)));
+  }
+
+  // Number of values buffered so far, to check that a field was written.
+  size_t num_values() const { return values_.size(); }
+
+  // Marks the field that ParseField() just skipped as omitted for the current
+  // event (e.g. an empty __data_loc string, which is omitted from the normal
+  // form too), rather than recording it with a default value.
+  void AppendOmittedValue() {
+    omitted_.push_back(values_.size());
+    values_.push_back(0);
+  }
+
+  void Write(protos::pbzero::FtraceEventBundle::CompactSched* compact_out,
+             protozero::PackedVarInt* scratch) const;
+  void Reset();
+
+ private:
+  const Event* const event_;
+  CompactEventInterner* const interner_;
+
+  uint64_t last_timestamp_ = 0;
+  // Delta-encoded as in |CompactSchedSwitchBuffer|.
+  std::vector<uint64_t> timestamp_;
+  // One row per event: the common pid, followed by the fields of the event in
+  // the order of |event_->fields|. Integers are stored as they would be
+  // varint-encoded in the normal form, strings as their interning index.
+  std::vector<uint64_t> values_;
+  // Indices in |values_| of the omitted fields, in increasing order. Their
+  // placeholder in |values_| isn't written out.
+  std::vector<size_t> omitted_;
+};
+
 // Mutable state for buffering parts of scheduling events, that can later be
 // written out in a compact format with |WriteAndReset|. Used by the ftrace
 // reader.
@@ -225,6 +342,11 @@ class CompactSchedBuffer {
   CompactSchedSwitchBuffer& sched_switch() { return switch_; }
   CompactSchedWakingBuffer& sched_waking() { return waking_; }
   CommInterner& interner() { return interner_; }
+  CompactEventInterner& event_interner() { return event_interner_; }
+
+  // Returns the buffer for the events of type |event|, which is recorded in
+  // the generic compact encoding.
+  CompactEventBuffer* GetOrCreateEventBuffer(const Event* event);
 
   // Writes out the currently buffered events, and starts the next batch
   // internally.
@@ -234,6 +356,13 @@ class CompactSchedBuffer {
   CommInterner interner_;
   CompactSchedSwitchBuffer switch_;
   CompactSchedWakingBuffer waking_;
+
+  CompactEventInterner event_interner_;
+  // Only a few event types are expected, so they are looked up linearly.
+  // Kept across batches, to reuse their storage.
+  std::vector<std::unique_ptr<CompactEventBuffer>> event_buffers_;
+  // Used to encode the columns of |event_buffers_|.
+  protozero::PackedVarInt scratch_;
 };
 
 }  // namespace perfetto
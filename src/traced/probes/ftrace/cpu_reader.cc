@@ -72,19 +72,21 @@ struct EventHeader {
 
 // Reads a string from `start` until the first '\0' byte or until fixed_len
 // characters have been read. Appends it to `*out` as field `field_id`.
+template <typename Out>
 void ReadIntoString(const uint8_t* start,
                     size_t fixed_len,
                     uint32_t field_id,
-                    protozero::Message* out) {
+                    Out* out) {
   size_t len = strnlen(reinterpret_cast<const char*>(start), fixed_len);
   out->AppendBytes(field_id, reinterpret_cast<const char*>(start), len);
 }
 
+template <typename Out>
 bool ReadDataLoc(const uint8_t* start,
                  const uint8_t* field_start,
                  const uint8_t* end,
                  const Field& field,
-                 protozero::Message* message) {
+                 Out* out) {
   PERFETTO_DCHECK(field.ftrace_size == 4);
   // See kernel header include/trace/trace_events.h
   uint32_t data = 0;
@@ -104,7 +106,7 @@ bool ReadDataLoc(const uint8_t* start,
     PERFETTO_DFATAL("__data_loc points at invalid location");
     return false;
   }
-  ReadIntoString(string_start, len, field.proto_field_id, message);
+  ReadIntoString(string_start, len, field.proto_field_id, out);
   return true;
 }
 
@@ -155,6 +157,9 @@ void LogInvalidPage(const void* start, size_t size) {
   }
 }
 
+// Enough for a full batch of the FtraceController (kParsingBufferSizePages).
+constexpr size_t kSplicePipeSizePages = 32;
+
 }  // namespace
 
 using protos::pbzero::GenericFtraceEvent;
@@ -182,6 +187,20 @@ size_t CpuReader::ReadCycle(
     size_t parsing_buf_size_pages,
     size_t max_pages,
     const std::set<FtraceDataSource*>& started_data_sources) {
+  std::vector<DataSourceOutput> outputs;
+  outputs.reserve(started_data_sources.size());
+  for (FtraceDataSource* data_source : started_data_sources) {
+    outputs.push_back({data_source->trace_writer(),
+                       data_source->mutable_metadata(),
+                       data_source->parsing_config()});
+  }
+  return ReadCycle(parsing_buf, parsing_buf_size_pages, max_pages, outputs);
+}
+
+size_t CpuReader::ReadCycle(uint8_t* parsing_buf,
+                            size_t parsing_buf_size_pages,
+                            size_t max_pages,
+                            const std::vector<DataSourceOutput>& outputs) {
   PERFETTO_DCHECK(max_pages > 0 && parsing_buf_size_pages > 0);
   metatrace::ScopedEvent evt(metatrace::TAG_FTRACE,
                              metatrace::FTRACE_CPU_READ_CYCLE);
@@ -191,8 +210,8 @@ size_t CpuReader::ReadCycle(
   for (bool is_first_batch = true;; is_first_batch = false) {
     size_t batch_pages =
         std::min(parsing_buf_size_pages, max_pages - total_pages_read);
-    size_t pages_read = ReadAndProcessBatch(
-        parsing_buf, batch_pages, is_first_batch, started_data_sources);
+    size_t pages_read =
+        ReadAndProcessBatch(parsing_buf, batch_pages, is_first_batch, outputs);
 
     PERFETTO_DCHECK(pages_read <= batch_pages);
     total_pages_read += pages_read;
@@ -218,12 +237,23 @@ size_t CpuReader::ReadAndProcessBatch(
     uint8_t* parsing_buf,
     size_t max_pages,
     bool first_batch_in_cycle,
-    const std::set<FtraceDataSource*>& started_data_sources) {
+    const std::vector<DataSourceOutput>& outputs) {
   size_t pages_read = 0;
   {
     metatrace::ScopedEvent evt(metatrace::TAG_FTRACE,
                                metatrace::FTRACE_CPU_READ_BATCH);
     for (; pages_read < max_pages;) {
+      // Move the pages that the kernel has finished writing in bulk. Only the
+      // page that is being written (or the remainder of a page partially
+      // consumed by a previous read) needs the read() below.
+      size_t pages_spliced =
+          SplicePages(parsing_buf + (pages_read * base::kPageSize),
+                      max_pages - pages_read);
+      if (pages_spliced > 0) {
+        pages_read += pages_spliced;
+        continue;
+      }
+
       uint8_t* curr_page = parsing_buf + (pages_read * base::kPageSize);
       ssize_t res =
           PERFETTO_EINTR(read(*trace_fd_, curr_page, base::kPageSize));
@@ -291,11 +321,11 @@ size_t CpuReader::ReadAndProcessBatch(
   if (pages_read == 0)
     return pages_read;
 
-  for (FtraceDataSource* data_source : started_data_sources) {
+  for (const DataSourceOutput& output : outputs) {
     size_t pages_parsed_ok = ProcessPagesForDataSource(
-        data_source->trace_writer(), data_source->mutable_metadata(), cpu_,
-        data_source->parsing_config(), parsing_buf, pages_read, table_,
-        symbolizer_, ftrace_clock_snapshot_, ftrace_clock_);
+        output.trace_writer, output.metadata, cpu_, output.parsing_config,
+        parsing_buf, pages_read, table_, symbolizer_, ftrace_clock_snapshot_,
+        ftrace_clock_);
     // If this happens, it means that we did not know how to parse the kernel
     // binary format. This is a bug in either perfetto or the kernel, and must
     // be investigated. Hence we abort instead of recording a bit in the ftrace
@@ -312,6 +342,61 @@ size_t CpuReader::ReadAndProcessBatch(
   return pages_read;
 }
 
+// Reading trace_pipe_raw takes a read() per page. Instead, splice() moves
+// many pages at once from the ring buffer into a pipe (without copying them),
+// and a single read() copies them out of the pipe. The kernel only splices
+// full pages: when there are none, or when the first page has been partially
+// consumed by a read(), this fails with EAGAIN and the caller reads the page
+// with read().
+size_t CpuReader::SplicePages(uint8_t* parsing_buf, size_t max_pages) {
+  if (splice_state_ == SpliceState::kUnsupported)
+    return 0;
+
+  if (splice_state_ == SpliceState::kUnknown) {
+    splice_pipe_ = base::Pipe::Create(base::Pipe::kBothNonBlock);
+    // Best effort, the default pipe size is 16 pages. Larger sizes can be
+    // rejected depending on /proc/sys/fs/pipe-max-size.
+    fcntl(*splice_pipe_.wr, F_SETPIPE_SZ,
+          static_cast<int>(kSplicePipeSizePages * base::kPageSize));
+    int pipe_size = fcntl(*splice_pipe_.wr, F_GETPIPE_SZ);
+    if (pipe_size < static_cast<int>(base::kPageSize)) {
+      PERFETTO_PLOG("[cpu%zu]: can't size the splice pipe", cpu_);
+      splice_state_ = SpliceState::kUnsupported;
+      splice_pipe_ = base::Pipe();
+      return 0;
+    }
+    splice_pipe_size_pages_ = static_cast<size_t>(pipe_size) / base::kPageSize;
+    splice_state_ = SpliceState::kSupported;
+  }
+
+  size_t max_bytes =
+      std::min(max_pages, splice_pipe_size_pages_) * base::kPageSize;
+  ssize_t res =
+      PERFETTO_EINTR(splice(*trace_fd_, nullptr, *splice_pipe_.wr, nullptr,
+                            max_bytes, SPLICE_F_MOVE | SPLICE_F_NONBLOCK));
+  if (res <= 0) {
+    // Same expected errors as for read(), see ReadAndProcessBatch(). Anything
+    // else (e.g. EINVAL) means that the fd doesn't support splice().
+    if (res < 0 && errno != EAGAIN && errno != ENOMEM && errno != EBUSY &&
+        errno != ENODEV) {
+      PERFETTO_DPLOG("[cpu%zu]: splice() not supported, using read()", cpu_);
+      splice_state_ = SpliceState::kUnsupported;
+      splice_pipe_ = base::Pipe();
+    }
+    return 0;
+  }
+
+  // The kernel splices whole pages of the ring buffer.
+  PERFETTO_CHECK(static_cast<size_t>(res) % base::kPageSize == 0);
+  for (size_t bytes_read = 0; bytes_read < static_cast<size_t>(res);) {
+    ssize_t rd = PERFETTO_EINTR(read(*splice_pipe_.rd, parsing_buf + bytes_read,
+                                     static_cast<size_t>(res) - bytes_read));
+    PERFETTO_CHECK(rd > 0);
+    bytes_read += static_cast<size_t>(rd);
+  }
+  return static_cast<size_t>(res) / base::kPageSize;
+}
+
 void CpuReader::Bundler::StartNewPacket(bool lost_events) {
   FinalizeAndRunSymbolizer();
   packet_ = trace_writer_->NewTracePacket();
@@ -441,8 +526,11 @@ size_t CpuReader::ProcessPagesForDataSource(
     //   interning lookups cheap again.
     bool interner_past_threshold =
         compact_sched_enabled &&
-        bundler.compact_sched_buffer()->interner().interned_comms_size() >
-            kCompactSchedInternerThreshold;
+        (bundler.compact_sched_buffer()->interner().interned_comms_size() >
+             kCompactSchedInternerThreshold ||
+         bundler.compact_sched_buffer()
+                 ->event_interner()
+                 .interned_strings_size() > kCompactSchedInternerThreshold);
 
     if (page_header->lost_events || interner_past_threshold) {
       bundler.StartNewPacket(page_header->lost_events);
@@ -651,6 +739,12 @@ size_t CpuReader::ParsePagePayload(const uint8_t* start_of_payload,
                               event, metadata))
                 return 0;
             }
+            // other events in the generic compact encoding
+          } else if (ds_config->compact_sched.IsCompactEvent(ftrace_event_id)) {
+            if (!ParseEventCompact(ftrace_event_id, start, next, timestamp,
+                                   table, bundler->compact_sched_buffer(),
+                                   metadata))
+              return 0;
           } else {
             // Common case: parse all other types of enabled events.
             protos::pbzero::FtraceEvent* event =
@@ -701,9 +795,15 @@ bool CpuReader::ParseEvent(uint16_t ftrace_event_id,
   protozero::Message* nested =
       message->BeginNestedMessage<protozero::Message>(info.proto_field_id);
 
-  // Parse generic event.
-  if (PERFETTO_UNLIKELY(info.proto_field_id ==
-                        protos::pbzero::FtraceEvent::kGenericFieldNumber)) {
+  FastEventLayout fast_layout = table->GetFastEventLayout(ftrace_event_id);
+  if (PERFETTO_LIKELY(fast_layout != FastEventLayout::kNone)) {
+    // Frequent events, with the layout we expect (see fast_event_layout.h).
+    success &= ParseFieldsWithFastLayout(fast_layout, info, start, end, table,
+                                         nested, metadata);
+  } else if (PERFETTO_UNLIKELY(
+                 info.proto_field_id ==
+                 protos::pbzero::FtraceEvent::kGenericFieldNumber)) {
+    // Parse generic event.
     nested->AppendString(GenericFtraceEvent::kEventNameFieldNumber, info.name);
     for (const Field& field : info.fields) {
       auto generic_field = nested->BeginNestedMessage<protozero::Message>(
@@ -746,104 +846,176 @@ bool CpuReader::ParseEvent(uint16_t ftrace_event_id,
 // The only exception is fields with strategy = kCStringToString
 // where the total size isn't known up front. In this case ParseField
 // will check the string terminates in the bounds and won't read past |end|.
+// static
+template <typename Out>
 bool CpuReader::ParseField(const Field& field,
                            const uint8_t* start,
                            const uint8_t* end,
                            const ProtoTranslationTable* table,
-                           protozero::Message* message,
+                           Out* out,
                            FtraceMetadata* metadata) {
+  switch (field.strategy) {
+#define PERFETTO_FTRACE_PARSE_FIELD_CASE(strategy)                         \
+  case strategy:                                                           \
+    return ParseFieldWithStrategy<strategy>(field, start, end, table, out, \
+                                            metadata);
+    PERFETTO_FTRACE_PARSE_FIELD_CASE(kUint8ToUint32)
+    PERFETTO_FTRACE_PARSE_FIELD_CASE(kUint8ToUint64)
+    PERFETTO_FTRACE_PARSE_FIELD_CASE(kUint16ToUint32)
+    PERFETTO_FTRACE_PARSE_FIELD_CASE(kUint16ToUint64)
+    PERFETTO_FTRACE_PARSE_FIELD_CASE(kUint32ToUint32)
+    PERFETTO_FTRACE_PARSE_FIELD_CASE(kUint32ToUint64)
+    PERFETTO_FTRACE_PARSE_FIELD_CASE(kUint64ToUint64)
+    PERFETTO_FTRACE_PARSE_FIELD_CASE(kInt8ToInt32)
+    PERFETTO_FTRACE_PARSE_FIELD_CASE(kInt8ToInt64)
+    PERFETTO_FTRACE_PARSE_FIELD_CASE(kInt16ToInt32)
+    PERFETTO_FTRACE_PARSE_FIELD_CASE(kInt16ToInt64)
+    PERFETTO_FTRACE_PARSE_FIELD_CASE(kInt32ToInt32)
+    PERFETTO_FTRACE_PARSE_FIELD_CASE(kInt32ToInt64)
+    PERFETTO_FTRACE_PARSE_FIELD_CASE(kInt64ToInt64)
+    PERFETTO_FTRACE_PARSE_FIELD_CASE(kFixedCStringToString)
+    PERFETTO_FTRACE_PARSE_FIELD_CASE(kCStringToString)
+    PERFETTO_FTRACE_PARSE_FIELD_CASE(kStringPtrToString)
+    PERFETTO_FTRACE_PARSE_FIELD_CASE(kDataLocToString)
+    PERFETTO_FTRACE_PARSE_FIELD_CASE(kBoolToUint32)
+    PERFETTO_FTRACE_PARSE_FIELD_CASE(kBoolToUint64)
+    PERFETTO_FTRACE_PARSE_FIELD_CASE(kInode32ToUint64)
+    PERFETTO_FTRACE_PARSE_FIELD_CASE(kInode64ToUint64)
+    PERFETTO_FTRACE_PARSE_FIELD_CASE(kPid32ToInt32)
+    PERFETTO_FTRACE_PARSE_FIELD_CASE(kPid32ToInt64)
+    PERFETTO_FTRACE_PARSE_FIELD_CASE(kCommonPid32ToInt32)
+    PERFETTO_FTRACE_PARSE_FIELD_CASE(kCommonPid32ToInt64)
+    PERFETTO_FTRACE_PARSE_FIELD_CASE(kDevId32ToUint64)
+    PERFETTO_FTRACE_PARSE_FIELD_CASE(kDevId64ToUint64)
+    PERFETTO_FTRACE_PARSE_FIELD_CASE(kFtraceSymAddr64ToUint64)
+#undef PERFETTO_FTRACE_PARSE_FIELD_CASE
+    case kInvalidTranslationStrategy:
+      break;
+  }
+  PERFETTO_FATAL("Unexpected translation strategy");
+}
+
+// The body of ParseField() for each strategy. Used directly (i.e. without the
+// switch) by the parsers specialized for a layout.
+// static
+template <TranslationStrategy kStrategy, typename Out>
+bool CpuReader::ParseFieldWithStrategy(const Field& field,
+                                       const uint8_t* start,
+                                       const uint8_t* end,
+                                       const ProtoTranslationTable* table,
+                                       Out* out,
+                                       FtraceMetadata* metadata) {
+  PERFETTO_DCHECK(field.strategy == kStrategy);
   PERFETTO_DCHECK(start + field.ftrace_offset + field.ftrace_size <= end);
   const uint8_t* field_start = start + field.ftrace_offset;
   uint32_t field_id = field.proto_field_id;
 
-  switch (field.strategy) {
-    case kUint8ToUint32:
-    case kUint8ToUint64:
-      ReadIntoVarInt<uint8_t>(field_start, field_id, message);
-      return true;
-    case kUint16ToUint32:
-    case kUint16ToUint64:
-      ReadIntoVarInt<uint16_t>(field_start, field_id, message);
-      return true;
-    case kUint32ToUint32:
-    case kUint32ToUint64:
-      ReadIntoVarInt<uint32_t>(field_start, field_id, message);
-      return true;
-    case kUint64ToUint64:
-      ReadIntoVarInt<uint64_t>(field_start, field_id, message);
-      return true;
-    case kInt8ToInt32:
-    case kInt8ToInt64:
-      ReadIntoVarInt<int8_t>(field_start, field_id, message);
-      return true;
-    case kInt16ToInt32:
-    case kInt16ToInt64:
-      ReadIntoVarInt<int16_t>(field_start, field_id, message);
-      return true;
-    case kInt32ToInt32:
-    case kInt32ToInt64:
-      ReadIntoVarInt<int32_t>(field_start, field_id, message);
-      return true;
-    case kInt64ToInt64:
-      ReadIntoVarInt<int64_t>(field_start, field_id, message);
-      return true;
-    case kFixedCStringToString:
-      // TODO(hjd): Kernel-dive to check this how size:0 char fields work.
-      ReadIntoString(field_start, field.ftrace_size, field_id, message);
-      return true;
-    case kCStringToString:
-      // TODO(hjd): Kernel-dive to check this how size:0 char fields work.
-      ReadIntoString(field_start, static_cast<size_t>(end - field_start),
-                     field_id, message);
-      return true;
-    case kStringPtrToString: {
-      uint64_t n = 0;
-      // The ftrace field may be 8 or 4 bytes and we need to copy it into the
-      // bottom of n. In the unlikely case where the field is >8 bytes we
-      // should avoid making things worse by corrupting the stack but we
-      // don't need to handle it correctly.
-      size_t size = std::min<size_t>(field.ftrace_size, sizeof(n));
-      memcpy(base::AssumeLittleEndian(&n),
-             reinterpret_cast<const void*>(field_start), size);
-      // Look up the adddress in the printk format map and write it into the
-      // proto.
-      base::StringView name = table->LookupTraceString(n);
-      message->AppendBytes(field_id, name.begin(), name.size());
-      return true;
-    }
-    case kDataLocToString:
-      return ReadDataLoc(start, field_start, end, field, message);
-    case kBoolToUint32:
-    case kBoolToUint64:
-      ReadIntoVarInt<uint8_t>(field_start, field_id, message);
-      return true;
-    case kInode32ToUint64:
-      ReadInode<uint32_t>(field_start, field_id, message, metadata);
-      return true;
-    case kInode64ToUint64:
-      ReadInode<uint64_t>(field_start, field_id, message, metadata);
-      return true;
-    case kPid32ToInt32:
-    case kPid32ToInt64:
-      ReadPid(field_start, field_id, message, metadata);
-      return true;
-    case kCommonPid32ToInt32:
-    case kCommonPid32ToInt64:
-      ReadCommonPid(field_start, field_id, message, metadata);
-      return true;
-    case kDevId32ToUint64:
-      ReadDevId<uint32_t>(field_start, field_id, message, metadata);
-      return true;
-    case kDevId64ToUint64:
-      ReadDevId<uint64_t>(field_start, field_id, message, metadata);
-      return true;
-    case kFtraceSymAddr64ToUint64:
-      ReadSymbolAddr<uint64_t>(field_start, field_id, message, metadata);
-      return true;
-    case kInvalidTranslationStrategy:
+  if constexpr (kStrategy == kUint8ToUint32 || kStrategy == kUint8ToUint64 ||
+                kStrategy == kBoolToUint32 || kStrategy == kBoolToUint64) {
+    ReadIntoVarInt<uint8_t>(field_start, field_id, out);
+  } else if constexpr (kStrategy == kUint16ToUint32 ||
+                       kStrategy == kUint16ToUint64) {
+    ReadIntoVarInt<uint16_t>(field_start, field_id, out);
+  } else if constexpr (kStrategy == kUint32ToUint32 ||
+                       kStrategy == kUint32ToUint64) {
+    ReadIntoVarInt<uint32_t>(field_start, field_id, out);
+  } else if constexpr (kStrategy == kUint64ToUint64) {
+    ReadIntoVarInt<uint64_t>(field_start, field_id, out);
+  } else if constexpr (kStrategy == kInt8ToInt32 || kStrategy == kInt8ToInt64) {
+    ReadIntoVarInt<int8_t>(field_start, field_id, out);
+  } else if constexpr (kStrategy == kInt16ToInt32 ||
+                       kStrategy == kInt16ToInt64) {
+    ReadIntoVarInt<int16_t>(field_start, field_id, out);
+  } else if constexpr (kStrategy == kInt32ToInt32 ||
+                       kStrategy == kInt32ToInt64) {
+    ReadIntoVarInt<int32_t>(field_start, field_id, out);
+  } else if constexpr (kStrategy == kInt64ToInt64) {
+    ReadIntoVarInt<int64_t>(field_start, field_id, out);
+  } else if constexpr (kStrategy == kFixedCStringToString) {
+    // TODO(hjd): Kernel-dive to check this how size:0 char fields work.
+    ReadIntoString(field_start, field.ftrace_size, field_id, out);
+  } else if constexpr (kStrategy == kCStringToString) {
+    // TODO(hjd): Kernel-dive to check this how size:0 char fields work.
+    ReadIntoString(field_start, static_cast<size_t>(end - field_start),
+                   field_id, out);
+  } else if constexpr (kStrategy == kStringPtrToString) {
+    uint64_t n = 0;
+    // The ftrace field may be 8 or 4 bytes and we need to copy it into the
+    // bottom of n. In the unlikely case where the field is >8 bytes we
+    // should avoid making things worse by corrupting the stack but we
+    // don't need to handle it correctly.
+    size_t size = std::min<size_t>(field.ftrace_size, sizeof(n));
+    memcpy(base::AssumeLittleEndian(&n),
+           reinterpret_cast<const void*>(field_start), size);
+    // Look up the adddress in the printk format map and write it into the
+    // proto.
+    base::StringView name = table->LookupTraceString(n);
+    out->AppendBytes(field_id, name.begin(), name.size());
+  } else if constexpr (kStrategy == kDataLocToString) {
+    return ReadDataLoc(start, field_start, end, field, out);
+  } else if constexpr (kStrategy == kInode32ToUint64) {
+    ReadInode<uint32_t>(field_start, field_id, out, metadata);
+  } else if constexpr (kStrategy == kInode64ToUint64) {
+    ReadInode<uint64_t>(field_start, field_id, out, metadata);
+  } else if constexpr (kStrategy == kPid32ToInt32 ||
+                       kStrategy == kPid32ToInt64) {
+    ReadPid(field_start, field_id, out, metadata);
+  } else if constexpr (kStrategy == kCommonPid32ToInt32 ||
+                       kStrategy == kCommonPid32ToInt64) {
+    ReadCommonPid(field_start, field_id, out, metadata);
+  } else if constexpr (kStrategy == kDevId32ToUint64) {
+    ReadDevId<uint32_t>(field_start, field_id, out, metadata);
+  } else if constexpr (kStrategy == kDevId64ToUint64) {
+    ReadDevId<uint64_t>(field_start, field_id, out, metadata);
+  } else if constexpr (kStrategy == kFtraceSymAddr64ToUint64) {
+    ReadSymbolAddr<uint64_t>(field_start, field_id, out, metadata);
+  } else {
+    static_assert(kStrategy != kStrategy, "Unexpected translation strategy");
+  }
+  return true;
+}
+
+// Parses the fields of |info|, which have the translation strategies
+// |kStrategies| (as validated by MatchFastEventLayout()). The loop over the
+// fields and the switch on their strategy are resolved at compile time.
+// static
+template <TranslationStrategy... kStrategies>
+bool CpuReader::ParseFieldsWithLayout(const Event& info,
+                                      const uint8_t* start,
+                                      const uint8_t* end,
+                                      const ProtoTranslationTable* table,
+                                      protozero::Message* message,
+                                      FtraceMetadata* metadata) {
+  PERFETTO_DCHECK(info.fields.size() == sizeof...(kStrategies));
+  const Field* field = info.fields.data();
+  bool success = true;
+  // The fields are parsed in order, as the operands of the comma operator are
+  // sequenced.
+  ((void)(success &= ParseFieldWithStrategy<kStrategies>(
+              *field++, start, end, table, message, metadata)),
+   ...);
+  return success;
+}
+
+// static
+bool CpuReader::ParseFieldsWithFastLayout(FastEventLayout layout,
+                                          const Event& info,
+                                          const uint8_t* start,
+                                          const uint8_t* end,
+                                          const ProtoTranslationTable* table,
+                                          protozero::Message* message,
+                                          FtraceMetadata* metadata) {
+  switch (layout) {
+#define PERFETTO_FTRACE_PARSE_FAST_EVENT_LAYOUT(name, ...)             \
+  case FastEventLayout::name:                                          \
+    return ParseFieldsWithLayout<__VA_ARGS__>(info, start, end, table, \
+                                              message, metadata);
+    PERFETTO_FTRACE_FAST_EVENT_LAYOUTS(PERFETTO_FTRACE_PARSE_FAST_EVENT_LAYOUT)
+#undef PERFETTO_FTRACE_PARSE_FAST_EVENT_LAYOUT
+    case FastEventLayout::kNone:
       break;
   }
-  PERFETTO_FATAL("Unexpected translation strategy");
+  PERFETTO_FATAL("Unexpected fast event layout");
 }
 
 bool CpuReader::ParseSysEnter(const Event& info,
@@ -937,6 +1109,43 @@ bool CpuReader::ParseSysExit(const Event& info,
   return true;
 }
 
+// Same as ParseEvent(), but the common pid and the fields of the event are
+// buffered as a row of its CompactEventBuffer, instead of being written as a
+// proto.
+// static
+bool CpuReader::ParseEventCompact(uint16_t ftrace_event_id,
+                                  const uint8_t* start,
+                                  const uint8_t* end,
+                                  uint64_t timestamp,
+                                  const ProtoTranslationTable* table,
+                                  CompactSchedBuffer* compact_buf,
+                                  FtraceMetadata* metadata) {
+  PERFETTO_DCHECK(start < end);
+  const Event& info = *table->GetEventById(ftrace_event_id);
+  if (info.size > static_cast<size_t>(end - start)) {
+    PERFETTO_DFATAL("Buffer overflowed.");
+    return false;
+  }
+
+  // Checked by CreateCompactSchedConfig().
+  const Field* common_pid_field = table->common_pid();
+  PERFETTO_DCHECK(common_pid_field);
+
+  CompactEventBuffer* event_buf = compact_buf->GetOrCreateEventBuffer(&info);
+  event_buf->AppendTimestamp(timestamp);
+  bool success =
+      ParseField(*common_pid_field, start, end, table, event_buf, metadata);
+  for (const Field& field : info.fields) {
+    size_t num_values = event_buf->num_values();
+    success &= ParseField(field, start, end, table, event_buf, metadata);
+    // Keep the rows aligned, even if the field wasn't written.
+    if (event_buf->num_values() == num_values)
+      event_buf->AppendOmittedValue();
+  }
+  metadata->FinishEvent();
+  return success;
+}
+
 // Parse a sched_switch event according to pre-validated format, and buffer the
 // individual fields in the current compact batch. See the code populating
 // |CompactSchedSwitchFormat| for the assumptions made around the format, which
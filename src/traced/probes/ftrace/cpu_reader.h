@@ -22,13 +22,16 @@
 
 #include <optional>
 #include <set>
+#include <vector>
 
+#include "perfetto/ext/base/pipe.h"
 #include "perfetto/ext/base/scoped_file.h"
 #include "perfetto/ext/traced/data_source_types.h"
 #include "perfetto/ext/tracing/core/trace_writer.h"
 #include "perfetto/protozero/message.h"
 #include "perfetto/protozero/message_handle.h"
 #include "src/traced/probes/ftrace/compact_sched.h"
+#include "src/traced/probes/ftrace/fast_event_layout.h"
 #include "src/traced/probes/ftrace/ftrace_metadata.h"
 
 #include "protos/perfetto/trace/trace_packet.pbzero.h"
@@ -114,6 +117,13 @@ class CpuReader {
     bool lost_events;
   };
 
+  // Where the data read by ReadCycle() is written, for one data source.
+  struct DataSourceOutput {
+    TraceWriter* trace_writer;
+    FtraceMetadata* metadata;
+    const FtraceDataSourceConfig* parsing_config;
+  };
+
   CpuReader(size_t cpu,
             base::ScopedFile trace_fd,
             const ProtoTranslationTable* table,
@@ -129,6 +139,25 @@ class CpuReader {
                    size_t max_pages,
                    const std::set<FtraceDataSource*>& started_data_sources);
 
+  // As above, but writes into the given |outputs| rather than into the trace
+  // writer and metadata of the data sources. Used by the CpuReaderWorker-s,
+  // which have their own writers.
+  size_t ReadCycle(uint8_t* parsing_buf,
+                   size_t parsing_buf_size_pages,
+                   size_t max_pages,
+                   const std::vector<DataSourceOutput>& outputs);
+
+  size_t cpu() const { return cpu_; }
+  int trace_fd() const { return *trace_fd_; }
+
+  // Parses the following pages with |table|. Used by the CpuReaderWorker-s,
+  // which get a new copy of the table when it gains events.
+  void set_table(const ProtoTranslationTable* table) { table_ = table; }
+
+  // Makes ReadCycle() read the pages one at a time, as if splice() wasn't
+  // supported.
+  void DisableSpliceForTesting() { splice_state_ = SpliceState::kUnsupported; }
+
   template <typename T>
   static bool ReadAndAdvance(const uint8_t** ptr, const uint8_t* end, T* out) {
     if (*ptr > end - sizeof(T))
@@ -139,44 +168,46 @@ class CpuReader {
     return true;
   }
 
+  // The Read* functions below write into |out|, which is either the
+  // protozero::Message of the event, or a CompactEventBuffer for the events
+  // recorded in the generic compact encoding.
+
   // Caller must do the bounds check:
   // [start + offset, start + offset + sizeof(T))
   // Returns the raw value not the varint.
-  template <typename T>
-  static T ReadIntoVarInt(const uint8_t* start,
-                          uint32_t field_id,
-                          protozero::Message* out) {
+  template <typename T, typename Out>
+  static T ReadIntoVarInt(const uint8_t* start, uint32_t field_id, Out* out) {
     T t;
     memcpy(&t, reinterpret_cast<const void*>(start), sizeof(T));
-    out->AppendVarInt<T>(field_id, t);
+    out->template AppendVarInt<T>(field_id, t);
     return t;
   }
 
-  template <typename T>
+  template <typename T, typename Out>
   static void ReadInode(const uint8_t* start,
                         uint32_t field_id,
-                        protozero::Message* out,
+                        Out* out,
                         FtraceMetadata* metadata) {
     T t = ReadIntoVarInt<T>(start, field_id, out);
     metadata->AddInode(static_cast<Inode>(t));
   }
 
-  template <typename T>
+  template <typename T, typename Out>
   static void ReadDevId(const uint8_t* start,
                         uint32_t field_id,
-                        protozero::Message* out,
+                        Out* out,
                         FtraceMetadata* metadata) {
     T t;
     memcpy(&t, reinterpret_cast<const void*>(start), sizeof(T));
     BlockDeviceID dev_id = TranslateBlockDeviceIDToUserspace<T>(t);
-    out->AppendVarInt<BlockDeviceID>(field_id, dev_id);
+    out->template AppendVarInt<BlockDeviceID>(field_id, dev_id);
     metadata->AddDevice(dev_id);
   }
 
-  template <typename T>
+  template <typename T, typename Out>
   static void ReadSymbolAddr(const uint8_t* start,
                              uint32_t field_id,
-                             protozero::Message* out,
+                             Out* out,
                              FtraceMetadata* metadata) {
     // ReadSymbolAddr is a bit special. In order to not disclose KASLR layout
     // via traces, we put in the trace only a mangled address (which really is
@@ -189,17 +220,19 @@ class CpuReader {
     out->AppendVarInt(field_id, interned_index);
   }
 
+  template <typename Out>
   static void ReadPid(const uint8_t* start,
                       uint32_t field_id,
-                      protozero::Message* out,
+                      Out* out,
                       FtraceMetadata* metadata) {
     int32_t pid = ReadIntoVarInt<int32_t>(start, field_id, out);
     metadata->AddPid(pid);
   }
 
+  template <typename Out>
   static void ReadCommonPid(const uint8_t* start,
                             uint32_t field_id,
-                            protozero::Message* out,
+                            Out* out,
                             FtraceMetadata* metadata) {
     int32_t pid = ReadIntoVarInt<int32_t>(start, field_id, out);
     metadata->AddCommonPid(pid);
@@ -257,13 +290,25 @@ class CpuReader {
                          protozero::Message* message,
                          FtraceMetadata* metadata);
 
+  // |out| is a protozero::Message or a CompactEventBuffer, see ReadIntoVarInt.
+  template <typename Out>
   static bool ParseField(const Field& field,
                          const uint8_t* start,
                          const uint8_t* end,
                          const ProtoTranslationTable* table,
-                         protozero::Message* message,
+                         Out* out,
                          FtraceMetadata* metadata);
 
+  // Parse the fields of an event that has the given |layout| (see
+  // ProtoTranslationTable::GetFastEventLayout), with code specialized for it.
+  static bool ParseFieldsWithFastLayout(FastEventLayout layout,
+                                        const Event& info,
+                                        const uint8_t* start,
+                                        const uint8_t* end,
+                                        const ProtoTranslationTable* table,
+                                        protozero::Message* message,
+                                        FtraceMetadata* metadata);
+
   // Parse a sys_enter event according to the pre-validated expected format
   static bool ParseSysEnter(const Event& info,
                             const uint8_t* start,
@@ -279,6 +324,17 @@ class CpuReader {
                            protozero::Message* message,
                            FtraceMetadata* metadata);
 
+  // Parse a single raw ftrace event, which is recorded in the generic compact
+  // encoding (see CompactSchedConfig::IsCompactEvent), and buffer its fields
+  // in the given compact encoding batch.
+  static bool ParseEventCompact(uint16_t ftrace_event_id,
+                                const uint8_t* start,
+                                const uint8_t* end,
+                                uint64_t timestamp,
+                                const ProtoTranslationTable* table,
+                                CompactSchedBuffer* compact_buf,
+                                FtraceMetadata* metadata);
+
   // Parse a sched_switch event according to pre-validated format, and buffer
   // the individual fields in the given compact encoding batch.
   static void ParseSchedSwitchCompact(const uint8_t* start,
@@ -319,22 +375,49 @@ class CpuReader {
   CpuReader(const CpuReader&) = delete;
   CpuReader& operator=(const CpuReader&) = delete;
 
+  template <TranslationStrategy kStrategy, typename Out>
+  static bool ParseFieldWithStrategy(const Field& field,
+                                     const uint8_t* start,
+                                     const uint8_t* end,
+                                     const ProtoTranslationTable* table,
+                                     Out* out,
+                                     FtraceMetadata* metadata);
+
+  template <TranslationStrategy... kStrategies>
+  static bool ParseFieldsWithLayout(const Event& info,
+                                    const uint8_t* start,
+                                    const uint8_t* end,
+                                    const ProtoTranslationTable* table,
+                                    protozero::Message* message,
+                                    FtraceMetadata* metadata);
+
   // Reads at most |max_pages| of ftrace data, parses it, and writes it
-  // into |started_data_sources|. Returns number of pages read.
+  // into |outputs|. Returns number of pages read.
   // See comment on ftrace_controller.cc:kMaxParsingWorkingSetPages for
   // rationale behind the batching.
-  size_t ReadAndProcessBatch(
-      uint8_t* parsing_buf,
-      size_t max_pages,
-      bool first_batch_in_cycle,
-      const std::set<FtraceDataSource*>& started_data_sources);
+  size_t ReadAndProcessBatch(uint8_t* parsing_buf,
+                             size_t max_pages,
+                             bool first_batch_in_cycle,
+                             const std::vector<DataSourceOutput>& outputs);
+
+  // Moves up to |max_pages| pages, that the kernel has finished writing, into
+  // |parsing_buf|. Returns the number of pages moved, which is 0 if there
+  // aren't any full pages or if splice() isn't usable.
+  size_t SplicePages(uint8_t* parsing_buf, size_t max_pages);
+
+  enum class SpliceState { kUnknown, kSupported, kUnsupported };
 
   const size_t cpu_;
-  const ProtoTranslationTable* const table_;
+  const ProtoTranslationTable* table_;
   LazyKernelSymbolizer* const symbolizer_;
   base::ScopedFile trace_fd_;
   protos::pbzero::FtraceClock ftrace_clock_{};
   const FtraceClockSnapshot* const ftrace_clock_snapshot_;
+  SpliceState splice_state_ = SpliceState::kUnknown;
+  // The pages are spliced from |trace_fd_| into this pipe, which is always
+  // empty in between calls to SplicePages().
+  base::Pipe splice_pipe_;
+  size_t splice_pipe_size_pages_ = 0;
 };
 
 }  // namespace perfetto
@@ -14,19 +14,36 @@
 
 #include <benchmark/benchmark.h>
 
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
 #include <optional>
+#include <thread>
+#include <vector>
 
+#include "perfetto/base/logging.h"
+#include "perfetto/ext/base/file_utils.h"
+#include "perfetto/ext/base/pipe.h"
 #include "perfetto/ext/base/utils.h"
 #include "perfetto/protozero/root_message.h"
 #include "perfetto/protozero/scattered_stream_null_delegate.h"
 #include "perfetto/protozero/scattered_stream_writer.h"
+#include "protos/perfetto/trace/ftrace/ftrace_event_bundle.gen.h"
 #include "protos/perfetto/trace/ftrace/ftrace_event_bundle.pbzero.h"
+#include "protos/perfetto/trace/trace_packet.gen.h"
 #include "src/traced/probes/ftrace/cpu_reader.h"
 #include "src/traced/probes/ftrace/ftrace_config_muxer.h"
 #include "src/traced/probes/ftrace/ftrace_print_filter.h"
 #include "src/traced/probes/ftrace/proto_translation_table.h"
 #include "src/traced/probes/ftrace/test/cpu_reader_support.h"
 #include "src/tracing/core/null_trace_writer.h"
+#include "src/tracing/core/trace_writer_for_testing.h"
 
 namespace perfetto {
 namespace {
@@ -824,26 +841,14 @@ ExamplePage g_full_page_atrace_print{
     )",
 };
 
-// Low level benchmark for the CpuReader::ParsePageHeader and
-// CpuReader::ParsePagePayload functions.
-void DoParse(const ExamplePage& test_case,
-             const std::vector<GroupAndName>& enabled_events,
-             std::optional<FtraceConfig::PrintFilter> print_filter,
-             benchmark::State& state) {
-  NullTraceWriter writer;
-  FtraceMetadata metadata{};
-  CpuReader::Bundler bundler(
-      &writer, &metadata, /*symbolizer=*/nullptr, /*cpu=*/0,
-      /*ftrace_clock_snapshot=*/nullptr,
-      /*ftrace_clock=*/protos::pbzero::FTRACE_CLOCK_UNSPECIFIED,
-      /*compact_sched_enabled=*/false);
-
-  ProtoTranslationTable* table = GetTable(test_case.name);
-  auto page = PageFromXxd(test_case.data);
-
+FtraceDataSourceConfig CreateDataSourceConfig(
+    ProtoTranslationTable* table,
+    const std::vector<GroupAndName>& enabled_events,
+    std::optional<FtraceConfig::PrintFilter> print_filter,
+    const CompactSchedConfig& compact_sched) {
   FtraceDataSourceConfig ds_config{EventFilter{},
                                    EventFilter{},
-                                   DisabledCompactSchedConfigForTesting(),
+                                   compact_sched,
                                    std::nullopt,
                                    {},
                                    {},
@@ -859,31 +864,253 @@ void DoParse(const ExamplePage& test_case,
     ds_config.event_filter.AddEnabledEvent(
         table->EventToFtraceId(enabled_event));
   }
+  return ds_config;
+}
+
+// Low level benchmark for the CpuReader::ParsePageHeader and
+// CpuReader::ParsePagePayload functions.
+void DoParsePage(const uint8_t* page,
+                 ProtoTranslationTable* table,
+                 const std::vector<GroupAndName>& enabled_events,
+                 std::optional<FtraceConfig::PrintFilter> print_filter,
+                 const CompactSchedConfig& compact_sched,
+                 benchmark::State& state) {
+  NullTraceWriter writer;
+  FtraceMetadata metadata{};
+  CpuReader::Bundler bundler(
+      &writer, &metadata, /*symbolizer=*/nullptr, /*cpu=*/0,
+      /*ftrace_clock_snapshot=*/nullptr,
+      /*ftrace_clock=*/protos::pbzero::FTRACE_CLOCK_UNSPECIFIED,
+      compact_sched.enabled);
+  FtraceDataSourceConfig ds_config = CreateDataSourceConfig(
+      table, enabled_events, print_filter, compact_sched);
 
   while (state.KeepRunning()) {
     std::unique_ptr<CompactSchedBuffer> compact_buffer(
         new CompactSchedBuffer());
-    const uint8_t* parse_pos = page.get();
+    const uint8_t* parse_pos = page;
     std::optional<CpuReader::PageHeader> page_header =
         CpuReader::ParsePageHeader(&parse_pos, table->page_header_size_len());
 
     if (!page_header.has_value())
       return;
 
-    CpuReader::ParsePagePayload(parse_pos, &page_header.value(), table,
-                                &ds_config, &bundler, &metadata);
+    size_t parsed = CpuReader::ParsePagePayload(
+        parse_pos, &page_header.value(), table, &ds_config, &bundler,
+        &metadata);
+    PERFETTO_CHECK(parsed == page_header->size);
 
     metadata.Clear();
     bundler.FinalizeAndRunSymbolizer();
   }
 }
 
+void DoParse(const ExamplePage& test_case,
+             const std::vector<GroupAndName>& enabled_events,
+             std::optional<FtraceConfig::PrintFilter> print_filter,
+             benchmark::State& state) {
+  auto page = PageFromXxd(test_case.data);
+  DoParsePage(page.get(), GetTable(test_case.name), enabled_events,
+              print_filter, DisabledCompactSchedConfigForTesting(), state);
+}
+
 void BM_ParsePageFullOfSchedSwitch(benchmark::State& state) {
   DoParse(g_full_page_sched_switch, {GroupAndName("sched", "sched_switch")},
           std::nullopt, state);
 }
 BENCHMARK(BM_ParsePageFullOfSchedSwitch);
 
+// Compares the parser specialized for the layout of sched_switch (arg 1) with
+// the generic one (arg 0).
+void BM_ParsePageFullOfSchedSwitchFastLayout(benchmark::State& state) {
+  ProtoTranslationTable* table = GetTable(g_full_page_sched_switch.name);
+  table->SetFastEventLayoutsEnabledForTesting(state.range(0) != 0);
+  DoParse(g_full_page_sched_switch, {GroupAndName("sched", "sched_switch")},
+          std::nullopt, state);
+  table->SetFastEventLayoutsEnabledForTesting(true);
+
+  // 59 events per page.
+  state.counters["events/s"] = benchmark::Counter(
+      static_cast<double>(state.iterations() * 59),
+      benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_ParsePageFullOfSchedSwitchFastLayout)->Arg(0)->Arg(1);
+
+// The format files of a 64-bit kernel, which has all the events below, each
+// with one of the layouts of fast_event_layout.h.
+constexpr char kFastLayoutTable[] = "android_raven_AOSP.MASTER_5.10.43";
+
+// One event of each layout in fast_event_layout.h that the format files of
+// kFastLayoutTable have.
+const GroupAndName kFastLayoutEvents[] = {
+    GroupAndName("sched", "sched_switch"),
+    GroupAndName("sched", "sched_waking"),
+    GroupAndName("irq", "irq_handler_entry"),
+    GroupAndName("irq", "irq_handler_exit"),
+    GroupAndName("irq", "softirq_entry"),
+    GroupAndName("workqueue", "workqueue_execute_start"),
+    GroupAndName("power", "cpu_frequency"),
+};
+
+// Fills a page with |event_name| events, laid out as the format files of
+// |table| say, with a short string in each string field and zeros elsewhere.
+// Returns the number of events in the page.
+size_t FillPageWithEvents(const ProtoTranslationTable* table,
+                          const GroupAndName& event_name,
+                          uint8_t* page) {
+  static constexpr char kString[] = "benchmark";
+  const Event* event = table->GetEvent(event_name);
+  PERFETTO_CHECK(event);
+  size_t event_size = event->size;
+  for (const Field& field : event->fields) {
+    if (field.strategy == kDataLocToString)
+      event_size += sizeof(kString);
+  }
+  // The size of short records is in the type_len bits of their header, in
+  // units of 4 bytes, up to 28 (see CpuReader::ParsePagePayload()).
+  const size_t record_size = base::AlignUp<4>(event_size);
+  PERFETTO_CHECK(record_size <= 28 * 4);
+  // A 64-bit timestamp and commit (size) field, as in kFastLayoutTable.
+  PERFETTO_CHECK(table->page_header_size_len() == 8);
+  constexpr size_t kPageHeaderSize = 16;
+
+  memset(page, 0, base::kPageSize);
+  size_t num_events = 0;
+  uint8_t* ptr = page + kPageHeaderSize;
+  while (ptr + 4 + record_size <= page + base::kPageSize) {
+    // 1us after the previous event.
+    const uint32_t header =
+        (1000u << 5) | static_cast<uint32_t>(record_size / 4);
+    memcpy(ptr, &header, sizeof(header));
+    uint8_t* const start = ptr + 4;
+    const uint16_t event_id = static_cast<uint16_t>(event->ftrace_event_id);
+    memcpy(start, &event_id, sizeof(event_id));
+    size_t data_loc_offset = event->size;
+    for (const Field& field : event->fields) {
+      if (field.strategy == kFixedCStringToString) {
+        memcpy(start + field.ftrace_offset, kString,
+               std::min<size_t>(sizeof(kString), field.ftrace_size));
+      } else if (field.strategy == kDataLocToString) {
+        const uint32_t data_loc =
+            static_cast<uint32_t>(sizeof(kString) << 16 | data_loc_offset);
+        memcpy(start + field.ftrace_offset, &data_loc, sizeof(data_loc));
+        memcpy(start + data_loc_offset, kString, sizeof(kString));
+        data_loc_offset += sizeof(kString);
+      }
+    }
+    ptr = start + record_size;
+    num_events++;
+  }
+  const uint64_t timestamp = 1000000000;
+  const uint64_t commit = static_cast<uint64_t>(ptr - page - kPageHeaderSize);
+  memcpy(page, &timestamp, sizeof(timestamp));
+  memcpy(page + 8, &commit, sizeof(commit));
+  return num_events;
+}
+
+// Compares the parsers specialized for the layouts of fast_event_layout.h
+// (arg 1 = 1) with the generic one (arg 1 = 0), on a page full of the events
+// kFastLayoutEvents[arg 0].
+void BM_ParsePageFullOfFastLayoutEvents(benchmark::State& state) {
+  ProtoTranslationTable* table = GetTable(kFastLayoutTable);
+  PERFETTO_CHECK(table);
+  const GroupAndName& event_name =
+      kFastLayoutEvents[static_cast<size_t>(state.range(0))];
+  PERFETTO_CHECK(table->GetFastEventLayout(table->EventToFtraceId(
+                     event_name)) != FastEventLayout::kNone);
+  auto page = std::unique_ptr<uint8_t[]>(new uint8_t[base::kPageSize]);
+  size_t num_events = FillPageWithEvents(table, event_name, page.get());
+
+  table->SetFastEventLayoutsEnabledForTesting(state.range(1) != 0);
+  DoParsePage(page.get(), table, {event_name}, std::nullopt,
+              DisabledCompactSchedConfigForTesting(), state);
+  table->SetFastEventLayoutsEnabledForTesting(true);
+
+  state.SetLabel(event_name.name());
+  state.counters["events/s"] = benchmark::Counter(
+      static_cast<double>(state.iterations() * num_events),
+      benchmark::Counter::kIsRate);
+}
+
+void FastLayoutEventsArgs(benchmark::internal::Benchmark* b) {
+  for (size_t i = 0; i < base::ArraySize(kFastLayoutEvents); i++) {
+    for (int64_t fast_layouts : {0, 1})
+      b->Args({static_cast<int64_t>(i), fast_layouts});
+  }
+}
+BENCHMARK(BM_ParsePageFullOfFastLayoutEvents)->Apply(FastLayoutEventsArgs);
+
+// The events of kFastLayoutEvents that can be recorded in the generic compact
+// encoding (see SupportsCompactEncoding()).
+const GroupAndName kCompactEvents[] = {
+    GroupAndName("irq", "irq_handler_entry"),
+    GroupAndName("irq", "irq_handler_exit"),
+    GroupAndName("irq", "softirq_entry"),
+    GroupAndName("workqueue", "workqueue_execute_start"),
+    GroupAndName("power", "cpu_frequency"),
+};
+
+// Returns the size of the FtraceEventBundle that |page| is recorded as.
+size_t BundleSize(const uint8_t* page,
+                  ProtoTranslationTable* table,
+                  const FtraceDataSourceConfig& ds_config) {
+  TraceWriterForTesting writer;
+  FtraceMetadata metadata{};
+  {
+    CpuReader::Bundler bundler(
+        &writer, &metadata, /*symbolizer=*/nullptr, /*cpu=*/0,
+        /*ftrace_clock_snapshot=*/nullptr,
+        /*ftrace_clock=*/protos::pbzero::FTRACE_CLOCK_UNSPECIFIED,
+        ds_config.compact_sched.enabled);
+    const uint8_t* parse_pos = page;
+    std::optional<CpuReader::PageHeader> page_header =
+        CpuReader::ParsePageHeader(&parse_pos, table->page_header_size_len());
+    PERFETTO_CHECK(page_header.has_value());
+    CpuReader::ParsePagePayload(parse_pos, &page_header.value(), table,
+                                &ds_config, &bundler, &metadata);
+  }
+  return writer.GetOnlyTracePacket().ftrace_events().SerializeAsString().size();
+}
+
+// Compares the generic compact encoding (arg 1 = 1) with the normal form
+// (arg 1 = 0) of a page full of the events kCompactEvents[arg 0], both in
+// parsing speed and in size of the output.
+void BM_ParsePageFullOfCompactEvents(benchmark::State& state) {
+  ProtoTranslationTable* table = GetTable(kFastLayoutTable);
+  PERFETTO_CHECK(table);
+  const GroupAndName& event_name =
+      kCompactEvents[static_cast<size_t>(state.range(0))];
+  const Event* event = table->GetEvent(event_name);
+  PERFETTO_CHECK(event && SupportsCompactEncoding(*event));
+  auto page = std::unique_ptr<uint8_t[]>(new uint8_t[base::kPageSize]);
+  size_t num_events = FillPageWithEvents(table, event_name, page.get());
+
+  const bool compact = state.range(1) != 0;
+  std::vector<bool> compact_events(event->ftrace_event_id + 1);
+  compact_events[event->ftrace_event_id] = compact;
+  CompactSchedConfig compact_sched(compact, compact_events);
+  size_t bundle_size = BundleSize(
+      page.get(), table,
+      CreateDataSourceConfig(table, {event_name}, std::nullopt, compact_sched));
+  DoParsePage(page.get(), table, {event_name}, std::nullopt, compact_sched,
+              state);
+
+  state.SetLabel(event_name.name());
+  state.counters["events/s"] = benchmark::Counter(
+      static_cast<double>(state.iterations() * num_events),
+      benchmark::Counter::kIsRate);
+  state.counters["bytes/event"] = benchmark::Counter(
+      static_cast<double>(bundle_size) / static_cast<double>(num_events));
+}
+
+void CompactEventsArgs(benchmark::internal::Benchmark* b) {
+  for (size_t i = 0; i < base::ArraySize(kCompactEvents); i++) {
+    for (int64_t compact : {0, 1})
+      b->Args({static_cast<int64_t>(i), compact});
+  }
+}
+BENCHMARK(BM_ParsePageFullOfCompactEvents)->Apply(CompactEventsArgs);
+
 void BM_ParsePageFullOfPrint(benchmark::State& state) {
   DoParse(g_full_page_print, {GroupAndName("ftrace", "print")}, std::nullopt,
           state);
@@ -984,5 +1211,182 @@ void BM_ProcessPagesFullOfPrint(benchmark::State& state) {
 }
 BENCHMARK(BM_ProcessPagesFullOfPrint)->Range(1, 64);
 
+bool IsBenchmarkFunctionalOnly() {
+  return getenv("BENCHMARK_FUNCTIONAL_TEST_ONLY") != nullptr;
+}
+
+// Same as the defaults of the FtraceController.
+constexpr size_t kParsingBufferSizePages = 32;
+constexpr size_t kMaxPagesPerRead = 256;
+
+// Reads |state.range(0)| pages of sched_switch events from a pipe (which stands
+// for trace_pipe_raw) per iteration, with splice() if |state.range(1)| is set,
+// otherwise with a read() per page.
+void BM_ReadCycleFromPipe(benchmark::State& state) {
+  const size_t num_pages = static_cast<size_t>(state.range(0));
+  const bool use_splice = state.range(1) != 0;
+
+  ProtoTranslationTable* table = GetTable(g_full_page_sched_switch.name);
+  auto page = PageFromXxd(g_full_page_sched_switch.data);
+  FtraceDataSourceConfig ds_config{EventFilter{},
+                                   EventFilter{},
+                                   DisabledCompactSchedConfigForTesting(),
+                                   std::nullopt,
+                                   {},
+                                   {},
+                                   false /*symbolize_ksyms*/,
+                                   false /*preserve_ftrace_buffer*/,
+                                   {}};
+  ds_config.event_filter.AddEnabledEvent(
+      table->EventToFtraceId(GroupAndName("sched", "sched_switch")));
+
+  base::Pipe pipe = base::Pipe::Create();
+  PERFETTO_CHECK(fcntl(*pipe.wr, F_SETPIPE_SZ,
+                       static_cast<int>(num_pages * base::kPageSize)) >= 0);
+  CpuReader reader(/*cpu=*/0, std::move(pipe.rd), table,
+                   /*symbolizer=*/nullptr,
+                   protos::pbzero::FTRACE_CLOCK_UNSPECIFIED,
+                   /*ftrace_clock_snapshot=*/nullptr);
+  if (!use_splice)
+    reader.DisableSpliceForTesting();
+
+  NullTraceWriter writer;
+  FtraceMetadata metadata{};
+  std::vector<CpuReader::DataSourceOutput> outputs{
+      {&writer, &metadata, &ds_config}};
+  auto parsing_buf =
+      std::make_unique<uint8_t[]>(base::kPageSize * kParsingBufferSizePages);
+  for (auto _ : state) {
+    for (size_t i = 0; i < num_pages; i++)
+      PERFETTO_CHECK(base::WriteAll(*pipe.wr, page.get(), base::kPageSize) ==
+                     static_cast<ssize_t>(base::kPageSize));
+    size_t pages = reader.ReadCycle(parsing_buf.get(), kParsingBufferSizePages,
+                                    kMaxPagesPerRead, outputs);
+    PERFETTO_CHECK(pages == num_pages);
+    metadata.Clear();
+  }
+  state.counters["pages/s"] = benchmark::Counter(
+      static_cast<double>(state.iterations() * num_pages),
+      benchmark::Counter::kIsRate);
+}
+
+void ReadCycleFromPipeArgs(benchmark::internal::Benchmark* b) {
+  if (IsBenchmarkFunctionalOnly()) {
+    b->Args({2, 0})->Args({2, 1})->Iterations(10);
+    return;
+  }
+  for (int64_t use_splice : {0, 1}) {
+    for (int64_t num_pages : {1, 8, 32})
+      b->Args({num_pages, use_splice});
+  }
+}
+BENCHMARK(BM_ReadCycleFromPipe)->Apply(ReadCycleFromPipeArgs);
+
+// Reads the cpus assigned to it (each emulated with a pipe) as fast as
+// possible until |stop| is set, like a CpuReaderWorker that is always woken up.
+// With a single reader thread, this is what the controller's thread does at
+// each drain period.
+void ReaderMain(const std::vector<CpuReader*>& cpu_readers,
+                const FtraceDataSourceConfig* ds_config,
+                std::atomic<bool>* stop,
+                std::atomic<uint64_t>* pages_read) {
+  NullTraceWriter writer;
+  FtraceMetadata metadata{};
+  std::vector<CpuReader::DataSourceOutput> outputs{
+      {&writer, &metadata, ds_config}};
+  auto parsing_buf =
+      std::make_unique<uint8_t[]>(base::kPageSize * kParsingBufferSizePages);
+  while (!stop->load(std::memory_order_relaxed)) {
+    size_t pages = 0;
+    for (CpuReader* reader : cpu_readers) {
+      pages += reader->ReadCycle(parsing_buf.get(), kParsingBufferSizePages,
+                                 kMaxPagesPerRead, outputs);
+    }
+    metadata.Clear();
+    if (pages == 0) {
+      std::this_thread::yield();
+      continue;
+    }
+    pages_read->fetch_add(pages, std::memory_order_relaxed);
+  }
+}
+
+// Throughput of the readers when |state.range(0)| cpus are producing a page of
+// sched_switch events per iteration, read by |state.range(1)| threads. A page
+// that doesn't fit into the buffer of its cpu (a pipe, which holds 16 pages by
+// default) is counted as an overrun, as the kernel would overwrite the oldest
+// page of the ring buffer.
+void BM_ReadManyCpus(benchmark::State& state) {
+  const size_t num_cpus = static_cast<size_t>(state.range(0));
+  const size_t num_threads = static_cast<size_t>(state.range(1));
+
+  ProtoTranslationTable* table = GetTable(g_full_page_sched_switch.name);
+  auto page = PageFromXxd(g_full_page_sched_switch.data);
+  FtraceDataSourceConfig ds_config{EventFilter{},
+                                   EventFilter{},
+                                   DisabledCompactSchedConfigForTesting(),
+                                   std::nullopt,
+                                   {},
+                                   {},
+                                   false /*symbolize_ksyms*/,
+                                   false /*preserve_ftrace_buffer*/,
+                                   {}};
+  ds_config.event_filter.AddEnabledEvent(
+      table->EventToFtraceId(GroupAndName("sched", "sched_switch")));
+
+  std::vector<std::unique_ptr<CpuReader>> cpu_readers;
+  std::vector<base::ScopedFile> cpu_buffers;
+  std::vector<std::vector<CpuReader*>> shards(num_threads);
+  for (size_t cpu = 0; cpu < num_cpus; cpu++) {
+    base::Pipe pipe = base::Pipe::Create(base::Pipe::kBothNonBlock);
+    cpu_readers.push_back(std::make_unique<CpuReader>(
+        cpu, std::move(pipe.rd), table, /*symbolizer=*/nullptr,
+        protos::pbzero::FTRACE_CLOCK_UNSPECIFIED,
+        /*ftrace_clock_snapshot=*/nullptr));
+    cpu_buffers.push_back(std::move(pipe.wr));
+    // Same sharding as in FtraceController::StartIfNeeded().
+    shards[cpu % num_threads].push_back(cpu_readers.back().get());
+  }
+
+  std::atomic<bool> stop{false};
+  std::atomic<uint64_t> pages_read{0};
+  std::vector<std::thread> readers;
+  for (size_t i = 0; i < num_threads; i++)
+    readers.emplace_back(ReaderMain, shards[i], &ds_config, &stop, &pages_read);
+
+  uint64_t overruns = 0;
+  for (auto _ : state) {
+    for (base::ScopedFile& cpu_buffer : cpu_buffers) {
+      // Writes of up to PIPE_BUF (a page) into a pipe are atomic.
+      ssize_t res =
+          PERFETTO_EINTR(write(*cpu_buffer, page.get(), base::kPageSize));
+      if (res < 0) {
+        PERFETTO_CHECK(errno == EAGAIN);
+        overruns++;
+      }
+    }
+  }
+
+  stop.store(true);
+  for (std::thread& reader : readers)
+    reader.join();
+
+  state.counters["pages/s"] = benchmark::Counter(
+      static_cast<double>(pages_read.load()), benchmark::Counter::kIsRate);
+  state.counters["overruns"] =
+      benchmark::Counter(static_cast<double>(overruns));
+}
+
+void ReadManyCpusArgs(benchmark::internal::Benchmark* b) {
+  b->UseRealTime();
+  if (IsBenchmarkFunctionalOnly()) {
+    b->Args({4, 1})->Args({4, 2})->Iterations(10);
+    return;
+  }
+  for (int64_t num_threads : {1, 4, 16})
+    b->Args({96, num_threads});
+}
+BENCHMARK(BM_ReadManyCpus)->Apply(ReadManyCpusArgs);
+
 }  // namespace
 }  // namespace perfetto
@@ -21,6 +21,8 @@
 #include <sys/syscall.h>
 
 #include "perfetto/base/build_config.h"
+#include "perfetto/ext/base/file_utils.h"
+#include "perfetto/ext/base/pipe.h"
 #include "perfetto/ext/base/utils.h"
 #include "perfetto/protozero/proto_utils.h"
 #include "perfetto/protozero/scattered_heap_buffer.h"
@@ -40,6 +42,7 @@
 #include "protos/perfetto/trace/ftrace/ftrace_event.pbzero.h"
 #include "protos/perfetto/trace/ftrace/ftrace_event_bundle.gen.h"
 #include "protos/perfetto/trace/ftrace/ftrace_event_bundle.pbzero.h"
+#include "protos/perfetto/trace/ftrace/irq.gen.h"
 #include "protos/perfetto/trace/ftrace/power.gen.h"
 #include "protos/perfetto/trace/ftrace/raw_syscalls.gen.h"
 #include "protos/perfetto/trace/ftrace/sched.gen.h"
@@ -2373,6 +2376,98 @@ TEST_F(CpuReaderParsePagePayloadTest, ParseFullPageSchedSwitch) {
   EXPECT_EQ(bundle.event().size(), 59u);
 }
 
+// The parsers specialized for the layout of the events must produce the same
+// output as the generic one.
+TEST_F(CpuReaderParsePagePayloadTest, FastEventLayoutMatchesGenericParsing) {
+  const ExamplePage* test_case = &g_full_page_sched_switch;
+
+  ProtoTranslationTable* table = GetTable(test_case->name);
+  auto page = PageFromXxd(test_case->data);
+  ASSERT_EQ(table->GetFastEventLayout(
+                table->EventToFtraceId(GroupAndName("sched", "sched_switch"))),
+            FastEventLayout::kSchedSwitch64);
+
+  FtraceDataSourceConfig ds_config = EmptyConfig();
+  ds_config.event_filter.AddEnabledEvent(
+      table->EventToFtraceId(GroupAndName("sched", "sched_switch")));
+
+  std::string serialized[2];
+  std::vector<int32_t> pids[2];
+  for (bool fast_layouts : {true, false}) {
+    table->SetFastEventLayoutsEnabledForTesting(fast_layouts);
+    metadata_.Clear();
+
+    const uint8_t* parse_pos = page.get();
+    std::optional<CpuReader::PageHeader> page_header =
+        CpuReader::ParsePageHeader(&parse_pos, table->page_header_size_len());
+    ASSERT_TRUE(page_header.has_value());
+
+    size_t evt_bytes = CpuReader::ParsePagePayload(
+        parse_pos, &page_header.value(), table, &ds_config,
+        CreateBundler(ds_config), &metadata_);
+    EXPECT_LT(0u, evt_bytes);
+
+    auto bundle = GetBundle();
+    EXPECT_EQ(bundle.event().size(), 59u);
+    serialized[fast_layouts] = bundle.SerializeAsString();
+    pids[fast_layouts].assign(metadata_.pids.begin(), metadata_.pids.end());
+  }
+  // The table is shared with the other tests.
+  table->SetFastEventLayoutsEnabledForTesting(true);
+
+  EXPECT_EQ(serialized[true], serialized[false]);
+  EXPECT_EQ(pids[true], pids[false]);
+}
+
+// The pages are read from a pipe, rather than from trace_pipe_raw, both with
+// splice() and with a read() per page.
+TEST(CpuReaderTest, ReadCycleFromPipe) {
+  const ExamplePage* test_case = &g_full_page_sched_switch;
+  ProtoTranslationTable* table = GetTable(test_case->name);
+  auto page = PageFromXxd(test_case->data);
+
+  FtraceDataSourceConfig ds_config = EmptyConfig();
+  ds_config.event_filter.AddEnabledEvent(
+      table->EventToFtraceId(GroupAndName("sched", "sched_switch")));
+
+  static constexpr size_t kParsingBufPages = 2;
+  auto parsing_buf =
+      std::make_unique<uint8_t[]>(base::kPageSize * kParsingBufPages);
+
+  for (bool use_splice : {true, false}) {
+    base::Pipe pipe = base::Pipe::Create();
+    CpuReader reader(/*cpu=*/1, std::move(pipe.rd), table,
+                     /*symbolizer=*/nullptr,
+                     protos::pbzero::FTRACE_CLOCK_UNSPECIFIED,
+                     /*ftrace_clock_snapshot=*/nullptr);
+    if (!use_splice)
+      reader.DisableSpliceForTesting();
+    for (size_t i = 0; i < 3; i++) {
+      ASSERT_EQ(base::WriteAll(*pipe.wr, page.get(), base::kPageSize),
+                static_cast<ssize_t>(base::kPageSize));
+    }
+
+    FtraceMetadata metadata{};
+    TraceWriterForTesting trace_writer;
+    std::vector<CpuReader::DataSourceOutput> outputs{
+        {&trace_writer, &metadata, &ds_config}};
+    EXPECT_EQ(reader.ReadCycle(parsing_buf.get(), kParsingBufPages,
+                               /*max_pages=*/16, outputs),
+              3u);
+    // The pipe is empty now.
+    EXPECT_EQ(reader.ReadCycle(parsing_buf.get(), kParsingBufPages,
+                               /*max_pages=*/16, outputs),
+              0u);
+
+    size_t num_events = 0;
+    for (const auto& packet : trace_writer.GetAllTracePackets()) {
+      EXPECT_EQ(packet.ftrace_events().cpu(), 1u);
+      num_events += packet.ftrace_events().event().size();
+    }
+    EXPECT_EQ(num_events, 3 * 59u);
+  }
+}
+
 // clang-format off
 // # tracer: nop
 // #
@@ -2457,6 +2552,88 @@ TEST_F(CpuReaderParsePagePayloadTest, ParseSuspendResume) {
   EXPECT_EQ(bundle.event()[4].suspend_resume().action(), "");
 }
 
+// Three irq_handler_entry events, written by hand with the format of the
+// android_raven kernel. The name of the second one is a __data_loc of length 0,
+// which is omitted from the normal form.
+//   irq=3 name=arch_timer (pid 42)
+//   irq=5 name=<length 0> (pid 42)
+//   irq=3 name=arch_timer (pid 0)
+static ExamplePage g_irq_handler_entry{
+    "android_raven_AOSP.MASTER_5.10.43",
+    R"(
+00000000: 0000 0001 0000 0000 5400 0000 0000 0000  ........T.......
+00000010: 077d 0000 4500 0100 2a00 0000 0300 0000  .}..E...*.......
+00000020: 1000 0b00 6172 6368 5f74 696d 6572 0000  ....arch_timer..
+00000030: 8402 0000 4500 0100 2a00 0000 0500 0000  ....E...*.......
+00000040: 0000 0000 c703 0000 4500 0100 0000 0000  ........E.......
+00000050: 0300 0000 1000 0b00 6172 6368 5f74 696d  ........arch_tim
+00000060: 6572 0000 0000 0000 0000 0000 0000 0000  er..............
+    )",
+};
+
+TEST_F(CpuReaderParsePagePayloadTest, ParseIrqHandlerEntryCompactFormat) {
+  const ExamplePage* test_case = &g_irq_handler_entry;
+
+  ProtoTranslationTable* table = GetTable(test_case->name);
+  auto page = PageFromXxd(test_case->data);
+
+  uint32_t irq_handler_entry_id =
+      table->EventToFtraceId(GroupAndName("irq", "irq_handler_entry"));
+  std::vector<bool> compact_events(irq_handler_entry_id + 1);
+  compact_events[irq_handler_entry_id] = true;
+  FtraceDataSourceConfig ds_config{EventFilter{},
+                                   EventFilter{},
+                                   CompactSchedConfig{/*enabled=*/true,
+                                                      compact_events},
+                                   std::nullopt,
+                                   {},
+                                   {},
+                                   false /* symbolize_ksyms*/,
+                                   false /*preserve_ftrace_buffer*/,
+                                   {}};
+  ds_config.event_filter.AddEnabledEvent(irq_handler_entry_id);
+
+  const uint8_t* parse_pos = page.get();
+  std::optional<CpuReader::PageHeader> page_header =
+      CpuReader::ParsePageHeader(&parse_pos, table->page_header_size_len());
+  ASSERT_TRUE(page_header.has_value());
+
+  size_t evt_bytes = CpuReader::ParsePagePayload(
+      parse_pos, &page_header.value(), table, &ds_config,
+      CreateBundler(ds_config), &metadata_);
+  EXPECT_EQ(evt_bytes, page_header->size);
+  auto bundle = GetBundle();
+  EXPECT_THAT(bundle.event(), IsEmpty());
+  ASSERT_EQ(bundle.compact_sched().event_columns().size(), 1u);
+
+  const auto& columns = bundle.compact_sched().event_columns()[0];
+  EXPECT_EQ(columns.event_field_id(),
+            static_cast<uint32_t>(
+                protos::gen::FtraceEvent::kIrqHandlerEntryFieldNumber));
+  EXPECT_THAT(columns.timestamp(), ElementsAre(0x1000000u + 1000u, 20u, 30u));
+  EXPECT_THAT(columns.pid(), ElementsAre(42, 42, 0));
+  ASSERT_EQ(columns.column().size(), 2u);
+
+  const auto& irq = columns.column()[0];
+  EXPECT_EQ(irq.field_id(), static_cast<uint32_t>(
+                                protos::gen::IrqHandlerEntryFtraceEvent::
+                                    kIrqFieldNumber));
+  EXPECT_FALSE(irq.interned_string());
+  EXPECT_THAT(irq.value(), ElementsAre(3u, 5u, 3u));
+  EXPECT_THAT(irq.omitted_event(), IsEmpty());
+
+  // The name of the second event is omitted, rather than recorded as "".
+  const auto& name = columns.column()[1];
+  EXPECT_EQ(name.field_id(), static_cast<uint32_t>(
+                                 protos::gen::IrqHandlerEntryFtraceEvent::
+                                     kNameFieldNumber));
+  EXPECT_TRUE(name.interned_string());
+  EXPECT_THAT(name.value(), ElementsAre(0u, 0u));
+  EXPECT_THAT(name.omitted_event(), ElementsAre(1u));
+  EXPECT_THAT(bundle.compact_sched().event_intern_table(),
+              ElementsAre("arch_timer"));
+}
+
 // clang-format off
 // # tracer: nop
 // #
@@ -0,0 +1,270 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/traced/probes/ftrace/cpu_reader_worker.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "perfetto/base/logging.h"
+#include "perfetto/ext/base/utils.h"
+#include "src/traced/probes/ftrace/ftrace_config_muxer.h"
+#include "src/traced/probes/ftrace/ftrace_data_source.h"
+#include "src/traced/probes/ftrace/proto_translation_table.h"
+
+namespace perfetto {
+namespace {
+
+// FtraceDataSourceConfig isn't copyable, as its EventFilter-s aren't.
+std::unique_ptr<const FtraceDataSourceConfig> CopyParsingConfig(
+    const FtraceDataSourceConfig& config) {
+  EventFilter event_filter;
+  event_filter.EnableEventsFrom(config.event_filter);
+  EventFilter syscall_filter;
+  syscall_filter.EnableEventsFrom(config.syscall_filter);
+  return std::make_unique<FtraceDataSourceConfig>(
+      std::move(event_filter), std::move(syscall_filter), config.compact_sched,
+      config.print_filter, config.atrace_apps, config.atrace_categories,
+      config.symbolize_ksyms, config.preserve_ftrace_buffer,
+      config.syscalls_returning_fd);
+}
+
+}  // namespace
+
+CpuReaderWorker::CpuReaderWorker(
+    const std::string& thread_name,
+    std::vector<std::unique_ptr<CpuReader>> cpu_readers,
+    std::shared_ptr<const ProtoTranslationTable> table,
+    std::shared_ptr<LazyKernelSymbolizer> symbolizer,
+    size_t parsing_buf_size_pages,
+    size_t max_pages_per_read,
+    size_t period_page_quota)
+    : symbolizer_(std::move(symbolizer)),
+      table_(std::move(table)),
+      parsing_buf_size_pages_(parsing_buf_size_pages),
+      max_pages_per_read_(max_pages_per_read),
+      parsing_mem_(base::PagedMemory::Allocate(base::kPageSize *
+                                               parsing_buf_size_pages)),
+      task_runner_(base::ThreadTaskRunner::CreateAndStart(thread_name)) {
+  // The worker thread doesn't run any task before the constructor returns.
+  cpus_.reserve(cpu_readers.size());
+  for (std::unique_ptr<CpuReader>& reader : cpu_readers)
+    cpus_.emplace_back(std::move(reader), period_page_quota);
+}
+
+CpuReaderWorker::~CpuReaderWorker() = default;
+
+// static
+void CpuReaderWorker::Destroy(std::unique_ptr<CpuReaderWorker> worker,
+                              base::TaskRunner* task_runner,
+                              std::function<void()> callback) {
+  // Owned by the tasks from now on, as tasks must be copyable.
+  CpuReaderWorker* worker_ptr = worker.release();
+  worker_ptr->Stop([worker_ptr, task_runner, callback] {
+    task_runner->PostTask([worker_ptr, callback] {
+      // The worker thread has nothing left to do, so this doesn't block.
+      delete worker_ptr;
+      callback();
+    });
+  });
+}
+
+void CpuReaderWorker::AddDataSource(FtraceDataSource* data_source) {
+  FtraceConfigId config_id = data_source->config_id();
+  data_sources_[config_id] = data_source;
+
+  // Shared with the task, as tasks must be copyable.
+  auto state = std::make_shared<DataSourceState>();
+  state->trace_writer = data_source->CreateTraceWriter();
+  state->parsing_config = CopyParsingConfig(*data_source->parsing_config());
+  task_runner_.PostTask([this, config_id, state] {
+    worker_data_sources_[config_id] = std::move(*state);
+    UpdateOutputs();
+    for (size_t i = 0; i < cpus_.size(); i++)
+      ArmWatch(i);
+  });
+}
+
+void CpuReaderWorker::RemoveDataSource(FtraceDataSource* data_source) {
+  FtraceConfigId config_id = data_source->config_id();
+  data_sources_.erase(config_id);
+  {
+    std::lock_guard<std::mutex> lock(published_metadata_mutex_);
+    published_metadata_.erase(config_id);
+  }
+  task_runner_.PostTask([this, config_id] {
+    worker_data_sources_.erase(config_id);
+    UpdateOutputs();
+  });
+}
+
+void CpuReaderWorker::UpdateTable(
+    std::shared_ptr<const ProtoTranslationTable> table) {
+  task_runner_.PostTask([this, table] {
+    table_ = table;
+    for (PerCpuState& cpu : cpus_)
+      cpu.reader->set_table(table_.get());
+  });
+}
+
+void CpuReaderWorker::StartDrainPeriod(size_t period_page_quota) {
+  task_runner_.PostTask([this, period_page_quota] {
+    PublishMetadata();
+    uint64_t generation = ++generation_;
+    for (size_t i = 0; i < cpus_.size(); i++) {
+      cpus_[i].period_page_quota = period_page_quota;
+      // The cpus that ran out of quota in the previous period were left
+      // without a watch.
+      ArmWatch(i);
+    }
+    ReadAllCpus(generation);
+  });
+}
+
+void CpuReaderWorker::Flush(size_t max_pages, std::function<void()> callback) {
+  task_runner_.PostTask([this, max_pages, callback] {
+    for (size_t i = 0; i < cpus_.size(); i++)
+      ReadCpu(i, max_pages);
+    // The commits are sent by the controller's thread, before it runs the
+    // tasks that |callback| posts to it.
+    for (auto& it : worker_data_sources_)
+      it.second.trace_writer->Flush();
+    PublishMetadata();
+    callback();
+  });
+}
+
+void CpuReaderWorker::Stop(std::function<void()> callback) {
+  task_runner_.PostTask([this, callback] {
+    ++generation_;
+    for (size_t i = 0; i < cpus_.size(); i++)
+      DisarmWatch(i);
+    worker_data_sources_.clear();
+    UpdateOutputs();
+    callback();
+  });
+}
+
+void CpuReaderWorker::ConsumeMetadata() {
+  std::map<FtraceConfigId, FtraceMetadata> metadata;
+  {
+    std::lock_guard<std::mutex> lock(published_metadata_mutex_);
+    metadata.swap(published_metadata_);
+  }
+  for (auto& it : metadata) {
+    // The worker might have published it just before the data source was
+    // removed.
+    auto ds_it = data_sources_.find(it.first);
+    if (ds_it != data_sources_.end())
+      ds_it->second->mutable_metadata()->MergeFrom(it.second);
+  }
+}
+
+void CpuReaderWorker::UpdateOutputs() {
+  outputs_.clear();
+  for (auto& it : worker_data_sources_) {
+    outputs_.push_back({it.second.trace_writer.get(), &it.second.metadata,
+                        it.second.parsing_config.get()});
+  }
+}
+
+// Like the metadata of the data sources on the controller's thread, the
+// metadata of the worker is cleared once per drain period, which also restarts
+// the interning of the kernel symbols.
+void CpuReaderWorker::PublishMetadata() {
+  std::lock_guard<std::mutex> lock(published_metadata_mutex_);
+  for (auto& it : worker_data_sources_) {
+    published_metadata_[it.first].MergeFrom(it.second.metadata);
+    it.second.metadata.Clear();
+  }
+}
+
+size_t CpuReaderWorker::ReadCpu(size_t cpu_index, size_t max_pages) {
+  if (max_pages == 0 || outputs_.empty())
+    return 0;
+  uint8_t* parsing_buf = reinterpret_cast<uint8_t*>(parsing_mem_.Get());
+  return cpus_[cpu_index].reader->ReadCycle(
+      parsing_buf, parsing_buf_size_pages_, max_pages, outputs_);
+}
+
+// Returns true if the cpu stopped at the cap on the number of pages per read,
+// and has quota left to continue in this period.
+bool CpuReaderWorker::ReadCpuWithinQuota(size_t cpu_index) {
+  PerCpuState& cpu = cpus_[cpu_index];
+  size_t max_pages = std::min(cpu.period_page_quota, max_pages_per_read_);
+  size_t pages_read = ReadCpu(cpu_index, max_pages);
+  PERFETTO_DCHECK(pages_read <= max_pages);
+  cpu.period_page_quota -= pages_read;
+  return max_pages > 0 && pages_read == max_pages &&
+         cpu.period_page_quota > 0;
+}
+
+// Same as FtraceController::ReadTickForInstance(), but without any other task
+// to yield to than the reads of the cpus woken up by poll().
+void CpuReaderWorker::ReadAllCpus(uint64_t generation) {
+  if (generation != generation_)
+    return;
+  bool all_cpus_done = true;
+  for (size_t i = 0; i < cpus_.size(); i++) {
+    if (ReadCpuWithinQuota(i))
+      all_cpus_done = false;
+  }
+  if (!all_cpus_done) {
+    task_runner_.PostTask([this, generation] { ReadAllCpus(generation); });
+  }
+}
+
+void CpuReaderWorker::OnCpuReadable(size_t cpu_index) {
+  // The fd stays readable until the cpu is read, so it is watched again only
+  // once we are done with this read.
+  DisarmWatch(cpu_index);
+  ReadCpuAndRearm(cpu_index);
+}
+
+void CpuReaderWorker::ReadCpuAndRearm(size_t cpu_index) {
+  if (ReadCpuWithinQuota(cpu_index)) {
+    // Continue after the reads of the other cpus that are already posted.
+    task_runner_.PostTask([this, cpu_index] { ReadCpuAndRearm(cpu_index); });
+    return;
+  }
+  // On older kernels the fd is readable as soon as the buffer isn't empty,
+  // which would wake us up for every event. Don't poll the cpu again until
+  // some data has accumulated.
+  task_runner_.PostDelayedTask([this, cpu_index] { ArmWatch(cpu_index); },
+                               kMinPollIntervalMs);
+}
+
+void CpuReaderWorker::ArmWatch(size_t cpu_index) {
+  PerCpuState& cpu = cpus_[cpu_index];
+  // Without quota, the cpu isn't read until the next StartDrainPeriod().
+  if (cpu.watch_armed || cpu.period_page_quota == 0 ||
+      worker_data_sources_.empty()) {
+    return;
+  }
+  cpu.watch_armed = true;
+  task_runner_.AddFileDescriptorWatch(
+      cpu.reader->trace_fd(), [this, cpu_index] { OnCpuReadable(cpu_index); });
+}
+
+void CpuReaderWorker::DisarmWatch(size_t cpu_index) {
+  PerCpuState& cpu = cpus_[cpu_index];
+  if (!cpu.watch_armed)
+    return;
+  cpu.watch_armed = false;
+  task_runner_.RemoveFileDescriptorWatch(cpu.reader->trace_fd());
+}
+
+}  // namespace perfetto
@@ -0,0 +1,185 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACED_PROBES_FTRACE_CPU_READER_WORKER_H_
+#define SRC_TRACED_PROBES_FTRACE_CPU_READER_WORKER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "perfetto/base/task_runner.h"
+#include "perfetto/ext/base/paged_memory.h"
+#include "perfetto/ext/base/thread_task_runner.h"
+#include "perfetto/ext/tracing/core/trace_writer.h"
+#include "src/traced/probes/ftrace/cpu_reader.h"
+#include "src/traced/probes/ftrace/ftrace_config_utils.h"
+#include "src/traced/probes/ftrace/ftrace_metadata.h"
+
+namespace perfetto {
+
+class FtraceDataSource;
+struct FtraceDataSourceConfig;
+class LazyKernelSymbolizer;
+class ProtoTranslationTable;
+
+// Reads and parses the ftrace buffers of a subset of the cpus on a dedicated
+// thread, writing into its own trace writer for each data source. Used by the
+// FtraceController instead of reading all the cpus on the main thread, if
+// traced_probes was started with --ftrace-reader-threads.
+//
+// A cpu is read when its trace_pipe_raw fd becomes readable (on recent kernels
+// that happens when the buffer is filled up to buffer_percent, on older ones
+// as soon as it's not empty), and after that at most every
+// |kMinPollIntervalMs|. The controller additionally drains all the cpus at
+// every drain period, which also resets the per-period page quota of the cpus
+// (see FtraceController::ReadTick).
+//
+// All the methods must be called on the controller's thread, and none of them
+// waits for the worker thread: its trace writers stall when the shared memory
+// buffer is full, until the controller's thread sends their commits to the
+// service (see SharedMemoryArbiterImpl::GetNewChunk()). For the same reason
+// the worker has its own copy of the translation table, rather than sharing
+// the one that the controller's thread adds events to.
+class CpuReaderWorker {
+ public:
+  // Minimum interval between two reads of a cpu woken up by poll().
+  static constexpr uint32_t kMinPollIntervalMs = 10;
+
+  // |cpu_readers| must parse with |table| and |symbolizer|, which the worker
+  // keeps alive, as it can outlive the controller (see Destroy()).
+  CpuReaderWorker(const std::string& thread_name,
+                  std::vector<std::unique_ptr<CpuReader>> cpu_readers,
+                  std::shared_ptr<const ProtoTranslationTable> table,
+                  std::shared_ptr<LazyKernelSymbolizer> symbolizer,
+                  size_t parsing_buf_size_pages,
+                  size_t max_pages_per_read,
+                  size_t period_page_quota);
+
+  // Joins the worker thread, so it must not be stalled in a trace writer: call
+  // it only once Stop() has called back, or use Destroy() instead.
+  ~CpuReaderWorker();
+
+  // Stops |worker| like Stop(), then destroys it on |task_runner| and runs
+  // |callback| there. The caller doesn't wait for the worker thread, and can
+  // be destroyed before the worker.
+  static void Destroy(std::unique_ptr<CpuReaderWorker> worker,
+                      base::TaskRunner* task_runner,
+                      std::function<void()> callback);
+
+  // Parses the data read from now on with |table|, a copy of the translation
+  // table of the controller taken after it gained events.
+  void UpdateTable(std::shared_ptr<const ProtoTranslationTable> table);
+
+  // Starts writing the ftrace data into a new trace writer of |data_source|,
+  // parsing it with a copy of the current parsing config of |data_source|.
+  void AddDataSource(FtraceDataSource*);
+
+  // Stops writing into the trace writer of |data_source| and destroys it.
+  void RemoveDataSource(FtraceDataSource*);
+
+  // Publishes the metadata seen in the previous period (see ConsumeMetadata()),
+  // resets the page quota of all the cpus to |period_page_quota|, and reads all
+  // of them.
+  void StartDrainPeriod(size_t period_page_quota);
+
+  // Reads at most |max_pages| from each cpu, flushes the trace writers and
+  // publishes the metadata. Then runs |callback| on the worker thread.
+  void Flush(size_t max_pages, std::function<void()> callback);
+
+  // Stops reading and destroys the trace writers. Then runs |callback| on the
+  // worker thread, after which the worker can be destroyed.
+  void Stop(std::function<void()> callback);
+
+  // Moves the pids, fds and inodes published by the worker thread into the
+  // metadata of the data sources (see FtraceMetadata::MergeFrom), so that the
+  // FtraceController::Observer can act on them.
+  void ConsumeMetadata();
+
+  size_t num_cpus() const { return cpus_.size(); }
+
+ private:
+  struct PerCpuState {
+    PerCpuState(std::unique_ptr<CpuReader> _reader, size_t _period_page_quota)
+        : reader(std::move(_reader)), period_page_quota(_period_page_quota) {}
+    std::unique_ptr<CpuReader> reader;
+    size_t period_page_quota = 0;
+    bool watch_armed = false;
+  };
+
+  struct DataSourceState {
+    std::unique_ptr<TraceWriter> trace_writer;
+    // The config of the data source is owned by the FtraceConfigMuxer, which
+    // destroys it when the data source is removed, maybe in the middle of a
+    // read of this worker.
+    std::unique_ptr<const FtraceDataSourceConfig> parsing_config;
+    // Its kernel symbols are interned on the sequence of |trace_writer|.
+    FtraceMetadata metadata;
+  };
+
+  CpuReaderWorker(const CpuReaderWorker&) = delete;
+  CpuReaderWorker& operator=(const CpuReaderWorker&) = delete;
+
+  // The methods below run on the worker thread.
+  void UpdateOutputs();
+  void PublishMetadata();
+  size_t ReadCpu(size_t cpu_index, size_t max_pages);
+  bool ReadCpuWithinQuota(size_t cpu_index);
+  void ReadAllCpus(uint64_t generation);
+  void OnCpuReadable(size_t cpu_index);
+  void ReadCpuAndRearm(size_t cpu_index);
+  void ArmWatch(size_t cpu_index);
+  void DisarmWatch(size_t cpu_index);
+
+  // Accessed only on the controller's thread.
+  std::map<FtraceConfigId, FtraceDataSource*> data_sources_;
+
+  // The metadata seen by the worker thread, until ConsumeMetadata() merges it
+  // into the metadata of the data sources.
+  std::mutex published_metadata_mutex_;
+  std::map<FtraceConfigId, FtraceMetadata> published_metadata_;
+
+  // Used by the readers in |cpus_|, kept alive for them.
+  const std::shared_ptr<LazyKernelSymbolizer> symbolizer_;
+
+  // The state below is accessed only on the worker thread.
+  // Used by the readers in |cpus_|, replaced by UpdateTable().
+  std::shared_ptr<const ProtoTranslationTable> table_;
+  const size_t parsing_buf_size_pages_;
+  const size_t max_pages_per_read_;
+  base::PagedMemory parsing_mem_;
+  std::vector<PerCpuState> cpus_;
+  std::map<FtraceConfigId, DataSourceState> worker_data_sources_;
+  // Points to the trace writers and metadata in |worker_data_sources_|.
+  std::vector<CpuReader::DataSourceOutput> outputs_;
+  // Bumped by StartDrainPeriod() and Stop(), to stop the continuation of the
+  // previous period's read.
+  uint64_t generation_ = 0;
+
+  // Keep last: it joins the worker thread, so it must be destroyed before the
+  // state above.
+  base::ThreadTaskRunner task_runner_;
+};
+
+}  // namespace perfetto
+
+#endif  // SRC_TRACED_PROBES_FTRACE_CPU_READER_WORKER_H_
@@ -0,0 +1,299 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/traced/probes/ftrace/cpu_reader_worker.h"
+
+#include <chrono>
+#include <future>
+#include <utility>
+
+#include "perfetto/base/time.h"
+#include "perfetto/ext/base/file_utils.h"
+#include "perfetto/ext/base/pipe.h"
+#include "perfetto/ext/base/utils.h"
+#include "src/base/test/test_task_runner.h"
+#include "src/traced/probes/ftrace/ftrace_config_muxer.h"
+#include "src/traced/probes/ftrace/ftrace_controller.h"
+#include "src/traced/probes/ftrace/ftrace_data_source.h"
+#include "src/traced/probes/ftrace/proto_translation_table.h"
+#include "src/traced/probes/ftrace/test/cpu_reader_support.h"
+#include "src/tracing/core/trace_writer_for_testing.h"
+#include "test/gtest_and_gmock.h"
+
+#include "protos/perfetto/trace/ftrace/ftrace_event.gen.h"
+#include "protos/perfetto/trace/ftrace/ftrace_event_bundle.gen.h"
+#include "protos/perfetto/trace/trace_packet.gen.h"
+
+namespace perfetto {
+namespace {
+
+using ::testing::ElementsAre;
+using ::testing::IsEmpty;
+using ::testing::SizeIs;
+
+constexpr size_t kParsingBufferSizePages = 4;
+constexpr size_t kMaxPagesPerRead = 16;
+
+// Same as in cpu_reader_unittest.cc.
+ExamplePage g_six_sched_switch{
+    "synthetic",
+    R"(
+    00000000: 2b16 c3be 90b6 0300 a001 0000 0000 0000  +...............
+    00000010: 1e00 0000 0000 0000 1000 0000 2f00 0103  ............/...
+    00000020: 0300 0000 6b73 6f66 7469 7271 642f 3000  ....ksoftirqd/0.
+    00000030: 0000 0000 0300 0000 7800 0000 0100 0000  ........x.......
+    00000040: 0000 0000 736c 6565 7000 722f 3000 0000  ....sleep.r/0...
+    00000050: 0000 0000 950e 0000 7800 0000 b072 8805  ........x....r..
+    00000060: 2f00 0103 950e 0000 736c 6565 7000 722f  /.......sleep.r/
+    00000070: 3000 0000 0000 0000 950e 0000 7800 0000  0...........x...
+    00000080: 0008 0000 0000 0000 7263 756f 702f 3000  ........rcuop/0.
+    00000090: 0000 0000 0000 0000 0a00 0000 7800 0000  ............x...
+    000000a0: f0b0 4700 2f00 0103 0700 0000 7263 755f  ..G./.......rcu_
+    000000b0: 7072 6565 6d70 7400 0000 0000 0700 0000  preempt.........
+    000000c0: 7800 0000 0100 0000 0000 0000 736c 6565  x...........slee
+    000000d0: 7000 722f 3000 0000 0000 0000 950e 0000  p.r/0...........
+    000000e0: 7800 0000 1001 ef00 2f00 0103 950e 0000  x......./.......
+    000000f0: 736c 6565 7000 722f 3000 0000 0000 0000  sleep.r/0.......
+    00000100: 950e 0000 7800 0000 0008 0000 0000 0000  ....x...........
+    00000110: 7368 0064 0065 722f 3000 0000 0000 0000  sh.d.er/0.......
+    00000120: b90d 0000 7800 0000 f0c7 e601 2f00 0103  ....x......./...
+    00000130: b90d 0000 7368 0064 0065 722f 3000 0000  ....sh.d.er/0...
+    00000140: 0000 0000 b90d 0000 7800 0000 0100 0000  ........x.......
+    00000150: 0000 0000 736c 6565 7000 722f 3000 0000  ....sleep.r/0...
+    00000160: 0000 0000 950e 0000 7800 0000 d030 0e00  ........x....0..
+    00000170: 2f00 0103 950e 0000 736c 6565 7000 722f  /.......sleep.r/
+    00000180: 3000 0000 0000 0000 950e 0000 7800 0000  0...........x...
+    00000190: 4000 0000 0000 0000 6b77 6f72 6b65 722f  @.......kworker/
+    000001a0: 7531 363a 3300 0000 610e 0000 7800 0000  u16:3...a...x...
+    000001b0: 0000 0000 0000 0000 0000 0000 0000 0000  ................
+    )",
+};
+
+// A trace writer which blocks the worker thread, like one stalled on a full
+// shared memory buffer, until |unblock| is set.
+class BlockingTraceWriter : public TraceWriterForTesting {
+ public:
+  explicit BlockingTraceWriter(std::shared_future<void> unblock)
+      : unblock_(std::move(unblock)) {}
+
+  TracePacketHandle NewTracePacket() override {
+    unblock_.wait();
+    return TraceWriterForTesting::NewTracePacket();
+  }
+
+ private:
+  std::shared_future<void> unblock_;
+};
+
+// Each cpu buffer is emulated with a pipe, which is readable with the same
+// semantics as trace_pipe_raw (one page per read).
+class CpuReaderWorkerTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    table_ = GetTable(g_six_sched_switch.name);
+    page_ = PageFromXxd(g_six_sched_switch.data);
+    ds_config_.event_filter.AddEnabledEvent(
+        table_->EventToFtraceId(GroupAndName("sched", "sched_switch")));
+
+    data_source_.reset(new FtraceDataSource(base::WeakPtr<FtraceController>(),
+                                            /*session_id=*/0, FtraceConfig(),
+                                            /*trace_writer=*/nullptr));
+    data_source_->Initialize(/*config_id=*/1, &ds_config_);
+    data_source_->set_trace_writer_factory([this] {
+      auto writer = std::make_unique<TraceWriterForTesting>();
+      writers_.push_back(writer.get());
+      return writer;
+    });
+  }
+
+  std::unique_ptr<CpuReaderWorker> CreateWorker(size_t num_cpus,
+                                                size_t period_page_quota) {
+    std::shared_ptr<const ProtoTranslationTable> table = table_->Copy();
+    std::vector<std::unique_ptr<CpuReader>> readers;
+    for (size_t cpu = 0; cpu < num_cpus; cpu++) {
+      base::Pipe pipe = base::Pipe::Create();
+      readers.push_back(std::make_unique<CpuReader>(
+          cpu, std::move(pipe.rd), table.get(), /*symbolizer=*/nullptr,
+          protos::pbzero::FTRACE_CLOCK_UNSPECIFIED,
+          /*ftrace_clock_snapshot=*/nullptr));
+      cpu_buffers_.push_back(std::move(pipe.wr));
+    }
+    return std::make_unique<CpuReaderWorker>(
+        "test_reader", std::move(readers), std::move(table),
+        /*symbolizer=*/nullptr, kParsingBufferSizePages, kMaxPagesPerRead,
+        period_page_quota);
+  }
+
+  void WritePage(size_t cpu) {
+    ASSERT_EQ(base::WriteAll(*cpu_buffers_[cpu], page_.get(), base::kPageSize),
+              static_cast<ssize_t>(base::kPageSize));
+  }
+
+  // With |max_pages| = 0, this only waits for the tasks posted to the worker
+  // so far and for the metadata to be published.
+  void FlushAndWait(CpuReaderWorker* worker, size_t max_pages) {
+    std::promise<void> flushed;
+    worker->Flush(max_pages, [&flushed] { flushed.set_value(); });
+    flushed.get_future().wait();
+  }
+
+  // Waits for the worker to read the cpus on its own.
+  bool WaitForPids(CpuReaderWorker* worker) {
+    for (int i = 0; i < 5000; i++) {
+      FlushAndWait(worker, /*max_pages=*/0);
+      worker->ConsumeMetadata();
+      if (!data_source_->mutable_metadata()->pids.empty())
+        return true;
+      base::SleepMicroseconds(1000);
+    }
+    return false;
+  }
+
+  ProtoTranslationTable* table_ = nullptr;
+  std::unique_ptr<uint8_t[]> page_;
+  FtraceDataSourceConfig ds_config_{EventFilter{},
+                                    EventFilter{},
+                                    DisabledCompactSchedConfigForTesting(),
+                                    std::nullopt,
+                                    {},
+                                    {},
+                                    false /*symbolize_ksyms*/,
+                                    false /*preserve_ftrace_buffer*/,
+                                    {}};
+  std::unique_ptr<FtraceDataSource> data_source_;
+  std::vector<TraceWriterForTesting*> writers_;
+  std::vector<base::ScopedFile> cpu_buffers_;
+};
+
+TEST_F(CpuReaderWorkerTest, ReadsCpuWhenReadable) {
+  auto worker = CreateWorker(/*num_cpus=*/2, /*period_page_quota=*/16);
+  worker->AddDataSource(data_source_.get());
+  ASSERT_THAT(writers_, SizeIs(1));
+
+  WritePage(/*cpu=*/1);
+  ASSERT_TRUE(WaitForPids(worker.get()));
+
+  std::vector<protos::gen::TracePacket> packets =
+      writers_[0]->GetAllTracePackets();
+  ASSERT_THAT(packets, SizeIs(1));
+  EXPECT_EQ(packets[0].ftrace_events().cpu(), 1u);
+  EXPECT_THAT(packets[0].ftrace_events().event(), SizeIs(6));
+}
+
+TEST_F(CpuReaderWorkerTest, DrainPeriodResetsQuota) {
+  // Without quota, the cpus are not read until the next drain period.
+  auto worker = CreateWorker(/*num_cpus=*/1, /*period_page_quota=*/0);
+  worker->AddDataSource(data_source_.get());
+  WritePage(/*cpu=*/0);
+  FlushAndWait(worker.get(), /*max_pages=*/0);
+  EXPECT_THAT(writers_[0]->GetAllTracePackets(), IsEmpty());
+
+  worker->StartDrainPeriod(/*period_page_quota=*/16);
+  ASSERT_TRUE(WaitForPids(worker.get()));
+  EXPECT_THAT(writers_[0]->GetAllTracePackets(), SizeIs(1));
+}
+
+TEST_F(CpuReaderWorkerTest, FlushReadsAllCpusAndMergesMetadata) {
+  auto worker = CreateWorker(/*num_cpus=*/2, /*period_page_quota=*/0);
+  worker->AddDataSource(data_source_.get());
+  WritePage(/*cpu=*/0);
+  WritePage(/*cpu=*/1);
+
+  FlushAndWait(worker.get(), /*max_pages=*/16);
+  std::vector<protos::gen::TracePacket> packets =
+      writers_[0]->GetAllTracePackets();
+  ASSERT_THAT(packets, SizeIs(2));
+  EXPECT_EQ(packets[0].ftrace_events().cpu(), 0u);
+  EXPECT_EQ(packets[1].ftrace_events().cpu(), 1u);
+
+  FtraceMetadata* metadata = data_source_->mutable_metadata();
+  EXPECT_THAT(metadata->pids, IsEmpty());
+  worker->ConsumeMetadata();
+  EXPECT_THAT(metadata->pids, ElementsAre(3, 7, 10, 3513, 3681, 3733));
+
+  // The metadata of the worker is cleared once consumed.
+  metadata->Clear();
+  worker->ConsumeMetadata();
+  EXPECT_THAT(metadata->pids, IsEmpty());
+}
+
+TEST_F(CpuReaderWorkerTest, RemovedDataSourceIsNotWritten) {
+  auto worker = CreateWorker(/*num_cpus=*/1, /*period_page_quota=*/0);
+  worker->AddDataSource(data_source_.get());
+  worker->RemoveDataSource(data_source_.get());
+  WritePage(/*cpu=*/0);
+  FlushAndWait(worker.get(), /*max_pages=*/16);
+  worker->ConsumeMetadata();
+  EXPECT_THAT(data_source_->mutable_metadata()->pids, IsEmpty());
+}
+
+TEST_F(CpuReaderWorkerTest, NeverWaitsForStalledWorkerThread) {
+  std::promise<void> unblock;
+  std::shared_future<void> unblock_future = unblock.get_future().share();
+  data_source_->set_trace_writer_factory([unblock_future] {
+    return std::make_unique<BlockingTraceWriter>(unblock_future);
+  });
+  auto worker = CreateWorker(/*num_cpus=*/1, /*period_page_quota=*/0);
+  worker->AddDataSource(data_source_.get());
+  WritePage(/*cpu=*/0);
+
+  // The worker thread stalls in the trace writer while flushing, and none of
+  // the calls below must wait for it.
+  std::promise<void> flushed;
+  std::promise<void> stopped;
+  worker->Flush(/*max_pages=*/16, [&flushed] { flushed.set_value(); });
+  worker->ConsumeMetadata();
+  worker->StartDrainPeriod(/*period_page_quota=*/16);
+  worker->RemoveDataSource(data_source_.get());
+  worker->Stop([&stopped] { stopped.set_value(); });
+  std::future<void> stopped_future = stopped.get_future();
+  EXPECT_EQ(stopped_future.wait_for(std::chrono::seconds(0)),
+            std::future_status::timeout);
+
+  unblock.set_value();
+  flushed.get_future().wait();
+  stopped_future.wait();
+  worker->ConsumeMetadata();
+  EXPECT_THAT(data_source_->mutable_metadata()->pids, IsEmpty());
+}
+
+TEST_F(CpuReaderWorkerTest, DestroyDoesNotWaitForStalledWorkerThread) {
+  std::promise<void> unblock;
+  std::shared_future<void> unblock_future = unblock.get_future().share();
+  data_source_->set_trace_writer_factory([unblock_future] {
+    return std::make_unique<BlockingTraceWriter>(unblock_future);
+  });
+  auto worker = CreateWorker(/*num_cpus=*/1, /*period_page_quota=*/0);
+  worker->AddDataSource(data_source_.get());
+  WritePage(/*cpu=*/0);
+  worker->Flush(/*max_pages=*/16, [] {});
+
+  // The worker is destroyed on |task_runner| once it has stopped, after the
+  // trace writer is unblocked. Until then |task_runner| keeps running tasks.
+  base::TestTaskRunner task_runner;
+  CpuReaderWorker::Destroy(std::move(worker), &task_runner,
+                           task_runner.CreateCheckpoint("destroyed"));
+  bool ran_task = false;
+  task_runner.PostTask([&ran_task] { ran_task = true; });
+  task_runner.RunUntilIdle();
+  EXPECT_TRUE(ran_task);
+
+  unblock.set_value();
+  task_runner.RunUntilCheckpoint("destroyed");
+}
+
+}  // namespace
+}  // namespace perfetto
@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/traced/probes/ftrace/fast_event_layout.h"
+
+#include <initializer_list>
+
+#include "protos/perfetto/trace/ftrace/ftrace_event.pbzero.h"
+
+namespace perfetto {
+
+namespace {
+
+bool FieldsMatch(const Event& event,
+                 std::initializer_list<TranslationStrategy> strategies) {
+  if (event.fields.size() != strategies.size())
+    return false;
+  size_t i = 0;
+  for (TranslationStrategy strategy : strategies) {
+    if (event.fields[i++].strategy != strategy)
+      return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+FastEventLayout MatchFastEventLayout(const Event& event) {
+  using protos::pbzero::FtraceEvent;
+  if (event.proto_field_id == FtraceEvent::kGenericFieldNumber ||
+      event.proto_field_id == FtraceEvent::kSysEnterFieldNumber ||
+      event.proto_field_id == FtraceEvent::kSysExitFieldNumber) {
+    return FastEventLayout::kNone;
+  }
+
+#define PERFETTO_FTRACE_MATCH_FAST_EVENT_LAYOUT(name, ...) \
+  if (FieldsMatch(event, {__VA_ARGS__}))                  \
+    return FastEventLayout::name;
+  PERFETTO_FTRACE_FAST_EVENT_LAYOUTS(PERFETTO_FTRACE_MATCH_FAST_EVENT_LAYOUT)
+#undef PERFETTO_FTRACE_MATCH_FAST_EVENT_LAYOUT
+
+  return FastEventLayout::kNone;
+}
+
+}  // namespace perfetto
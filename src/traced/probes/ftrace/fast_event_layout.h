@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACED_PROBES_FTRACE_FAST_EVENT_LAYOUT_H_
+#define SRC_TRACED_PROBES_FTRACE_FAST_EVENT_LAYOUT_H_
+
+#include <stdint.h>
+
+#include "src/traced/probes/ftrace/event_info_constants.h"
+
+namespace perfetto {
+
+// Layouts of the most frequent events (scheduling, irqs, workqueues, cpu
+// frequency and idle), as the translation strategies of their fields, in
+// order. CpuReader::ParseEvent() decodes the events that have one of these
+// layouts with code specialized at compile time for it (see
+// CpuReader::ParseFieldsWithLayout()), instead of switching on the strategy of
+// every field at runtime.
+//
+// An event uses a layout only if the strategies of its fields, which are
+// derived from the format files of the kernel, match it exactly. Otherwise it's
+// parsed by the generic code, so a kernel with a different layout (e.g. a
+// 32-bit long or a missing field) is still parsed correctly.
+//
+// X(name, strategies...)
+#define PERFETTO_FTRACE_FAST_EVENT_LAYOUTS(X)                                 \
+  /* sched_switch, 64-bit kernel. */                                         \
+  X(kSchedSwitch64, kFixedCStringToString, kPid32ToInt32, kInt32ToInt32,     \
+    kInt64ToInt64, kFixedCStringToString, kPid32ToInt32, kInt32ToInt32)      \
+  /* sched_switch, 32-bit kernel. */                                         \
+  X(kSchedSwitch32, kFixedCStringToString, kPid32ToInt32, kInt32ToInt32,     \
+    kInt32ToInt64, kFixedCStringToString, kPid32ToInt32, kInt32ToInt32)      \
+  /* sched_waking, sched_wakeup(_new). */                                    \
+  X(kSchedWaking, kFixedCStringToString, kPid32ToInt32, kInt32ToInt32,       \
+    kInt32ToInt32, kInt32ToInt32)                                            \
+  /* As above, on kernels without the 'success' field. */                    \
+  X(kSchedWakingNoSuccess, kFixedCStringToString, kPid32ToInt32,             \
+    kInt32ToInt32, kInt32ToInt32)                                            \
+  /* irq_handler_entry. */                                                   \
+  X(kIrqHandlerEntry, kInt32ToInt32, kDataLocToString)                       \
+  /* irq_handler_exit. */                                                    \
+  X(kIrqHandlerExit, kInt32ToInt32, kInt32ToInt32)                           \
+  /* softirq_entry, softirq_exit, softirq_raise. */                          \
+  X(kSoftirq, kUint32ToUint32)                                               \
+  /* workqueue_execute_start, workqueue_execute_end. */                      \
+  X(kWorkqueueExecute, kFtraceSymAddr64ToUint64, kFtraceSymAddr64ToUint64)   \
+  /* cpu_frequency, cpu_idle. */                                             \
+  X(kCpuFrequency, kUint32ToUint32, kUint32ToUint32)
+
+enum class FastEventLayout : uint8_t {
+  kNone = 0,
+#define PERFETTO_FTRACE_FAST_EVENT_LAYOUT_ENUM(name, ...) name,
+  PERFETTO_FTRACE_FAST_EVENT_LAYOUTS(PERFETTO_FTRACE_FAST_EVENT_LAYOUT_ENUM)
+#undef PERFETTO_FTRACE_FAST_EVENT_LAYOUT_ENUM
+};
+
+// Returns the layout matching the fields of |event|, or kNone. Always kNone
+// for the events that CpuReader::ParseEvent() special-cases (generic events,
+// sys_enter and sys_exit).
+FastEventLayout MatchFastEventLayout(const Event& event);
+
+}  // namespace perfetto
+
+#endif  // SRC_TRACED_PROBES_FTRACE_FAST_EVENT_LAYOUT_H_
@@ -605,8 +605,11 @@ bool FtraceConfigMuxer::SetupConfig(FtraceConfigId id,
 
     // If someone outside of perfetto is using a non-nop tracer, yield. We can't
     // realistically figure out all notions of "in use" even if we look at
-    // set_event or events/enable, so this is all we check for.
-    if (!request.preserve_ftrace_buffer() && !ftrace_->IsTracingAvailable()) {
+    // set_event or events/enable, so this is all we check for. Our own
+    // function_graph tracer can still be set, until the controller can reset it
+    // (see ResetCurrentTracer()).
+    if (!request.preserve_ftrace_buffer() && !current_state_.funcgraph_on &&
+        !ftrace_->IsTracingAvailable()) {
       PERFETTO_ELOG(
           "ftrace in use by non-Perfetto. Check that %s current_tracer is nop.",
           ftrace_->GetRootPath().c_str());
@@ -723,9 +726,11 @@ bool FtraceConfigMuxer::SetupConfig(FtraceConfigId id,
   // steering in the parser), and we don't want to remove functions midway
   // through a trace (but some might get added).
   if (request.enable_function_graph()) {
-    if (!current_state_.funcgraph_on && !ftrace_->ClearFunctionFilters())
+    // The filters left by data sources that are gone are replaced too.
+    bool clear_filters = !current_state_.funcgraph_on || ds_configs_.empty();
+    if (clear_filters && !ftrace_->ClearFunctionFilters())
       return false;
-    if (!current_state_.funcgraph_on && !ftrace_->ClearFunctionGraphFilters())
+    if (clear_filters && !ftrace_->ClearFunctionGraphFilters())
       return false;
     if (!ftrace_->AppendFunctionFilters(request.function_filters()))
       return false;
@@ -741,8 +746,7 @@ bool FtraceConfigMuxer::SetupConfig(FtraceConfigId id,
     current_state_.funcgraph_on = true;
   }
 
-  auto compact_sched =
-      CreateCompactSchedConfig(request, table_->compact_sched_format());
+  auto compact_sched = CreateCompactSchedConfig(request, table_);
 
   std::optional<FtracePrintFilterConfig> ftrace_print_filter;
   if (request.has_print_filter()) {
@@ -26,6 +26,8 @@
 #include "src/traced/probes/ftrace/proto_translation_table.h"
 #include "test/gtest_and_gmock.h"
 
+#include "protos/perfetto/trace/ftrace/ftrace_event.pbzero.h"
+
 using testing::_;
 using testing::AnyNumber;
 using testing::Contains;
@@ -44,6 +46,7 @@ namespace {
 
 constexpr int kFakeSchedSwitchEventId = 1;
 constexpr int kCgroupMkdirEventId = 12;
+constexpr int kFakeIrqHandlerExitEventId = 15;
 constexpr int kFakePrintEventId = 20;
 constexpr int kSysEnterId = 329;
 
@@ -153,6 +156,12 @@ class FtraceConfigMuxerTest : public ::testing::Test {
       CompactSchedEventFormat compact_format =
           InvalidCompactSchedEventFormatForTesting()) {
     std::vector<Field> common_fields;
+    {
+      Field field = {};
+      field.ftrace_name = "common_pid";
+      field.proto_field_id = protos::pbzero::FtraceEvent::kPidFieldNumber;
+      common_fields.push_back(field);
+    }
     std::vector<Event> events;
     {
       Event event = {};
@@ -202,6 +211,16 @@ class FtraceConfigMuxerTest : public ::testing::Test {
       events.push_back(event);
     }
 
+    {
+      Event event = {};
+      event.name = "irq_handler_exit";
+      event.group = "irq";
+      event.ftrace_event_id = kFakeIrqHandlerExitEventId;
+      event.proto_field_id =
+          protos::pbzero::FtraceEvent::kIrqHandlerExitFieldNumber;
+      events.push_back(event);
+    }
+
     {
       Event event = {};
       event.name = "print";
@@ -1179,6 +1198,57 @@ TEST_F(FtraceConfigMuxerTest, CompactSchedConfig) {
   }
 }
 
+TEST_F(FtraceConfigMuxerTest, CompactSchedConfigWithEvents) {
+  auto valid_compact_format =
+      CompactSchedEventFormat{/*format_valid=*/true, CompactSchedSwitchFormat{},
+                              CompactSchedWakingFormat{}};
+
+  NiceMock<MockFtraceProcfs> ftrace;
+  table_ = CreateFakeTable(valid_compact_format);
+  FtraceConfigMuxer model(&ftrace, table_.get(), GetSyscallTable(), {});
+
+  FtraceConfig config = CreateFtraceConfig(
+      {"sched/sched_switch", "sched/sched_wakeup", "irq/irq_handler_exit"});
+  config.mutable_compact_sched()->set_enabled(true);
+  *config.mutable_compact_sched()->add_events() = "irq/irq_handler_exit";
+  // Unknown and unsupported events are ignored.
+  *config.mutable_compact_sched()->add_events() = "sched/sched_wakeup";
+  *config.mutable_compact_sched()->add_events() = "sched/sched_unknown";
+  *config.mutable_compact_sched()->add_events() = "sched_new";
+
+  // Same events, without enabling the compact encoding.
+  FtraceConfig config_disabled = config;
+  config_disabled.mutable_compact_sched()->set_enabled(false);
+
+  ON_CALL(ftrace, ReadFileIntoString("/root/current_tracer"))
+      .WillByDefault(Return("nop"));
+  ON_CALL(ftrace, ReadFileIntoString("/root/events/enable"))
+      .WillByDefault(Return("0"));
+
+  {
+    FtraceConfigId id = 73;
+    ASSERT_TRUE(model.SetupConfig(id, config));
+    const FtraceDataSourceConfig* ds_config = model.GetDataSourceConfig(id);
+    ASSERT_TRUE(ds_config);
+    EXPECT_TRUE(ds_config->compact_sched.enabled);
+    EXPECT_TRUE(
+        ds_config->compact_sched.IsCompactEvent(kFakeIrqHandlerExitEventId));
+    EXPECT_FALSE(ds_config->compact_sched.IsCompactEvent(10));
+    EXPECT_FALSE(ds_config->compact_sched.IsCompactEvent(11));
+    EXPECT_FALSE(
+        ds_config->compact_sched.IsCompactEvent(kFakeSchedSwitchEventId));
+  }
+  {
+    FtraceConfigId id = 87;
+    ASSERT_TRUE(model.SetupConfig(id, config_disabled));
+    const FtraceDataSourceConfig* ds_config = model.GetDataSourceConfig(id);
+    ASSERT_TRUE(ds_config);
+    EXPECT_FALSE(ds_config->compact_sched.enabled);
+    EXPECT_FALSE(
+        ds_config->compact_sched.IsCompactEvent(kFakeIrqHandlerExitEventId));
+  }
+}
+
 TEST_F(FtraceConfigMuxerTest, CompactSchedConfigWithInvalidFormat) {
   NiceMock<MockFtraceProcfs> ftrace;
   FtraceConfigMuxer model(&ftrace, table_.get(), GetSyscallTable(), {});
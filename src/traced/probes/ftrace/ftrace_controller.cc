@@ -24,7 +24,9 @@
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <string>
+#include <vector>
 
 #include "perfetto/base/build_config.h"
 #include "perfetto/base/logging.h"
@@ -159,7 +161,8 @@ bool HardResetFtraceState() {
 // static
 std::unique_ptr<FtraceController> FtraceController::Create(
     base::TaskRunner* runner,
-    Observer* observer) {
+    Observer* observer,
+    uint32_t num_reader_threads) {
   std::unique_ptr<FtraceProcfs> ftrace_procfs =
       FtraceProcfs::CreateGuessingMountPoint("");
   if (!ftrace_procfs)
@@ -177,9 +180,11 @@ std::unique_ptr<FtraceController> FtraceController::Create(
 
   auto muxer = std::make_unique<FtraceConfigMuxer>(
       ftrace_procfs.get(), table.get(), std::move(syscalls), vendor_evts);
-  return std::unique_ptr<FtraceController>(
+  std::unique_ptr<FtraceController> controller(
       new FtraceController(std::move(ftrace_procfs), std::move(table),
                            std::move(muxer), runner, observer));
+  controller->num_reader_threads_ = num_reader_threads;
+  return controller;
 }
 
 FtraceController::FtraceController(std::unique_ptr<FtraceProcfs> ftrace_procfs,
@@ -189,6 +194,7 @@ FtraceController::FtraceController(std::unique_ptr<FtraceProcfs> ftrace_procfs,
                                    Observer* observer)
     : task_runner_(task_runner),
       observer_(observer),
+      symbolizer_(std::make_shared<LazyKernelSymbolizer>()),
       primary_(std::move(ftrace_procfs), std::move(table), std::move(muxer)),
       weak_factory_(this) {}
 
@@ -199,7 +205,11 @@ FtraceController::~FtraceController() {
   PERFETTO_DCHECK(data_sources_.empty());
   PERFETTO_DCHECK(primary_.started_data_sources.empty());
   PERFETTO_DCHECK(primary_.per_cpu.empty());
-  PERFETTO_DCHECK(secondary_instances_.empty());
+  PERFETTO_DCHECK(primary_.workers.empty());
+  // Only the instances whose reader threads are still stopping can be left.
+  // The threads don't use them, and are destroyed later on |task_runner_|.
+  for (const auto& it : secondary_instances_)
+    PERFETTO_DCHECK(it.second->num_stopping_workers > 0);
 }
 
 uint64_t FtraceController::NowMs() const {
@@ -207,30 +217,77 @@ uint64_t FtraceController::NowMs() const {
 }
 
 void FtraceController::StartIfNeeded(FtraceInstanceState* instance) {
-  using FtraceClock = protos::pbzero::FtraceClock;
   if (instance->started_data_sources.size() > 1)
     return;
+  // The reader threads of the previous session still hold the trace pipes,
+  // which must be closed for its cleanup. The readers are started again once
+  // they are gone, see OnWorkerStopped().
+  if (instance->num_stopping_workers > 0)
+    return;
+  StartReaders(instance);
+}
 
-  // Lazily allocate the memory used for reading & parsing ftrace. In the case
-  // of multiple ftrace instances, this might already be valid.
-  if (!parsing_mem_.IsValid()) {
-    parsing_mem_ =
-        base::PagedMemory::Allocate(base::kPageSize * kParsingBufferSizePages);
-  }
-
+void FtraceController::StartReaders(FtraceInstanceState* instance) {
+  using FtraceClock = protos::pbzero::FtraceClock;
   PERFETTO_DCHECK(instance->per_cpu.empty());
+  PERFETTO_DCHECK(instance->workers.empty());
   size_t num_cpus = instance->ftrace_procfs->NumberOfCpus();
   const auto ftrace_clock = instance->ftrace_config_muxer->ftrace_clock();
-  instance->per_cpu.clear();
-  instance->per_cpu.reserve(num_cpus);
   size_t period_page_quota =
       instance->ftrace_config_muxer->GetPerCpuBufferSizePages();
-  for (size_t cpu = 0; cpu < num_cpus; cpu++) {
-    auto reader = std::make_unique<CpuReader>(
-        cpu, instance->ftrace_procfs->OpenPipeForCpu(cpu),
-        instance->table.get(), &symbolizer_, ftrace_clock,
-        &ftrace_clock_snapshot_);
-    instance->per_cpu.emplace_back(std::move(reader), period_page_quota);
+
+  // The clock snapshots for non-boot clocks are taken on this thread, in
+  // between reads (see MaybeSnapshotFtraceClock()). The reader threads can't
+  // keep their bundles in sync with them.
+  const bool use_reader_threads =
+      num_reader_threads_ > 0 &&
+      ftrace_clock == FtraceClock::FTRACE_CLOCK_UNSPECIFIED;
+  if (use_reader_threads) {
+    // The table gains events on this thread (see AddDataSource()), the reader
+    // threads parse with a copy of it.
+    std::shared_ptr<const ProtoTranslationTable> table =
+        instance->table->Copy();
+
+    // Shard the cpus between the threads. Each thread reads its cpus as their
+    // buffers fill up, so a busy cpu only delays the others of its thread.
+    size_t num_workers = std::min<size_t>(num_reader_threads_, num_cpus);
+    std::vector<std::vector<std::unique_ptr<CpuReader>>> worker_readers(
+        num_workers);
+    for (size_t cpu = 0; cpu < num_cpus; cpu++) {
+      worker_readers[cpu % num_workers].push_back(std::make_unique<CpuReader>(
+          cpu, instance->ftrace_procfs->OpenPipeForCpu(cpu), table.get(),
+          symbolizer_.get(), ftrace_clock,
+          /*ftrace_clock_snapshot=*/nullptr));
+    }
+    instance->workers.reserve(num_workers);
+    for (size_t i = 0; i < num_workers; i++) {
+      instance->workers.push_back(std::make_unique<CpuReaderWorker>(
+          "ftrace_read_" + std::to_string(i), std::move(worker_readers[i]),
+          table, symbolizer_, kParsingBufferSizePages,
+          kMaxPagesPerCpuPerReadTick, period_page_quota));
+    }
+  } else {
+    if (num_reader_threads_ > 0) {
+      PERFETTO_LOG(
+          "Ftrace reader threads require the boot clock, reading ftrace on "
+          "the main thread");
+    }
+
+    // Lazily allocate the memory used for reading & parsing ftrace. In the
+    // case of multiple ftrace instances, this might already be valid.
+    if (!parsing_mem_.IsValid()) {
+      parsing_mem_ = base::PagedMemory::Allocate(base::kPageSize *
+                                                 kParsingBufferSizePages);
+    }
+
+    instance->per_cpu.reserve(num_cpus);
+    for (size_t cpu = 0; cpu < num_cpus; cpu++) {
+      auto reader = std::make_unique<CpuReader>(
+          cpu, instance->ftrace_procfs->OpenPipeForCpu(cpu),
+          instance->table.get(), symbolizer_.get(), ftrace_clock,
+          &ftrace_clock_snapshot_);
+      instance->per_cpu.emplace_back(std::move(reader), period_page_quota);
+    }
   }
 
   // Special case for primary instance: if not using the boot clock, take
@@ -280,6 +337,10 @@ void FtraceController::StartIfNeeded(FtraceInstanceState* instance) {
 // drain period. Therefore we introduce |per_cpu.period_page_quota|. If the
 // consumer wants to handle a high bandwidth of ftrace events, they should set
 // the config values appropriately.
+//
+// With reader threads (see CpuReaderWorker), the reading happens on the
+// threads instead. The ReadTick then only passes the metadata seen by them to
+// the observer and starts the next drain period.
 void FtraceController::ReadTick(int generation) {
   metatrace::ScopedEvent evt(metatrace::TAG_FTRACE,
                              metatrace::FTRACE_READ_TICK);
@@ -309,6 +370,8 @@ void FtraceController::ReadTick(int generation) {
         primary_.ftrace_config_muxer->GetPerCpuBufferSizePages();
     for (auto& per_cpu : primary_.per_cpu)
       per_cpu.period_page_quota = period_page_quota;
+    for (auto& worker : primary_.workers)
+      worker->StartDrainPeriod(period_page_quota);
 
     for (auto& it : secondary_instances_) {
       FtraceInstanceState* instance = it.second.get();
@@ -316,6 +379,8 @@ void FtraceController::ReadTick(int generation) {
       for (auto& per_cpu : instance->per_cpu) {
         per_cpu.period_page_quota = quota;
       }
+      for (auto& worker : instance->workers)
+        worker->StartDrainPeriod(quota);
     }
 
     // Snapshot the clock so the data in the next period will be clock synced as
@@ -346,6 +411,11 @@ bool FtraceController::ReadTickForInstance(FtraceInstanceState* instance) {
   }
 #endif
 
+  if (!instance->workers.empty()) {
+    ConsumeWorkersMetadata(instance);
+    return true;
+  }
+
   bool all_cpus_done = true;
   uint8_t* parsing_buf = reinterpret_cast<uint8_t*>(parsing_mem_.Get());
   for (size_t i = 0; i < instance->per_cpu.size(); i++) {
@@ -392,24 +462,19 @@ void FtraceController::Flush(FlushRequestID flush_id) {
   metatrace::ScopedEvent evt(metatrace::TAG_FTRACE,
                              metatrace::FTRACE_CPU_FLUSH);
 
-  FlushForInstance(&primary_);
+  FlushForInstance(&primary_, flush_id);
   for (auto& it : secondary_instances_) {
-    FlushForInstance(it.second.get());
+    FlushForInstance(it.second.get(), flush_id);
   }
 
-  observer_->OnFtraceDataWrittenIntoDataSourceBuffers();
-
-  for (FtraceDataSource* data_source : primary_.started_data_sources) {
-    data_source->OnFtraceFlushComplete(flush_id);
-  }
-  for (auto& kv : secondary_instances_) {
-    for (FtraceDataSource* data_source : kv.second->started_data_sources) {
-      data_source->OnFtraceFlushComplete(flush_id);
-    }
-  }
+  // Otherwise the flush completes once the reader threads are done, see
+  // OnWorkerFlushed().
+  if (pending_worker_flushes_.count(flush_id) == 0)
+    OnFlushComplete(flush_id);
 }
 
-void FtraceController::FlushForInstance(FtraceInstanceState* instance) {
+void FtraceController::FlushForInstance(FtraceInstanceState* instance,
+                                        FlushRequestID flush_id) {
   if (instance->started_data_sources.empty())
     return;
 
@@ -424,6 +489,50 @@ void FtraceController::FlushForInstance(FtraceInstanceState* instance) {
                                            per_cpubuf_size_pages,
                                            instance->started_data_sources);
   }
+
+  base::TaskRunner* task_runner = task_runner_;
+  auto weak_this = weak_factory_.GetWeakPtr();
+  for (auto& worker : instance->workers) {
+    pending_worker_flushes_[flush_id]++;
+    worker->Flush(per_cpubuf_size_pages, [task_runner, weak_this, flush_id] {
+      task_runner->PostTask([weak_this, flush_id] {
+        if (weak_this)
+          weak_this->OnWorkerFlushed(flush_id);
+      });
+    });
+  }
+}
+
+void FtraceController::OnWorkerFlushed(FlushRequestID flush_id) {
+  auto it = pending_worker_flushes_.find(flush_id);
+  PERFETTO_CHECK(it != pending_worker_flushes_.end());
+  if (--it->second > 0)
+    return;
+  pending_worker_flushes_.erase(it);
+  OnFlushComplete(flush_id);
+}
+
+void FtraceController::OnFlushComplete(FlushRequestID flush_id) {
+  ConsumeWorkersMetadata(&primary_);
+  for (auto& it : secondary_instances_) {
+    ConsumeWorkersMetadata(it.second.get());
+  }
+
+  observer_->OnFtraceDataWrittenIntoDataSourceBuffers();
+
+  for (FtraceDataSource* data_source : primary_.started_data_sources) {
+    data_source->OnFtraceFlushComplete(flush_id);
+  }
+  for (auto& kv : secondary_instances_) {
+    for (FtraceDataSource* data_source : kv.second->started_data_sources) {
+      data_source->OnFtraceFlushComplete(flush_id);
+    }
+  }
+}
+
+void FtraceController::ConsumeWorkersMetadata(FtraceInstanceState* instance) {
+  for (auto& worker : instance->workers)
+    worker->ConsumeMetadata();
 }
 
 // We are not implicitly flushing on Stop. The tracing service is supposed to
@@ -434,21 +543,63 @@ void FtraceController::StopIfNeeded(FtraceInstanceState* instance) {
     return;
 
   instance->per_cpu.clear();
+
+  // The reader threads can be stalled in their trace writers until this thread
+  // sends their commits, so they can't be joined here. They still hold the
+  // trace pipe fds: the rest of the cleanup waits for them, see
+  // OnWorkerStopped().
+  auto weak_this = weak_factory_.GetWeakPtr();
+  for (auto& worker : instance->workers) {
+    instance->num_stopping_workers++;
+    CpuReaderWorker::Destroy(std::move(worker), task_runner_,
+                             [weak_this, instance] {
+                               if (weak_this)
+                                 weak_this->OnWorkerStopped(instance);
+                             });
+  }
+  instance->workers.clear();
+
+  if (instance->num_stopping_workers == 0)
+    OnReadersStopped(instance);
+}
+
+void FtraceController::OnWorkerStopped(FtraceInstanceState* instance) {
+  PERFETTO_CHECK(instance->num_stopping_workers > 0);
+  if (--instance->num_stopping_workers > 0)
+    return;
+
+  if (instance->started_data_sources.empty()) {
+    OnReadersStopped(instance);
+    return;
+  }
+
+  // The instance was started again while its readers were stopping, see
+  // StartIfNeeded(). Reset the tracer like OnReadersStopped() does, and start
+  // reading again.
+  ResetCurrentTracerIfUnused(instance);
+  StartReaders(instance);
+  for (auto& worker : instance->workers) {
+    for (FtraceDataSource* data_source : instance->started_data_sources)
+      worker->AddDataSource(data_source);
+  }
+}
+
+void FtraceController::OnReadersStopped(FtraceInstanceState* instance) {
   if (instance == &primary_) {
     cpu_zero_stats_fd_.reset();
   }
   // Muxer cannot change the current_tracer until we close the trace pipe fds
   // (i.e. per_cpu). Hence an explicit request here.
-  instance->ftrace_config_muxer->ResetCurrentTracer();
+  ResetCurrentTracerIfUnused(instance);
 
   DestroyIfUnusedSeconaryInstance(instance);
 
   // Clean up global state if done with all data sources.
-  if (!data_sources_.empty())
+  if (!data_sources_.empty() || AnyWorkersStopping())
     return;
 
   if (!retain_ksyms_on_stop_) {
-    symbolizer_.Destroy();
+    symbolizer_->Destroy();
   }
   retain_ksyms_on_stop_ = false;
 
@@ -457,6 +608,29 @@ void FtraceController::StopIfNeeded(FtraceInstanceState* instance) {
   }
 }
 
+// With reader threads, the tracer is reset only once they have closed the
+// trace pipes. By then new data sources might have set it up again.
+void FtraceController::ResetCurrentTracerIfUnused(
+    FtraceInstanceState* instance) {
+  for (FtraceDataSource* data_source : data_sources_) {
+    if (data_source->config().enable_function_graph() &&
+        GetInstance(data_source->config().instance_name()) == instance) {
+      return;
+    }
+  }
+  instance->ftrace_config_muxer->ResetCurrentTracer();
+}
+
+bool FtraceController::AnyWorkersStopping() const {
+  if (primary_.num_stopping_workers > 0)
+    return true;
+  for (auto& it : secondary_instances_) {
+    if (it.second->num_stopping_workers > 0)
+      return true;
+  }
+  return false;
+}
+
 bool FtraceController::AddDataSource(FtraceDataSource* data_source) {
   if (!ValidConfig(data_source->config()))
     return false;
@@ -477,6 +651,15 @@ bool FtraceController::AddDataSource(FtraceDataSource* data_source) {
     return false;
   }
 
+  // The config can add events (e.g. generic ones) to the translation table.
+  // The reader threads parse with a copy of it, replace it with a new one.
+  if (!instance->workers.empty()) {
+    std::shared_ptr<const ProtoTranslationTable> table =
+        instance->table->Copy();
+    for (auto& worker : instance->workers)
+      worker->UpdateTable(table);
+  }
+
   const FtraceDataSourceConfig* ds_config =
       instance->ftrace_config_muxer->GetDataSourceConfig(config_id);
   auto it_and_inserted = data_sources_.insert(data_source);
@@ -509,13 +692,16 @@ bool FtraceController::StartDataSource(FtraceDataSource* data_source) {
   // Note that we're already recording data into the kernel ftrace
   // buffers while doing the symbol parsing.
   if (data_source->config().symbolize_ksyms()) {
-    symbolizer_.GetOrCreateKernelSymbolMap();
+    symbolizer_->GetOrCreateKernelSymbolMap();
     // If at least one config sets the KSYMS_RETAIN flag, keep the ksysm map
     // around in StopIfNeeded().
     const auto KRET = FtraceConfig::KSYMS_RETAIN;
     retain_ksyms_on_stop_ |= data_source->config().ksyms_mem_policy() == KRET;
   }
 
+  for (auto& worker : instance->workers)
+    worker->AddDataSource(data_source);
+
   return true;
 }
 
@@ -528,6 +714,8 @@ void FtraceController::RemoveDataSource(FtraceDataSource* data_source) {
       GetOrCreateInstance(data_source->config().instance_name());
   PERFETTO_CHECK(instance);
 
+  for (auto& worker : instance->workers)
+    worker->RemoveDataSource(data_source);
   instance->ftrace_config_muxer->RemoveConfig(data_source->config_id());
   instance->started_data_sources.erase(data_source);
   StopIfNeeded(instance);
@@ -542,8 +730,8 @@ void FtraceController::DumpFtraceStats(FtraceDataSource* data_source,
     return;
 
   DumpAllCpuStats(instance->ftrace_procfs.get(), stats_out);
-  if (symbolizer_.is_valid()) {
-    auto* symbol_map = symbolizer_.GetOrCreateKernelSymbolMap();
+  if (symbolizer_->is_valid()) {
+    auto* symbol_map = symbolizer_->GetOrCreateKernelSymbolMap();
     stats_out->kernel_symbols_parsed =
         static_cast<uint32_t>(symbol_map->num_syms());
     stats_out->kernel_symbols_mem_kb =
@@ -616,6 +804,9 @@ void FtraceController::DestroyIfUnusedSeconaryInstance(
     FtraceInstanceState* instance) {
   if (instance == &primary_)
     return;
+  // Destroyed once its reader threads have stopped, see OnWorkerStopped().
+  if (instance->num_stopping_workers > 0)
+    return;
   for (auto it = secondary_instances_.begin(); it != secondary_instances_.end();
        ++it) {
     if (it->second.get() == instance &&
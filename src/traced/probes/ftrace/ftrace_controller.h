@@ -32,6 +32,7 @@
 #include "perfetto/ext/tracing/core/basic_types.h"
 #include "src/kallsyms/lazy_kernel_symbolizer.h"
 #include "src/traced/probes/ftrace/cpu_reader.h"
+#include "src/traced/probes/ftrace/cpu_reader_worker.h"
 #include "src/traced/probes/ftrace/ftrace_config_utils.h"
 
 namespace perfetto {
@@ -71,7 +72,14 @@ class FtraceController {
   };
 
   // The passed Observer must outlive the returned FtraceController instance.
-  static std::unique_ptr<FtraceController> Create(base::TaskRunner*, Observer*);
+  // If |num_reader_threads| is not 0, the per-cpu buffers are read and parsed
+  // on that many threads (each reading a subset of the cpus, see
+  // CpuReaderWorker) rather than on the |TaskRunner|. This is not supported
+  // with non-boot ftrace clocks, which fall back to reading on the
+  // |TaskRunner|.
+  static std::unique_ptr<FtraceController> Create(base::TaskRunner*,
+                                                  Observer*,
+                                                  uint32_t num_reader_threads);
   virtual ~FtraceController();
 
   bool AddDataSource(FtraceDataSource*) PERFETTO_WARN_UNUSED_RESULT;
@@ -79,7 +87,7 @@ class FtraceController {
   void RemoveDataSource(FtraceDataSource*);
 
   // Force a read of the ftrace buffers. Will call OnFtraceFlushComplete() on
-  // all started data sources.
+  // all started data sources, asynchronously if there are reader threads.
   void Flush(FlushRequestID);
 
   void DumpFtraceStats(FtraceDataSource*, FtraceStats*);
@@ -118,6 +126,11 @@ class FtraceController {
     std::unique_ptr<ProtoTranslationTable> table;
     std::unique_ptr<FtraceConfigMuxer> ftrace_config_muxer;
     std::vector<PerCpuState> per_cpu;  // empty if no started data sources
+    // Used instead of |per_cpu| when reading on reader threads.
+    std::vector<std::unique_ptr<CpuReaderWorker>> workers;
+    // The |workers| of the last stop whose threads haven't stopped yet. They
+    // destroy themselves, see CpuReaderWorker::Destroy().
+    size_t num_stopping_workers = 0;
     std::set<FtraceDataSource*> started_data_sources;
   };
 
@@ -140,10 +153,18 @@ class FtraceController {
   bool ReadTickForInstance(FtraceInstanceState* instance);
   uint32_t GetDrainPeriodMs();
 
-  void FlushForInstance(FtraceInstanceState* instance);
+  void FlushForInstance(FtraceInstanceState* instance, FlushRequestID);
+  void OnWorkerFlushed(FlushRequestID);
+  void OnFlushComplete(FlushRequestID);
+  void ConsumeWorkersMetadata(FtraceInstanceState* instance);
 
   void StartIfNeeded(FtraceInstanceState* instance);
+  void StartReaders(FtraceInstanceState* instance);
   void StopIfNeeded(FtraceInstanceState* instance);
+  void OnWorkerStopped(FtraceInstanceState* instance);
+  void OnReadersStopped(FtraceInstanceState* instance);
+  void ResetCurrentTracerIfUnused(FtraceInstanceState* instance);
+  bool AnyWorkersStopping() const;
 
   FtraceInstanceState* GetOrCreateInstance(const std::string& instance_name);
   void DestroyIfUnusedSeconaryInstance(FtraceInstanceState* instance);
@@ -153,12 +174,16 @@ class FtraceController {
 
   base::TaskRunner* const task_runner_;
   Observer* const observer_;
+  uint32_t num_reader_threads_ = 0;
   base::PagedMemory parsing_mem_;
-  LazyKernelSymbolizer symbolizer_;
+  // Shared with the reader threads, which can outlive the controller.
+  std::shared_ptr<LazyKernelSymbolizer> symbolizer_;
   FtraceConfigId next_cfg_id_ = 1;
   int generation_ = 0;
   bool retain_ksyms_on_stop_ = false;
   std::set<FtraceDataSource*> data_sources_;
+  // Number of reader threads that haven't finished each flush yet.
+  std::map<FlushRequestID, size_t> pending_worker_flushes_;
   // Default tracefs instance (normally /sys/kernel/tracing) is valid for as
   // long as the controller is valid.
   // Secondary instances (i.e. /sys/kernel/tracing/instances/...) are created
@@ -20,6 +20,9 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 
+#include <mutex>
+
+#include "perfetto/base/time.h"
 #include "perfetto/ext/base/file_utils.h"
 #include "src/traced/probes/ftrace/compact_sched.h"
 #include "src/traced/probes/ftrace/cpu_reader.h"
@@ -176,6 +179,10 @@ class MockFtraceProcfs : public FtraceProcfs {
               WriteToFile,
               (const std::string& path, const std::string& str),
               (override));
+  MOCK_METHOD(bool,
+              AppendToFile,
+              (const std::string& path, const std::string& str),
+              (override));
   MOCK_METHOD(size_t, NumberOfCpus, (), (const, override));
   MOCK_METHOD(char, ReadOneCharFromFile, (const std::string& path), (override));
   MOCK_METHOD(bool, ClearFile, (const std::string& path), (override));
@@ -213,6 +220,8 @@ class TestFtraceController : public FtraceController,
   MockTaskRunner* runner() { return runner_.get(); }
   MockFtraceProcfs* procfs() { return primary_procfs_; }
   uint32_t drain_period_ms() { return GetDrainPeriodMs(); }
+  void set_num_reader_threads(uint32_t num) { num_reader_threads_ = num; }
+  size_t num_workers() { return primary_.workers.size(); }
 
   std::unique_ptr<FtraceDataSource> AddFakeDataSource(const FtraceConfig& cfg) {
     std::unique_ptr<FtraceDataSource> data_source(new FtraceDataSource(
@@ -559,6 +568,76 @@ TEST(FtraceControllerTest, PeriodicDrainConfig) {
   }
 }
 
+TEST(FtraceControllerTest, ReaderThreadsRestartOnceStopped) {
+  auto controller = CreateTestController(true /* nice procfs */);
+  controller->set_num_reader_threads(1);
+  ON_CALL(*controller->procfs(), AppendToFile(_, _))
+      .WillByDefault(Return(true));
+  EXPECT_CALL(*controller->procfs(), ReadFileIntoString(_)).Times(AnyNumber());
+
+  // The reader thread posts to the controller's thread once it has stopped.
+  std::mutex tasks_mutex;
+  std::vector<std::function<void()>> tasks;
+  ON_CALL(*controller->runner(), PostTask(_))
+      .WillByDefault(Invoke([&tasks_mutex, &tasks](std::function<void()> task) {
+        std::lock_guard<std::mutex> lock(tasks_mutex);
+        tasks.push_back(std::move(task));
+      }));
+  auto wait_and_run_task = [&tasks_mutex, &tasks] {
+    for (int i = 0; i < 5000; i++) {
+      std::function<void()> task;
+      {
+        std::lock_guard<std::mutex> lock(tasks_mutex);
+        if (!tasks.empty()) {
+          task = std::move(tasks.front());
+          tasks.erase(tasks.begin());
+        }
+      }
+      if (task) {
+        task();
+        return true;
+      }
+      base::SleepMicroseconds(1000);
+    }
+    return false;
+  };
+
+  auto add_data_source = [&controller](bool function_graph) {
+    FtraceConfig config = CreateFtraceConfig({"group/foo"});
+    config.set_enable_function_graph(function_graph);
+    auto data_source = controller->AddFakeDataSource(config);
+    PERFETTO_CHECK(data_source);
+    data_source->set_trace_writer_factory(
+        [] { return std::make_unique<TraceWriterForTesting>(); });
+    return data_source;
+  };
+  std::string current_tracer_path = "/root/current_tracer";
+
+  auto data_source_a = add_data_source(/*function_graph=*/true);
+  ASSERT_TRUE(controller->StartDataSource(data_source_a.get()));
+  EXPECT_EQ(controller->num_workers(), 1u);
+  EXPECT_EQ(controller->procfs()->ReadCurrentTracer(current_tracer_path),
+            "function_graph");
+
+  // Started again before the reader thread has stopped: the cleanup of the
+  // first session resets the tracer, then the new reader thread starts.
+  controller->RemoveDataSource(data_source_a.get());
+  auto data_source_b = add_data_source(/*function_graph=*/false);
+  ASSERT_TRUE(controller->StartDataSource(data_source_b.get()));
+  EXPECT_EQ(controller->num_workers(), 0u);
+  EXPECT_EQ(controller->procfs()->ReadCurrentTracer(current_tracer_path),
+            "function_graph");
+
+  ASSERT_TRUE(wait_and_run_task());
+  EXPECT_EQ(controller->num_workers(), 1u);
+  EXPECT_EQ(controller->procfs()->ReadCurrentTracer(current_tracer_path),
+            "nop");
+
+  controller->RemoveDataSource(data_source_b.get());
+  EXPECT_EQ(controller->num_workers(), 0u);
+  ASSERT_TRUE(wait_and_run_task());
+}
+
 TEST(FtraceMetadataTest, Clear) {
   FtraceMetadata metadata;
   metadata.inode_and_device.insert(std::make_pair(1, 1));
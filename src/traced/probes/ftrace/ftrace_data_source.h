@@ -24,6 +24,7 @@
 #include <string>
 #include <utility>
 
+#include "perfetto/base/logging.h"
 #include "perfetto/ext/base/scoped_file.h"
 #include "perfetto/ext/base/weak_ptr.h"
 #include "perfetto/ext/tracing/core/basic_types.h"
@@ -56,6 +57,8 @@ class FtraceDataSource : public ProbesDataSource {
  public:
   static const ProbesDataSource::Descriptor descriptor;
 
+  using TraceWriterFactory = std::function<std::unique_ptr<TraceWriter>()>;
+
   FtraceDataSource(base::WeakPtr<FtraceController>,
                    TracingSessionID,
                    const FtraceConfig&,
@@ -84,6 +87,17 @@ class FtraceDataSource : public ProbesDataSource {
   FtraceSetupErrors* mutable_setup_errors() { return &setup_errors_; }
   TraceWriter* trace_writer() { return writer_.get(); }
 
+  // Set by ProbesProducer. Used by the FtraceController to create additional
+  // writers, targeting the same buffer as trace_writer(), for its reader
+  // threads.
+  void set_trace_writer_factory(TraceWriterFactory factory) {
+    trace_writer_factory_ = std::move(factory);
+  }
+  std::unique_ptr<TraceWriter> CreateTraceWriter() {
+    PERFETTO_CHECK(trace_writer_factory_);
+    return trace_writer_factory_();
+  }
+
  private:
   // Hands out internal pointers to callbacks.
   FtraceDataSource(const FtraceDataSource&) = delete;
@@ -99,6 +113,7 @@ class FtraceDataSource : public ProbesDataSource {
   FtraceStats stats_before_{};
   FtraceSetupErrors setup_errors_{};
   std::map<FlushRequestID, std::function<void()>> pending_flushes_;
+  TraceWriterFactory trace_writer_factory_;
 
   // -- Fields initialized by the Initialize() call:
   FtraceConfigId config_id_ = 0;
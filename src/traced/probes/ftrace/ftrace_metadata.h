@@ -77,9 +77,8 @@ struct FtraceMetadata {
 #if PERFETTO_DCHECK_IS_ON()
     PERFETTO_DCHECK(seen_device_id);
 #endif
-    static int32_t cached_pid = 0;
-    if (!cached_pid)
-      cached_pid = getpid();
+    // Initialized once, even if the reader threads get here concurrently.
+    static const int32_t cached_pid = getpid();
 
     PERFETTO_DCHECK(last_seen_common_pid);
     PERFETTO_DCHECK(cached_pid == getpid());
@@ -120,6 +119,21 @@ struct FtraceMetadata {
     return it_and_inserted.first->index;
   }
 
+  // Adds the pids, fds and inodes seen by |other| (e.g. the metadata of a
+  // reader thread) to this instance. The kernel symbol addresses are not
+  // merged, as their indexes are specific to the sequence they were written
+  // into.
+  void MergeFrom(const FtraceMetadata& other) {
+    for (const InodeBlockPair& inode : other.inode_and_device)
+      inode_and_device.insert(inode);
+    for (int32_t pid : other.rename_pids)
+      rename_pids.insert(pid);
+    for (int32_t pid : other.pids)
+      AddPid(pid);
+    for (const auto& fd : other.fds)
+      fds.insert(fd);
+  }
+
   void Clear() {
     inode_and_device.clear();
     rename_pids.clear();
@@ -534,6 +534,25 @@ ProtoTranslationTable::ProtoTranslationTable(
       common_pid_ = field;
     }
   }
+  BuildFastEventLayouts();
+}
+
+void ProtoTranslationTable::BuildFastEventLayouts() {
+  fast_event_layouts_.assign(largest_id_ + 1, FastEventLayout::kNone);
+  for (size_t id = 0; id <= largest_id_; id++) {
+    const Event& event = events_[id];
+    if (event.ftrace_event_id)
+      fast_event_layouts_[id] = MatchFastEventLayout(event);
+  }
+}
+
+void ProtoTranslationTable::SetFastEventLayoutsEnabledForTesting(
+    bool enabled) {
+  if (enabled) {
+    BuildFastEventLayouts();
+  } else {
+    fast_event_layouts_.clear();
+  }
 }
 
 const Event* ProtoTranslationTable::GetOrCreateEvent(
@@ -580,6 +599,45 @@ const Event* ProtoTranslationTable::GetOrCreateEvent(
   return e;
 }
 
+std::unique_ptr<ProtoTranslationTable> ProtoTranslationTable::Copy() const {
+  std::vector<Event> events;
+  std::vector<const Event*> generic_events;
+  for (const Event& event : events_) {
+    if (!event.ftrace_event_id)
+      continue;
+    if (event.proto_field_id ==
+        protos::pbzero::FtraceEvent::kGenericFieldNumber) {
+      generic_events.push_back(&event);
+    } else {
+      events.push_back(event);
+    }
+  }
+  std::unique_ptr<ProtoTranslationTable> table(new ProtoTranslationTable(
+      ftrace_procfs_, events, common_fields_, ftrace_page_header_spec_,
+      compact_sched_format_, printk_formats_));
+  for (const Event* event : generic_events)
+    table->CopyGenericEvent(*event);
+  table->fast_event_layouts_ = fast_event_layouts_;
+  return table;
+}
+
+void ProtoTranslationTable::CopyGenericEvent(const Event& event) {
+  if (event.ftrace_event_id > largest_id_) {
+    events_.resize(event.ftrace_event_id + 1);
+    largest_id_ = event.ftrace_event_id;
+  }
+  Event* e = &events_.at(event.ftrace_event_id);
+  *e = event;
+  e->name = InternString(event.name);
+  e->group = InternString(event.group);
+  for (Field& field : e->fields)
+    field.ftrace_name = InternString(field.ftrace_name);
+
+  group_and_name_to_event_[GroupAndName(e->group, e->name)] = e;
+  name_to_events_[e->name].push_back(e);
+  group_to_events_[e->group].push_back(e);
+}
+
 const char* ProtoTranslationTable::InternString(const std::string& str) {
   auto it_and_inserted = interned_strings_.insert(str);
   return it_and_inserted.first->c_str();
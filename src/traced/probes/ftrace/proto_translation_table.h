@@ -28,9 +28,11 @@
 #include <string>
 #include <vector>
 
+#include "perfetto/base/compiler.h"
 #include "perfetto/ext/base/scoped_file.h"
 #include "src/traced/probes/ftrace/compact_sched.h"
 #include "src/traced/probes/ftrace/event_info.h"
+#include "src/traced/probes/ftrace/fast_event_layout.h"
 #include "src/traced/probes/ftrace/format_parser/format_parser.h"
 #include "src/traced/probes/ftrace/printk_formats_parser.h"
 
@@ -174,10 +176,27 @@ class ProtoTranslationTable {
     return compact_sched_format_;
   }
 
+  // Returns the layout of the event with the given id, if it is parsed by a
+  // specialized parser (see fast_event_layout.h).
+  FastEventLayout GetFastEventLayout(size_t id) const {
+    if (PERFETTO_UNLIKELY(id >= fast_event_layouts_.size()))
+      return FastEventLayout::kNone;
+    return fast_event_layouts_[id];
+  }
+
+  // Makes all the events be parsed by the generic parser, to compare the two in
+  // benchmarks and tests.
+  void SetFastEventLayoutsEnabledForTesting(bool enabled);
+
   base::StringView LookupTraceString(uint64_t address) const {
     return printk_formats_.at(address);
   }
 
+  // Returns a copy of the table, including the generic events added so far.
+  // The reader threads parse with a copy (see CpuReaderWorker), as this table
+  // keeps gaining events on the controller's thread.
+  std::unique_ptr<ProtoTranslationTable> Copy() const;
+
  private:
   ProtoTranslationTable(const ProtoTranslationTable&) = delete;
   ProtoTranslationTable& operator=(const ProtoTranslationTable&) = delete;
@@ -188,6 +207,12 @@ class ProtoTranslationTable {
   uint16_t CreateGenericEventField(const FtraceEvent::Field& ftrace_field,
                                    Event& event);
 
+  // Adds the generic |event| of another table, with its strings interned in
+  // this one.
+  void CopyGenericEvent(const Event& event);
+
+  void BuildFastEventLayouts();
+
   const FtraceProcfs* ftrace_procfs_;
   std::deque<Event> events_;
   size_t largest_id_;
@@ -199,6 +224,9 @@ class ProtoTranslationTable {
   FtracePageHeaderSpec ftrace_page_header_spec_{};
   std::set<std::string> interned_strings_;
   CompactSchedEventFormat compact_sched_format_;
+  // Indexed by event id. Only covers the events known at construction time,
+  // the generic events added later are never parsed by specialized parsers.
+  std::vector<FastEventLayout> fast_event_layouts_;
   PrintkMap printk_formats_;
 };
 
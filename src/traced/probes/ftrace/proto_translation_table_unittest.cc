@@ -317,6 +317,42 @@ TEST(TranslationTableTest, CompactSchedFormatParsingSeedData) {
   ASSERT_FALSE(format.format_valid);
 }
 
+TEST(TranslationTableTest, FastEventLayoutsWalleyeData) {
+  std::string path = base::GetTestDataPath(
+      "src/traced/probes/ftrace/test/data/"
+      "android_walleye_OPM5.171019.017.A1_4.4.88/");
+  FtraceProcfs ftrace_procfs(path);
+  auto table = ProtoTranslationTable::Create(
+      &ftrace_procfs, GetStaticEventInfo(), GetStaticCommonFieldsInfo());
+  PERFETTO_CHECK(table);
+  auto layout = [&table](const char* group, const char* name) {
+    return table->GetFastEventLayout(
+        table->EventToFtraceId(GroupAndName(group, name)));
+  };
+
+  // Note: 64 bit long prev_state.
+  EXPECT_EQ(layout("sched", "sched_switch"), FastEventLayout::kSchedSwitch64);
+  EXPECT_EQ(layout("sched", "sched_waking"), FastEventLayout::kSchedWaking);
+  EXPECT_EQ(layout("irq", "irq_handler_entry"),
+            FastEventLayout::kIrqHandlerEntry);
+  EXPECT_EQ(layout("irq", "irq_handler_exit"),
+            FastEventLayout::kIrqHandlerExit);
+  EXPECT_EQ(layout("irq", "softirq_entry"), FastEventLayout::kSoftirq);
+  EXPECT_EQ(layout("workqueue", "workqueue_execute_start"),
+            FastEventLayout::kWorkqueueExecute);
+  EXPECT_EQ(layout("power", "cpu_frequency"), FastEventLayout::kCpuFrequency);
+  EXPECT_EQ(layout("power", "cpu_idle"), FastEventLayout::kCpuFrequency);
+
+  // Parsed by the generic code.
+  EXPECT_EQ(layout("ftrace", "print"), FastEventLayout::kNone);
+  EXPECT_EQ(layout("raw_syscalls", "sys_enter"), FastEventLayout::kNone);
+  EXPECT_EQ(table->GetFastEventLayout(0), FastEventLayout::kNone);
+  EXPECT_EQ(table->GetFastEventLayout(100000), FastEventLayout::kNone);
+
+  table->SetFastEventLayoutsEnabledForTesting(false);
+  EXPECT_EQ(layout("sched", "sched_switch"), FastEventLayout::kNone);
+}
+
 TEST(TranslationTableTest, InferFtraceType) {
   FtraceFieldType type;
 
@@ -526,6 +562,44 @@ print fmt: "some format")"));
   EXPECT_EQ(uint_field.ftrace_offset, 33);
 }
 
+TEST(TranslationTableTest, CopyHasGenericEvents) {
+  MockFtraceProcfs ftrace;
+  ON_CALL(ftrace, ReadPageHeaderFormat()).WillByDefault(Return(""));
+  ON_CALL(ftrace, ReadEventFormat(_, _)).WillByDefault(Return(""));
+  ON_CALL(ftrace, ReadEventFormat("group", "foo"))
+      .WillByDefault(Return(R"(name: foo
+ID: 42
+format:
+	field:unsigned short common_type;	offset:0;	size:2;	signed:0;
+	field:int common_pid;	offset:4;	size:4;	signed:1;
+
+	field:int field_a;	offset:8;	size:4;	signed:1;
+
+print fmt: "some format")"));
+  EXPECT_CALL(ftrace, ReadPageHeaderFormat()).Times(AnyNumber());
+  EXPECT_CALL(ftrace, ReadEventFormat(_, _)).Times(AnyNumber());
+
+  auto table = ProtoTranslationTable::Create(&ftrace, GetStaticEventInfo(),
+                                             GetStaticCommonFieldsInfo());
+  PERFETTO_CHECK(table);
+  GroupAndName group_and_name("group", "foo");
+  ASSERT_TRUE(table->GetOrCreateEvent(group_and_name));
+
+  std::unique_ptr<ProtoTranslationTable> copy = table->Copy();
+  // The strings of the generic event are interned in the copy.
+  table.reset();
+  EXPECT_EQ(copy->largest_id(), 42ul);
+  EXPECT_EQ(copy->EventToFtraceId(group_and_name), 42ul);
+  const Event* e = copy->GetEventById(42);
+  ASSERT_TRUE(e);
+  EXPECT_STREQ(e->name, "foo");
+  EXPECT_STREQ(e->group, "group");
+  ASSERT_EQ(e->fields.size(), 1ul);
+  EXPECT_STREQ(e->fields[0].ftrace_name, "field_a");
+  EXPECT_EQ(e->fields[0].ftrace_offset, 8);
+  EXPECT_EQ(copy->GetEventsByGroup("group")->front(), e);
+}
+
 TEST(EventFilterTest, EnableEventsFrom) {
   EventFilter filter;
   filter.AddEnabledEvent(1);
@@ -22,6 +22,7 @@
 #include "perfetto/base/logging.h"
 #include "perfetto/ext/base/file_utils.h"
 #include "perfetto/ext/base/getopt.h"
+#include "perfetto/ext/base/string_utils.h"
 #include "perfetto/ext/base/unix_task_runner.h"
 #include "perfetto/ext/base/utils.h"
 #include "perfetto/ext/base/version.h"
@@ -33,6 +34,13 @@
 #include "src/traced/probes/probes_producer.h"
 
 namespace perfetto {
+namespace {
+
+// Upper bound for --ftrace-reader-threads. Each thread reads at least one cpu,
+// so the controller never starts more threads than cpus anyway.
+constexpr uint32_t kMaxFtraceReaderThreads = 1024;
+
+}  // namespace
 
 int PERFETTO_EXPORT_ENTRYPOINT ProbesMain(int argc, char** argv) {
   enum LongOption {
@@ -40,15 +48,19 @@ int PERFETTO_EXPORT_ENTRYPOINT ProbesMain(int argc, char** argv) {
     OPT_VERSION,
     OPT_BACKGROUND,
     OPT_RESET_FTRACE,
+    OPT_FTRACE_READER_THREADS,
   };
 
   bool background = false;
   bool reset_ftrace = false;
+  uint32_t ftrace_reader_threads = 0;
 
   static const option long_options[] = {
       {"background", no_argument, nullptr, OPT_BACKGROUND},
       {"cleanup-after-crash", no_argument, nullptr, OPT_CLEANUP_AFTER_CRASH},
       {"reset-ftrace", no_argument, nullptr, OPT_RESET_FTRACE},
+      {"ftrace-reader-threads", required_argument, nullptr,
+       OPT_FTRACE_READER_THREADS},
       {"version", no_argument, nullptr, OPT_VERSION},
       {nullptr, 0, nullptr, 0}};
 
@@ -69,15 +81,27 @@ int PERFETTO_EXPORT_ENTRYPOINT ProbesMain(int argc, char** argv) {
         // This is like --cleanup-after-crash but doesn't quit.
         reset_ftrace = true;
         break;
+      case OPT_FTRACE_READER_THREADS: {
+        // Reads and parses the per-cpu ftrace buffers on this many threads,
+        // rather than on the main thread. See FtraceController::Create().
+        std::optional<uint32_t> threads = base::CStringToUInt32(optarg);
+        if (!threads || *threads > kMaxFtraceReaderThreads) {
+          PERFETTO_ELOG("--ftrace-reader-threads must be in [0, %u]",
+                        kMaxFtraceReaderThreads);
+          return 1;
+        }
+        ftrace_reader_threads = *threads;
+        break;
+      }
       case OPT_VERSION:
         printf("%s\n", base::GetVersionString());
         return 0;
       default:
-        fprintf(
-            stderr,
-            "Usage: %s [--background] [--reset-ftrace] [--cleanup-after-crash] "
-            "[--version]\n",
-            argv[0]);
+        fprintf(stderr,
+                "Usage: %s [--background] [--reset-ftrace] "
+                "[--cleanup-after-crash] [--ftrace-reader-threads N] "
+                "[--version]\n",
+                argv[0]);
         return 1;
     }
   }
@@ -117,6 +141,7 @@ int PERFETTO_EXPORT_ENTRYPOINT ProbesMain(int argc, char** argv) {
 
   base::UnixTaskRunner task_runner;
   ProbesProducer producer;
+  producer.set_ftrace_reader_threads(ftrace_reader_threads);
   // If the TRACED_PROBES_NOTIFY_FD env var is set, write 1 and close the FD,
   // when all data sources have been registered. This is used for //src/tracebox
   // --background-wait, to make sure that the data sources are registered before
@@ -105,11 +105,14 @@ void ProbesProducer::Restart() {
 
   base::TaskRunner* task_runner = task_runner_;
   const char* socket_name = socket_name_;
+  uint32_t ftrace_reader_threads = ftrace_reader_threads_;
 
   // Invoke destructor and then the constructor again.
   this->~ProbesProducer();
   new (this) ProbesProducer();
 
+  ftrace_reader_threads_ = ftrace_reader_threads;
+
   ConnectWithRetries(socket_name, task_runner);
 }
 
@@ -128,7 +131,8 @@ ProbesProducer::CreateDSInstance<FtraceDataSource>(
   ftrace_config.ParseFromString(config.ftrace_config_raw());
   // Lazily create on the first instance.
   if (!ftrace_) {
-    ftrace_ = FtraceController::Create(task_runner_, this);
+    ftrace_ = FtraceController::Create(task_runner_, this,
+                                       ftrace_reader_threads_);
 
     if (!ftrace_) {
       PERFETTO_ELOG("Failed to create FtraceController");
@@ -142,6 +146,9 @@ ProbesProducer::CreateDSInstance<FtraceDataSource>(
   std::unique_ptr<FtraceDataSource> data_source(new FtraceDataSource(
       ftrace_->GetWeakPtr(), session_id, std::move(ftrace_config),
       endpoint_->CreateTraceWriter(buffer_id)));
+  data_source->set_trace_writer_factory([this, buffer_id] {
+    return endpoint_->CreateTraceWriter(buffer_id);
+  });
   if (!ftrace_->AddDataSource(data_source.get())) {
     PERFETTO_ELOG("Failed to setup ftrace");
     return nullptr;
@@ -75,6 +75,12 @@ class ProbesProducer : public Producer, public FtraceController::Observer {
 
   void ActivateTrigger(std::string trigger);
 
+  // Number of threads reading the per-cpu ftrace buffers, see
+  // FtraceController::Create(). Must be called before connecting.
+  void set_ftrace_reader_threads(uint32_t threads) {
+    ftrace_reader_threads_ = threads;
+  }
+
   // Calls `cb` when all data sources have been registered.
   void SetAllDataSourcesRegisteredCb(std::function<void()> cb) {
     all_data_sources_registered_cb_ = cb;
@@ -105,6 +111,7 @@ class ProbesProducer : public Producer, public FtraceController::Observer {
   std::unique_ptr<TracingService::ProducerEndpoint> endpoint_;
   std::unique_ptr<FtraceController> ftrace_;
   bool ftrace_creation_failed_ = false;
+  uint32_t ftrace_reader_threads_ = 0;
   uint32_t connection_backoff_ms_ = 0;
   const char* socket_name_ = nullptr;
 
@@ -0,0 +1,246 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/tracing/core/async_file_writer.h"
+
+#include <inttypes.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include <utility>
+
+#include "perfetto/base/build_config.h"
+#include "perfetto/base/logging.h"
+#include "perfetto/base/task_runner.h"
+#include "perfetto/base/time.h"
+#include "perfetto/ext/base/file_utils.h"
+#include "perfetto/ext/base/scoped_file.h"
+#include "perfetto/ext/base/thread_utils.h"
+#include "src/tracing/core/trace_file_writer.h"
+
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace perfetto {
+
+namespace {
+
+// Buffers kept around for AcquireStorage().
+constexpr size_t kMaxFreeStorage = 2;
+
+base::ScopedFile DuplicateFd(int fd) {
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
+  return base::ScopedFile(_dup(fd));
+#else
+  return base::ScopedFile(dup(fd));
+#endif
+}
+
+}  // namespace
+
+struct AsyncFileWriter::State {
+  State(base::TaskRunner* _task_runner,
+        base::ScopedFile _fd,
+        uint64_t _max_file_size,
+        size_t _max_pending_bytes)
+      : task_runner(_task_runner),
+        fd(std::move(_fd)),
+        max_file_size(_max_file_size),
+        max_pending_bytes(_max_pending_bytes) {}
+
+  base::TaskRunner* const task_runner;
+  base::ScopedFile fd;  // Accessed only by the writer thread.
+  const uint64_t max_file_size;
+  const size_t max_pending_bytes;
+
+  // All the fields below are protected by |mutex|.
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::deque<std::pair<Batch, size_t /*size*/>> queue;
+  std::vector<std::vector<uint8_t>> free_storage;
+  size_t pending_bytes = 0;  // Includes the batch being written, if any.
+  bool stopped = false;
+  bool quit = false;
+  // Cleared when the AsyncFileWriter is destroyed. It's posted with |mutex|
+  // held, so that it's never posted after that.
+  std::function<void()> finish_callback;
+  Stats stats;
+};
+
+AsyncFileWriter::AsyncFileWriter(base::TaskRunner* task_runner,
+                                 int fd,
+                                 uint64_t max_file_size,
+                                 size_t max_pending_bytes)
+    : state_(std::make_shared<State>(task_runner,
+                                     DuplicateFd(fd),
+                                     max_file_size,
+                                     max_pending_bytes)) {
+  if (!state_->fd) {
+    PERFETTO_PLOG("Failed to duplicate the trace file descriptor");
+    state_->stopped = true;
+  }
+  std::thread(&AsyncFileWriter::RunWriterThread, state_).detach();
+}
+
+AsyncFileWriter::~AsyncFileWriter() {
+  {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    state_->quit = true;
+    state_->finish_callback = nullptr;
+  }
+  state_->cv.notify_all();
+}
+
+size_t AsyncFileWriter::available_bytes() {
+  std::lock_guard<std::mutex> lock(state_->mutex);
+  if (state_->stopped || state_->pending_bytes >= state_->max_pending_bytes)
+    return 0;
+  return state_->max_pending_bytes - state_->pending_bytes;
+}
+
+std::vector<uint8_t> AsyncFileWriter::AcquireStorage(size_t size) {
+  std::vector<uint8_t> storage;
+  {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    if (!state_->free_storage.empty()) {
+      storage = std::move(state_->free_storage.back());
+      state_->free_storage.pop_back();
+    }
+  }
+  storage.reserve(size);
+  return storage;
+}
+
+void AsyncFileWriter::Write(Batch batch) {
+  // The size of the data written into the file, including the preambles.
+  size_t size = 0;
+  for (TracePacket& packet : batch.packets)
+    size += std::get<1>(packet.GetProtoPreamble()) + packet.size();
+  if (size == 0)
+    return;
+  {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    PERFETTO_DCHECK(!state_->quit);
+    if (state_->stopped)
+      return;
+    state_->pending_bytes += size;
+    state_->stats.bytes_queued += size;
+    state_->stats.max_pending_bytes =
+        std::max(state_->stats.max_pending_bytes,
+                 uint64_t{state_->pending_bytes});
+    state_->queue.emplace_back(std::move(batch), size);
+  }
+  state_->cv.notify_all();
+}
+
+bool AsyncFileWriter::stopped() {
+  std::lock_guard<std::mutex> lock(state_->mutex);
+  return state_->stopped;
+}
+
+void AsyncFileWriter::Finish(std::function<void()> callback) {
+  {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    PERFETTO_DCHECK(!state_->quit);
+    state_->quit = true;
+    state_->finish_callback = std::move(callback);
+  }
+  state_->cv.notify_all();
+}
+
+AsyncFileWriter::Stats AsyncFileWriter::GetStats() {
+  std::lock_guard<std::mutex> lock(state_->mutex);
+  return state_->stats;
+}
+
+// static
+void AsyncFileWriter::RunWriterThread(std::shared_ptr<State> state) {
+  base::MaybeSetThreadName("TracedFileWriter");
+  TraceFileWriter writer(*state->fd, /*bytes_written=*/0,
+                         state->max_file_size);
+  for (;;) {
+    std::pair<Batch, size_t> batch_and_size;
+    {
+      std::unique_lock<std::mutex> lock(state->mutex);
+      state->cv.wait(lock,
+                     [&state] { return state->quit || !state->queue.empty(); });
+      if (state->queue.empty())
+        break;  // |quit| is set and everything has been written.
+
+      // The batch is removed from |pending_bytes| only once written, so that
+      // the caller can't queue more than |max_pending_bytes| while a slow
+      // write is in progress.
+      batch_and_size = std::move(state->queue.front());
+      state->queue.pop_front();
+    }
+    Batch& batch = batch_and_size.first;
+
+    const auto start = base::GetWallTimeNs();
+    bool ok = true;
+    for (TracePacket& packet : batch.packets) {
+      if (!writer.AppendPacket(&packet)) {
+        ok = false;
+        break;
+      }
+    }
+    if (!writer.Flush())
+      ok = false;
+    const auto end = base::GetWallTimeNs();
+
+    // Drop the packets before recycling the storage they point to.
+    batch.packets.clear();
+    batch.storage.clear();
+    {
+      std::lock_guard<std::mutex> lock(state->mutex);
+      state->pending_bytes -= batch_and_size.second;
+      state->stats.bytes_written = writer.bytes_written();
+      state->stats.write_time_ns +=
+          static_cast<uint64_t>((end - start).count());
+      if (state->free_storage.size() < kMaxFreeStorage &&
+          batch.storage.capacity() > 0) {
+        state->free_storage.emplace_back(std::move(batch.storage));
+      }
+      if (!ok && !state->stopped) {
+        PERFETTO_ELOG("Stopped writing into the trace file (size: %" PRIu64
+                      ")",
+                      writer.bytes_written());
+        state->stopped = true;
+        for (const auto& dropped : state->queue)
+          state->pending_bytes -= dropped.second;
+        state->queue.clear();
+      }
+    }
+  }
+
+  // Ensure all the data was written to the file before closing it.
+  if (state->fd) {
+    base::FlushFile(*state->fd);
+    state->fd.reset();
+  }
+
+  std::lock_guard<std::mutex> lock(state->mutex);
+  if (state->finish_callback)
+    state->task_runner->PostTask(std::move(state->finish_callback));
+}
+
+}  // namespace perfetto
@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACING_CORE_ASYNC_FILE_WRITER_H_
+#define SRC_TRACING_CORE_ASYNC_FILE_WRITER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "perfetto/ext/tracing/core/trace_packet.h"
+
+namespace perfetto {
+
+namespace base {
+class TaskRunner;
+}  // namespace base
+
+// Writes TracePacket(s) into a file from a dedicated thread, so that the
+// latency of the storage doesn't stall the thread producing the data.
+//
+// The packets are handed over to the writer thread, which formats them as a
+// root trace.proto message and writes them with a TraceFileWriter, i.e.
+// without copying their payload. The memory of their slices must stay valid
+// until they have been written: see Batch::storage.
+//
+// The amount of data queued and not yet written is bounded by the caller,
+// which is expected to check available_bytes() and hold off producing more
+// data when it's 0, rather than queueing it anyway.
+//
+// The writer thread and the queue can outlive the AsyncFileWriter: destroying
+// it never waits for the queued data to be written, which could take forever
+// if nobody reads the other end of the fd (e.g. a pipe).
+//
+// All the methods must be called on the thread of the TaskRunner passed to the
+// constructor.
+class AsyncFileWriter {
+ public:
+  struct Stats {
+    uint64_t bytes_queued = 0;
+    uint64_t bytes_written = 0;
+
+    // The maximum number of bytes that have been queued at the same time.
+    uint64_t max_pending_bytes = 0;
+
+    // Total time spent by the writer thread writing into the file.
+    uint64_t write_time_ns = 0;
+  };
+
+  // A group of packets queued together.
+  struct Batch {
+    std::vector<TracePacket> packets;
+
+    // Backs the slices of |packets| that don't own their memory (e.g. copies
+    // of packets read from a TraceBuffer, which can be overwritten as soon as
+    // the packets have been read). See AcquireStorage().
+    std::vector<uint8_t> storage;
+  };
+
+  // Writes into a duplicate of |fd|, which the writer thread flushes and
+  // closes once it's done. Packets that would make the file size reach
+  // |max_file_size| are not written (0 means no limit). |max_pending_bytes| is
+  // the size of the queue.
+  AsyncFileWriter(base::TaskRunner*,
+                  int fd,
+                  uint64_t max_file_size,
+                  size_t max_pending_bytes);
+
+  // Doesn't block: the writer thread keeps writing the queued data in the
+  // background, but the callback passed to Finish() isn't run anymore.
+  ~AsyncFileWriter();
+
+  AsyncFileWriter(const AsyncFileWriter&) = delete;
+  AsyncFileWriter& operator=(const AsyncFileWriter&) = delete;
+
+  // Returns the number of bytes that can be queued before the queue is full.
+  size_t available_bytes();
+
+  // Returns an empty buffer, with room for at least |size| bytes, to be used
+  // as Batch::storage. The buffers of the batches already written are reused,
+  // to avoid faulting in new memory for each batch.
+  std::vector<uint8_t> AcquireStorage(size_t size);
+
+  // Queues |batch| for writing. Its size can exceed available_bytes(). The
+  // data is dropped if stopped().
+  void Write(Batch batch);
+
+  // Returns true if no more data will be written into the file, because a
+  // write failed or the file reached its maximum size.
+  bool stopped();
+
+  // Stops accepting data. Returns immediately: once all the queued data has
+  // been written and the file flushed, the writer thread stops and posts
+  // |callback| on the task runner.
+  void Finish(std::function<void()> callback);
+
+  Stats GetStats();
+
+ private:
+  // Shared with the writer thread.
+  struct State;
+
+  static void RunWriterThread(std::shared_ptr<State>);
+
+  std::shared_ptr<State> state_;
+};
+
+}  // namespace perfetto
+
+#endif  // SRC_TRACING_CORE_ASYNC_FILE_WRITER_H_
@@ -0,0 +1,211 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/tracing/core/async_file_writer.h"
+
+#include <fcntl.h>
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include "perfetto/base/build_config.h"
+#include "perfetto/ext/base/file_utils.h"
+#include "perfetto/ext/base/pipe.h"
+#include "perfetto/ext/base/scoped_file.h"
+#include "perfetto/ext/base/temp_file.h"
+#include "perfetto/ext/tracing/core/trace_packet.h"
+#include "src/base/test/test_task_runner.h"
+#include "test/gtest_and_gmock.h"
+
+#if !PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
+#include <unistd.h>
+#endif
+
+namespace perfetto {
+namespace {
+
+// Returns a batch with a single packet of |size| bytes, all set to |value|,
+// backed by the storage of the batch. Appends to |expected| what is expected
+// to be written into the file for it.
+AsyncFileWriter::Batch MakeBatch(AsyncFileWriter* writer,
+                                 size_t size,
+                                 uint8_t value,
+                                 std::string* expected) {
+  AsyncFileWriter::Batch batch;
+  batch.storage = writer->AcquireStorage(size);
+  batch.storage.assign(size, value);
+  TracePacket packet;
+  packet.AddSlice(batch.storage.data(), size);
+  if (expected) {
+    char* preamble;
+    size_t preamble_size;
+    std::tie(preamble, preamble_size) = packet.GetProtoPreamble();
+    expected->append(preamble, preamble_size);
+    expected->append(batch.storage.begin(), batch.storage.end());
+  }
+  batch.packets.emplace_back(std::move(packet));
+  return batch;
+}
+
+TEST(AsyncFileWriterTest, WritesAllPacketsInOrder) {
+  base::TestTaskRunner task_runner;
+  base::TempFile file = base::TempFile::Create();
+  std::string expected;
+  {
+    AsyncFileWriter writer(&task_runner, file.fd(), 0, 1024 * 1024);
+    for (size_t i = 0; i < 100; i++) {
+      writer.Write(
+          MakeBatch(&writer, 1 + i * 13, static_cast<uint8_t>(i), &expected));
+    }
+    writer.Finish(task_runner.CreateCheckpoint("finished"));
+    task_runner.RunUntilCheckpoint("finished");
+    EXPECT_FALSE(writer.stopped());
+
+    AsyncFileWriter::Stats stats = writer.GetStats();
+    EXPECT_EQ(stats.bytes_queued, expected.size());
+    EXPECT_EQ(stats.bytes_written, expected.size());
+    EXPECT_GT(stats.max_pending_bytes, 0u);
+  }
+
+  std::string contents;
+  ASSERT_TRUE(base::ReadFile(file.path(), &contents));
+  EXPECT_EQ(contents, expected);
+}
+
+TEST(AsyncFileWriterTest, StopsBeforeMaxFileSize) {
+  base::TestTaskRunner task_runner;
+  base::TempFile file = base::TempFile::Create();
+  std::string data(100, 'x');
+  TracePacket packet;
+  packet.AddSlice(data.data(), data.size());
+  const size_t packet_size =
+      std::get<1>(packet.GetProtoPreamble()) + data.size();
+
+  // Only two packets fit.
+  AsyncFileWriter writer(&task_runner, file.fd(), 3 * packet_size - 1,
+                         1024 * 1024);
+  for (int i = 0; i < 3; i++)
+    writer.Write(MakeBatch(&writer, data.size(), 'x', nullptr));
+  writer.Finish(task_runner.CreateCheckpoint("finished"));
+  task_runner.RunUntilCheckpoint("finished");
+  EXPECT_TRUE(writer.stopped());
+  EXPECT_EQ(writer.available_bytes(), 0u);
+  EXPECT_EQ(writer.GetStats().bytes_written, 2 * packet_size);
+
+  std::string contents;
+  ASSERT_TRUE(base::ReadFile(file.path(), &contents));
+  EXPECT_EQ(contents.size(), 2 * packet_size);
+}
+
+#if !PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
+// Simulates an output fd that can't keep up: a pipe that nobody reads from
+// until the end of the test.
+TEST(AsyncFileWriterTest, SlowFdDoesNotBlockWrites) {
+  base::TestTaskRunner task_runner;
+  base::Pipe pipe = base::Pipe::Create();
+  const size_t kPacketSize = 64 * 1024;
+  const size_t kMaxPendingBytes = kPacketSize * 4;
+  AsyncFileWriter writer(&task_runner, *pipe.wr, 0, kMaxPendingBytes);
+
+  // Writes never block, even if the writer thread is stuck on the pipe. Once
+  // the pipe is full, the queue fills up.
+  std::string expected;
+  size_t num_packets = 0;
+  while (writer.available_bytes() > 0) {
+    ASSERT_LT(num_packets, 1000u);
+    writer.Write(MakeBatch(&writer, kPacketSize,
+                           static_cast<uint8_t>(num_packets++), &expected));
+  }
+  EXPECT_GE(writer.GetStats().max_pending_bytes, kMaxPendingBytes);
+
+  // Finish() doesn't block either: the callback is posted once the data has
+  // been written, i.e. once somebody reads from the pipe.
+  writer.Finish(task_runner.CreateCheckpoint("finished"));
+
+  std::string received;
+  std::thread reader([&] {
+    char buf[4096];
+    for (;;) {
+      ssize_t rsize = PERFETTO_EINTR(read(*pipe.rd, buf, sizeof(buf)));
+      if (rsize <= 0)
+        break;
+      received.append(buf, static_cast<size_t>(rsize));
+    }
+  });
+
+  task_runner.RunUntilCheckpoint("finished");
+  EXPECT_FALSE(writer.stopped());
+  pipe.wr.reset();
+  reader.join();
+
+  EXPECT_EQ(received, expected);
+}
+
+// Destroying the writer (e.g. when the tracing session is freed) doesn't wait
+// for the data to be written either: the writer thread keeps going.
+TEST(AsyncFileWriterTest, DestroyDoesNotWaitForSlowFd) {
+  base::TestTaskRunner task_runner;
+  base::Pipe pipe = base::Pipe::Create();
+  const size_t kPacketSize = 64 * 1024;
+  std::unique_ptr<AsyncFileWriter> writer(
+      new AsyncFileWriter(&task_runner, *pipe.wr, 0, kPacketSize * 4));
+  std::string expected;
+  size_t num_packets = 0;
+  while (writer->available_bytes() > 0) {
+    ASSERT_LT(num_packets, 1000u);
+    writer->Write(MakeBatch(writer.get(), kPacketSize,
+                            static_cast<uint8_t>(num_packets++), &expected));
+  }
+  writer.reset();
+
+  // The writer thread closes its own copy of the fd once done, which is when
+  // the reader gets EOF.
+  pipe.wr.reset();
+  std::string received;
+  char buf[4096];
+  for (;;) {
+    ssize_t rsize = PERFETTO_EINTR(read(*pipe.rd, buf, sizeof(buf)));
+    if (rsize <= 0)
+      break;
+    received.append(buf, static_cast<size_t>(rsize));
+  }
+  EXPECT_EQ(received, expected);
+}
+#endif
+
+TEST(AsyncFileWriterTest, WriteFailure) {
+  base::TestTaskRunner task_runner;
+  base::TempFile file = base::TempFile::Create();
+  base::ScopedFile read_only_fd = base::OpenFile(file.path(), O_RDONLY);
+  ASSERT_TRUE(read_only_fd);
+
+  AsyncFileWriter writer(&task_runner, *read_only_fd, 0, 1024);
+  writer.Write(MakeBatch(&writer, 100, 'x', nullptr));
+
+  // Further writes are dropped.
+  writer.Write(MakeBatch(&writer, 100, 'x', nullptr));
+  writer.Finish(task_runner.CreateCheckpoint("finished"));
+  task_runner.RunUntilCheckpoint("finished");
+  EXPECT_TRUE(writer.stopped());
+  EXPECT_EQ(writer.available_bytes(), 0u);
+  EXPECT_EQ(writer.GetStats().bytes_written, 0u);
+}
+
+}  // namespace
+}  // namespace perfetto
@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <stdlib.h>
+
+#include <string>
+#include <vector>
+
+#include "perfetto/base/build_config.h"
+#include "perfetto/ext/base/file_utils.h"
+#include "perfetto/ext/tracing/core/slice.h"
+#include "perfetto/ext/tracing/core/trace_packet.h"
+#include "perfetto/ext/tracing/core/tracing_service.h"
+#include "src/base/test/utils.h"
+
+#include "protos/perfetto/trace/trace.pbzero.h"
+
+#if PERFETTO_BUILDFLAG(PERFETTO_ZLIB)
+#include "src/tracing/core/zlib_compressor.h"
+#endif
+
+#if PERFETTO_BUILDFLAG(PERFETTO_ZSTD)
+#include "src/tracing/core/zstd_compressor.h"
+#endif
+
+namespace perfetto {
+namespace {
+
+// The service compresses the packets read from the buffers in each
+// ReadBuffers() pass, which are at most this big.
+constexpr size_t kBatchSize = 1024 * 1024;
+
+bool IsBenchmarkFunctionalOnly() {
+  return getenv("BENCHMARK_FUNCTIONAL_TEST_ONLY") != nullptr;
+}
+
+// Splits a real trace in batches of packets like the ones the service
+// compresses. Set PERFETTO_COMPRESSOR_BENCHMARK_TRACE to benchmark another
+// (uncompressed) trace.
+std::vector<std::vector<std::string>> LoadBatches(benchmark::State& state) {
+  std::vector<std::vector<std::string>> batches;
+  // Don't run the benchmark on the CI as it requires pushing all test data,
+  // which slows down significantly the CI.
+  if (IsBenchmarkFunctionalOnly())
+    return batches;
+
+  const char* path = getenv("PERFETTO_COMPRESSOR_BENCHMARK_TRACE");
+  std::string trace;
+  if (!base::ReadFile(path ? path
+                           : base::GetTestDataPath(
+                                 "test/data/example_android_trace_30s.pb"),
+                      &trace)) {
+    state.SkipWithError("Failed to read the trace");
+    return batches;
+  }
+
+  size_t batch_size = kBatchSize;
+  protos::pbzero::Trace::Decoder decoder(trace);
+  for (auto it = decoder.packet(); it; ++it) {
+    protozero::ConstBytes packet = *it;
+    if (batch_size + packet.size > kBatchSize) {
+      batches.emplace_back();
+      batch_size = 0;
+    }
+    batches.back().emplace_back(reinterpret_cast<const char*>(packet.data),
+                                packet.size);
+    batch_size += packet.size;
+  }
+  return batches;
+}
+
+std::vector<TracePacket> ToTracePackets(const std::vector<std::string>& batch) {
+  std::vector<TracePacket> packets;
+  for (const std::string& data : batch) {
+    Slice slice = Slice::Allocate(data.size());
+    memcpy(slice.own_data(), data.data(), data.size());
+    TracePacket packet;
+    packet.AddSlice(std::move(slice));
+    packets.emplace_back(std::move(packet));
+  }
+  return packets;
+}
+
+// Reports the input throughput (i.e. the inverse of the CPU time per MB) and
+// the compression ratio of |compress|.
+void BenchmarkCompressor(benchmark::State& state,
+                         TracingService::InitOpts::CompressorFn compress) {
+  std::vector<std::vector<std::string>> batches = LoadBatches(state);
+  size_t uncompressed_size = 0;
+  size_t compressed_size = 0;
+  for (auto _ : state) {
+    state.PauseTiming();
+    std::vector<std::vector<TracePacket>> inputs;
+    for (const auto& batch : batches)
+      inputs.emplace_back(ToTracePackets(batch));
+    state.ResumeTiming();
+
+    for (std::vector<TracePacket>& packets : inputs) {
+      for (const TracePacket& packet : packets)
+        uncompressed_size += packet.size();
+      compress(&packets);
+      for (const TracePacket& packet : packets)
+        compressed_size += packet.size();
+    }
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(uncompressed_size));
+  if (compressed_size > 0) {
+    state.counters["ratio"] = static_cast<double>(uncompressed_size) /
+                              static_cast<double>(compressed_size);
+  }
+}
+
+#if PERFETTO_BUILDFLAG(PERFETTO_ZLIB)
+void BM_PacketCompressor_Zlib(benchmark::State& state) {
+  BenchmarkCompressor(state, &ZlibCompressFn);
+}
+BENCHMARK(BM_PacketCompressor_Zlib)->Unit(benchmark::kMillisecond);
+#endif
+
+#if PERFETTO_BUILDFLAG(PERFETTO_ZSTD)
+void BM_PacketCompressor_Zstd(benchmark::State& state) {
+  BenchmarkCompressor(state, &ZstdCompressFn);
+}
+BENCHMARK(BM_PacketCompressor_Zstd)->Unit(benchmark::kMillisecond);
+#endif
+
+}  // namespace
+}  // namespace perfetto
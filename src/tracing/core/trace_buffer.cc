@@ -16,6 +16,7 @@
 
 #include "src/tracing/core/trace_buffer.h"
 
+#include <algorithm>
 #include <limits>
 
 #include "perfetto/base/logging.h"
@@ -78,9 +79,10 @@ bool TraceBuffer::Initialize(size_t size) {
   stats_.set_buffer_size(size);
   max_chunk_size_ = std::min(size, ChunkRecord::kMaxSize);
   wptr_ = begin();
-  index_.clear();
-  last_chunk_id_written_.clear();
-  read_iter_ = GetReadIterForSequence(index_.end());
+  sequences_.Clear();
+  sequences_to_read_.clear();
+  next_sequence_to_read_ = 0;
+  read_iter_ = SequenceIterator();
   return true;
 }
 
@@ -136,14 +138,20 @@ void TraceBuffer::CopyChunkUntrusted(ProducerID producer_id_trusted,
   record.flags = chunk_flags;
   ChunkMeta::Key key(record);
 
+  // The sequence is looked up only once. The pointer stays valid until the end
+  // of this function because |sequences_| is altered only at the very end, if
+  // this is the first chunk of the sequence.
+  const ProducerAndWriterID producer_and_writer_id =
+      MkProducerAndWriterID(producer_id_trusted, writer_id);
+  ChunkSequence* sequence = sequences_.Find(producer_and_writer_id);
+
   // Check whether we have already copied the same chunk previously. This may
   // happen if the service scrapes chunks in a potentially incomplete state
   // before receiving commit requests for them from the producer. Note that the
   // service may scrape and thus override chunks in arbitrary order since the
   // chunks aren't ordered in the SMB.
-  const auto it = index_.find(key);
-  if (PERFETTO_UNLIKELY(it != index_.end())) {
-    ChunkMeta* record_meta = &it->second;
+  ChunkMeta* record_meta = sequence ? sequence->Find(chunk_id) : nullptr;
+  if (PERFETTO_UNLIKELY(record_meta)) {
     ChunkRecord* prev = GetChunkRecordAt(begin() + record_meta->record_off);
 
     // Verify that the old chunk's metadata corresponds to the new one.
@@ -175,13 +183,11 @@ void TraceBuffer::CopyChunkUntrusted(ProducerID producer_id_trusted,
     // chunk N after having read from chunk N+1, thereby violating sequential
     // read of packets. This shouldn't happen if the producer is well-behaved,
     // because it shouldn't start chunk N+1 before completing chunk N.
-    ChunkMeta::Key subsequent_key = key;
     static_assert(std::numeric_limits<ChunkID>::max() == kMaxChunkID,
                   "ChunkID wraps");
-    subsequent_key.chunk_id++;
-    const auto subsequent_it = index_.find(subsequent_key);
-    if (subsequent_it != index_.end() &&
-        subsequent_it->second.num_fragments_read > 0) {
+    const ChunkMeta* subsequent_meta =
+        sequence->Find(static_cast<ChunkID>(chunk_id + 1));
+    if (subsequent_meta && subsequent_meta->num_fragments_read > 0) {
       stats_.set_abi_violations(stats_.abi_violations() + 1);
       PERFETTO_DCHECK(suppress_client_dchecks_for_testing_);
       return;
@@ -217,6 +223,10 @@ void TraceBuffer::CopyChunkUntrusted(ProducerID producer_id_trusted,
   if (PERFETTO_UNLIKELY(discard_writes_))
     return DiscardWrite();
 
+  // Deleting chunks below can remove sequences that become empty from
+  // |sequences_|, which invalidates |sequence| if it is one of them.
+  const size_t num_sequences = sequences_.size();
+
   // If there isn't enough room from the given write position. Write a padding
   // record to clear the end of the buffer and wrap back.
   const size_t cached_size_to_end = size_to_end();
@@ -261,10 +271,19 @@ void TraceBuffer::CopyChunkUntrusted(ProducerID producer_id_trusted,
   stats_.set_bytes_written(stats_.bytes_written() + record_size);
 
   uint32_t chunk_off = GetOffset(GetChunkRecordAt(wptr_));
-  auto it_and_inserted = index_.emplace(
-      key, ChunkMeta(chunk_off, num_fragments, chunk_complete, chunk_flags,
-                     producer_uid_trusted, producer_pid_trusted));
-  PERFETTO_DCHECK(it_and_inserted.second);
+  if (sequence && sequences_.size() != num_sequences)
+    sequence = sequences_.Find(producer_and_writer_id);
+  if (!sequence) {
+    sequence = sequences_
+                   .Insert(producer_and_writer_id,
+                           ChunkSequence(producer_id_trusted, writer_id))
+                   .first;
+    // There is no previous chunk this one could be out of order with.
+    sequence->last_chunk_id_written = chunk_id;
+  }
+  sequence->Insert(ChunkMeta(chunk_id, chunk_off, num_fragments,
+                             chunk_complete, chunk_flags, producer_uid_trusted,
+                             producer_pid_trusted));
   TRACE_BUFFER_DLOG("  copying @ [%" PRIdPTR " - %" PRIdPTR "] %zu", wptr_ - begin(),
                     uintptr_t(wptr_ - begin()) + record_size, record_size);
   WriteChunkRecord(wptr_, record, src, size);
@@ -289,8 +308,7 @@ void TraceBuffer::CopyChunkUntrusted(ProducerID producer_id_trusted,
   // last_chunk_id shouldn't be updated even though it's larger (e.g. |chunk_id|
   // = kMaxChunkId and |last_chunk_id| = 1; chunk_id - last_chunk_id =
   // kMaxChunkId - 1).
-  auto producer_and_writer_id = std::make_pair(producer_id_trusted, writer_id);
-  ChunkID& last_chunk_id = last_chunk_id_written_[producer_and_writer_id];
+  ChunkID& last_chunk_id = sequence->last_chunk_id_written;
   static_assert(std::numeric_limits<ChunkID>::max() == kMaxChunkID,
                 "This code assumes that ChunkID wraps at kMaxChunkID");
   if (chunk_id - last_chunk_id < kMaxChunkID / 2) {
@@ -315,7 +333,7 @@ ssize_t TraceBuffer::DeleteNextChunksFor(size_t bytes_to_clear) {
   TRACE_BUFFER_DLOG("Delete [%zu %zu]", wptr_ - begin(), search_end - begin());
   DcheckIsAlignedAndWithinBounds(wptr_);
   PERFETTO_DCHECK(search_end <= end());
-  std::vector<ChunkMap::iterator> index_delete;
+  std::vector<std::pair<ChunkSequence*, ChunkID>> index_delete;
   uint64_t chunks_overwritten = stats_.chunks_overwritten();
   uint64_t bytes_overwritten = stats_.bytes_overwritten();
   uint64_t padding_bytes_cleared = stats_.padding_bytes_cleared();
@@ -340,23 +358,24 @@ ssize_t TraceBuffer::DeleteNextChunksFor(size_t bytes_to_clear) {
     // Remove |next_chunk| from the index, unless it's a padding record (padding
     // records are not part of the index).
     if (PERFETTO_LIKELY(!next_chunk.is_padding)) {
-      ChunkMeta::Key key(next_chunk);
-      auto it = index_.find(key);
+      ChunkSequence* sequence = sequences_.Find(
+          MkProducerAndWriterID(next_chunk.producer_id, next_chunk.writer_id));
+      const ChunkMeta* meta =
+          sequence ? sequence->Find(next_chunk.chunk_id) : nullptr;
       bool will_remove = false;
-      if (PERFETTO_LIKELY(it != index_.end())) {
-        const ChunkMeta& meta = it->second;
-        if (PERFETTO_UNLIKELY(meta.num_fragments_read < meta.num_fragments)) {
+      if (PERFETTO_LIKELY(meta)) {
+        if (PERFETTO_UNLIKELY(meta->num_fragments_read < meta->num_fragments)) {
           if (overwrite_policy_ == kDiscard)
             return -1;
           chunks_overwritten++;
           bytes_overwritten += next_chunk.size;
         }
-        index_delete.push_back(it);
+        index_delete.emplace_back(sequence, next_chunk.chunk_id);
         will_remove = true;
       }
       TRACE_BUFFER_DLOG(
           "  del index {%" PRIu32 ",%" PRIu32 ",%u} @ [%" PRIdPTR " - %" PRIdPTR "] %d",
-          key.producer_id, key.writer_id, key.chunk_id,
+          next_chunk.producer_id, next_chunk.writer_id, next_chunk.chunk_id,
           next_chunk_ptr - begin(), next_chunk_ptr - begin() + next_chunk.size,
           will_remove);
       PERFETTO_DCHECK(will_remove);
@@ -373,9 +392,15 @@ ssize_t TraceBuffer::DeleteNextChunksFor(size_t bytes_to_clear) {
     PERFETTO_CHECK(next_chunk_ptr <= end());
   }
 
-  // Remove from the index.
-  for (auto it : index_delete) {
-    index_.erase(it);
+  // Remove from the index. No later entry of |index_delete| refers to a
+  // sequence that became empty, so it can be erased right away.
+  for (const auto& sequence_and_chunk_id : index_delete) {
+    ChunkSequence* sequence = sequence_and_chunk_id.first;
+    sequence->Erase(sequence_and_chunk_id.second);
+    if (sequence->empty()) {
+      sequences_.Erase(MkProducerAndWriterID(sequence->producer_id(),
+                                             sequence->writer_id()));
+    }
   }
   stats_.set_chunks_overwritten(chunks_overwritten);
   stats_.set_bytes_overwritten(bytes_overwritten);
@@ -404,12 +429,14 @@ bool TraceBuffer::TryPatchChunkContents(ProducerID producer_id,
                                         bool other_patches_pending) {
   PERFETTO_CHECK(!read_only_);
   ChunkMeta::Key key(producer_id, writer_id, chunk_id);
-  auto it = index_.find(key);
-  if (it == index_.end()) {
+  ChunkSequence* sequence =
+      sequences_.Find(MkProducerAndWriterID(producer_id, writer_id));
+  ChunkMeta* chunk_meta_ptr = sequence ? sequence->Find(chunk_id) : nullptr;
+  if (!chunk_meta_ptr) {
     stats_.set_patches_failed(stats_.patches_failed() + 1);
     return false;
   }
-  ChunkMeta& chunk_meta = it->second;
+  ChunkMeta& chunk_meta = *chunk_meta_ptr;
 
   // Check that the index is consistent with the actual ProducerID/WriterID
   // stored in the ChunkRecord.
@@ -456,78 +483,134 @@ bool TraceBuffer::TryPatchChunkContents(ProducerID producer_id,
 }
 
 void TraceBuffer::BeginRead() {
-  read_iter_ = GetReadIterForSequence(index_.begin());
+  // Sequences are read in {ProducerID, WriterID} order.
+  sequences_to_read_.clear();
+  for (auto it = sequences_.GetIterator(); it; ++it) {
+    if (!it.value().empty())
+      sequences_to_read_.push_back(it.key());
+  }
+  std::sort(sequences_to_read_.begin(), sequences_to_read_.end());
+  next_sequence_to_read_ = 0;
+  read_iter_ = SequenceIterator();
 #if PERFETTO_DCHECK_IS_ON()
   changed_since_last_read_ = false;
 #endif
 }
 
 TraceBuffer::SequenceIterator TraceBuffer::GetReadIterForSequence(
-    ChunkMap::iterator seq_begin) {
+    ProducerAndWriterID producer_and_writer_id) {
   SequenceIterator iter;
-  iter.seq_begin = seq_begin;
-  if (seq_begin == index_.end()) {
-    iter.cur = iter.seq_end = index_.end();
+  ChunkSequence* sequence = sequences_.Find(producer_and_writer_id);
+  if (!sequence || sequence->empty())
     return iter;
-  }
-
-#if PERFETTO_DCHECK_IS_ON()
-  // Either |seq_begin| is == index_.begin() or the item immediately before must
-  // belong to a different {ProducerID, WriterID} sequence.
-  if (seq_begin != index_.begin() && seq_begin != index_.end()) {
-    auto prev_it = seq_begin;
-    prev_it--;
-    PERFETTO_DCHECK(
-        seq_begin == index_.begin() ||
-        std::tie(prev_it->first.producer_id, prev_it->first.writer_id) <
-            std::tie(seq_begin->first.producer_id, seq_begin->first.writer_id));
-  }
-#endif
-
-  // Find the first entry that has a greater {ProducerID, WriterID} (or just
-  // index_.end() if we reached the end).
-  ChunkMeta::Key key = seq_begin->first;  // Deliberate copy.
-  key.chunk_id = kMaxChunkID;
-  iter.seq_end = index_.upper_bound(key);
-  PERFETTO_DCHECK(iter.seq_begin != iter.seq_end);
-
-  // Now find the first entry between [seq_begin, seq_end) that is
-  // > last_chunk_id_written_. This is where we the sequence will start (see
-  // notes about wrapping of IDs in the header).
-  auto producer_and_writer_id = std::make_pair(key.producer_id, key.writer_id);
-  PERFETTO_DCHECK(last_chunk_id_written_.count(producer_and_writer_id));
-  iter.wrapping_id = last_chunk_id_written_[producer_and_writer_id];
-  key.chunk_id = iter.wrapping_id;
-  iter.cur = index_.upper_bound(key);
-  if (iter.cur == iter.seq_end)
-    iter.cur = iter.seq_begin;
+  iter.sequence = sequence;
+
+  // Now find the first chunk that is > last_chunk_id_written. This is where
+  // the sequence will start (see notes about wrapping of IDs in the header).
+  iter.wrapping_id = sequence->last_chunk_id_written;
+  iter.cur = sequence->UpperBound(iter.wrapping_id);
+  if (iter.cur == sequence->size())
+    iter.cur = 0;
   return iter;
 }
 
 void TraceBuffer::SequenceIterator::MoveNext() {
   // Stop iterating when we reach the end of the sequence.
-  // Note: |seq_begin| might be == |seq_end|.
-  if (cur == seq_end || cur->first.chunk_id == wrapping_id) {
-    cur = seq_end;
+  if (!is_valid() || chunk_id() == wrapping_id) {
+    MoveToEnd();
     return;
   }
 
   // If the current chunk wasn't completed yet, we shouldn't advance past it as
   // it may be rewritten with additional packets.
-  if (!cur->second.is_complete()) {
-    cur = seq_end;
+  if (!sequence->at(cur).is_complete()) {
+    MoveToEnd();
     return;
   }
 
-  ChunkID last_chunk_id = cur->first.chunk_id;
-  if (++cur == seq_end)
-    cur = seq_begin;
+  ChunkID last_chunk_id = chunk_id();
+  if (++cur == sequence->size())
+    cur = 0;
 
   // There may be a missing chunk in the sequence of chunks, in which case the
   // next chunk's ID won't follow the last one's. If so, skip the rest of the
   // sequence. We'll return to it later once the hole is filled.
-  if (last_chunk_id + 1 != cur->first.chunk_id)
-    cur = seq_end;
+  if (last_chunk_id + 1 != chunk_id())
+    MoveToEnd();
+}
+
+size_t TraceBuffer::ChunkSequence::LowerBound(ChunkID chunk_id) const {
+  // Chunks are usually appended, check the last one before bisecting.
+  if (size_ == 0 || at(size_ - 1).chunk_id < chunk_id)
+    return size_;
+  size_t lo = 0;
+  size_t hi = size_ - 1;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (at(mid).chunk_id < chunk_id) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+size_t TraceBuffer::ChunkSequence::UpperBound(ChunkID chunk_id) const {
+  if (chunk_id == kMaxChunkID)
+    return size_;
+  return LowerBound(chunk_id + 1);
+}
+
+TraceBuffer::ChunkMeta* TraceBuffer::ChunkSequence::Insert(
+    const ChunkMeta& meta) {
+  if (size_ == ring_.size())
+    Resize(std::max(ring_.size() * 2, kMinRingSize));
+  const size_t pos = LowerBound(meta.chunk_id);
+  PERFETTO_DCHECK(pos == size_ || at(pos).chunk_id != meta.chunk_id);
+  const size_t mask = ring_.size() - 1;
+  size_++;
+  if (pos < size_ / 2) {
+    // Move the chunks before |pos| one slot towards the head.
+    head_ = (head_ + mask) & mask;
+    for (size_t i = 0; i < pos; i++)
+      at(i) = at(i + 1);
+  } else {
+    // Move the chunks after |pos| one slot towards the tail.
+    for (size_t i = size_ - 1; i > pos; i--)
+      at(i) = at(i - 1);
+  }
+  at(pos) = meta;
+  return &at(pos);
+}
+
+void TraceBuffer::ChunkSequence::Erase(ChunkID chunk_id) {
+  const size_t pos = LowerBound(chunk_id);
+  PERFETTO_DCHECK(pos < size_ && at(pos).chunk_id == chunk_id);
+  if (pos < size_ / 2) {
+    for (size_t i = pos; i > 0; i--)
+      at(i) = at(i - 1);
+    head_ = (head_ + 1) & (ring_.size() - 1);
+  } else {
+    for (size_t i = pos; i + 1 < size_; i++)
+      at(i) = at(i + 1);
+  }
+  size_--;
+
+  // Halve rings that are less than a quarter full, e.g. after a burst of
+  // chunks of a writer has been overwritten. The gap between the two
+  // thresholds avoids reallocating back and forth around a single size.
+  if (ring_.size() > kMinRingSize && size_ < ring_.size() / 4)
+    Resize(ring_.size() / 2);
+}
+
+void TraceBuffer::ChunkSequence::Resize(size_t new_size) {
+  PERFETTO_DCHECK(new_size >= size_ && (new_size & (new_size - 1)) == 0);
+  std::vector<ChunkMeta> new_ring(new_size);
+  for (size_t i = 0; i < size_; i++)
+    new_ring[i] = at(i);
+  ring_ = std::move(new_ring);
+  head_ = 0;
 }
 
 bool TraceBuffer::ReadNextTracePacket(
@@ -557,16 +640,17 @@ bool TraceBuffer::ReadNextTracePacket(
   for (;; read_iter_.MoveNext()) {
     if (PERFETTO_UNLIKELY(!read_iter_.is_valid())) {
       // We ran out of chunks in the current {ProducerID, WriterID} sequence or
-      // we just reached the index_.end().
+      // we just called BeginRead().
 
-      if (PERFETTO_UNLIKELY(read_iter_.seq_end == index_.end()))
+      if (PERFETTO_UNLIKELY(next_sequence_to_read_ ==
+                            sequences_to_read_.size())) {
         return false;
+      }
 
       // We reached the end of sequence, move to the next one.
-      // Note: ++read_iter_.seq_end might become index_.end(), but
-      // GetReadIterForSequence() knows how to deal with that.
-      read_iter_ = GetReadIterForSequence(read_iter_.seq_end);
-      PERFETTO_DCHECK(read_iter_.is_valid() && read_iter_.cur != index_.end());
+      read_iter_ =
+          GetReadIterForSequence(sequences_to_read_[next_sequence_to_read_++]);
+      PERFETTO_DCHECK(read_iter_.is_valid());
       previous_packet_dropped = true;
     }
 
@@ -916,7 +1000,6 @@ TraceBuffer::TraceBuffer(CloneCtor, const TraceBuffer& src)
 
   data_.EnsureCommitted(data_.size());
   memcpy(data_.Get(), src.data_.Get(), src.data_.size());
-  last_chunk_id_written_ = src.last_chunk_id_written_;
 
   stats_ = src.stats_;
   stats_.set_bytes_read(0);
@@ -925,12 +1008,15 @@ TraceBuffer::TraceBuffer(CloneCtor, const TraceBuffer& src)
   stats_.set_readaheads_succeeded(0);
 
   // Copy the index of chunk metadata and reset the read states.
-  index_ = ChunkMap(src.index_);
-  for (auto& kv : index_) {
-    ChunkMeta& chunk_meta = kv.second;
-    chunk_meta.num_fragments_read = 0;
-    chunk_meta.cur_fragment_offset = 0;
-    chunk_meta.set_last_read_packet_skipped(false);
+  for (auto it = src.sequences_.GetIterator(); it; ++it) {
+    ChunkSequence* sequence =
+        sequences_.Insert(it.key(), ChunkSequence(it.value())).first;
+    for (size_t i = 0; i < sequence->size(); i++) {
+      ChunkMeta& chunk_meta = sequence->at(i);
+      chunk_meta.num_fragments_read = 0;
+      chunk_meta.cur_fragment_offset = 0;
+      chunk_meta.set_last_read_packet_skipped(false);
+    }
   }
   read_iter_ = SequenceIterator();
 }
@@ -22,8 +22,8 @@
 
 #include <array>
 #include <limits>
-#include <map>
 #include <tuple>
+#include <vector>
 
 #include "perfetto/base/logging.h"
 #include "perfetto/ext/base/flat_hash_map.h"
@@ -112,8 +112,8 @@ class TracePacket;
 // quite useful in future to recover the buffer from crash reports).
 //
 // However, in order to keep some operations (patching and reading) fast, a
-// lookaside index is maintained (in |index_|), keeping each chunk in the buffer
-// indexed by their {ProducerID, WriterID, ChunkID} tuple.
+// lookaside index is maintained (in |sequences_|), keeping each chunk in the
+// buffer indexed by their {ProducerID, WriterID, ChunkID} tuple.
 //
 // Patching data out-of-band
 // -------------------------
@@ -356,7 +356,7 @@ class TraceBuffer {
   // This struct should not have any field that is essential for reconstructing
   // the contents of the buffer from a crash dump.
   struct ChunkMeta {
-    // Key used for sorting in the map.
+    // Uniquely identifies a chunk in the buffer.
     struct Key {
       Key(ProducerID p, WriterID w, ChunkID c)
           : producer_id{p}, writer_id{w}, chunk_id{c} {}
@@ -368,8 +368,7 @@ class TraceBuffer {
           : Key(cr.producer_id, cr.writer_id, cr.chunk_id) {}
 
       // Note that this sorting doesn't keep into account the fact that ChunkID
-      // will wrap over at some point. The extra logic in SequenceIterator deals
-      // with that.
+      // will wrap over at some point.
       bool operator<(const Key& other) const {
         return std::tie(producer_id, writer_id, chunk_id) <
                std::tie(other.producer_id, other.writer_id, other.chunk_id);
@@ -403,13 +402,16 @@ class TraceBuffer {
       kLastReadPacketSkipped = 1 << 1
     };
 
-    ChunkMeta(uint32_t _record_off,
+    ChunkMeta() = default;
+    ChunkMeta(ChunkID _chunk_id,
+              uint32_t _record_off,
               uint16_t _num_fragments,
               bool complete,
               uint8_t _flags,
               uid_t _trusted_uid,
               pid_t _trusted_pid)
-        : record_off{_record_off},
+        : chunk_id{_chunk_id},
+          record_off{_record_off},
           trusted_uid{_trusted_uid},
           trusted_pid(_trusted_pid),
           flags{_flags},
@@ -419,6 +421,7 @@ class TraceBuffer {
     }
 
     ChunkMeta(const ChunkMeta&) noexcept = default;
+    ChunkMeta& operator=(const ChunkMeta&) noexcept = default;
 
     bool is_complete() const { return index_flags & kComplete; }
 
@@ -442,9 +445,15 @@ class TraceBuffer {
       }
     }
 
-    const uint32_t record_off;  // Offset of ChunkRecord within |data_|.
-    const uid_t trusted_uid;    // uid of the producer.
-    const pid_t trusted_pid;    // pid of the producer.
+    // The {ProducerID, WriterID} are not stored here as they are the same for
+    // all the chunks of a ChunkSequence.
+    ChunkID chunk_id = 0;
+
+    // These fields never change once the chunk has been copied. They are not
+    // const only because ChunkSequence moves entries around.
+    uint32_t record_off = 0;  // Offset of ChunkRecord within |data_|.
+    uid_t trusted_uid = 0;    // uid of the producer.
+    pid_t trusted_pid = 0;    // pid of the producer.
 
     // Flags set by TraceBuffer to track the state of the chunk in the index.
     uint8_t index_flags = 0;
@@ -465,62 +474,133 @@ class TraceBuffer {
     uint16_t cur_fragment_offset = 0;
   };
 
-  using ChunkMap = std::map<ChunkMeta::Key, ChunkMeta>;
+  // The index entries of all the chunks of a {ProducerID, WriterID} sequence,
+  // sorted by ChunkID (without taking into account the wrapping of ChunkID,
+  // SequenceIterator deals with that).
+  // The entries are stored in a ring buffer: chunks are normally copied in
+  // increasing ChunkID order and overwritten in the same order, so both the
+  // insertions and the deletions happen at the ends of the ring and don't need
+  // to move any other entry. Out of order chunks are inserted by moving the
+  // entries on the shorter side of the insertion point.
+  class ChunkSequence {
+   public:
+    ChunkSequence(ProducerID p, WriterID w) : producer_id_(p), writer_id_(w) {}
+
+    ProducerID producer_id() const { return producer_id_; }
+    WriterID writer_id() const { return writer_id_; }
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+    // Returns the |i|-th chunk in ChunkID order. |i| must be < size().
+    ChunkMeta& at(size_t i) {
+      PERFETTO_DCHECK(i < size_);
+      return ring_[(head_ + i) & (ring_.size() - 1)];
+    }
+    const ChunkMeta& at(size_t i) const {
+      PERFETTO_DCHECK(i < size_);
+      return ring_[(head_ + i) & (ring_.size() - 1)];
+    }
+
+    // Returns the position of the first chunk with a ChunkID >= |chunk_id|
+    // (LowerBound()) or > |chunk_id| (UpperBound()), or size() if none.
+    size_t LowerBound(ChunkID chunk_id) const;
+    size_t UpperBound(ChunkID chunk_id) const;
+
+    // Returns nullptr if the chunk is not in the sequence.
+    ChunkMeta* Find(ChunkID chunk_id) {
+      size_t pos = LowerBound(chunk_id);
+      if (pos == size_ || at(pos).chunk_id != chunk_id)
+        return nullptr;
+      return &at(pos);
+    }
+
+    // Inserts a chunk which must not be in the sequence already. Invalidates
+    // all the pointers to the entries of the sequence.
+    ChunkMeta* Insert(const ChunkMeta&);
+
+    // Removes a chunk which must be in the sequence. Invalidates all the
+    // pointers to the entries of the sequence.
+    void Erase(ChunkID chunk_id);
+
+    // The highest ChunkID written for this sequence, taking into account a
+    // potential overflow of ChunkIDs. In the case of overflow, stores the
+    // highest ChunkID written since the overflow.
+    ChunkID last_chunk_id_written = 0;
+
+   private:
+    static constexpr size_t kMinRingSize = 4;
+
+    // Reallocates |ring_| with |new_size| entries, which must be a power of two
+    // >= |size_|.
+    void Resize(size_t new_size);
+
+    ProducerID producer_id_;
+    WriterID writer_id_;
+
+    // Its size is always either 0 or a power of two.
+    std::vector<ChunkMeta> ring_;
+    size_t head_ = 0;  // Index in |ring_| of the entry with the lowest ChunkID.
+    size_t size_ = 0;  // Number of valid entries in |ring_|.
+  };
+
+  using ChunkSequenceMap = base::FlatHashMap<ProducerAndWriterID,
+                                             ChunkSequence,
+                                             std::hash<ProducerAndWriterID>,
+                                             base::QuadraticProbe>;
 
-  // Allows to iterate over a sub-sequence of |index_| for all keys belonging to
-  // the same {ProducerID,WriterID}. Furthermore takes into account the wrapping
-  // of ChunkID. Instances are valid only as long as the |index_| is not altered
-  // (can be used safely only between adjacent ReadNextTracePacket() calls).
+  // Allows to iterate over the chunks of a ChunkSequence, taking into account
+  // the wrapping of ChunkID. Instances are valid only as long as the
+  // |sequences_| are not altered (can be used safely only between adjacent
+  // ReadNextTracePacket() calls).
   // The order of the iteration will proceed in the following order:
-  // |wrapping_id| + 1 -> |seq_end|, |seq_begin| -> |wrapping_id|.
+  // |wrapping_id| + 1 -> last chunk, first chunk -> |wrapping_id|.
   // Practical example:
   // - Assume that kMaxChunkID == 7
   // - Assume that we have all 8 chunks in the range (0..7).
-  // - Hence, |seq_begin| == c0, |seq_end| == c7
+  // - Hence, the first chunk is c0, the last chunk is c7
   // - Assume |wrapping_id| = 4 (c4 is the last chunk copied over
   //   through a CopyChunkUntrusted()).
   // The resulting iteration order will be: c5, c6, c7, c0, c1, c2, c3, c4.
   struct SequenceIterator {
-    // Points to the 1st key (the one with the numerically min ChunkID).
-    ChunkMap::iterator seq_begin;
-
-    // Points one past the last key (the one with the numerically max ChunkID).
-    ChunkMap::iterator seq_end;
+    // The sequence being iterated. nullptr if there is no such sequence.
+    ChunkSequence* sequence = nullptr;
 
-    // Current iterator, always >= seq_begin && <= seq_end.
-    ChunkMap::iterator cur;
+    // Position of the current chunk within |sequence|, always <= size().
+    // is_valid() becomes false when this reaches size().
+    size_t cur = 0;
 
     // The latest ChunkID written. Determines the start/end of the sequence.
-    ChunkID wrapping_id;
+    ChunkID wrapping_id = 0;
 
-    bool is_valid() const { return cur != seq_end; }
+    bool is_valid() const { return sequence && cur < sequence->size(); }
 
     ProducerID producer_id() const {
       PERFETTO_DCHECK(is_valid());
-      return cur->first.producer_id;
+      return sequence->producer_id();
     }
 
     WriterID writer_id() const {
       PERFETTO_DCHECK(is_valid());
-      return cur->first.writer_id;
+      return sequence->writer_id();
     }
 
     ChunkID chunk_id() const {
       PERFETTO_DCHECK(is_valid());
-      return cur->first.chunk_id;
+      return sequence->at(cur).chunk_id;
     }
 
     ChunkMeta& operator*() {
       PERFETTO_DCHECK(is_valid());
-      return cur->second;
+      return sequence->at(cur);
     }
 
-    // Moves |cur| to the next chunk in the index.
+    // Moves |cur| to the next chunk in the sequence.
     // is_valid() will become false after calling this, if this was the last
     // entry of the sequence.
     void MoveNext();
 
-    void MoveToEnd() { cur = seq_end; }
+    void MoveToEnd() { cur = sequence ? sequence->size() : 0; }
   };
 
   enum class ReadAheadResult {
@@ -546,14 +626,11 @@ class TraceBuffer {
 
   bool Initialize(size_t size);
 
-  // Returns an object that allows to iterate over chunks in the |index_| that
-  // have the same {ProducerID, WriterID} of
-  // |seq_begin.first.{producer,writer}_id|. |seq_begin| must be an iterator to
-  // the first entry in the |index_| that has a different {ProducerID, WriterID}
-  // from the previous one. It is valid for |seq_begin| to be == index_.end()
-  // (i.e. if the index is empty). The iteration takes care of ChunkID wrapping,
-  // by using |last_chunk_id_|.
-  SequenceIterator GetReadIterForSequence(ChunkMap::iterator seq_begin);
+  // Returns an object that allows to iterate over the chunks of the given
+  // {ProducerID, WriterID} sequence. The returned iterator is not valid if the
+  // sequence has no chunks. The iteration takes care of ChunkID wrapping, by
+  // using |ChunkSequence::last_chunk_id_written|.
+  SequenceIterator GetReadIterForSequence(ProducerAndWriterID);
 
   // Used as a last resort when a buffer corruption is detected.
   void ClearContentsAndResetRWCursors();
@@ -676,11 +753,20 @@ class TraceBuffer {
   uint8_t* wptr_ = nullptr;    // Write pointer.
 
   // An index that keeps track of the positions and metadata of each
-  // ChunkRecord.
-  ChunkMap index_;
+  // ChunkRecord, grouped by {ProducerID, WriterID} sequence. Sequences are
+  // removed as soon as all their chunks have been overwritten, so the index
+  // doesn't grow with the number of writers that come and go over the course
+  // of the trace.
+  ChunkSequenceMap sequences_;
+
+  // The non-empty sequences at the time of the last BeginRead(), sorted by
+  // {ProducerID, WriterID}, and the position in it of the next sequence that
+  // ReadNextTracePacket() will move to.
+  std::vector<ProducerAndWriterID> sequences_to_read_;
+  size_t next_sequence_to_read_ = 0;
 
   // Read iterator used for ReadNext(). It is reset by calling BeginRead().
-  // It becomes invalid after any call to methods that alters the |index_|.
+  // It becomes invalid after any call to methods that alters the |sequences_|.
   SequenceIterator read_iter_;
 
   // See comments at the top of the file.
@@ -694,15 +780,6 @@ class TraceBuffer {
   // a write fails because it would overwrite unread chunks.
   bool discard_writes_ = false;
 
-  // Keeps track of the highest ChunkID written for a given sequence, taking
-  // into account a potential overflow of ChunkIDs. In the case of overflow,
-  // stores the highest ChunkID written since the overflow.
-  //
-  // TODO(primiano): should clean up keys from this map. Right now it grows
-  // without bounds (although realistically is not a problem unless we have too
-  // many producers/writers within the same trace session).
-  std::map<std::pair<ProducerID, WriterID>, ChunkID> last_chunk_id_written_;
-
   // Statistics about buffer usage.
   TraceStats::BufferStats stats_;
 
@@ -0,0 +1,156 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+
+#include <memory>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "perfetto/base/logging.h"
+#include "perfetto/ext/tracing/core/basic_types.h"
+#include "perfetto/ext/tracing/core/trace_packet.h"
+#include "perfetto/protozero/proto_utils.h"
+#include "src/tracing/core/trace_buffer.h"
+
+namespace {
+
+using perfetto::ChunkID;
+using perfetto::ProducerID;
+using perfetto::TraceBuffer;
+using perfetto::WriterID;
+
+// Chunks of the same size of the default SMB page, each holding 16 packets.
+constexpr size_t kChunkSize = 4096;
+constexpr size_t kPacketsPerChunk = 16;
+constexpr size_t kBufferSize = 64 * 1024 * 1024;
+constexpr size_t kChunksPerIteration = 1024;
+
+bool IsBenchmarkFunctionalOnly() {
+  return getenv("BENCHMARK_FUNCTIONAL_TEST_ONLY") != nullptr;
+}
+
+void BenchmarkArgs(benchmark::internal::Benchmark* b) {
+  if (IsBenchmarkFunctionalOnly()) {
+    b->Arg(16);
+  } else {
+    b->Arg(1)->Arg(100)->Arg(1000)->Arg(10000)->Arg(30000);
+  }
+}
+
+// Returns the payload of a chunk (i.e. without the ChunkRecord header that the
+// TraceBuffer prepends) made of |kPacketsPerChunk| packets of the same size.
+std::vector<uint8_t> CreateChunkPayload() {
+  const size_t payload_size = kChunkSize - 16 /* sizeof(ChunkRecord) */;
+  const size_t packet_size = payload_size / kPacketsPerChunk;
+  std::vector<uint8_t> payload;
+  payload.reserve(payload_size);
+  for (size_t i = 0; i < kPacketsPerChunk; i++) {
+    // |packet_size| includes the size of the 2 bytes varint header.
+    uint8_t header[protozero::proto_utils::kMaxSimpleFieldEncodedSize];
+    uint8_t* header_end =
+        protozero::proto_utils::WriteVarInt(packet_size - 2, header);
+    PERFETTO_CHECK(header_end - header == 2);
+    payload.insert(payload.end(), header, header_end);
+    payload.insert(payload.end(), packet_size - 2, static_cast<uint8_t>(i));
+  }
+  PERFETTO_CHECK(payload.size() == payload_size);
+  return payload;
+}
+
+// Round-robins chunks over |num_sequences| {ProducerID, WriterID} sequences,
+// as if each producer had up to 256 writers.
+class ChunkWriter {
+ public:
+  explicit ChunkWriter(size_t num_sequences)
+      : payload_(CreateChunkPayload()), next_chunk_ids_(num_sequences) {}
+
+  void CopyChunks(TraceBuffer* buf, size_t num_chunks) {
+    for (size_t i = 0; i < num_chunks; i++) {
+      const auto producer_id = static_cast<ProducerID>(1 + next_seq_ / 256);
+      const auto writer_id = static_cast<WriterID>(1 + next_seq_ % 256);
+      ChunkID chunk_id = next_chunk_ids_[next_seq_]++;
+      buf->CopyChunkUntrusted(producer_id, /*producer_uid_trusted=*/0,
+                              /*producer_pid_trusted=*/0, writer_id, chunk_id,
+                              kPacketsPerChunk, /*chunk_flags=*/0,
+                              /*chunk_complete=*/true, payload_.data(),
+                              payload_.size());
+      if (++next_seq_ == next_chunk_ids_.size())
+        next_seq_ = 0;
+    }
+  }
+
+ private:
+  const std::vector<uint8_t> payload_;
+  std::vector<ChunkID> next_chunk_ids_;
+  size_t next_seq_ = 0;
+};
+
+}  // namespace
+
+static void BM_TraceBuffer_CopyChunks(benchmark::State& state) {
+  std::unique_ptr<TraceBuffer> buf = TraceBuffer::Create(kBufferSize);
+  ChunkWriter writer(static_cast<size_t>(state.range(0)));
+
+  // Fill the buffer first, so that every copy also overwrites a chunk.
+  writer.CopyChunks(buf.get(), kBufferSize / kChunkSize);
+
+  for (auto _ : state) {
+    writer.CopyChunks(buf.get(), kChunksPerIteration);
+  }
+  PERFETTO_CHECK(buf->stats().chunks_written() > 0);
+
+  const auto chunks = static_cast<int64_t>(state.iterations()) *
+                      static_cast<int64_t>(kChunksPerIteration);
+  state.SetItemsProcessed(chunks);
+  state.SetBytesProcessed(chunks * static_cast<int64_t>(kChunkSize));
+}
+
+static void BM_TraceBuffer_ReadBack(benchmark::State& state) {
+  std::unique_ptr<TraceBuffer> buf = TraceBuffer::Create(kBufferSize);
+  ChunkWriter writer(static_cast<size_t>(state.range(0)));
+  const size_t chunks_per_buffer = kBufferSize / kChunkSize;
+
+  int64_t chunks = 0;
+  for (auto _ : state) {
+    // Overwrite the whole buffer with new chunks, which will be read back.
+    state.PauseTiming();
+    writer.CopyChunks(buf.get(), chunks_per_buffer);
+    state.ResumeTiming();
+
+    buf->BeginRead();
+    size_t packets = 0;
+    for (;;) {
+      perfetto::TracePacket packet;
+      TraceBuffer::PacketSequenceProperties sequence_properties{};
+      bool previous_packet_dropped;
+      if (!buf->ReadNextTracePacket(&packet, &sequence_properties,
+                                    &previous_packet_dropped)) {
+        break;
+      }
+      packets++;
+    }
+    PERFETTO_CHECK(packets > 0);
+    chunks += static_cast<int64_t>(packets / kPacketsPerChunk);
+  }
+
+  state.SetItemsProcessed(chunks);
+  state.SetBytesProcessed(chunks * static_cast<int64_t>(kChunkSize));
+}
+
+BENCHMARK(BM_TraceBuffer_CopyChunks)->Apply(BenchmarkArgs);
+BENCHMARK(BM_TraceBuffer_ReadBack)->Apply(BenchmarkArgs);
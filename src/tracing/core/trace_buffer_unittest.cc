@@ -16,6 +16,7 @@
 
 #include <string.h>
 
+#include <algorithm>
 #include <initializer_list>
 #include <random>
 #include <sstream>
@@ -127,9 +128,7 @@ class TraceBufferTest : public testing::Test {
   }
 
   SequenceIterator GetReadIterForSequence(ProducerID p, WriterID w) {
-    TraceBuffer::ChunkMeta::Key key(p, w, 0);
-    return trace_buffer_->GetReadIterForSequence(
-        trace_buffer_->index_.lower_bound(key));
+    return trace_buffer_->GetReadIterForSequence(MkProducerAndWriterID(p, w));
   }
 
   void SuppressClientDchecksForTesting() {
@@ -138,12 +137,19 @@ class TraceBufferTest : public testing::Test {
 
   std::vector<ChunkMetaKey> GetIndex() {
     std::vector<ChunkMetaKey> keys;
-    keys.reserve(trace_buffer_->index_.size());
-    for (const auto& it : trace_buffer_->index_)
-      keys.push_back(it.first);
+    for (auto it = trace_buffer_->sequences_.GetIterator(); it; ++it) {
+      const TraceBuffer::ChunkSequence& sequence = it.value();
+      for (size_t i = 0; i < sequence.size(); i++) {
+        keys.emplace_back(sequence.producer_id(), sequence.writer_id(),
+                          sequence.at(i).chunk_id);
+      }
+    }
+    std::sort(keys.begin(), keys.end());
     return keys;
   }
 
+  size_t GetNumSequences() { return trace_buffer_->sequences_.size(); }
+
   TraceBuffer* trace_buffer() { return trace_buffer_.get(); }
   size_t size_to_end() { return trace_buffer_->size_to_end(); }
 
@@ -1379,6 +1385,85 @@ TEST_F(TraceBufferTest, Iterator_ManyStreamsWrapping) {
   ASSERT_TRUE(IteratorSeqEq(ProducerID(3), WriterID(1), {Neg(-1), 0, 1}));
 }
 
+TEST_F(TraceBufferTest, Iterator_OutOfOrderChunks) {
+  ResetBuffer(64 * 1024);
+  AppendChunks({
+      {ProducerID(1), WriterID(1), ChunkID(5)},
+      {ProducerID(1), WriterID(1), ChunkID(3)},
+      {ProducerID(1), WriterID(1), ChunkID(7)},
+      {ProducerID(1), WriterID(1), ChunkID(0)},
+      {ProducerID(2), WriterID(1), ChunkID(0)},
+      {ProducerID(1), WriterID(1), ChunkID(1)},
+      {ProducerID(1), WriterID(1), ChunkID(2)},
+      {ProducerID(1), WriterID(1), ChunkID(4)},
+      {ProducerID(1), WriterID(1), ChunkID(6)},
+      {ProducerID(1), WriterID(1), ChunkID(9)},
+      {ProducerID(1), WriterID(1), ChunkID(8)},
+  });
+  ASSERT_TRUE(IteratorSeqEq(ProducerID(1), WriterID(1),
+                            {0, 1, 2, 3, 4, 5, 6, 7, 8, 9}));
+  ASSERT_TRUE(IteratorSeqEq(ProducerID(2), WriterID(1), {0}));
+  ASSERT_EQ(7u, trace_buffer()->stats().chunks_committed_out_of_order());
+}
+
+// Writes many more chunks than the buffer can hold for the same sequence, so
+// that the index entries are continuously added and removed.
+TEST_F(TraceBufferTest, ReadWrite_IndexFollowsOverwrites) {
+  ResetBuffer(4096);
+  for (ChunkID c = 0; c < 40; c++) {
+    ASSERT_EQ(512u, CreateChunk(ProducerID(1), WriterID(1), c)
+                        .AddPacket(512 - 16, static_cast<char>('A' + c))
+                        .CopyIntoTraceBuffer());
+  }
+  std::vector<ChunkMetaKey> expected_index;
+  for (ChunkID c = 32; c < 40; c++)
+    expected_index.emplace_back(1, 1, c);
+  ASSERT_EQ(expected_index, GetIndex());
+
+  trace_buffer()->BeginRead();
+  for (ChunkID c = 32; c < 40; c++) {
+    ASSERT_THAT(ReadPacket(), ElementsAre(FakePacketFragment(
+                                  512 - 16, static_cast<char>('A' + c))));
+  }
+  ASSERT_THAT(ReadPacket(), IsEmpty());
+}
+
+// Short-lived writers (e.g. threads) come and go during a trace. Sequences
+// whose chunks have all been overwritten must be dropped from the index.
+TEST_F(TraceBufferTest, ReadWrite_WriterChurn) {
+  ResetBuffer(4096);
+  for (WriterID w = 1; w <= 100; w++) {
+    for (ChunkID c = 0; c < 3; c++) {
+      ASSERT_EQ(512u, CreateChunk(ProducerID(1), w, c)
+                          .AddPacket(512 - 16, static_cast<char>('A' + w % 26))
+                          .CopyIntoTraceBuffer());
+    }
+  }
+  // Only the last 8 chunks fit in the buffer.
+  std::vector<ChunkMetaKey> expected_index = {{1, 98, 1}, {1, 98, 2}};
+  for (WriterID w = 99; w <= 100; w++) {
+    for (ChunkID c = 0; c < 3; c++)
+      expected_index.emplace_back(1, w, c);
+  }
+  ASSERT_EQ(expected_index, GetIndex());
+  ASSERT_EQ(3u, GetNumSequences());
+
+  // A writer whose sequence has been dropped can come back.
+  ASSERT_EQ(512u, CreateChunk(ProducerID(1), WriterID(1), ChunkID(3))
+                      .AddPacket(512 - 16, 'z')
+                      .CopyIntoTraceBuffer());
+  ASSERT_EQ(4u, GetNumSequences());
+  ASSERT_EQ(0u, trace_buffer()->stats().chunks_committed_out_of_order());
+
+  trace_buffer()->BeginRead();
+  ASSERT_THAT(ReadPacket(), ElementsAre(FakePacketFragment(512 - 16, 'z')));
+  for (WriterID w : {98, 99, 99, 99, 100, 100, 100}) {
+    ASSERT_THAT(ReadPacket(), ElementsAre(FakePacketFragment(
+                                  512 - 16, static_cast<char>('A' + w % 26))));
+  }
+  ASSERT_THAT(ReadPacket(), IsEmpty());
+}
+
 // -------------------
 // Re-writing same chunk id
 // -------------------
@@ -0,0 +1,176 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/tracing/core/trace_file_writer.h"
+
+#include <limits.h>
+#include <string.h>
+
+#include <algorithm>
+#include <tuple>
+
+#include "perfetto/base/build_config.h"
+#include "perfetto/base/logging.h"
+#include "perfetto/ext/base/file_utils.h"
+#include "perfetto/ext/base/utils.h"
+#include "perfetto/ext/tracing/core/trace_packet.h"
+
+#if !PERFETTO_BUILDFLAG(PERFETTO_OS_WIN) && \
+    !PERFETTO_BUILDFLAG(PERFETTO_OS_NACL)
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_WIN) || PERFETTO_BUILDFLAG(PERFETTO_OS_NACL)
+struct iovec {
+  void* iov_base;  // Address
+  size_t iov_len;  // Block size
+};
+#endif
+
+namespace perfetto {
+
+namespace {
+
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_WIN) || PERFETTO_BUILDFLAG(PERFETTO_OS_NACL)
+// Simple implementation of writev. Note that this does not give the atomicity
+// guarantees of a real writev, but we don't depend on these (we aren't writing
+// to the same file from another thread).
+ssize_t writev(int fd, const struct iovec* iov, int iovcnt) {
+  ssize_t total_size = 0;
+  for (int i = 0; i < iovcnt; ++i) {
+    ssize_t current_size = base::WriteAll(fd, iov[i].iov_base, iov[i].iov_len);
+    if (current_size != static_cast<ssize_t>(iov[i].iov_len))
+      return -1;
+    total_size += current_size;
+  }
+  return total_size;
+}
+
+#define IOV_MAX 1024  // Linux compatible limit.
+
+#endif  // PERFETTO_BUILDFLAG(PERFETTO_OS_WIN) ||
+        // PERFETTO_BUILDFLAG(PERFETTO_OS_NACL)
+
+// writev() can take at most IOV_MAX entries per call.
+constexpr size_t kMaxIovecs = IOV_MAX;
+
+// Size of the buffer holding the copies of the small slices. Filling it up
+// (at most kMaxCopiedSliceSize bytes per iovec) takes as many iovecs as
+// kMaxIovecs, so that in practice both run out at the same time.
+constexpr size_t kScratchSize = 64 * 1024;
+
+}  // namespace
+
+TraceFileWriter::TraceFileWriter(int fd,
+                                 uint64_t bytes_written,
+                                 uint64_t max_file_size)
+    : fd_(fd),
+      bytes_written_(bytes_written),
+      max_file_size_(max_file_size),
+      iovecs_(new struct iovec[kMaxIovecs]),
+      scratch_(new uint8_t[kScratchSize]) {}
+
+TraceFileWriter::~TraceFileWriter() {
+  PERFETTO_DCHECK(num_iovecs_ == 0);
+}
+
+bool TraceFileWriter::AppendPacket(TracePacket* packet) {
+  if (write_failed_)
+    return false;
+
+  char* preamble;
+  size_t preamble_size;
+  std::tie(preamble, preamble_size) = packet->GetProtoPreamble();
+  const uint64_t packet_size = preamble_size + packet->size();
+  if (max_file_size_ &&
+      bytes_written_ + pending_bytes_ + packet_size >= max_file_size_) {
+    return false;
+  }
+
+  AppendSlice(preamble, preamble_size);
+  for (const Slice& slice : packet->slices())
+    AppendSlice(slice.start, slice.size);
+  return !write_failed_;
+}
+
+void TraceFileWriter::AppendSlice(const void* data, size_t size) {
+  if (size == 0)
+    return;
+
+  const bool copy = size <= kMaxCopiedSliceSize;
+  if (num_iovecs_ == kMaxIovecs ||
+      (copy && scratch_used_ + size > kScratchSize)) {
+    Flush();
+  }
+  pending_bytes_ += size;
+
+  if (!copy) {
+    // writev() doesn't change the passed pointer. However, struct iovec
+    // take a non-const ptr because it's the same struct used by readv().
+    // Hence the const_cast here.
+    iovecs_[num_iovecs_++] = {const_cast<void*>(data), size};
+    return;
+  }
+
+  uint8_t* dst = &scratch_[scratch_used_];
+  memcpy(dst, data, size);
+  scratch_used_ += size;
+
+  // Consecutive copies are contiguous: extend the last iovec if it ends where
+  // this copy starts.
+  if (num_iovecs_ > 0) {
+    struct iovec& last = iovecs_[num_iovecs_ - 1];
+    if (static_cast<uint8_t*>(last.iov_base) + last.iov_len == dst) {
+      last.iov_len += size;
+      return;
+    }
+  }
+  iovecs_[num_iovecs_++] = {dst, size};
+}
+
+bool TraceFileWriter::Flush() {
+  size_t i = 0;
+  while (i < num_iovecs_ && !write_failed_) {
+    int iov_batch_size =
+        static_cast<int>(std::min(num_iovecs_ - i, kMaxIovecs));
+    ssize_t wr_size = PERFETTO_EINTR(writev(fd_, &iovecs_[i], iov_batch_size));
+    if (wr_size <= 0) {
+      PERFETTO_PLOG("writev() failed");
+      write_failed_ = true;
+      break;
+    }
+    bytes_written_ += static_cast<uint64_t>(wr_size);
+
+    // Skip the iovecs that have been fully written and adjust the one that
+    // has been written only partially, if any.
+    size_t left = static_cast<size_t>(wr_size);
+    while (i < num_iovecs_ && left >= iovecs_[i].iov_len) {
+      left -= iovecs_[i].iov_len;
+      i++;
+    }
+    if (left > 0) {
+      iovecs_[i].iov_base = static_cast<uint8_t*>(iovecs_[i].iov_base) + left;
+      iovecs_[i].iov_len -= left;
+    }
+  }
+  num_iovecs_ = 0;
+  pending_bytes_ = 0;
+  scratch_used_ = 0;
+  return !write_failed_;
+}
+
+}  // namespace perfetto
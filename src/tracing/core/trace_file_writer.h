@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACING_CORE_TRACE_FILE_WRITER_H_
+#define SRC_TRACING_CORE_TRACE_FILE_WRITER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+
+struct iovec;
+
+namespace perfetto {
+
+class TracePacket;
+
+// Writes TracePacket(s) into a file, in the format of a root trace.proto
+// message: each packet is prepended with a preamble stating its field id
+// (within trace.proto) and size.
+//
+// Packets are batched and written with as few writev() calls as possible.
+// The data of large slices is never copied: the iovecs passed to writev()
+// point directly to it. For packets read from a TraceBuffer, this is the
+// buffer memory itself. Small slices (the preambles, the trusted fields
+// appended by the service to each packet, tiny packets) are instead copied
+// into a scratch buffer, where they end up next to each other and can be
+// written with a single iovec.
+class TraceFileWriter {
+ public:
+  // Slices up to this size are copied into the scratch buffer.
+  static constexpr size_t kMaxCopiedSliceSize = 64;
+
+  // |bytes_written| is the current size of the file. Packets that would make
+  // the file size reach |max_file_size| are not written. 0 means no limit.
+  TraceFileWriter(int fd, uint64_t bytes_written, uint64_t max_file_size);
+  ~TraceFileWriter();
+
+  TraceFileWriter(const TraceFileWriter&) = delete;
+  TraceFileWriter& operator=(const TraceFileWriter&) = delete;
+
+  // Appends a packet to the file. The slices up to kMaxCopiedSliceSize bytes
+  // are copied. The memory of the other slices must stay valid until the next
+  // call to Flush(), which this can call internally.
+  // Returns false, without writing the packet, if it doesn't fit in the
+  // maximum file size or if a write failed.
+  bool AppendPacket(TracePacket*);
+
+  // Writes all the appended packets into the file. Must be called before
+  // destroying the TraceFileWriter. Returns false if a write failed.
+  bool Flush();
+
+  // The size of the file, including the data written by this instance.
+  uint64_t bytes_written() const { return bytes_written_; }
+
+ private:
+  void AppendSlice(const void* data, size_t size);
+
+  const int fd_;
+  uint64_t bytes_written_;
+  const uint64_t max_file_size_;
+
+  // Set after the first failed write. No more data is written after that.
+  bool write_failed_ = false;
+
+  // The iovecs for the next writev() call.
+  std::unique_ptr<struct iovec[]> iovecs_;
+  size_t num_iovecs_ = 0;
+  uint64_t pending_bytes_ = 0;  // SUM(iov_len for each iovec in |iovecs_|).
+
+  // Holds the copies of the small slices referenced by |iovecs_|.
+  std::unique_ptr<uint8_t[]> scratch_;
+  size_t scratch_used_ = 0;
+};
+
+}  // namespace perfetto
+
+#endif  // SRC_TRACING_CORE_TRACE_FILE_WRITER_H_
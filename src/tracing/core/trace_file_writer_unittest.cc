@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/tracing/core/trace_file_writer.h"
+
+#include <fcntl.h>
+#include <string.h>
+
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "perfetto/ext/base/file_utils.h"
+#include "perfetto/ext/base/scoped_file.h"
+#include "perfetto/ext/base/temp_file.h"
+#include "perfetto/ext/tracing/core/trace_packet.h"
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace {
+
+// Returns what TraceFileWriter is expected to write for |packet|.
+std::string Serialize(TracePacket* packet) {
+  char* preamble;
+  size_t preamble_size;
+  std::tie(preamble, preamble_size) = packet->GetProtoPreamble();
+  return std::string(preamble, preamble_size) +
+         packet->GetRawBytesForTesting();
+}
+
+std::string ReadAll(const base::TempFile& file) {
+  std::string contents;
+  PERFETTO_CHECK(base::ReadFile(file.path(), &contents));
+  return contents;
+}
+
+TEST(TraceFileWriterTest, WritesRootTraceMessage) {
+  base::TempFile file = base::TempFile::Create();
+
+  // Mix small (copied) and large (referenced) slices, with enough packets to
+  // exceed both the scratch buffer and the number of iovecs per writev().
+  std::vector<std::string> slices_data;
+  for (size_t i = 0; i < 3000; i++) {
+    slices_data.emplace_back(1 + i % 8, static_cast<char>('a' + i % 26));
+    slices_data.emplace_back(1 + (i * 37) % 300, static_cast<char>(i));
+  }
+
+  std::string expected;
+  TraceFileWriter writer(file.fd(), 0, 0);
+  for (size_t i = 0; i < slices_data.size(); i += 2) {
+    TracePacket packet;
+    packet.AddSlice(slices_data[i].data(), slices_data[i].size());
+    packet.AddSlice(slices_data[i + 1].data(), slices_data[i + 1].size());
+    expected += Serialize(&packet);
+    ASSERT_TRUE(writer.AppendPacket(&packet));
+  }
+  ASSERT_TRUE(writer.Flush());
+
+  EXPECT_EQ(writer.bytes_written(), expected.size());
+  EXPECT_EQ(ReadAll(file), expected);
+}
+
+TEST(TraceFileWriterTest, CopiesOnlySmallSlices) {
+  base::TempFile file = base::TempFile::Create();
+  std::string small(TraceFileWriter::kMaxCopiedSliceSize, 's');
+  std::string large(TraceFileWriter::kMaxCopiedSliceSize + 1, 'l');
+
+  TracePacket packet;
+  packet.AddSlice(small.data(), small.size());
+  packet.AddSlice(large.data(), large.size());
+  TraceFileWriter writer(file.fd(), 0, 0);
+  ASSERT_TRUE(writer.AppendPacket(&packet));
+
+  // The small slice has been copied, the large one is written from its
+  // original location when flushing.
+  std::string before = Serialize(&packet);
+  memset(&small[0], 'x', small.size());
+  memset(&large[0], 'y', large.size());
+  ASSERT_TRUE(writer.Flush());
+
+  std::string contents = ReadAll(file);
+  ASSERT_EQ(contents.size(), before.size());
+  EXPECT_EQ(contents.substr(0, before.size() - large.size()),
+            before.substr(0, before.size() - large.size()));
+  EXPECT_EQ(contents.substr(before.size() - large.size()), large);
+}
+
+TEST(TraceFileWriterTest, StopsBeforeMaxFileSize) {
+  base::TempFile file = base::TempFile::Create();
+  std::string data(100, 'd');
+
+  TracePacket packet;
+  packet.AddSlice(data.data(), data.size());
+  const uint64_t packet_size = Serialize(&packet).size();
+
+  // Pretend that the file already contains some data. Only two packets fit.
+  const uint64_t initial_size = 1000;
+  TraceFileWriter writer(file.fd(), initial_size,
+                         initial_size + 3 * packet_size - 1);
+  EXPECT_TRUE(writer.AppendPacket(&packet));
+  EXPECT_TRUE(writer.AppendPacket(&packet));
+  EXPECT_FALSE(writer.AppendPacket(&packet));
+  ASSERT_TRUE(writer.Flush());
+
+  EXPECT_EQ(writer.bytes_written(), initial_size + 2 * packet_size);
+  EXPECT_EQ(ReadAll(file).size(), 2 * packet_size);
+}
+
+TEST(TraceFileWriterTest, WriteFailure) {
+  base::TempFile file = base::TempFile::Create();
+  base::ScopedFile read_only_fd = base::OpenFile(file.path(), O_RDONLY);
+  ASSERT_TRUE(read_only_fd);
+  std::string data(100, 'd');
+
+  TracePacket packet;
+  packet.AddSlice(data.data(), data.size());
+  TraceFileWriter writer(*read_only_fd, 0, 0);
+  EXPECT_TRUE(writer.AppendPacket(&packet));
+  EXPECT_FALSE(writer.Flush());
+  EXPECT_FALSE(writer.AppendPacket(&packet));
+  EXPECT_EQ(writer.bytes_written(), 0u);
+}
+
+}  // namespace
+}  // namespace perfetto
@@ -24,12 +24,12 @@
 #include <limits>
 #include <optional>
 #include <regex>
+#include <tuple>
 #include <unordered_set>
 #include "perfetto/base/time.h"
 
 #if !PERFETTO_BUILDFLAG(PERFETTO_OS_WIN) && \
     !PERFETTO_BUILDFLAG(PERFETTO_OS_NACL)
-#include <sys/uio.h>
 #include <sys/utsname.h>
 #include <unistd.h>
 #endif
@@ -77,9 +77,11 @@
 #include "src/android_stats/statsd_logging_helper.h"
 #include "src/protozero/filtering/message_filter.h"
 #include "src/protozero/filtering/string_filter.h"
+#include "src/tracing/core/async_file_writer.h"
 #include "src/tracing/core/packet_stream_validator.h"
 #include "src/tracing/core/shared_memory_arbiter_impl.h"
 #include "src/tracing/core/trace_buffer.h"
+#include "src/tracing/core/trace_file_writer.h"
 
 #include "protos/perfetto/common/builtin_clock.gen.h"
 #include "protos/perfetto/common/builtin_clock.pbzero.h"
@@ -120,31 +122,6 @@ constexpr uint32_t kMaxTracingDurationMillis = 7 * 24 * kMillisPerHour;
 constexpr uint32_t kGuardrailsMaxTracingBufferSizeKb = 128 * 1024;
 constexpr uint32_t kGuardrailsMaxTracingDurationMillis = 24 * kMillisPerHour;
 
-#if PERFETTO_BUILDFLAG(PERFETTO_OS_WIN) || PERFETTO_BUILDFLAG(PERFETTO_OS_NACL)
-struct iovec {
-  void* iov_base;  // Address
-  size_t iov_len;  // Block size
-};
-
-// Simple implementation of writev. Note that this does not give the atomicity
-// guarantees of a real writev, but we don't depend on these (we aren't writing
-// to the same file from another thread).
-ssize_t writev(int fd, const struct iovec* iov, int iovcnt) {
-  ssize_t total_size = 0;
-  for (int i = 0; i < iovcnt; ++i) {
-    ssize_t current_size = base::WriteAll(fd, iov[i].iov_base, iov[i].iov_len);
-    if (current_size != static_cast<ssize_t>(iov[i].iov_len))
-      return -1;
-    total_size += current_size;
-  }
-  return total_size;
-}
-
-#define IOV_MAX 1024  // Linux compatible limit.
-
-#endif  // PERFETTO_BUILDFLAG(PERFETTO_OS_WIN) ||
-        // PERFETTO_BUILDFLAG(PERFETTO_OS_NACL)
-
 // Partially encodes a CommitDataRequest in an int32 for the purposes of
 // metatracing. Note that it encodes only the bottom 10 bits of the producer id
 // (which is technically 16 bits wide).
@@ -893,12 +870,18 @@ base::Status TracingServiceImpl::EnableTracing(ConsumerEndpointImpl* consumer,
     tracing_session->write_period_ms = write_period_ms;
     tracing_session->max_file_size_bytes = cfg.max_file_size_bytes();
     tracing_session->bytes_written_into_file = 0;
+    if (init_opts_.async_write_into_file) {
+      tracing_session->file_writer.reset(new AsyncFileWriter(
+          task_runner_, *tracing_session->write_into_file,
+          tracing_session->max_file_size_bytes,
+          max_file_writer_pending_bytes_));
+    }
   }
 
   if (!cfg.compress_from_cli() &&
       cfg.compression_type() == TraceConfig::COMPRESSION_TYPE_DEFLATE) {
     if (init_opts_.compressor_fn) {
-      tracing_session->compress_deflate = true;
+      tracing_session->compressor_fn = init_opts_.compressor_fn;
     } else {
       PERFETTO_LOG(
           "COMPRESSION_TYPE_DEFLATE is not supported in the current build "
@@ -906,6 +889,16 @@ base::Status TracingServiceImpl::EnableTracing(ConsumerEndpointImpl* consumer,
     }
   }
 
+  if (cfg.compression_type() == TraceConfig::COMPRESSION_TYPE_ZSTD) {
+    if (init_opts_.zstd_compressor_fn) {
+      tracing_session->compressor_fn = init_opts_.zstd_compressor_fn;
+    } else {
+      PERFETTO_LOG(
+          "COMPRESSION_TYPE_ZSTD is not supported in the current build "
+          "configuration. Skipping compression");
+    }
+  }
+
   // Initialize the log buffers.
   bool did_allocate_all_buffers = true;
   bool invalid_buffer_config = false;
@@ -1742,8 +1735,12 @@ void TracingServiceImpl::DisableTracingNotifyConsumerAndFlushFile(
   MaybeLogUploadEvent(tracing_session->config, tracing_session->trace_uuid,
                       PerfettoStatsdAtom::kTracedNotifyTracingDisabled);
 
-  if (tracing_session->consumer_maybe_null)
+  // If the file writer thread is still writing, the consumer is notified once
+  // the file is complete.
+  if (tracing_session->consumer_maybe_null &&
+      !tracing_session->file_writer_finishing) {
     tracing_session->consumer_maybe_null->NotifyOnTracingDisabled("");
+  }
 }
 
 void TracingServiceImpl::Flush(TracingSessionID tsid,
@@ -2165,8 +2162,10 @@ bool TracingServiceImpl::ReadBuffersIntoFile(TracingSessionID tsid) {
 
   // This can happen if the file is closed by a previous task because it reaches
   // |max_file_size_bytes|.
-  if (!tracing_session->write_into_file)
+  if (!tracing_session->write_into_file ||
+      tracing_session->file_writer_finishing) {
     return false;
+  }
 
   if (IsWaitingForTrigger(tracing_session))
     return false;
@@ -2181,33 +2180,80 @@ bool TracingServiceImpl::ReadBuffersIntoFile(TracingSessionID tsid) {
   // to support the disable_immediately=true code paths.
   bool has_more = true;
   bool stop_writing_into_file = false;
-  do {
-    std::vector<TracePacket> packets =
-        ReadBuffers(tracing_session, kWriteIntoFileChunkSize, &has_more);
+  bool file_writer_queue_full = false;
+  if (tracing_session->file_writer) {
+    stop_writing_into_file =
+        QueueBuffersIntoFileWriter(tracing_session, &file_writer_queue_full);
+  } else if (!tracing_session->trace_filter &&
+             !tracing_session->compressor_fn) {
+    // Fast path: the packets don't need to be transformed and can be written
+    // straight out of the buffers.
+    stop_writing_into_file = WriteBuffersIntoFile(tracing_session);
+  } else {
+    do {
+      std::vector<TracePacket> packets =
+          ReadBuffers(tracing_session, kWriteIntoFileChunkSize, &has_more);
 
-    stop_writing_into_file = WriteIntoFile(tracing_session, std::move(packets));
-  } while (has_more && !stop_writing_into_file);
+      stop_writing_into_file =
+          WriteIntoFile(tracing_session, std::move(packets));
+    } while (has_more && !stop_writing_into_file);
+  }
 
   if (stop_writing_into_file || tracing_session->write_period_ms == 0) {
-    // Ensure all data was written to the file before we close it.
-    base::FlushFile(tracing_session->write_into_file.get());
-    tracing_session->write_into_file.reset();
     tracing_session->write_period_ms = 0;
+    if (tracing_session->file_writer) {
+      // Don't wait for the writer thread to write the queued data: the file is
+      // closed once it's done. The |file_writer| is kept around (stopped) for
+      // its stats.
+      tracing_session->file_writer_finishing = true;
+      auto weak_this = weak_ptr_factory_.GetWeakPtr();
+      tracing_session->file_writer->Finish([weak_this, tsid] {
+        if (weak_this)
+          weak_this->OnFileWriterFinished(tsid);
+      });
+    } else {
+      // Ensure all data was written to the file before we close it.
+      base::FlushFile(tracing_session->write_into_file.get());
+      tracing_session->write_into_file.reset();
+    }
     if (tracing_session->state == TracingSession::STARTED)
       DisableTracing(tsid);
     return true;
   }
 
+  // If the writer thread is lagging behind, come back as soon as possible to
+  // keep draining the buffers, rather than waiting for a full period.
+  uint32_t delay_ms = tracing_session->delay_to_next_write_period_ms();
+  if (file_writer_queue_full)
+    delay_ms = std::min(delay_ms, min_write_period_ms_);
+
   auto weak_this = weak_ptr_factory_.GetWeakPtr();
   task_runner_->PostDelayedTask(
       [weak_this, tsid] {
         if (weak_this)
           weak_this->ReadBuffersIntoFile(tsid);
       },
-      tracing_session->delay_to_next_write_period_ms());
+      delay_ms);
   return true;
 }
 
+void TracingServiceImpl::OnFileWriterFinished(TracingSessionID tsid) {
+  PERFETTO_DCHECK_THREAD(thread_checker_);
+  TracingSession* tracing_session = GetTracingSession(tsid);
+  if (!tracing_session || !tracing_session->file_writer_finishing)
+    return;
+  tracing_session->file_writer_finishing = false;
+  // The writer thread has already flushed the file.
+  tracing_session->write_into_file.reset();
+
+  // DisableTracingNotifyConsumerAndFlushFile() skipped the notification while
+  // the file was being written.
+  if (tracing_session->state == TracingSession::DISABLED &&
+      tracing_session->consumer_maybe_null) {
+    tracing_session->consumer_maybe_null->NotifyOnTracingDisabled("");
+  }
+}
+
 bool TracingServiceImpl::IsWaitingForTrigger(TracingSession* tracing_session) {
   // Ignore the logic below for cloned tracing sessions. In this case we
   // actually want to read the (cloned) trace buffers even if no trigger was
@@ -2254,35 +2300,7 @@ std::vector<TracePacket> TracingServiceImpl::ReadBuffers(
   std::vector<TracePacket> packets;
   packets.reserve(1024);  // Just an educated guess to avoid trivial expansions.
 
-  if (!tracing_session->initial_clock_snapshot.empty()) {
-    EmitClockSnapshot(tracing_session,
-                      std::move(tracing_session->initial_clock_snapshot),
-                      &packets);
-  }
-
-  for (auto& snapshot : tracing_session->clock_snapshot_ring_buffer) {
-    PERFETTO_DCHECK(!snapshot.empty());
-    EmitClockSnapshot(tracing_session, std::move(snapshot), &packets);
-  }
-  tracing_session->clock_snapshot_ring_buffer.clear();
-
-  if (tracing_session->should_emit_sync_marker) {
-    EmitSyncMarker(&packets);
-    tracing_session->should_emit_sync_marker = false;
-  }
-
-  if (!tracing_session->config.builtin_data_sources().disable_trace_config()) {
-    MaybeEmitUuidAndTraceConfig(tracing_session, &packets);
-    MaybeEmitReceivedTriggers(tracing_session, &packets);
-  }
-  if (!tracing_session->config.builtin_data_sources().disable_system_info())
-    MaybeEmitSystemInfo(tracing_session, &packets);
-
-  // Note that in the proto comment, we guarantee that the tracing_started
-  // lifecycle event will be emitted before any data packets so make sure to
-  // keep this before reading the tracing buffers.
-  if (!tracing_session->config.builtin_data_sources().disable_service_events())
-    EmitLifecycleEvents(tracing_session, &packets);
+  EmitPacketsBeforeBuffers(tracing_session, &packets);
 
   size_t packets_bytes = 0;  // SUM(slice.size() for each slice in |packets|).
 
@@ -2305,50 +2323,14 @@ std::vector<TracePacket> TracingServiceImpl::ReadBuffers(
     tbuf.BeginRead();
     while (!did_hit_threshold) {
       TracePacket packet;
-      TraceBuffer::PacketSequenceProperties sequence_properties{};
-      bool previous_packet_dropped;
-      if (!tbuf.ReadNextTracePacket(&packet, &sequence_properties,
-                                    &previous_packet_dropped)) {
+      uint8_t trusted_fields[kMaxTrustedFieldsSize];
+      size_t trusted_fields_size;
+      if (!ReadNextValidPacket(tracing_session, &tbuf, &packet, trusted_fields,
+                               &trusted_fields_size)) {
         break;
       }
-      PERFETTO_DCHECK(sequence_properties.producer_id_trusted != 0);
-      PERFETTO_DCHECK(sequence_properties.writer_id != 0);
-      PERFETTO_DCHECK(sequence_properties.producer_uid_trusted != kInvalidUid);
-      // Not checking sequence_properties.producer_pid_trusted: it is
-      // base::kInvalidPid if the platform doesn't support it.
-
-      PERFETTO_DCHECK(packet.size() > 0);
-      if (!PacketStreamValidator::Validate(packet.slices())) {
-        tracing_session->invalid_packets++;
-        PERFETTO_DLOG("Dropping invalid packet");
-        continue;
-      }
-
-      // Append a slice with the trusted field data. This can't be spoofed
-      // because above we validated that the existing slices don't contain any
-      // trusted fields. For added safety we append instead of prepending
-      // because according to protobuf semantics, if the same field is
-      // encountered multiple times the last instance takes priority. Note that
-      // truncated packets are also rejected, so the producer can't give us a
-      // partial packet (e.g., a truncated string) which only becomes valid when
-      // the trusted data is appended here.
-      Slice slice = Slice::Allocate(32);
-      protozero::StaticBuffered<protos::pbzero::TracePacket> trusted_packet(
-          slice.own_data(), slice.size);
-      trusted_packet->set_trusted_uid(
-          static_cast<int32_t>(sequence_properties.producer_uid_trusted));
-      trusted_packet->set_trusted_packet_sequence_id(
-          tracing_session->GetPacketSequenceID(
-              sequence_properties.producer_id_trusted,
-              sequence_properties.writer_id));
-      if (sequence_properties.producer_pid_trusted != base::kInvalidPid) {
-        // Not supported on all platforms.
-        trusted_packet->set_trusted_pid(
-            static_cast<int32_t>(sequence_properties.producer_pid_trusted));
-      }
-      if (previous_packet_dropped)
-        trusted_packet->set_previous_packet_dropped(previous_packet_dropped);
-      slice.size = trusted_packet.Finalize();
+      Slice slice = Slice::Allocate(trusted_fields_size);
+      memcpy(slice.own_data(), trusted_fields, trusted_fields_size);
       packet.AddSlice(std::move(slice));
 
       // Append the packet (inclusive of the trusted uid) to |packets|.
@@ -2360,12 +2342,66 @@ std::vector<TracePacket> TracingServiceImpl::ReadBuffers(
 
   *has_more = did_hit_threshold;
 
-  // Only emit the "read complete" lifetime event when there is no more trace
-  // data available to read. These events are used as safe points to limit
+  if (!*has_more)
+    EmitPacketsAfterBuffers(tracing_session, &packets);
+
+  MaybeFilterPackets(tracing_session, &packets);
+
+  MaybeCompressPackets(tracing_session, &packets);
+
+  if (!*has_more) {
+    // We've observed some extremely high memory usage by scudo after
+    // MaybeFilterPackets in the past. The original bug (b/195145848) is fixed
+    // now, but this code asks scudo to release memory just in case.
+    base::MaybeReleaseAllocatorMemToOS();
+  }
+
+  return packets;
+}
+
+void TracingServiceImpl::EmitPacketsBeforeBuffers(
+    TracingSession* tracing_session,
+    std::vector<TracePacket>* packets) {
+  if (!tracing_session->initial_clock_snapshot.empty()) {
+    EmitClockSnapshot(tracing_session,
+                      std::move(tracing_session->initial_clock_snapshot),
+                      packets);
+  }
+
+  for (auto& snapshot : tracing_session->clock_snapshot_ring_buffer) {
+    PERFETTO_DCHECK(!snapshot.empty());
+    EmitClockSnapshot(tracing_session, std::move(snapshot), packets);
+  }
+  tracing_session->clock_snapshot_ring_buffer.clear();
+
+  if (tracing_session->should_emit_sync_marker) {
+    EmitSyncMarker(packets);
+    tracing_session->should_emit_sync_marker = false;
+  }
+
+  if (!tracing_session->config.builtin_data_sources().disable_trace_config()) {
+    MaybeEmitUuidAndTraceConfig(tracing_session, packets);
+    MaybeEmitReceivedTriggers(tracing_session, packets);
+  }
+  if (!tracing_session->config.builtin_data_sources().disable_system_info())
+    MaybeEmitSystemInfo(tracing_session, packets);
+
+  // Note that in the proto comment, we guarantee that the tracing_started
+  // lifecycle event will be emitted before any data packets so make sure to
+  // keep this before reading the tracing buffers.
+  if (!tracing_session->config.builtin_data_sources().disable_service_events())
+    EmitLifecycleEvents(tracing_session, packets);
+}
+
+void TracingServiceImpl::EmitPacketsAfterBuffers(
+    TracingSession* tracing_session,
+    std::vector<TracePacket>* packets) {
+  // This must be called only when there is no more trace data available to
+  // read. The "read complete" lifetime events are used as safe points to limit
   // sorting in trace processor: the code shouldn't emit the event unless the
   // buffers are empty.
-  if (!*has_more && !tracing_session->config.builtin_data_sources()
-                         .disable_service_events()) {
+  if (!tracing_session->config.builtin_data_sources()
+           .disable_service_events()) {
     // We don't bother snapshotting clocks here because we wouldn't be able to
     // emit it and we shouldn't have significant drift from the last snapshot in
     // any case.
@@ -2373,31 +2409,72 @@ std::vector<TracePacket> TracingServiceImpl::ReadBuffers(
                           protos::pbzero::TracingServiceEvent::
                               kReadTracingBuffersCompletedFieldNumber,
                           false /* snapshot_clocks */);
-    EmitLifecycleEvents(tracing_session, &packets);
+    EmitLifecycleEvents(tracing_session, packets);
   }
 
-  // Only emit the stats when there is no more trace data is available to read.
-  // That way, any problems that occur while reading from the buffers are
-  // reflected in the emitted stats. This is particularly important for use
-  // cases where ReadBuffers is only ever called after the tracing session is
-  // stopped.
-  if (!*has_more && tracing_session->should_emit_stats) {
-    EmitStats(tracing_session, &packets);
+  // Similarly, the stats are emitted only when there is no more trace data
+  // available to read. That way, any problems that occur while reading from
+  // the buffers are reflected in the emitted stats. This is particularly
+  // important for use cases where ReadBuffers is only ever called after the
+  // tracing session is stopped.
+  if (tracing_session->should_emit_stats) {
+    EmitStats(tracing_session, packets);
     tracing_session->should_emit_stats = false;
   }
+}
 
-  MaybeFilterPackets(tracing_session, &packets);
-
-  MaybeCompressPackets(tracing_session, &packets);
+bool TracingServiceImpl::ReadNextValidPacket(TracingSession* tracing_session,
+                                             TraceBuffer* tbuf,
+                                             TracePacket* packet,
+                                             uint8_t* trusted_fields,
+                                             size_t* trusted_fields_size) {
+  for (;;) {
+    TraceBuffer::PacketSequenceProperties sequence_properties{};
+    bool previous_packet_dropped;
+    if (!tbuf->ReadNextTracePacket(packet, &sequence_properties,
+                                   &previous_packet_dropped)) {
+      return false;
+    }
+    PERFETTO_DCHECK(sequence_properties.producer_id_trusted != 0);
+    PERFETTO_DCHECK(sequence_properties.writer_id != 0);
+    PERFETTO_DCHECK(sequence_properties.producer_uid_trusted != kInvalidUid);
+    // Not checking sequence_properties.producer_pid_trusted: it is
+    // base::kInvalidPid if the platform doesn't support it.
+
+    PERFETTO_DCHECK(packet->size() > 0);
+    if (!PacketStreamValidator::Validate(packet->slices())) {
+      tracing_session->invalid_packets++;
+      PERFETTO_DLOG("Dropping invalid packet");
+      *packet = TracePacket();
+      continue;
+    }
 
-  if (!*has_more) {
-    // We've observed some extremely high memory usage by scudo after
-    // MaybeFilterPackets in the past. The original bug (b/195145848) is fixed
-    // now, but this code asks scudo to release memory just in case.
-    base::MaybeReleaseAllocatorMemToOS();
+    // Append a slice with the trusted field data. This can't be spoofed
+    // because above we validated that the existing slices don't contain any
+    // trusted fields. For added safety we append instead of prepending
+    // because according to protobuf semantics, if the same field is
+    // encountered multiple times the last instance takes priority. Note that
+    // truncated packets are also rejected, so the producer can't give us a
+    // partial packet (e.g., a truncated string) which only becomes valid when
+    // the trusted data is appended here.
+    protozero::StaticBuffered<protos::pbzero::TracePacket> trusted_packet(
+        trusted_fields, kMaxTrustedFieldsSize);
+    trusted_packet->set_trusted_uid(
+        static_cast<int32_t>(sequence_properties.producer_uid_trusted));
+    trusted_packet->set_trusted_packet_sequence_id(
+        tracing_session->GetPacketSequenceID(
+            sequence_properties.producer_id_trusted,
+            sequence_properties.writer_id));
+    if (sequence_properties.producer_pid_trusted != base::kInvalidPid) {
+      // Not supported on all platforms.
+      trusted_packet->set_trusted_pid(
+          static_cast<int32_t>(sequence_properties.producer_pid_trusted));
+    }
+    if (previous_packet_dropped)
+      trusted_packet->set_previous_packet_dropped(previous_packet_dropped);
+    *trusted_fields_size = trusted_packet.Finalize();
+    return true;
   }
-
-  return packets;
 }
 
 void TracingServiceImpl::MaybeFilterPackets(TracingSession* tracing_session,
@@ -2449,11 +2526,11 @@ void TracingServiceImpl::MaybeFilterPackets(TracingSession* tracing_session,
 void TracingServiceImpl::MaybeCompressPackets(
     TracingSession* tracing_session,
     std::vector<TracePacket>* packets) {
-  if (!tracing_session->compress_deflate) {
+  if (!tracing_session->compressor_fn) {
     return;
   }
 
-  init_opts_.compressor_fn(packets);
+  tracing_session->compressor_fn(packets);
 }
 
 bool TracingServiceImpl::WriteIntoFile(TracingSession* tracing_session,
@@ -2461,72 +2538,172 @@ bool TracingServiceImpl::WriteIntoFile(TracingSession* tracing_session,
   if (!tracing_session->write_into_file) {
     return false;
   }
-  const uint64_t max_size = tracing_session->max_file_size_bytes
-                                ? tracing_session->max_file_size_bytes
-                                : std::numeric_limits<size_t>::max();
-
-  size_t total_slices = 0;
-  for (const TracePacket& packet : packets) {
-    total_slices += packet.slices().size();
-  }
   // When writing into a file, the file should look like a root trace.proto
-  // message. Each packet should be prepended with a proto preamble stating
-  // its field id (within trace.proto) and size. Hence the addition below.
-  const size_t max_iovecs = total_slices + packets.size();
-
-  size_t num_iovecs = 0;
+  // message. TraceFileWriter prepends each packet with a proto preamble
+  // stating its field id (within trace.proto) and size.
+  TraceFileWriter writer(*tracing_session->write_into_file,
+                         tracing_session->bytes_written_into_file,
+                         tracing_session->max_file_size_bytes);
   bool stop_writing_into_file = false;
-  std::unique_ptr<struct iovec[]> iovecs(new struct iovec[max_iovecs]);
-  size_t num_iovecs_at_last_packet = 0;
-  uint64_t bytes_about_to_be_written = 0;
   for (TracePacket& packet : packets) {
-    std::tie(iovecs[num_iovecs].iov_base, iovecs[num_iovecs].iov_len) =
-        packet.GetProtoPreamble();
-    bytes_about_to_be_written += iovecs[num_iovecs].iov_len;
-    num_iovecs++;
-    for (const Slice& slice : packet.slices()) {
-      // writev() doesn't change the passed pointer. However, struct iovec
-      // take a non-const ptr because it's the same struct used by readv().
-      // Hence the const_cast here.
-      char* start = static_cast<char*>(const_cast<void*>(slice.start));
-      bytes_about_to_be_written += slice.size;
-      iovecs[num_iovecs++] = {start, slice.size};
-    }
-
-    if (tracing_session->bytes_written_into_file + bytes_about_to_be_written >=
-        max_size) {
+    if (!writer.AppendPacket(&packet)) {
       stop_writing_into_file = true;
-      num_iovecs = num_iovecs_at_last_packet;
       break;
     }
+  }
+  if (!writer.Flush())
+    stop_writing_into_file = true;
+
+  PERFETTO_DLOG("Draining into file, written: %" PRIu64 " KB, stop: %d",
+                (writer.bytes_written() -
+                 tracing_session->bytes_written_into_file + 1023) /
+                    1024,
+                stop_writing_into_file);
+  tracing_session->bytes_written_into_file = writer.bytes_written();
+  return stop_writing_into_file;
+}
 
-    num_iovecs_at_last_packet = num_iovecs;
+bool TracingServiceImpl::WriteBuffersIntoFile(TracingSession* tracing_session) {
+  PERFETTO_DCHECK_THREAD(thread_checker_);
+  PERFETTO_DCHECK(!tracing_session->trace_filter);
+  PERFETTO_DCHECK(!tracing_session->compressor_fn);
+  if (!tracing_session->write_into_file) {
+    return false;
   }
-  PERFETTO_DCHECK(num_iovecs <= max_iovecs);
-  int fd = *tracing_session->write_into_file;
 
-  uint64_t total_wr_size = 0;
+  // The packets read from the buffers point directly to the buffer memory,
+  // which stays untouched until this function returns, and are written from
+  // there. The trusted fields are instead encoded on the stack and must be
+  // copied by the TraceFileWriter.
+  static_assert(kMaxTrustedFieldsSize <= TraceFileWriter::kMaxCopiedSliceSize,
+                "The trusted fields must be copied by TraceFileWriter");
 
-  // writev() can take at most IOV_MAX entries per call. Batch them.
-  constexpr size_t kIOVMax = IOV_MAX;
-  for (size_t i = 0; i < num_iovecs; i += kIOVMax) {
-    int iov_batch_size = static_cast<int>(std::min(num_iovecs - i, kIOVMax));
-    ssize_t wr_size = PERFETTO_EINTR(writev(fd, &iovecs[i], iov_batch_size));
-    if (wr_size <= 0) {
-      PERFETTO_PLOG("writev() failed");
+  TraceFileWriter writer(*tracing_session->write_into_file,
+                         tracing_session->bytes_written_into_file,
+                         tracing_session->max_file_size_bytes);
+
+  // The slices of the service-generated packets are referenced (not copied)
+  // by |writer| until the last Flush().
+  std::vector<TracePacket> packets_before;
+  EmitPacketsBeforeBuffers(tracing_session, &packets_before);
+  bool stop_writing_into_file = false;
+  for (TracePacket& packet : packets_before) {
+    if (!writer.AppendPacket(&packet)) {
       stop_writing_into_file = true;
       break;
     }
-    total_wr_size += static_cast<size_t>(wr_size);
   }
 
-  tracing_session->bytes_written_into_file += total_wr_size;
+  for (size_t buf_idx = 0;
+       buf_idx < tracing_session->num_buffers() && !stop_writing_into_file;
+       buf_idx++) {
+    auto tbuf_iter = buffers_.find(tracing_session->buffers_index[buf_idx]);
+    if (tbuf_iter == buffers_.end()) {
+      PERFETTO_DFATAL("Buffer not found.");
+      continue;
+    }
+    TraceBuffer& tbuf = *tbuf_iter->second;
+    tbuf.BeginRead();
+    while (!stop_writing_into_file) {
+      TracePacket packet;
+      uint8_t trusted_fields[kMaxTrustedFieldsSize];
+      size_t trusted_fields_size;
+      if (!ReadNextValidPacket(tracing_session, &tbuf, &packet, trusted_fields,
+                               &trusted_fields_size)) {
+        break;
+      }
+      packet.AddSlice(trusted_fields, trusted_fields_size);
+      stop_writing_into_file = !writer.AppendPacket(&packet);
+    }
+  }
+
+  std::vector<TracePacket> packets_after;
+  if (!stop_writing_into_file) {
+    EmitPacketsAfterBuffers(tracing_session, &packets_after);
+    for (TracePacket& packet : packets_after) {
+      if (!writer.AppendPacket(&packet)) {
+        stop_writing_into_file = true;
+        break;
+      }
+    }
+  }
+  if (!writer.Flush())
+    stop_writing_into_file = true;
 
   PERFETTO_DLOG("Draining into file, written: %" PRIu64 " KB, stop: %d",
-                (total_wr_size + 1023) / 1024, stop_writing_into_file);
+                (writer.bytes_written() -
+                 tracing_session->bytes_written_into_file + 1023) /
+                    1024,
+                stop_writing_into_file);
+  tracing_session->bytes_written_into_file = writer.bytes_written();
   return stop_writing_into_file;
 }
 
+bool TracingServiceImpl::QueueBuffersIntoFileWriter(
+    TracingSession* tracing_session,
+    bool* queue_full) {
+  PERFETTO_DCHECK_THREAD(thread_checker_);
+  AsyncFileWriter* file_writer = tracing_session->file_writer.get();
+  PERFETTO_DCHECK(file_writer);
+  *queue_full = false;
+
+  // The last read must drain the buffers in full, because they can be freed
+  // right after. Rather than waiting for the writer thread to make room in the
+  // queue, the queue size is exceeded: this is bounded by the buffer size.
+  const bool last_read = tracing_session->write_period_ms == 0;
+  const bool packets_own_memory =
+      tracing_session->trace_filter || tracing_session->compressor_fn;
+  bool has_more = true;
+  while (has_more) {
+    if (file_writer->stopped())
+      return true;
+    size_t available_bytes =
+        last_read ? kWriteIntoFileChunkSize : file_writer->available_bytes();
+    if (available_bytes == 0) {
+      // Leave the data in the buffers and retry when the writer thread has
+      // caught up. This is what decouples the service from the output file.
+      tracing_session->file_writer_queue_full_events++;
+      *queue_full = true;
+      return false;
+    }
+
+    std::vector<TracePacket> packets =
+        ReadBuffers(tracing_session,
+                    std::min(available_bytes, kWriteIntoFileChunkSize),
+                    &has_more);
+
+    AsyncFileWriter::Batch batch;
+    if (packets_own_memory) {
+      // Filtered and compressed packets are made of slices that own their
+      // memory: they are handed over as they are.
+      batch.packets = std::move(packets);
+    } else {
+      // The packets point to the buffers, which can be overwritten as soon
+      // as this returns. Their payload is copied, once, into storage owned by
+      // the batch. This copy is the only thing the writer thread can't do:
+      // formatting and writing the packets happens there.
+      size_t size = 0;
+      for (const TracePacket& packet : packets)
+        size += packet.size();
+      batch.storage = file_writer->AcquireStorage(size);
+      batch.packets.reserve(packets.size());
+      for (const TracePacket& packet : packets) {
+        TracePacket copy;
+        for (const Slice& slice : packet.slices()) {
+          // |storage| doesn't reallocate: its capacity is >= |size|.
+          const uint8_t* data = static_cast<const uint8_t*>(slice.start);
+          size_t offset = batch.storage.size();
+          batch.storage.insert(batch.storage.end(), data, data + slice.size);
+          copy.AddSlice(batch.storage.data() + offset, slice.size);
+        }
+        batch.packets.emplace_back(std::move(copy));
+      }
+    }
+    file_writer->Write(std::move(batch));
+  }
+  return false;
+}
+
 void TracingServiceImpl::FreeBuffers(TracingSessionID tsid) {
   PERFETTO_DCHECK_THREAD(thread_checker_);
   PERFETTO_DLOG("Freeing buffers for session %" PRIu64, tsid);
@@ -3367,6 +3544,18 @@ TraceStats TracingServiceImpl::GetTraceStats(TracingSession* tracing_session) {
     filt_stats->set_time_taken_ns(tracing_session->filter_time_taken_ns);
   }
 
+  if (tracing_session->file_writer) {
+    AsyncFileWriter::Stats writer_stats =
+        tracing_session->file_writer->GetStats();
+    auto* file_stats = trace_stats.mutable_write_into_file_stats();
+    file_stats->set_bytes_queued(writer_stats.bytes_queued);
+    file_stats->set_bytes_written(writer_stats.bytes_written);
+    file_stats->set_max_pending_bytes(writer_stats.max_pending_bytes);
+    file_stats->set_queue_full_events(
+        tracing_session->file_writer_queue_full_events);
+    file_stats->set_write_time_ns(writer_stats.write_time_ns);
+  }
+
   for (BufferID buf_id : tracing_session->buffers_index) {
     TraceBuffer* buf = GetBufferByID(buf_id);
     if (!buf) {
@@ -3712,7 +3901,7 @@ base::Status TracingServiceImpl::DoCloneSession(ConsumerEndpointImpl* consumer,
   cloned_session->flushes_requested = src->flushes_requested;
   cloned_session->flushes_succeeded = src->flushes_succeeded;
   cloned_session->flushes_failed = src->flushes_failed;
-  cloned_session->compress_deflate = src->compress_deflate;
+  cloned_session->compressor_fn = src->compressor_fn;
   if (src->trace_filter) {
     // Copy the trace filter.
     cloned_session->trace_filter.reset(
@@ -67,6 +67,7 @@ enum TraceStats_FinalFlushOutcome : int;
 class Consumer;
 class Producer;
 class SharedMemory;
+class AsyncFileWriter;
 class SharedMemoryArbiterImpl;
 class TraceBuffer;
 class TracePacket;
@@ -92,6 +93,11 @@ class TracingServiceImpl : public TracingService {
   // allocated.
   static constexpr size_t kWriteIntoFileChunkSize = 1024 * 1024ul;
 
+  // The maximum amount of data queued to the file writer thread of each
+  // session, when InitOpts.async_write_into_file is set. When the queue is
+  // full, the data is left in the buffers until the writer catches up.
+  static constexpr size_t kMaxFileWriterPendingBytes = 8 * 1024 * 1024ul;
+
   // The implementation behind the service endpoint exposed to each producer.
   class ProducerEndpointImpl : public TracingService::ProducerEndpoint {
    public:
@@ -568,8 +574,8 @@ class TracingServiceImpl : public TracingService {
     // Whether we put the system info into the trace output yet.
     bool did_emit_system_info = false;
 
-    // Whether we should compress TracePackets after reading them.
-    bool compress_deflate = false;
+    // If set, the function used to compress TracePackets after reading them.
+    TracingService::InitOpts::CompressorFn compressor_fn = nullptr;
 
     // The number of received triggers we've emitted into the trace output.
     size_t num_triggers_emitted_into_trace = 0;
@@ -638,6 +644,17 @@ class TracingServiceImpl : public TracingService {
     uint64_t max_file_size_bytes = 0;
     uint64_t bytes_written_into_file = 0;
 
+    // Set only when InitOpts.async_write_into_file is true. Writes into a
+    // duplicate of |write_into_file| from a dedicated thread, which keeps
+    // writing the queued data if the session is destroyed in the meantime.
+    std::unique_ptr<AsyncFileWriter> file_writer;
+    uint64_t file_writer_queue_full_events = 0;
+
+    // Set after the last data has been queued to |file_writer|, until it has
+    // been written. The file is closed, and the consumer notified that tracing
+    // is disabled, only after that (see OnFileWriterFinished()).
+    bool file_writer_finishing = false;
+
     // Periodic task for snapshotting service events (e.g. clocks, sync markers
     // etc)
     base::PeriodicTask snapshot_periodic_task;
@@ -747,6 +764,32 @@ class TracingServiceImpl : public TracingService {
                                        size_t threshold,
                                        bool* has_more);
 
+  // Appends to `*packets` the service-generated packets that precede the
+  // contents of the buffers (clock snapshots, trace config, lifecycle events,
+  // ...) on each read.
+  void EmitPacketsBeforeBuffers(TracingSession* tracing_session,
+                                std::vector<TracePacket>* packets);
+
+  // Appends to `*packets` the service-generated packets that follow the
+  // contents of the buffers, once they have been fully read.
+  void EmitPacketsAfterBuffers(TracingSession* tracing_session,
+                               std::vector<TracePacket>* packets);
+
+  // Maximum size of the trusted fields appended to each packet read from a
+  // buffer.
+  static constexpr size_t kMaxTrustedFieldsSize = 32;
+
+  // Reads the next valid packet from `*tbuf` into `*packet`, skipping (and
+  // accounting for) the invalid ones. On success, encodes the trusted fields
+  // that must be appended to the packet into `trusted_fields`, which must be
+  // at least kMaxTrustedFieldsSize bytes long, and stores their size into
+  // `*trusted_fields_size`. Returns false when there are no more packets.
+  bool ReadNextValidPacket(TracingSession* tracing_session,
+                           TraceBuffer* tbuf,
+                           TracePacket* packet,
+                           uint8_t* trusted_fields,
+                           size_t* trusted_fields_size);
+
   // If `*tracing_session` has a filter, applies it to `*packets`. Doesn't
   // change the number of `*packets`, only their content.
   void MaybeFilterPackets(TracingSession* tracing_session,
@@ -763,6 +806,30 @@ class TracingServiceImpl : public TracingService {
   // been an error), false otherwise.
   bool WriteIntoFile(TracingSession* tracing_session,
                      std::vector<TracePacket> packets);
+
+  // Like ReadBuffers() followed by WriteIntoFile(), but streams the packets
+  // directly from the buffers into the file, without retaining nor copying
+  // them. Can be used only if no filtering nor compression is required.
+  //
+  // Returns true if the file should be closed (because it's full or there has
+  // been an error), false otherwise.
+  bool WriteBuffersIntoFile(TracingSession* tracing_session);
+
+  // Like ReadBuffers() followed by WriteIntoFile(), but hands over the packets
+  // to the `file_writer` thread of `*tracing_session`. Reads only as much data
+  // as it fits in its queue, unless `write_period_ms` is 0 (i.e. this is the
+  // last read), in which case the buffers are read in full regardless of the
+  // queue size. Sets `*queue_full` if it left data in the buffers. Never
+  // waits for the writer thread.
+  //
+  // Returns true if the file should be closed (because it's full or there has
+  // been an error), false otherwise.
+  bool QueueBuffersIntoFileWriter(TracingSession* tracing_session,
+                                  bool* queue_full);
+
+  // Closes the trace file of the session once its `file_writer` has written
+  // all the data queued to it.
+  void OnFileWriterFinished(TracingSessionID);
   void OnStartTriggersTimeout(TracingSessionID tsid);
   void MaybeLogUploadEvent(const TraceConfig&,
                            const base::Uuid&,
@@ -804,6 +871,8 @@ class TracingServiceImpl : public TracingService {
   bool smb_scraping_enabled_ = false;
   bool lockdown_mode_ = false;
   uint32_t min_write_period_ms_ = 100;       // Overridable for testing.
+  size_t max_file_writer_pending_bytes_ =    // Overridable for testing.
+      kMaxFileWriterPendingBytes;
   int64_t trigger_window_ns_ = kOneDayInNs;  // Overridable for testing.
 
   std::minstd_rand trigger_probability_rand_;
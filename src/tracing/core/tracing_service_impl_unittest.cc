@@ -18,7 +18,10 @@
 
 #include <string.h>
 
+#include <thread>
+
 #include "perfetto/ext/base/file_utils.h"
+#include "perfetto/ext/base/pipe.h"
 #include "perfetto/ext/base/string_utils.h"
 #include "perfetto/ext/base/temp_file.h"
 #include "perfetto/ext/base/utils.h"
@@ -54,6 +57,11 @@
 #include "src/tracing/core/zlib_compressor.h"
 #endif
 
+#if PERFETTO_BUILDFLAG(PERFETTO_ZSTD)
+#include <zstd.h>
+#include "src/tracing/core/zstd_compressor.h"
+#endif
+
 using ::testing::_;
 using ::testing::AssertionFailure;
 using ::testing::AssertionResult;
@@ -155,6 +163,24 @@ std::vector<protos::gen::TracePacket> DecompressTrace(
 }
 #endif  // PERFETTO_BUILDFLAG(PERFETTO_ZLIB)
 
+#if PERFETTO_BUILDFLAG(PERFETTO_ZSTD)
+std::string ZstdDecompress(const std::string& data) {
+  uint8_t out[1024];
+  ZSTD_DCtx* ctx = ZSTD_createDCtx();
+  ZSTD_inBuffer in{data.data(), data.size(), 0};
+  std::string s;
+  size_t ret;
+  do {
+    ZSTD_outBuffer out_buf{out, sizeof(out), 0};
+    ret = ZSTD_decompressStream(ctx, &out_buf, &in);
+    EXPECT_FALSE(ZSTD_isError(ret));
+    s.append(reinterpret_cast<char*>(out), out_buf.pos);
+  } while (ret != 0 && !ZSTD_isError(ret));
+  ZSTD_freeDCtx(ctx);
+  return s;
+}
+#endif  // PERFETTO_BUILDFLAG(PERFETTO_ZSTD)
+
 }  // namespace
 
 class TracingServiceImplTest : public testing::Test {
@@ -267,6 +293,12 @@ class TracingServiceImplTest : public testing::Test {
     svc->trigger_rnd_override_for_testing_ = number;
   }
 
+  void SetMaxFileWriterPendingBytes(size_t bytes) {
+    svc->max_file_writer_pending_bytes_ = bytes;
+  }
+
+  TraceStats GetTraceStats() { return svc->GetTraceStats(tracing_session()); }
+
   base::TestTaskRunner task_runner;
   std::unique_ptr<TracingServiceImpl> svc;
 };
@@ -2131,6 +2163,71 @@ TEST_F(TracingServiceImplTest, CloneSessionWithCompression) {
 
 #endif  // PERFETTO_BUILDFLAG(PERFETTO_ZLIB)
 
+#if PERFETTO_BUILDFLAG(PERFETTO_ZSTD)
+TEST_F(TracingServiceImplTest, CompressionZstdReadIpc) {
+  TracingService::InitOpts init_opts;
+  init_opts.zstd_compressor_fn = ZstdCompressFn;
+  InitializeSvcWithOpts(init_opts);
+
+  std::unique_ptr<MockConsumer> consumer = CreateMockConsumer();
+  consumer->Connect(svc.get());
+
+  std::unique_ptr<MockProducer> producer = CreateMockProducer();
+  producer->Connect(svc.get(), "mock_producer");
+  producer->RegisterDataSource("data_source");
+
+  TraceConfig trace_config;
+  trace_config.add_buffers()->set_size_kb(4096);
+  auto* ds_config = trace_config.add_data_sources()->mutable_config();
+  ds_config->set_name("data_source");
+  ds_config->set_target_buffer(0);
+  trace_config.set_compression_type(TraceConfig::COMPRESSION_TYPE_ZSTD);
+  consumer->EnableTracing(trace_config);
+
+  producer->WaitForTracingSetup();
+  producer->WaitForDataSourceSetup("data_source");
+  producer->WaitForDataSourceStart("data_source");
+
+  std::unique_ptr<TraceWriter> writer =
+      producer->CreateTraceWriter("data_source");
+  {
+    auto tp = writer->NewTracePacket();
+    tp->set_for_testing()->set_str("payload-1");
+  }
+  {
+    auto tp = writer->NewTracePacket();
+    tp->set_for_testing()->set_str("payload-2");
+  }
+
+  writer->Flush();
+  writer.reset();
+
+  consumer->DisableTracing();
+  producer->WaitForDataSourceStop("data_source");
+  consumer->WaitForTracingDisabled();
+
+  std::vector<protos::gen::TracePacket> compressed_packets =
+      consumer->ReadBuffers();
+  EXPECT_THAT(compressed_packets, Not(IsEmpty()));
+  std::vector<protos::gen::TracePacket> decompressed_packets;
+  for (const protos::gen::TracePacket& c : compressed_packets) {
+    ASSERT_THAT(c.compressed_packets(), Not(IsEmpty()));
+    protos::gen::Trace t;
+    ASSERT_TRUE(t.ParseFromString(ZstdDecompress(c.compressed_packets())));
+    decompressed_packets.insert(decompressed_packets.end(), t.packet().begin(),
+                                t.packet().end());
+  }
+  EXPECT_THAT(decompressed_packets,
+              Contains(Property(
+                  &protos::gen::TracePacket::for_testing,
+                  Property(&protos::gen::TestEvent::str, Eq("payload-1")))));
+  EXPECT_THAT(decompressed_packets,
+              Contains(Property(
+                  &protos::gen::TracePacket::for_testing,
+                  Property(&protos::gen::TestEvent::str, Eq("payload-2")))));
+}
+#endif  // PERFETTO_BUILDFLAG(PERFETTO_ZSTD)
+
 // Note: file_write_period_ms is set to a large enough to have exactly one flush
 // of the tracing buffers (and therefore at most one synchronization section),
 // unless the test runs unrealistically slowly, or the implementation of the
@@ -2265,6 +2362,94 @@ TEST_F(TracingServiceImplTest, WriteIntoFileWithPath) {
                   Property(&protos::gen::TestEvent::str, Eq("payload")))));
 }
 
+// Checks that, with async_write_into_file, an output file that doesn't keep up
+// (here a pipe that nobody reads from for a while) doesn't stall the service,
+// and that all the data is written once the file catches up.
+TEST_F(TracingServiceImplTest, AsyncWriteIntoFileWithSlowFd) {
+  TracingService::InitOpts init_opts;
+  init_opts.async_write_into_file = true;
+  InitializeSvcWithOpts(init_opts);
+  SetMaxFileWriterPendingBytes(4096);
+
+  std::unique_ptr<MockConsumer> consumer = CreateMockConsumer();
+  consumer->Connect(svc.get());
+
+  std::unique_ptr<MockProducer> producer = CreateMockProducer();
+  producer->Connect(svc.get(), "mock_producer");
+  producer->RegisterDataSource("data_source");
+
+  TraceConfig trace_config;
+  trace_config.add_buffers()->set_size_kb(4096);
+  auto* ds_config = trace_config.add_data_sources()->mutable_config();
+  ds_config->set_name("data_source");
+  ds_config->set_target_buffer(0);
+  trace_config.set_write_into_file(true);
+  trace_config.set_file_write_period_ms(1);
+  base::Pipe pipe = base::Pipe::Create();
+  consumer->EnableTracing(trace_config, std::move(pipe.wr));
+
+  producer->WaitForTracingSetup();
+  producer->WaitForDataSourceSetup("data_source");
+  producer->WaitForDataSourceStart("data_source");
+
+  // Write way more data than what the pipe and the queue of the writer thread
+  // can hold.
+  static const size_t kNumTestPackets = 200;
+  const std::string payload(1024, 'x');
+  std::unique_ptr<TraceWriter> writer =
+      producer->CreateTraceWriter("data_source");
+  for (size_t i = 0; i < kNumTestPackets; i++) {
+    auto tp = writer->NewTracePacket();
+    tp->set_for_testing()->set_str(payload);
+  }
+  writer->Flush();
+  writer.reset();
+
+  // The service keeps running its periodic file writes without blocking, and
+  // notices that the queue is full.
+  for (int i = 0; tracing_session()->file_writer_queue_full_events == 0; i++) {
+    auto checkpoint_name = "wait_queue_full_" + std::to_string(i);
+    auto timer_expired = task_runner.CreateCheckpoint(checkpoint_name);
+    task_runner.PostDelayedTask([timer_expired] { timer_expired(); }, 1);
+    task_runner.RunUntilCheckpoint(checkpoint_name);
+  }
+
+  // Now drain the pipe, until the service closes the file.
+  std::string trace_raw;
+  std::thread reader([&trace_raw, &pipe] {
+    char buf[4096];
+    for (;;) {
+      ssize_t rsize = PERFETTO_EINTR(read(*pipe.rd, buf, sizeof(buf)));
+      if (rsize <= 0)
+        break;
+      trace_raw.append(buf, static_cast<size_t>(rsize));
+    }
+  });
+
+  consumer->DisableTracing();
+  producer->WaitForDataSourceStop("data_source");
+  consumer->WaitForTracingDisabled();
+  reader.join();
+
+  protos::gen::Trace trace;
+  ASSERT_TRUE(trace.ParseFromString(trace_raw));
+  size_t num_test_packets = 0;
+  for (const protos::gen::TracePacket& packet : trace.packet()) {
+    if (packet.has_for_testing()) {
+      EXPECT_EQ(packet.for_testing().str(), payload);
+      num_test_packets++;
+    }
+  }
+  EXPECT_EQ(num_test_packets, kNumTestPackets);
+
+  TraceStats trace_stats = GetTraceStats();
+  const auto& file_stats = trace_stats.write_into_file_stats();
+  EXPECT_GT(file_stats.queue_full_events(), 0u);
+  EXPECT_GT(file_stats.max_pending_bytes(), 0u);
+  EXPECT_EQ(file_stats.bytes_written(), trace_raw.size());
+  EXPECT_EQ(file_stats.bytes_queued(), trace_raw.size());
+}
+
 TEST_F(TracingServiceImplTest, WriteIntoFileFilterMultipleChunks) {
   static const size_t kNumTestPackets = 5;
   static const size_t kPayloadSize = 500 * 1024UL;
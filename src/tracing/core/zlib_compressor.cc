@@ -24,36 +24,12 @@
 
 #include "protos/perfetto/trace/trace.pbzero.h"
 #include "protos/perfetto/trace/trace_packet.pbzero.h"
+#include "src/tracing/core/packet_compressor_utils.h"
 
 namespace perfetto {
 
 namespace {
 
-struct Preamble {
-  uint32_t size;
-  std::array<uint8_t, 16> buf;
-};
-
-template <uint32_t id>
-Preamble GetPreamble(size_t sz) {
-  Preamble preamble;
-  uint8_t* ptr = preamble.buf.data();
-  constexpr uint32_t tag = protozero::proto_utils::MakeTagLengthDelimited(id);
-  ptr = protozero::proto_utils::WriteVarInt(tag, ptr);
-  ptr = protozero::proto_utils::WriteVarInt(sz, ptr);
-  preamble.size =
-      static_cast<uint32_t>(reinterpret_cast<uintptr_t>(ptr) -
-                            reinterpret_cast<uintptr_t>(preamble.buf.data()));
-  PERFETTO_DCHECK(preamble.size < preamble.buf.size());
-  return preamble;
-}
-
-Slice PreambleToSlice(const Preamble& preamble) {
-  Slice slice = Slice::Allocate(preamble.size);
-  memcpy(slice.own_data(), preamble.buf.data(), preamble.size);
-  return slice;
-}
-
 // A compressor for `TracePacket`s that uses zlib. The class is exposed for
 // testing.
 class ZlibPacketCompressor {
@@ -95,8 +71,9 @@ void ZlibPacketCompressor::PushPacket(const TracePacket& packet) {
   // We need to be able to tokenize packets in the compressed stream, so we
   // prefix a proto preamble to each packet. The compressed stream looks like a
   // valid Trace proto.
-  Preamble preamble =
-      GetPreamble<protos::pbzero::Trace::kPacketFieldNumber>(packet.size());
+  PacketPreamble preamble =
+      GetPacketPreamble<protos::pbzero::Trace::kPacketFieldNumber>(
+          packet.size());
   PushData(preamble.buf.data(), preamble.size);
   for (const Slice& slice : packet.slices()) {
     PushData(slice.start, static_cast<uint32_t>(slice.size));
@@ -127,8 +104,9 @@ TracePacket ZlibPacketCompressor::Finish() {
   PushCurSlice();
 
   TracePacket packet;
-  packet.AddSlice(PreambleToSlice(
-      GetPreamble<protos::pbzero::TracePacket::kCompressedPacketsFieldNumber>(
+  packet.AddSlice(PacketPreambleToSlice(
+      GetPacketPreamble<
+          protos::pbzero::TracePacket::kCompressedPacketsFieldNumber>(
           total_new_slices_size_)));
   for (auto& slice : new_slices_) {
     packet.AddSlice(std::move(slice));
@@ -154,6 +154,200 @@ class Parsing(TestSuite):
         """,
         out=Path('sched_waking_instants_compact_sched.out'))
 
+  # Decoding of other events in the generic compact encoding
+  # (CompactSched.event_columns).
+  def test_compact_sched_event_columns(self):
+    return DiffTestBlueprint(
+        trace=TextProto(r"""
+        packet {
+          ftrace_events {
+            cpu: 1
+            compact_sched {
+              event_columns {
+                event_field_id: 11
+                timestamp: 1000
+                timestamp: 100
+                pid: 0
+                pid: 0
+                column {
+                  field_id: 1
+                  value: 500000
+                  value: 800000
+                }
+                column {
+                  field_id: 2
+                  value: 1
+                  value: 1
+                }
+              }
+              event_columns {
+                event_field_id: 36
+                timestamp: 1050
+                timestamp: 20
+                pid: 0
+                pid: 0
+                column {
+                  field_id: 1
+                  value: 3
+                  value: 5
+                }
+                column {
+                  field_id: 2
+                  value: 0
+                  interned_string: true
+                  omitted_event: 1
+                }
+              }
+              event_columns {
+                event_field_id: 37
+                timestamp: 1060
+                timestamp: 20
+                pid: 0
+                pid: 0
+                column {
+                  field_id: 1
+                  value: 3
+                  value: 5
+                }
+                column {
+                  field_id: 2
+                  value: 1
+                  value: 0
+                }
+              }
+              event_columns {
+                event_field_id: 113
+                timestamp: 1200
+                pid: 42
+                column {
+                  field_id: 2
+                  value: 0
+                }
+              }
+              event_intern_table: "arch_timer"
+            }
+          }
+        }
+        """),
+        query="""
+        SELECT
+          ts,
+          ftrace_event.cpu,
+          ftrace_event.name,
+          tid,
+          EXTRACT_ARG(arg_set_id, 'state') AS state,
+          EXTRACT_ARG(arg_set_id, 'irq') AS irq,
+          EXTRACT_ARG(arg_set_id, 'name') AS irq_name,
+          EXTRACT_ARG(arg_set_id, 'ret') AS ret
+        FROM ftrace_event
+        JOIN thread USING (utid)
+        ORDER BY ts;
+        """,
+        out=Csv("""
+        "ts","cpu","name","tid","state","irq","irq_name","ret"
+        1000,1,"cpu_frequency",0,500000,"[NULL]","[NULL]","[NULL]"
+        1050,1,"irq_handler_entry",0,"[NULL]",3,"arch_timer","[NULL]"
+        1060,1,"irq_handler_exit",0,"[NULL]",3,"[NULL]",1
+        1070,1,"irq_handler_entry",0,"[NULL]",5,"[NULL]","[NULL]"
+        1080,1,"irq_handler_exit",0,"[NULL]",5,"[NULL]",0
+        1100,1,"cpu_frequency",0,800000,"[NULL]","[NULL]","[NULL]"
+        """))
+
+  def test_compact_sched_event_columns_parsed(self):
+    return DiffTestBlueprint(
+        trace=TextProto(r"""
+        packet {
+          ftrace_events {
+            cpu: 1
+            compact_sched {
+              event_columns {
+                event_field_id: 11
+                timestamp: 1000
+                timestamp: 100
+                pid: 0
+                pid: 0
+                column {
+                  field_id: 1
+                  value: 500000
+                  value: 800000
+                }
+                column {
+                  field_id: 2
+                  value: 1
+                  value: 1
+                }
+              }
+              event_columns {
+                event_field_id: 36
+                timestamp: 1050
+                timestamp: 20
+                pid: 0
+                pid: 0
+                column {
+                  field_id: 1
+                  value: 3
+                  value: 5
+                }
+                column {
+                  field_id: 2
+                  value: 0
+                  interned_string: true
+                  omitted_event: 1
+                }
+              }
+              event_columns {
+                event_field_id: 37
+                timestamp: 1060
+                timestamp: 20
+                pid: 0
+                pid: 0
+                column {
+                  field_id: 1
+                  value: 3
+                  value: 5
+                }
+                column {
+                  field_id: 2
+                  value: 1
+                  value: 0
+                }
+              }
+              event_columns {
+                event_field_id: 113
+                timestamp: 1200
+                pid: 42
+                column {
+                  field_id: 2
+                  value: 0
+                }
+              }
+              event_intern_table: "arch_timer"
+            }
+          }
+        }
+        """),
+        query="""
+        SELECT ts, name, dur AS value, EXTRACT_ARG(arg_set_id, 'ret') AS ret
+        FROM slice
+        UNION ALL
+        SELECT ts, cpu_counter_track.name, value, NULL
+        FROM counter
+        JOIN cpu_counter_track ON counter.track_id = cpu_counter_track.id
+        UNION ALL
+        SELECT NULL, name, value, NULL
+        FROM stats
+        WHERE name = 'compact_ftrace_event_unsupported'
+        ORDER BY ts;
+        """,
+        out=Csv("""
+        "ts","name","value","ret"
+        "[NULL]","compact_ftrace_event_unsupported",1,"[NULL]"
+        1000,"cpufreq",500000.000000,"[NULL]"
+        1050,"IRQ (arch_timer)",10,"handled"
+        1070,"IRQ ()",10,"unhandled"
+        1100,"cpufreq",800000.000000,"[NULL]"
+        """))
+
   # Mm Event
   def test_mm_event(self):
     return DiffTestBlueprint(